@@ -0,0 +1,201 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "ConcurrentAssetHeap.h"
+#include <algorithm>
+#include <functional>
+#include <thread>
+
+namespace AssetsNew
+{
+	unsigned EpochReclaimer::Pin()
+	{
+		// Claim a free slot, starting from a per-thread position so that threads don't usually contend on the same slots
+		static thread_local unsigned s_slotHint = unsigned(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+		for (;;) {
+			for (unsigned c=0; c<s_slotCount; ++c) {
+				auto slot = (s_slotHint + c) % s_slotCount;
+				uint64_t expected = 0;
+				auto epoch = _globalEpoch.load();
+				if (!_slots[slot]._epoch.compare_exchange_strong(expected, epoch))
+					continue;
+
+				// If the global epoch moved while we were pinning, TryAdvanceAlreadyLocked() may not have seen our
+				// slot. Keep republishing until we're pinned at the current epoch
+				for (;;) {
+					auto current = _globalEpoch.load();
+					if (current == epoch) break;
+					epoch = current;
+					_slots[slot]._epoch.store(epoch);
+				}
+
+				s_slotHint = slot;
+				return slot;
+			}
+			// All slots in use. Guards are only held for the duration of a lookup, so this can only happen when
+			// there are more threads than slots looking things up at the same moment; one will free up shortly
+			std::this_thread::yield();
+		}
+	}
+
+	void EpochReclaimer::Unpin(unsigned slot)
+	{
+		assert(slot < s_slotCount);
+		_slots[slot]._epoch.store(0);
+	}
+
+	bool EpochReclaimer::TryAdvanceAlreadyLocked()
+	{
+		// We can only move to the next epoch once every pinned reader has observed the current one
+		auto epoch = _globalEpoch.load();
+		for (unsigned c=0; c<s_slotCount; ++c) {
+			auto e = _slots[c]._epoch.load();
+			if (e != 0 && e != epoch)
+				return false;
+		}
+		return _globalEpoch.compare_exchange_strong(epoch, epoch+1);
+	}
+
+	void EpochReclaimer::Retire(void* object, void (*deleter)(void*))
+	{
+		bool reclaim;
+		{
+			ScopedLock(_retiredLock);
+			_retired.push_back(Retired{object, deleter, _globalEpoch.load()});
+			reclaim = _retired.size() >= s_reclaimThreshold;
+		}
+		if (reclaim)
+			Reclaim();
+	}
+
+	void EpochReclaimer::Reclaim()
+	{
+		std::vector<Retired> toDelete;
+		{
+			ScopedLock(_retiredLock);
+			TryAdvanceAlreadyLocked();
+			auto epoch = _globalEpoch.load();
+			auto i = std::partition(
+				_retired.begin(), _retired.end(),
+				[epoch](const Retired& r) { return (r._epoch + 2) > epoch; });
+			toDelete.insert(toDelete.end(), i, _retired.end());
+			_retired.erase(i, _retired.end());
+		}
+		// run deleters outside of the lock, since they can be expensive (ie, destroying assets)
+		for (const auto& r:toDelete)
+			(*r._deleter)(r._object);
+	}
+
+	size_t EpochReclaimer::GetRetiredCount()
+	{
+		ScopedLock(_retiredLock);
+		return _retired.size();
+	}
+
+	EpochReclaimer::EpochReclaimer()
+	{
+		for (auto& s:_slots) s._epoch.store(0);
+		_globalEpoch.store(1);
+	}
+
+	EpochReclaimer::~EpochReclaimer()
+	{
+		#if defined(_DEBUG)
+			for (auto& s:_slots) assert(s._epoch.load() == 0);		// guard outlived the reclaimer
+		#endif
+		for (const auto& r:_retired)
+			(*r._deleter)(r._object);
+	}
+
+	EpochReclaimer::Guard::Guard(EpochReclaimer& reclaimer)
+	: _reclaimer(&reclaimer), _slot(reclaimer.Pin())
+	{}
+
+	EpochReclaimer::Guard::~Guard()
+	{
+		if (_reclaimer) _reclaimer->Unpin(_slot);
+	}
+
+	EpochReclaimer::Guard::Guard(Guard&& moveFrom) never_throws
+	: _reclaimer(moveFrom._reclaimer), _slot(moveFrom._slot)
+	{
+		moveFrom._reclaimer = nullptr;
+		moveFrom._slot = ~0u;
+	}
+
+	auto EpochReclaimer::Guard::operator=(Guard&& moveFrom) never_throws -> Guard&
+	{
+		if (this != &moveFrom) {
+			if (_reclaimer) _reclaimer->Unpin(_slot);
+			_reclaimer = moveFrom._reclaimer;
+			_slot = moveFrom._slot;
+			moveFrom._reclaimer = nullptr;
+			moveFrom._slot = ~0u;
+		}
+		return *this;
+	}
+
+///////////////////////////////////////////////////////////////////////////
+
+	auto ConcurrentAssetHeap::FindTable(uint64_t typeCode) const -> TableBase*
+	{
+		// Tables are never removed, so a null slot terminates the probe
+		auto idx = unsigned(typeCode ^ (typeCode >> 32ull)) % s_typeSlotCount;
+		for (unsigned c=0; c<s_typeSlotCount; ++c) {
+			auto* table = _typeSlots[idx].load(std::memory_order_acquire);
+			if (expect_evaluation(table && table->_typeCode == typeCode, true)) return table;
+			if (!table) return nullptr;
+			idx = (idx+1) % s_typeSlotCount;
+		}
+		return nullptr;
+	}
+
+	auto ConcurrentAssetHeap::InstallTable(std::unique_ptr<TableBase>&& table) -> TableBase*
+	{
+		auto typeCode = table->_typeCode;
+		auto idx = unsigned(typeCode ^ (typeCode >> 32ull)) % s_typeSlotCount;
+		for (unsigned c=0; c<s_typeSlotCount; ++c) {
+			TableBase* expected = nullptr;
+			if (_typeSlots[idx].compare_exchange_strong(expected, table.get(), std::memory_order_acq_rel))
+				return table.release();
+			if (expected->_typeCode == typeCode)
+				return expected;		// another thread installed a table for this type first
+			idx = (idx+1) % s_typeSlotCount;
+		}
+		Throw(std::runtime_error("ConcurrentAssetHeap ran out of type slots"));
+	}
+
+	auto ConcurrentAssetHeap::VisibilityBarrier() -> VisibilityMarkerId
+	{
+		ScopedLock(_barrierLock);
+		auto barrier = _lastVisibilityMarker.load()+1;
+		for (unsigned c=0; c<s_typeSlotCount; ++c)
+			if (auto* table = _typeSlots[c].load(std::memory_order_acquire))
+				table->CompletePending(barrier);
+		_lastVisibilityMarker.store(barrier);
+		_reclaimer.Reclaim();
+		return barrier;
+	}
+
+	ConcurrentAssetHeap::ConcurrentAssetHeap()
+	{
+		_typeSlots = std::make_unique<std::atomic<TableBase*>[]>(s_typeSlotCount);
+		for (unsigned c=0; c<s_typeSlotCount; ++c) _typeSlots[c].store(nullptr, std::memory_order_relaxed);
+		_lastVisibilityMarker.store(0);
+	}
+
+	ConcurrentAssetHeap::~ConcurrentAssetHeap()
+	{
+		for (unsigned c=0; c<s_typeSlotCount; ++c) {
+			auto* table = _typeSlots[c].load();
+			#if defined(_DEBUG)
+				// References can't outlive the heap (see ConcurrentAssetHeap::Reference)
+				assert(!table || table->_liveReferences.load() == 0);
+			#endif
+			delete table;
+		}
+	}
+
+	ConcurrentAssetHeap::TableBase::~TableBase() = default;
+}
@@ -0,0 +1,752 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "AssetTraits.h"
+#include "AssetsCore.h"
+#include "DepVal.h"
+#include "Marker.h"
+#include "InitializerPack.h"
+#include "../Utility/Threading/CompletionThreadPool.h"
+#include "../Utility/Threading/Mutex.h"
+#include "../Utility/MemoryUtils.h"
+#include "../Core/Prefix.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace AssetsNew
+{
+	/// <summary>Epoch based reclamation for objects read by lock free readers</summary>
+	///
+	/// Readers hold a Guard for as long as they might be using pointers to shared objects. Writers that
+	/// unlink an object pass it to Retire(), and it will only be destroyed once every Guard that might
+	/// have seen it has been released (ie, once the global epoch has advanced twice since it was retired).
+	///
+	/// Creating and releasing a Guard is lock free. Retire() and Reclaim() take a mutex, but are only
+	/// called by writers. There are a fixed number of reader slots, so guards should only be held for the
+	/// duration of a lookup; anything that needs to outlive that should take a reference count on the
+	/// object it found (see ConcurrentAssetHeap::Reference).
+	class EpochReclaimer
+	{
+	public:
+		class Guard
+		{
+		public:
+			explicit operator bool() const { return _reclaimer != nullptr; }
+
+			Guard() = default;
+			explicit Guard(EpochReclaimer& reclaimer);
+			~Guard();
+			Guard(Guard&&) never_throws;
+			Guard& operator=(Guard&&) never_throws;
+		private:
+			EpochReclaimer* _reclaimer = nullptr;
+			unsigned _slot = ~0u;
+		};
+
+		void Retire(void* object, void (*deleter)(void*));
+		void Reclaim();
+
+		uint64_t GetEpoch() const { return _globalEpoch.load(); }
+		size_t GetRetiredCount();
+
+		EpochReclaimer();
+		~EpochReclaimer();
+		EpochReclaimer(const EpochReclaimer&) = delete;
+		EpochReclaimer& operator=(const EpochReclaimer&) = delete;
+
+	private:
+		static constexpr unsigned s_slotCount = 256;
+		static constexpr size_t s_reclaimThreshold = 128;
+		struct alignas(64) Slot { std::atomic<uint64_t> _epoch; };
+		Slot _slots[s_slotCount];
+		alignas(64) std::atomic<uint64_t> _globalEpoch;
+
+		struct Retired { void* _object; void (*_deleter)(void*); uint64_t _epoch; };
+		std::mutex _retiredLock;
+		std::vector<Retired> _retired;
+
+		unsigned Pin();
+		void Unpin(unsigned slot);
+		bool TryAdvanceAlreadyLocked();
+	};
+
+	/// <summary>Variation of AssetHeap for heavily concurrent access</summary>
+	///
+	/// Differs from AssetHeap in a few important ways:
+	/// <list>
+	///   <item>Per-type tables are found via a fixed hash slot (keyed on TypeHashCode<>), without taking any locks</item>
+	///   <item>Lookups by IdentifierCode are lock free. Entries are immutable once published; changes (including
+	///		completion of a pending future) publish a new entry and retire the old one via the EpochReclaimer</item>
+	///   <item>A Reference doesn't hold a lock (or pin the reclaimer); it's a reference counted handle to the
+	///		entry it was created from. So long lived references never block Insert() or Erase(), or delay the
+	///		reclamation of other entries. They will just see the state of the heap at the time they looked.
+	///		However, a Reference must not outlive the heap it came from (StallWhilePending() goes back to the
+	///		table); debug builds assert on this in ~ConcurrentAssetHeap()</item>
+	///   <item>Futures aren't watched individually. Instead each table keeps a list of pending futures, and
+	///		VisibilityBarrier() polls them and publishes all completions for a table in a single batch</item>
+	/// </list>
+	///
+	/// Writes to the same table are serialized by a mutex for that table (but never block readers).
+	class ConcurrentAssetHeap
+	{
+	public:
+		using IdentifierCode = uint64_t;
+		using VisibilityMarkerId = uint64_t;
+		T1(Type) class Reference;
+
+		T1(Type) void Insert(IdentifierCode, std::string initializer, std::shared_future<Type>&&);
+		T1(Type) void Insert(IdentifierCode, std::string initializer, std::future<Type>&&);
+		T1(Type) void Insert(IdentifierCode, std::string initializer, Type&&);
+		T1(Type) bool Erase(IdentifierCode);
+
+		/// Inserts only if the entry for the given id is still the one referenced by "expected" (or if there is
+		/// no entry for the id, when "expected" is empty). Returns false if another thread got there first
+		T1(Type) bool CompareAndInsert(IdentifierCode, const Reference<Type>& expected, std::string initializer, std::shared_future<Type>&&);
+
+		T1(Type) Reference<Type> Lookup(IdentifierCode) const;
+
+		/// Calls "fn" with a Reference<Type> for every entry in the table for "Type". Doesn't block writers;
+		/// entries inserted or erased during the iteration may or may not be visited
+		template<typename Type, typename Fn> void ForEach(Fn&& fn) const;
+		T1(Type) size_t GetCount() const;
+
+		VisibilityMarkerId VisibilityBarrier();
+		EpochReclaimer& GetReclaimer() { return _reclaimer; }
+
+		ConcurrentAssetHeap();
+		~ConcurrentAssetHeap();
+		ConcurrentAssetHeap(const ConcurrentAssetHeap&) = delete;
+		ConcurrentAssetHeap& operator=(const ConcurrentAssetHeap&) = delete;
+
+	private:
+		class TableBase
+		{
+		public:
+			const uint64_t _typeCode;
+			virtual void CompletePending(VisibilityMarkerId barrier) = 0;
+			TableBase(uint64_t typeCode) : _typeCode(typeCode) {}
+			virtual ~TableBase();
+
+			#if defined(_DEBUG)
+				mutable std::atomic<unsigned> _liveReferences{0};		// References pointing at this table, to catch any that outlive the heap
+				static void AddTableRef(const TableBase* table) { if (table) table->_liveReferences.fetch_add(1, std::memory_order_relaxed); }
+				static void ReleaseTableRef(const TableBase* table) { if (table) table->_liveReferences.fetch_sub(1, std::memory_order_relaxed); }
+			#else
+				static void AddTableRef(const TableBase*) {}
+				static void ReleaseTableRef(const TableBase*) {}
+			#endif
+		};
+		T1(Type) class Table;
+
+		static constexpr unsigned s_typeSlotCount = 256;
+		std::unique_ptr<std::atomic<TableBase*>[]> _typeSlots;
+		mutable EpochReclaimer _reclaimer;
+		std::mutex _barrierLock;
+		std::atomic<VisibilityMarkerId> _lastVisibilityMarker;
+
+		TableBase* FindTable(uint64_t typeCode) const;
+		TableBase* InstallTable(std::unique_ptr<TableBase>&& table);
+		T1(Type) Table<Type>* FindTable() const { return static_cast<Table<Type>*>(FindTable(TypeHashCode<Type>)); }
+		T1(Type) Table<Type>& FindOrCreateTable();
+	};
+
+	T1(Type) class ConcurrentAssetHeap::Table : public TableBase
+	{
+	public:
+		struct Record
+		{
+			IdentifierCode _id = 0;
+			unsigned _valIdx = 0;			// incremented each time the entry for this id is replaced by Insert()
+			::Assets::AssetState _state = ::Assets::AssetState::Pending;
+			VisibilityMarkerId _visibilityBarrier = ~VisibilityMarkerId(0);
+			std::shared_future<Type> _future;
+			std::optional<Type> _completed;
+			::Assets::Blob _actualizationLog;
+			::Assets::DependencyValidation _depVal;
+			std::string _initializer;
+			mutable std::atomic<unsigned> _refCount{1};		// the table holds one reference while the record is published
+		};
+
+		struct Buckets
+		{
+			std::unique_ptr<std::atomic<Record*>[]> _slots;
+			size_t _mask = 0;
+		};
+
+		const Record* Find(IdentifierCode id) const;
+		template<typename Fn> void ForEach(Fn&& fn) const;
+
+		/// Finds the record for an id and adds a reference to it. The caller must call Release() when done
+		const Record* Acquire(IdentifierCode id) const;
+		void AcquireAll(std::vector<Reference<Type>>& result);
+		static void AddRef(const Record* record) { record->_refCount.fetch_add(1, std::memory_order_relaxed); }
+		static void Release(const Record* record);
+		size_t GetCount() const { return _liveCount.load(std::memory_order_relaxed); }
+
+		unsigned Publish(std::unique_ptr<Record>&& record);
+		bool CompareAndPublish(const Record* expected, std::unique_ptr<Record>&& record);
+		bool Erase(IdentifierCode id);
+
+		/// Wait for a pending entry to complete, and publish the result immediately (rather than waiting for the next VisibilityBarrier)
+		void CompleteImmediately(const Record& record, std::shared_future<Type> future);
+		void CompletePending(VisibilityMarkerId barrier) override;
+
+		Table(EpochReclaimer& reclaimer);
+		~Table();
+
+	private:
+		std::atomic<Buckets*> _buckets;
+		std::atomic<size_t> _liveCount;
+		EpochReclaimer* _reclaimer;
+
+		// _writeLock protects everything below, and is held while modifying the contents of _buckets
+		std::mutex _writeLock;
+		size_t _usedSlots = 0;		// includes tombstones
+		struct PendingEntry { IdentifierCode _id; unsigned _valIdx; std::shared_future<Type> _future; };
+		std::vector<PendingEntry> _newlyPending;
+
+		std::vector<PendingEntry> _pending;		// only accessed from CompletePending(), which is serialized by the heap
+
+		static Record* Tombstone() { return reinterpret_cast<Record*>(uintptr_t(1)); }
+		static size_t HashSlot(IdentifierCode id) { return size_t((id ^ (id >> 31ull)) * 0x9e3779b97f4a7c15ull >> 16ull); }
+		std::atomic<Record*>* FindSlotAlreadyLocked(IdentifierCode id);
+		void InsertNewAlreadyLocked(Record* record);
+		void PublishAlreadyLocked(std::atomic<Record*>* slot, std::unique_ptr<Record>&& record);
+		void ReplaceIfPendingAlreadyLocked(const PendingEntry& entry, std::unique_ptr<Record>&& completed);
+		static std::unique_ptr<Record> BuildCompletedRecord(const Record& pending, const std::shared_future<Type>& future, VisibilityMarkerId barrier);
+	};
+
+	/// References keep the entry they refer to alive, but not the heap. They must be released before the
+	/// ConcurrentAssetHeap is destroyed
+	T1(Type) class ConcurrentAssetHeap::Reference
+	{
+	public:
+		IdentifierCode Id() const { assert(_record); return _record->_id; }
+		::Assets::AssetState GetState() const { assert(_record); return _record->_state; }
+		const std::string& GetInitializer() const { assert(_record); return _record->_initializer; }
+		const ::Assets::Blob& GetActualizationLog() const { assert(_record); return _record->_actualizationLog; }
+		const ::Assets::DependencyValidation& GetDependencyValidation() const { assert(_record); return _record->_depVal; }
+		VisibilityMarkerId GetVisibilityMarker() const { assert(_record); return _record->_visibilityBarrier; }
+		const std::shared_future<Type>& GetFuture() const { assert(_record); return _record->_future; }
+
+		// Pointers returned from TryActualize / Actualize are valid for the lifetime of this Reference
+		const Type* TryActualize() const;
+		const Type& Actualize() const;
+
+		// Stall variants return a reference to the updated entry. This reference continues to refer to the same
+		// entry it was created with (which never changes state)
+		Reference StallWhilePending() const;
+		Reference StallWhilePendingFor(std::chrono::microseconds) const;
+
+		explicit operator bool() const { return _record != nullptr; }
+
+		using value_type = Type;
+		const Type& operator*() const { return Actualize(); }
+		const Type* operator->() const { return &Actualize(); }
+
+		Reference() = default;
+		~Reference();
+		Reference(const Reference&);
+		Reference& operator=(const Reference&);
+		Reference(Reference&&) never_throws;
+		Reference& operator=(Reference&&) never_throws;
+
+	private:
+		using Record = typename ConcurrentAssetHeap::Table<Type>::Record;
+		const Record* _record = nullptr;
+		ConcurrentAssetHeap::Table<Type>* _table = nullptr;
+
+		// takes ownership of a reference count already added to "record"
+		Reference(const Record* record, ConcurrentAssetHeap::Table<Type>* table)
+		: _record(record), _table(table) { TableBase::AddTableRef(_table); }
+		friend class ConcurrentAssetHeap;
+		friend class ConcurrentAssetHeap::Table<Type>;
+	};
+
+////////////////////////////////////////////////////////////////////////////////////
+
+	T1(Type) auto ConcurrentAssetHeap::Table<Type>::Find(IdentifierCode id) const -> const Record*
+	{
+		// caller must hold an EpochReclaimer::Guard
+		auto* buckets = _buckets.load(std::memory_order_acquire);
+		auto idx = HashSlot(id) & buckets->_mask;
+		for (;;) {
+			auto* r = buckets->_slots[idx].load(std::memory_order_acquire);
+			if (!r) return nullptr;
+			if (r != Tombstone() && r->_id == id) return r;
+			idx = (idx+1) & buckets->_mask;
+		}
+	}
+
+	T1(Type) template<typename Fn>
+		void ConcurrentAssetHeap::Table<Type>::ForEach(Fn&& fn) const
+	{
+		// caller must hold an EpochReclaimer::Guard
+		auto* buckets = _buckets.load(std::memory_order_acquire);
+		for (size_t c=0; c<=buckets->_mask; ++c) {
+			auto* r = buckets->_slots[c].load(std::memory_order_acquire);
+			if (r && r != Tombstone())
+				fn(r);
+		}
+	}
+
+	T1(Type) auto ConcurrentAssetHeap::Table<Type>::Acquire(IdentifierCode id) const -> const Record*
+	{
+		// The table's own reference can't be released until our guard is, so it's safe to add a reference here
+		EpochReclaimer::Guard guard{*_reclaimer};
+		auto* record = Find(id);
+		if (record) AddRef(record);
+		return record;
+	}
+
+	T1(Type) void ConcurrentAssetHeap::Table<Type>::AcquireAll(std::vector<Reference<Type>>& result)
+	{
+		EpochReclaimer::Guard guard{*_reclaimer};
+		result.reserve(result.size() + GetCount());
+		ForEach([&result, this](const Record* r) { AddRef(r); result.push_back(Reference<Type>{r, this}); });
+	}
+
+	T1(Type) void ConcurrentAssetHeap::Table<Type>::Release(const Record* record)
+	{
+		if (record->_refCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			delete record;
+	}
+
+	T1(Type) auto ConcurrentAssetHeap::Table<Type>::FindSlotAlreadyLocked(IdentifierCode id) -> std::atomic<Record*>*
+	{
+		auto* buckets = _buckets.load(std::memory_order_relaxed);
+		auto idx = HashSlot(id) & buckets->_mask;
+		for (;;) {
+			auto* r = buckets->_slots[idx].load(std::memory_order_relaxed);
+			if (!r) return nullptr;
+			if (r != Tombstone() && r->_id == id) return &buckets->_slots[idx];
+			idx = (idx+1) & buckets->_mask;
+		}
+	}
+
+	T1(Type) void ConcurrentAssetHeap::Table<Type>::InsertNewAlreadyLocked(Record* record)
+	{
+		// Keep the load factor (including tombstones) at or under 1/2. When we need to grow, we build a
+		// new bucket array off to the side and publish it in one go; readers still using the old array
+		// continue to see a consistent (if slightly old) snapshot until they release their guards
+		auto* buckets = _buckets.load(std::memory_order_relaxed);
+		if ((_usedSlots+1)*2 > (buckets->_mask+1)) {
+			auto liveCount = _liveCount.load(std::memory_order_relaxed);
+			size_t newSize = 16;
+			while (newSize < (liveCount+1)*4) newSize <<= 1;
+
+			auto newBuckets = std::make_unique<Buckets>();
+			newBuckets->_slots = std::make_unique<std::atomic<Record*>[]>(newSize);
+			newBuckets->_mask = newSize-1;
+			for (size_t c=0; c<newSize; ++c) newBuckets->_slots[c].store(nullptr, std::memory_order_relaxed);
+			for (size_t c=0; c<=buckets->_mask; ++c) {
+				auto* r = buckets->_slots[c].load(std::memory_order_relaxed);
+				if (!r || r == Tombstone()) continue;
+				auto idx = HashSlot(r->_id) & newBuckets->_mask;
+				while (newBuckets->_slots[idx].load(std::memory_order_relaxed)) idx = (idx+1) & newBuckets->_mask;
+				newBuckets->_slots[idx].store(r, std::memory_order_relaxed);
+			}
+			_usedSlots = liveCount;
+
+			auto* oldBuckets = buckets;
+			buckets = newBuckets.release();
+			_buckets.store(buckets, std::memory_order_release);
+			_reclaimer->Retire(oldBuckets, [](void* b) { delete (Buckets*)b; });
+		}
+
+		// we know the id isn't in the table, so we can reuse the first tombstone we find
+		auto idx = HashSlot(record->_id) & buckets->_mask;
+		for (;;) {
+			auto* r = buckets->_slots[idx].load(std::memory_order_relaxed);
+			if (!r) { ++_usedSlots; break; }
+			if (r == Tombstone()) break;
+			idx = (idx+1) & buckets->_mask;
+		}
+		buckets->_slots[idx].store(record, std::memory_order_release);
+		_liveCount.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	T1(Type) void ConcurrentAssetHeap::Table<Type>::PublishAlreadyLocked(std::atomic<Record*>* slot, std::unique_ptr<Record>&& record)
+	{
+		if (record->_state == ::Assets::AssetState::Pending)
+			_newlyPending.push_back(PendingEntry{record->_id, record->_valIdx, record->_future});
+
+		if (slot) {
+			auto* oldRecord = slot->exchange(record.release(), std::memory_order_acq_rel);
+			_reclaimer->Retire(oldRecord, [](void* r) { Release((Record*)r); });
+		} else {
+			InsertNewAlreadyLocked(record.release());
+		}
+	}
+
+	T1(Type) unsigned ConcurrentAssetHeap::Table<Type>::Publish(std::unique_ptr<Record>&& record)
+	{
+		ScopedLock(_writeLock);
+		auto* slot = FindSlotAlreadyLocked(record->_id);
+		record->_valIdx = slot ? slot->load(std::memory_order_relaxed)->_valIdx+1 : 1;
+		auto valIdx = record->_valIdx;
+		PublishAlreadyLocked(slot, std::move(record));
+		return valIdx;
+	}
+
+	T1(Type) bool ConcurrentAssetHeap::Table<Type>::CompareAndPublish(const Record* expected, std::unique_ptr<Record>&& record)
+	{
+		ScopedLock(_writeLock);
+		auto* slot = FindSlotAlreadyLocked(record->_id);
+		auto* existing = slot ? slot->load(std::memory_order_relaxed) : nullptr;
+		if (existing != expected)
+			return false;
+		record->_valIdx = existing ? existing->_valIdx+1 : 1;
+		PublishAlreadyLocked(slot, std::move(record));
+		return true;
+	}
+
+	T1(Type) bool ConcurrentAssetHeap::Table<Type>::Erase(IdentifierCode id)
+	{
+		ScopedLock(_writeLock);
+		auto* slot = FindSlotAlreadyLocked(id);
+		if (!slot) return false;
+		auto* oldRecord = slot->exchange(Tombstone(), std::memory_order_acq_rel);
+		_liveCount.fetch_sub(1, std::memory_order_relaxed);
+		_reclaimer->Retire(oldRecord, [](void* r) { Release((Record*)r); });
+		// any entry in _newlyPending / _pending will be ignored when it completes, because the id is no longer found
+		return true;
+	}
+
+	T1(Type) auto ConcurrentAssetHeap::Table<Type>::BuildCompletedRecord(const Record& pending, const std::shared_future<Type>& future, VisibilityMarkerId barrier) -> std::unique_ptr<Record>
+	{
+		auto result = std::make_unique<Record>();
+		result->_id = pending._id;
+		result->_valIdx = pending._valIdx;
+		result->_future = future;
+		result->_initializer = pending._initializer;
+		result->_visibilityBarrier = barrier;
+		TRY
+		{
+			result->_completed = future.get();
+			result->_actualizationLog = ::Assets::Internal::GetActualizationLog(*result->_completed);
+			result->_depVal = ::Assets::Internal::GetDependencyValidation(*result->_completed);
+			result->_state = ::Assets::AssetState::Ready;
+		} CATCH(const ::Assets::Exceptions::ConstructionError& e) {
+			result->_completed = {};
+			result->_actualizationLog = e.GetActualizationLog();
+			result->_depVal = e.GetDependencyValidation();
+			result->_state = ::Assets::AssetState::Invalid;
+		} CATCH(const ::Assets::Exceptions::InvalidAsset& e) {
+			result->_completed = {};
+			result->_actualizationLog = e.GetActualizationLog();
+			result->_depVal = e.GetDependencyValidation();
+			result->_state = ::Assets::AssetState::Invalid;
+		} CATCH(const ::Assets::Exceptions::ExceptionWithDepVal& e) {
+			result->_completed = {};
+			result->_actualizationLog = ::Assets::AsBlob(e.what());
+			result->_depVal = e.GetDependencyValidation();
+			result->_state = ::Assets::AssetState::Invalid;
+		} CATCH(const std::exception& e) {
+			result->_completed = {};
+			result->_actualizationLog = ::Assets::AsBlob(e.what());
+			result->_depVal = {};
+			result->_state = ::Assets::AssetState::Invalid;
+		} CATCH_END
+		return result;
+	}
+
+	T1(Type) void ConcurrentAssetHeap::Table<Type>::ReplaceIfPendingAlreadyLocked(const PendingEntry& entry, std::unique_ptr<Record>&& completed)
+	{
+		auto* slot = FindSlotAlreadyLocked(entry._id);
+		if (!slot) return;		// erased while the future was completing
+		auto* existing = slot->load(std::memory_order_relaxed);
+		if (existing->_valIdx != entry._valIdx || existing->_state != ::Assets::AssetState::Pending)
+			return;		// replaced, or already completed via StallWhilePending
+		PublishAlreadyLocked(slot, std::move(completed));
+	}
+
+	T1(Type) void ConcurrentAssetHeap::Table<Type>::CompleteImmediately(const Record& record, std::shared_future<Type> future)
+	{
+		// No locks are held while we're yielding
+		Utility::YieldToPool(future);
+		auto completed = BuildCompletedRecord(record, future, ~VisibilityMarkerId(0));
+		ScopedLock(_writeLock);
+		ReplaceIfPendingAlreadyLocked(PendingEntry{record._id, record._valIdx, {}}, std::move(completed));
+	}
+
+	T1(Type) void ConcurrentAssetHeap::Table<Type>::CompletePending(VisibilityMarkerId barrier)
+	{
+		{
+			ScopedLock(_writeLock);
+			if (_pending.empty()) {
+				std::swap(_pending, _newlyPending);
+			} else {
+				_pending.insert(_pending.end(), std::make_move_iterator(_newlyPending.begin()), std::make_move_iterator(_newlyPending.end()));
+				_newlyPending.clear();
+			}
+		}
+		if (_pending.empty()) return;
+
+		// Poll all of the outstanding futures without any locks held, and build the completed records
+		// Then publish everything that completed with a single acquisition of the write lock
+		std::vector<std::pair<size_t, std::unique_ptr<Record>>> completed;
+		for (size_t c=0; c<_pending.size(); ++c) {
+			auto& p = _pending[c];
+			if (p._future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+				continue;
+			Record pendingRecord;
+			pendingRecord._id = p._id;
+			pendingRecord._valIdx = p._valIdx;
+			{
+				EpochReclaimer::Guard guard{*_reclaimer};
+				auto* current = Find(p._id);
+				if (!current || current->_valIdx != p._valIdx || current->_state != ::Assets::AssetState::Pending) {
+					completed.emplace_back(c, nullptr);		// no longer relevant
+					continue;
+				}
+				pendingRecord._initializer = current->_initializer;
+			}
+			completed.emplace_back(c, BuildCompletedRecord(pendingRecord, p._future, barrier));
+		}
+		if (completed.empty()) return;
+
+		{
+			ScopedLock(_writeLock);
+			for (auto& c:completed)
+				if (c.second)
+					ReplaceIfPendingAlreadyLocked(_pending[c.first], std::move(c.second));
+		}
+
+		// remove completed entries from _pending (iterate backwards so the indices remain valid)
+		for (auto i=completed.rbegin(); i!=completed.rend(); ++i) {
+			if (i->first != _pending.size()-1)
+				_pending[i->first] = std::move(_pending.back());
+			_pending.pop_back();
+		}
+	}
+
+	T1(Type) ConcurrentAssetHeap::Table<Type>::Table(EpochReclaimer& reclaimer)
+	: TableBase(TypeHashCode<Type>), _reclaimer(&reclaimer)
+	{
+		auto buckets = std::make_unique<Buckets>();
+		buckets->_slots = std::make_unique<std::atomic<Record*>[]>(16);
+		buckets->_mask = 15;
+		for (unsigned c=0; c<16; ++c) buckets->_slots[c].store(nullptr, std::memory_order_relaxed);
+		_buckets.store(buckets.release());
+		_liveCount.store(0);
+	}
+
+	T1(Type) ConcurrentAssetHeap::Table<Type>::~Table()
+	{
+		// Retired records & bucket arrays are owned by the reclaimer; we only need to release what's still live
+		// (records can outlive the table, if there are still References to them)
+		auto* buckets = _buckets.load();
+		for (size_t c=0; c<=buckets->_mask; ++c) {
+			auto* r = buckets->_slots[c].load();
+			if (r && r != Tombstone()) Release(r);
+		}
+		delete buckets;
+	}
+
+////////////////////////////////////////////////////////////////////////////////////
+
+	T1(Type) const Type* ConcurrentAssetHeap::Reference<Type>::TryActualize() const
+	{
+		assert(_record);
+		if (_record->_state == ::Assets::AssetState::Invalid)
+			Throw(::Assets::Exceptions::InvalidAsset(_record->_initializer, _record->_depVal, _record->_actualizationLog));
+		if (_record->_state != ::Assets::AssetState::Ready)
+			return nullptr;
+		return &_record->_completed.value();
+	}
+
+	T1(Type) const Type& ConcurrentAssetHeap::Reference<Type>::Actualize() const
+	{
+		assert(_record);
+		if (_record->_state == ::Assets::AssetState::Pending)
+			Throw(::Assets::Exceptions::PendingAsset(_record->_initializer));
+		if (_record->_state == ::Assets::AssetState::Invalid)
+			Throw(::Assets::Exceptions::InvalidAsset(_record->_initializer, _record->_depVal, _record->_actualizationLog));
+		return _record->_completed.value();
+	}
+
+	T1(Type) auto ConcurrentAssetHeap::Reference<Type>::StallWhilePending() const -> Reference
+	{
+		assert(_record);
+		if (_record->_state == ::Assets::AssetState::Pending)
+			_table->CompleteImmediately(*_record, _record->_future);
+		auto* record = _table->Acquire(_record->_id);
+		if (!record) return {};		// erased
+		return Reference{record, _table};
+	}
+
+	T1(Type) auto ConcurrentAssetHeap::Reference<Type>::StallWhilePendingFor(std::chrono::microseconds timeout) const -> Reference
+	{
+		assert(_record);
+		if (_record->_state == ::Assets::AssetState::Pending) {
+			auto future = _record->_future;
+			if (Utility::YieldToPoolFor(future, timeout) == std::future_status::timeout)
+				return *this;
+			_table->CompleteImmediately(*_record, std::move(future));
+		}
+		auto* record = _table->Acquire(_record->_id);
+		if (!record) return {};
+		return Reference{record, _table};
+	}
+
+	T1(Type) ConcurrentAssetHeap::Reference<Type>::~Reference()
+	{
+		if (_record) Table<Type>::Release(_record);
+		TableBase::ReleaseTableRef(_table);
+	}
+
+	T1(Type) ConcurrentAssetHeap::Reference<Type>::Reference(const Reference& copyFrom)
+	: _record(copyFrom._record), _table(copyFrom._table)
+	{
+		if (_record) Table<Type>::AddRef(_record);
+		TableBase::AddTableRef(_table);
+	}
+
+	T1(Type) auto ConcurrentAssetHeap::Reference<Type>::operator=(const Reference& copyFrom) -> Reference&
+	{
+		if (this != &copyFrom) {
+			if (copyFrom._record) Table<Type>::AddRef(copyFrom._record);
+			if (_record) Table<Type>::Release(_record);
+			TableBase::AddTableRef(copyFrom._table);
+			TableBase::ReleaseTableRef(_table);
+			_record = copyFrom._record;
+			_table = copyFrom._table;
+		}
+		return *this;
+	}
+
+	T1(Type) ConcurrentAssetHeap::Reference<Type>::Reference(Reference&& moveFrom) never_throws
+	: _record(moveFrom._record), _table(moveFrom._table)
+	{
+		moveFrom._record = nullptr;
+		moveFrom._table = nullptr;
+	}
+
+	T1(Type) auto ConcurrentAssetHeap::Reference<Type>::operator=(Reference&& moveFrom) never_throws -> Reference&
+	{
+		if (this != &moveFrom) {
+			if (_record) Table<Type>::Release(_record);
+			TableBase::ReleaseTableRef(_table);
+			_record = moveFrom._record;
+			_table = moveFrom._table;
+			moveFrom._record = nullptr;
+			moveFrom._table = nullptr;
+		}
+		return *this;
+	}
+
+////////////////////////////////////////////////////////////////////////////////////
+
+	T1(Type) auto ConcurrentAssetHeap::FindOrCreateTable() -> Table<Type>&
+	{
+		if (auto* existing = FindTable<Type>())
+			return *existing;
+		return *static_cast<Table<Type>*>(InstallTable(std::make_unique<Table<Type>>(_reclaimer)));
+	}
+
+	T1(Type) void ConcurrentAssetHeap::Insert(IdentifierCode id, std::string initializer, std::shared_future<Type>&& future)
+	{
+		auto record = std::make_unique<typename Table<Type>::Record>();
+		record->_id = id;
+		record->_future = std::move(future);
+		record->_initializer = std::move(initializer);
+		FindOrCreateTable<Type>().Publish(std::move(record));
+	}
+
+	T1(Type) void ConcurrentAssetHeap::Insert(IdentifierCode id, std::string initializer, std::future<Type>&& future)
+	{
+		Insert<Type>(id, std::move(initializer), std::shared_future<Type>{std::move(future)});
+	}
+
+	T1(Type) void ConcurrentAssetHeap::Insert(IdentifierCode id, std::string initializer, Type&& asset)
+	{
+		// we always need a future, event when we're receiving a completed object
+		std::promise<Type> p;
+		std::shared_future<Type> f = p.get_future();
+		p.set_value(asset);
+
+		auto record = std::make_unique<typename Table<Type>::Record>();
+		record->_id = id;
+		record->_state = ::Assets::AssetState::Ready;
+		record->_visibilityBarrier = _lastVisibilityMarker.load();
+		record->_future = std::move(f);
+		record->_completed = std::move(asset);
+		record->_actualizationLog = ::Assets::Internal::GetActualizationLog(*record->_completed);
+		record->_depVal = ::Assets::Internal::GetDependencyValidation(*record->_completed);
+		record->_initializer = std::move(initializer);
+		FindOrCreateTable<Type>().Publish(std::move(record));
+	}
+
+	T1(Type) bool ConcurrentAssetHeap::CompareAndInsert(IdentifierCode id, const Reference<Type>& expected, std::string initializer, std::shared_future<Type>&& future)
+	{
+		assert(!expected || expected.Id() == id);
+		auto record = std::make_unique<typename Table<Type>::Record>();
+		record->_id = id;
+		record->_future = std::move(future);
+		record->_initializer = std::move(initializer);
+		return FindOrCreateTable<Type>().CompareAndPublish(expected._record, std::move(record));
+	}
+
+	T1(Type) bool ConcurrentAssetHeap::Erase(IdentifierCode id)
+	{
+		auto* table = FindTable<Type>();
+		return table ? table->Erase(id) : false;
+	}
+
+	T1(Type) auto ConcurrentAssetHeap::Lookup(IdentifierCode id) const -> Reference<Type>
+	{
+		auto* table = FindTable<Type>();
+		if (!table) return {};
+		auto* record = table->Acquire(id);
+		if (!record) return {};
+		return Reference<Type>{record, table};
+	}
+
+	template<typename Type, typename Fn>
+		void ConcurrentAssetHeap::ForEach(Fn&& fn) const
+	{
+		auto* table = FindTable<Type>();
+		if (!table) return;
+		// Take references to everything up front, so that "fn" isn't called while the reclaimer is pinned
+		std::vector<Reference<Type>> refs;
+		table->AcquireAll(refs);
+		for (const auto& ref:refs)
+			fn(ref);
+	}
+
+	T1(Type) size_t ConcurrentAssetHeap::GetCount() const
+	{
+		auto* table = FindTable<Type>();
+		return table ? table->GetCount() : 0;
+	}
+
+////////////////////////////////////////////////////////////////////////////////////
+
+	template<typename Type, typename... Params> ::AssetsNew::ConcurrentAssetHeap::Reference<Type> Get(ConcurrentAssetHeap& heap, Params&&... initialisers)
+	{
+		auto cacheKey = ::Assets::Internal::BuildParamHash(initialisers...);
+
+		auto existing = heap.Lookup<Type>(cacheKey);
+		if (existing && existing.GetDependencyValidation().GetValidationIndex() <= 0)
+			return existing;
+
+		// No existing asset, or asset is invalidated. Only one thread will succeed in replacing "existing";
+		// everyone else will return whatever that thread inserted
+		std::promise<Type> promise;
+		if (heap.CompareAndInsert<Type>(cacheKey, existing, ::Assets::Internal::AsString(initialisers...), promise.get_future()))
+			::Assets::AutoConstructToPromise(std::move(promise), std::forward<Params>(initialisers)...);
+		return heap.Lookup<Type>(cacheKey);
+	}
+}
@@ -492,6 +492,22 @@ namespace Assets
 			return _globalChangeIndex.load();
 		}
 
+		ShutdownSignalId BindShutdownSignal(std::function<void()>&& fn) override
+		{
+			ScopedLock(_lock);
+			auto id = _nextShutdownSignalId++;
+			_shutdownSignals.emplace_back(id, std::move(fn));
+			return id;
+		}
+
+		void UnbindShutdownSignal(ShutdownSignalId id) override
+		{
+			ScopedLock(_lock);
+			auto i = std::find_if(_shutdownSignals.begin(), _shutdownSignals.end(), [id](const auto& q) { return q.first == id; });
+			if (i != _shutdownSignals.end())
+				_shutdownSignals.erase(i);
+		}
+
 		DependencyValidationSystem()
 		: _globalChangeIndex(0)
 		{
@@ -499,7 +515,14 @@ namespace Assets
 
 		~DependencyValidationSystem()
 		{
-
+			// Call the shutdown signals outside of the lock, since they will typically be releasing DependencyValidations
+			decltype(_shutdownSignals) shutdownSignals;
+			{
+				ScopedLock(_lock);
+				std::swap(shutdownSignals, _shutdownSignals);
+			}
+			for (auto& s:shutdownSignals)
+				s.second();
 		}
 	private:
 		SpanningHeap<DependencyValidationMarker> _markerHeap;
@@ -509,6 +532,8 @@ namespace Assets
 
 		std::vector<std::pair<DependencyValidationMarker, DependencyValidationMarker>> _assetLinks;
 		std::vector<std::pair<DependencyValidationMarker, std::pair<MonitoredFileId, unsigned>>> _fileLinks;
+		std::vector<std::pair<ShutdownSignalId, std::function<void()>>> _shutdownSignals;
+		ShutdownSignalId _nextShutdownSignalId = 1;
 		Threading::Mutex _lock;
 		std::atomic<unsigned> _globalChangeIndex;
 	};
@@ -7,6 +7,7 @@
 #include "IFileSystem.h"
 #include "../Utility/IteratorUtils.h"
 #include "../Utility/StringUtils.h"
+#include <functional>
 
 namespace Assets
 {
@@ -101,6 +102,13 @@ namespace Assets
 
         virtual unsigned GlobalChangeIndex() = 0;
 
+        /// <summary>Registers a function to be called when the system is being destroyed</summary>
+        /// Long lived caches that hold DependencyValidation objects (outside of any particular asset) should
+        /// release them from this callback. Those objects can't be used with any other system.
+        using ShutdownSignalId = unsigned;
+        virtual ShutdownSignalId BindShutdownSignal(std::function<void()>&& fn) = 0;
+        virtual void UnbindShutdownSignal(ShutdownSignalId) = 0;
+
         virtual ~IDependencyValidationSystem() = default;
     };
 
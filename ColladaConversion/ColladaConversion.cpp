@@ -34,6 +34,8 @@
 #include "../Formatters/TextOutputFormatter.h"
 #include "../Formatters/FormatterUtils.h"
 #include "../Utility/PtrUtils.h"
+#include "../Utility/Threading/CompletionThreadPool.h"
+#include "../ConsoleRig/GlobalServices.h"
 #include "../Core/SelectConfiguration.h"
 
 #include "../RenderCore/Assets/ModelRendererConstruction.h"
@@ -43,6 +45,7 @@
 #include <memory>
 #include <map>
 #include <set>
+#include <optional>
 
 #pragma warning(disable:4505) // unreferenced local function has been removed
 
@@ -90,15 +93,11 @@ namespace ColladaConversion
 		IteratorRange<const SkeletonRoot*> skinningSkeletons,
 		IteratorRange<const Node*> roots);
 
-	static NascentObjectGuid ConvertGeometryBlock(
-		NascentModel& model,
-		std::map<NascentObjectGuid, std::vector<uint64_t>>& geoBlockMatBindings,
+	static const MeshGeometry* ResolveGeometryReference(
 		Section reference,
 		const ::ColladaConversion::URIResolveContext& resolveContext,
-		const ImportConfiguration& cfg)
+		GuidReference& refGuid)
 	{
-		GuidReference refGuid(reference);
-
 		auto* scaffoldGeo = FindElement(refGuid, resolveContext, &IDocScopeIdResolver::FindMeshGeometry);
 		if (!scaffoldGeo) {
 				// look for a skin controller instead... We will use the geometry object that is referenced
@@ -114,10 +113,51 @@ namespace ColladaConversion
 			Throw(::Exceptions::BasicLabel("Could not found geometry object to instantiate (%s)",
 				reference.AsString().c_str()));
 
+		return scaffoldGeo;
+	}
+
+		// Geometry and controller conversions are independent of each other (they only read from
+		// the document scaffold), so we convert them all up-front on the thread pool, and then
+		// bind them into the NascentModel in the original order afterwards.
+		// Exceptions are stored and rethrown during the binding step, so error reporting is
+		// unchanged.
+	struct PreparedGeometry
+	{
+		const MeshGeometry* _scaffold = nullptr;
+		std::optional<ConvertedMeshGeometry> _converted;
+		std::exception_ptr _exception;
+	};
+
+	struct PreparedController
+	{
+		std::optional<UnboundSkinController> _converted;
+		std::exception_ptr _exception;
+	};
+
+	static NascentObjectGuid ConvertGeometryBlock(
+		NascentModel& model,
+		std::map<NascentObjectGuid, std::vector<uint64_t>>& geoBlockMatBindings,
+		std::map<NascentObjectGuid, PreparedGeometry>& preparedGeometries,
+		Section reference,
+		const ::ColladaConversion::URIResolveContext& resolveContext,
+		const ImportConfiguration& cfg)
+	{
+		GuidReference refGuid { reference };
+		auto* scaffoldGeo = ResolveGeometryReference(reference, resolveContext, refGuid);
+
 		NascentObjectGuid geoId { refGuid._id, refGuid._fileHash };
 		auto* existingGeometry = model.FindGeometryBlock(geoId);
 		if (!existingGeometry) {
-			auto convertedMesh = Convert(*scaffoldGeo, resolveContext, cfg);
+			ConvertedMeshGeometry convertedMesh;
+			auto prepared = preparedGeometries.find(geoId);
+			if (prepared != preparedGeometries.end() && prepared->second._exception) {
+				std::rethrow_exception(prepared->second._exception);
+			} else if (prepared != preparedGeometries.end() && prepared->second._converted) {
+				convertedMesh = std::move(*prepared->second._converted);
+				prepared->second._converted = {};
+			} else
+				convertedMesh = Convert(*scaffoldGeo, resolveContext, cfg);
+
 			if (convertedMesh._geoBlock._drawCalls.empty()) {
                     
 					// everything else should be empty as well...
@@ -214,6 +254,62 @@ namespace ColladaConversion
 		NascentModel model;
 		std::map<NascentObjectGuid, std::vector<uint64_t>> geoBlockMatBindings;
 
+		///////////////////
+		std::map<NascentObjectGuid, PreparedGeometry> preparedGeometries;
+		std::vector<PreparedController> preparedControllers(scene.GetInstanceControllerCount());
+		{
+			auto prepareGeometry = [&](Section reference) {
+				TRY {
+					GuidReference refGuid { reference };
+					auto* scaffoldGeo = ResolveGeometryReference(reference, input._resolveContext, refGuid);
+					preparedGeometries[NascentObjectGuid{refGuid._id, refGuid._fileHash}]._scaffold = scaffoldGeo;
+				} CATCH(...) {
+					// failures will be reported when we attempt to bind this geometry below
+				} CATCH_END
+			};
+
+			std::vector<unsigned> controllerJobs;
+			for (unsigned instGeoIndex=0; instGeoIndex<scene.GetInstanceGeometryCount(); ++instGeoIndex)
+				if (IsAncestorOf(scene.GetInstanceGeometry_Attach(instGeoIndex), roots))
+					prepareGeometry(scene.GetInstanceGeometry(instGeoIndex)._reference);
+			for (unsigned instSkinControllerIndex=0; instSkinControllerIndex<scene.GetInstanceControllerCount(); ++instSkinControllerIndex)
+				if (IsAncestorOf(scene.GetInstanceController_Attach(instSkinControllerIndex), roots)) {
+					prepareGeometry(scene.GetInstanceController(instSkinControllerIndex)._reference);
+					controllerJobs.push_back(instSkinControllerIndex);
+				}
+
+			std::vector<PreparedGeometry*> geometryJobs;
+			geometryJobs.reserve(preparedGeometries.size());
+			for (auto& g:preparedGeometries) geometryJobs.push_back(&g.second);
+
+			auto convertFn = [&](unsigned jobIndex) {
+				if (jobIndex < geometryJobs.size()) {
+					auto& job = *geometryJobs[jobIndex];
+					TRY {
+						job._converted = Convert(*job._scaffold, input._resolveContext, input._cfg);
+					} CATCH(...) {
+						job._exception = std::current_exception();
+					} CATCH_END
+				} else {
+					auto instSkinControllerIndex = controllerJobs[jobIndex - geometryJobs.size()];
+					const auto& instController = scene.GetInstanceController(instSkinControllerIndex);
+					auto& job = preparedControllers[instSkinControllerIndex];
+					TRY {
+						auto* scaffoldController = FindElement(GuidReference{instController._reference}, input._resolveContext, &IDocScopeIdResolver::FindSkinController);
+						if (scaffoldController) {
+							ColladaConversion::SkeletonBindRootFn skeletonRootCalculator = [&instController](const Node& n) { return FindSkeletonInverseBindRoot(instController, n); };
+							job._converted = Convert(*scaffoldController, input._resolveContext, input._cfg, skeletonRootCalculator);
+						}
+					} CATCH(...) {
+						job._exception = std::current_exception();
+					} CATCH_END
+				}
+			};
+			ParallelFor(
+				ConsoleRig::GlobalServices::GetInstance().GetLongTaskThreadPool(),
+				unsigned(geometryJobs.size() + controllerJobs.size()), convertFn);
+		}
+
 		///////////////////
 		for (unsigned instGeoIndex=0; instGeoIndex<scene.GetInstanceGeometryCount(); ++instGeoIndex) {
             const auto& instGeo = scene.GetInstanceGeometry(instGeoIndex);
@@ -223,7 +319,7 @@ namespace ColladaConversion
 
 			TRY {
 				auto geoId = ConvertGeometryBlock(
-					model, geoBlockMatBindings,
+					model, geoBlockMatBindings, preparedGeometries,
 					instGeo._reference,
 					input._resolveContext, input._cfg);
 
@@ -253,7 +349,7 @@ namespace ColladaConversion
 			bool skinSuccessful = false;
             TRY {
 				geoId = ConvertGeometryBlock(
-					model, geoBlockMatBindings,
+					model, geoBlockMatBindings, preparedGeometries,
 					instController._reference,
 					input._resolveContext, input._cfg);
 
@@ -266,9 +362,16 @@ namespace ColladaConversion
 					Throw(::Exceptions::BasicLabel("Could not find controller object to instantiate (%s)",
 						instController._reference.AsString().c_str()));
 
+				auto& preparedController = preparedControllers[instSkinControllerIndex];
+				if (preparedController._exception)
+					std::rethrow_exception(preparedController._exception);
+
 				ColladaConversion::SkeletonBindRootFn skeletonRootCalculator = [&instController](const Node& n) { return FindSkeletonInverseBindRoot(instController, n); };
 
-				auto controller = Convert(*scaffoldController, input._resolveContext, input._cfg, skeletonRootCalculator);
+				auto controller = preparedController._converted
+					? std::move(*preparedController._converted)
+					: Convert(*scaffoldController, input._resolveContext, input._cfg, skeletonRootCalculator);
+				preparedController._converted = {};
 				auto skeleName = GetControllerSkeletonName(instController, input._resolveContext);
 
 				model.Add(
@@ -122,9 +122,9 @@ namespace ColladaConversion
 
         _rawData = std::make_shared<std::vector<uint8_t>>(source.GetCount() * parsedTypeSize);
         if (sourceType == DataFlow::ArrayType::Int) {
-            ParseXMLList((uint32_t*)AsPointer(_rawData->begin()), (unsigned)source.GetCount(), source.GetArrayData());
+            ParseXMLListParallel((unsigned*)AsPointer(_rawData->begin()), (unsigned)source.GetCount(), source.GetArrayData());
         } else if (sourceType == DataFlow::ArrayType::Float) {
-            ParseXMLList((float*)AsPointer(_rawData->begin()), (unsigned)source.GetCount(), source.GetArrayData());
+            ParseXMLListParallel((float*)AsPointer(_rawData->begin()), (unsigned)source.GetCount(), source.GetArrayData());
         }
     }
 
@@ -359,7 +359,7 @@ namespace ColladaConversion
         auto indexCount = geoPrim.GetPrimitiveCount() * 3;
         auto valueCount = indexCount * workingPrim._primitiveStride;
         auto rawIndices = std::make_unique<unsigned[]>(valueCount);
-        ParseXMLList(AsPointer(rawIndices.get()), valueCount, geoPrim.GetPrimitiveData(0));
+        ParseXMLListParallel(AsPointer(rawIndices.get()), valueCount, geoPrim.GetPrimitiveData(0));
 
         std::vector<unsigned> finalIndices(indexCount);
         for (size_t i=0; i<indexCount; ++i) {
@@ -401,27 +401,34 @@ namespace ColladaConversion
         ParseXMLList(AsPointer(vcount.begin()), (unsigned)vcount.size(), vcountSrc);
         std::vector<unsigned> finalIndices;
         finalIndices.reserve(vcount.size()*6);
-                
-        auto pIterator = geoPrim.GetPrimitiveData(0);
+
+            // The <p> element is usually the largest part of the primitive, so parse it all
+            // in one go (split across the thread pool) before walking through the polygons.
+            // Any indices missing from the end of the list are treated as zero
+        size_t totalIndices = 0;
+        for (auto v : vcount) totalIndices += v * workingPrim._primitiveStride;
+        std::vector<unsigned> rawIndices(totalIndices, 0);
+        if (totalIndices)
+            ParseXMLListParallel(AsPointer(rawIndices.begin()), (unsigned)totalIndices, geoPrim.GetPrimitiveData(0));
 
             // we're going to convert each polygon into triangles using
             // primitive triangulation...
 
-        std::vector<unsigned> rawIndices(32 * workingPrim._primitiveStride);
         std::vector<unsigned> unifiedVertexIndices(32);
         std::vector<unsigned> windingRemap(32*2);
+        auto rawIndicesIterator = rawIndices.begin();
         for (auto v : vcount) {
             auto indiciesToLoad = v * workingPrim._primitiveStride;
 
-            if (rawIndices.size() < indiciesToLoad) rawIndices.resize(indiciesToLoad);
             if (windingRemap.size() < (v*3))        windingRemap.resize(v*3);
             if (unifiedVertexIndices.size() < v)    unifiedVertexIndices.resize(v);
 
-            pIterator._start = ParseXMLList(AsPointer(rawIndices.begin()), indiciesToLoad, pIterator);
+            auto polygonIndices = rawIndicesIterator;
+            rawIndicesIterator += indiciesToLoad;
 
                 // build "unified" vertices from the list of vertices provided here
             for (auto q=0u; q<v; ++q) {
-                const auto* rawI = &rawIndices[q*workingPrim._primitiveStride];
+                const auto* rawI = &polygonIndices[q*workingPrim._primitiveStride];
                 for (const auto& e:workingPrim._inputs)
                     vertexTemp[e._mappedInput] = rawI[e._indexInPrimitive];
 
@@ -791,7 +798,7 @@ namespace ColladaConversion
             // parse in the array of raw floats
         auto rawFloatCount = invBindSource->GetCount();
         auto rawFloats = std::make_unique<float[]>(rawFloatCount);
-        ParseXMLList(rawFloats.get(), (unsigned)rawFloatCount, invBindSource->GetArrayData());
+        ParseXMLListParallel(rawFloats.get(), (unsigned)rawFloatCount, invBindSource->GetArrayData());
 
         for (unsigned c=0; c<count; ++c) {
             auto r = c * commonAccessor->GetStride();
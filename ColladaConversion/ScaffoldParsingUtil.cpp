@@ -7,7 +7,10 @@
 #include "ScaffoldParsingUtil.h"
 #include "../Utility/ArithmeticUtils.h"
 #include "../Math/XLEMath.h"
+#include "../ConsoleRig/GlobalServices.h"
+#include "../Utility/Threading/CompletionThreadPool.h"
 #include <iostream>
+#include <vector>
 
 namespace ColladaConversion
 {
@@ -24,6 +27,98 @@ namespace ColladaConversion
         if ((section._end - section._start) < ptrdiff_t(matchLen)) return false;
         return Is(Formatters::XmlInputFormatter<utf8>::InteriorSection(section._end - matchLen, section._end), match);
     }
+
+    namespace Internal
+    {
+        using Section = Formatters::XmlInputFormatter<utf8>::InteriorSection;
+
+            // Lists smaller than this are parsed on the calling thread. Collada files are dominated
+            // by a few very large <float_array> and <p> elements, so there's no benefit in splitting
+            // up the many small ones
+        static const size_t s_minParallelChunkSize = 256*1024;
+        static const unsigned s_maxParallelChunks = 64;
+
+        static unsigned CountListElements(Section section)
+        {
+            unsigned result = 0;
+            auto* i = section._start;
+            for (;;) {
+                while (i < section._end && IsWhitespace(*i)) ++i;
+                if (i == section._end) break;
+                ++result;
+                while (i < section._end && !IsWhitespace(*i)) ++i;
+            }
+            return result;
+        }
+
+        template<typename Type>
+            static unsigned ParseListChunk(Type dest[], unsigned destCount, Section section)
+        {
+            size_t elementCount = 0;
+            FastParseValueList(MakeStringSection(section._start, section._end), MakeIteratorRange(dest, dest+destCount), elementCount);
+            return (unsigned)elementCount;
+        }
+
+        template<typename Type>
+            static unsigned ParseListParallel(Type dest[], unsigned destCount, Section section)
+        {
+            auto sectionSize = size_t(section._end - section._start);
+            auto* pool = &ConsoleRig::GlobalServices::GetInstance().GetShortTaskThreadPool();
+            unsigned chunkCount = 1;
+            if (pool->IsGood())
+                chunkCount = (unsigned)std::min(sectionSize / s_minParallelChunkSize, size_t(std::min(pool->GetThreadContext()+1, s_maxParallelChunks)));
+            if (chunkCount <= 1)
+                return ParseListChunk(dest, destCount, section);
+
+                // Split on whitespace, so that no element straddles a chunk boundary
+            std::vector<Section> chunks;
+            chunks.reserve(chunkCount);
+            auto* chunkStart = section._start;
+            for (unsigned c=1; c<chunkCount; ++c) {
+                auto* split = std::max(chunkStart, section._start + sectionSize * c / chunkCount);
+                while (split < section._end && !IsWhitespace(*split)) ++split;
+                chunks.emplace_back(chunkStart, split);
+                chunkStart = split;
+            }
+            chunks.emplace_back(chunkStart, section._end);
+
+                // Count the elements in each chunk first, so each chunk can be parsed directly into
+                // the right place in the output array
+            std::vector<unsigned> chunkElementCounts(chunkCount, 0);
+            auto countFn = [&](unsigned c) { chunkElementCounts[c] = CountListElements(chunks[c]); };
+            ParallelFor(*pool, chunkCount, countFn);
+
+            std::vector<unsigned> chunkOffsets(chunkCount, 0);
+            for (unsigned c=1; c<chunkCount; ++c)
+                chunkOffsets[c] = chunkOffsets[c-1] + chunkElementCounts[c-1];
+
+            std::vector<unsigned> chunkParsedCounts(chunkCount, 0);
+            auto parseFn = [&](unsigned c) {
+                if (chunkOffsets[c] >= destCount) return;
+                auto count = std::min(chunkElementCounts[c], destCount - chunkOffsets[c]);
+                chunkParsedCounts[c] = ParseListChunk(dest + chunkOffsets[c], count, chunks[c]);
+            };
+            ParallelFor(*pool, chunkCount, parseFn);
+
+                // Like ParseXMLList, stop at the first element that couldn't be parsed
+            unsigned result = 0;
+            for (unsigned c=0; c<chunkCount; ++c) {
+                result += chunkParsedCounts[c];
+                if (chunkParsedCounts[c] != chunkElementCounts[c]) break;
+            }
+            return std::min(result, destCount);
+        }
+    }
+
+    unsigned ParseXMLListParallel(float dest[], unsigned destCount, Formatters::XmlInputFormatter<utf8>::InteriorSection section)
+    {
+        return Internal::ParseListParallel(dest, destCount, section);
+    }
+
+    unsigned ParseXMLListParallel(unsigned dest[], unsigned destCount, Formatters::XmlInputFormatter<utf8>::InteriorSection section)
+    {
+        return Internal::ParseListParallel(dest, destCount, section);
+    }
 }
 
 namespace Formatters
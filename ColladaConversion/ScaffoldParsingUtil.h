@@ -79,6 +79,13 @@ namespace ColladaConversion
         return eleStart;
     }
 
+    /// <summary>Parse a large whitespace deliminated list, splitting the work across the short task thread pool</summary>
+    /// The section is divided into chunks on whitespace boundaries, the elements in each chunk are
+    /// counted and then each chunk is parsed directly into its final location in "dest". Small lists
+    /// are parsed on the calling thread. Returns the number of elements written.
+    unsigned ParseXMLListParallel(float dest[], unsigned destCount, Formatters::XmlInputFormatter<utf8>::InteriorSection section);
+    unsigned ParseXMLListParallel(unsigned dest[], unsigned destCount, Formatters::XmlInputFormatter<utf8>::InteriorSection section);
+
     template<typename Section>
         static std::string AsString(const Section& section)
     {
@@ -0,0 +1,889 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "BinaryDecodeProgram.h"
+#include "../Utility/Streams/PreprocessorInterpreter.h"
+#include "../Utility/StringFormat.h"
+#include "../Utility/PtrUtils.h"
+#include <sstream>
+
+using namespace Utility::Literals;
+
+namespace Formatters
+{
+	using Op = BinaryDecodeProgram::Op;
+	using OpType = BinaryDecodeProgram::OpType;
+
+	struct BinaryDecoder::Frame
+	{
+		const BinaryDecodeProgram* _program;
+		size_t _slotBase;
+		const Frame* _parent;
+	};
+
+	static bool IsSystemVariable(uint64_t hash)
+	{
+		return hash == "align2"_h || hash == "align4"_h || hash == "align8"_h || hash == "nullterm"_h || hash == "remainingbytes"_h;
+	}
+
+	static unsigned AsArrayCount(int64_t value, const BinaryDecodeProgram& program, const Op& op)
+	{
+		if (value < 0 || value > (int64_t)std::numeric_limits<uint32_t>::max())
+			Throw(std::runtime_error(
+				"Array count out of range in block " + program._schemata->GetBlockDefinitionName(program._blockDefinitionId)
+				+ ", member: " + program._definition->_tokenDictionary._tokenDefinitions[op._nameToken].AsStringSection().AsString()));
+		return (unsigned)value;
+	}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	//    c o m p i l a t i o n
+
+	namespace Internal
+	{
+		struct TypeRef { bool _dynamic = false; unsigned _value = ~0u; };
+
+		static bool ShadowsAny(const std::vector<uint64_t>& slotNames, const std::vector<uint64_t>& sortedGlobalNames)
+		{
+			for (auto n:slotNames)
+				if (std::binary_search(sortedGlobalNames.begin(), sortedGlobalNames.end(), n))
+					return true;
+			return false;
+		}
+
+		struct MemberTypeInfo
+		{
+			bool _isBlock = false;
+			bool _hasAlias = false;
+			bool _isCharAlias = false;
+			ImpliedTyping::TypeDesc _valueTypeDesc { ImpliedTyping::TypeCat::Void };
+		};
+
+		static TypeRef CompileTypeLookup(
+			EvaluationContext& evalContext, BinaryDecodeProgram& program,
+			unsigned baseNameToken, IteratorRange<const unsigned*> paramTypeCodes,
+			std::vector<TypeRef>& typeStack, std::vector<unsigned>& valueStack)
+		{
+			// This follows EvaluationContext::GetEvaluatedType(), except that template parameters that depend on
+			// decoded values are recorded in a DynamicType, to be resolved while decoding
+			auto& def = *program._definition;
+			for (unsigned c=0; c<def._templateParameterNames.size(); ++c)
+				if (def._templateParameterNames[c] == baseNameToken && (def._templateParameterTypeField & (1<<c))) {
+					assert(program._templateParamsTypeField & (1<<c));
+					if (paramTypeCodes.size() != 0)
+						Throw(std::runtime_error("Using partial templates as template parameters is unsupported"));
+					return TypeRef{false, (unsigned)program._templateParams[c]};
+				}
+
+			using DynamicType = BinaryDecodeProgram::DynamicType;
+			auto paramCount = (unsigned)paramTypeCodes.size();
+			DynamicType dynType;
+			dynType._baseNameToken = baseNameToken;
+			dynType._params.resize(paramCount);
+			bool isDynamic = false;
+			for (unsigned p=0; p<paramCount; ++p) {
+				// params end up in reverse order, so we have to reverse them as we're looking them up
+				auto& dst = dynType._params[paramCount-1-p];
+				if (paramTypeCodes[p] == (unsigned)TemplateParameterType::Typename) {
+					assert(!typeStack.empty());
+					auto type = typeStack.back();
+					typeStack.pop_back();
+					dst = { type._dynamic ? DynamicType::ParamSource::DynamicType : DynamicType::ParamSource::TypeToken, (int64_t)type._value };
+					isDynamic |= type._dynamic;
+				} else {
+					assert(!valueStack.empty());
+					auto exprIdx = valueStack.back();
+					valueStack.pop_back();
+					const auto& expr = program._expressions[exprIdx];
+					if (expr._isConstant) {
+						dst = { DynamicType::ParamSource::Constant, expr._constantValue };
+					} else {
+						dst = { DynamicType::ParamSource::Expression, (int64_t)exprIdx };
+						isDynamic = true;
+					}
+				}
+			}
+
+			auto baseName = def._tokenDictionary._tokenDefinitions[baseNameToken].AsStringSection();
+			if (!isDynamic) {
+				VLA(int64_t, params, paramCount);
+				unsigned typeBitField = 0;
+				for (unsigned p=0; p<paramCount; ++p) {
+					params[p] = dynType._params[p]._value;
+					if (dynType._params[p]._source == DynamicType::ParamSource::TypeToken)
+						typeBitField |= 1 << p;
+				}
+				return TypeRef{false, evalContext.GetEvaluatedType(program._schemata, baseName, program._blockDefinitionId, MakeIteratorRange(params, &params[paramCount]), typeBitField)};
+			}
+
+			// We can't resolve the evaluated type until decode time, but we can at least figure out if it's a block
+			// or a value type now
+			auto aliasId = program._schemata->FindAlias(baseName, program._blockDefinitionId);
+			if (aliasId != BinarySchemata::AliasId_Invalid) {
+				auto aliasedType = evalContext.GetEvaluatedType(program._schemata, program._schemata->GetAlias(aliasId)._aliasedType, BinarySchemata::BlockDefinitionId_Invalid);
+				dynType._valueTypeDesc = evalContext.GetEvaluatedTypeDesc(aliasedType)._valueTypeDesc;
+				dynType._isCharAlias = XlEqString(program._schemata->GetAliasName(aliasId), "char");
+			} else {
+				if (program._schemata->FindBlockDefinition(baseName, program._blockDefinitionId) == BinarySchemata::BlockDefinitionId_Invalid)
+					Throw(std::runtime_error("Unknown type while looking up (" + baseName.AsString() + ")"));
+				dynType._isBlock = true;
+			}
+			program._dynamicTypes.push_back(std::move(dynType));
+			return TypeRef{true, unsigned(program._dynamicTypes.size()-1)};
+		}
+
+		static MemberTypeInfo GetMemberTypeInfo(const EvaluationContext& evalContext, const BinaryDecodeProgram& program, TypeRef typeRef)
+		{
+			MemberTypeInfo result;
+			if (typeRef._dynamic) {
+				auto& dynType = program._dynamicTypes[typeRef._value];
+				result._isBlock = dynType._isBlock;
+				result._hasAlias = !dynType._isBlock;		// only aliases and blocks can have template parameters
+				result._isCharAlias = dynType._isCharAlias;
+				result._valueTypeDesc = dynType._valueTypeDesc;
+			} else {
+				auto& evalType = evalContext.GetEvaluatedTypeDesc(typeRef._value);
+				result._isBlock = evalType._blockDefinition != BinarySchemata::BlockDefinitionId_Invalid;
+				result._hasAlias = evalType._alias != BinarySchemata::AliasId_Invalid;
+				result._isCharAlias = result._hasAlias && evalType._schemata->GetAliasName(evalType._alias) == "char";		// (special case for "char" alias, as per BinaryInputFormatter)
+				result._valueTypeDesc = evalType._valueTypeDesc;
+			}
+			return result;
+		}
+
+		static unsigned GetOrAddSlot(BinaryDecodeProgram& program, uint64_t name)
+		{
+			auto i = std::find(program._slotNames.begin(), program._slotNames.end(), name);
+			if (i != program._slotNames.end())
+				return (unsigned)std::distance(program._slotNames.begin(), i);
+			program._slotNames.push_back(name);
+			return unsigned(program._slotNames.size()-1);
+		}
+	}
+
+	unsigned BinaryDecoder::CompileExpression(BinaryDecodeProgram& program, IteratorRange<const unsigned*> tokens)
+	{
+		auto& def = *program._definition;
+		BinaryDecodeProgram::Expression expr;
+		expr._tokens = tokens;
+
+		// Simple lookups of previous members (typically array counts) can skip the expression evaluator entirely
+		if (tokens.size() == 1 && def._tokenDictionary._tokenDefinitions[tokens[0]]._type == Utility::Internal::TokenDictionary::TokenType::Variable) {
+			auto hash = def._tokenDictionary._tokenDefinitions[tokens[0]].AsHashValue();
+			auto i = std::find(program._slotNames.begin(), program._slotNames.end(), hash);
+			if (i != program._slotNames.end())
+				expr._singleSlot = (unsigned)std::distance(program._slotNames.begin(), i);
+		}
+
+		if (expr._singleSlot == ~0u) {
+			// Attempt to fold the expression into a constant. We can do this when it depends only on template parameters
+			// and global parameters. Anything else must wait until we're decoding
+			TRY {
+				bool foldable = true;
+				std::vector<uint64_t> foldedGlobals;
+				Utility::Internal::ExpressionEvaluator exprEval{def._tokenDictionary, tokens};
+				while (auto nextStep = exprEval.GetNextStep()) {
+					assert(nextStep._type == Utility::Internal::ExpressionEvaluator::StepType::LookupVariable);
+					uint64_t hash = def._tokenDictionary._tokenDefinitions[nextStep._nameTokenIndex].AsHashValue();
+					if (IsSystemVariable(hash) || std::find(program._slotNames.begin(), program._slotNames.end(), hash) != program._slotNames.end()) {
+						foldable = false;
+						break;
+					}
+
+					bool foundTemplateParam = false;
+					for (unsigned p=0; p<(unsigned)def._templateParameterNames.size(); ++p)
+						if (def._templateParameterNames[p] == nextStep._nameTokenIndex) {
+							assert(!(program._templateParamsTypeField & (1<<p)));		// assert value, not type parameter
+							nextStep.ReturnNonRetained(program._templateParams[p]);
+							foundTemplateParam = true;
+							break;
+						}
+					if (foundTemplateParam) continue;
+
+					if (program._foldGlobals) {
+						auto& globals = _evalContext->GetGlobalParameters();
+						auto globalType = globals.GetParameterType(hash);
+						if (globalType._type != ImpliedTyping::TypeCat::Void) {
+							nextStep.Return(ImpliedTyping::VariantNonRetained{globalType, globals.GetParameterRawValue(hash)});
+							foldedGlobals.push_back(hash);
+							continue;
+						}
+					}
+
+					// could be a member of an enclosing block
+					foldable = false;
+					break;
+				}
+
+				if (foldable) {
+					auto result = exprEval.GetResult();
+					int64_t resultValue = 0;
+					if (ImpliedTyping::Cast(MakeOpaqueIteratorRange(resultValue), ImpliedTyping::TypeOf<int64_t>(), result._data, result._type)) {
+						expr._isConstant = true;
+						expr._constantValue = resultValue;
+						program._foldedGlobals.insert(program._foldedGlobals.end(), foldedGlobals.begin(), foldedGlobals.end());
+					}
+				}
+			} CATCH(...) {
+				// leave it to be evaluated (and report errors) while decoding, in case it's in a branch that is never taken
+			} CATCH_END
+		}
+
+		program._expressions.push_back(expr);
+		return unsigned(program._expressions.size()-1);
+	}
+
+	std::unique_ptr<BinaryDecodeProgram> BinaryDecoder::Compile(EvaluatedTypeToken blockType, bool foldGlobals)
+	{
+		auto result = std::make_unique<BinaryDecodeProgram>();
+		auto& program = *result;
+		program._foldGlobals = foldGlobals;
+		{
+			const auto& evalType = _evalContext->GetEvaluatedTypeDesc(blockType);
+			if (evalType._blockDefinition == BinarySchemata::BlockDefinitionId_Invalid)
+				Throw(std::runtime_error("Attempting to compile a decode program for a type that is not a block"));
+			program._evalType = blockType;
+			program._schemata = evalType._schemata;
+			program._blockDefinitionId = evalType._blockDefinition;
+			program._definition = &evalType._schemata->GetBlockDefinition(evalType._blockDefinition);
+			program._templateParams = evalType._params;
+			program._templateParamsTypeField = evalType._paramTypeField;
+		}
+
+		const auto& def = *program._definition;
+		const unsigned* cmdsBegin = def._cmdList.data();
+		const unsigned* cmdsEnd = cmdsBegin + def._cmdList.size();
+		std::vector<Internal::TypeRef> typeStack;
+		std::vector<unsigned> valueStack;
+		std::vector<unsigned> cmdToOp(def._cmdList.size()+1, ~0u);
+		std::vector<unsigned> jumpTargets;
+		unsigned openRun = ~0u;
+
+		auto* cmds = cmdsBegin;
+		while (cmds < cmdsEnd) {
+			auto cmdIdx = unsigned(cmds - cmdsBegin);
+			if (std::find(jumpTargets.begin(), jumpTargets.end(), cmdIdx) != jumpTargets.end())
+				openRun = ~0u;		// fixed runs can't span jump targets
+			cmdToOp[cmdIdx] = (unsigned)program._ops.size();
+
+			auto cmd = (Cmd)*cmds++;
+			switch (cmd) {
+			case Cmd::LookupType:
+				{
+					auto baseNameToken = *cmds++;
+					auto paramCount = *cmds++;
+					assert(cmds+paramCount <= cmdsEnd);
+					auto paramTypeCodes = MakeIteratorRange(cmds, cmds+paramCount);
+					cmds += paramCount;
+					typeStack.push_back(Internal::CompileTypeLookup(*_evalContext, program, baseNameToken, paramTypeCodes, typeStack, valueStack));
+					break;
+				}
+
+			case Cmd::PopTypeStack:
+				assert(!typeStack.empty());
+				typeStack.pop_back();
+				break;
+
+			case Cmd::EvaluateExpression:
+				{
+					auto length = *cmds++;
+					assert(cmds+length <= cmdsEnd);
+					valueStack.push_back(CompileExpression(program, MakeIteratorRange(cmds, cmds+length)));
+					cmds += length;
+					break;
+				}
+
+			case Cmd::InlineIndividualMember:
+			case Cmd::InlineArrayMember:
+				{
+					bool isArray = cmd == Cmd::InlineArrayMember;
+					auto nameToken = *cmds++;
+					assert(!typeStack.empty());
+					auto typeRef = typeStack.back();
+					auto typeInfo = Internal::GetMemberTypeInfo(*_evalContext, program, typeRef);
+
+					Op op;
+					op._nameToken = nameToken;
+					op._name = def._tokenDictionary._tokenDefinitions[nameToken].AsHashValue();
+					if (typeRef._dynamic) op._dynamicType = typeRef._value;
+					else op._evalType = typeRef._value;
+					op._typeDesc = typeInfo._valueTypeDesc;
+
+					bool countIsConstant = true;
+					if (isArray) {
+						assert(!valueStack.empty());
+						auto countExpr = valueStack.back();
+						valueStack.pop_back();
+						if (program._expressions[countExpr]._isConstant) {
+							op._count = AsArrayCount(program._expressions[countExpr]._constantValue, program, op);
+						} else {
+							op._expression = countExpr;
+							countIsConstant = false;
+						}
+					}
+
+					std::optional<size_t> fixedSize;
+					if (!typeInfo._isBlock) {
+						// Sometimes we can just compress the "array count" into the basic value description (as per BinaryInputFormatter)
+						bool isCompressible = (!typeInfo._hasAlias || typeInfo._isCharAlias) && typeInfo._valueTypeDesc._arrayCount <= 1;
+						if (!isArray || isCompressible) {
+							op._type = OpType::Value;
+							if (isArray) {
+								op._typeDesc._arrayCount = op._count;
+								if (typeInfo._isCharAlias) op._typeDesc._typeHint = ImpliedTyping::TypeHint::String;
+							}
+							if (countIsConstant) fixedSize = op._typeDesc.GetSize();
+						} else {
+							op._type = OpType::ValueArray;
+							if (countIsConstant) fixedSize = size_t(op._count) * op._typeDesc.GetSize();
+						}
+						op._slot = Internal::GetOrAddSlot(program, op._name);
+					} else {
+						op._type = isArray ? OpType::BlockArray : OpType::Block;
+						// Avoid recursing into types we're already compiling; those will be resolved when first decoded
+						if (!typeRef._dynamic && std::find(_compilingTypes.begin(), _compilingTypes.end(), typeRef._value) == _compilingTypes.end()) {
+							op._subProgram = &GetProgram(typeRef._value, program._foldGlobals);
+							// members of this block shadow global parameters of the same name within the sub-program
+							if (Internal::ShadowsAny(program._slotNames, op._subProgram->_foldedGlobals))
+								op._subProgram = &GetProgram(typeRef._value, false);
+							program._foldedGlobals.insert(program._foldedGlobals.end(), op._subProgram->_foldedGlobals.begin(), op._subProgram->_foldedGlobals.end());
+							if (countIsConstant && op._subProgram->_fixedSize.has_value())
+								fixedSize = op._count * op._subProgram->_fixedSize.value();
+						}
+					}
+
+					// members with dynamic types are excluded from fixed runs, so that nothing within a run requires expression evaluation
+					if (fixedSize.has_value() && !typeRef._dynamic) {
+						if (openRun == ~0u) {
+							openRun = (unsigned)program._ops.size();
+							Op runOp;
+							runOp._type = OpType::FixedRun;
+							program._ops.push_back(runOp);
+						}
+						op._inFixedRun = true;
+						op._fixedSize = fixedSize.value();
+						op._runOffset = program._ops[openRun]._fixedSize;
+						program._ops[openRun]._fixedSize += fixedSize.value();
+					} else
+						openRun = ~0u;
+					program._ops.push_back(op);
+					break;
+				}
+
+			case Cmd::IfFalseThenJump:
+				{
+					assert(!valueStack.empty());
+					auto exprIdx = valueStack.back();
+					valueStack.pop_back();
+					auto jumpPt = *cmds++;
+					++cmds;		// condition symbol
+					if (jumpPt > def._cmdList.size())
+						Throw(std::runtime_error("Jump point in conditional is invalid"));
+
+					const auto& expr = program._expressions[exprIdx];
+					if (expr._isConstant) {
+						// resolved at compile time; when false the statement is just dead code
+						if (!expr._constantValue)
+							cmds = cmdsBegin + jumpPt;
+					} else {
+						openRun = ~0u;
+						Op op;
+						op._type = OpType::JumpIfFalse;
+						op._expression = exprIdx;
+						op._jumpTarget = jumpPt;		// (remapped to an op index below)
+						program._ops.push_back(op);
+						jumpTargets.push_back(jumpPt);
+					}
+					break;
+				}
+
+			case Cmd::Throw:
+				{
+					openRun = ~0u;
+					Op op;
+					op._type = OpType::Throw;
+					op._throwExpressionCount = *cmds++;
+					op._throwExpressionsBegin = (unsigned)program._indexPool.size();
+					for (unsigned c=0; c<op._throwExpressionCount; ++c) {
+						assert(!valueStack.empty());
+						program._indexPool.push_back(valueStack.back());
+						valueStack.pop_back();
+					}
+					auto* throwCmdsStart = cmds;
+					for (;;) {
+						assert(cmds < cmdsEnd);
+						auto next = *cmds++;
+						if (!next) break;
+						if (int(next) > 0) cmds += next;
+					}
+					op._throwCmds = MakeIteratorRange(throwCmdsStart, cmds);
+					program._ops.push_back(op);
+					break;
+				}
+
+			default:
+				Throw(std::runtime_error("Unexpected token in command stream"));
+			}
+		}
+		cmdToOp[def._cmdList.size()] = (unsigned)program._ops.size();
+		assert(typeStack.empty());
+
+		std::sort(program._foldedGlobals.begin(), program._foldedGlobals.end());
+		program._foldedGlobals.erase(std::unique(program._foldedGlobals.begin(), program._foldedGlobals.end()), program._foldedGlobals.end());
+
+		for (auto& op:program._ops)
+			if (op._type == OpType::JumpIfFalse) {
+				assert(cmdToOp[op._jumpTarget] != ~0u);
+				op._jumpTarget = cmdToOp[op._jumpTarget];
+			}
+
+		// The entire block is fixed size if it's made up of just a single fixed run (or it's empty)
+		if (program._ops.empty()) {
+			program._fixedSize = 0;
+		} else if (program._ops[0]._type == OpType::FixedRun) {
+			bool singleRun = std::all_of(program._ops.begin()+1, program._ops.end(), [](const auto& op) { return op._inFixedRun; });
+			if (singleRun)
+				program._fixedSize = program._ops[0]._fixedSize;
+		}
+
+		return result;
+	}
+
+	const BinaryDecodeProgram& BinaryDecoder::GetProgram(EvaluatedTypeToken blockType, bool foldGlobals)
+	{
+		auto& programs = foldGlobals ? _programs : _unfoldedPrograms;
+		auto i = LowerBound(programs, blockType);
+		if (i != programs.end() && i->first == blockType)
+			return *i->second;
+
+		std::unique_ptr<BinaryDecodeProgram> program;
+		_compilingTypes.push_back(blockType);
+		TRY {
+			program = Compile(blockType, foldGlobals);
+		} CATCH(...) {
+			_compilingTypes.pop_back();
+			RETHROW;
+		} CATCH_END
+		_compilingTypes.pop_back();
+
+		// programs may have been modified while compiling, so we must search again
+		i = LowerBound(programs, blockType);
+		i = programs.insert(i, std::make_pair(blockType, std::move(program)));
+		return *i->second;
+	}
+
+	auto BinaryDecoder::GetBlockType(
+		const std::shared_ptr<BinarySchemata>& schemata, BinarySchemata::BlockDefinitionId blockDefId,
+		IteratorRange<const int64_t*> templateParams, uint32_t templateParamsTypeField) -> EvaluatedTypeToken
+	{
+		EvaluationContext::EvaluatedType type;
+		type._blockDefinition = blockDefId;
+		type._params = {templateParams.begin(), templateParams.end()};
+		type._paramTypeField = templateParamsTypeField;
+		type._schemata = schemata;
+		return _evalContext->GetEvaluatedType(type);
+	}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	//    d e c o d i n g
+
+	IteratorRange<const void*> BinaryDecoder::Decode(IteratorRange<const void*> data, EvaluatedTypeToken blockType, IBinaryDecodeVisitor& visitor)
+	{
+		if (_evalContext->GetGlobalStateChangeId() != _globalStateChangeId) {
+			// global parameters are folded into the compiled programs, so they must be rebuilt
+			_programs.clear();
+			_unfoldedPrograms.clear();
+			_globalStateChangeId = _evalContext->GetGlobalStateChangeId();
+		}
+
+		auto& program = GetProgram(blockType);
+		_originalStart = data.begin();
+		_dataEnd = data.end();
+		_slotStack.clear();
+		auto* end = Execute(program, data.begin(), &visitor, nullptr);
+		return { end, data.end() };
+	}
+
+	IteratorRange<const void*> BinaryDecoder::Decode(
+		IteratorRange<const void*> data,
+		const std::shared_ptr<BinarySchemata>& schemata, BinarySchemata::BlockDefinitionId blockDefId,
+		IBinaryDecodeVisitor& visitor,
+		IteratorRange<const int64_t*> templateParams, uint32_t templateParamsTypeField)
+	{
+		return Decode(data, GetBlockType(schemata, blockDefId, templateParams, templateParamsTypeField), visitor);
+	}
+
+	const void* BinaryDecoder::Execute(const BinaryDecodeProgram& program, const void* ptr, IBinaryDecodeVisitor* visitor, const Frame* parent)
+	{
+		// Note that _slotStack can be reallocated by nested calls; so we only access it via indices
+		Frame frame { &program, _slotStack.size(), parent };
+		_slotStack.resize(frame._slotBase + program._slotNames.size());
+
+		const void* runBase = nullptr;
+		const auto& ops = program._ops;
+		unsigned opIdx = 0;
+		while (opIdx < ops.size()) {
+			const auto& op = ops[opIdx];
+			switch (op._type) {
+			case OpType::FixedRun:
+				assert(opIdx+1 < ops.size());
+				if (PtrDiff(_dataEnd, ptr) < (ptrdiff_t)op._fixedSize)
+					ThrowOverrun(program, ops[opIdx+1]);
+				runBase = ptr;
+				ptr = PtrAdd(ptr, op._fixedSize);
+				break;
+
+			case OpType::Value:
+				{
+					auto typeDesc = op._typeDesc;
+					const void* start;
+					if (op._inFixedRun) {
+						start = PtrAdd(runBase, op._runOffset);
+					} else {
+						if (op._expression != ~0u)
+							typeDesc._arrayCount = AsArrayCount(EvaluateExpression(program._expressions[op._expression], frame, ptr), program, op);
+						if (PtrDiff(_dataEnd, ptr) < (ptrdiff_t)typeDesc.GetSize())
+							ThrowOverrun(program, op);
+						start = ptr;
+						ptr = PtrAdd(ptr, typeDesc.GetSize());
+					}
+
+					ImpliedTyping::VariantNonRetained value { typeDesc, MakeIteratorRange(start, PtrAdd(start, typeDesc.GetSize())), _reversedEndian && typeDesc._type > ImpliedTyping::TypeCat::UInt8 };
+					_slotStack[frame._slotBase + op._slot] = value;
+					if (visitor) {
+						auto evalType = op._evalType;
+						if (op._dynamicType != ~0u)
+							evalType = ResolveDynamicType(program, op._dynamicType, frame, ptr);
+						visitor->OnValue(op._name, value, evalType);
+					}
+					break;
+				}
+
+			case OpType::ValueArray:
+				{
+					auto count = op._count;
+					auto elementSize = op._typeDesc.GetSize();
+					const void* start;
+					if (op._inFixedRun) {
+						start = PtrAdd(runBase, op._runOffset);
+					} else {
+						if (op._expression != ~0u)
+							count = AsArrayCount(EvaluateExpression(program._expressions[op._expression], frame, ptr), program, op);
+						if (PtrDiff(_dataEnd, ptr) < ptrdiff_t(size_t(count) * elementSize))
+							ThrowOverrun(program, op);
+						start = ptr;
+						ptr = PtrAdd(ptr, size_t(count) * elementSize);
+					}
+
+					bool reversedEndian = _reversedEndian && op._typeDesc._type > ImpliedTyping::TypeCat::UInt8;
+					// as per BinaryInputFormatter, only the first element is available for use in expressions
+					_slotStack[frame._slotBase + op._slot] = { op._typeDesc, MakeIteratorRange(start, PtrAdd(start, elementSize)), reversedEndian };
+					if (visitor) {
+						auto evalType = op._evalType;
+						if (op._dynamicType != ~0u)
+							evalType = ResolveDynamicType(program, op._dynamicType, frame, ptr);
+						ImpliedTyping::VariantNonRetained elements { op._typeDesc, MakeIteratorRange(start, PtrAdd(start, size_t(count) * elementSize)), reversedEndian };
+						visitor->OnValueArray(op._name, elements, count, evalType);
+					}
+					break;
+				}
+
+			case OpType::Block:
+				{
+					EvaluatedTypeToken type;
+					auto& subProgram = GetSubProgram(op, frame, ptr, type);
+					auto* blockStart = op._inFixedRun ? PtrAdd(runBase, op._runOffset) : ptr;
+					bool visitBlock = visitor && visitor->OnBeginBlock(op._name, type);
+					const void* blockEnd;
+					if (!visitBlock && subProgram._fixedSize.has_value()) {
+						if (PtrDiff(_dataEnd, blockStart) < (ptrdiff_t)subProgram._fixedSize.value())
+							ThrowOverrun(program, op);
+						blockEnd = PtrAdd(blockStart, subProgram._fixedSize.value());
+					} else
+						blockEnd = Execute(subProgram, blockStart, visitBlock ? visitor : nullptr, &frame);
+					if (!op._inFixedRun) ptr = blockEnd;
+					if (visitBlock) visitor->OnEndBlock();
+					break;
+				}
+
+			case OpType::BlockArray:
+				{
+					EvaluatedTypeToken type;
+					auto& subProgram = GetSubProgram(op, frame, ptr, type);
+					auto count = op._count;
+					if (op._expression != ~0u)
+						count = AsArrayCount(EvaluateExpression(program._expressions[op._expression], frame, ptr), program, op);
+					auto* arrayStart = op._inFixedRun ? PtrAdd(runBase, op._runOffset) : ptr;
+					bool visitArray = visitor && visitor->OnBeginArray(op._name, count, type);
+
+					const void* arrayEnd;
+					if (subProgram._fixedSize.has_value()) {
+						// fixed size elements; we can bounds check the entire array at once, and find the end without decoding
+						auto elementSize = subProgram._fixedSize.value();
+						if (PtrDiff(_dataEnd, arrayStart) < ptrdiff_t(elementSize * count))
+							ThrowOverrun(program, op);
+						if (visitArray) {
+							auto* element = arrayStart;
+							for (unsigned c=0; c<count; ++c, element=PtrAdd(element, elementSize))
+								if (visitor->OnBeginBlock(0, type)) {
+									Execute(subProgram, element, visitor, &frame);
+									visitor->OnEndBlock();
+								}
+						}
+						arrayEnd = PtrAdd(arrayStart, elementSize * count);
+					} else {
+						auto* element = arrayStart;
+						for (unsigned c=0; c<count; ++c) {
+							bool visitElement = visitArray && visitor->OnBeginBlock(0, type);
+							element = Execute(subProgram, element, visitElement ? visitor : nullptr, &frame);
+							if (visitElement) visitor->OnEndBlock();
+						}
+						arrayEnd = element;
+					}
+					if (!op._inFixedRun) ptr = arrayEnd;
+					if (visitArray) visitor->OnEndArray();
+					break;
+				}
+
+			case OpType::JumpIfFalse:
+				if (!EvaluateExpression(program._expressions[op._expression], frame, ptr)) {
+					opIdx = op._jumpTarget;
+					continue;
+				}
+				break;
+
+			case OpType::Throw:
+				{
+					VLA(int64_t, evaled, op._throwExpressionCount);
+					for (unsigned c=0; c<op._throwExpressionCount; ++c)
+						evaled[c] = EvaluateExpression(program._expressions[program._indexPool[op._throwExpressionsBegin+c]], frame, ptr);
+
+					std::stringstream str;
+					auto* cmds = op._throwCmds.begin();
+					for (;;) {
+						assert(cmds < op._throwCmds.end());
+						auto next = *cmds++;
+						if (!next) break;
+						if (int(next) < 0) {
+							int item = -int(next)-1;
+							assert(item < int(op._throwExpressionCount));
+							str << evaled[item];
+						} else {
+							str << (const char*)cmds;
+							cmds += next;
+						}
+					}
+					Throw(std::runtime_error(str.str()));
+				}
+			}
+			++opIdx;
+		}
+
+		_slotStack.resize(frame._slotBase);
+		return ptr;
+	}
+
+	int64_t BinaryDecoder::EvaluateExpression(const BinaryDecodeProgram::Expression& expr, const Frame& frame, const void* ptr)
+	{
+		if (expr._isConstant) return expr._constantValue;
+
+		if (expr._singleSlot != ~0u) {
+			const auto& value = _slotStack[frame._slotBase + expr._singleSlot];
+			if (value._type._type != ImpliedTyping::TypeCat::Void && value._type._typeHint != ImpliedTyping::TypeHint::String && value._type._arrayCount <= 1) {
+				int64_t result = 0;
+				bool castSuccess = value._reversedEndian
+					? ImpliedTyping::Cast_FlipEndian(MakeOpaqueIteratorRange(result), ImpliedTyping::TypeOf<int64_t>(), value._data, value._type)
+					: ImpliedTyping::Cast(MakeOpaqueIteratorRange(result), ImpliedTyping::TypeOf<int64_t>(), value._data, value._type);
+				if (castSuccess) return result;
+			}
+			// otherwise fall through to the full evaluation
+		}
+
+		// Lookup rules here should match BinaryInputFormatter::EvaluateExpression
+		const auto& tokenDictionary = frame._program->_definition->_tokenDictionary;
+		TRY {
+			uint8_t scratchBuffer[1024];
+			unsigned scratchIterator = 0;
+			Utility::Internal::ExpressionEvaluator exprEval{tokenDictionary, expr._tokens};
+			while (auto nextStep = exprEval.GetNextStep()) {
+				assert(nextStep._type == Utility::Internal::ExpressionEvaluator::StepType::LookupVariable);
+				uint64_t hash = tokenDictionary._tokenDefinitions[nextStep._nameTokenIndex].AsHashValue();
+
+				// ------------------------- system variables --------------------
+				if (hash == "align2"_h) {
+					nextStep.Return(PtrDiff(ptr, _originalStart) & 1);
+					continue;
+				} else if (hash == "align4"_h) {
+					auto v = PtrDiff(ptr, _originalStart) & 3;
+					nextStep.Return((v == 0) ? 0 : 4-v);
+					continue;
+				} else if (hash == "align8"_h) {
+					auto v = PtrDiff(ptr, _originalStart) & 7;
+					nextStep.Return((v == 0) ? 0 : 8-v);
+					continue;
+				} else if (hash == "nullterm"_h) {
+					auto remaining = PtrDiff(_dataEnd, ptr);
+					ptrdiff_t v = 0;
+					while (v < remaining && ((const uint8_t*)ptr)[v] != 0) ++v;
+					nextStep.Return(v);
+					continue;
+				} else if (hash == "remainingbytes"_h) {
+					nextStep.Return(size_t(PtrDiff(_dataEnd, ptr)));
+					continue;
+				}
+
+				// ------------------------- previously decoded members & template parameters --------------------
+				bool gotValue = false;
+				for (auto* f=&frame; f && !gotValue; f=f->_parent) {
+					const auto& slotNames = f->_program->_slotNames;
+					for (unsigned s=0; s<(unsigned)slotNames.size(); ++s) {
+						if (slotNames[s] != hash) continue;
+						const auto& value = _slotStack[f->_slotBase + s];
+						if (value._type._type == ImpliedTyping::TypeCat::Void) continue;		// not decoded (yet)
+
+						if (value._type._typeHint == ImpliedTyping::TypeHint::String && (value._type._type == ImpliedTyping::TypeCat::UInt8 || value._type._type == ImpliedTyping::TypeCat::Int8)) {
+							if (scratchIterator == dimof(scratchBuffer))
+								Throw(std::runtime_error("Parsing buffer exceeded in expression evaluation in BinaryDecoder."));
+							auto parsedType = ImpliedTyping::ParseFullMatch(
+								MakeStringSection((const char*)value._data.begin(), (const char*)value._data.end()),
+								MakeIteratorRange(&scratchBuffer[scratchIterator], &scratchBuffer[dimof(scratchBuffer)]));
+							if (parsedType._type != ImpliedTyping::TypeCat::Void) {
+								nextStep.Return(ImpliedTyping::VariantNonRetained{parsedType, MakeIteratorRange(&scratchBuffer[scratchIterator], &scratchBuffer[scratchIterator+parsedType.GetSize()])});
+								scratchIterator += parsedType.GetSize();
+							}
+						} else if (value._reversedEndian) {
+							// flip endian early in order to avoid pushing flipped endian values into ExpressionEvaluator
+							auto size = value._type.GetSize();
+							if (size > 8)
+								Throw(std::runtime_error("Attempting to use a reversed endian large type with a conditional statement. This isn't supported"));
+							if (scratchIterator + size > dimof(scratchBuffer))
+								Throw(std::runtime_error("Parsing buffer exceeded in expression evaluation in BinaryDecoder."));
+							auto buffer = MakeIteratorRange(&scratchBuffer[scratchIterator], &scratchBuffer[scratchIterator+size]);
+							ImpliedTyping::FlipEndian(buffer, value._data.begin(), value._type);
+							nextStep.Return(ImpliedTyping::VariantNonRetained{value._type, buffer});
+							scratchIterator += size;
+						} else {
+							nextStep.Return(value);
+						}
+						gotValue = true;
+						break;
+					}
+
+					// template variables (only for the immediately enclosing block)
+					if (!gotValue && f == &frame) {
+						const auto& def = *f->_program->_definition;
+						for (unsigned p=0; p<(unsigned)def._templateParameterNames.size(); ++p)
+							if (def._templateParameterNames[p] == nextStep._nameTokenIndex) {
+								assert(!(f->_program->_templateParamsTypeField & (1<<p)));		// assert value, not type parameter
+								nextStep.ReturnNonRetained(f->_program->_templateParams[p]);
+								gotValue = true;
+								break;
+							}
+					}
+				}
+				if (gotValue) continue;
+
+				// ------------------------- global parameters --------------------
+				auto& globals = _evalContext->GetGlobalParameters();
+				auto globalType = globals.GetParameterType(hash);
+				if (globalType._type != ImpliedTyping::TypeCat::Void)
+					nextStep.Return(ImpliedTyping::VariantNonRetained{globalType, globals.GetParameterRawValue(hash)});
+			}
+
+			auto result = exprEval.GetResult();
+			int64_t resultValue = 0;
+			if (!ImpliedTyping::Cast(MakeOpaqueIteratorRange(resultValue), ImpliedTyping::TypeOf<int64_t>(), result._data, result._type))
+				Throw(std::runtime_error("Invalid expression or returned value that could not be cast to scalar integral in formatter expression evaluation"));
+			return resultValue;
+
+		} CATCH(const std::exception& e) {
+			auto exprString = tokenDictionary.AsString(expr._tokens);
+			Throw(std::runtime_error(e.what() + std::string{", while evaluating ["} + exprString + "]"));
+		} CATCH_END
+	}
+
+	auto BinaryDecoder::ResolveDynamicType(const BinaryDecodeProgram& program, unsigned dynamicType, const Frame& frame, const void* ptr) -> EvaluatedTypeToken
+	{
+		using DynamicType = BinaryDecodeProgram::DynamicType;
+		const auto& dynType = program._dynamicTypes[dynamicType];
+		auto paramCount = (unsigned)dynType._params.size();
+		VLA(int64_t, params, paramCount);
+		unsigned typeBitField = 0;
+		for (unsigned p=0; p<paramCount; ++p) {
+			const auto& src = dynType._params[p];
+			switch (src._source) {
+			case DynamicType::ParamSource::Constant:
+				params[p] = src._value;
+				break;
+			case DynamicType::ParamSource::Expression:
+				params[p] = EvaluateExpression(program._expressions[(unsigned)src._value], frame, ptr);
+				break;
+			case DynamicType::ParamSource::TypeToken:
+				params[p] = src._value;
+				typeBitField |= 1 << p;
+				break;
+			case DynamicType::ParamSource::DynamicType:
+				params[p] = ResolveDynamicType(program, (unsigned)src._value, frame, ptr);
+				typeBitField |= 1 << p;
+				break;
+			}
+		}
+		auto baseName = program._definition->_tokenDictionary._tokenDefinitions[dynType._baseNameToken].AsStringSection();
+		return _evalContext->GetEvaluatedType(program._schemata, baseName, program._blockDefinitionId, MakeIteratorRange(params, &params[paramCount]), typeBitField);
+	}
+
+	const BinaryDecodeProgram& BinaryDecoder::GetSubProgram(const Op& op, const Frame& frame, const void* ptr, EvaluatedTypeToken& resolvedType)
+	{
+		if (op._dynamicType != ~0u) {
+			resolvedType = ResolveDynamicType(*frame._program, op._dynamicType, frame, ptr);
+		} else {
+			resolvedType = op._evalType;
+			if (op._subProgram) return *op._subProgram;		// linked while compiling, with shadowing already accounted for
+		}
+
+		// Global parameters folded into the program must not be shadowed by a member of any enclosing block
+		// (BinaryInputFormatter searches the enclosing blocks before the globals)
+		auto* result = &GetProgram(resolvedType, frame._program->_foldGlobals);
+		if (!result->_foldedGlobals.empty())
+			for (auto* f=&frame; f; f=f->_parent)
+				if (Internal::ShadowsAny(f->_program->_slotNames, result->_foldedGlobals)) {
+					result = &GetProgram(resolvedType, false);
+					break;
+				}
+
+		// only programs that are valid in any context can be linked permanently
+		if (op._dynamicType == ~0u && result->_foldedGlobals.empty())
+			op._subProgram = result;
+		return *result;
+	}
+
+	void BinaryDecoder::ThrowOverrun(const BinaryDecodeProgram& program, const Op& op)
+	{
+		Throw(std::runtime_error(
+			"Binary Schemata reads past the end of data while reading block " + program._schemata->GetBlockDefinitionName(program._blockDefinitionId)
+			+ ", member: " + program._definition->_tokenDictionary._tokenDefinitions[op._nameToken].AsStringSection().AsString()));
+	}
+
+	BinaryDecoder::BinaryDecoder(std::shared_ptr<EvaluationContext> evalContext)
+	: _evalContext(std::move(evalContext))
+	{
+		assert(_evalContext);
+	}
+
+	BinaryDecoder::~BinaryDecoder() = default;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	void IBinaryDecodeVisitor::OnValueArray(uint64_t name, const ImpliedTyping::VariantNonRetained& elements, unsigned count, EvaluatedTypeToken elementType)
+	{
+		if (!OnBeginArray(name, count, elementType)) return;
+		auto elementSize = elements._type.GetSize();
+		for (unsigned c=0; c<count; ++c) {
+			auto* e = PtrAdd(elements._data.begin(), size_t(c) * elementSize);
+			OnValue(0, ImpliedTyping::VariantNonRetained{elements._type, MakeIteratorRange(e, PtrAdd(e, elementSize)), elements._reversedEndian}, elementType);
+		}
+		OnEndArray();
+	}
+
+	IBinaryDecodeVisitor::~IBinaryDecodeVisitor() = default;
+}
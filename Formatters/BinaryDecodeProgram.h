@@ -0,0 +1,177 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "BinaryFormatter.h"
+#include "../Utility/ImpliedTyping.h"
+#include "../Utility/IteratorUtils.h"
+#include <vector>
+#include <memory>
+
+namespace Formatters
+{
+	/// <summary>Receives the decoded members of a block from BinaryDecoder</summary>
+	///
+	/// Members arrive in the same order and with the same nesting that BinaryInputFormatter would return
+	/// them. Data ranges always point directly into the source buffer. When the decoder is configured for
+	/// reversed endian, VariantNonRetained::_reversedEndian will be set on multi-byte values and the visitor
+	/// is responsible for flipping them.
+	///
+	/// Names are passed as hash values (the same hashes returned by BinaryInputFormatter::TryKeyedItem(uint64_t&)).
+	/// Array elements are passed with a name of 0.
+	class IBinaryDecodeVisitor
+	{
+	public:
+		using EvaluatedTypeToken = EvaluationContext::EvaluatedTypeToken;
+
+		virtual void OnValue(uint64_t name, const ImpliedTyping::VariantNonRetained& value, EvaluatedTypeToken evaluatedType) = 0;
+
+		/// Return false to skip over the contents of the block. Blocks of fixed size are skipped without decoding
+		virtual bool OnBeginBlock(uint64_t name, EvaluatedTypeToken evaluatedType) = 0;
+		virtual void OnEndBlock() = 0;
+
+		/// Return false to skip over all elements of the array
+		virtual bool OnBeginArray(uint64_t name, unsigned count, EvaluatedTypeToken elementType) = 0;
+		virtual void OnEndArray() = 0;
+
+		/// <summary>Called for arrays of values that can't be collapsed into a single value</summary>
+		/// For example, arrays of aliased types or arrays of vectors. The elements are tightly packed in
+		/// "elements._data", and "elements._type" describes a single element. The default implementation
+		/// expands into OnBeginArray / OnValue / OnEndArray (matching BinaryInputFormatter), but visitors
+		/// can override it to copy the entire range in one go.
+		virtual void OnValueArray(uint64_t name, const ImpliedTyping::VariantNonRetained& elements, unsigned count, EvaluatedTypeToken elementType);
+
+		virtual ~IBinaryDecodeVisitor();
+	};
+
+	/// <summary>Flattened form of a BinarySchemata block definition, for a single evaluated type</summary>
+	///
+	/// The command list of the block definition is lowered into a list of ops with type lookups
+	/// resolved, constant expressions folded and consecutive fixed size members grouped into "fixed runs".
+	/// Members within a fixed run have precomputed offsets and require no bounds checks or expression
+	/// evaluation while decoding.
+	///
+	/// Global parameters from the EvaluationContext are folded in at compile time; BinaryDecoder will
+	/// recompile when they change. A member of an enclosing block shadows a global parameter with the same
+	/// name, so each program records which globals it folded (including those folded into statically linked
+	/// sub-programs), and BinaryDecoder falls back to a variant compiled without global folding wherever
+	/// one of those names is declared by an enclosing block.
+	class BinaryDecodeProgram
+	{
+	public:
+		enum class OpType : uint8_t { FixedRun, Value, ValueArray, Block, BlockArray, JumpIfFalse, Throw };
+		struct Op
+		{
+			OpType _type = OpType::Value;
+			bool _inFixedRun = false;
+			unsigned _nameToken = ~0u;
+			uint64_t _name = 0;
+			EvaluationContext::EvaluatedTypeToken _evalType = ~0u;
+			unsigned _dynamicType = ~0u;
+			ImpliedTyping::TypeDesc _typeDesc { ImpliedTyping::TypeCat::Void };		// for arrays, this is the element type
+			unsigned _slot = ~0u;
+			unsigned _count = 1;
+			unsigned _expression = ~0u;			// array count, or condition for JumpIfFalse
+			size_t _fixedSize = 0;				// for FixedRun ops, the size of the entire run
+			size_t _runOffset = 0;
+			unsigned _jumpTarget = ~0u;
+			unsigned _throwExpressionsBegin = 0, _throwExpressionCount = 0;
+			IteratorRange<const unsigned*> _throwCmds;
+			mutable const BinaryDecodeProgram* _subProgram = nullptr;
+		};
+
+		struct Expression
+		{
+			IteratorRange<const unsigned*> _tokens;
+			bool _isConstant = false;
+			int64_t _constantValue = 0;
+			unsigned _singleSlot = ~0u;			// expression is just a lookup of a previous member of this block
+		};
+
+		struct DynamicType
+		{
+			enum class ParamSource : uint8_t { Constant, Expression, TypeToken, DynamicType };
+			struct Param { ParamSource _source; int64_t _value; };
+			unsigned _baseNameToken = ~0u;
+			std::vector<Param> _params;
+			bool _isBlock = false;
+			bool _isCharAlias = false;
+			ImpliedTyping::TypeDesc _valueTypeDesc { ImpliedTyping::TypeCat::Void };
+		};
+
+		std::vector<Op> _ops;
+		std::vector<Expression> _expressions;
+		std::vector<DynamicType> _dynamicTypes;
+		std::vector<unsigned> _indexPool;
+		std::vector<uint64_t> _slotNames;
+		std::vector<uint64_t> _foldedGlobals;		// sorted; names of global parameters this program depends on being unshadowed
+		bool _foldGlobals = true;
+
+		EvaluationContext::EvaluatedTypeToken _evalType = ~0u;
+		std::shared_ptr<BinarySchemata> _schemata;
+		BinarySchemata::BlockDefinitionId _blockDefinitionId = BinarySchemata::BlockDefinitionId_Invalid;
+		const BlockDefinition* _definition = nullptr;
+		std::vector<int64_t> _templateParams;
+		uint32_t _templateParamsTypeField = 0;
+
+		std::optional<size_t> _fixedSize;		// set when the block is made up only of members with sizes known at compile time
+
+		bool IsFixedSize() const { return _fixedSize.has_value(); }
+	};
+
+	/// <summary>Decodes binary data described by a BinarySchemata using precompiled decode programs</summary>
+	///
+	/// This is an alternative to BinaryInputFormatter for large files. Instead of interpreting the command list of
+	/// each block as it goes, each evaluated block type is compiled once into a BinaryDecodeProgram, and decoded
+	/// members are pushed directly into an IBinaryDecodeVisitor.
+	///
+	/// Not thread safe (in the same way that EvaluationContext is not thread safe)
+	class BinaryDecoder
+	{
+	public:
+		using EvaluatedTypeToken = EvaluationContext::EvaluatedTypeToken;
+
+		/// Decode the members of the given block type from the start of "data". Returns the data remaining after the block
+		IteratorRange<const void*> Decode(IteratorRange<const void*> data, EvaluatedTypeToken blockType, IBinaryDecodeVisitor& visitor);
+		IteratorRange<const void*> Decode(
+			IteratorRange<const void*> data,
+			const std::shared_ptr<BinarySchemata>& schemata, BinarySchemata::BlockDefinitionId blockDefId,
+			IBinaryDecodeVisitor& visitor,
+			IteratorRange<const int64_t*> templateParams = {}, uint32_t templateParamsTypeField = 0u);
+
+		const BinaryDecodeProgram& GetProgram(EvaluatedTypeToken blockType, bool foldGlobals = true);
+		EvaluatedTypeToken GetBlockType(const std::shared_ptr<BinarySchemata>& schemata, BinarySchemata::BlockDefinitionId blockDefId, IteratorRange<const int64_t*> templateParams = {}, uint32_t templateParamsTypeField = 0u);
+
+		bool ReversedEndian() const { return _reversedEndian; }
+		void SetReversedEndian(bool newState) { _reversedEndian = newState; }
+		const std::shared_ptr<EvaluationContext>& GetEvaluationContext() const { return _evalContext; }
+
+		explicit BinaryDecoder(std::shared_ptr<EvaluationContext> evalContext = std::make_shared<EvaluationContext>());
+		~BinaryDecoder();
+		BinaryDecoder(BinaryDecoder&&) = default;
+		BinaryDecoder& operator=(BinaryDecoder&&) = default;
+
+	private:
+		std::shared_ptr<EvaluationContext> _evalContext;
+		std::vector<std::pair<EvaluatedTypeToken, std::unique_ptr<BinaryDecodeProgram>>> _programs;
+		std::vector<std::pair<EvaluatedTypeToken, std::unique_ptr<BinaryDecodeProgram>>> _unfoldedPrograms;
+		std::vector<EvaluatedTypeToken> _compilingTypes;
+		std::vector<ImpliedTyping::VariantNonRetained> _slotStack;
+		unsigned _globalStateChangeId = ~0u;
+		bool _reversedEndian = false;
+
+		const void* _originalStart = nullptr;
+		const void* _dataEnd = nullptr;
+
+		struct Frame;
+		std::unique_ptr<BinaryDecodeProgram> Compile(EvaluatedTypeToken blockType, bool foldGlobals);
+		unsigned CompileExpression(BinaryDecodeProgram& program, IteratorRange<const unsigned*> tokens);
+		const void* Execute(const BinaryDecodeProgram& program, const void* ptr, IBinaryDecodeVisitor* visitor, const Frame* parent);
+		int64_t EvaluateExpression(const BinaryDecodeProgram::Expression& expr, const Frame& frame, const void* ptr);
+		EvaluatedTypeToken ResolveDynamicType(const BinaryDecodeProgram& program, unsigned dynamicType, const Frame& frame, const void* ptr);
+		const BinaryDecodeProgram& GetSubProgram(const BinaryDecodeProgram::Op& op, const Frame& frame, const void* ptr, EvaluatedTypeToken& resolvedType);
+		[[noreturn]] void ThrowOverrun(const BinaryDecodeProgram& program, const BinaryDecodeProgram::Op& op);
+	};
+}
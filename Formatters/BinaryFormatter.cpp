@@ -382,11 +382,13 @@ namespace Formatters
 	{
 		_globalState.SetParameter(name, value);
 		_calculatedSizeStates.clear();		// global parameters can invalidate calculated sizes -- so we must clear and recalculate them all
+		++_globalStateChangeId;
 	}
 
 	ParameterBox& EvaluationContext::GetGlobalParameterBox()
 	{
 		_calculatedSizeStates.clear();		// global parameters can invalidate calculated sizes -- so we must clear and recalculate them all
+		++_globalStateChangeId;
 		return _globalState;
 	}
 
@@ -517,9 +519,10 @@ namespace Formatters
 				}
 
 				if (!gotValue) {
-					auto globalType = this->_evalContext->GetGlobalParameterBox().GetParameterType(hash);
+					auto& globals = this->_evalContext->GetGlobalParameters();
+					auto globalType = globals.GetParameterType(hash);
 					if (globalType._type != ImpliedTyping::TypeCat::Void) {
-						nextStep.Return(ImpliedTyping::VariantNonRetained{globalType, this->_evalContext->GetGlobalParameterBox().GetParameterRawValue(hash)});
+						nextStep.Return(ImpliedTyping::VariantNonRetained{globalType, globals.GetParameterRawValue(hash)});
 						gotValue = true;
 					}
 				}
@@ -147,6 +147,8 @@ namespace Formatters
 
 		void SetGlobalParameter(StringSection<> name, int64_t value);
 		ParameterBox& GetGlobalParameterBox();
+		const ParameterBox& GetGlobalParameters() const { return _globalState; }
+		unsigned GetGlobalStateChangeId() const { return _globalStateChangeId; }
 
 		EvaluationContext();
 		~EvaluationContext();
@@ -163,6 +165,7 @@ namespace Formatters
 		};
 		mutable std::vector<CalculatedSizeState> _calculatedSizeStates;
 		std::vector<std::pair<uint64_t, std::unique_ptr<CachedSubEvals>>> _cachedSubEvals;
+		unsigned _globalStateChangeId = 0;
 	};
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,545 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "BatchTransformations.h"
+#include "Transformations.h"
+#include "Matrix.h"
+#include "SIMDLanes_Internal.h"
+#include <algorithm>
+#include <cmath>
+#include <assert.h>
+
+namespace XLEMath
+{
+    static_assert(sizeof(Float3) == 3*sizeof(float), "Expecting tightly packed vectors");
+    static_assert(sizeof(Float3x3) == 9*sizeof(float) && sizeof(Float3x4) == 12*sizeof(float) && sizeof(Float4x4) == 16*sizeof(float), "Expecting tightly packed matrices");
+    static_assert(sizeof(Quaternion) == 4*sizeof(float), "Expecting tightly packed quaternions");
+
+    static const float* FloatsOf(const Float4x4& m) { return &m(0,0); }
+    static const float* FloatsOf(const Float3x4& m) { return &m(0,0); }
+    static float* FloatsOf(Float4x4& m) { return &m(0,0); }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+        //      Combine
+        //
+        //      These work on one transform at a time, since each row of the result is just a
+        //      weighted sum of the rows of "first" (ie, result row r = sum(second(r,k) * first row k))
+
+    static void Combine4x4(float* dst, const float* first, const float* second)
+    {
+        #if defined(HAS_AVX2_INSTRUCTIONS)
+                // 2 rows of the result at a time
+            auto f0 = _mm256_broadcast_ps((const __m128*)(first+0)), f1 = _mm256_broadcast_ps((const __m128*)(first+4));
+            auto f2 = _mm256_broadcast_ps((const __m128*)(first+8)), f3 = _mm256_broadcast_ps((const __m128*)(first+12));
+            auto s01 = _mm256_loadu_ps(second+0), s23 = _mm256_loadu_ps(second+8);
+            auto r01 = _mm256_mul_ps(_mm256_shuffle_ps(s01, s01, 0x00), f0);
+            auto r23 = _mm256_mul_ps(_mm256_shuffle_ps(s23, s23, 0x00), f0);
+            r01 = _mm256_add_ps(r01, _mm256_mul_ps(_mm256_shuffle_ps(s01, s01, 0x55), f1));
+            r23 = _mm256_add_ps(r23, _mm256_mul_ps(_mm256_shuffle_ps(s23, s23, 0x55), f1));
+            r01 = _mm256_add_ps(r01, _mm256_mul_ps(_mm256_shuffle_ps(s01, s01, 0xaa), f2));
+            r23 = _mm256_add_ps(r23, _mm256_mul_ps(_mm256_shuffle_ps(s23, s23, 0xaa), f2));
+            r01 = _mm256_add_ps(r01, _mm256_mul_ps(_mm256_shuffle_ps(s01, s01, 0xff), f3));
+            r23 = _mm256_add_ps(r23, _mm256_mul_ps(_mm256_shuffle_ps(s23, s23, 0xff), f3));
+            _mm256_storeu_ps(dst+0, r01);
+            _mm256_storeu_ps(dst+8, r23);
+        #elif defined(HAS_SSE_INSTRUCTIONS)
+            auto f0 = _mm_loadu_ps(first+0), f1 = _mm_loadu_ps(first+4), f2 = _mm_loadu_ps(first+8), f3 = _mm_loadu_ps(first+12);
+            for (unsigned r=0; r<4; ++r) {
+                auto s = _mm_loadu_ps(second+r*4);
+                auto v = _mm_mul_ps(_mm_shuffle_ps(s, s, 0x00), f0);
+                v = _mm_add_ps(v, _mm_mul_ps(_mm_shuffle_ps(s, s, 0x55), f1));
+                v = _mm_add_ps(v, _mm_mul_ps(_mm_shuffle_ps(s, s, 0xaa), f2));
+                v = _mm_add_ps(v, _mm_mul_ps(_mm_shuffle_ps(s, s, 0xff), f3));
+                _mm_storeu_ps(dst+r*4, v);
+            }
+        #else
+            float result[16];
+            for (unsigned r=0; r<4; ++r)
+                for (unsigned c=0; c<4; ++c)
+                    result[r*4+c] = second[r*4+0] * first[0*4+c] + second[r*4+1] * first[1*4+c] + second[r*4+2] * first[2*4+c] + second[r*4+3] * first[3*4+c];
+            std::copy(result, &result[16], dst);
+        #endif
+    }
+
+    static void Combine3x4(float* dst, const float* first, const float* second)
+    {
+        #if defined(HAS_SSE_INSTRUCTIONS)
+                // the implied bottom row of (0,0,0,1) means the translation column of "second" is added directly
+            auto f0 = _mm_loadu_ps(first+0), f1 = _mm_loadu_ps(first+4), f2 = _mm_loadu_ps(first+8);
+            auto zero = _mm_setzero_ps();
+            for (unsigned r=0; r<3; ++r) {
+                auto s = _mm_loadu_ps(second+r*4);
+                auto v = _mm_mul_ps(_mm_shuffle_ps(s, s, 0x00), f0);
+                v = _mm_add_ps(v, _mm_mul_ps(_mm_shuffle_ps(s, s, 0x55), f1));
+                v = _mm_add_ps(v, _mm_mul_ps(_mm_shuffle_ps(s, s, 0xaa), f2));
+                v = _mm_add_ps(v, _mm_blend_ps(zero, s, 0x8));
+                _mm_storeu_ps(dst+r*4, v);
+            }
+        #else
+            float result[12];
+            for (unsigned r=0; r<3; ++r)
+                for (unsigned c=0; c<4; ++c)
+                    result[r*4+c] = second[r*4+0] * first[0*4+c] + second[r*4+1] * first[1*4+c] + second[r*4+2] * first[2*4+c] + ((c==3) ? second[r*4+3] : 0.f);
+            std::copy(result, &result[12], dst);
+        #endif
+    }
+
+    void BatchCombine(IteratorRange<Float4x4*> dst, IteratorRange<const Float4x4*> first, IteratorRange<const Float4x4*> second)
+    {
+        assert(dst.size() == first.size() && dst.size() == second.size());
+        for (size_t i=0; i<dst.size(); ++i)
+            Combine4x4(FloatsOf(dst[i]), FloatsOf(first[i]), FloatsOf(second[i]));
+    }
+
+    void BatchCombine(IteratorRange<Float4x4*> dst, IteratorRange<const Float4x4*> first, const Float4x4& second)
+    {
+        assert(dst.size() == first.size());
+        Float4x4 s = second;        // (copy incase "second" is within "dst")
+        for (size_t i=0; i<dst.size(); ++i)
+            Combine4x4(FloatsOf(dst[i]), FloatsOf(first[i]), FloatsOf(s));
+    }
+
+    void BatchCombine(IteratorRange<Float4x4*> dst, const Float4x4& first, IteratorRange<const Float4x4*> second)
+    {
+        assert(dst.size() == second.size());
+        Float4x4 f = first;
+        for (size_t i=0; i<dst.size(); ++i)
+            Combine4x4(FloatsOf(dst[i]), FloatsOf(f), FloatsOf(second[i]));
+    }
+
+    void BatchCombine(IteratorRange<Float3x4*> dst, IteratorRange<const Float3x4*> first, IteratorRange<const Float3x4*> second)
+    {
+        assert(dst.size() == first.size() && dst.size() == second.size());
+        for (size_t i=0; i<dst.size(); ++i)
+            Combine3x4(&dst[i](0,0), FloatsOf(first[i]), FloatsOf(second[i]));
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+        //      The remaining functions work on s_laneCount elements at once, with one element
+        //      per SIMD lane
+
+#if defined(HAS_SSE_INSTRUCTIONS)
+
+    static const float* FloatsOf(const Quaternion& q) { return &q[0]; }
+    static float* FloatsOf(Float3x3& m) { return &m(0,0); }
+    static float* FloatsOf(Quaternion& q) { return &q[0]; }
+
+        // Run "kernel" over groups of s_laneCount Float3s. The final partial group is copied through a temporary buffer
+    template<typename Kernel>
+        static void ForEachFloat3Group(IteratorRange<Float3*> dst, IteratorRange<const Float3*> src, Kernel&& kernel)
+    {
+        assert(dst.size() == src.size());
+        size_t count = src.size(), i=0;
+        for (; (i+s_laneCount)<=count; i+=s_laneCount) {
+            LaneVector x, y, z;
+            LoadFloat3Lanes(x, y, z, &src[i][0]);
+            kernel(x, y, z);
+            StoreFloat3Lanes(&dst[i][0], x, y, z);
+        }
+        if (i < count) {
+            Float3 temp[s_laneCount];
+            std::fill(temp, &temp[s_laneCount], Float3(0.f, 0.f, 0.f));
+            std::copy(&src[i], src.end(), temp);
+            LaneVector x, y, z;
+            LoadFloat3Lanes(x, y, z, &temp[0][0]);
+            kernel(x, y, z);
+            StoreFloat3Lanes(&temp[0][0], x, y, z);
+            std::copy(temp, &temp[count-i], &dst[i]);
+        }
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+        // (x0*y0 - x1*y1 + x2*y2) * scale
+    static force_inline LaneVector CofactorTerm(LaneVector x0, LaneVector y0, LaneVector x1, LaneVector y1, LaneVector x2, LaneVector y2, LaneVector scale)
+    {
+        return LaneMul(LaneAdd(LaneSub(LaneMul(x0, y0), LaneMul(x1, y1)), LaneMul(x2, y2)), scale);
+    }
+
+        // (-x0*y0 + x1*y1 - x2*y2) * scale
+    static force_inline LaneVector NegCofactorTerm(LaneVector x0, LaneVector y0, LaneVector x1, LaneVector y1, LaneVector x2, LaneVector y2, LaneVector scale)
+    {
+        return LaneMul(LaneSub(LaneSub(LaneMul(x1, y1), LaneMul(x0, y0)), LaneMul(x2, y2)), scale);
+    }
+
+    static void InverseLanes(LaneVector b[16], const LaneVector a[16])
+    {
+            // Cofactor expansion, sharing the 2x2 sub-determinants of the top 2 rows (s*) & bottom 2 rows (c*)
+        auto s0 = LaneSub(LaneMul(a[ 0], a[ 5]), LaneMul(a[ 4], a[ 1]));
+        auto s1 = LaneSub(LaneMul(a[ 0], a[ 6]), LaneMul(a[ 4], a[ 2]));
+        auto s2 = LaneSub(LaneMul(a[ 0], a[ 7]), LaneMul(a[ 4], a[ 3]));
+        auto s3 = LaneSub(LaneMul(a[ 1], a[ 6]), LaneMul(a[ 5], a[ 2]));
+        auto s4 = LaneSub(LaneMul(a[ 1], a[ 7]), LaneMul(a[ 5], a[ 3]));
+        auto s5 = LaneSub(LaneMul(a[ 2], a[ 7]), LaneMul(a[ 6], a[ 3]));
+
+        auto c5 = LaneSub(LaneMul(a[10], a[15]), LaneMul(a[14], a[11]));
+        auto c4 = LaneSub(LaneMul(a[ 9], a[15]), LaneMul(a[13], a[11]));
+        auto c3 = LaneSub(LaneMul(a[ 9], a[14]), LaneMul(a[13], a[10]));
+        auto c2 = LaneSub(LaneMul(a[ 8], a[15]), LaneMul(a[12], a[11]));
+        auto c1 = LaneSub(LaneMul(a[ 8], a[14]), LaneMul(a[12], a[10]));
+        auto c0 = LaneSub(LaneMul(a[ 8], a[13]), LaneMul(a[12], a[ 9]));
+
+        auto det = LaneMul(s0, c5);
+        det = LaneSub(det, LaneMul(s1, c4));
+        det = LaneAdd(det, LaneMul(s2, c3));
+        det = LaneAdd(det, LaneMul(s3, c2));
+        det = LaneSub(det, LaneMul(s4, c1));
+        det = LaneAdd(det, LaneMul(s5, c0));
+        auto invDet = LaneDiv(LaneSplat(1.f), det);
+
+        b[ 0] = CofactorTerm(a[ 5], c5, a[ 6], c4, a[ 7], c3, invDet);
+        b[ 1] = NegCofactorTerm(a[ 1], c5, a[ 2], c4, a[ 3], c3, invDet);
+        b[ 2] = CofactorTerm(a[13], s5, a[14], s4, a[15], s3, invDet);
+        b[ 3] = NegCofactorTerm(a[ 9], s5, a[10], s4, a[11], s3, invDet);
+
+        b[ 4] = NegCofactorTerm(a[ 4], c5, a[ 6], c2, a[ 7], c1, invDet);
+        b[ 5] = CofactorTerm(a[ 0], c5, a[ 2], c2, a[ 3], c1, invDet);
+        b[ 6] = NegCofactorTerm(a[12], s5, a[14], s2, a[15], s1, invDet);
+        b[ 7] = CofactorTerm(a[ 8], s5, a[10], s2, a[11], s1, invDet);
+
+        b[ 8] = CofactorTerm(a[ 4], c4, a[ 5], c2, a[ 7], c0, invDet);
+        b[ 9] = NegCofactorTerm(a[ 0], c4, a[ 1], c2, a[ 3], c0, invDet);
+        b[10] = CofactorTerm(a[12], s4, a[13], s2, a[15], s0, invDet);
+        b[11] = NegCofactorTerm(a[ 8], s4, a[ 9], s2, a[11], s0, invDet);
+
+        b[12] = NegCofactorTerm(a[ 4], c3, a[ 5], c1, a[ 6], c0, invDet);
+        b[13] = CofactorTerm(a[ 0], c3, a[ 1], c1, a[ 2], c0, invDet);
+        b[14] = NegCofactorTerm(a[12], s3, a[13], s1, a[14], s0, invDet);
+        b[15] = CofactorTerm(a[ 8], s3, a[ 9], s1, a[10], s0, invDet);
+    }
+
+    void BatchInverse(IteratorRange<Float4x4*> dst, IteratorRange<const Float4x4*> src)
+    {
+        assert(dst.size() == src.size());
+        for (size_t i=0; i<src.size(); i+=s_laneCount) {
+            const float* srcLanes[s_laneCount];
+            float* dstLanes[s_laneCount];
+            LanePointers(srcLanes, src, i, [](const Float4x4& m) { return FloatsOf(m); });
+            LanePointers(dstLanes, dst, i, [](Float4x4& m) { return FloatsOf(m); });
+
+            LaneVector a[16], b[16];
+            GatherLanes(a, srcLanes, 16);
+            InverseLanes(b, a);
+            ScatterLanes(dstLanes, (unsigned)std::min(size_t(s_laneCount), src.size()-i), b, 16);
+        }
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    void BatchTransformPoints(IteratorRange<Float3*> dst, const Float4x4& transform, IteratorRange<const Float3*> src)
+    {
+        LaneVector m[12];
+        for (unsigned c=0; c<12; ++c) m[c] = LaneSplat(transform(c/4, c%4));
+        ForEachFloat3Group(dst, src,
+            [&m](LaneVector& x, LaneVector& y, LaneVector& z) {
+                auto rx = LaneMulAdd(m[ 0], x, LaneMulAdd(m[ 1], y, LaneMulAdd(m[ 2], z, m[ 3])));
+                auto ry = LaneMulAdd(m[ 4], x, LaneMulAdd(m[ 5], y, LaneMulAdd(m[ 6], z, m[ 7])));
+                auto rz = LaneMulAdd(m[ 8], x, LaneMulAdd(m[ 9], y, LaneMulAdd(m[10], z, m[11])));
+                x = rx; y = ry; z = rz;
+            });
+    }
+
+    static force_inline void TransformLanes3x3(LaneVector& x, LaneVector& y, LaneVector& z, const LaneVector m[9])
+    {
+        auto rx = LaneAdd(LaneAdd(LaneMul(m[0], x), LaneMul(m[1], y)), LaneMul(m[2], z));
+        auto ry = LaneAdd(LaneAdd(LaneMul(m[3], x), LaneMul(m[4], y)), LaneMul(m[5], z));
+        auto rz = LaneAdd(LaneAdd(LaneMul(m[6], x), LaneMul(m[7], y)), LaneMul(m[8], z));
+        x = rx; y = ry; z = rz;
+    }
+
+    void BatchTransformDirectionVectors(IteratorRange<Float3*> dst, const Float4x4& transform, IteratorRange<const Float3*> src)
+    {
+        LaneVector m[9];
+        for (unsigned c=0; c<9; ++c) m[c] = LaneSplat(transform(c/3, c%3));
+        ForEachFloat3Group(dst, src,
+            [&m](LaneVector& x, LaneVector& y, LaneVector& z) { TransformLanes3x3(x, y, z, m); });
+    }
+
+    void BatchTransformNormals(IteratorRange<Float3*> dst, const Float4x4& transform, IteratorRange<const Float3*> src)
+    {
+        auto normalTransform = Transpose(Inverse(Truncate3x3(transform)));
+        LaneVector m[9];
+        for (unsigned c=0; c<9; ++c) m[c] = LaneSplat(normalTransform(c/3, c%3));
+        ForEachFloat3Group(dst, src,
+            [&m](LaneVector& x, LaneVector& y, LaneVector& z) {
+                TransformLanes3x3(x, y, z, m);
+                auto length = LaneSqrt(LaneAdd(LaneAdd(LaneMul(x, x), LaneMul(y, y)), LaneMul(z, z)));
+                x = LaneDiv(x, length); y = LaneDiv(y, length); z = LaneDiv(z, length);
+            });
+    }
+
+    void BatchTransformPoints(const Float4x4& transform, float* x, float* y, float* z, size_t count)
+    {
+        LaneVector m[12];
+        for (unsigned c=0; c<12; ++c) m[c] = LaneSplat(transform(c/4, c%4));
+        auto kernel = [&m](float* x, float* y, float* z) {
+            auto lx = LaneLoadU(x), ly = LaneLoadU(y), lz = LaneLoadU(z);
+            LaneStoreU(x, LaneMulAdd(m[ 0], lx, LaneMulAdd(m[ 1], ly, LaneMulAdd(m[ 2], lz, m[ 3]))));
+            LaneStoreU(y, LaneMulAdd(m[ 4], lx, LaneMulAdd(m[ 5], ly, LaneMulAdd(m[ 6], lz, m[ 7]))));
+            LaneStoreU(z, LaneMulAdd(m[ 8], lx, LaneMulAdd(m[ 9], ly, LaneMulAdd(m[10], lz, m[11]))));
+        };
+
+        size_t i=0;
+        for (; (i+s_laneCount)<=count; i+=s_laneCount)
+            kernel(x+i, y+i, z+i);
+        if (i < count) {
+            float tx[s_laneCount] = {}, ty[s_laneCount] = {}, tz[s_laneCount] = {};
+            std::copy(x+i, x+count, tx); std::copy(y+i, y+count, ty); std::copy(z+i, z+count, tz);
+            kernel(tx, ty, tz);
+            std::copy(tx, tx+count-i, x+i); std::copy(ty, ty+count-i, y+i); std::copy(tz, tz+count-i, z+i);
+        }
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+        // Same as cml::matrix_rotation_quaternion (with scalar first quaternions & column basis matrices)
+        // m is the 3x3 rotation in row major order
+    static void QuaternionToMatrixLanes(LaneVector m[9], const LaneVector q[4])
+    {
+        auto x2 = LaneAdd(q[1], q[1]), y2 = LaneAdd(q[2], q[2]), z2 = LaneAdd(q[3], q[3]);
+        auto xx2 = LaneMul(q[1], x2), yy2 = LaneMul(q[2], y2), zz2 = LaneMul(q[3], z2);
+        auto xy2 = LaneMul(q[1], y2), yz2 = LaneMul(q[2], z2), zx2 = LaneMul(q[3], x2);
+        auto xw2 = LaneMul(q[0], x2), yw2 = LaneMul(q[0], y2), zw2 = LaneMul(q[0], z2);
+        auto one = LaneSplat(1.f);
+
+        m[0] = LaneSub(LaneSub(one, yy2), zz2);
+        m[1] = LaneSub(xy2, zw2);
+        m[2] = LaneAdd(zx2, yw2);
+        m[3] = LaneAdd(xy2, zw2);
+        m[4] = LaneSub(LaneSub(one, zz2), xx2);
+        m[5] = LaneSub(yz2, xw2);
+        m[6] = LaneSub(zx2, yw2);
+        m[7] = LaneAdd(yz2, xw2);
+        m[8] = LaneSub(LaneSub(one, xx2), yy2);
+    }
+
+    void BatchAsFloat3x3(IteratorRange<Float3x3*> dst, IteratorRange<const Quaternion*> src)
+    {
+        assert(dst.size() == src.size());
+        for (size_t i=0; i<src.size(); i+=s_laneCount) {
+            const float* srcLanes[s_laneCount];
+            float* dstLanes[s_laneCount];
+            LanePointers(srcLanes, src, i, [](const Quaternion& q) { return FloatsOf(q); });
+            LanePointers(dstLanes, dst, i, [](Float3x3& m) { return FloatsOf(m); });
+
+            LaneVector q[4], m[9];
+            GatherLanes(q, srcLanes, 4);
+            QuaternionToMatrixLanes(m, q);
+            ScatterLanes(dstLanes, (unsigned)std::min(size_t(s_laneCount), src.size()-i), m, 9);
+        }
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    void BatchSphericalInterpolate(IteratorRange<Quaternion*> dst, IteratorRange<const Quaternion*> lhs, IteratorRange<const Quaternion*> rhs, float alpha)
+    {
+        assert(dst.size() == lhs.size() && dst.size() == rhs.size());
+        const float tolerance = 1e-4f;      // (same as SphericalInterpolate())
+        auto alphaLanes = LaneSplat(alpha), invAlphaLanes = LaneSplat(1.f - alpha);
+        for (size_t i=0; i<dst.size(); i+=s_laneCount) {
+            const float* lhsLanes[s_laneCount], *rhsLanes[s_laneCount];
+            float* dstLanes[s_laneCount];
+            LanePointers(lhsLanes, lhs, i, [](const Quaternion& q) { return FloatsOf(q); });
+            LanePointers(rhsLanes, rhs, i, [](const Quaternion& q) { return FloatsOf(q); });
+            LanePointers(dstLanes, dst, i, [](Quaternion& q) { return FloatsOf(q); });
+
+            LaneVector l[4], r[4];
+            GatherLanes(l, lhsLanes, 4);
+            GatherLanes(r, rhsLanes, 4);
+
+                // take the shorter path by negating "rhs" when the dot product is negative
+            auto c = LaneAdd(LaneAdd(LaneMul(l[0], r[0]), LaneMul(l[1], r[1])), LaneAdd(LaneMul(l[2], r[2]), LaneMul(l[3], r[3])));
+            auto flip = LaneLess(c, LaneSplat(0.f));
+            for (unsigned e=0; e<4; ++e) r[e] = LaneSelect(flip, LaneNeg(r[e]), r[e]);
+            c = LaneAbs(c);
+
+                // The trigonometry is done per lane; everything else is vectorized
+            alignas(32) float cosOmega[s_laneCount], sinOmega[s_laneCount], lhsWeight[s_laneCount], rhsWeight[s_laneCount];
+            LaneStore(cosOmega, c);
+            for (unsigned q=0; q<s_laneCount; ++q) {
+                float omega = cml::acos_safe(cosOmega[q]);
+                sinOmega[q] = std::sin(omega);
+                lhsWeight[q] = std::sin((1.f - alpha) * omega);
+                rhsWeight[q] = std::sin(alpha * omega);
+            }
+            auto s = LaneLoad(sinOmega), lw = LaneLoad(lhsWeight), rw = LaneLoad(rhsWeight);
+            auto nearlyParallel = LaneLess(s, LaneSplat(tolerance));
+
+                // When the quaternions are very close, fall back to a normalized linear interpolation
+            LaneVector lerp[4];
+            for (unsigned e=0; e<4; ++e) lerp[e] = LaneAdd(LaneMul(invAlphaLanes, l[e]), LaneMul(alphaLanes, r[e]));
+            auto lerpLength = LaneSqrt(LaneAdd(
+                LaneAdd(LaneMul(lerp[0], lerp[0]), LaneMul(lerp[1], lerp[1])),
+                LaneAdd(LaneMul(lerp[2], lerp[2]), LaneMul(lerp[3], lerp[3]))));
+
+            LaneVector result[4];
+            for (unsigned e=0; e<4; ++e) {
+                auto slerp = LaneDiv(LaneAdd(LaneMul(lw, l[e]), LaneMul(rw, r[e])), s);
+                result[e] = LaneSelect(nearlyParallel, LaneDiv(lerp[e], lerpLength), slerp);
+            }
+            ScatterLanes(dstLanes, (unsigned)std::min(size_t(s_laneCount), dst.size()-i), result, 4);
+        }
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+        // Same as cml::quaternion_rotation_matrix (with scalar first quaternions & column basis matrices),
+        // except that the branches are replaced with selects. m is the 3x3 rotation in row major order
+    static void MatrixToQuaternionLanes(LaneVector q[4], const LaneVector m[9])
+    {
+        auto m00 = m[0], m01 = m[1], m02 = m[2];
+        auto m10 = m[3], m11 = m[4], m12 = m[5];
+        auto m20 = m[6], m21 = m[7], m22 = m[8];
+
+            // Either the trace is positive, or we build from the largest diagonal element
+        auto trace = LaneAdd(LaneAdd(m00, m11), m22);
+        auto useTrace = LaneGreaterEqual(trace, LaneSplat(0.f));
+        auto gt01 = LaneGreater(m00, m11);
+        auto largest0 = LaneAndNot(gt01, LaneGreater(m22, m00));
+        auto largest1 = LaneAndNot(LaneGreater(m11, m22), gt01);
+
+        auto diag0 = LaneSub(LaneSub(m00, m11), m22);
+        auto diag1 = LaneSub(LaneSub(m11, m22), m00);
+        auto diag2 = LaneSub(LaneSub(m22, m00), m11);
+        auto d = LaneSelect(useTrace, trace, LaneSelect(largest0, diag0, LaneSelect(largest1, diag1, diag2)));
+        auto p = LaneMul(LaneSqrt(LaneAdd(d, LaneSplat(1.f))), LaneSplat(0.5f));
+        auto s = LaneDiv(LaneSplat(0.25f), p);
+
+        auto d21 = LaneMul(LaneSub(m21, m12), s), d02 = LaneMul(LaneSub(m02, m20), s), d10 = LaneMul(LaneSub(m10, m01), s);
+        auto a01 = LaneMul(LaneAdd(m01, m10), s), a02 = LaneMul(LaneAdd(m02, m20), s), a12 = LaneMul(LaneAdd(m12, m21), s);
+
+        q[0] = LaneSelect(useTrace, p,   LaneSelect(largest0, d21, LaneSelect(largest1, d02, d10)));
+        q[1] = LaneSelect(useTrace, d21, LaneSelect(largest0, p,   LaneSelect(largest1, a01, a02)));
+        q[2] = LaneSelect(useTrace, d02, LaneSelect(largest0, a01, LaneSelect(largest1, p,   a12)));
+        q[3] = LaneSelect(useTrace, d10, LaneSelect(largest0, a02, LaneSelect(largest1, a12, p)));
+    }
+
+    void BatchDecompose(IteratorRange<ScaleRotationTranslationQ*> dst, IteratorRange<const Float4x4*> src)
+    {
+        assert(dst.size() == src.size());
+        const float diagThreshold = 1e-4f;      // (same as the ScaleRotationTranslation constructor)
+        auto threshold = LaneSplat(diagThreshold);
+        for (size_t i=0; i<src.size(); i+=s_laneCount) {
+            const float* srcLanes[s_laneCount];
+            LanePointers(srcLanes, src, i, [](const Float4x4& m) { return FloatsOf(m); });
+
+                // only the top 3 rows are required
+            LaneVector a[12];
+            GatherLanes(a, srcLanes, 12);
+
+                // The columns of the 3x3 part are orthogonal when there's no skew. In that case the
+                // scale is the length of each column, and the rotation is the normalized columns
+                // (see the ScaleRotationTranslation constructor for the general case)
+            auto dot = [&a](unsigned c0, unsigned c1) {
+                return LaneAdd(LaneAdd(LaneMul(a[c0], a[c1]), LaneMul(a[4+c0], a[4+c1])), LaneMul(a[8+c0], a[8+c1]));
+            };
+            auto orthogonal01 = LaneLess(LaneAbs(dot(0, 1)), threshold);
+            auto orthogonal02 = LaneLess(LaneAbs(dot(0, 2)), threshold);
+            auto orthogonal12 = LaneLess(LaneAbs(dot(1, 2)), threshold);
+            unsigned noSkewBits = LaneMaskBits(LaneAnd(LaneAnd(orthogonal01, orthogonal02), orthogonal12));
+
+            LaneVector scale[3] = { LaneSqrt(dot(0, 0)), LaneSqrt(dot(1, 1)), LaneSqrt(dot(2, 2)) };
+            LaneVector rot[9];
+            for (unsigned r=0; r<3; ++r)
+                for (unsigned c=0; c<3; ++c)
+                    rot[r*3+c] = LaneDiv(a[r*4+c], scale[c]);
+
+                // by convention, reflections are always expressed as a negative x scale
+            auto det = LaneMul(rot[0], LaneSub(LaneMul(rot[4], rot[8]), LaneMul(rot[5], rot[7])));
+            det = LaneSub(det, LaneMul(rot[1], LaneSub(LaneMul(rot[3], rot[8]), LaneMul(rot[5], rot[6]))));
+            det = LaneAdd(det, LaneMul(rot[2], LaneSub(LaneMul(rot[3], rot[7]), LaneMul(rot[4], rot[6]))));
+            auto reflection = LaneLess(det, LaneSplat(0.f));
+            scale[0] = LaneSelect(reflection, LaneNeg(scale[0]), scale[0]);
+            rot[0] = LaneSelect(reflection, LaneNeg(rot[0]), rot[0]);
+            rot[3] = LaneSelect(reflection, LaneNeg(rot[3]), rot[3]);
+            rot[6] = LaneSelect(reflection, LaneNeg(rot[6]), rot[6]);
+
+            LaneVector q[4];
+            MatrixToQuaternionLanes(q, rot);
+
+            alignas(32) float results[10][s_laneCount];
+            for (unsigned c=0; c<4; ++c) LaneStore(results[c], q[c]);
+            for (unsigned c=0; c<3; ++c) LaneStore(results[4+c], scale[c]);
+            for (unsigned c=0; c<3; ++c) LaneStore(results[7+c], a[c*4+3]);
+
+            auto activeLanes = (unsigned)std::min(size_t(s_laneCount), src.size()-i);
+            for (unsigned l=0; l<activeLanes; ++l) {
+                if (noSkewBits & (1u<<l)) {
+                    dst[i+l] = ScaleRotationTranslationQ(
+                        Float3(results[4][l], results[5][l], results[6][l]),
+                        Quaternion(results[0][l], results[1][l], results[2][l], results[3][l]),
+                        Float3(results[7][l], results[8][l], results[9][l]));
+                } else {
+                    dst[i+l] = ScaleRotationTranslationQ(src[i+l]);
+                }
+            }
+        }
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+        //      Without SIMD instructions, emulating the lanes is slower than the per-element
+        //      functions, so just use those
+
+#else
+
+    void BatchInverse(IteratorRange<Float4x4*> dst, IteratorRange<const Float4x4*> src)
+    {
+        assert(dst.size() == src.size());
+        for (size_t i=0; i<src.size(); ++i)
+            dst[i] = Inverse(src[i]);
+    }
+
+    void BatchTransformPoints(IteratorRange<Float3*> dst, const Float4x4& transform, IteratorRange<const Float3*> src)
+    {
+        assert(dst.size() == src.size());
+        for (size_t i=0; i<src.size(); ++i)
+            dst[i] = TransformPoint(transform, src[i]);
+    }
+
+    void BatchTransformDirectionVectors(IteratorRange<Float3*> dst, const Float4x4& transform, IteratorRange<const Float3*> src)
+    {
+        assert(dst.size() == src.size());
+        for (size_t i=0; i<src.size(); ++i)
+            dst[i] = TransformDirectionVector(transform, src[i]);
+    }
+
+    void BatchTransformNormals(IteratorRange<Float3*> dst, const Float4x4& transform, IteratorRange<const Float3*> src)
+    {
+        assert(dst.size() == src.size());
+        auto normalTransform = Transpose(Inverse(Truncate3x3(transform)));
+        for (size_t i=0; i<src.size(); ++i)
+            dst[i] = Normalize(TransformDirectionVector(normalTransform, src[i]));
+    }
+
+    void BatchTransformPoints(const Float4x4& transform, float* x, float* y, float* z, size_t count)
+    {
+        for (size_t i=0; i<count; ++i) {
+            auto p = TransformPoint(transform, Float3(x[i], y[i], z[i]));
+            x[i] = p[0]; y[i] = p[1]; z[i] = p[2];
+        }
+    }
+
+    void BatchAsFloat3x3(IteratorRange<Float3x3*> dst, IteratorRange<const Quaternion*> src)
+    {
+        assert(dst.size() == src.size());
+        for (size_t i=0; i<src.size(); ++i)
+            dst[i] = AsFloat3x3(src[i]);
+    }
+
+    void BatchSphericalInterpolate(IteratorRange<Quaternion*> dst, IteratorRange<const Quaternion*> lhs, IteratorRange<const Quaternion*> rhs, float alpha)
+    {
+        assert(dst.size() == lhs.size() && dst.size() == rhs.size());
+        for (size_t i=0; i<dst.size(); ++i)
+            dst[i] = SphericalInterpolate(lhs[i], rhs[i], alpha);
+    }
+
+    void BatchDecompose(IteratorRange<ScaleRotationTranslationQ*> dst, IteratorRange<const Float4x4*> src)
+    {
+        assert(dst.size() == src.size());
+        for (size_t i=0; i<src.size(); ++i)
+            dst[i] = ScaleRotationTranslationQ(src[i]);
+    }
+
+#endif
+}
@@ -0,0 +1,66 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "Matrix.h"
+#include "Quaternion.h"
+#include "Transformations.h"
+#include "../Utility/IteratorUtils.h"       // for IteratorRange
+
+namespace XLEMath
+{
+        //
+        //      Array oriented versions of common transformation operations
+        //
+        //      These are intended for large arrays of transforms (eg, skeleton/animation
+        //      evaluation, instance transforms, etc). Each is equivalent to calling the
+        //      per-element function from Transformations.h for each element, but several
+        //      elements are processed at once with SIMD instructions (SSE, or 8 wide AVX
+        //      when compiled with AVX2 enabled). On platforms without those instructions, they
+        //      just call the per-element functions.
+        //
+        //      Results match the per-element functions to within floating point tolerance,
+        //      but aren't guaranteed to be bitwise identical (the order of operations can differ).
+        //
+        //      Unless otherwise noted, all of the ranges in a single call must be the same
+        //      size. The output range may be the same as one of the inputs, but must not
+        //      partially overlap an input.
+        //
+
+        /// dst[i] = Combine(first[i], second[i])
+    void BatchCombine(IteratorRange<Float4x4*> dst, IteratorRange<const Float4x4*> first, IteratorRange<const Float4x4*> second);
+        /// dst[i] = Combine(first[i], second)
+    void BatchCombine(IteratorRange<Float4x4*> dst, IteratorRange<const Float4x4*> first, const Float4x4& second);
+        /// dst[i] = Combine(first, second[i])
+    void BatchCombine(IteratorRange<Float4x4*> dst, const Float4x4& first, IteratorRange<const Float4x4*> second);
+        /// dst[i] = Combine(first[i], second[i])
+    void BatchCombine(IteratorRange<Float3x4*> dst, IteratorRange<const Float3x4*> first, IteratorRange<const Float3x4*> second);
+
+        /// dst[i] = Inverse(src[i]), for general (not just affine) matrices
+    void BatchInverse(IteratorRange<Float4x4*> dst, IteratorRange<const Float4x4*> src);
+
+        /// dst[i] = TransformPoint(transform, src[i])
+    void BatchTransformPoints(IteratorRange<Float3*> dst, const Float4x4& transform, IteratorRange<const Float3*> src);
+        /// dst[i] = TransformDirectionVector(transform, src[i])
+    void BatchTransformDirectionVectors(IteratorRange<Float3*> dst, const Float4x4& transform, IteratorRange<const Float3*> src);
+        /// dst[i] = Normalize(Transpose(Inverse(Truncate3x3(transform))) * src[i])
+        /// (ie, the transformation required for surface normals when the transform contains non-uniform scale)
+    void BatchTransformNormals(IteratorRange<Float3*> dst, const Float4x4& transform, IteratorRange<const Float3*> src);
+
+        /// TransformPoint(transform, ...) for points stored in separate x, y & z arrays (each
+        /// of "count" elements). The points are transformed in place.
+    void BatchTransformPoints(const Float4x4& transform, float* x, float* y, float* z, size_t count);
+
+        /// dst[i] = AsFloat3x3(src[i])
+    void BatchAsFloat3x3(IteratorRange<Float3x3*> dst, IteratorRange<const Quaternion*> src);
+
+        /// dst[i] = SphericalInterpolate(lhs[i], rhs[i], alpha)
+    void BatchSphericalInterpolate(IteratorRange<Quaternion*> dst, IteratorRange<const Quaternion*> lhs, IteratorRange<const Quaternion*> rhs, float alpha);
+
+        /// dst[i] = ScaleRotationTranslationQ(src[i])
+        /// Transforms without skew (the common case) are decomposed with SIMD instructions; any
+        /// elements with skew fall back to the per-element decomposition
+    void BatchDecompose(IteratorRange<ScaleRotationTranslationQ*> dst, IteratorRange<const Float4x4*> src);
+}
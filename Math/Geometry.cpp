@@ -113,6 +113,48 @@ namespace XLEMath
 		return closestDistanceSq <= sphereRadiusSq;
     }
 
+    bool RayVsTriangle(float& alpha, const std::pair<Float3, Float3>& ray, const Float3& v0, const Float3& v1, const Float3& v2)
+    {
+            //  Based on "Watertight Ray/Triangle Intersection" (Woop, Benthin & Wald, JCGT 2013)
+            //  The ray is transformed so that it points along +Z, and the triangle is tested in 2D with edge
+            //  functions. Edge functions that evaluate to exactly zero are recalculated in double precision, which
+            //  is what prevents rays from slipping through the gaps between adjacent triangles
+        Float3 direction = ray.second - ray.first;
+        unsigned kz = (std::abs(direction[0]) > std::abs(direction[1]))
+            ? ((std::abs(direction[0]) > std::abs(direction[2])) ? 0 : 2)
+            : ((std::abs(direction[1]) > std::abs(direction[2])) ? 1 : 2);
+        unsigned kx = (kz+1)%3, ky = (kx+1)%3;
+        if (direction[kz] == 0.f) return false;         // zero length ray
+        if (direction[kz] < 0.f) std::swap(kx, ky);     // preserve winding
+        float Sx = direction[kx] / direction[kz], Sy = direction[ky] / direction[kz], Sz = 1.f / direction[kz];
+
+        Float3 A = v0 - ray.first, B = v1 - ray.first, C = v2 - ray.first;
+        float Ax = A[kx] - Sx * A[kz], Ay = A[ky] - Sy * A[kz];
+        float Bx = B[kx] - Sx * B[kz], By = B[ky] - Sy * B[kz];
+        float Cx = C[kx] - Sx * C[kz], Cy = C[ky] - Sy * C[kz];
+
+        float U = Cx * By - Cy * Bx;
+        float V = Ax * Cy - Ay * Cx;
+        float W = Bx * Ay - By * Ax;
+        if (U == 0.f || V == 0.f || W == 0.f) {
+            U = float(double(Cx) * double(By) - double(Cy) * double(Bx));
+            V = float(double(Ax) * double(Cy) - double(Ay) * double(Cx));
+            W = float(double(Bx) * double(Ay) - double(By) * double(Ax));
+        }
+
+        if ((U < 0.f || V < 0.f || W < 0.f) && (U > 0.f || V > 0.f || W > 0.f))
+            return false;
+        float det = U + V + W;
+        if (det == 0.f)
+            return false;
+
+        float T = U * (Sz * A[kz]) + V * (Sz * B[kz]) + W * (Sz * C[kz]);
+        if (det > 0.f ? (T < 0.f || T > det) : (T > 0.f || T < det))
+            return false;       // intersection is outside of the ray segment
+        alpha = T / det;
+        return true;
+    }
+
     bool RayVsAABB(const std::pair<Float3, Float3>& worldSpaceRay, const Float3x4& aabbToWorld, const Float3& mins, const Float3& maxs)
     {
             //  Does this ray intersect the aabb? 
@@ -73,6 +73,12 @@ namespace XLEMath
     /// Returns true iff the given (finite length) ray intersects a sphere at the origin with the given radius squared
     bool RayVsSphere(Float3 rayStart, Float3 rayEnd, float sphereRadiusSq);
 
+    /// <summary>Tests a (finite length) ray against a triangle</summary>
+    /// This is a "watertight" test; so a ray that passes exactly through an edge or vertex shared by
+    /// multiple triangles will always intersect at least one of them. Triangles are double sided.
+    /// On intersection, "alpha" is set to the position along the ray (0 at the start, 1 at the end)
+    bool RayVsTriangle(float& alpha, const std::pair<Float3, Float3>& ray, const Float3& v0, const Float3& v1, const Float3& v2);
+
     unsigned ClipTriangle(Float3 dst[], const Float3 source[], float clippingParam[]);
 
 	template<typename Primitive>
@@ -0,0 +1,415 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "RayIntersection.h"
+#include "Geometry.h"
+#include "SIMDLanes_Internal.h"
+#include <algorithm>
+#include <cmath>
+#include <assert.h>
+
+namespace XLEMath
+{
+    static_assert(sizeof(std::pair<Float3, Float3>) == 6*sizeof(float), "Expecting tightly packed rays & bounding boxes");
+    static_assert(sizeof(Float4) == 4*sizeof(float), "Expecting tightly packed vectors");
+
+    static const float s_minRayComponent = 1e-30f;
+
+    static float SafeReciprocal(float d) { return 1.f / ((std::abs(d) < s_minRayComponent) ? s_minRayComponent : d); }
+
+#if defined(HAS_SSE_INSTRUCTIONS)
+
+        //  Run "kernel" for each group of s_laneCount results. The kernel always writes a full set of
+        //  lanes; only the first "activeLanes" are copied into the destination
+    template<typename Kernel>
+        static void ForEachLaneGroup(IteratorRange<float*> dst, Kernel&& kernel)
+    {
+        for (size_t i=0; i<dst.size(); i+=s_laneCount) {
+            auto activeLanes = (unsigned)std::min(size_t(s_laneCount), dst.size()-i);
+            alignas(32) float results[s_laneCount];
+            kernel(results, i, activeLanes);
+            std::copy(results, &results[activeLanes], &dst[i]);
+        }
+    }
+
+    static force_inline LaneVector LaneSafeReciprocal(LaneVector d)
+    {
+            // Ray components close to zero are replaced with a tiny value (the sign doesn't matter, since the slab test
+            // is symmetrical). This avoids 0 * infinity in the slab test, when the ray starts exactly on a slab plane
+        auto tiny = LaneSplat(s_minRayComponent);
+        return LaneDiv(LaneSplat(1.f), LaneSelect(LaneLess(LaneAbs(d), tiny), tiny, d));
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+        //      Axis aligned boxes (slab test)
+
+    static force_inline LaneVector SlabTest(const LaneVector start[3], const LaneVector invDirection[3], const LaneVector mins[3], const LaneVector maxs[3])
+    {
+        auto tNear = LaneSplat(0.f), tFar = LaneSplat(1.f);
+        for (unsigned c=0; c<3; ++c) {
+            auto t0 = LaneMul(LaneSub(mins[c], start[c]), invDirection[c]);
+            auto t1 = LaneMul(LaneSub(maxs[c], start[c]), invDirection[c]);
+            tNear = LaneMax(tNear, LaneMin(t0, t1));
+            tFar = LaneMin(tFar, LaneMax(t0, t1));
+        }
+        return LaneSelect(LaneLessEqual(tNear, tFar), tNear, LaneSplat(RayIntersection_Miss));
+    }
+
+    void RayVsAABBs(IteratorRange<float*> dst, const std::pair<Float3, Float3>& ray, IteratorRange<const std::pair<Float3, Float3>*> aabbs)
+    {
+        assert(dst.size() == aabbs.size());
+        LaneVector start[3], invDirection[3];
+        for (unsigned c=0; c<3; ++c) {
+            start[c] = LaneSplat(ray.first[c]);
+            invDirection[c] = LaneSplat(SafeReciprocal(ray.second[c] - ray.first[c]));
+        }
+
+        ForEachLaneGroup(
+            dst,
+            [&](float results[], size_t first, unsigned) {
+                const float* src[s_laneCount];
+                LanePointers(src, aabbs, first, [](const std::pair<Float3, Float3>& aabb) { return &aabb.first[0]; });
+                LaneVector aabbLanes[6];
+                GatherLanes(aabbLanes, src, 6);
+                LaneStore(results, SlabTest(start, invDirection, &aabbLanes[0], &aabbLanes[3]));
+            });
+    }
+
+    void RaysVsAABB(IteratorRange<float*> dst, IteratorRange<const std::pair<Float3, Float3>*> rays, const Float3& mins, const Float3& maxs)
+    {
+        assert(dst.size() == rays.size());
+        LaneVector minsLanes[3], maxsLanes[3];
+        for (unsigned c=0; c<3; ++c) {
+            minsLanes[c] = LaneSplat(mins[c]);
+            maxsLanes[c] = LaneSplat(maxs[c]);
+        }
+
+        ForEachLaneGroup(
+            dst,
+            [&](float results[], size_t first, unsigned) {
+                const float* src[s_laneCount];
+                LanePointers(src, rays, first, [](const std::pair<Float3, Float3>& ray) { return &ray.first[0]; });
+                LaneVector rayLanes[6], invDirection[3];
+                GatherLanes(rayLanes, src, 6);
+                for (unsigned c=0; c<3; ++c)
+                    invDirection[c] = LaneSafeReciprocal(LaneSub(rayLanes[3+c], rayLanes[c]));
+                LaneStore(results, SlabTest(&rayLanes[0], invDirection, minsLanes, maxsLanes));
+            });
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+        //      Spheres
+
+    static force_inline LaneVector LaneDot3(const LaneVector a[3], const LaneVector b[3])
+    {
+        return LaneMulAdd(a[2], b[2], LaneMulAdd(a[1], b[1], LaneMul(a[0], b[0])));
+    }
+
+    static force_inline LaneVector SphereTest(const LaneVector start[3], const LaneVector direction[3], const LaneVector center[3], LaneVector radius)
+    {
+            //  Solve |start + t * direction - center| = radius for the smaller t
+        LaneVector m[3] { LaneSub(start[0], center[0]), LaneSub(start[1], center[1]), LaneSub(start[2], center[2]) };
+        auto a = LaneDot3(direction, direction);
+        auto b = LaneDot3(m, direction);
+        auto c = LaneSub(LaneDot3(m, m), LaneMul(radius, radius));
+        auto discriminant = LaneSub(LaneMul(b, b), LaneMul(a, c));
+        auto t = LaneDiv(LaneSub(LaneNeg(b), LaneSqrt(LaneMax(discriminant, LaneSplat(0.f)))), a);
+
+        auto zero = LaneSplat(0.f);
+        auto startsInside = LaneLessEqual(c, zero);
+            // outside the sphere, so we must be moving towards the center & the entry point must be within the segment
+        auto hit = LaneAnd(LaneAnd(LaneLess(b, zero), LaneGreaterEqual(discriminant, zero)), LaneLessEqual(t, LaneSplat(1.f)));
+        return LaneSelect(startsInside, zero, LaneSelect(hit, t, LaneSplat(RayIntersection_Miss)));
+    }
+
+    void RayVsSpheres(IteratorRange<float*> dst, const std::pair<Float3, Float3>& ray, IteratorRange<const Float4*> spheres)
+    {
+        assert(dst.size() == spheres.size());
+        LaneVector start[3], direction[3];
+        for (unsigned c=0; c<3; ++c) {
+            start[c] = LaneSplat(ray.first[c]);
+            direction[c] = LaneSplat(ray.second[c] - ray.first[c]);
+        }
+
+        ForEachLaneGroup(
+            dst,
+            [&](float results[], size_t first, unsigned) {
+                const float* src[s_laneCount];
+                LanePointers(src, spheres, first, [](const Float4& sphere) { return &sphere[0]; });
+                LaneVector sphereLanes[4];
+                GatherLanes(sphereLanes, src, 4);
+                LaneStore(results, SphereTest(start, direction, &sphereLanes[0], sphereLanes[3]));
+            });
+    }
+
+    void RaysVsSphere(IteratorRange<float*> dst, IteratorRange<const std::pair<Float3, Float3>*> rays, const Float3& center, float radius)
+    {
+        assert(dst.size() == rays.size());
+        LaneVector centerLanes[3] { LaneSplat(center[0]), LaneSplat(center[1]), LaneSplat(center[2]) };
+        auto radiusLanes = LaneSplat(radius);
+
+        ForEachLaneGroup(
+            dst,
+            [&](float results[], size_t first, unsigned) {
+                const float* src[s_laneCount];
+                LanePointers(src, rays, first, [](const std::pair<Float3, Float3>& ray) { return &ray.first[0]; });
+                LaneVector rayLanes[6];
+                GatherLanes(rayLanes, src, 6);
+                LaneVector direction[3] { LaneSub(rayLanes[3], rayLanes[0]), LaneSub(rayLanes[4], rayLanes[1]), LaneSub(rayLanes[5], rayLanes[2]) };
+                LaneStore(results, SphereTest(&rayLanes[0], direction, centerLanes, radiusLanes));
+            });
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+        //      Triangles
+        //
+        //      This is the same watertight test as RayVsTriangle(), with the same order of operations (so the
+        //      results are identical). The triangle corners are given relative to the ray start, with the components
+        //      already permuted so the ray's major axis is last. Lanes where any edge function is exactly zero are
+        //      flagged, so they can be recalculated with the (double precision) scalar fallback.
+
+    static force_inline LaneVector WatertightTriangleTest(
+        LaneMask& needsFallback,
+        const LaneVector A[3], const LaneVector B[3], const LaneVector C[3],
+        LaneVector Sx, LaneVector Sy, LaneVector Sz)
+    {
+        auto Ax = LaneSub(A[0], LaneMul(Sx, A[2])), Ay = LaneSub(A[1], LaneMul(Sy, A[2]));
+        auto Bx = LaneSub(B[0], LaneMul(Sx, B[2])), By = LaneSub(B[1], LaneMul(Sy, B[2]));
+        auto Cx = LaneSub(C[0], LaneMul(Sx, C[2])), Cy = LaneSub(C[1], LaneMul(Sy, C[2]));
+
+        auto U = LaneSub(LaneMul(Cx, By), LaneMul(Cy, Bx));
+        auto V = LaneSub(LaneMul(Ax, Cy), LaneMul(Ay, Cx));
+        auto W = LaneSub(LaneMul(Bx, Ay), LaneMul(By, Ax));
+
+        auto zero = LaneSplat(0.f);
+        needsFallback = LaneOr(LaneOr(LaneEqual(U, zero), LaneEqual(V, zero)), LaneEqual(W, zero));
+        auto anyNegative = LaneOr(LaneOr(LaneLess(U, zero), LaneLess(V, zero)), LaneLess(W, zero));
+        auto anyPositive = LaneOr(LaneOr(LaneGreater(U, zero), LaneGreater(V, zero)), LaneGreater(W, zero));
+
+        auto det = LaneAdd(LaneAdd(U, V), W);
+        auto T = LaneAdd(LaneAdd(LaneMul(U, LaneMul(Sz, A[2])), LaneMul(V, LaneMul(Sz, B[2]))), LaneMul(W, LaneMul(Sz, C[2])));
+
+            // flip the signs of both T & det when det is negative, so we only need to test 0 <= T <= det
+        auto negativeDet = LaneLess(det, zero);
+        auto signedT = LaneSelect(negativeDet, LaneNeg(T), T);
+        auto absDet = LaneSelect(negativeDet, LaneNeg(det), det);
+        auto withinSegment = LaneAnd(LaneGreaterEqual(signedT, zero), LaneLessEqual(signedT, absDet));
+        auto hit = LaneAndNot(LaneAndNot(withinSegment, LaneAnd(anyNegative, anyPositive)), LaneEqual(det, zero));
+        return LaneSelect(hit, LaneDiv(T, det), LaneSplat(RayIntersection_Miss));
+    }
+
+    struct WatertightRay
+    {
+        unsigned _kx, _ky, _kz;
+        float _Sx, _Sy, _Sz;
+        bool _degenerate;
+
+        WatertightRay(const std::pair<Float3, Float3>& ray)
+        {
+            Float3 direction = ray.second - ray.first;
+            _kz = (std::abs(direction[0]) > std::abs(direction[1]))
+                ? ((std::abs(direction[0]) > std::abs(direction[2])) ? 0 : 2)
+                : ((std::abs(direction[1]) > std::abs(direction[2])) ? 1 : 2);
+            _kx = (_kz+1)%3; _ky = (_kx+1)%3;
+            _degenerate = direction[_kz] == 0.f;
+            if (_degenerate) { _Sx = _Sy = _Sz = 0.f; return; }
+            if (direction[_kz] < 0.f) std::swap(_kx, _ky);
+            _Sx = direction[_kx] / direction[_kz];
+            _Sy = direction[_ky] / direction[_kz];
+            _Sz = 1.f / direction[_kz];
+        }
+    };
+
+    static void ApplyTriangleFallback(
+        float results[], unsigned activeLanes, unsigned fallbackMask,
+        const std::pair<Float3, Float3>* rays, const Float3* const triangles[])
+    {
+        for (unsigned l=0; l<activeLanes; ++l)
+            if (fallbackMask & (1u<<l)) {
+                const auto& ray = rays[l];
+                const auto* tri = triangles[l];
+                float alpha;
+                results[l] = RayVsTriangle(alpha, ray, tri[0], tri[1], tri[2]) ? alpha : RayIntersection_Miss;
+            }
+    }
+
+    void RayVsTriangles(IteratorRange<float*> dst, const std::pair<Float3, Float3>& ray, IteratorRange<const Float3*> triangleCorners)
+    {
+        assert(triangleCorners.size() % 3 == 0);
+        assert(dst.size() == triangleCorners.size() / 3);
+        WatertightRay wr(ray);
+        if (wr._degenerate) {
+            std::fill(dst.begin(), dst.end(), RayIntersection_Miss);
+            return;
+        }
+
+        const unsigned permutation[3] { wr._kx, wr._ky, wr._kz };
+        LaneVector start[3];
+        for (unsigned c=0; c<3; ++c) start[c] = LaneSplat(ray.first[permutation[c]]);
+        auto Sx = LaneSplat(wr._Sx), Sy = LaneSplat(wr._Sy), Sz = LaneSplat(wr._Sz);
+        auto triangleCount = dst.size();
+
+        ForEachLaneGroup(
+            dst,
+            [&](float results[], size_t first, unsigned activeLanes) {
+                const float* src[s_laneCount];
+                for (unsigned l=0; l<s_laneCount; ++l)
+                    src[l] = &triangleCorners[std::min(first+l, triangleCount-1)*3][0];
+                LaneVector corners[9];
+                GatherLanes(corners, src, 9);
+
+                LaneVector A[3], B[3], C[3];
+                for (unsigned c=0; c<3; ++c) {
+                    A[c] = LaneSub(corners[0+permutation[c]], start[c]);
+                    B[c] = LaneSub(corners[3+permutation[c]], start[c]);
+                    C[c] = LaneSub(corners[6+permutation[c]], start[c]);
+                }
+
+                LaneMask needsFallback;
+                LaneStore(results, WatertightTriangleTest(needsFallback, A, B, C, Sx, Sy, Sz));
+                if (auto fallbackMask = LaneMaskBits(needsFallback) & ((1u<<activeLanes)-1)) {
+                    std::pair<Float3, Float3> rays[s_laneCount];
+                    const Float3* triangles[s_laneCount];
+                    for (unsigned l=0; l<activeLanes; ++l) {
+                        rays[l] = ray;
+                        triangles[l] = &triangleCorners[(first+l)*3];
+                    }
+                    ApplyTriangleFallback(results, activeLanes, fallbackMask, rays, triangles);
+                }
+            });
+    }
+
+    void RaysVsTriangle(IteratorRange<float*> dst, IteratorRange<const std::pair<Float3, Float3>*> rays, const Float3& v0, const Float3& v1, const Float3& v2)
+    {
+        assert(dst.size() == rays.size());
+        auto rayCount = rays.size();
+
+        ForEachLaneGroup(
+            dst,
+            [&](float results[], size_t first, unsigned activeLanes) {
+                    // Each ray has its own axis permutation, so the lanes are built up one ray at a time
+                alignas(32) float A[3][s_laneCount], B[3][s_laneCount], C[3][s_laneCount];
+                alignas(32) float Sx[s_laneCount], Sy[s_laneCount], Sz[s_laneCount];
+                unsigned degenerateMask = 0;
+                for (unsigned l=0; l<s_laneCount; ++l) {
+                    const auto& ray = rays[std::min(first+l, rayCount-1)];
+                    WatertightRay wr(ray);
+                    const unsigned permutation[3] { wr._kx, wr._ky, wr._kz };
+                    for (unsigned c=0; c<3; ++c) {
+                        A[c][l] = v0[permutation[c]] - ray.first[permutation[c]];
+                        B[c][l] = v1[permutation[c]] - ray.first[permutation[c]];
+                        C[c][l] = v2[permutation[c]] - ray.first[permutation[c]];
+                    }
+                    Sx[l] = wr._Sx; Sy[l] = wr._Sy; Sz[l] = wr._Sz;
+                    degenerateMask |= unsigned(wr._degenerate) << l;
+                }
+
+                LaneVector ALanes[3], BLanes[3], CLanes[3];
+                for (unsigned c=0; c<3; ++c) {
+                    ALanes[c] = LaneLoad(A[c]);
+                    BLanes[c] = LaneLoad(B[c]);
+                    CLanes[c] = LaneLoad(C[c]);
+                }
+                LaneMask needsFallback;
+                LaneStore(results, WatertightTriangleTest(needsFallback, ALanes, BLanes, CLanes, LaneLoad(Sx), LaneLoad(Sy), LaneLoad(Sz)));
+
+                for (unsigned l=0; l<activeLanes; ++l)
+                    if (degenerateMask & (1u<<l))
+                        results[l] = RayIntersection_Miss;
+                if (auto fallbackMask = LaneMaskBits(needsFallback) & ~degenerateMask & ((1u<<activeLanes)-1)) {
+                    const Float3 triangle[3] { v0, v1, v2 };
+                    const Float3* triangles[s_laneCount];
+                    std::fill(triangles, &triangles[s_laneCount], triangle);
+                    ApplyTriangleFallback(results, activeLanes, fallbackMask, &rays[first], triangles);
+                }
+            });
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+        //      Without SIMD instructions, emulating the lanes is slower than testing one primitive
+        //      at a time, so these are just loops over the scalar tests
+
+#else
+
+    static float SlabTest(const Float3& start, const Float3& invDirection, const Float3& mins, const Float3& maxs)
+    {
+        float tNear = 0.f, tFar = 1.f;
+        for (unsigned c=0; c<3; ++c) {
+            auto t0 = (mins[c] - start[c]) * invDirection[c];
+            auto t1 = (maxs[c] - start[c]) * invDirection[c];
+            tNear = std::max(tNear, std::min(t0, t1));
+            tFar = std::min(tFar, std::max(t0, t1));
+        }
+        return (tNear <= tFar) ? tNear : RayIntersection_Miss;
+    }
+
+    void RayVsAABBs(IteratorRange<float*> dst, const std::pair<Float3, Float3>& ray, IteratorRange<const std::pair<Float3, Float3>*> aabbs)
+    {
+        assert(dst.size() == aabbs.size());
+        Float3 invDirection;
+        for (unsigned c=0; c<3; ++c) invDirection[c] = SafeReciprocal(ray.second[c] - ray.first[c]);
+        for (size_t i=0; i<aabbs.size(); ++i)
+            dst[i] = SlabTest(ray.first, invDirection, aabbs[i].first, aabbs[i].second);
+    }
+
+    void RaysVsAABB(IteratorRange<float*> dst, IteratorRange<const std::pair<Float3, Float3>*> rays, const Float3& mins, const Float3& maxs)
+    {
+        assert(dst.size() == rays.size());
+        for (size_t i=0; i<rays.size(); ++i) {
+            Float3 invDirection;
+            for (unsigned c=0; c<3; ++c) invDirection[c] = SafeReciprocal(rays[i].second[c] - rays[i].first[c]);
+            dst[i] = SlabTest(rays[i].first, invDirection, mins, maxs);
+        }
+    }
+
+    static float SphereTest(const Float3& start, const Float3& direction, const Float3& center, float radius)
+    {
+            //  Solve |start + t * direction - center| = radius for the smaller t
+        auto m = start - center;
+        auto a = Dot(direction, direction);
+        auto b = Dot(m, direction);
+        auto c = Dot(m, m) - radius * radius;
+        if (c <= 0.f) return 0.f;       // starts inside
+        auto discriminant = b * b - a * c;
+        if (b >= 0.f || discriminant < 0.f) return RayIntersection_Miss;
+        auto t = (-b - std::sqrt(discriminant)) / a;
+        return (t <= 1.f) ? t : RayIntersection_Miss;
+    }
+
+    void RayVsSpheres(IteratorRange<float*> dst, const std::pair<Float3, Float3>& ray, IteratorRange<const Float4*> spheres)
+    {
+        assert(dst.size() == spheres.size());
+        auto direction = ray.second - ray.first;
+        for (size_t i=0; i<spheres.size(); ++i)
+            dst[i] = SphereTest(ray.first, direction, Truncate(spheres[i]), spheres[i][3]);
+    }
+
+    void RaysVsSphere(IteratorRange<float*> dst, IteratorRange<const std::pair<Float3, Float3>*> rays, const Float3& center, float radius)
+    {
+        assert(dst.size() == rays.size());
+        for (size_t i=0; i<rays.size(); ++i)
+            dst[i] = SphereTest(rays[i].first, rays[i].second - rays[i].first, center, radius);
+    }
+
+    void RayVsTriangles(IteratorRange<float*> dst, const std::pair<Float3, Float3>& ray, IteratorRange<const Float3*> triangleCorners)
+    {
+        assert(triangleCorners.size() % 3 == 0);
+        assert(dst.size() == triangleCorners.size() / 3);
+        for (size_t i=0; i<dst.size(); ++i) {
+            float alpha;
+            dst[i] = RayVsTriangle(alpha, ray, triangleCorners[i*3], triangleCorners[i*3+1], triangleCorners[i*3+2]) ? alpha : RayIntersection_Miss;
+        }
+    }
+
+    void RaysVsTriangle(IteratorRange<float*> dst, IteratorRange<const std::pair<Float3, Float3>*> rays, const Float3& v0, const Float3& v1, const Float3& v2)
+    {
+        assert(dst.size() == rays.size());
+        for (size_t i=0; i<rays.size(); ++i) {
+            float alpha;
+            dst[i] = RayVsTriangle(alpha, rays[i], v0, v1, v2) ? alpha : RayIntersection_Miss;
+        }
+    }
+
+#endif
+}
@@ -0,0 +1,51 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "Vector.h"
+#include "../Utility/IteratorUtils.h"       // for IteratorRange
+#include <utility>
+#include <limits>
+
+namespace XLEMath
+{
+        //
+        //      Ray intersection tests for many primitives (or many rays) at once
+        //
+        //      These test either one ray against an array of primitives, or an array of rays against
+        //      one primitive. Several tests are done at once with SIMD instructions (4 at a time with
+        //      SSE, or 8 with AVX2); without those instructions, they are tested one at a time. They
+        //      are intended for picking & CPU raycasting, where there are many candidates to test.
+        //
+        //      Rays are finite segments, given as a (start, end) pair (the same as RayVsAABB). For each
+        //      test the result is the position along the ray of the first intersection, where 0 is
+        //      the start of the ray and 1 is the end. When the ray starts inside of a volume, the
+        //      result is 0. When there's no intersection, the result is RayIntersection_Miss (which
+        //      compares greater than any intersection, so the closest hit is just the minimum result).
+        //
+        //      The results agree with the scalar functions in Geometry.h (RayVsAABB, RayVsSphere &
+        //      RayVsTriangle), except for rays that graze the surface of a primitive to within
+        //      floating point precision.
+        //
+        //      In each function, "dst" must be the same size as the array of primitives (or rays).
+        //
+
+    constexpr float RayIntersection_Miss = std::numeric_limits<float>::infinity();
+
+        /// dst[i] = first intersection of "ray" with the axis aligned box aabbs[i] (given as a (mins, maxs) pair)
+    void RayVsAABBs(IteratorRange<float*> dst, const std::pair<Float3, Float3>& ray, IteratorRange<const std::pair<Float3, Float3>*> aabbs);
+        /// dst[i] = first intersection of "ray" with the sphere spheres[i] (center in XYZ, radius in W)
+    void RayVsSpheres(IteratorRange<float*> dst, const std::pair<Float3, Float3>& ray, IteratorRange<const Float4*> spheres);
+        /// dst[i] = intersection of "ray" with the triangle (triangleCorners[i*3], triangleCorners[i*3+1], triangleCorners[i*3+2])
+        /// Triangles are double sided, and tested with the same watertight test as RayVsTriangle()
+    void RayVsTriangles(IteratorRange<float*> dst, const std::pair<Float3, Float3>& ray, IteratorRange<const Float3*> triangleCorners);
+
+        /// dst[i] = first intersection of rays[i] with the axis aligned box (mins, maxs)
+    void RaysVsAABB(IteratorRange<float*> dst, IteratorRange<const std::pair<Float3, Float3>*> rays, const Float3& mins, const Float3& maxs);
+        /// dst[i] = first intersection of rays[i] with the sphere at "center" with the given radius
+    void RaysVsSphere(IteratorRange<float*> dst, IteratorRange<const std::pair<Float3, Float3>*> rays, const Float3& center, float radius);
+        /// dst[i] = intersection of rays[i] with the triangle (v0, v1, v2)
+    void RaysVsTriangle(IteratorRange<float*> dst, IteratorRange<const std::pair<Float3, Float3>*> rays, const Float3& v0, const Float3& v1, const Float3& v2);
+}
@@ -0,0 +1,248 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "Vector.h"
+#include "../Core/Prefix.h"
+#include <cmath>
+
+#if (defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)) && defined(__SSE4_1__)
+    #include <immintrin.h>			// MSVC & clang intrinsic
+    #define HAS_SSE_INSTRUCTIONS
+    #if defined(__AVX2__)
+        #define HAS_AVX2_INSTRUCTIONS
+    #endif
+#endif
+
+#if defined(HAS_SSE_INSTRUCTIONS)
+
+namespace XLEMath
+{
+    //
+    //      Internal helpers shared by the array oriented (SIMD) math functions. Not intended for
+    //      use outside of the Math library implementation files.
+    //
+    //      These are only available with SIMD instructions; without them, those functions just
+    //      fall back to the per-element functions (emulating the lanes is slower than that).
+    //
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+        //      Lanes: one vector holds the same element from s_laneCount different array elements
+
+    #if defined(HAS_AVX2_INSTRUCTIONS)
+        static const unsigned s_laneCount = 8;
+        using LaneVector = __m256;
+        using LaneMask = __m256;
+        static force_inline LaneVector LaneLoad(const float* lanes) { return _mm256_load_ps(lanes); }
+        static force_inline LaneVector LaneLoadU(const float* lanes) { return _mm256_loadu_ps(lanes); }
+        static force_inline void LaneStore(float* lanes, LaneVector v) { _mm256_store_ps(lanes, v); }
+        static force_inline void LaneStoreU(float* lanes, LaneVector v) { _mm256_storeu_ps(lanes, v); }
+        static force_inline LaneVector LaneSplat(float f) { return _mm256_set1_ps(f); }
+        static force_inline LaneVector LaneAdd(LaneVector a, LaneVector b) { return _mm256_add_ps(a, b); }
+        static force_inline LaneVector LaneSub(LaneVector a, LaneVector b) { return _mm256_sub_ps(a, b); }
+        static force_inline LaneVector LaneMul(LaneVector a, LaneVector b) { return _mm256_mul_ps(a, b); }
+        static force_inline LaneVector LaneDiv(LaneVector a, LaneVector b) { return _mm256_div_ps(a, b); }
+        static force_inline LaneVector LaneSqrt(LaneVector a) { return _mm256_sqrt_ps(a); }
+        static force_inline LaneVector LaneNeg(LaneVector a) { return _mm256_xor_ps(a, _mm256_set1_ps(-0.f)); }
+        static force_inline LaneVector LaneAbs(LaneVector a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), a); }
+        static force_inline LaneMask LaneLess(LaneVector a, LaneVector b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+        static force_inline LaneMask LaneGreater(LaneVector a, LaneVector b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+        static force_inline LaneMask LaneGreaterEqual(LaneVector a, LaneVector b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+        static force_inline LaneMask LaneAnd(LaneMask a, LaneMask b) { return _mm256_and_ps(a, b); }
+        static force_inline LaneMask LaneAndNot(LaneMask a, LaneMask b) { return _mm256_andnot_ps(b, a); }        // a & ~b
+        static force_inline LaneVector LaneSelect(LaneMask m, LaneVector ifTrue, LaneVector ifFalse) { return _mm256_blendv_ps(ifFalse, ifTrue, m); }
+        static force_inline unsigned LaneMaskBits(LaneMask m) { return (unsigned)_mm256_movemask_ps(m); }
+        static force_inline LaneVector LaneMin(LaneVector a, LaneVector b) { return _mm256_min_ps(a, b); }
+        static force_inline LaneVector LaneMax(LaneVector a, LaneVector b) { return _mm256_max_ps(a, b); }
+        static force_inline LaneMask LaneLessEqual(LaneVector a, LaneVector b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+        static force_inline LaneMask LaneEqual(LaneVector a, LaneVector b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+        static force_inline LaneMask LaneOr(LaneMask a, LaneMask b) { return _mm256_or_ps(a, b); }
+    #else
+        static const unsigned s_laneCount = 4;
+        using LaneVector = __m128;
+        using LaneMask = __m128;
+        static force_inline LaneVector LaneLoad(const float* lanes) { return _mm_load_ps(lanes); }
+        static force_inline LaneVector LaneLoadU(const float* lanes) { return _mm_loadu_ps(lanes); }
+        static force_inline void LaneStore(float* lanes, LaneVector v) { _mm_store_ps(lanes, v); }
+        static force_inline void LaneStoreU(float* lanes, LaneVector v) { _mm_storeu_ps(lanes, v); }
+        static force_inline LaneVector LaneSplat(float f) { return _mm_set1_ps(f); }
+        static force_inline LaneVector LaneAdd(LaneVector a, LaneVector b) { return _mm_add_ps(a, b); }
+        static force_inline LaneVector LaneSub(LaneVector a, LaneVector b) { return _mm_sub_ps(a, b); }
+        static force_inline LaneVector LaneMul(LaneVector a, LaneVector b) { return _mm_mul_ps(a, b); }
+        static force_inline LaneVector LaneDiv(LaneVector a, LaneVector b) { return _mm_div_ps(a, b); }
+        static force_inline LaneVector LaneSqrt(LaneVector a) { return _mm_sqrt_ps(a); }
+        static force_inline LaneVector LaneNeg(LaneVector a) { return _mm_xor_ps(a, _mm_set1_ps(-0.f)); }
+        static force_inline LaneVector LaneAbs(LaneVector a) { return _mm_andnot_ps(_mm_set1_ps(-0.f), a); }
+        static force_inline LaneMask LaneLess(LaneVector a, LaneVector b) { return _mm_cmplt_ps(a, b); }
+        static force_inline LaneMask LaneGreater(LaneVector a, LaneVector b) { return _mm_cmpgt_ps(a, b); }
+        static force_inline LaneMask LaneGreaterEqual(LaneVector a, LaneVector b) { return _mm_cmpge_ps(a, b); }
+        static force_inline LaneMask LaneAnd(LaneMask a, LaneMask b) { return _mm_and_ps(a, b); }
+        static force_inline LaneMask LaneAndNot(LaneMask a, LaneMask b) { return _mm_andnot_ps(b, a); }           // a & ~b
+        static force_inline LaneVector LaneSelect(LaneMask m, LaneVector ifTrue, LaneVector ifFalse) { return _mm_blendv_ps(ifFalse, ifTrue, m); }
+        static force_inline unsigned LaneMaskBits(LaneMask m) { return (unsigned)_mm_movemask_ps(m); }
+        static force_inline LaneVector LaneMin(LaneVector a, LaneVector b) { return _mm_min_ps(a, b); }
+        static force_inline LaneVector LaneMax(LaneVector a, LaneVector b) { return _mm_max_ps(a, b); }
+        static force_inline LaneMask LaneLessEqual(LaneVector a, LaneVector b) { return _mm_cmple_ps(a, b); }
+        static force_inline LaneMask LaneEqual(LaneVector a, LaneVector b) { return _mm_cmpeq_ps(a, b); }
+        static force_inline LaneMask LaneOr(LaneMask a, LaneMask b) { return _mm_or_ps(a, b); }
+    #endif
+
+    static force_inline LaneVector LaneMulAdd(LaneVector a, LaneVector b, LaneVector c) { return LaneAdd(LaneMul(a, b), c); }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+        //      Gather & scatter: transposing between arrays of elements and lanes
+
+    static inline void Transpose4(__m128 dst[4], const float* const src[4], unsigned offset)
+    {
+        auto r0 = _mm_loadu_ps(src[0]+offset), r1 = _mm_loadu_ps(src[1]+offset), r2 = _mm_loadu_ps(src[2]+offset), r3 = _mm_loadu_ps(src[3]+offset);
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        dst[0] = r0; dst[1] = r1; dst[2] = r2; dst[3] = r3;
+    }
+
+    static inline void Transpose4(float* const dst[4], unsigned activeLanes, unsigned offset, __m128 r0, __m128 r1, __m128 r2, __m128 r3)
+    {
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        if (activeLanes > 0) _mm_storeu_ps(dst[0]+offset, r0);
+        if (activeLanes > 1) _mm_storeu_ps(dst[1]+offset, r1);
+        if (activeLanes > 2) _mm_storeu_ps(dst[2]+offset, r2);
+        if (activeLanes > 3) _mm_storeu_ps(dst[3]+offset, r3);
+    }
+
+    static inline void GatherLaneGroup(LaneVector dst[], const float* const src[s_laneCount], unsigned offset)
+    {
+        #if defined(HAS_AVX2_INSTRUCTIONS)
+            __m128 lo[4], hi[4];
+            Transpose4(lo, src, offset);
+            Transpose4(hi, src+4, offset);
+            for (unsigned q=0; q<4; ++q)
+                dst[offset+q] = _mm256_insertf128_ps(_mm256_castps128_ps256(lo[q]), hi[q], 1);
+        #else
+            Transpose4(&dst[offset], src, offset);
+        #endif
+    }
+
+    static inline void ScatterLaneGroup(float* const dst[s_laneCount], unsigned activeLanes, const LaneVector src[], unsigned offset)
+    {
+        #if defined(HAS_AVX2_INSTRUCTIONS)
+            Transpose4(
+                dst, activeLanes, offset,
+                _mm256_castps256_ps128(src[offset+0]), _mm256_castps256_ps128(src[offset+1]),
+                _mm256_castps256_ps128(src[offset+2]), _mm256_castps256_ps128(src[offset+3]));
+            if (activeLanes > 4)
+                Transpose4(
+                    dst+4, activeLanes-4, offset,
+                    _mm256_extractf128_ps(src[offset+0], 1), _mm256_extractf128_ps(src[offset+1], 1),
+                    _mm256_extractf128_ps(src[offset+2], 1), _mm256_extractf128_ps(src[offset+3], 1));
+        #else
+            Transpose4(dst, activeLanes, offset, src[offset+0], src[offset+1], src[offset+2], src[offset+3]);
+        #endif
+    }
+
+        // Load "count" consecutive floats from each lane's source, returning one vector per float
+    static inline void GatherLanes(LaneVector dst[], const float* const src[s_laneCount], unsigned count)
+    {
+        if (count >= 4) {
+                // groups of 4 floats are transposed together; a final partial group overlaps the previous one
+            for (unsigned c=0; (c+4)<=count; c+=4)
+                GatherLaneGroup(dst, src, c);
+            if (count%4)
+                GatherLaneGroup(dst, src, count-4);
+            return;
+        }
+        for (unsigned c=0; c<count; ++c) {
+            alignas(32) float t[s_laneCount];
+            for (unsigned l=0; l<s_laneCount; ++l) t[l] = src[l][c];
+            dst[c] = LaneLoad(t);
+        }
+    }
+
+        // Write "count" vectors back to consecutive floats in the destination of each of the first "activeLanes" lanes
+    static inline void ScatterLanes(float* const dst[s_laneCount], unsigned activeLanes, const LaneVector src[], unsigned count)
+    {
+        if (count >= 4) {
+            for (unsigned c=0; (c+4)<=count; c+=4)
+                ScatterLaneGroup(dst, activeLanes, src, c);
+            if (count%4)
+                ScatterLaneGroup(dst, activeLanes, src, count-4);
+            return;
+        }
+        for (unsigned c=0; c<count; ++c) {
+            alignas(32) float t[s_laneCount];
+            LaneStore(t, src[c]);
+            for (unsigned l=0; l<activeLanes; ++l) dst[l][c] = t[l];
+        }
+    }
+
+        // Pointers to the floats of "s_laneCount" consecutive elements, starting at "first". Lanes past the end
+        // of the range repeat the last element, so the full width can always be processed
+    template<typename ElementType, typename Member>
+        static inline void LanePointers(const float* dst[s_laneCount], IteratorRange<const ElementType*> src, size_t first, Member&& member)
+    {
+        for (unsigned l=0; l<s_laneCount; ++l)
+            dst[l] = member(src[std::min(first+l, src.size()-1)]);
+    }
+
+    template<typename ElementType, typename Member>
+        static inline void LanePointers(float* dst[s_laneCount], IteratorRange<ElementType*> range, size_t first, Member&& member)
+    {
+        for (unsigned l=0; l<s_laneCount; ++l)
+            dst[l] = member(range[std::min(first+l, range.size()-1)]);
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+        //      Float3 arrays
+        //
+        //      Groups of 4 packed Float3s are 3 SSE registers (x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3);
+        //      these are rearranged into (x0 x1 x2 x3), etc with blends & shuffles. With AVX, each
+        //      128 bit half handles a separate group of 4.
+
+    #if defined(HAS_AVX2_INSTRUCTIONS)
+        #define LANE_BLEND(A, B, IMM) _mm256_blend_ps(A, B, (IMM) | ((IMM) << 4))
+        #define LANE_SHUFFLE(A, IMM) _mm256_shuffle_ps(A, A, IMM)
+        static force_inline LaneVector LoadFloat3Block(const float* src, unsigned offset)
+        {
+            return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(src+offset)), _mm_loadu_ps(src+12+offset), 1);
+        }
+    #else
+        #define LANE_BLEND(A, B, IMM) _mm_blend_ps(A, B, IMM)
+        #define LANE_SHUFFLE(A, IMM) _mm_shuffle_ps(A, A, IMM)
+        static force_inline LaneVector LoadFloat3Block(const float* src, unsigned offset) { return _mm_loadu_ps(src+offset); }
+    #endif
+
+    static force_inline void LoadFloat3Lanes(LaneVector& x, LaneVector& y, LaneVector& z, const float* src)
+    {
+        auto a = LoadFloat3Block(src, 0), b = LoadFloat3Block(src, 4), c = LoadFloat3Block(src, 8);
+        x = LANE_SHUFFLE(LANE_BLEND(LANE_BLEND(a, b, 0x4), c, 0x2), _MM_SHUFFLE(1,2,3,0));     // (a0 c1 b2 a3) -> (a0 a3 b2 c1)
+        y = LANE_SHUFFLE(LANE_BLEND(LANE_BLEND(a, b, 0x9), c, 0x4), _MM_SHUFFLE(2,3,0,1));     // (b0 a1 c2 b3) -> (a1 b0 b3 c2)
+        z = LANE_SHUFFLE(LANE_BLEND(LANE_BLEND(a, b, 0x2), c, 0x9), _MM_SHUFFLE(3,0,1,2));     // (c0 b1 a2 c3) -> (a2 b1 c0 c3)
+    }
+
+    static force_inline void StoreFloat3Lanes(float* dst, LaneVector x, LaneVector y, LaneVector z)
+    {
+            // each of these permutations is its own inverse
+        x = LANE_SHUFFLE(x, _MM_SHUFFLE(1,2,3,0));
+        y = LANE_SHUFFLE(y, _MM_SHUFFLE(2,3,0,1));
+        z = LANE_SHUFFLE(z, _MM_SHUFFLE(3,0,1,2));
+        auto a = LANE_BLEND(LANE_BLEND(x, y, 0x2), z, 0x4);
+        auto b = LANE_BLEND(LANE_BLEND(y, z, 0x2), x, 0x4);
+        auto c = LANE_BLEND(LANE_BLEND(z, x, 0x2), y, 0x4);
+        #if defined(HAS_AVX2_INSTRUCTIONS)
+            _mm_storeu_ps(dst+0, _mm256_castps256_ps128(a));
+            _mm_storeu_ps(dst+4, _mm256_castps256_ps128(b));
+            _mm_storeu_ps(dst+8, _mm256_castps256_ps128(c));
+            _mm_storeu_ps(dst+12, _mm256_extractf128_ps(a, 1));
+            _mm_storeu_ps(dst+16, _mm256_extractf128_ps(b, 1));
+            _mm_storeu_ps(dst+20, _mm256_extractf128_ps(c, 1));
+        #else
+            _mm_storeu_ps(dst+0, a);
+            _mm_storeu_ps(dst+4, b);
+            _mm_storeu_ps(dst+8, c);
+        #endif
+    }
+    #undef LANE_BLEND
+    #undef LANE_SHUFFLE
+}
+
+#endif
@@ -1098,12 +1098,14 @@ namespace PlatformRig { namespace Overlays
         size_t largestFreeBlock = 0;
         size_t largestHeapSize = 0;
         size_t totalBlockCount = 0;
+        float fragmentationSum = 0.f;
         for (auto i=metrics._heaps.begin(); i!=metrics._heaps.end(); ++i) {
             allocatedSpace += i->_allocatedSpace;
             unallocatedSpace += i->_unallocatedSpace;
             largestFreeBlock = std::max(largestFreeBlock, i->_largestFreeBlock);
             largestHeapSize = std::max(largestHeapSize, i->_heapSize);
             totalBlockCount += i->_referencedCountedBlockCount;
+            fragmentationSum += i->CalculateFragmentation();
         }
 
         _runningAveAllocs = LinearInterpolate(_runningAveAllocs, (float)metrics._recentAllocateBytes, 0.05f);
@@ -1115,7 +1117,7 @@ namespace PlatformRig { namespace Overlays
                 StringMeldInPlace(buffer) << "Heap count: " << metrics._heaps.size() << " / Total allocated: " << ByteCount{allocatedSpace} << " / Total unallocated: " << ByteCount{unallocatedSpace});
             if (!metrics._heaps.empty()) {
                 DrawText().Color(textColour).FormatAndDraw(context, layout.Allocate(16), 
-                    StringMeldInPlace(buffer) << "Largest free block: " << ByteCount{largestFreeBlock} << " / Average unallocated: " << ByteCount{unallocatedSpace/metrics._heaps.size()});
+                    StringMeldInPlace(buffer) << "Largest free block: " << ByteCount{largestFreeBlock} << " / Average unallocated: " << ByteCount{unallocatedSpace/metrics._heaps.size()} << " / Average fragmentation: " << unsigned(100.f*fragmentationSum/metrics._heaps.size()) << "%");
                 DrawText().Color(textColour).FormatAndDraw(context, layout.Allocate(16),
                     StringMeldInPlace(buffer) << "Block count: " << totalBlockCount << " / Ave block size: " << ByteCount{allocatedSpace/totalBlockCount});
 
@@ -0,0 +1,477 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "AnimationSampling.h"
+#include "RawAnimationCurve.h"
+#include "../../Math/Matrix.h"
+#include "../../Math/Quaternion.h"
+#include "../../Math/Vector.h"
+#include "../../Utility/Threading/CompletionThreadPool.h"
+#include "../../Utility/PtrUtils.h"
+#include <unordered_map>
+#include <cstring>
+
+#if (defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)) && defined(__SSE4_1__)
+	#include <immintrin.h>			// MSVC & clang intrinsic
+	#define HAS_SSE_INSTRUCTIONS
+#endif
+
+namespace RenderCore { namespace Assets
+{
+	Quaternion Decompress_36bit(const void* data);
+
+	using Track = AnimationSamplingContext::Track;
+	static const unsigned s_maxCursorSteps = 4;			// fall back to a binary search after stepping forward this many keys
+	static const unsigned s_minInstancesPerTask = 16;
+
+	static unsigned SamplerTypeSize(AnimSamplerType samplerType)
+	{
+		switch (samplerType) {
+		case AnimSamplerType::Float1: return sizeof(float);
+		case AnimSamplerType::Float3: return sizeof(Float3);
+		case AnimSamplerType::Float4: return sizeof(Float4);
+		case AnimSamplerType::Float4x4: return sizeof(Float4x4);
+		case AnimSamplerType::Quaternion: return sizeof(Quaternion);
+		}
+		return 0;
+	}
+
+	static void ResolveKeys(const Track& track, uint32_t& cursor, float frame, unsigned& k0, unsigned& k1, float& alpha)
+	{
+		if (track._timeMarkers) {
+			// Find the first key after "frame", as per the upper_bound() in RawAnimationCurve::Calculate
+			auto* markers = track._timeMarkers;
+			unsigned keyCount = track._keyCount;
+			auto f = (uint16_t)((frame > 0.f) ? std::min(frame, 65535.f) : 0.f);
+			unsigned keyUpper = std::min(cursor, keyCount);
+			if (keyUpper != 0 && markers[keyUpper-1] > f) {
+				// moving backwards (eg, a looping animation wrapping around)
+				keyUpper = unsigned(std::upper_bound(markers, markers+keyUpper, f) - markers);
+			} else {
+				unsigned steps = 0;
+				while (keyUpper < keyCount && markers[keyUpper] <= f) {
+					++keyUpper;
+					if (++steps == s_maxCursorSteps) {
+						keyUpper = unsigned(std::upper_bound(markers+keyUpper, markers+keyCount, f) - markers);
+						break;
+					}
+				}
+			}
+			cursor = keyUpper;
+
+				// note -- clamping at start and end positions of the curve
+			if (expect_evaluation(keyUpper == keyCount || keyUpper == 0, false)) {
+				k0 = k1 = (frame == 0.f) ? 0 : keyCount-1;
+				alpha = 0.f;
+				return;
+			}
+			k0 = keyUpper-1;
+			k1 = keyUpper;
+			alpha = (frame - float(markers[k0])) / (float(markers[k1]) - float(markers[k0]));
+		} else {
+			// key on every frame
+			unsigned key = (frame > 0.f) ? unsigned(frame) : 0u;
+			alpha = frame - float(key);
+			k0 = std::min(key, track._keyCount-1);
+			k1 = std::min(key+1, track._keyCount-1);
+		}
+	}
+
+		//
+		//	Slerp weights without trig functions, from "A Fast and Accurate Algorithm for Computing SLERP" (David Eberly)
+		//	slerp(q0, q1, t) = w0*q0 + w1*q1, where "x" is dot(q0, q1) (which must be >= 0)
+		//
+	static const float s_slerpMu = 1.85298109240830f;
+	static const float s_slerpU[8] = { 1.f/(1*3), 1.f/(2*5), 1.f/(3*7), 1.f/(4*9), 1.f/(5*11), 1.f/(6*13), 1.f/(7*15), s_slerpMu/(8*17) };
+	static const float s_slerpV[8] = { 1.f/3, 2.f/5, 3.f/7, 4.f/9, 5.f/11, 6.f/13, 7.f/15, s_slerpMu*8/17 };
+
+	static void SlerpWeights(float x, float t, float& w0, float& w1)
+	{
+		float xm1 = x - 1.f, d = 1.f - t;
+		float sqrT = t*t, sqrD = d*d;
+		float fT = 1.f, fD = 1.f;
+		for (int i=7; i>=0; --i) {
+			fT = 1.f + (s_slerpU[i]*sqrT - s_slerpV[i])*xm1*fT;
+			fD = 1.f + (s_slerpU[i]*sqrD - s_slerpV[i])*xm1*fD;
+		}
+		w0 = d*fD;
+		w1 = t*fT;
+	}
+
+#if defined(HAS_SSE_INSTRUCTIONS)
+	static void SlerpWeights(__m128 x, __m128 t, __m128& w0, __m128& w1)
+	{
+		auto one = _mm_set1_ps(1.f);
+		auto xm1 = _mm_sub_ps(x, one), d = _mm_sub_ps(one, t);
+		auto sqrT = _mm_mul_ps(t, t), sqrD = _mm_mul_ps(d, d);
+		auto fT = one, fD = one;
+		for (int i=7; i>=0; --i) {
+			auto u = _mm_set1_ps(s_slerpU[i]), v = _mm_set1_ps(s_slerpV[i]);
+			fT = _mm_add_ps(one, _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(_mm_mul_ps(u, sqrT), v), xm1), fT));
+			fD = _mm_add_ps(one, _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(_mm_mul_ps(u, sqrD), v), xm1), fD));
+		}
+		w0 = _mm_mul_ps(d, fD);
+		w1 = _mm_mul_ps(t, fT);
+	}
+#endif
+
+		//
+		//	Each Evaluate function handles all of the tracks of one TrackType in a block
+		//
+
+	static void EvaluateStep(const Track* tracks, const Track* tracksEnd, uint32_t* cursors, const float* keys, unsigned keySize, float frame, void* output)
+	{
+		unsigned k0, k1; float alpha;
+		for (auto* t=tracks; t!=tracksEnd; ++t, ++cursors) {
+			ResolveKeys(*t, *cursors, frame, k0, k1, alpha);
+			if (keySize == 1) {
+				*(float*)PtrAdd(output, t->_outputOffset) = keys[t->_firstKey+k0];
+			} else
+				std::memcpy(PtrAdd(output, t->_outputOffset), &keys[t->_firstKey+k0*4], keySize*sizeof(float));
+		}
+	}
+
+	static void EvaluateLinear1(const Track* tracks, const Track* tracksEnd, uint32_t* cursors, const float* keys, float frame, void* output)
+	{
+		unsigned k0, k1; float alpha;
+		auto* t = tracks;
+		#if defined(HAS_SSE_INSTRUCTIONS)
+			for (; (tracksEnd-t)>=4; t+=4, cursors+=4) {
+				alignas(16) float p0[4], p1[4], a[4], r[4];
+				for (unsigned l=0; l<4; ++l) {
+					ResolveKeys(t[l], cursors[l], frame, k0, k1, a[l]);
+					p0[l] = keys[t[l]._firstKey+k0];
+					p1[l] = keys[t[l]._firstKey+k1];
+				}
+				auto P0 = _mm_load_ps(p0);
+				_mm_store_ps(r, _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(p1), P0), _mm_load_ps(a)), P0));
+				for (unsigned l=0; l<4; ++l)
+					*(float*)PtrAdd(output, t[l]._outputOffset) = r[l];
+			}
+		#endif
+		for (; t!=tracksEnd; ++t, ++cursors) {
+			ResolveKeys(*t, *cursors, frame, k0, k1, alpha);
+			*(float*)PtrAdd(output, t->_outputOffset) = LinearInterpolate(keys[t->_firstKey+k0], keys[t->_firstKey+k1], alpha);
+		}
+	}
+
+	template<unsigned Dimension>
+		static void EvaluateLinear(const Track* tracks, const Track* tracksEnd, uint32_t* cursors, const float* keys, float frame, void* output)
+	{
+		// keys are padded to 4 floats, so Float3 & Float4 are both a single SIMD lerp per track
+		unsigned k0, k1; float alpha;
+		for (auto* t=tracks; t!=tracksEnd; ++t, ++cursors) {
+			ResolveKeys(*t, *cursors, frame, k0, k1, alpha);
+			auto* p0 = &keys[t->_firstKey+k0*4];
+			auto* p1 = &keys[t->_firstKey+k1*4];
+			auto* dst = (float*)PtrAdd(output, t->_outputOffset);
+			#if defined(HAS_SSE_INSTRUCTIONS)
+				auto P0 = _mm_loadu_ps(p0);
+				auto r = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(p1), P0), _mm_set1_ps(alpha)), P0);
+				if constexpr (Dimension == 4) {
+					_mm_storeu_ps(dst, r);
+				} else {
+					_mm_storel_pi((__m64*)dst, r);
+					_mm_store_ss(dst+2, _mm_movehl_ps(r, r));
+				}
+			#else
+				for (unsigned c=0; c<Dimension; ++c)
+					dst[c] = LinearInterpolate(p0[c], p1[c], alpha);
+			#endif
+		}
+	}
+
+	static void EvaluateSlerp(const Track* tracks, const Track* tracksEnd, uint32_t* cursors, const float* keys, float frame, void* output)
+	{
+		// 4 quaternions at a time, in structure-of-arrays form. Partial groups repeat the last track
+		unsigned k0, k1, count;
+		for (auto* t=tracks; t!=tracksEnd; t+=count, cursors+=count) {
+			count = (unsigned)std::min(ptrdiff_t(4), tracksEnd-t);
+			const float* p0[4]; const float* p1[4];
+			alignas(16) float a[4];
+			for (unsigned l=0; l<count; ++l) {
+				ResolveKeys(t[l], cursors[l], frame, k0, k1, a[l]);
+				p0[l] = &keys[t[l]._firstKey+k0*4];
+				p1[l] = &keys[t[l]._firstKey+k1*4];
+			}
+			for (unsigned l=count; l<4; ++l) { p0[l] = p0[count-1]; p1[l] = p1[count-1]; a[l] = a[count-1]; }
+
+			#if defined(HAS_SSE_INSTRUCTIONS)
+				auto A0 = _mm_loadu_ps(p0[0]), A1 = _mm_loadu_ps(p0[1]), A2 = _mm_loadu_ps(p0[2]), A3 = _mm_loadu_ps(p0[3]);
+				auto B0 = _mm_loadu_ps(p1[0]), B1 = _mm_loadu_ps(p1[1]), B2 = _mm_loadu_ps(p1[2]), B3 = _mm_loadu_ps(p1[3]);
+				_MM_TRANSPOSE4_PS(A0, A1, A2, A3);
+				_MM_TRANSPOSE4_PS(B0, B1, B2, B3);
+
+					// negate q1 where required to take the shorter path (as per SphericalInterpolate)
+				auto dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(A0, B0), _mm_mul_ps(A1, B1)), _mm_add_ps(_mm_mul_ps(A2, B2), _mm_mul_ps(A3, B3)));
+				auto signBits = _mm_and_ps(dot, _mm_set1_ps(-0.f));
+				B0 = _mm_xor_ps(B0, signBits); B1 = _mm_xor_ps(B1, signBits);
+				B2 = _mm_xor_ps(B2, signBits); B3 = _mm_xor_ps(B3, signBits);
+
+				__m128 w0, w1;
+				SlerpWeights(_mm_xor_ps(dot, signBits), _mm_load_ps(a), w0, w1);
+				auto R0 = _mm_add_ps(_mm_mul_ps(A0, w0), _mm_mul_ps(B0, w1));
+				auto R1 = _mm_add_ps(_mm_mul_ps(A1, w0), _mm_mul_ps(B1, w1));
+				auto R2 = _mm_add_ps(_mm_mul_ps(A2, w0), _mm_mul_ps(B2, w1));
+				auto R3 = _mm_add_ps(_mm_mul_ps(A3, w0), _mm_mul_ps(B3, w1));
+				_MM_TRANSPOSE4_PS(R0, R1, R2, R3);
+				__m128 r[4] = { R0, R1, R2, R3 };
+				for (unsigned l=0; l<count; ++l)
+					_mm_storeu_ps((float*)PtrAdd(output, t[l]._outputOffset), r[l]);
+			#else
+				for (unsigned l=0; l<count; ++l) {
+					float dot = p0[l][0]*p1[l][0] + p0[l][1]*p1[l][1] + p0[l][2]*p1[l][2] + p0[l][3]*p1[l][3];
+					float w0, w1;
+					SlerpWeights(std::abs(dot), a[l], w0, w1);
+					if (dot < 0.f) w1 = -w1;
+					auto* dst = (float*)PtrAdd(output, t[l]._outputOffset);
+					for (unsigned c=0; c<4; ++c)
+						dst[c] = p0[l][c]*w0 + p1[l][c]*w1;
+				}
+			#endif
+		}
+	}
+
+	void AnimationSamplingContext::EvaluateInstance(void* outputBlock, const AnimationState& animState, InstanceState& instance, uint32_t* cursors) const
+	{
+		if (animState._animation == 0x0) return;
+
+		auto animations = _animSet->GetAnimations();
+		if (instance._animation != animState._animation) {
+			auto i = std::lower_bound(animations.begin(), animations.end(), animState._animation, CompareFirst<uint64_t, AnimationSet::Animation>());
+			instance._animation = animState._animation;
+			instance._animationIndex = (i!=animations.end() && i->first == animState._animation) ? unsigned(i-animations.begin()) : ~0u;
+		}
+		if (instance._animationIndex == ~0u) return;
+
+		const auto& anim = animations[instance._animationIndex].second;
+		if (anim._startBlock == anim._endBlock) return;
+		auto animBlocks = _animSet->GetAnimationBlocks();
+		float frame = animState._time * anim._framesPerSecond;
+		auto b = anim._startBlock;
+		while ((b+1) != anim._endBlock && frame >= animBlocks[b+1]._beginFrame) ++b;
+		frame -= animBlocks[b]._beginFrame;
+
+		if (b != instance._block) {
+			std::fill(cursors, cursors+_maxTracksPerBlock, 0u);
+			instance._block = b;
+		}
+
+		const auto& plan = _blocks[b];
+		const auto* tracks = _tracks.data();
+		const auto* keys = _keys.data();
+		auto cursorsFor = [&](TrackType type) { return cursors + (plan._trackBegin[unsigned(type)] - plan._trackBegin[0]); };
+		auto range = [&](TrackType type) { return std::make_pair(tracks + plan._trackBegin[unsigned(type)], tracks + plan._trackBegin[unsigned(type)+1]); };
+
+		auto r = range(TrackType::Step1); EvaluateStep(r.first, r.second, cursorsFor(TrackType::Step1), keys, 1, frame, outputBlock);
+		r = range(TrackType::Step3); EvaluateStep(r.first, r.second, cursorsFor(TrackType::Step3), keys, 3, frame, outputBlock);
+		r = range(TrackType::Step4); EvaluateStep(r.first, r.second, cursorsFor(TrackType::Step4), keys, 4, frame, outputBlock);
+		r = range(TrackType::Linear1); EvaluateLinear1(r.first, r.second, cursorsFor(TrackType::Linear1), keys, frame, outputBlock);
+		r = range(TrackType::Linear3); EvaluateLinear<3>(r.first, r.second, cursorsFor(TrackType::Linear3), keys, frame, outputBlock);
+		r = range(TrackType::Linear4); EvaluateLinear<4>(r.first, r.second, cursorsFor(TrackType::Linear4), keys, frame, outputBlock);
+		r = range(TrackType::Slerp); EvaluateSlerp(r.first, r.second, cursorsFor(TrackType::Slerp), keys, frame, outputBlock);
+
+		for (auto d=plan._fallbackBegin; d<plan._fallbackEnd; ++d) {
+			const auto& driver = _fallbackDrivers[d];
+			auto* dst = PtrAdd(outputBlock, driver._outputOffset);
+			switch (driver._samplerType) {
+			case AnimSamplerType::Float4x4: *(Float4x4*)dst = driver._curve->Calculate<Float4x4>(frame, driver._interpolationType); break;
+			case AnimSamplerType::Float4: *(Float4*)dst = driver._curve->Calculate<Float4>(frame, driver._interpolationType); break;
+			case AnimSamplerType::Quaternion: *(Quaternion*)dst = driver._curve->Calculate<Quaternion>(frame, driver._interpolationType); break;
+			case AnimSamplerType::Float3: *(Float3*)dst = driver._curve->Calculate<Float3>(frame, driver._interpolationType); break;
+			case AnimSamplerType::Float1: *(float*)dst = driver._curve->Calculate<float>(frame, driver._interpolationType); break;
+			}
+		}
+
+		for (auto c=plan._constantBegin; c<plan._constantEnd; ++c) {
+			const auto& driver = _constantDrivers[c];
+			std::memcpy(PtrAdd(outputBlock, driver._outputOffset), &_constantData[driver._dataOffset], driver._size);
+		}
+	}
+
+	void AnimationSamplingContext::CalculateOutput(
+		IteratorRange<void*>					outputBlocks,
+		size_t									outputBlockStride,
+		IteratorRange<const AnimationState*>	animStates,
+		Utility::ThreadPool*					threadPool)
+	{
+		if (animStates.empty()) return;
+		if (!_animSet)
+			Throw(::Exceptions::BasicLabel("AnimationSamplingContext::CalculateOutput called on an uninitialized context"));
+		auto instanceCount = (unsigned)animStates.size();
+		if (outputBlocks.size() < (instanceCount-1)*outputBlockStride+_minimumOutputBlockSize)
+			Throw(::Exceptions::BasicLabel("Output blocks passed to AnimationSamplingContext::CalculateOutput are too small"));
+
+		if (_instances.size() < instanceCount) {
+			_instances.resize(instanceCount);
+			_cursors.resize(size_t(instanceCount)*_maxTracksPerBlock, 0u);
+		}
+
+		unsigned taskCount = 1;
+		if (threadPool && threadPool->IsGood() && instanceCount >= 2*s_minInstancesPerTask)
+			taskCount = std::min(instanceCount/s_minInstancesPerTask, threadPool->GetThreadContext()+1);
+
+		auto taskFn = [&](unsigned t) {
+			for (unsigned i=instanceCount*t/taskCount; i<instanceCount*(t+1)/taskCount; ++i)
+				EvaluateInstance(
+					PtrAdd(outputBlocks.begin(), i*outputBlockStride), animStates[i],
+					_instances[i], _cursors.data() + size_t(i)*_maxTracksPerBlock);
+		};
+
+		if (taskCount > 1) {
+			ParallelFor(*threadPool, taskCount, taskFn);
+		} else
+			taskFn(0);
+	}
+
+	void AnimationSamplingContext::ResetCursors()
+	{
+		for (auto& i:_instances) i = InstanceState{};
+		std::fill(_cursors.begin(), _cursors.end(), 0u);
+	}
+
+	static AnimationSamplingContext::TrackType SelectTrackType(const RawAnimationCurve& curve, CurveInterpolationType interpolationType, AnimSamplerType samplerType)
+	{
+		using TrackType = AnimationSamplingContext::TrackType;
+		const auto& desc = curve.Desc();
+		if (desc._timeMarkerType == TimeMarkerType::FrameIndices) {
+			if (curve.TimeMarkers().empty() || curve.TimeMarkers().size() != curve.KeyCount()) return TrackType::Max;
+		} else if (desc._timeMarkerType != TimeMarkerType::None || curve.KeyCount() == 0)
+			return TrackType::Max;
+
+		bool linear = interpolationType == CurveInterpolationType::Linear;
+		if (!linear && interpolationType != CurveInterpolationType::None) return TrackType::Max;
+
+		switch (samplerType) {
+		case AnimSamplerType::Float1: return linear ? TrackType::Linear1 : TrackType::Step1;
+		case AnimSamplerType::Float3: return linear ? TrackType::Linear3 : TrackType::Step3;
+		case AnimSamplerType::Float4: return linear ? TrackType::Linear4 : TrackType::Step4;
+		case AnimSamplerType::Quaternion:
+			if ((desc._flags & CurveDesc::Flags::HasDequantBlock) && !(desc._flags & CurveDesc::Flags::BitPackedKeys)) return TrackType::Max;
+			return linear ? TrackType::Slerp : TrackType::Step4;
+		default: return TrackType::Max;
+		}
+	}
+
+	static unsigned DecodeCurveKeys(std::vector<float>& dst, const RawAnimationCurve& curve, AnimSamplerType samplerType)
+	{
+		auto result = (unsigned)dst.size();
+		auto keyCount = curve.KeyCount();
+		if (samplerType == AnimSamplerType::Float1) {
+			dst.resize(result+keyCount);
+			curve.DecodeKeys(MakeIteratorRange(dst.data()+result, dst.data()+result+keyCount));
+			return result;
+		}
+
+		dst.resize(result+keyCount*4, 0.f);
+		auto* d = dst.data()+result;
+		if (samplerType == AnimSamplerType::Float3) {
+			std::vector<Float3> keys(keyCount);
+			curve.DecodeKeys(MakeIteratorRange(keys.data(), keys.data()+keyCount));
+			for (const auto& k:keys) { d[0] = k[0]; d[1] = k[1]; d[2] = k[2]; d += 4; }
+		} else if (samplerType == AnimSamplerType::Float4) {
+			std::vector<Float4> keys(keyCount);
+			curve.DecodeKeys(MakeIteratorRange(keys.data(), keys.data()+keyCount));
+			for (const auto& k:keys) { d[0] = k[0]; d[1] = k[1]; d[2] = k[2]; d[3] = k[3]; d += 4; }
+		} else {
+			assert(samplerType == AnimSamplerType::Quaternion);
+			std::vector<Quaternion> keys(keyCount);
+			curve.DecodeKeys(MakeIteratorRange(keys.data(), keys.data()+keyCount));
+			for (const auto& k:keys) { d[0] = k[0]; d[1] = k[1]; d[2] = k[2]; d[3] = k[3]; d += 4; }
+		}
+		return result;
+	}
+
+	AnimationSamplingContext::AnimationSamplingContext(
+		const AnimationSet& animSet,
+		IteratorRange<const AnimationSet::ParameterBindingRules*> bindingRules)
+	: _animSet(&animSet)
+	{
+		for (const auto& br:bindingRules)
+			if (br._outputOffset != ~0u)
+				_minimumOutputBlockSize = std::max(_minimumOutputBlockSize, size_t(br._outputOffset + SamplerTypeSize(br._samplerType)));
+
+		auto drivers = animSet.GetAnimationDrivers();
+		auto constantDrivers = animSet.GetConstantDrivers();
+		auto constantData = animSet.GetConstantData();
+		auto curves = animSet.GetCurves();
+		std::unordered_map<uint64_t, unsigned> decodedCurves;		// (curve index, sampler type) -> offset in _keys
+		std::vector<Track> tracksByType[unsigned(TrackType::Max)];
+
+		_blocks.reserve(animSet.GetAnimationBlocks().size());
+		for (const auto& block:animSet.GetAnimationBlocks()) {
+			BlockPlan plan;
+			for (auto& t:tracksByType) t.clear();
+
+			plan._fallbackBegin = (unsigned)_fallbackDrivers.size();
+			for (auto d=block._beginDriver; d<block._endDriver; ++d) {
+				const auto& driver = drivers[d];
+				if (driver._parameterIndex >= bindingRules.size()) continue;
+				const auto& br = bindingRules[driver._parameterIndex];
+				if (br._outputOffset == ~0u) continue;   // (unbound output)
+
+				assert(driver._curveIndex < curves.size());
+				const auto& curve = curves[driver._curveIndex];
+				auto type = SelectTrackType(curve, driver._interpolationType, br._samplerType);
+				if (type == TrackType::Max) {
+					_fallbackDrivers.push_back({&curve, driver._interpolationType, br._samplerType, br._outputOffset});
+					continue;
+				}
+
+				auto decodeKey = (uint64_t(driver._curveIndex) << 32ull) | uint64_t(br._samplerType);
+				auto i = decodedCurves.find(decodeKey);
+				if (i == decodedCurves.end())
+					i = decodedCurves.insert({decodeKey, DecodeCurveKeys(_keys, curve, br._samplerType)}).first;
+
+				Track track;
+				track._timeMarkers = (curve.Desc()._timeMarkerType == TimeMarkerType::FrameIndices) ? curve.TimeMarkers().begin() : nullptr;
+				track._keyCount = curve.KeyCount();
+				track._firstKey = i->second;
+				track._outputOffset = br._outputOffset;
+				tracksByType[unsigned(type)].push_back(track);
+			}
+			plan._fallbackEnd = (unsigned)_fallbackDrivers.size();
+
+			plan._trackBegin[0] = (unsigned)_tracks.size();
+			for (unsigned t=0; t<unsigned(TrackType::Max); ++t) {
+				_tracks.insert(_tracks.end(), tracksByType[t].begin(), tracksByType[t].end());
+				plan._trackBegin[t+1] = (unsigned)_tracks.size();
+			}
+			_maxTracksPerBlock = std::max(_maxTracksPerBlock, plan._trackBegin[unsigned(TrackType::Max)] - plan._trackBegin[0]);
+
+				// decompress constants now, so sampling is just a copy
+			plan._constantBegin = (unsigned)_constantDrivers.size();
+			for (auto c=block._beginConstantDriver; c<block._endConstantDriver; ++c) {
+				const auto& driver = constantDrivers[c];
+				if (driver._parameterIndex >= bindingRules.size()) continue;
+				const auto& br = bindingRules[driver._parameterIndex];
+				if (br._outputOffset == ~0u) continue;   // (unbound output)
+
+				const void* data = PtrAdd(constantData.begin(), driver._dataOffset);
+				ConstantDriver cd;
+				cd._dataOffset = (unsigned)_constantData.size();
+				cd._size = SamplerTypeSize(br._samplerType);
+				cd._outputOffset = br._outputOffset;
+				_constantData.resize(_constantData.size() + cd._size);
+				if (br._samplerType == AnimSamplerType::Quaternion && driver._format == Format::R12G12B12A4_SNORM) {
+					auto q = Decompress_36bit(data);
+					std::memcpy(&_constantData[cd._dataOffset], &q, sizeof(q));
+				} else {
+					assert(BitsPerPixel(driver._format)/8 == cd._size);
+					std::memcpy(&_constantData[cd._dataOffset], data, cd._size);
+				}
+				_constantDrivers.push_back(cd);
+			}
+			plan._constantEnd = (unsigned)_constantDrivers.size();
+
+			_blocks.push_back(plan);
+		}
+	}
+
+	AnimationSamplingContext::AnimationSamplingContext() = default;
+	AnimationSamplingContext::~AnimationSamplingContext() = default;
+	AnimationSamplingContext::AnimationSamplingContext(AnimationSamplingContext&&) = default;
+	AnimationSamplingContext& AnimationSamplingContext::operator=(AnimationSamplingContext&&) = default;
+
+}}
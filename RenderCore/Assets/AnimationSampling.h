@@ -0,0 +1,116 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "AnimationSet.h"
+#include <vector>
+
+namespace Utility { class ThreadPool; }
+
+namespace RenderCore { namespace Assets
+{
+	/// <summary>Samples an AnimationSet for many characters at once</summary>
+	/// Equivalent to calling AnimationSet::CalculateOutput() for each AnimationState, but with a few optimizations for the
+	/// common case where the same animation set is sampled every frame for many characters:
+	///
+	///		* each character keeps a key cursor for every curve in the animation block it's currently playing. Playback is
+	///		  almost always monotonic, so finding the keys for the next sample is usually just a step or two forward from
+	///		  the cursor, rather than a binary search through the time markers
+	///		* key data is decompressed & dequantized once on construction, rather than on every sample
+	///		* curves are grouped by output type & interpolation type, and each group is evaluated 4 curves at a time with
+	///		  SIMD instructions (including a trig-free slerp for quaternions)
+	///
+	/// Curves that don't fit into these groups (eg, Bezier & CatmullRom interpolation, Float4x4 outputs and NURBS curves)
+	/// fall back to RawAnimationCurve::Calculate().
+	///
+	/// Quaternion slerp is evaluated with a polynomial approximation, so results can differ from AnimationSet::CalculateOutput()
+	/// by a small amount (in the order of 1e-6 for normalized quaternions). Other results match.
+	///
+	/// Cursors are the only mutable state. Different characters can be sampled on different threads, but the same character
+	/// must not be sampled by 2 threads at the same time.
+	class AnimationSamplingContext
+	{
+	public:
+		/// Sample the animation state for each character. The output block for character "i" is at
+		/// PtrAdd(outputBlocks.begin(), i*outputBlockStride), and should be pre-initialized with the defaults (as per
+		/// AnimationSet::CalculateOutput). Cursors are kept per index in "animStates", so callers should keep the ordering
+		/// of characters consistent from frame to frame (otherwise results are still correct, just slower)
+		void CalculateOutput(
+			IteratorRange<void*>					outputBlocks,
+			size_t									outputBlockStride,
+			IteratorRange<const AnimationState*>	animStates,
+			Utility::ThreadPool*					threadPool = nullptr);
+
+		/// Forget all cursors (for example, when the characters sampled by this context are reassigned)
+		void ResetCursors();
+
+		size_t GetMinimumOutputBlockSize() const { return _minimumOutputBlockSize; }
+		unsigned GetFallbackDriverCount() const { return (unsigned)_fallbackDrivers.size(); }
+
+		AnimationSamplingContext(
+			const AnimationSet& animSet,
+			IteratorRange<const AnimationSet::ParameterBindingRules*> bindingRules);
+		AnimationSamplingContext();
+		~AnimationSamplingContext();
+		AnimationSamplingContext(AnimationSamplingContext&&);
+		AnimationSamplingContext& operator=(AnimationSamplingContext&&);
+
+		enum class TrackType : uint32_t { Step1, Step3, Step4, Linear1, Linear3, Linear4, Slerp, Max };
+
+		struct Track
+		{
+			const uint16_t*	_timeMarkers;		// null for curves with a key on every frame
+			uint32_t		_keyCount;
+			uint32_t		_firstKey;			// offset into _keys. Float1 tracks use 1 float per key, others 4
+			uint32_t		_outputOffset;
+		};
+
+		struct FallbackDriver
+		{
+			const RawAnimationCurve*	_curve;
+			CurveInterpolationType		_interpolationType;
+			AnimSamplerType				_samplerType;
+			uint32_t					_outputOffset;
+		};
+
+		struct ConstantDriver
+		{
+			uint32_t	_dataOffset;			// offset into _constantData, which holds the decompressed value
+			uint32_t	_size;
+			uint32_t	_outputOffset;
+		};
+
+	private:
+		struct BlockPlan
+		{
+			unsigned	_trackBegin[unsigned(TrackType::Max)+1];		// tracks of each type are contiguous in _tracks
+			unsigned	_fallbackBegin, _fallbackEnd;
+			unsigned	_constantBegin, _constantEnd;
+		};
+
+		struct InstanceState
+		{
+			uint64_t	_animation = 0;
+			unsigned	_animationIndex = ~0u;
+			unsigned	_block = ~0u;			// cursors are valid for this block
+		};
+
+		const AnimationSet*			_animSet = nullptr;
+		std::vector<BlockPlan>		_blocks;
+		std::vector<Track>			_tracks;
+		std::vector<FallbackDriver>	_fallbackDrivers;
+		std::vector<ConstantDriver>	_constantDrivers;
+		std::vector<float>			_keys;
+		std::vector<uint8_t>		_constantData;
+		size_t						_minimumOutputBlockSize = 0;
+		unsigned					_maxTracksPerBlock = 0;
+
+		std::vector<InstanceState>	_instances;
+		std::vector<uint32_t>		_cursors;			// _maxTracksPerBlock cursors for each instance
+
+		void EvaluateInstance(void* outputBlock, const AnimationState& animState, InstanceState& instance, uint32_t* cursors) const;
+	};
+
+}}
@@ -7,6 +7,7 @@
 #include "RawAnimationCurve.h"
 #include "../GeoProc/NascentCommandStream.h"
 #include "../GeoProc/NascentObjectsSerialize.h"
+#include "../GeoProc/AnimationCompression.h"
 #include "../../Assets/Assets.h"
 #include "../../Assets/BlockSerializer.h"
 #include "../../Assets/AssetServices.h"
@@ -14,6 +15,7 @@
 #include "../../OSServices/AttachableLibrary.h"
 #include "../../Utility/Streams/PathUtils.h"
 #include "../../Core/Prefix.h"
+#include <optional>
 
 namespace RenderCore { namespace Assets
 {
@@ -73,6 +75,10 @@ namespace RenderCore { namespace Assets
 	static ::Assets::SimpleCompilerResult MergedAnimSetCompileOperation(const ::Assets::InitializerPack& initializers)
 	{
 		auto baseFolderSrc = initializers.GetInitializer<std::string>(0);
+		// Compression is opt-in; pass AnimationCompressionSettings as the second initializer to enable it
+		std::optional<GeoProc::AnimationCompressionSettings> compressionSettings;
+		if (initializers.GetCount() >= 2 && initializers.GetInitializerType(1).hash_code() == typeid(GeoProc::AnimationCompressionSettings).hash_code())
+			compressionSettings = initializers.GetInitializer<GeoProc::AnimationCompressionSettings>(1);
 		auto splitPath = MakeSplitPath(baseFolderSrc);
 		if (splitPath.GetSectionCount() < 2 || !XlEqString(splitPath.GetSection(splitPath.GetSectionCount()-1), "*"))
 			Throw(std::runtime_error("Expecting merged anim set request to end with '/*'"));
@@ -106,6 +112,13 @@ namespace RenderCore { namespace Assets
 			} CATCH_END
 		}
 
+		// We don't have a skeleton here, so constant tracks are kept as constant drivers, rather than stripped
+		// against the default pose
+		if (compressionSettings) {
+			auto compressionReport = GeoProc::CompressAnimationSet(animSet, *compressionSettings);
+			SerializationOperator(log, compressionReport);
+		}
+
 		std::string finalName = splitPath.GetSection(splitPath.GetSectionCount()-2).AsString();
 		auto serializedArtifacts = GeoProc::SerializeAnimationsToChunks(finalName, animSet);
 
@@ -0,0 +1,373 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "MipGeneration.h"
+#include "../../Math/XLEMath.h"
+#include "../../Utility/PtrUtils.h"
+#include "../../Core/Exceptions.h"
+#include "../../Foreign/half-1.9.2/include/half.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cfloat>
+
+#if (defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)) && defined(__SSE4_1__)
+	#include <immintrin.h>			// MSVC & clang intrinsic
+	#define HAS_SSE_INSTRUCTIONS
+#endif
+
+namespace RenderCore { namespace Assets
+{
+	namespace Internal
+	{
+		struct SRGBTables
+		{
+			float _toLinear[256];
+			float _thresholds[255];		// linear value half way between adjacent 8 bit sRGB values
+
+			SRGBTables()
+			{
+				auto toLinear = [](double c) { return (c <= 0.04045) ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4); };
+				for (unsigned c=0; c<256; ++c) _toLinear[c] = (float)toLinear(c / 255.0);
+				for (unsigned c=0; c<255; ++c) _thresholds[c] = (float)toLinear((c + 0.5) / 255.0);
+			}
+		};
+
+		static const SRGBTables& GetSRGBTables()
+		{
+			static SRGBTables s_tables;
+			return s_tables;
+		}
+
+		static uint8_t EncodeSRGB(const SRGBTables& tables, float linear)
+		{
+			// exact inverse of the decode table, so round trips don't drift
+			return uint8_t(std::upper_bound(tables._thresholds, &tables._thresholds[255], linear) - tables._thresholds);
+		}
+
+		static uint8_t EncodeUNorm8(float value)
+		{
+			return uint8_t(std::clamp(value * 255.f + 0.5f, 0.f, 255.f));
+		}
+
+		static double Sinc(double x)
+		{
+			if (std::abs(x) < 1e-6) return 1.0;
+			x *= gPI;
+			return std::sin(x) / x;
+		}
+
+		static double BesselI0(double x)
+		{
+			double sum = 1.0, term = 1.0, halfX = 0.5 * x;
+			for (unsigned k=1; k<32; ++k) {
+				term *= (halfX / k) * (halfX / k);
+				sum += term;
+				if (term < sum * 1e-12) break;
+			}
+			return sum;
+		}
+
+		static constexpr double WindowedFilterWidth = 3.0;		// in destination texels, each side
+		static constexpr double KaiserAlpha = 4.0;
+
+		static double FilterWeight(MipFilter filter, double t)
+		{
+			t = std::abs(t);
+			if (t >= WindowedFilterWidth) return 0.0;
+			switch (filter) {
+			case MipFilter::Lanczos:
+				return Sinc(t) * Sinc(t / WindowedFilterWidth);
+			case MipFilter::Kaiser:
+				{
+					auto r = t / WindowedFilterWidth;
+					return Sinc(t) * BesselI0(KaiserAlpha * std::sqrt(1.0 - r*r)) / BesselI0(KaiserAlpha);
+				}
+			default:
+				return 1.0;
+			}
+		}
+
+		static void FilterRow(float* dst, const float* src, unsigned srcWidth, unsigned dstWidth, const float* weights, unsigned tapsPerSide)
+		{
+			const int taps = int(2*tapsPerSide), maxX = int(srcWidth)-1;
+			for (unsigned x=0; x<dstWidth; ++x) {
+				int first = int(2*x) - int(tapsPerSide-1);
+				#if defined(HAS_SSE_INSTRUCTIONS)
+					auto acc = _mm_setzero_ps();
+					for (int k=0; k<taps; ++k) {
+						auto sx = std::clamp(first+k, 0, maxX);
+						acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(src + sx*4), _mm_set1_ps(weights[k])));
+					}
+					_mm_storeu_ps(dst + x*4, acc);
+				#else
+					float acc[4] = {0.f, 0.f, 0.f, 0.f};
+					for (int k=0; k<taps; ++k) {
+						auto* s = src + std::clamp(first+k, 0, maxX)*4;
+						for (unsigned c=0; c<4; ++c) acc[c] += s[c] * weights[k];
+					}
+					std::memcpy(dst + x*4, acc, sizeof(acc));
+				#endif
+			}
+		}
+
+		static void FilterColumns(float* dst, const float* firstSrcRow, size_t srcRowStride, unsigned floatCount, const float* weights, unsigned taps)
+		{
+			unsigned i=0;
+			#if defined(HAS_SSE_INSTRUCTIONS)
+				for (; (i+4)<=floatCount; i+=4) {
+					auto acc = _mm_setzero_ps();
+					for (unsigned k=0; k<taps; ++k)
+						acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(firstSrcRow + k*srcRowStride + i), _mm_set1_ps(weights[k])));
+					_mm_storeu_ps(dst + i, acc);
+				}
+			#endif
+			for (; i<floatCount; ++i) {
+				float acc = 0.f;
+				for (unsigned k=0; k<taps; ++k) acc += firstSrcRow[k*srcRowStride + i] * weights[k];
+				dst[i] = acc;
+			}
+		}
+
+		static void RenormalizeRow(float* row, unsigned width)
+		{
+			for (unsigned x=0; x<width; ++x, row+=4) {
+				float n[3] { row[0]*2.f-1.f, row[1]*2.f-1.f, row[2]*2.f-1.f };
+				float magSq = n[0]*n[0] + n[1]*n[1] + n[2]*n[2];
+				if (magSq > 1e-12f) {
+					float rcp = 1.f / std::sqrt(magSq);
+					for (unsigned c=0; c<3; ++c) row[c] = n[c]*rcp*0.5f + 0.5f;
+				} else {
+					row[0] = row[1] = 0.5f; row[2] = 1.f;
+				}
+			}
+		}
+	}
+
+	void MipGenerator::DecodeRow(float* dst, const void* src, unsigned width) const
+	{
+		switch (_encoding) {
+		case Encoding::UNorm8:
+			{
+				const auto& tables = Internal::GetSRGBTables();
+				auto* s = (const uint8_t*)src;
+				for (unsigned x=0; x<width; ++x, s+=_channelCount) {
+					auto* d = dst + x*4;
+					d[0] = d[1] = d[2] = 0.f; d[3] = 1.f;
+					for (unsigned c=0; c<_channelCount; ++c)
+						d[c] = (_srgb && c<3) ? tables._toLinear[s[c]] : s[c] * (1.f/255.f);
+				}
+			}
+			break;
+		case Encoding::Float16:
+			for (unsigned x=0; x<width*4; ++x)
+				dst[x] = half_float::detail::half2float(((const uint16_t*)src)[x]);
+			break;
+		case Encoding::Float32:
+			std::memcpy(dst, src, width*4*sizeof(float));
+			break;
+		}
+
+		if (_normalMap && _channelCount == 2)
+			for (unsigned x=0; x<width; ++x) {
+				auto* d = dst + x*4;
+				float nx = d[0]*2.f-1.f, ny = d[1]*2.f-1.f;
+				d[2] = 0.5f * std::sqrt(std::max(0.f, 1.f - nx*nx - ny*ny)) + 0.5f;
+			}
+	}
+
+	void MipGenerator::EncodeRow(void* dst, const float* src, unsigned width) const
+	{
+		switch (_encoding) {
+		case Encoding::UNorm8:
+			{
+				const auto& tables = Internal::GetSRGBTables();
+				auto* d = (uint8_t*)dst;
+				for (unsigned x=0; x<width; ++x, d+=_channelCount) {
+					auto* s = src + x*4;
+					for (unsigned c=0; c<_channelCount; ++c)
+						d[c] = (_srgb && c<3) ? Internal::EncodeSRGB(tables, s[c]) : Internal::EncodeUNorm8(s[c]);
+				}
+			}
+			break;
+		case Encoding::Float16:
+			for (unsigned x=0; x<width*4; ++x)
+				((uint16_t*)dst)[x] = half_float::detail::float2half<std::round_to_nearest>(src[x]);
+			break;
+		case Encoding::Float32:
+			std::memcpy(dst, src, width*4*sizeof(float));
+			break;
+		}
+	}
+
+	void MipGenerator::GenerateRows(const LevelView& src, const LevelView& dst, unsigned firstRow, unsigned endRow) const
+	{
+		assert(firstRow < endRow && endRow <= dst._height);
+		assert(dst._width == std::max(1u, src._width>>1) && dst._height == std::max(1u, src._height>>1));
+
+		// Filter horizontally every source row this band touches, and then vertically from those. With a 2:1 reduction
+		// each destination row uses 2*_tapsPerSide source rows, starting 2 rows below the previous destination row
+		const int firstSrcRow = int(2*firstRow) - int(_tapsPerSide-1);
+		const unsigned srcRowCount = 2*(endRow-firstRow) + 2*_tapsPerSide - 2;
+		const size_t rowFloats = size_t(dst._width)*4;
+
+		std::vector<float> decodedRow(size_t(src._width)*4);
+		std::vector<float> filteredRows(srcRowCount*rowFloats);
+		for (unsigned r=0; r<srcRowCount; ++r) {
+			auto srcY = (unsigned)std::clamp(firstSrcRow+int(r), 0, int(src._height)-1);
+			DecodeRow(decodedRow.data(), PtrAdd(src._data, size_t(srcY)*src._rowPitch), src._width);
+			Internal::FilterRow(&filteredRows[r*rowFloats], decodedRow.data(), src._width, dst._width, _weights.data(), _tapsPerSide);
+		}
+
+		std::vector<float> outputRow(rowFloats);
+		for (unsigned y=firstRow; y<endRow; ++y) {
+			Internal::FilterColumns(outputRow.data(), &filteredRows[2*(y-firstRow)*rowFloats], rowFloats, (unsigned)rowFloats, _weights.data(), 2*_tapsPerSide);
+			if (_normalMap)
+				Internal::RenormalizeRow(outputRow.data(), dst._width);
+			EncodeRow(PtrAdd(dst._data, size_t(y)*dst._rowPitch), outputRow.data(), dst._width);
+		}
+	}
+
+	float MipGenerator::CalculateAlphaCoverage(const LevelView& level, float alphaScale) const
+	{
+		if (_channelCount != 4 || !level._width || !level._height) return 1.f;
+		uint64_t coveredCount = 0;
+		for (unsigned y=0; y<level._height; ++y) {
+			auto* row = PtrAdd(level._data, size_t(y)*level._rowPitch);
+			for (unsigned x=0; x<level._width; ++x) {
+				float alpha;
+				switch (_encoding) {
+				case Encoding::UNorm8: alpha = ((const uint8_t*)row)[x*4+3] * (1.f/255.f); break;
+				case Encoding::Float16: alpha = half_float::detail::half2float(((const uint16_t*)row)[x*4+3]); break;
+				default: alpha = ((const float*)row)[x*4+3]; break;
+				}
+				if (std::min(1.f, alpha*alphaScale) > _alphaCoverageReference) ++coveredCount;
+			}
+		}
+		return float(double(coveredCount) / double(uint64_t(level._width)*level._height));
+	}
+
+	void MipGenerator::ScaleAlphaToCoverage(const LevelView& level, float targetCoverage) const
+	{
+		if (!PreservesAlphaCoverage()) return;
+
+		// binary search for the alpha scale that gets closest to the target coverage. Coverage is a step function of the
+		// scale, so the last scale tested isn't necessarily the best one
+		float minScale = 0.f, maxScale = 4.f, scale = 1.f;
+		float bestScale = 1.f, bestError = FLT_MAX;
+		for (unsigned i=0; i<10; ++i) {
+			auto coverage = CalculateAlphaCoverage(level, scale);
+			auto error = std::abs(coverage - targetCoverage);
+			if (error < bestError) { bestError = error; bestScale = scale; }
+			if (coverage < targetCoverage) minScale = scale;
+			else if (coverage > targetCoverage) maxScale = scale;
+			else break;
+			scale = 0.5f * (minScale + maxScale);
+		}
+		scale = bestScale;
+		if (scale == 1.f) return;
+
+		for (unsigned y=0; y<level._height; ++y) {
+			auto* row = PtrAdd(level._data, size_t(y)*level._rowPitch);
+			for (unsigned x=0; x<level._width; ++x) {
+				switch (_encoding) {
+				case Encoding::UNorm8:
+					{
+						auto& a = ((uint8_t*)row)[x*4+3];
+						a = Internal::EncodeUNorm8(std::min(1.f, a * (1.f/255.f) * scale));
+					}
+					break;
+				case Encoding::Float16:
+					{
+						auto& a = ((uint16_t*)row)[x*4+3];
+						a = half_float::detail::float2half<std::round_to_nearest>(std::min(1.f, half_float::detail::half2float(a) * scale));
+					}
+					break;
+				default:
+					{
+						auto& a = ((float*)row)[x*4+3];
+						a = std::min(1.f, a * scale);
+					}
+					break;
+				}
+			}
+		}
+	}
+
+	static bool GetEncoding(Format fmt, unsigned& channelCount, bool& hasAlpha, bool& isFloat16, bool& isFloat32)
+	{
+		isFloat16 = isFloat32 = false;
+		hasAlpha = false;
+		switch (fmt) {
+		case Format::R8G8B8A8_TYPELESS:
+		case Format::R8G8B8A8_UNORM:
+		case Format::R8G8B8A8_UNORM_SRGB:
+		case Format::B8G8R8A8_TYPELESS:
+		case Format::B8G8R8A8_UNORM:
+		case Format::B8G8R8A8_UNORM_SRGB:	channelCount = 4; hasAlpha = true; return true;
+		case Format::B8G8R8X8_TYPELESS:
+		case Format::B8G8R8X8_UNORM:
+		case Format::B8G8R8X8_UNORM_SRGB:	channelCount = 4; return true;
+		case Format::R8G8_TYPELESS:
+		case Format::R8G8_UNORM:			channelCount = 2; return true;
+		case Format::R8_TYPELESS:
+		case Format::R8_UNORM:				channelCount = 1; return true;
+		case Format::R16G16B16A16_FLOAT:	channelCount = 4; hasAlpha = true; isFloat16 = true; return true;
+		case Format::R32G32B32A32_FLOAT:	channelCount = 4; hasAlpha = true; isFloat32 = true; return true;
+		default:							return false;
+		}
+	}
+
+	bool MipGenerator::IsSupported(Format fmt)
+	{
+		unsigned channelCount; bool hasAlpha, isFloat16, isFloat32;
+		return GetEncoding(fmt, channelCount, hasAlpha, isFloat16, isFloat32);
+	}
+
+	MipGenerator::MipGenerator(Format format, const MipGenerationSettings& settings, bool filterInLinearSpace)
+	{
+		bool hasAlpha, isFloat16, isFloat32;
+		if (!GetEncoding(format, _channelCount, hasAlpha, isFloat16, isFloat32))
+			Throw(std::runtime_error(Concatenate("Mip generation is not supported for pixel format: ", AsString(format))));
+		_encoding = isFloat32 ? Encoding::Float32 : (isFloat16 ? Encoding::Float16 : Encoding::UNorm8);
+		_normalMap = settings._normalMap && _channelCount >= 2;
+		// normal maps are never gamma encoded, regardless of what the format says
+		_srgb = filterInLinearSpace && !_normalMap && _encoding == Encoding::UNorm8 && _channelCount >= 3;
+		_alphaCoverageReference = hasAlpha ? settings._alphaCoverageReference : 0.f;
+
+		// Weights for a 2:1 reduction. Destination texel x is centered on the edge between source texels 2x and 2x+1,
+		// so the taps sit at distances of (k+0.5) source texels on either side of it
+		_tapsPerSide = (settings._filter == MipFilter::Box) ? 1 : unsigned(2.0 * Internal::WindowedFilterWidth);
+		_weights.resize(2*_tapsPerSide);
+		double sum = 0.0;
+		for (unsigned k=0; k<2*_tapsPerSide; ++k) {
+			double srcDistance = double(int(k) - int(_tapsPerSide-1)) - 0.5;
+			double w = Internal::FilterWeight(settings._filter, 0.5 * srcDistance);
+			_weights[k] = (float)w;
+			sum += w;
+		}
+		for (auto& w:_weights) w = float(w / sum);
+	}
+
+	MipGenerator::MipGenerator() = default;
+	MipGenerator::~MipGenerator() = default;
+
+	const char* AsString(MipFilter filter)
+	{
+		switch (filter) {
+		case MipFilter::Box: return "Box";
+		case MipFilter::Kaiser: return "Kaiser";
+		case MipFilter::Lanczos: return "Lanczos";
+		default: return "<<unknown>>";
+		}
+	}
+
+	std::optional<MipFilter> AsMipFilter(StringSection<> input)
+	{
+		if (XlEqString(input, "Box")) return MipFilter::Box;
+		if (XlEqString(input, "Kaiser")) return MipFilter::Kaiser;
+		if (XlEqString(input, "Lanczos")) return MipFilter::Lanczos;
+		return {};
+	}
+}}
@@ -0,0 +1,70 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "../Format.h"
+#include "../../Utility/StringUtils.h"
+#include <optional>
+#include <vector>
+
+namespace RenderCore { namespace Assets
+{
+	enum class MipFilter { Box, Kaiser, Lanczos };
+	const char* AsString(MipFilter);
+	std::optional<MipFilter> AsMipFilter(StringSection<>);
+
+	struct MipGenerationSettings
+	{
+		MipFilter _filter = MipFilter::Box;
+		bool _normalMap = false;				// renormalize xyz after filtering (for 2 channel textures, z is reconstructed first)
+		float _alphaCoverageReference = 0.f;	// when non-zero, alpha in generated levels is scaled to preserve the fraction of texels passing an alpha test at this reference
+	};
+
+	/// <summary>Generates mip levels on the CPU with a selectable filter</summary>
+	/// Filtering is separable and done in floating point. 8 bit sRGB data is converted to linear before filtering and
+	/// back afterwards. The generator is stateless after construction, so any number of threads can call GenerateRows()
+	/// for different bands of the same level at once.
+	class MipGenerator
+	{
+	public:
+		struct LevelView
+		{
+			void* _data = nullptr;
+			unsigned _rowPitch = 0;
+			unsigned _width = 0, _height = 0;
+		};
+
+		/// Writes rows [firstRow, endRow) of "dst", which must be the level immediately below "src"
+		void GenerateRows(const LevelView& src, const LevelView& dst, unsigned firstRow, unsigned endRow) const;
+
+		/// Fraction of texels with an alpha value (multiplied by "alphaScale") above the reference in the settings
+		float CalculateAlphaCoverage(const LevelView& level, float alphaScale = 1.f) const;
+		/// Scale the alpha channel of the given level so that its coverage matches "targetCoverage"
+		void ScaleAlphaToCoverage(const LevelView& level, float targetCoverage) const;
+		bool PreservesAlphaCoverage() const { return _alphaCoverageReference > 0.f; }
+
+		static bool IsSupported(Format);
+
+		MipGenerator(Format format, const MipGenerationSettings& settings, bool filterInLinearSpace);
+		MipGenerator();
+		~MipGenerator();
+		MipGenerator(MipGenerator&&) = default;
+		MipGenerator& operator=(MipGenerator&&) = default;
+
+	private:
+		enum class Encoding { UNorm8, Float16, Float32 };
+		Encoding _encoding = Encoding::UNorm8;
+		unsigned _channelCount = 0;
+		bool _srgb = false;
+		bool _normalMap = false;
+		float _alphaCoverageReference = 0.f;
+
+		std::vector<float> _weights;		// for 2:1 reduction; weight k applies to source texel 2x-(tapsPerSide-1)+k
+		unsigned _tapsPerSide = 0;
+
+		void DecodeRow(float* dst, const void* src, unsigned width) const;
+		void EncodeRow(void* dst, const float* src, unsigned width) const;
+	};
+}}
@@ -333,7 +333,7 @@ namespace RenderCore { namespace Assets
                     c->_type);
 
                 if (!gotValue)
-                    _defaults.GetParameter(c->_hash + e, PtrAdd(dst.begin(), c->_offsetsByLanguage[alignmentRules]), c->_type);
+                    _defaults.GetParameter(c->_hash + e, PtrAdd(dst.begin(), c->_offsetsByLanguage[alignmentRules] + e * c->_arrayElementStride), c->_type);
             }
         }
     }
@@ -354,6 +354,181 @@ namespace RenderCore { namespace Assets
         BuildCB(MakeIteratorRange(result), parameters, lang);
         return result;
     }
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+    namespace Internal
+    {
+        template<typename DstType, typename SrcType>
+            static void ConvertElements(void* dst, const void* src, unsigned count)
+        {
+                // (source values in parameter boxes are not aligned)
+            for (unsigned c=0; c<count; ++c) {
+                SrcType s;
+                std::memcpy(&s, PtrAdd(src, c*sizeof(SrcType)), sizeof(SrcType));
+                DstType d = DstType(s);
+                std::memcpy(PtrAdd(dst, c*sizeof(DstType)), &d, sizeof(DstType));
+            }
+        }
+
+        template<typename DstType>
+            static auto FindConversionFrom(ImpliedTyping::TypeCat srcType) -> void(*)(void*, const void*, unsigned)
+        {
+            switch (srcType) {
+            case ImpliedTyping::TypeCat::Bool: return &ConvertElements<DstType, bool>;
+            case ImpliedTyping::TypeCat::Int32: return &ConvertElements<DstType, int32_t>;
+            case ImpliedTyping::TypeCat::UInt32: return &ConvertElements<DstType, uint32_t>;
+            case ImpliedTyping::TypeCat::Float: return &ConvertElements<DstType, float>;
+            case ImpliedTyping::TypeCat::Double: return &ConvertElements<DstType, double>;
+            default: return nullptr;
+            }
+        }
+
+            // Conversions between the types that commonly appear in constant buffers & material parameters.
+            // These do the same thing as ImpliedTyping::Cast() would for these types
+        static auto FindConversion(ImpliedTyping::TypeCat dstType, ImpliedTyping::TypeCat srcType) -> void(*)(void*, const void*, unsigned)
+        {
+            switch (dstType) {
+            case ImpliedTyping::TypeCat::Int32: return FindConversionFrom<int32_t>(srcType);
+            case ImpliedTyping::TypeCat::UInt32: return FindConversionFrom<uint32_t>(srcType);
+            case ImpliedTyping::TypeCat::Float: return FindConversionFrom<float>(srcType);
+            default: return nullptr;
+            }
+        }
+    }
+
+    CompiledCBWriter::CompiledCBWriter(const PredefinedCBLayout& layout, const ParameterBox& signature, ShaderLanguage lang)
+    : _layout(layout), _lang(lang)
+    {
+        auto alignmentRules = AlignmentRulesForLanguage(lang);
+        _cbSize = layout.GetSize(lang);
+        _signatureNamesHash = signature.GetParameterNamesHash();
+        _signatureTypes = std::vector<ImpliedTyping::TypeDesc>(signature.GetTypeTable().begin(), signature.GetTypeTable().end());
+        _constants.resize(_cbSize, 0);
+
+        auto valueTable = signature.GetValueTable();
+        std::vector<uint8_t> temporary;
+        for (const auto& c:layout._elements) {
+            auto dstType = c._type;
+            auto dstSize = dstType.GetSize();
+            auto dstElementSize = ImpliedTyping::TypeDesc{dstType._type}.GetSize();
+            temporary.resize(dstSize);
+
+            for (auto e=0u; e<std::max(1u, c._arrayElementCount); e++) {
+                auto dstOffset = c._offsetsByLanguage[alignmentRules] + e * c._arrayElementStride;
+                assert(dstOffset + dstSize <= _cbSize);
+
+                bool gotValue = false;
+                if (signature.HasParameter(c._hash + e)) {
+                        // Cast() succeeding or failing depends only on the types involved (not the values), so
+                        // we can use the values in "signature" to find out if the cast will work
+                    auto srcType = signature.GetParameterType(c._hash + e);
+                    auto srcValue = signature.GetParameterRawValue(c._hash + e);
+                    if (ImpliedTyping::Cast(MakeIteratorRange(temporary), dstType, srcValue, srcType)) {
+                        auto srcOffset = (unsigned)PtrDiff(srcValue.begin(), valueTable.begin());
+                        if (srcType._type == dstType._type && srcType._arrayCount == dstType._arrayCount) {
+                            _steps.push_back({StepType::CopyParameter, srcOffset, dstOffset, dstSize});
+                        } else {
+                                // When the destination has more elements than the source, the remaining elements are
+                                // always filled with the same values. Convert the elements we have, and copy the rest
+                                // from the constants table
+                            auto convertedCount = (dstType._arrayCount <= 1) ? 1u : std::min(srcType._arrayCount, dstType._arrayCount);
+                            if (srcType._type == dstType._type) {
+                                _steps.push_back({StepType::CopyParameter, srcOffset, dstOffset, convertedCount * dstElementSize});
+                            } else if (auto convert = Internal::FindConversion(dstType._type, srcType._type)) {
+                                _steps.push_back({StepType::ConvertParameter, srcOffset, dstOffset, convertedCount, convert});
+                            } else {
+                                Step step{StepType::CastParameter, srcOffset, dstOffset, convertedCount};
+                                step._srcType = ImpliedTyping::TypeDesc{srcType._type, std::min(srcType._arrayCount, convertedCount)};
+                                step._dstType = ImpliedTyping::TypeDesc{dstType._type, convertedCount};
+                                _steps.push_back(step);
+                            }
+
+                            auto convertedSize = convertedCount * dstElementSize;
+                            if (convertedSize < dstSize) {
+                                std::memcpy(&_constants[dstOffset + convertedSize], &temporary[convertedSize], dstSize - convertedSize);
+                                _steps.push_back({StepType::CopyConstant, dstOffset + convertedSize, dstOffset + convertedSize, dstSize - convertedSize});
+                            }
+                        }
+                        gotValue = true;
+                    }
+                }
+
+                if (!gotValue && layout._defaults.GetParameter(c._hash + e, &_constants[dstOffset], dstType))
+                    _steps.push_back({StepType::CopyConstant, dstOffset, dstOffset, dstSize});
+            }
+        }
+
+            // Merge copies that are contiguous in both the source & destination. Elements are usually declared
+            // in the same order in the layout & the parameter box, so this can significantly reduce the step count
+        std::sort(_steps.begin(), _steps.end(), [](const Step& lhs, const Step& rhs) { return lhs._dstOffset < rhs._dstOffset; });
+        std::vector<Step> mergedSteps;
+        mergedSteps.reserve(_steps.size());
+        for (const auto& s:_steps) {
+            if (!mergedSteps.empty()) {
+                auto& prev = mergedSteps.back();
+                bool isCopy = s._type == StepType::CopyParameter || s._type == StepType::CopyConstant;
+                if (isCopy && prev._type == s._type
+                    && prev._dstOffset + prev._size == s._dstOffset
+                    && prev._srcOffset + prev._size == s._srcOffset) {
+                    prev._size += s._size;
+                    continue;
+                }
+            }
+            mergedSteps.push_back(s);
+        }
+        _steps = std::move(mergedSteps);
+    }
+
+    CompiledCBWriter::CompiledCBWriter() = default;
+    CompiledCBWriter::~CompiledCBWriter() = default;
+
+    bool CompiledCBWriter::IsCompatible(const ParameterBox& parameters) const
+    {
+            // Parameters are stored in name hash order, so the same names & types means values are at the same offsets
+        auto types = parameters.GetTypeTable();
+        return parameters.GetParameterNamesHash() == _signatureNamesHash
+            && std::equal(types.begin(), types.end(), _signatureTypes.begin(), _signatureTypes.end());
+    }
+
+    void CompiledCBWriter::BuildCB(IteratorRange<void*> dst, const ParameterBox& parameters) const
+    {
+        if (!IsCompatible(parameters)) {
+            _layout.BuildCB(dst, parameters, _lang);
+            return;
+        }
+
+        assert(dst.size() >= _cbSize);
+        auto* values = (const uint8_t*)parameters.GetValueTable().begin();
+        auto* dstBytes = (uint8_t*)dst.begin();
+        for (const auto& s:_steps) {
+            switch (s._type) {
+            case StepType::CopyParameter: std::memcpy(dstBytes + s._dstOffset, values + s._srcOffset, s._size); break;
+            case StepType::CopyConstant: std::memcpy(dstBytes + s._dstOffset, _constants.data() + s._srcOffset, s._size); break;
+            case StepType::ConvertParameter: (*s._convert)(dstBytes + s._dstOffset, values + s._srcOffset, s._size); break;
+            case StepType::CastParameter:
+                ImpliedTyping::Cast(
+                    MakeIteratorRange(dstBytes + s._dstOffset, dstBytes + s._dstOffset + s._dstType.GetSize()), s._dstType,
+                    MakeIteratorRange(values + s._srcOffset, values + s._srcOffset + s._srcType.GetSize()), s._srcType);
+                break;
+            }
+        }
+    }
+
+    std::vector<uint8_t> CompiledCBWriter::BuildCBDataAsVector(const ParameterBox& parameters) const
+    {
+        std::vector<uint8_t> cbData(_cbSize, uint8_t(0));
+        BuildCB(MakeIteratorRange(cbData), parameters);
+        return cbData;
+    }
+
+    SharedPkt CompiledCBWriter::BuildCBDataAsPkt(const ParameterBox& parameters) const
+    {
+        SharedPkt result = MakeSharedPktSize(_cbSize);
+        std::memset(result.begin(), 0, _cbSize);
+        BuildCB(MakeIteratorRange(result), parameters);
+        return result;
+    }
     
     uint64_t PredefinedCBLayout::CalculateHash(uint64_t seed) const
     {
@@ -100,6 +100,54 @@ namespace RenderCore { namespace Assets
 		friend class PredefinedDescriptorSetLayout;
     };
 
+    /// <summary>Writes constant buffer data for a PredefinedCBLayout from parameter boxes with a fixed signature</summary>
+    /// PredefinedCBLayout::BuildCB() looks up each element by name in the ParameterBox and converts
+    /// its type on every call. This object resolves those lookups & conversions once, for parameter boxes
+    /// with the same names & types as "signature". Writing the buffer is then just a short list of copies
+    /// (and a few simple conversions), which matters when the same buffer is rebuilt every time its parameters change.
+    ///
+    /// Parameter boxes with a different signature are still supported, but go through PredefinedCBLayout::BuildCB().
+    class CompiledCBWriter
+    {
+    public:
+        void BuildCB(IteratorRange<void*> dst, const ParameterBox& parameters) const;
+        std::vector<uint8_t> BuildCBDataAsVector(const ParameterBox& parameters) const;
+        SharedPkt BuildCBDataAsPkt(const ParameterBox& parameters) const;
+
+        bool IsCompatible(const ParameterBox& parameters) const;
+        unsigned GetSize() const { return _cbSize; }
+        unsigned GetStepCount() const { return (unsigned)_steps.size(); }
+
+        CompiledCBWriter(const PredefinedCBLayout& layout, const ParameterBox& signature, ShaderLanguage lang);
+        CompiledCBWriter();
+        ~CompiledCBWriter();
+        CompiledCBWriter(const CompiledCBWriter&) = default;
+        CompiledCBWriter& operator=(const CompiledCBWriter&) = default;
+        CompiledCBWriter(CompiledCBWriter&&) never_throws = default;
+        CompiledCBWriter& operator=(CompiledCBWriter&&) never_throws = default;
+
+    private:
+        using ConvertFn = void(*)(void* dst, const void* src, unsigned count);
+        enum class StepType : uint8_t { CopyParameter, CopyConstant, ConvertParameter, CastParameter };
+        struct Step
+        {
+            StepType _type;
+            unsigned _srcOffset, _dstOffset;
+            unsigned _size;                     // in bytes for copies, or element count for conversions
+            ConvertFn _convert = nullptr;
+            ImpliedTyping::TypeDesc _srcType, _dstType;     // only for CastParameter
+        };
+        std::vector<Step> _steps;
+        std::vector<uint8_t> _constants;        // defaults & padding, already converted & at their final offsets
+
+        uint64_t _signatureNamesHash = 0;
+        std::vector<ImpliedTyping::TypeDesc> _signatureTypes;
+
+        PredefinedCBLayout _layout;             // (for parameter boxes that don't match the signature)
+        ShaderLanguage _lang = ShaderLanguage::HLSL;
+        unsigned _cbSize = 0;
+    };
+
 	/// <summary>A file that can contain multiple PredefinedCBLayout</summary>
 	/// Deprecated interface. Prefer PredefinedDescriptorSetLayout instead.
     XLE_DEPRECATED_ATTRIBUTE class PredefinedCBLayoutFile
@@ -292,6 +292,92 @@ namespace RenderCore { namespace Assets
 		return Float4x4();
 	}
 
+	template<typename OutType>
+		class CurveElementBitPackedDecompressor
+		{
+		public:
+			OutType operator()(unsigned idx, unsigned timeMarkerValue, unsigned componentOffset=0) const;
+			unsigned KeyCount() const { return _keyCount; }
+
+			CurveElementBitPackedDecompressor(IteratorRange<const void*> data, unsigned strideInBits, unsigned keyCount);
+		private:
+			const CurveDequantizationBlock* _dequantBlock;
+			const uint8_t* _bits;
+			unsigned _stride;
+			unsigned _bitsPerComponent;
+			unsigned _keyCount;
+			float _scale;
+
+			void Dequantize(float dst[], unsigned componentCount, unsigned idx) const;
+		};
+
+	static uint32_t ReadBits(const uint8_t* data, unsigned bitOffset, unsigned bitCount)
+	{
+		// Bits are packed from the least significant bit of each byte upwards. Read byte by byte, so we never
+		// touch memory past the end of the last key
+		assert(bitCount <= 24);
+		auto* p = data + (bitOffset>>3);
+		unsigned shift = bitOffset&7;
+		unsigned byteCount = (shift+bitCount+7)>>3;
+		uint32_t v = 0;
+		for (unsigned c=0; c<byteCount; ++c) v |= uint32_t(p[c]) << (c*8);
+		return (v >> shift) & ((1u<<bitCount)-1);
+	}
+
+	template<typename OutType>
+		CurveElementBitPackedDecompressor<OutType>::CurveElementBitPackedDecompressor(IteratorRange<const void*> data, unsigned strideInBits, unsigned keyCount)
+		: _stride(strideInBits), _keyCount(keyCount)
+	{
+		assert(data.size() >= sizeof(CurveDequantizationBlock));
+		_dequantBlock = (const CurveDequantizationBlock*)data.begin();
+		_bits = (const uint8_t*)PtrAdd(data.begin(), sizeof(CurveDequantizationBlock));
+		_bitsPerComponent = (_dequantBlock->_elementFlags >> 8) & 0xff;
+		assert(_bitsPerComponent <= 24);
+		assert(data.size() >= sizeof(CurveDequantizationBlock) + (size_t(keyCount)*strideInBits+7)/8);
+		_scale = _bitsPerComponent ? 1.f / float((1u<<_bitsPerComponent)-1) : 0.f;
+	}
+
+	template<typename OutType>
+		void CurveElementBitPackedDecompressor<OutType>::Dequantize(float dst[], unsigned componentCount, unsigned idx) const
+	{
+		auto bitOffset = idx*_stride;
+		for (unsigned c=0; c<componentCount; ++c) {
+			dst[c] = _dequantBlock->_mins[c];
+			if (_dequantBlock->_elementFlags & (1<<c)) {
+				dst[c] = LinearInterpolate(_dequantBlock->_mins[c], _dequantBlock->_maxs[c], float(ReadBits(_bits, bitOffset, _bitsPerComponent)) * _scale);
+				bitOffset += _bitsPerComponent;
+			}
+		}
+	}
+
+	template<typename OutType>
+		OutType CurveElementBitPackedDecompressor<OutType>::operator()(unsigned idx, unsigned timeMarkerValue, unsigned componentOffset) const
+	{
+		assert(componentOffset == 0);		// tangents aren't supported with bit packed keys
+		if constexpr (std::is_same_v<OutType, float>) {
+			float result;
+			Dequantize(&result, 1, idx);
+			return result;
+		} else if constexpr (std::is_same_v<OutType, Float3>) {
+			float result[3];
+			Dequantize(result, 3, idx);
+			return Float3{result[0], result[1], result[2]};
+		} else if constexpr (std::is_same_v<OutType, Float4>) {
+			float result[4];
+			Dequantize(result, 4, idx);
+			return Float4{result[0], result[1], result[2], result[3]};
+		} else if constexpr (std::is_same_v<OutType, Quaternion>) {
+			// only x, y, z are stored; the quaternion was flipped on compression so that w is positive
+			float xyz[3];
+			Dequantize(xyz, 3, idx);
+			float t = std::min(xyz[0]*xyz[0] + xyz[1]*xyz[1] + xyz[2]*xyz[2], 1.0f);
+			return Quaternion(std::sqrt(1.0f - t), xyz[0], xyz[1], xyz[2]);
+		} else {
+			UNREACHABLE();
+			return OutType();
+		}
+	}
+
 	template<typename OutType, typename Decomp>
         OutType        EvaluateCurve(	float evalFrame, 
 										IteratorRange<const uint16_t*> timeMarkers,
@@ -492,7 +578,14 @@ namespace RenderCore { namespace Assets
 	template<typename OutType>
         OutType        RawAnimationCurve::Calculate(float inputTime, CurveInterpolationType interpolationType) const never_throws
     {
-		if (_desc._flags & CurveDesc::Flags::HasDequantBlock) {
+		if (_desc._flags & CurveDesc::Flags::BitPackedKeys) {
+			assert(_desc._flags & CurveDesc::Flags::HasDequantBlock);
+			return EvaluateCurve<OutType>(
+				inputTime, 
+				MakeIteratorRange(_timeMarkers.begin(), _timeMarkers.end()),
+				_desc, interpolationType,
+				CurveElementBitPackedDecompressor<OutType>(MakeIteratorRange(_keyData.begin(), _keyData.end()), _desc._elementStride, (unsigned)_timeMarkers.size()));
+		} else if (_desc._flags & CurveDesc::Flags::HasDequantBlock) {
 			return EvaluateCurve<OutType>(
 				inputTime, 
 				MakeIteratorRange(_timeMarkers.begin(), _timeMarkers.end()),
@@ -507,6 +600,36 @@ namespace RenderCore { namespace Assets
 		}
 	}
 
+	template<typename OutType, typename Decomp>
+		static void DecodeAllKeys(IteratorRange<OutType*> dst, const Decomp& decomp)
+	{
+		assert(dst.size() >= decomp.KeyCount());
+		for (unsigned c=0; c<decomp.KeyCount(); ++c)
+			dst[c] = decomp(c, c);
+	}
+
+	template<typename OutType>
+		void RawAnimationCurve::DecodeKeys(IteratorRange<OutType*> dst) const
+	{
+		if (_desc._flags & CurveDesc::Flags::BitPackedKeys) {
+			DecodeAllKeys(dst, CurveElementBitPackedDecompressor<OutType>(MakeIteratorRange(_keyData.begin(), _keyData.end()), _desc._elementStride, (unsigned)_timeMarkers.size()));
+		} else if (_desc._flags & CurveDesc::Flags::HasDequantBlock) {
+			DecodeAllKeys(dst, CurveElementDequantDecompressor<OutType>(MakeIteratorRange(_keyData.begin(), _keyData.end()), _desc._elementStride, _desc._elementFormat));
+		} else {
+			DecodeAllKeys(dst, CurveElementDecompressor<OutType>(MakeIteratorRange(_keyData.begin(), _keyData.end()), _desc._elementStride, _desc._elementFormat));
+		}
+	}
+
+	unsigned RawAnimationCurve::KeyCount() const
+	{
+		if (_desc._flags & CurveDesc::Flags::BitPackedKeys)
+			return (unsigned)_timeMarkers.size();		// padding at the end of the bit stream means we can't calculate from the data size
+		if (!_desc._elementStride) return 0;
+		if (_desc._flags & CurveDesc::Flags::HasDequantBlock)
+			return unsigned((_keyData.size() - sizeof(CurveDequantizationBlock)) / _desc._elementStride);
+		return unsigned(_keyData.size() / _desc._elementStride);
+	}
+
     uint16_t       RawAnimationCurve::TimeAtFirstKeyframe() const
     {
 		if (_desc._timeMarkerType == TimeMarkerType::None) {
@@ -521,6 +644,7 @@ namespace RenderCore { namespace Assets
     {
 		if (_desc._timeMarkerType == TimeMarkerType::None) {
 			// no time markers -- just get from number of keyframes in _keyData
+			assert(!(_desc._flags & CurveDesc::Flags::BitPackedKeys));
 			if (_desc._flags & CurveDesc::Flags::HasDequantBlock) {
 				return ((_keyData.size() - sizeof(CurveDequantizationBlock)) / _desc._elementStride) - 1;
 			} else {
@@ -538,6 +662,11 @@ namespace RenderCore { namespace Assets
     template Float4x4   RawAnimationCurve::Calculate(float, CurveInterpolationType) const never_throws;
 	template Quaternion RawAnimationCurve::Calculate(float, CurveInterpolationType) const never_throws;
 
+	template void RawAnimationCurve::DecodeKeys(IteratorRange<float*>) const;
+	template void RawAnimationCurve::DecodeKeys(IteratorRange<Float3*>) const;
+	template void RawAnimationCurve::DecodeKeys(IteratorRange<Float4*>) const;
+	template void RawAnimationCurve::DecodeKeys(IteratorRange<Quaternion*>) const;
+
     RawAnimationCurve::RawAnimationCurve(   SerializableVector<uint16_t>&& timeMarkers, 
 											SerializableVector<uint8_t>&& keyData,
 											const CurveDesc& curveDesc)
@@ -8,6 +8,7 @@
 
 #include "../Format.h"
 #include "../../Utility/PtrUtils.h"
+#include "../../Utility/IteratorUtils.h"
 #include "../../Utility/Streams/SerializationUtils.h"
 #include <memory>
 
@@ -18,7 +19,7 @@ namespace RenderCore { namespace Assets
 
 	struct CurveDesc
 	{
-		struct Flags { enum BitValue { HasDequantBlock = 1<<0, HasInTangent = 1<<1, HasOutTangent = 1<<2 }; using BitField = unsigned; };
+		struct Flags { enum BitValue { HasDequantBlock = 1<<0, HasInTangent = 1<<1, HasOutTangent = 1<<2, BitPackedKeys = 1<<3 }; using BitField = unsigned; };
 		Flags::BitField	_flags = 0;
 		unsigned		_elementStride = 0;
 		Format			_elementFormat = Format(0);
@@ -38,6 +39,13 @@ namespace RenderCore { namespace Assets
         template<typename OutType>
             OutType        Calculate(float inputTime, CurveInterpolationType interpolationType) const never_throws;
 
+        /// Decompress the value of every key into "dst" (which must have room for KeyCount() elements). Tangents are not included
+        template<typename OutType>
+            void        DecodeKeys(IteratorRange<OutType*> dst) const;
+        unsigned        KeyCount() const;
+        IteratorRange<const uint16_t*> TimeMarkers() const { return MakeIteratorRange(_timeMarkers.begin(), _timeMarkers.end()); }
+        IteratorRange<const void*> KeyData() const { return MakeIteratorRange(_keyData.begin(), _keyData.end()); }
+
 		RawAnimationCurve(  SerializableVector<uint16_t>&& timeMarkers, 
                             SerializableVector<uint8_t>&& keyData,
 							const CurveDesc&	keyDataDesc);
@@ -53,6 +61,14 @@ namespace RenderCore { namespace Assets
         CurveDesc			            _desc;
     };
 
+    /// <summary>Precedes the key data in curves with CurveDesc::Flags::HasDequantBlock</summary>
+    /// Bits 0-3 of _elementFlags mark the components that are stored in each key. Other components are constant
+    /// and take the value in _mins.
+    ///
+    /// With CurveDesc::Flags::BitPackedKeys, bits 8-15 of _elementFlags hold the number of bits used for each
+    /// stored component, keys are packed without padding and CurveDesc::_elementStride is the size of a key in bits.
+    /// Quaternions are stored as x, y, z (in dequantization slots 0-2), with w reconstructed as positive. Bit packed
+    /// curves always use TimeMarkerType::FrameIndices.
     struct CurveDequantizationBlock
 	{
 		unsigned _elementFlags;
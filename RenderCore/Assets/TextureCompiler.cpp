@@ -3,6 +3,7 @@
 // http://www.opensource.org/licenses/mit-license.php)
 
 #include "TextureCompiler.h"
+#include "TextureCompression.h"
 #include "../BufferUploads/IBufferUploads.h"
 #include "../../Assets/IntermediateCompilers.h"
 #include "../../Assets/IFileSystem.h"
@@ -15,6 +16,7 @@
 #include "../../Formatters/FormatterUtils.h"
 #include "../../Formatters/TextFormatter.h"
 #include "../../OSServices/AttachableLibrary.h"
+#include "../../OSServices/Log.h"
 #include "../../Utility/Streams/SerializationUtils.h"
 #include "../../Utility/StringFormat.h"
 #include "../../Utility/StringUtils.h"
@@ -32,6 +34,40 @@ namespace RenderCore { namespace Assets
 {
 	::Assets::Blob PrepareDDSBlob(const TextureDesc& tDesc, size_t& headerSize);
 
+	static AlignedUniquePtr<uint8_t> LoadTextureDataSync(BufferUploads::IAsyncDataSource& srcPkt, TextureDesc& desc)
+	{
+		auto descFuture = srcPkt.GetDesc();
+		descFuture.wait();
+		auto resDesc = descFuture.get();
+		assert(resDesc._type == ResourceDesc::Type::Texture && resDesc._textureDesc._width >= 1 && resDesc._textureDesc._height >= 1);
+		desc = resDesc._textureDesc;
+
+		AlignedUniquePtr<uint8_t> data { (uint8_t*)XlMemAlign(ByteCount(desc), 64) };		// use a very large alignment, even if it's not specifically requested by the compression library
+
+		auto mipCount = desc._mipCount;
+		auto arrayLayerCount = ActualArrayLayerCount(desc);
+		VLA_UNSAFE_FORCE(BufferUploads::IAsyncDataSource::SubResource, subres, mipCount*arrayLayerCount);
+		for (unsigned a=0; a<arrayLayerCount; ++a)
+			for (unsigned m=0; m<mipCount; ++m) {
+				auto& sr = subres[m+a*mipCount];
+				auto srcOffset = GetSubResourceOffset(desc, m, a);
+				sr._id = SubResourceId{m, a};
+				sr._destination = {PtrAdd(data.get(), srcOffset._offset), PtrAdd(data.get(), srcOffset._offset+srcOffset._size)};
+				sr._pitches = srcOffset._pitches;
+			}
+
+		auto dataFuture = srcPkt.PrepareData(MakeIteratorRange(subres, &subres[mipCount*arrayLayerCount]));
+		dataFuture.wait();
+		return data;
+	}
+
+	static unsigned FullMipChainLength(const TextureDesc& desc)
+	{
+		unsigned result = 1;
+		while ((std::max(desc._width, desc._height) >> result) != 0) ++result;
+		return result;
+	}
+
 #if XLE_COMPRESSONATOR_ENABLE
 	static CMP_FORMAT AsCompressonatorFormat(Format fmt)
 	{
@@ -122,38 +158,18 @@ namespace RenderCore { namespace Assets
 		CMP_Texture _srcTexture;
 		TextureDesc _srcDesc;
 
-		CompressonatorTexture(BufferUploads::IAsyncDataSource& dataSrc)
+		CompressonatorTexture(const TextureDesc& desc, AlignedUniquePtr<uint8_t>&& data)
 		{
 			XlZeroMemory(_srcTexture);
-
-			auto descFuture = dataSrc.GetDesc();
-			descFuture.wait();
-			auto desc = descFuture.get();
-			assert(desc._type == ResourceDesc::Type::Texture && desc._textureDesc._width >= 1 && desc._textureDesc._height >= 1);
-			_srcDesc = desc._textureDesc;
+			_srcDesc = desc;
 
 			_srcTexture.dwSize     = sizeof(_srcTexture);
-			_srcTexture.dwWidth    = desc._textureDesc._width;
-			_srcTexture.dwHeight   = desc._textureDesc._height;
+			_srcTexture.dwWidth    = desc._width;
+			_srcTexture.dwHeight   = desc._height;
 			_srcTexture.dwPitch    = 0;		// interpreted as packed
-			_srcTexture.format     = AsCompressonatorFormat(desc._textureDesc._format);
-			_srcTexture.dwDataSize = ByteCount(desc._textureDesc);
-			_srcTexture.pData = (CMP_BYTE*)XlMemAlign(_srcTexture.dwDataSize, 64);		// use a very large alignment, even if it's not specifically requested by compressonator
-
-			auto mipCount = desc._textureDesc._mipCount;
-			auto arrayLayerCount = ActualArrayLayerCount(desc._textureDesc);
-			VLA_UNSAFE_FORCE(BufferUploads::IAsyncDataSource::SubResource, subres, mipCount*arrayLayerCount);
-			for (unsigned a=0; a<arrayLayerCount; ++a)
-				for (unsigned m=0; m<mipCount; ++m) {
-					auto& sr = subres[m+a*mipCount];
-					auto srcOffset = GetSubResourceOffset(desc._textureDesc, m, a);
-					sr._id = SubResourceId{m, a};
-					sr._destination = {PtrAdd(_srcTexture.pData, srcOffset._offset), PtrAdd(_srcTexture.pData, srcOffset._offset+srcOffset._size)};
-					sr._pitches = srcOffset._pitches;
-				}
-
-			auto dataFuture = dataSrc.PrepareData(MakeIteratorRange(subres, &subres[mipCount*arrayLayerCount]));
-			dataFuture.wait();
+			_srcTexture.format     = AsCompressonatorFormat(desc._format);
+			_srcTexture.dwDataSize = ByteCount(desc);
+			_srcTexture.pData = (CMP_BYTE*)data.release();		// (allocated with XlMemAlign)
 
 			// as per compressonator example, swizzle BGRA types
 			if (_srcTexture.format == CMP_FORMAT_BGRA_8888) {
@@ -181,111 +197,149 @@ namespace RenderCore { namespace Assets
 		CompressonatorTexture& operator=(CompressonatorTexture&&) = default;
 	};
 
+	static void ConvertWithCompressonator(CompressonatorTexture& input, const TextureDesc& dstDesc, IteratorRange<void*> dst)
+	{
+		if (input._srcTexture.format == CMP_FORMAT_Unknown)
+			Throw(std::runtime_error(Concatenate("Cannot initialize src texture for format conversion, because source format is not supported: ", AsString(input._srcDesc._format))));
+
+		CMP_CompressOptions options = {0};
+		options.dwSize       = sizeof(options);
+		options.fquality     = 0.05f;
+		// Compressonator seems to have an issue when dwnumThreads is set to 1 (other than running slow). It appears to spin up threads it can never close down
+		// let's just set it to "auto" to allow it to adapt to the processor (even if it squeezes our thread pool)
+		options.dwnumThreads = 0;
+		auto comprDstFormat = AsCompressonatorFormat(dstDesc._format);
+		if (comprDstFormat == CMP_FORMAT_Unknown)
+			Throw(std::runtime_error(Concatenate("Cannot write to the request texture pixel format because it is not supported by the compression library: ", AsString(dstDesc._format))));
+
+		// simple hack because we can't enter Compressonator while it's working
+		// (only conversions that CompressTextureParallel() can't handle, or would handle with its lower quality built-in encoders, come through here)
+		static Threading::Mutex s_compressonatorLock;
+		std::unique_lock l(s_compressonatorLock, std::defer_lock);
+		while (!l.try_lock())
+			YieldToPoolFor(std::chrono::milliseconds(10));
+
+		auto mipCount = dstDesc._mipCount;
+		auto arrayLayerCount = ActualArrayLayerCount(dstDesc);
+		for (unsigned a=0; a<arrayLayerCount; ++a)
+			for (unsigned m=0; m<mipCount; ++m) {
+				auto dstOffset = GetSubResourceOffset(dstDesc, m, a);
+				auto srcMipDesc = CalculateMipMapDesc(input._srcDesc, m);
+
+				CMP_Texture destTexture = {0};
+				destTexture.dwSize     = sizeof(destTexture);
+				destTexture.dwWidth    = std::max(1u, (unsigned)srcMipDesc._width);
+				destTexture.dwHeight   = std::max(1u, (unsigned)srcMipDesc._height);
+				destTexture.dwPitch    = 0;
+				destTexture.format     = comprDstFormat;
+				destTexture.dwDataSize = (CMP_DWORD)dstOffset._size;
+				auto calcSize = CMP_CalculateBufferSize(&destTexture);
+				assert(destTexture.dwDataSize == calcSize);
+				destTexture.pData = (CMP_BYTE*)PtrAdd(dst.begin(), dstOffset._offset);
+				assert(PtrAdd(destTexture.pData, destTexture.dwDataSize) <= dst.end());
+
+				auto srcOffset = GetSubResourceOffset(input._srcDesc, m, a);
+				auto srcTexture = input._srcTexture;
+				srcTexture.dwWidth = destTexture.dwWidth;
+				srcTexture.dwHeight = destTexture.dwHeight;
+				srcTexture.dwDataSize = (CMP_DWORD)srcOffset._size;
+				srcTexture.pData = PtrAdd(srcTexture.pData, srcOffset._offset);
+
+				CMP_ERROR cmp_status;
+				cmp_status = CMP_ConvertTexture(&srcTexture, &destTexture, &options, nullptr);
+				if (cmp_status != CMP_OK)
+					Throw(std::runtime_error("Compression library failed while processing texture compiler file"));
+			}
+
+		l.unlock();
+	}
+#endif
+
 	::Assets::Blob ConvertAndPrepareDDSBlobSync(
 		BufferUploads::IAsyncDataSource& srcPkt,
-		Format dstFmt)
+		Format dstFmt, bool generateMips, const MipGenerationSettings& mipSettings)
 	{
-		CompressonatorTexture input{srcPkt};
+		TextureDesc srcDesc;
+		auto srcData = LoadTextureDataSync(srcPkt, srcDesc);
+		auto srcRange = MakeIteratorRange(srcData.get(), PtrAdd(srcData.get(), ByteCount(srcDesc)));
+		auto& pool = ConsoleRig::GlobalServices::GetInstance().GetLongTaskThreadPool();
 
-		auto dstDesc = input._srcDesc;
+		auto dstDesc = srcDesc;
 		dstDesc._format = dstFmt;
-		size_t ddsHeaderOffset = 0;
-		auto destinationBlob = PrepareDDSBlob(dstDesc, ddsHeaderOffset);
-
-		if (input._srcDesc._format != dstDesc._format) {
-			if (input._srcTexture.format == CMP_FORMAT_Unknown)
-				Throw(std::runtime_error(Concatenate("Cannot initialize src texture for format conversion, because source format is not supported: ", AsString(input._srcDesc._format))));
-
-			CMP_CompressOptions options = {0};
-			options.dwSize       = sizeof(options);
-			options.fquality     = 0.05f;
-			// Compressonator seems to have an issue when dwnumThreads is set to 1 (other than running slow). It appears to spin up threads it can never close down
-			// let's just set it to "auto" to allow it to adapt to the processor (even if it squeezes our thread pool)
-			options.dwnumThreads = 0;
-			auto comprDstFormat = AsCompressonatorFormat(dstFmt);
-			if (comprDstFormat == CMP_FORMAT_Unknown)
-				Throw(std::runtime_error(Concatenate("Cannot write to the request texture pixel format because it is not supported by the compression library: ", AsString(dstFmt))));
-
-			// simple hack because we can't enter Compressonator while it's working
-			static Threading::Mutex s_compressonatorLock;
-			std::unique_lock l(s_compressonatorLock, std::defer_lock);
-			while (!l.try_lock())
-				YieldToPoolFor(std::chrono::milliseconds(10));
-
-			auto mipCount = dstDesc._mipCount;
-			auto arrayLayerCount = ActualArrayLayerCount(dstDesc);
-			for (unsigned a=0; a<arrayLayerCount; ++a)
-				for (unsigned m=0; m<mipCount; ++m) {
-					auto dstOffset = GetSubResourceOffset(dstDesc, m, a);
-					auto dstMipDesc = CalculateMipMapDesc(dstDesc, m);
-					auto srcMipDesc = CalculateMipMapDesc(input._srcDesc, m);
-
-					CMP_Texture destTexture = {0};
-					destTexture.dwSize     = sizeof(destTexture);
-					destTexture.dwWidth    = std::max(1u, (unsigned)srcMipDesc._width);
-					destTexture.dwHeight   = std::max(1u, (unsigned)srcMipDesc._height);
-					destTexture.dwPitch    = 0;
-					destTexture.format     = comprDstFormat;
-					destTexture.dwDataSize = (CMP_DWORD)dstOffset._size;
-					auto calcSize = CMP_CalculateBufferSize(&destTexture);
-					assert(destTexture.dwDataSize == calcSize);
-					destTexture.pData = (CMP_BYTE*)PtrAdd(destinationBlob->data(), ddsHeaderOffset + dstOffset._offset);
-					assert(PtrAdd(destTexture.pData, destTexture.dwDataSize) <= AsPointer(destinationBlob->end()));
-
-					auto srcOffset = GetSubResourceOffset(input._srcDesc, m, a);
-					auto srcTexture = input._srcTexture;
-					srcTexture.dwWidth = destTexture.dwWidth;
-					srcTexture.dwHeight = destTexture.dwHeight;
-					srcTexture.dwDataSize = (CMP_DWORD)srcOffset._size;
-					srcTexture.pData = PtrAdd(srcTexture.pData, srcOffset._offset);
-
-					CMP_ERROR cmp_status;
-					cmp_status = CMP_ConvertTexture(&srcTexture, &destTexture, &options, nullptr);
-					if (cmp_status != CMP_OK)
-						Throw(std::runtime_error("Compression library failed while processing texture compiler file"));
-				}
+		if (generateMips)
+			dstDesc._mipCount = (uint8_t)std::max((unsigned)srcDesc._mipCount, FullMipChainLength(srcDesc));
+
+		// The tiled compressor runs without any process-wide locks, so prefer it whenever it supports the conversion without
+		// losing quality. Its built-in block encoders are lower quality than Compressonator, so they're only used when
+		// Compressonator isn't available
+		bool useParallelCompression = CanCompressTextureParallel(srcDesc, dstFmt);
+		#if XLE_COMPRESSONATOR_ENABLE
+			if (useParallelCompression && UsesBuiltInBlockEncoder(srcDesc, dstFmt))
+				useParallelCompression = false;
+		#else
+			if (useParallelCompression && UsesBuiltInBlockEncoder(srcDesc, dstFmt))
+				Log(Warning) << "Compressing texture to " << AsString(dstFmt) << " with the built-in block encoder, because Compressonator isn't available. Quality will be lower than a Compressonator build" << std::endl;
+		#endif
+		if (useParallelCompression) {
+			size_t ddsHeaderOffset = 0;
+			auto destinationBlob = PrepareDDSBlob(dstDesc, ddsHeaderOffset);
+			TextureCompressionMetrics metrics;
+			CompressTextureParallel(
+				MakeIteratorRange(PtrAdd(destinationBlob->data(), ddsHeaderOffset), AsPointer(destinationBlob->end())), dstDesc,
+				srcRange, srcDesc, mipSettings, &pool, &metrics);
+			Log(Verbose) << "Compressed " << AsString(srcDesc._format) << " texture to " << AsString(dstFmt) << " at " << metrics.GetMegapixelsPerSecond() << " MP/s (" << metrics._jobCount << " jobs)" << std::endl;
+			return destinationBlob;
+		}
 
-			l.unlock();
-		} else {
+		if (dstDesc._mipCount > srcDesc._mipCount) {
+			// generate the missing mips in the source format, and then convert everything together below
+			if (!CanCompressTextureParallel(srcDesc, srcDesc._format))
+				Throw(std::runtime_error(Concatenate("Cannot generate mipmaps for texture with source format: ", AsString(srcDesc._format))));
+			auto expandedDesc = srcDesc;
+			expandedDesc._mipCount = dstDesc._mipCount;
+			AlignedUniquePtr<uint8_t> expandedData { (uint8_t*)XlMemAlign(ByteCount(expandedDesc), 64) };
+			CompressTextureParallel(
+				MakeIteratorRange(expandedData.get(), PtrAdd(expandedData.get(), ByteCount(expandedDesc))), expandedDesc,
+				srcRange, srcDesc, mipSettings, &pool);
+			srcData = std::move(expandedData);
+			srcDesc = expandedDesc;
+		}
+
+		if (srcDesc._format == dstFmt) {
 			// copy directly into the output dds
-			if (destinationBlob->size() != (ddsHeaderOffset + input._srcTexture.dwDataSize))
+			size_t ddsHeaderOffset = 0;
+			auto destinationBlob = PrepareDDSBlob(dstDesc, ddsHeaderOffset);
+			if (destinationBlob->size() != (ddsHeaderOffset + ByteCount(srcDesc)))
 				Throw(std::runtime_error("Texture conversion failed because of size mismatch"));
-			std::memcpy(PtrAdd(destinationBlob->data(), ddsHeaderOffset), input._srcTexture.pData, input._srcTexture.dwDataSize);
+			std::memcpy(PtrAdd(destinationBlob->data(), ddsHeaderOffset), srcData.get(), ByteCount(srcDesc));
+			return destinationBlob;
 		}
 
-		return destinationBlob;
+		#if XLE_COMPRESSONATOR_ENABLE
+			size_t ddsHeaderOffset = 0;
+			auto destinationBlob = PrepareDDSBlob(dstDesc, ddsHeaderOffset);
+			CompressonatorTexture input{srcDesc, std::move(srcData)};
+			ConvertWithCompressonator(input, dstDesc, MakeIteratorRange(PtrAdd(destinationBlob->data(), ddsHeaderOffset), AsPointer(destinationBlob->end())));
+			return destinationBlob;
+		#else
+			// no library available for this conversion; write out the texture in its original format
+			Log(Warning) << "Cannot convert texture to " << AsString(dstFmt) << " without Compressonator. Writing as " << AsString(srcDesc._format) << " instead" << std::endl;
+			size_t ddsHeaderOffset = 0;
+			auto destinationBlob = PrepareDDSBlob(srcDesc, ddsHeaderOffset);
+			std::memcpy(PtrAdd(destinationBlob->data(), ddsHeaderOffset), srcData.get(), ByteCount(srcDesc));
+			return destinationBlob;
+		#endif
 	}
-#endif
 
 	::Assets::Blob PrepareDDSBlobSyncWithoutConvert(
 		BufferUploads::IAsyncDataSource& srcPkt)
 	{
-		auto descFuture = srcPkt.GetDesc();
-		descFuture.wait();
-		auto desc = descFuture.get();
-		assert(desc._type == ResourceDesc::Type::Texture && desc._textureDesc._width >= 1 && desc._textureDesc._height >= 1);
+		TextureDesc desc;
+		auto data = LoadTextureDataSync(srcPkt, desc);
 		auto srcSize = ByteCount(desc);
-		auto dstDesc = desc._textureDesc;
-
-		AlignedUniquePtr<uint8_t> data { (uint8_t*)XlMemAlign(srcSize, 64) };
-
-		auto mipCount = desc._textureDesc._mipCount;
-		auto arrayLayerCount = ActualArrayLayerCount(desc._textureDesc);
-		VLA_UNSAFE_FORCE(BufferUploads::IAsyncDataSource::SubResource, subres, mipCount*arrayLayerCount);
-		for (unsigned a=0; a<arrayLayerCount; ++a)
-			for (unsigned m=0; m<mipCount; ++m) {
-				auto& sr = subres[m+a*mipCount];
-				auto srcOffset = GetSubResourceOffset(desc._textureDesc, m, a);
-				sr._id = SubResourceId{m, a};
-				sr._destination = {PtrAdd(data.get(), srcOffset._offset), PtrAdd(data.get(), srcOffset._offset+srcOffset._size)};
-				sr._pitches = srcOffset._pitches;
-			}
-
-		auto dataFuture = srcPkt.PrepareData(MakeIteratorRange(subres, &subres[mipCount*arrayLayerCount]));
-		dataFuture.wait();
 
 		size_t ddsHeaderOffset = 0;
-		auto destinationBlob = PrepareDDSBlob(dstDesc, ddsHeaderOffset);
+		auto destinationBlob = PrepareDDSBlob(desc, ddsHeaderOffset);
 
 		// copy directly into the output dds
 		if (destinationBlob->size() != (ddsHeaderOffset + srcSize))
@@ -420,6 +474,16 @@ namespace RenderCore { namespace Assets
 				auto mode = Formatters::RequireStringValue(fmttr);
 				if (auto fmtOpt = AsFormat(mode)) dst._format = *fmtOpt;
 				else Throw(Formatters::FormatException("Unknown 'Format' field in texture compiler file: " + mode.AsString(), fmttr.GetLocation()));
+			} else if (XlEqString(kn, "GenerateMips")) {
+				dst._generateMips = Formatters::RequireCastValue<decltype(dst._generateMips)>(fmttr);
+			} else if (XlEqString(kn, "MipFilter")) {
+				auto mode = Formatters::RequireStringValue(fmttr);
+				if (auto filterOpt = AsMipFilter(mode)) dst._mipSettings._filter = *filterOpt;
+				else Throw(Formatters::FormatException("Unknown 'MipFilter' field in texture compiler file: " + mode.AsString(), fmttr.GetLocation()));
+			} else if (XlEqString(kn, "NormalMap")) {
+				dst._mipSettings._normalMap = Formatters::RequireCastValue<decltype(dst._mipSettings._normalMap)>(fmttr);
+			} else if (XlEqString(kn, "AlphaCoverageReference")) {
+				dst._mipSettings._alphaCoverageReference = Formatters::RequireCastValue<decltype(dst._mipSettings._alphaCoverageReference)>(fmttr);
 			} else Formatters::SkipValueOrElement(fmttr);
 		}
 	}
@@ -464,13 +528,9 @@ namespace RenderCore { namespace Assets
 			assert(postConvert._format != Format::Unknown);
 			ITextureCompiler::Context ctx { &opHelper, &conduit };
 			auto pkt = compiler.ExecuteCompile(ctx);
-			#if XLE_COMPRESSONATOR_ENABLE
-				if (opHelper)
-					opHelper.SetMessage(Concatenate("Compressing to pixel format ", AsString(postConvert._format)));
-				auto blob = ConvertAndPrepareDDSBlobSync(*pkt, postConvert._format);
-			#else
-				auto blob = PrepareDDSBlobSyncWithoutConvert(*pkt);
-			#endif
+			if (opHelper)
+				opHelper.SetMessage(Concatenate("Compressing to pixel format ", AsString(postConvert._format)));
+			auto blob = ConvertAndPrepareDDSBlobSync(*pkt, postConvert._format, postConvert._generateMips, postConvert._mipSettings);
 
 			_serializedArtifacts.emplace_back(TextureCompilerProcessType, 0, ".dds", blob);
 			_dependencies.insert(_dependencies.end(), ctx._dependencies.begin(), ctx._dependencies.end());
@@ -533,6 +593,13 @@ namespace RenderCore { namespace Assets
 		if (indexer._scaffold.get()->HasComponent(indexer._entityNameHash, "PostConvert"_h)) {
 			result._postConvert = util->GetFuture<PostConvert>("PostConvert"_h, indexer).get();
 			result._intermediateName = Concatenate(result._intermediateName, "-", AsString(result._postConvert->_format));
+			if (result._postConvert->_generateMips) {
+				const auto& mipSettings = result._postConvert->_mipSettings;
+				result._intermediateName = Concatenate(result._intermediateName, "-mips-", AsString(mipSettings._filter));
+				if (mipSettings._normalMap) result._intermediateName += "-n";
+				if (mipSettings._alphaCoverageReference > 0.f)
+					result._intermediateName += "-ac" + std::to_string(unsigned(mipSettings._alphaCoverageReference*255.f + 0.5f));
+			}
 		}
 
 		return result;
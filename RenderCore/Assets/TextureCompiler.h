@@ -5,6 +5,7 @@
 #pragma once
 
 #include "TextureLoaders.h"
+#include "MipGeneration.h"
 #include "../../Assets/IntermediateCompilers.h"
 #include "../../Assets/DepVal.h"
 #include "../../Utility/MemoryUtils.h"
@@ -67,6 +68,8 @@ namespace RenderCore { namespace Assets
 	struct PostConvert
 	{
 		Format _format = Format::Unknown;
+		bool _generateMips = false;		// fill out the full mip chain when the source doesn't have one
+		MipGenerationSettings _mipSettings;
 		friend void DeserializationOperator(Formatters::TextInputFormatter<char>&, PostConvert&);
 	};
 
@@ -99,7 +102,7 @@ namespace RenderCore { namespace Assets
 
 	::Assets::Blob ConvertAndPrepareDDSBlobSync(
 		BufferUploads::IAsyncDataSource& src,
-		Format dstFmt);
+		Format dstFmt, bool generateMips = false, const MipGenerationSettings& mipSettings = {});
 
 	class ITextureCompiler;
 	std::shared_ptr<ITextureCompiler> TextureCompiler_Base(
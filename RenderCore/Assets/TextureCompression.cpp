@@ -0,0 +1,484 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "TextureCompression.h"
+#include "MipGeneration.h"
+#include "../ResourceUtils.h"
+#include "../Format.h"
+#include "../../Utility/Threading/CompletionThreadPool.h"
+#include "../../Utility/PtrUtils.h"
+#include "../../Core/Exceptions.h"
+#include "../../Foreign/half-1.9.2/include/half.hpp"
+#include <atomic>
+#include <thread>
+#include <climits>
+#include <cstring>
+
+#if XLE_ISPCTEX_ENABLE
+	#include "../../Foreign/ISPCTex/ispc_texcomp.h"
+#endif
+
+namespace RenderCore { namespace Assets
+{
+	namespace Internal
+	{
+		static constexpr unsigned TileDimension = 64;			// in pixels, must be a multiple of the block size
+		static constexpr unsigned MipGenerationBandHeight = 32;	// rows of the destination mip level per mip generation job
+
+		struct SourceLayout
+		{
+			unsigned _bytesPerPixel = 0;
+			unsigned _channelCount = 0;
+			bool _swapRB = false;
+			bool _float16 = false;
+			bool _float32 = false;
+		};
+
+		static SourceLayout GetSourceLayout(Format fmt)
+		{
+			switch (fmt) {
+			case Format::R8G8B8A8_TYPELESS:
+			case Format::R8G8B8A8_UNORM:
+			case Format::R8G8B8A8_UNORM_SRGB:	return { 4, 4 };
+			case Format::B8G8R8A8_TYPELESS:
+			case Format::B8G8R8A8_UNORM:
+			case Format::B8G8R8A8_UNORM_SRGB:
+			case Format::B8G8R8X8_TYPELESS:
+			case Format::B8G8R8X8_UNORM:
+			case Format::B8G8R8X8_UNORM_SRGB:	return { 4, 4, true };
+			case Format::R8G8_TYPELESS:
+			case Format::R8G8_UNORM:			return { 2, 2 };
+			case Format::R8_TYPELESS:
+			case Format::R8_UNORM:				return { 1, 1 };
+			case Format::R16G16B16A16_FLOAT:	return { 8, 4, false, true };
+			case Format::R32G32B32A32_FLOAT:	return { 16, 4, false, false, true };
+			default:							return {};
+			}
+		}
+
+		enum class Kernel { None, Copy, BC1, BC3, BC4, BC5, ISPC_BC1, ISPC_BC3, ISPC_BC6H, ISPC_BC7 };
+
+		static Kernel SelectKernel(const SourceLayout& src, Format srcFormat, Format dstFormat)
+		{
+			if (!src._bytesPerPixel) return Kernel::None;
+			if (srcFormat == dstFormat) return Kernel::Copy;
+			bool ldrSource = !src._float16 && !src._float32;
+			#if XLE_ISPCTEX_ENABLE
+				const bool ispc = true;
+			#else
+				const bool ispc = false;
+			#endif
+			switch (dstFormat) {
+			case Format::BC1_TYPELESS:
+			case Format::BC1_UNORM:
+			case Format::BC1_UNORM_SRGB:	return ldrSource ? (ispc ? Kernel::ISPC_BC1 : Kernel::BC1) : Kernel::None;
+			case Format::BC3_TYPELESS:
+			case Format::BC3_UNORM:
+			case Format::BC3_UNORM_SRGB:	return ldrSource ? (ispc ? Kernel::ISPC_BC3 : Kernel::BC3) : Kernel::None;
+			case Format::BC4_TYPELESS:
+			case Format::BC4_UNORM:			return ldrSource ? Kernel::BC4 : Kernel::None;
+			case Format::BC5_TYPELESS:
+			case Format::BC5_UNORM:			return (ldrSource && src._channelCount >= 2) ? Kernel::BC5 : Kernel::None;
+			case Format::BC6H_UF16:			return (ispc && !ldrSource) ? Kernel::ISPC_BC6H : Kernel::None;
+			case Format::BC7_TYPELESS:
+			case Format::BC7_UNORM:
+			case Format::BC7_UNORM_SRGB:	return (ispc && ldrSource) ? Kernel::ISPC_BC7 : Kernel::None;
+			default:						return Kernel::None;
+			}
+		}
+
+		static unsigned StagingBytesPerPixel(Kernel kernel) { return (kernel == Kernel::ISPC_BC6H) ? 8 : 4; }
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		static uint16_t PackRGB565(const int c[3])
+		{
+			return uint16_t(((c[0]>>3)<<11) | ((c[1]>>2)<<5) | (c[2]>>3));
+		}
+
+		static void UnpackRGB565(uint16_t v, int c[3])
+		{
+			int r = (v>>11)&31, g = (v>>5)&63, b = v&31;
+			c[0] = (r<<3)|(r>>2); c[1] = (g<<2)|(g>>4); c[2] = (b<<3)|(b>>2);
+		}
+
+		// Bounding box encoder; with the box inset slightly and the diagonal chosen to follow the color distribution
+		static void EncodeBC1Block(const uint8_t* rgba, unsigned stride, uint8_t dst[8])
+		{
+			int mn[3] = {255, 255, 255}, mx[3] = {0, 0, 0}, mean[3] = {0, 0, 0};
+			for (unsigned y=0; y<4; ++y)
+				for (unsigned x=0; x<4; ++x) {
+					auto* p = rgba + y*stride + x*4;
+					for (unsigned c=0; c<3; ++c) {
+						mn[c] = std::min(mn[c], (int)p[c]);
+						mx[c] = std::max(mx[c], (int)p[c]);
+						mean[c] += p[c];
+					}
+				}
+			for (unsigned c=0; c<3; ++c) mean[c] = (mean[c]+8)/16;
+
+			int covRG = 0, covBG = 0;
+			for (unsigned y=0; y<4; ++y)
+				for (unsigned x=0; x<4; ++x) {
+					auto* p = rgba + y*stride + x*4;
+					covRG += (p[0]-mean[0])*(p[1]-mean[1]);
+					covBG += (p[2]-mean[2])*(p[1]-mean[1]);
+				}
+
+			int hi[3], lo[3];
+			for (unsigned c=0; c<3; ++c) {
+				int inset = (mx[c]-mn[c]) >> 4;
+				hi[c] = mx[c]-inset;
+				lo[c] = mn[c]+inset;
+			}
+			if (covRG < 0) std::swap(hi[0], lo[0]);
+			if (covBG < 0) std::swap(hi[2], lo[2]);
+
+			auto c0 = PackRGB565(hi), c1 = PackRGB565(lo);
+			if (c0 < c1) std::swap(c0, c1);		// c0 > c1 selects the 4 color mode
+
+			uint32_t indices = 0;
+			if (c0 != c1) {
+				int palette[4][3];
+				UnpackRGB565(c0, palette[0]);
+				UnpackRGB565(c1, palette[1]);
+				for (unsigned c=0; c<3; ++c) {
+					palette[2][c] = (2*palette[0][c] + palette[1][c]) / 3;
+					palette[3][c] = (palette[0][c] + 2*palette[1][c]) / 3;
+				}
+				for (unsigned i=0; i<16; ++i) {
+					auto* p = rgba + (i/4)*stride + (i%4)*4;
+					unsigned best = 0; int bestDist = INT_MAX;
+					for (unsigned q=0; q<4; ++q) {
+						int dr = p[0]-palette[q][0], dg = p[1]-palette[q][1], db = p[2]-palette[q][2];
+						int dist = dr*dr + dg*dg + db*db;
+						if (dist < bestDist) { bestDist = dist; best = q; }
+					}
+					indices |= best << (2*i);
+				}
+			}
+
+			dst[0] = uint8_t(c0); dst[1] = uint8_t(c0>>8);
+			dst[2] = uint8_t(c1); dst[3] = uint8_t(c1>>8);
+			for (unsigned b=0; b<4; ++b) dst[4+b] = uint8_t(indices >> (8*b));
+		}
+
+		// Single channel block (also used for the alpha of BC3 and both channels of BC5)
+		static void EncodeBC4Block(const uint8_t* src, unsigned stride, unsigned pixelStride, uint8_t dst[8])
+		{
+			int mn = 255, mx = 0;
+			for (unsigned y=0; y<4; ++y)
+				for (unsigned x=0; x<4; ++x) {
+					int v = src[y*stride + x*pixelStride];
+					mn = std::min(mn, v); mx = std::max(mx, v);
+				}
+
+			uint64_t indices = 0;
+			if (mx != mn) {
+				// a0 > a1 selects the mode with 6 interpolated values
+				int palette[8];
+				palette[0] = mx; palette[1] = mn;
+				for (int i=1; i<7; ++i) palette[i+1] = ((7-i)*mx + i*mn) / 7;
+				for (unsigned i=0; i<16; ++i) {
+					int v = src[(i/4)*stride + (i%4)*pixelStride];
+					unsigned best = 0; int bestDist = INT_MAX;
+					for (unsigned q=0; q<8; ++q) {
+						int dist = std::abs(v - palette[q]);
+						if (dist < bestDist) { bestDist = dist; best = q; }
+					}
+					indices |= uint64_t(best) << (3*i);
+				}
+			}
+
+			dst[0] = uint8_t(mx); dst[1] = uint8_t(mn);
+			for (unsigned b=0; b<6; ++b) dst[2+b] = uint8_t(indices >> (8*b));
+		}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+		using LevelData = MipGenerator::LevelView;
+
+		// Copy a tile out of the source level into the staging format for the kernel, clamping at the edges to pad out to full blocks
+		static void FillStaging(
+			uint8_t* staging, unsigned stagingPitch, Kernel kernel,
+			const SourceLayout& layout, const LevelData& src,
+			unsigned x0, unsigned y0, unsigned width, unsigned height, unsigned paddedWidth, unsigned paddedHeight)
+		{
+			for (unsigned y=0; y<paddedHeight; ++y) {
+				auto* srcRow = PtrAdd(src._data, (y0+std::min(y, height-1))*src._rowPitch);
+				auto* dstRow = staging + y*stagingPitch;
+				for (unsigned x=0; x<paddedWidth; ++x) {
+					auto* s = PtrAdd(srcRow, (x0+std::min(x, width-1))*layout._bytesPerPixel);
+					if (kernel == Kernel::ISPC_BC6H) {
+						auto* d = (uint16_t*)(dstRow + x*8);
+						if (layout._float16) {
+							std::memcpy(d, s, 8);
+						} else {
+							for (unsigned c=0; c<4; ++c)
+								d[c] = half_float::detail::float2half<std::round_to_nearest>(((const float*)s)[c]);
+						}
+					} else {
+						auto* d = dstRow + x*4;
+						auto* s8 = (const uint8_t*)s;
+						d[0] = s8[layout._swapRB ? 2 : 0];
+						d[1] = (layout._channelCount > 1) ? s8[1] : 0;
+						d[2] = (layout._channelCount > 2) ? s8[layout._swapRB ? 0 : 2] : 0;
+						d[3] = (layout._channelCount > 3) ? s8[3] : 0xff;
+					}
+				}
+			}
+		}
+
+		static void CompressTile(
+			Kernel kernel, const SourceLayout& layout, const LevelData& src,
+			void* dst, unsigned dstRowPitch, unsigned blockBytes,
+			unsigned x0, unsigned y0)
+		{
+			unsigned width = std::min(TileDimension, src._width-x0), height = std::min(TileDimension, src._height-y0);
+
+			if (kernel == Kernel::Copy) {
+				for (unsigned y=0; y<height; ++y)
+					std::memcpy(
+						PtrAdd(dst, (y0+y)*dstRowPitch + x0*layout._bytesPerPixel),
+						PtrAdd(src._data, (y0+y)*src._rowPitch + x0*layout._bytesPerPixel),
+						width*layout._bytesPerPixel);
+				return;
+			}
+
+			unsigned paddedWidth = (width+3)&~3u, paddedHeight = (height+3)&~3u;
+			alignas(16) uint8_t staging[TileDimension*TileDimension*8];
+			unsigned stagingPitch = paddedWidth*StagingBytesPerPixel(kernel);
+			FillStaging(staging, stagingPitch, kernel, layout, src, x0, y0, width, height, paddedWidth, paddedHeight);
+
+			unsigned blocksWide = paddedWidth/4, blocksHigh = paddedHeight/4;
+			for (unsigned by=0; by<blocksHigh; ++by) {
+				auto* dstRow = (uint8_t*)PtrAdd(dst, (y0/4+by)*dstRowPitch + (x0/4)*blockBytes);
+				auto* stagingRow = staging + by*4*stagingPitch;
+
+				#if XLE_ISPCTEX_ENABLE
+					if (kernel >= Kernel::ISPC_BC1) {
+						// compress a full row of blocks at a time; the output is in raster order, which matches the destination row
+						rgba_surface surface { stagingRow, int32_t(paddedWidth), 4, int32_t(stagingPitch) };
+						switch (kernel) {
+						case Kernel::ISPC_BC1: CompressBlocksBC1(&surface, dstRow); break;
+						case Kernel::ISPC_BC3: CompressBlocksBC3(&surface, dstRow); break;
+						case Kernel::ISPC_BC6H: { bc6h_enc_settings settings; GetProfile_bc6h_veryfast(&settings); CompressBlocksBC6H(&surface, dstRow, &settings); break; }
+						case Kernel::ISPC_BC7: { bc7_enc_settings settings; GetProfile_alpha_veryfast(&settings); CompressBlocksBC7(&surface, dstRow, &settings); break; }
+						default: assert(0); break;
+						}
+						continue;
+					}
+				#endif
+
+				for (unsigned bx=0; bx<blocksWide; ++bx) {
+					auto* block = stagingRow + bx*4*4;
+					auto* out = dstRow + bx*blockBytes;
+					switch (kernel) {
+					case Kernel::BC1: EncodeBC1Block(block, stagingPitch, out); break;
+					case Kernel::BC3: EncodeBC4Block(block+3, stagingPitch, 4, out); EncodeBC1Block(block, stagingPitch, out+8); break;
+					case Kernel::BC4: EncodeBC4Block(block, stagingPitch, 4, out); break;
+					case Kernel::BC5: EncodeBC4Block(block, stagingPitch, 4, out); EncodeBC4Block(block+1, stagingPitch, 4, out+8); break;
+					default: assert(0); break;
+					}
+				}
+			}
+		}
+
+		struct Job
+		{
+			enum class Type : unsigned { GenerateMip, Compress };
+			Type _type;
+			unsigned _mip, _arrayLayer;
+			unsigned _x, _y;				// tile origin for compression, first row for mip generation
+		};
+	}
+
+	bool CanCompressTextureParallel(const TextureDesc& srcDesc, Format dstFormat)
+	{
+		if (srcDesc._dimensionality == TextureDesc::Dimensionality::T3D || srcDesc._depth > 1) return false;
+		auto layout = Internal::GetSourceLayout(srcDesc._format);
+		return Internal::SelectKernel(layout, srcDesc._format, dstFormat) != Internal::Kernel::None;
+	}
+
+	bool UsesBuiltInBlockEncoder(const TextureDesc& srcDesc, Format dstFormat)
+	{
+		if (!CanCompressTextureParallel(srcDesc, dstFormat)) return false;
+		auto kernel = Internal::SelectKernel(Internal::GetSourceLayout(srcDesc._format), srcDesc._format, dstFormat);
+		return kernel == Internal::Kernel::BC1 || kernel == Internal::Kernel::BC3 || kernel == Internal::Kernel::BC4 || kernel == Internal::Kernel::BC5;
+	}
+
+	void CompressTextureParallel(
+		IteratorRange<void*> dst, const TextureDesc& dstDesc,
+		IteratorRange<const void*> src, const TextureDesc& srcDesc,
+		const MipGenerationSettings& mipSettings,
+		Utility::ThreadPool* pool,
+		TextureCompressionMetrics* metrics)
+	{
+		using namespace Internal;
+		auto startTime = std::chrono::steady_clock::now();
+
+		if (!CanCompressTextureParallel(srcDesc, dstDesc._format))
+			Throw(std::runtime_error(Concatenate("Parallel texture compression does not support writing ", AsString(dstDesc._format), " from ", AsString(srcDesc._format))));
+		auto arrayLayerCount = ActualArrayLayerCount(srcDesc);
+		if (dstDesc._width != srcDesc._width || dstDesc._height != srcDesc._height || ActualArrayLayerCount(dstDesc) != arrayLayerCount || dstDesc._dimensionality != srcDesc._dimensionality)
+			Throw(std::runtime_error("Source and destination dimensions don't match in parallel texture compression"));
+		if (src.size() < ByteCount(srcDesc) || dst.size() < ByteCount(dstDesc))
+			Throw(std::runtime_error("Buffers provided to parallel texture compression are too small"));
+		unsigned fullChainLength = 1;
+		while ((std::max(srcDesc._width, srcDesc._height) >> fullChainLength) != 0) ++fullChainLength;
+		if (!dstDesc._mipCount || dstDesc._mipCount > fullChainLength || !srcDesc._mipCount)
+			Throw(std::runtime_error("Invalid mip count in parallel texture compression"));
+
+		auto layout = GetSourceLayout(srcDesc._format);
+		auto kernel = SelectKernel(layout, srcDesc._format, dstDesc._format);
+		auto compressionParams = GetCompressionParameters(dstDesc._format);
+		unsigned blockBytes = (kernel == Kernel::Copy) ? layout._bytesPerPixel : compressionParams._blockBytes;
+
+		unsigned mipCount = dstDesc._mipCount;
+		unsigned srcMipCount = std::min((unsigned)srcDesc._mipCount, mipCount);
+
+		std::vector<unsigned> dstOffsets(mipCount*arrayLayerCount), dstRowPitches(mipCount*arrayLayerCount);
+		for (unsigned a=0; a<arrayLayerCount; ++a)
+			for (unsigned m=0; m<mipCount; ++m) {
+				auto dstOffset = GetSubResourceOffset(dstDesc, m, a);
+				dstOffsets[m+a*mipCount] = (unsigned)dstOffset._offset;
+				dstRowPitches[m+a*mipCount] = dstOffset._pitches._rowPitch;
+			}
+
+		// Storage for mip levels that we're generating. These are in the source format, so they can go through the same
+		// tiling & staging as the source levels. When there's no format conversion, generated levels are written straight
+		// into the destination and there's nothing more to do with them
+		std::vector<std::unique_ptr<uint8_t[]>> generatedLevels;
+		std::vector<LevelData> levels(mipCount*arrayLayerCount);
+		for (unsigned a=0; a<arrayLayerCount; ++a)
+			for (unsigned m=0; m<mipCount; ++m) {
+				auto levelIdx = m+a*mipCount;
+				auto& l = levels[levelIdx];
+				l._width = std::max(1u, srcDesc._width >> m);
+				l._height = std::max(1u, srcDesc._height >> m);
+				if (m < srcMipCount) {
+					auto srcOffset = GetSubResourceOffset(srcDesc, m, a);
+					l._data = const_cast<void*>(PtrAdd(src.begin(), srcOffset._offset));
+					l._rowPitch = srcOffset._pitches._rowPitch;
+				} else if (kernel == Kernel::Copy) {
+					l._data = PtrAdd(dst.begin(), dstOffsets[levelIdx]);
+					l._rowPitch = dstRowPitches[levelIdx];
+				} else {
+					l._rowPitch = l._width*layout._bytesPerPixel;
+					generatedLevels.emplace_back(std::make_unique<uint8_t[]>(size_t(l._rowPitch)*l._height));
+					l._data = generatedLevels.back().get();
+				}
+			}
+
+		MipGenerator mipGenerator;
+		std::vector<float> targetAlphaCoverage;
+		if (mipCount > srcMipCount) {
+			// sRGB data is filtered in linear space. Often the source is tagged as linear, and only the compressed
+			// destination format tells us how the texture will be sampled
+			bool linearSpace = GetComponentType(srcDesc._format) == FormatComponentType::UNorm_SRGB || GetComponentType(dstDesc._format) == FormatComponentType::UNorm_SRGB;
+			mipGenerator = MipGenerator(srcDesc._format, mipSettings, linearSpace);
+			if (mipGenerator.PreservesAlphaCoverage())
+				for (unsigned a=0; a<arrayLayerCount; ++a)
+					targetAlphaCoverage.push_back(mipGenerator.CalculateAlphaCoverage(levels[a*mipCount]));
+		}
+
+		// Build the job list in dependency order. Generating a level is interleaved with compressing the level above it,
+		// so that workers have something independent to do while the level they depend on is still being filtered
+		std::vector<Job> jobs;
+		auto appendCompressJobs = [&](unsigned m) {
+			if (kernel == Kernel::Copy && m >= srcMipCount) return;		// already in place
+			for (unsigned a=0; a<arrayLayerCount; ++a) {
+				const auto& l = levels[m+a*mipCount];
+				for (unsigned y=0; y<l._height; y+=TileDimension)
+					for (unsigned x=0; x<l._width; x+=TileDimension)
+						jobs.push_back({Job::Type::Compress, m, a, x, y});
+			}
+		};
+		for (unsigned m=0; m<mipCount; ++m) {
+			if (m >= srcMipCount)
+				for (unsigned a=0; a<arrayLayerCount; ++a)
+					for (unsigned y=0; y<levels[m+a*mipCount]._height; y+=MipGenerationBandHeight)
+						jobs.push_back({Job::Type::GenerateMip, m, a, 0, y});
+			if (m > 0) appendCompressJobs(m-1);
+		}
+		appendCompressJobs(mipCount-1);
+
+		// Outstanding generation work for each (mip, array layer) pair. Source levels start at zero. When preserving alpha
+		// coverage there's an extra unit of work per level, which is done by whichever job finishes the last band
+		const unsigned levelFixupCount = mipGenerator.PreservesAlphaCoverage() ? 1 : 0;
+		auto pendingGeneration = std::make_unique<std::atomic<unsigned>[]>(levels.size());
+		uint64_t pixelCount = 0;
+		for (unsigned a=0; a<arrayLayerCount; ++a)
+			for (unsigned m=0; m<mipCount; ++m) {
+				const auto& l = levels[m+a*mipCount];
+				pendingGeneration[m+a*mipCount].store((m < srcMipCount) ? 0 : ((l._height+MipGenerationBandHeight-1)/MipGenerationBandHeight + levelFixupCount), std::memory_order_relaxed);
+				pixelCount += l._width * l._height;
+			}
+
+		std::atomic<unsigned> nextJob { 0 };
+		std::atomic<bool> aborted { false };
+
+		auto waitForLevel = [&](unsigned levelIdx) {
+			// Any job we're waiting on has already been claimed by a running worker (it's earlier in the list), so this can't deadlock
+			while (pendingGeneration[levelIdx].load(std::memory_order_acquire) != 0) {
+				if (aborted.load(std::memory_order_relaxed))
+					Throw(std::runtime_error("Parallel texture compression aborted"));
+				std::this_thread::yield();
+			}
+		};
+
+		auto workerFn = [&]() {
+			for (;;) {
+				auto j = nextJob.fetch_add(1, std::memory_order_relaxed);
+				if (j >= jobs.size()) break;
+				const auto& job = jobs[j];
+				auto levelIdx = job._mip+job._arrayLayer*mipCount;
+				TRY {
+					if (job._type == Job::Type::GenerateMip) {
+						waitForLevel(levelIdx-1);
+						const auto& l = levels[levelIdx];
+						mipGenerator.GenerateRows(levels[levelIdx-1], l, job._y, std::min(job._y+MipGenerationBandHeight, l._height));
+						auto remaining = pendingGeneration[levelIdx].fetch_sub(1, std::memory_order_acq_rel) - 1;
+						if (levelFixupCount && remaining == levelFixupCount) {
+							mipGenerator.ScaleAlphaToCoverage(l, targetAlphaCoverage[job._arrayLayer]);
+							pendingGeneration[levelIdx].fetch_sub(1, std::memory_order_release);
+						}
+					} else {
+						waitForLevel(levelIdx);
+						CompressTile(kernel, layout, levels[levelIdx], PtrAdd(dst.begin(), dstOffsets[levelIdx]), dstRowPitches[levelIdx], blockBytes, job._x, job._y);
+					}
+				} CATCH(...) {
+					aborted.store(true, std::memory_order_relaxed);
+					throw;
+				} CATCH_END
+			}
+		};
+
+		unsigned threadCount = 1;
+		if (pool && pool->IsGood())
+			threadCount = std::max(1u, std::min((unsigned)jobs.size(), pool->GetThreadContext()+1));
+
+		if (threadCount > 1) {
+			// every worker pulls jobs from the same queue, so the index is unused
+			ParallelFor(*pool, threadCount, [&workerFn](unsigned) { workerFn(); });
+		} else
+			workerFn();
+
+		if (metrics) {
+			metrics->_dstFormat = dstDesc._format;
+			metrics->_pixelCount = pixelCount;
+			metrics->_jobCount = (unsigned)jobs.size();
+			metrics->_generatedMipLevels = mipCount - srcMipCount;
+			metrics->_threadCount = threadCount;
+			metrics->_elapsed = std::chrono::steady_clock::now() - startTime;
+		}
+	}
+
+	double TextureCompressionMetrics::GetMegapixelsPerSecond() const
+	{
+		auto seconds = std::chrono::duration_cast<std::chrono::duration<double>>(_elapsed).count();
+		if (seconds <= 0.0) return 0.0;
+		return double(_pixelCount) / 1e6 / seconds;
+	}
+}}
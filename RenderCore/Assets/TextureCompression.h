@@ -0,0 +1,57 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "../ResourceDesc.h"
+#include "../../Utility/IteratorUtils.h"
+#include <chrono>
+
+namespace Utility { class ThreadPool; }
+
+namespace RenderCore { namespace Assets
+{
+	struct MipGenerationSettings;
+
+	struct TextureCompressionMetrics
+	{
+		Format _dstFormat = Format::Unknown;
+		uint64_t _pixelCount = 0;					// across all destination subresources, including generated mips
+		unsigned _jobCount = 0;
+		unsigned _generatedMipLevels = 0;
+		unsigned _threadCount = 0;
+		std::chrono::nanoseconds _elapsed { 0 };
+
+		double GetMegapixelsPerSecond() const;
+	};
+
+	/// <summary>Returns true if CompressTextureParallel() can write the given format from the given source</summary>
+	/// The built-in kernels cover BC1, BC3, BC4 & BC5 from 8 bit unorm sources. When built with XLE_ISPCTEX_ENABLE, BC1 & BC3
+	/// go via the ISPC kernels instead, and BC6H (unsigned, from float sources) & BC7 are also available.
+	/// dstFormat may also be the same as the source format, in which case the only work done is mip generation.
+	bool CanCompressTextureParallel(const TextureDesc& srcDesc, Format dstFormat);
+
+	/// <summary>Returns true if CompressTextureParallel() would use its built-in block encoders for this conversion</summary>
+	/// The built-in encoders are simple bounding box encoders; they are fast, but lower quality than Compressonator
+	/// or the ISPC kernels. Returns false for conversions that go via the ISPC kernels, that only copy and generate mips,
+	/// or that aren't supported at all.
+	bool UsesBuiltInBlockEncoder(const TextureDesc& srcDesc, Format dstFormat);
+
+	/// <summary>Block compress a texture without any process-wide locks</summary>
+	/// Each subresource is split into tiles, which are compressed as independent jobs on the given pool (the calling thread
+	/// also takes jobs). Jobs are claimed from a shared atomic counter, so there's no locking between workers.
+	///
+	/// Mip levels that exist in dstDesc but not in srcDesc are generated with MipGenerator as part of the same job graph;
+	/// compression of a level begins as soon as that level has been generated, while lower levels are still being filtered.
+	/// Filtering happens in linear space if either the source or destination format is sRGB.
+	///
+	/// Both src and dst are packed as per GetSubResourceOffset(). Throws if the conversion isn't supported (see
+	/// CanCompressTextureParallel())
+	void CompressTextureParallel(
+		IteratorRange<void*> dst, const TextureDesc& dstDesc,
+		IteratorRange<const void*> src, const TextureDesc& srcDesc,
+		const MipGenerationSettings& mipSettings,
+		Utility::ThreadPool* pool,
+		TextureCompressionMetrics* metrics = nullptr);
+}}
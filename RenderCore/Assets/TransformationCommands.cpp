@@ -9,8 +9,14 @@
 #include "../../Math/Matrix.h"
 #include "../../Math/Transformations.h"
 #include "../../Math/MathSerialization.h"
+#include "../../Utility/Threading/CompletionThreadPool.h"
 #include <sstream>
 
+#if (defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)) && defined(__SSE4_1__)
+	#include <immintrin.h>			// MSVC & clang intrinsic
+	#define HAS_SSE_INSTRUCTIONS
+#endif
+
 #pragma warning(disable:4127)
 #pragma warning(disable:4505)       // unreferenced function removed
 
@@ -1176,6 +1182,613 @@ namespace RenderCore { namespace Assets
             std::function<void(const Float4x4&, const Float4x4&)>());
     }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    static const unsigned s_batchLaneCount = 4;
+    static const unsigned s_minGroupsPerTask = 16;
+
+    #if defined(HAS_SSE_INSTRUCTIONS)
+        using LaneVector = __m128;
+        static LaneVector LaneLoad(const float* lanes) { return _mm_load_ps(lanes); }
+        static void LaneStore(float* lanes, LaneVector v) { _mm_store_ps(lanes, v); }
+        static LaneVector LaneSplat(float f) { return _mm_set1_ps(f); }
+        static LaneVector LaneAdd(LaneVector a, LaneVector b) { return _mm_add_ps(a, b); }
+        static LaneVector LaneSub(LaneVector a, LaneVector b) { return _mm_sub_ps(a, b); }
+        static LaneVector LaneMul(LaneVector a, LaneVector b) { return _mm_mul_ps(a, b); }
+    #else
+        struct LaneVector { float _v[s_batchLaneCount]; };
+        static LaneVector LaneLoad(const float* lanes) { LaneVector r; for (unsigned l=0; l<s_batchLaneCount; ++l) r._v[l] = lanes[l]; return r; }
+        static void LaneStore(float* lanes, LaneVector v) { for (unsigned l=0; l<s_batchLaneCount; ++l) lanes[l] = v._v[l]; }
+        static LaneVector LaneSplat(float f) { LaneVector r; for (unsigned l=0; l<s_batchLaneCount; ++l) r._v[l] = f; return r; }
+        static LaneVector LaneAdd(LaneVector a, LaneVector b) { for (unsigned l=0; l<s_batchLaneCount; ++l) a._v[l] += b._v[l]; return a; }
+        static LaneVector LaneSub(LaneVector a, LaneVector b) { for (unsigned l=0; l<s_batchLaneCount; ++l) a._v[l] -= b._v[l]; return a; }
+        static LaneVector LaneMul(LaneVector a, LaneVector b) { for (unsigned l=0; l<s_batchLaneCount; ++l) a._v[l] *= b._v[l]; return a; }
+    #endif
+
+        // One node for 4 instances; element (r,c) of instance "l" is _e[r*4+c][l]
+    struct alignas(16) MatrixLanes { float _e[16][s_batchLaneCount]; };
+
+    static void LoadLanes(LaneVector dst[16], const MatrixLanes& src)
+    {
+        for (unsigned c=0; c<16; ++c) dst[c] = LaneLoad(src._e[c]);
+    }
+
+    static void SplatLanes(LaneVector dst[], const Float4x4& src, unsigned rowCount)
+    {
+        for (unsigned c=0; c<rowCount*4; ++c) dst[c] = LaneSplat(src(c/4, c%4));
+    }
+
+        // Load "count" consecutive floats from each lane's parameter block, returning one vector per float
+    static void GatherLanes(LaneVector dst[], const void* const laneBlocks[], unsigned offset, unsigned count)
+    {
+        auto* src0 = (const float*)PtrAdd(laneBlocks[0], offset), *src1 = (const float*)PtrAdd(laneBlocks[1], offset);
+        auto* src2 = (const float*)PtrAdd(laneBlocks[2], offset), *src3 = (const float*)PtrAdd(laneBlocks[3], offset);
+        #if defined(HAS_SSE_INSTRUCTIONS)
+            if (count == 4) {
+                auto r0 = _mm_loadu_ps(src0), r1 = _mm_loadu_ps(src1), r2 = _mm_loadu_ps(src2), r3 = _mm_loadu_ps(src3);
+                _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+                dst[0] = r0; dst[1] = r1; dst[2] = r2; dst[3] = r3;
+                return;
+            }
+            for (unsigned c=0; c<count; ++c)
+                dst[c] = _mm_set_ps(src3[c], src2[c], src1[c], src0[c]);
+        #else
+            for (unsigned c=0; c<count; ++c)
+                dst[c] = LaneVector { src0[c], src1[c], src2[c], src3[c] };
+        #endif
+    }
+
+        // dst = parent * local, for a general 4x4 local
+    static void CombineLanes_General(MatrixLanes& dst, const LaneVector p[16], const LaneVector l[16])
+    {
+        for (unsigned r=0; r<4; ++r)
+            for (unsigned c=0; c<4; ++c) {
+                auto v = LaneMul(p[r*4+0], l[0*4+c]);
+                v = LaneAdd(v, LaneMul(p[r*4+1], l[1*4+c]));
+                v = LaneAdd(v, LaneMul(p[r*4+2], l[2*4+c]));
+                v = LaneAdd(v, LaneMul(p[r*4+3], l[3*4+c]));
+                LaneStore(dst._e[r*4+c], v);
+            }
+    }
+
+        // dst = parent * local, where the local has a bottom row of (0,0,0,1) and only the top 3 rows are given
+    static void CombineLanes_Affine(MatrixLanes& dst, const LaneVector p[16], const LaneVector l[12])
+    {
+        for (unsigned r=0; r<4; ++r)
+            for (unsigned c=0; c<4; ++c) {
+                auto v = LaneMul(p[r*4+0], l[0*4+c]);
+                v = LaneAdd(v, LaneMul(p[r*4+1], l[1*4+c]));
+                v = LaneAdd(v, LaneMul(p[r*4+2], l[2*4+c]));
+                if (c == 3) v = LaneAdd(v, p[r*4+3]);
+                LaneStore(dst._e[r*4+c], v);
+            }
+    }
+
+        //
+        //  The local transform for an Affine step is built up in "acc" (top 3 rows of an affine matrix) by
+        //  calculating acc = acc * op for each op in turn. "accIsIdentity" lets the first op just be copied in.
+        //
+    static void AccumulateTranslation(LaneVector acc[12], bool& accIsIdentity, const LaneVector t[3])
+    {
+        if (accIsIdentity) {
+            auto zero = LaneSplat(0.f), one = LaneSplat(1.f);
+            for (unsigned r=0; r<3; ++r) {
+                for (unsigned c=0; c<3; ++c) acc[r*4+c] = (r==c) ? one : zero;
+                acc[r*4+3] = t[r];
+            }
+            accIsIdentity = false;
+            return;
+        }
+        for (unsigned r=0; r<3; ++r) {
+            auto v = LaneAdd(acc[r*4+3], LaneMul(acc[r*4+0], t[0]));
+            v = LaneAdd(v, LaneMul(acc[r*4+1], t[1]));
+            acc[r*4+3] = LaneAdd(v, LaneMul(acc[r*4+2], t[2]));
+        }
+    }
+
+        // "rot" is a 3x3 matrix, given as rot[row*3+column]
+    static void AccumulateRotation(LaneVector acc[12], bool& accIsIdentity, const LaneVector rot[9])
+    {
+        if (accIsIdentity) {
+            auto zero = LaneSplat(0.f);
+            for (unsigned r=0; r<3; ++r) {
+                for (unsigned c=0; c<3; ++c) acc[r*4+c] = rot[r*3+c];
+                acc[r*4+3] = zero;
+            }
+            accIsIdentity = false;
+            return;
+        }
+        for (unsigned r=0; r<3; ++r) {
+            auto a0 = acc[r*4+0], a1 = acc[r*4+1], a2 = acc[r*4+2];
+            for (unsigned c=0; c<3; ++c)
+                acc[r*4+c] = LaneAdd(LaneAdd(LaneMul(a0, rot[0*3+c]), LaneMul(a1, rot[1*3+c])), LaneMul(a2, rot[2*3+c]));
+        }
+    }
+
+    static void AccumulateScale(LaneVector acc[12], bool& accIsIdentity, const LaneVector s[3])
+    {
+        if (accIsIdentity) {
+            auto zero = LaneSplat(0.f);
+            for (unsigned r=0; r<3; ++r)
+                for (unsigned c=0; c<4; ++c) acc[r*4+c] = (r==c) ? s[r] : zero;
+            accIsIdentity = false;
+            return;
+        }
+        for (unsigned r=0; r<3; ++r)
+            for (unsigned c=0; c<3; ++c)
+                acc[r*4+c] = LaneMul(acc[r*4+c], s[c]);
+    }
+
+    static void AccumulateAffine(LaneVector acc[12], bool& accIsIdentity, const Float4x4& m)
+    {
+        if (accIsIdentity) {
+            SplatLanes(acc, m, 3);
+            accIsIdentity = false;
+            return;
+        }
+        LaneVector l[12];
+        SplatLanes(l, m, 3);
+        for (unsigned r=0; r<3; ++r) {
+            auto a0 = acc[r*4+0], a1 = acc[r*4+1], a2 = acc[r*4+2], a3 = acc[r*4+3];
+            for (unsigned c=0; c<4; ++c) {
+                auto v = LaneAdd(LaneAdd(LaneMul(a0, l[0*4+c]), LaneMul(a1, l[1*4+c])), LaneMul(a2, l[2*4+c]));
+                acc[r*4+c] = (c == 3) ? LaneAdd(v, a3) : v;
+            }
+        }
+    }
+
+    static void AccumulateOp(
+        LaneVector acc[12], bool& accIsIdentity,
+        const BatchedTransformationMachine::Op& op, const void* const laneBlocks[], IteratorRange<const Float4x4*> matrices)
+    {
+        using OpType = BatchedTransformationMachine::OpType;
+        switch (op._type) {
+        case OpType::StaticTransform:
+            AccumulateAffine(acc, accIsIdentity, matrices[op._operand]);
+            break;
+
+        case OpType::Translate_Parameter:
+        case OpType::ArbitraryScale_Parameter:
+            {
+                LaneVector v[3];
+                GatherLanes(v, laneBlocks, op._operand, 3);
+                if (op._type == OpType::Translate_Parameter) AccumulateTranslation(acc, accIsIdentity, v);
+                else AccumulateScale(acc, accIsIdentity, v);
+            }
+            break;
+
+        case OpType::UniformScale_Parameter:
+            {
+                LaneVector v[3];
+                GatherLanes(v, laneBlocks, op._operand, 1);
+                v[1] = v[2] = v[0];
+                AccumulateScale(acc, accIsIdentity, v);
+            }
+            break;
+
+        case OpType::RotateQuaternion_Parameter:
+            {
+                    // Same as cml::matrix_rotation_quaternion, but for 4 quaternions at once (scalar first ordering)
+                LaneVector q[4];
+                GatherLanes(q, laneBlocks, op._operand, 4);
+                auto w = q[0], x = q[1], y = q[2], z = q[3];
+                auto x2 = LaneAdd(x, x), y2 = LaneAdd(y, y), z2 = LaneAdd(z, z);
+                auto xx2 = LaneMul(x, x2), yy2 = LaneMul(y, y2), zz2 = LaneMul(z, z2);
+                auto xy2 = LaneMul(x, y2), yz2 = LaneMul(y, z2), zx2 = LaneMul(z, x2);
+                auto xw2 = LaneMul(w, x2), yw2 = LaneMul(w, y2), zw2 = LaneMul(w, z2);
+                auto one = LaneSplat(1.f);
+                LaneVector rot[9] {
+                    LaneSub(LaneSub(one, yy2), zz2),    LaneSub(xy2, zw2),                  LaneAdd(zx2, yw2),
+                    LaneAdd(xy2, zw2),                  LaneSub(LaneSub(one, zz2), xx2),    LaneSub(yz2, xw2),
+                    LaneSub(zx2, yw2),                  LaneAdd(yz2, xw2),                  LaneSub(LaneSub(one, xx2), yy2)
+                };
+                AccumulateRotation(acc, accIsIdentity, rot);
+            }
+            break;
+
+        case OpType::RotateX_Parameter:
+        case OpType::RotateY_Parameter:
+        case OpType::RotateZ_Parameter:
+        case OpType::RotateAxisAngle_Parameter:
+            {
+                    // These are uncommon in animated skeletons, so the rotation matrices are just built per instance
+                bool axisAngle = op._type == OpType::RotateAxisAngle_Parameter;
+                alignas(16) float rotTemp[9][s_batchLaneCount];
+                for (unsigned l=0; l<s_batchLaneCount; ++l) {
+                    auto* src = (const float*)PtrAdd(laneBlocks[l], op._operand);
+                    Float3x3 rot;
+                    auto angle = Deg2Rad(axisAngle ? src[3] : src[0]);
+                    switch (op._type) {
+                    case OpType::RotateX_Parameter: rot = Truncate3x3(AsFloat4x4(RotationX(angle))); break;
+                    case OpType::RotateY_Parameter: rot = Truncate3x3(AsFloat4x4(RotationY(angle))); break;
+                    case OpType::RotateZ_Parameter: rot = Truncate3x3(AsFloat4x4(RotationZ(angle))); break;
+                    default: rot = MakeRotationMatrix(Float3(src[0], src[1], src[2]), angle); break;
+                    }
+                    for (unsigned c=0; c<9; ++c) rotTemp[c][l] = rot(c/3, c%3);
+                }
+                LaneVector rot[9];
+                for (unsigned c=0; c<9; ++c) rot[c] = LaneLoad(rotTemp[c]);
+                AccumulateRotation(acc, accIsIdentity, rot);
+            }
+            break;
+
+        case OpType::TransformFloat4x4_Parameter:
+            assert(0);      // only used in General steps
+            break;
+        }
+    }
+
+    static void WriteOutputLanes(IteratorRange<Float4x4*> result, unsigned firstIdx, unsigned stride, unsigned laneCount, const MatrixLanes& src)
+    {
+        #if defined(HAS_SSE_INSTRUCTIONS)
+            if (Float4x4::array_layout == cml::row_major_c) {
+                    // transpose each row from "one element for 4 instances" to "4 elements for one instance"
+                for (unsigned r=0; r<4; ++r) {
+                    auto c0 = _mm_load_ps(src._e[r*4+0]), c1 = _mm_load_ps(src._e[r*4+1]);
+                    auto c2 = _mm_load_ps(src._e[r*4+2]), c3 = _mm_load_ps(src._e[r*4+3]);
+                    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+                    const __m128 rows[] { c0, c1, c2, c3 };
+                    for (unsigned l=0; l<laneCount; ++l)
+                        _mm_storeu_ps(&result[firstIdx+l*stride](r, 0), rows[l]);
+                }
+                return;
+            }
+        #endif
+        for (unsigned l=0; l<laneCount; ++l) {
+            auto& m = result[firstIdx+l*stride];
+            for (unsigned c=0; c<16; ++c) m(c/4, c%4) = src._e[c][l];
+        }
+    }
+
+    void BatchedTransformationMachine::EvaluateGroups(
+        IteratorRange<Float4x4*> result, IteratorRange<const void*> parameterBlocks, size_t parameterBlockStride,
+        unsigned instanceCount, unsigned groupBegin, unsigned groupEnd) const
+    {
+        std::vector<MatrixLanes> nodes(_steps.size());
+        auto outputCount = (unsigned)_outputs.size();
+        auto matrices = MakeIteratorRange(_matrices);
+
+        for (unsigned g=groupBegin; g<groupEnd; ++g) {
+            auto firstInstance = g*s_batchLaneCount;
+            auto laneCount = std::min(s_batchLaneCount, instanceCount-firstInstance);
+
+                // Partial groups just repeat the last instance in the unused lanes
+            const void* laneBlocks[s_batchLaneCount];
+            for (unsigned l=0; l<s_batchLaneCount; ++l)
+                laneBlocks[l] = PtrAdd(parameterBlocks.begin(), (firstInstance+std::min(l, laneCount-1))*parameterBlockStride);
+
+            for (unsigned s=0; s<(unsigned)_steps.size(); ++s) {
+                const auto& step = _steps[s];
+                LaneVector parent[16];
+                if (step._parent & s_constantNodeFlag) {
+                    SplatLanes(parent, _matrices[step._parent & ~s_constantNodeFlag], 4);
+                } else {
+                    assert(step._parent < s);
+                    LoadLanes(parent, nodes[step._parent]);
+                }
+
+                if (step._type == StepType::General) {
+                    assert(step._opCount == 1);
+                    const auto& op = _ops[step._firstOp];
+                    LaneVector local[16];
+                    if (op._type == OpType::StaticTransform) {
+                        SplatLanes(local, _matrices[op._operand], 4);
+                    } else {
+                        assert(op._type == OpType::TransformFloat4x4_Parameter);
+                        alignas(16) float temp[16][s_batchLaneCount];
+                        for (unsigned l=0; l<s_batchLaneCount; ++l) {
+                            const auto& m = *(const Float4x4*)PtrAdd(laneBlocks[l], op._operand);
+                            for (unsigned c=0; c<16; ++c) temp[c][l] = m(c/4, c%4);
+                        }
+                        for (unsigned c=0; c<16; ++c) local[c] = LaneLoad(temp[c]);
+                    }
+                    CombineLanes_General(nodes[s], parent, local);
+                    continue;
+                }
+
+                if (step._type == StepType::AffineGeoSpace) {
+                    LaneVector t[3];
+                    GatherLanes(t, laneBlocks, step._operand, 3);
+                    for (unsigned r=0; r<3; ++r) parent[r*4+3] = t[r];
+                }
+
+                LaneVector acc[12];
+                bool accIsIdentity = true;
+                for (unsigned o=step._firstOp; o<step._firstOp+step._opCount; ++o)
+                    AccumulateOp(acc, accIsIdentity, _ops[o], laneBlocks, matrices);
+
+                if (!accIsIdentity) {
+                    CombineLanes_Affine(nodes[s], parent, acc);
+                } else {
+                    for (unsigned c=0; c<16; ++c) LaneStore(nodes[s]._e[c], parent[c]);
+                }
+            }
+
+            for (unsigned o=0; o<outputCount; ++o) {
+                auto node = _outputs[o];
+                if (node & s_constantNodeFlag) {
+                    const auto& m = _matrices[node & ~s_constantNodeFlag];
+                    for (unsigned l=0; l<laneCount; ++l)
+                        result[(firstInstance+l)*outputCount+o] = m;
+                } else
+                    WriteOutputLanes(result, firstInstance*outputCount+o, outputCount, laneCount, nodes[node]);
+            }
+        }
+    }
+
+    void BatchedTransformationMachine::GenerateOutputTransforms(
+        IteratorRange<Float4x4*>            result,
+        IteratorRange<const void*>          parameterBlocks,
+        size_t                              parameterBlockStride,
+        unsigned                            instanceCount,
+        Utility::ThreadPool*                threadPool) const
+    {
+        if (!instanceCount) return;
+        if (result.size() < instanceCount*_outputs.size())
+            Throw(::Exceptions::BasicLabel("Output buffer to BatchedTransformationMachine::GenerateOutputTransforms is too small"));
+        if (_minimumParameterBlockSize && parameterBlocks.size() < (instanceCount-1)*parameterBlockStride+_minimumParameterBlockSize)
+            Throw(::Exceptions::BasicLabel("Parameter blocks passed to BatchedTransformationMachine::GenerateOutputTransforms are too small"));
+
+        unsigned groupCount = (instanceCount+s_batchLaneCount-1)/s_batchLaneCount;
+        unsigned taskCount = 1;
+        if (threadPool && threadPool->IsGood() && groupCount >= 2*s_minGroupsPerTask)
+            taskCount = std::min(groupCount/s_minGroupsPerTask, threadPool->GetThreadContext()+1);
+
+        auto taskFn = [&](unsigned t) {
+            EvaluateGroups(
+                result, parameterBlocks, parameterBlockStride, instanceCount,
+                groupCount*t/taskCount, groupCount*(t+1)/taskCount);
+        };
+
+        if (taskCount > 1) {
+            ParallelFor(*threadPool, taskCount, taskFn);
+        } else
+            taskFn(0);
+    }
+
+    static bool IsAffine(const Float4x4& m)
+    {
+        return m(3,0) == 0.f && m(3,1) == 0.f && m(3,2) == 0.f && m(3,3) == 1.f;
+    }
+
+    BatchedTransformationMachine::BatchedTransformationMachine(IteratorRange<const uint32_t*> commandStream, unsigned outputMatrixCount)
+    {
+        const uint32_t identityNode = s_constantNodeFlag | 0;
+        _matrices.push_back(Identity<Float4x4>());
+        _outputs.resize(outputMatrixCount, identityNode);
+
+            // "foldable" nodes are referenced only by that stack entry, so further transforms can be merged into
+            // them directly. Foldable steps are always the most recently added step, so their ops are at the end of _ops
+        struct WorkingNode { uint32_t _node; bool _foldable; };
+        WorkingNode workingStack[MaxSkeletonMachineDepth];
+        WorkingNode* working = workingStack;
+        *working = { identityNode, false };
+
+        auto addStep = [&](StepType type, uint32_t operand, bool foldable) {
+            _steps.push_back({type, working->_node, operand, (uint32_t)_ops.size(), 0});
+            *working = { uint32_t(_steps.size()-1), foldable };
+        };
+
+        auto addStatic = [&](auto&& combineIntoRHS) {
+            if (working->_node & s_constantNodeFlag) {
+                    // parent is known, so this node is also a constant
+                if (working->_foldable) {
+                    combineIntoRHS(_matrices[working->_node & ~s_constantNodeFlag]);
+                } else {
+                    auto m = _matrices[working->_node & ~s_constantNodeFlag];
+                    combineIntoRHS(m);
+                    _matrices.push_back(m);
+                    *working = { uint32_t(_matrices.size()-1) | s_constantNodeFlag, true };
+                }
+                return;
+            }
+
+            if (working->_foldable) {
+                auto& step = _steps[working->_node];
+                assert(working->_node == _steps.size()-1 && step._firstOp+step._opCount == _ops.size());
+                if (step._opCount && _ops.back()._type == OpType::StaticTransform) {
+                    auto m = _matrices[_ops.back()._operand];
+                    combineIntoRHS(m);
+                    if (IsAffine(m)) {
+                        _matrices[_ops.back()._operand] = m;
+                        return;
+                    }
+                }
+            }
+
+            auto local = Identity<Float4x4>();
+            combineIntoRHS(local);
+            _matrices.push_back(local);
+            if (!IsAffine(local)) {
+                addStep(StepType::General, 0, false);
+                _ops.push_back({OpType::StaticTransform, uint32_t(_matrices.size()-1)});
+                _steps.back()._opCount = 1;
+                return;
+            }
+            if (!working->_foldable)
+                addStep(StepType::Affine, 0, true);
+            _ops.push_back({OpType::StaticTransform, uint32_t(_matrices.size()-1)});
+            ++_steps.back()._opCount;
+        };
+
+        auto addParameter = [&](OpType type, uint32_t parameterOffset, size_t parameterSize) {
+            _minimumParameterBlockSize = std::max(_minimumParameterBlockSize, parameterOffset+parameterSize);
+            if (type == OpType::TransformFloat4x4_Parameter) {
+                addStep(StepType::General, 0, false);
+            } else if (!working->_foldable || (working->_node & s_constantNodeFlag))
+                addStep(StepType::Affine, 0, true);
+            _ops.push_back({type, parameterOffset});
+            ++_steps.back()._opCount;
+        };
+
+        auto writeOutput = [&](uint32_t outputIndex, uint32_t node, const char* cmdName) {
+            if (outputIndex < _outputs.size()) {
+                _outputs[outputIndex] = node;
+            } else
+                Log(Warning) << "Warning -- bad output matrix index in " << cmdName << " (" << outputIndex << ")" << std::endl;
+        };
+
+        for (auto i=commandStream.cbegin(); i!=commandStream.cend();) {
+            auto commandIndex = *i++;
+            auto* floats = reinterpret_cast<const float*>(AsPointer(i));
+            switch ((TransformCommand)commandIndex) {
+            case TransformCommand::PushLocalToWorld:
+                if ((working+1) >= &workingStack[dimof(workingStack)])
+                    Throw(::Exceptions::BasicLabel("Exceeded maximum stack depth in BatchedTransformationMachine"));
+                working->_foldable = false;
+                *(working+1) = *working;
+                ++working;
+                break;
+
+            case TransformCommand::PopLocalToWorld:
+                {
+                    auto popCount = *i++;
+                    if (working < workingStack+popCount)
+                        Throw(::Exceptions::BasicLabel("Stack underflow in BatchedTransformationMachine"));
+                    working -= popCount;
+                }
+                break;
+
+            case TransformCommand::TransformFloat4x4_Static:
+                {
+                    const Float4x4& transformMatrix = *reinterpret_cast<const Float4x4*>(floats);
+                    addStatic([&](Float4x4& m) { m = Combine(transformMatrix, m); });
+                    i += 16;
+                }
+                break;
+
+            case TransformCommand::Translate_Static:
+                addStatic([&](Float4x4& m) { Combine_IntoRHS(AsFloat3(floats), m); });
+                i += 3;
+                break;
+
+            case TransformCommand::RotateX_Static:
+                addStatic([&](Float4x4& m) { Combine_IntoRHS(RotationX(Deg2Rad(floats[0])), m); });
+                i++;
+                break;
+
+            case TransformCommand::RotateY_Static:
+                addStatic([&](Float4x4& m) { Combine_IntoRHS(RotationY(Deg2Rad(floats[0])), m); });
+                i++;
+                break;
+
+            case TransformCommand::RotateZ_Static:
+                addStatic([&](Float4x4& m) { Combine_IntoRHS(RotationZ(Deg2Rad(floats[0])), m); });
+                i++;
+                break;
+
+            case TransformCommand::RotateAxisAngle_Static:
+                addStatic([&](Float4x4& m) { Combine_IntoRHS(ArbitraryRotation(AsFloat3(floats), Deg2Rad(floats[3])), m); });
+                i += 4;
+                break;
+
+            case TransformCommand::RotateQuaternion_Static:
+                addStatic([&](Float4x4& m) { Combine_IntoRHS(*reinterpret_cast<const Quaternion*>(floats), m); });
+                i += 4;
+                break;
+
+            case TransformCommand::UniformScale_Static:
+                addStatic([&](Float4x4& m) { Combine_IntoRHS(UniformScale(floats[0]), m); });
+                i++;
+                break;
+
+            case TransformCommand::ArbitraryScale_Static:
+                addStatic([&](Float4x4& m) { Combine_IntoRHS(ArbitraryScale(AsFloat3(floats)), m); });
+                i += 3;
+                break;
+
+            case TransformCommand::TransformFloat4x4_Parameter:     addParameter(OpType::TransformFloat4x4_Parameter, *i++, sizeof(Float4x4)); break;
+            case TransformCommand::Translate_Parameter:             addParameter(OpType::Translate_Parameter, *i++, sizeof(Float3)); break;
+            case TransformCommand::RotateX_Parameter:               addParameter(OpType::RotateX_Parameter, *i++, sizeof(float)); break;
+            case TransformCommand::RotateY_Parameter:               addParameter(OpType::RotateY_Parameter, *i++, sizeof(float)); break;
+            case TransformCommand::RotateZ_Parameter:               addParameter(OpType::RotateZ_Parameter, *i++, sizeof(float)); break;
+            case TransformCommand::RotateAxisAngle_Parameter:       addParameter(OpType::RotateAxisAngle_Parameter, *i++, sizeof(Float4)); break;
+            case TransformCommand::RotateQuaternion_Parameter:      addParameter(OpType::RotateQuaternion_Parameter, *i++, sizeof(Quaternion)); break;
+            case TransformCommand::UniformScale_Parameter:          addParameter(OpType::UniformScale_Parameter, *i++, sizeof(float)); break;
+            case TransformCommand::ArbitraryScale_Parameter:        addParameter(OpType::ArbitraryScale_Parameter, *i++, sizeof(Float3)); break;
+
+            case TransformCommand::Translate_ParameterGeoSpace:
+                {
+                    uint32_t parameterOffset = *i++;
+                    _minimumParameterBlockSize = std::max(_minimumParameterBlockSize, parameterOffset+sizeof(Float3));
+                    addStep(StepType::AffineGeoSpace, parameterOffset, true);
+                }
+                break;
+
+            case TransformCommand::WriteOutputMatrix:
+                working->_foldable = false;
+                writeOutput(*i++, working->_node, "WriteOutputMatrix");
+                break;
+
+            case TransformCommand::TransformFloat4x4AndWrite_Static:
+                {
+                    uint32_t outputIndex = *i++;
+                    const Float4x4& transformMatrix = *reinterpret_cast<const Float4x4*>(AsPointer(i));
+                    i += 16;
+                        // evaluate as if on a temporary copy of the working node, which is then discarded
+                    auto saved = working->_node;
+                    working->_foldable = false;
+                    addStatic([&](Float4x4& m) { m = Combine(transformMatrix, m); });
+                    writeOutput(outputIndex, working->_node, "TransformFloat4x4AndWrite_Static");
+                    *working = { saved, false };
+                }
+                break;
+
+            case TransformCommand::TransformFloat4x4AndWrite_Parameter:
+                {
+                    uint32_t outputIndex = *i++;
+                    uint32_t parameterOffset = *i++;
+                    auto saved = working->_node;
+                    working->_foldable = false;
+                    addParameter(OpType::TransformFloat4x4_Parameter, parameterOffset, sizeof(Float4x4));
+                    writeOutput(outputIndex, working->_node, "TransformFloat4x4AndWrite_Parameter");
+                    *working = { saved, false };
+                }
+                break;
+
+            case TransformCommand::BindingPoint_0:
+            case TransformCommand::BindingPoint_1:
+            case TransformCommand::BindingPoint_2:
+            case TransformCommand::BindingPoint_3:
+                // skip over the binding point and treat the static defaults as just normal statics
+                i += 2;
+                break;
+
+            case TransformCommand::Comment:
+                i+=64/4;
+                break;
+            }
+        }
+
+            // Drop steps that don't contribute to any output. Parents always come before their children, so
+            // we can find everything that is used in a single reverse pass
+        std::vector<bool> used(_steps.size(), false);
+        for (auto o:_outputs)
+            if (!(o & s_constantNodeFlag)) used[o] = true;
+        for (auto s=_steps.size(); s-- > 0;)
+            if (used[s] && !(_steps[s]._parent & s_constantNodeFlag))
+                used[_steps[s]._parent] = true;
+
+        std::vector<uint32_t> remapping(_steps.size(), ~0u);
+        unsigned compactedCount = 0;
+        for (unsigned s=0; s<_steps.size(); ++s) {
+            if (!used[s]) continue;
+            auto step = _steps[s];
+            if (!(step._parent & s_constantNodeFlag))
+                step._parent = remapping[step._parent];
+            remapping[s] = compactedCount;
+            _steps[compactedCount++] = step;
+        }
+        _steps.resize(compactedCount);
+        for (auto& o:_outputs)
+            if (!(o & s_constantNodeFlag)) o = remapping[o];
+    }
+
+    BatchedTransformationMachine::BatchedTransformationMachine() = default;
+    BatchedTransformationMachine::~BatchedTransformationMachine() = default;
+    BatchedTransformationMachine::BatchedTransformationMachine(BatchedTransformationMachine&&) = default;
+    BatchedTransformationMachine& BatchedTransformationMachine::operator=(BatchedTransformationMachine&&) = default;
+
 	void CalculateParentPointers(
 		IteratorRange<uint32_t*>					result,
 		IteratorRange<const uint32_t*>				commandStream)
@@ -12,6 +12,8 @@
 #include <vector>
 #include <functional>
 
+namespace Utility { class ThreadPool; }
+
 namespace RenderCore { namespace Assets
 {
     enum class TransformCommand : uint32_t
@@ -80,6 +82,85 @@ namespace RenderCore { namespace Assets
 
     const uint32_t* NextTransformationCommand(const uint32_t*);
 
+    /// <summary>Pre-compiled form of a transformation command stream, for evaluating many instances at once</summary>
+    /// The command stream is flattened into a list of steps. Each step calculates one node from a parent node and a
+    /// short chain of local transforms (typically the translation, rotation & scale of a single joint), so push & pop
+    /// are resolved into explicit parent indices. Runs of static transforms are folded into single matrices, anything
+    /// that doesn't depend on the parameter block is evaluated once on construction, and steps that don't contribute to
+    /// any output are dropped.
+    ///
+    /// GenerateOutputTransforms() evaluates the steps for many instances of the same skeleton, each with its own parameter
+    /// block. Instances are processed 4 at a time in structure-of-arrays form (ie, each SIMD operation works on the same
+    /// matrix element for 4 different instances), and groups of instances are distributed across the thread pool.
+    ///
+    /// Results match RenderCore::Assets::GenerateOutputTransforms(), barring small floating point differences due to the
+    /// reordering of static transforms.
+    class BatchedTransformationMachine
+    {
+    public:
+        /// Results for instance "i" are written to result[i*GetOutputMatrixCount()] onwards. The parameter block for
+        /// instance "i" starts at PtrAdd(parameterBlocks.begin(), i*parameterBlockStride)
+        void GenerateOutputTransforms(
+            IteratorRange<Float4x4*>            result,
+            IteratorRange<const void*>          parameterBlocks,
+            size_t                              parameterBlockStride,
+            unsigned                            instanceCount,
+            Utility::ThreadPool*                threadPool = nullptr) const;
+
+        unsigned GetOutputMatrixCount() const { return (unsigned)_outputs.size(); }
+        unsigned GetStepCount() const { return (unsigned)_steps.size(); }
+        size_t GetMinimumParameterBlockSize() const { return _minimumParameterBlockSize; }
+
+        BatchedTransformationMachine(IteratorRange<const uint32_t*> commandStream, unsigned outputMatrixCount);
+        BatchedTransformationMachine();
+        ~BatchedTransformationMachine();
+        BatchedTransformationMachine(BatchedTransformationMachine&&);
+        BatchedTransformationMachine& operator=(BatchedTransformationMachine&&);
+
+        enum class OpType : uint32_t
+        {
+            StaticTransform,
+            TransformFloat4x4_Parameter, Translate_Parameter,
+            RotateX_Parameter, RotateY_Parameter, RotateZ_Parameter, RotateAxisAngle_Parameter, RotateQuaternion_Parameter,
+            UniformScale_Parameter, ArbitraryScale_Parameter
+        };
+
+        struct Op
+        {
+            OpType      _type;
+            uint32_t    _operand;       // index into _matrices for StaticTransform, otherwise offset into the parameter block
+        };
+
+        enum class StepType : uint32_t
+        {
+            Affine,             // node = parent * (product of the ops), where every op is affine
+            AffineGeoSpace,     // as Affine, but the translation of the parent is first replaced with the Float3 parameter at _operand
+            General             // node = parent * (single op, which may not be affine)
+        };
+
+        struct Step
+        {
+            StepType    _type;
+            uint32_t    _parent;        // node reference (see s_constantNodeFlag)
+            uint32_t    _operand;
+            uint32_t    _firstOp, _opCount;
+        };
+
+        /// Node references with this bit set refer to a precalculated matrix in _matrices, otherwise they are step indices
+        static const uint32_t s_constantNodeFlag = 0x80000000u;
+
+    private:
+        std::vector<Step>       _steps;
+        std::vector<Op>         _ops;
+        std::vector<Float4x4>   _matrices;          // static local transforms & precalculated constant nodes
+        std::vector<uint32_t>   _outputs;           // node reference for each output matrix
+        size_t                  _minimumParameterBlockSize = 0;
+
+        void EvaluateGroups(
+            IteratorRange<Float4x4*> result, IteratorRange<const void*> parameterBlocks, size_t parameterBlockStride,
+            unsigned instanceCount, unsigned groupBegin, unsigned groupEnd) const;
+    };
+
 	/// <summary>For each output marker, calculate the immediate parent</summary>
 	/// The parent of a given marker is defines as the first marker we encounter if we traverse back through
 	/// the set of commands that affect the state of that given marker.
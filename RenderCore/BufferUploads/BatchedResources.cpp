@@ -7,6 +7,7 @@
 #include "ResourceUploadHelper.h"
 #include "../../OSServices/Log.h"
 #include "../../Utility/HeapUtils.h"
+#include <limits>
 
 namespace RenderCore { namespace BufferUploads
 {
@@ -31,6 +32,7 @@ namespace RenderCore { namespace BufferUploads
 		const ResourceDesc&     GetPrototype() const { return _prototype; }
 
 		void                    TickDefrag() override;
+		void                    SetDefragPolicy(const BatchedResourcesDefragPolicy&) override;
 
 		//////////// event lists //////////////
 		IteratorRange<const Event_ResourceReposition*>	EventList_Get(EventListID id) override;
@@ -57,6 +59,7 @@ namespace RenderCore { namespace BufferUploads
 
 			//  Active defrag stuff...
 		std::unique_ptr<ActiveReposition> _activeDefrag;
+		BatchedResourcesDefragPolicy _defragPolicy;		// protected by _lock
 
 		mutable std::atomic<unsigned>   _recentDeviceCreateCount;
 		std::atomic<size_t>             _totalCreateCount;
@@ -386,139 +389,207 @@ namespace RenderCore { namespace BufferUploads
 			return;
 		}
 
-		const unsigned minWeightToDoSomething = _prototype._linearBufferDesc._sizeInBytes / 4; // only do something when there's X byte difference between total available space and the largest block
-		const unsigned largestBlockThreshold = _prototype._linearBufferDesc._sizeInBytes / 8;
-		unsigned bestWeight = minWeightToDoSomething;
-		unsigned largestBlockForHeapDrain = 0;
-		HeapedResource* bestHeapForCompression = nullptr;
-		std::vector<RepositionStep> compression;
+		DefragOperation operation;
+		HeapedResource* srcHeap = nullptr;
+		{
+			ScopedLock(_lock);
+			if (!_defragPolicy._enabled) return;
 
-		const unsigned heapDrainThreshold = _prototype._linearBufferDesc._sizeInBytes / 4;
+			std::vector<DefragCandidateHeap> candidates;
+			candidates.reserve(_heaps.size());
+			for (const auto& h:_heaps) {
+				assert(!h->_lockedForDefrag);		// only the active defrag locks heaps, and we've just checked that there isn't one
+				candidates.push_back({&h->_heap, h->_allocatedSpace, h->_hashLastDefrag});
+			}
 
-		HeapedResource* bestIncrementalDefragHeap = nullptr;
-		std::vector<RepositionStep> bestIncrementalDefragSteps;
-		const unsigned minDefragQuant = 16*1024;
-		const unsigned minHeapCountForHeapDrain = 8;
-		int bestIncrementalDefragQuant = minDefragQuant;
+			operation = PlanDefragOperation(candidates, _defragPolicy);
+			if (operation._type == DefragOperation::Type::None) return;
 
-		{
-			ScopedLock(_lock);
-			for (auto i=_heaps.begin(); i!=_heaps.end(); ++i) {
-
-				// evaluate candidacy for a small incremental move
-				if (((*i)->_size - (*i)->_allocatedSpace) > bestIncrementalDefragQuant) {
-
-					// Check a hash value to ensure we're not triggering a defrag for the same heap over and over
-					// This can happens when none of the blocks from the defrag operation actually moved; meaning it most likely remains
-					// the most optimal defrag operation
-					if ((*i)->_heap.CalculateHash() == (*i)->_hashLastDefrag)
-						continue;
-
-					auto steps = (*i)->_heap.CalculateIncrementalDefragCandidate();
-					if (!steps._steps.empty()) {
-						int increase = steps._newLargestFreeBlock - (int)(*i)->_heap.CalculateLargestFreeBlock();
-						if (increase > bestIncrementalDefragQuant) {
-							bestIncrementalDefragQuant = increase;
-							bestIncrementalDefragSteps = std::move(steps._steps);
-							bestIncrementalDefragHeap = i->get();
-						}
-					}
-				}
+			// set _lockedForDefrag before we exit _lock, because this prevents destroying this heap
+			srcHeap = _heaps[operation._heapIndex].get();
+			assert(srcHeap->_heapResource);
+			auto oldLocked = srcHeap->_lockedForDefrag.exchange(true);
+			assert(!oldLocked); (void)oldLocked;
 
-				auto largestBlock = (*i)->_heap.CalculateLargestFreeBlock();
-				if ((*i)->_allocatedSpace > heapDrainThreshold) largestBlockForHeapDrain = std::max(largestBlockForHeapDrain, largestBlock);
-				if (largestBlock > largestBlockThreshold) continue;		// only care about pages where the largest block has become small
+			// For the "heap drain" path, _hashLastDefrag may already equal the current hash here -- it's only required to
+			// change for the incremental & compression paths
+			auto newState = srcHeap->_heap.CalculateHash();
+			assert(operation._type == DefragOperation::Type::HeapDrain || newState != srcHeap->_hashLastDefrag);
+			srcHeap->_hashLastDefrag = newState;
+		}
 
-				auto availableSpace = (*i)->_size - (*i)->_allocatedSpace;
-				if (largestBlock*2 > availableSpace) continue;			// we want to at least double the largest block size in order to make this worthwhile
+							//      -=-=-=-=-=-=-=-=-=-=-       //
 
-				// As above, reject heaps that haven't changed since last defrag event
-				if ((*i)->_heap.CalculateHash() == (*i)->_hashLastDefrag)
-					continue;
+		_recentRepositionBytes += operation._byteCount;
+		_totalRepositionBytes += operation._byteCount;
 
-				auto weight = availableSpace - largestBlock;
-				if (weight > bestWeight) {
-					assert((*i)->_heapResource);
-					bestHeapForCompression = i->get();
-					bestWeight = weight;
-				}
-			}
+		auto newDefrag = StartReposition(*bu, *srcHeap, std::move(operation._steps));
 
-			if (bestIncrementalDefragHeap) {
-				// set _lockedForDefrag before we exit _lock, because this prevents destroying this heap
-				auto oldLocked = bestIncrementalDefragHeap->_lockedForDefrag.exchange(true);
-				assert(!oldLocked); (void)oldLocked;
+		assert(!_activeDefrag);
+		_activeDefrag = std::move(newDefrag);
 
-				auto newState = bestIncrementalDefragHeap->_heap.CalculateHash();
-				assert(newState != bestIncrementalDefragHeap->_hashLastDefrag);
-				bestIncrementalDefragHeap->_hashLastDefrag = newState;
-			} else {
-				if (!bestHeapForCompression && largestBlockForHeapDrain > heapDrainThreshold && _heaps.size() >= minHeapCountForHeapDrain) {
-					// Look for the first small heap that where we can move the entire contents to another heap
-					for (auto i=_heaps.begin(); i!=_heaps.end(); ++i) {
-						if ((*i)->_allocatedSpace < heapDrainThreshold) {
-							bestHeapForCompression = i->get();
+		#if defined(_DEBUG)
+			if (operation._type != DefragOperation::Type::Incremental) {
+				// Validate that everything recorded in the _refCounts is part of the repositioning
+				ScopedLock(_lock);
+				unsigned blockCount = srcHeap->_refCounts.GetEntryCount();
+				for (unsigned b=0; b<blockCount; ++b) {
+					auto block = srcHeap->_refCounts.GetEntry(b);
+					bool foundOne = false;
+					for (auto i =_activeDefrag->_steps.begin(); i!=_activeDefrag->_steps.end(); ++i)
+						if (block.first >= i->_sourceStart && block.second <= i->_sourceEnd) {
+							foundOne = true;
 							break;
 						}
-					}
+					assert(foundOne);
 				}
+			}
+		#endif
+	}
 
-				// set _lockedForDefrag before we exit _lock, because this prevents destroying this heap
-				if (bestHeapForCompression) {
-					auto oldLocked = bestHeapForCompression->_lockedForDefrag.exchange(true);
-					assert(!oldLocked); (void)oldLocked;
-
-					compression = bestHeapForCompression->_heap.CalculateHeapCompression();
+	void BatchedResources::SetDefragPolicy(const BatchedResourcesDefragPolicy& policy)
+	{
+		ScopedLock(_lock);
+		_defragPolicy = policy;
+	}
 
-					// bestHeapForCompression->_hashLastDefrag *may* equal bestHeapForCompression->_heap.CalculateHash() here, but 
-					// only if we're going through the "heap drain" path
-					bestHeapForCompression->_hashLastDefrag = bestHeapForCompression->_heap.CalculateHash();
-				}
+	static unsigned CalculateLargestFreeBlockAfterMove(const SpanningHeap<uint32_t>& heap, IteratorRange<const RepositionStep*> steps)
+	{
+		// Moved ranges become free space once the clients release them. The steps can jump over tiny unallocated
+		// gaps, so merge them with the existing unallocated spans (every second marker starts one of these)
+		auto markers = heap.CalculateMetrics();
+		std::vector<std::pair<unsigned, unsigned>> freeSpans;
+		freeSpans.reserve(markers.size()/2 + steps.size());
+		for (size_t c=0; (c+1)<markers.size(); c+=2)
+			freeSpans.emplace_back(markers[c], markers[c+1]);
+		for (const auto& s:steps)
+			freeSpans.emplace_back(s._sourceStart, s._sourceEnd);
+		if (freeSpans.empty()) return 0;
+		std::sort(freeSpans.begin(), freeSpans.end());
+
+		unsigned result = 0;
+		auto current = freeSpans[0];
+		for (auto i=freeSpans.begin()+1; i!=freeSpans.end(); ++i) {
+			if (i->first <= current.second) {
+				current.second = std::max(current.second, i->second);
+			} else {
+				result = std::max(result, current.second - current.first);
+				current = *i;
 			}
 		}
+		return std::max(result, current.second - current.first);
+	}
 
-							//      -=-=-=-=-=-=-=-=-=-=-       //
-
-		// prioritize the small incremental defrag op
-		if (bestIncrementalDefragHeap) {
-			size_t byteCount = 0;
-			for (const auto& s:bestIncrementalDefragSteps) byteCount += s._sourceEnd-s._sourceStart;
-			_recentRepositionBytes += byteCount;
-			_totalRepositionBytes += byteCount;
+	DefragOperation PlanDefragOperation(IteratorRange<const DefragCandidateHeap*> heaps, const BatchedResourcesDefragPolicy& policy)
+	{
+		DefragOperation result;
+		if (!policy._enabled || heaps.empty()) return result;
 
-			auto newDefrag = StartReposition(*bu, *bestIncrementalDefragHeap, std::move(bestIncrementalDefragSteps));
+		const size_t maxBytesPerOperation = policy._maxBytesPerOperation ? policy._maxBytesPerOperation : std::numeric_limits<size_t>::max();
+		unsigned bestIncrementalIncrease = policy._minLargestBlockIncrease;
+		unsigned bestCompressionWeight = 0;
+		unsigned bestCompressionHeap = ~0u;
+		unsigned largestBlockForHeapDrain = 0;
+		unsigned heapDrainThreshold = 0;
+
+		for (unsigned h=0; h<heaps.size(); ++h) {
+			const auto& candidate = heaps[h];
+			assert(candidate._heap);
+			auto heapSize = candidate._heap->CalculateHeapSize();
+			auto largestBlock = candidate._heap->CalculateLargestFreeBlock();
+			auto availableSpace = heapSize - candidate._allocatedSpace;
+
+			heapDrainThreshold = std::max(heapDrainThreshold, heapSize/4);
+			if (candidate._allocatedSpace > heapSize/4) largestBlockForHeapDrain = std::max(largestBlockForHeapDrain, largestBlock);
+
+			// Check a hash value to ensure we're not triggering a defrag for the same heap over and over
+			// This can happens when none of the blocks from the defrag operation actually moved; meaning it most likely remains
+			// the most optimal defrag operation
+			if (candidate._heap->CalculateHash() == candidate._hashLastDefrag)
+				continue;
+
+			if (CalculateFragmentation(largestBlock, availableSpace) < policy._fragmentationThreshold)
+				continue;
+
+			// evaluate candidacy for a small incremental move
+			if (availableSpace > bestIncrementalIncrease) {
+				auto incremental = candidate._heap->CalculateIncrementalDefragCandidate();
+
+				// Each step's destination only depends on the steps before it, so any prefix is also a valid operation.
+				// Take as many as will fit within the budget
+				size_t byteCount = 0;
+				auto stepCount = incremental._steps.size();
+				for (size_t s=0; s<incremental._steps.size(); ++s) {
+					auto stepSize = incremental._steps[s]._sourceEnd - incremental._steps[s]._sourceStart;
+					if ((byteCount + stepSize) > maxBytesPerOperation) {
+						stepCount = s;
+						break;
+					}
+					byteCount += stepSize;
+				}
 
-			assert(!_activeDefrag);
-			_activeDefrag = std::move(newDefrag);
-		} else if (bestHeapForCompression) {
-			size_t byteCount = 0;
-			for (const auto& s:compression) byteCount += s._sourceEnd-s._sourceStart;
-			_recentRepositionBytes += byteCount;
-			_totalRepositionBytes += byteCount;
+				if (stepCount) {
+					incremental._steps.erase(incremental._steps.begin()+stepCount, incremental._steps.end());
+					auto newLargestBlock = CalculateLargestFreeBlockAfterMove(*candidate._heap, incremental._steps);
+					int increase = (int)newLargestBlock - (int)largestBlock;
+					if (increase > (int)bestIncrementalIncrease) {
+						bestIncrementalIncrease = increase;
+						result._type = DefragOperation::Type::Incremental;
+						result._heapIndex = h;
+						result._steps = std::move(incremental._steps);
+						result._byteCount = byteCount;
+					}
+				}
+			}
 
-			auto newDefrag = StartReposition(*bu, *bestHeapForCompression, std::move(compression));
+			// evaluate candidacy for compressing the entire heap
+			if (largestBlock > heapSize/8) continue;					// only care about pages where the largest block has become small
+			if (largestBlock*2 > availableSpace) continue;				// we want to at least double the largest block size in order to make this worthwhile
+			if (candidate._allocatedSpace > maxBytesPerOperation) continue;
 
-			assert(!_activeDefrag);
-			_activeDefrag = std::move(newDefrag);
+			auto weight = availableSpace - largestBlock;				// only do something when there's a significant difference between total available space and the largest block
+			if (weight > std::max(bestCompressionWeight, heapSize/4)) {
+				bestCompressionHeap = h;
+				bestCompressionWeight = weight;
+			}
+		}
 
-			#if defined(_DEBUG)
-				// Validate that everything recorded in the _refCounts is part of the repositioning
-				{
-					ScopedLock(_lock);
-					unsigned blockCount = bestHeapForCompression->_refCounts.GetEntryCount();
-					for (unsigned b=0; b<blockCount; ++b) {
-						auto block = bestHeapForCompression->_refCounts.GetEntry(b);
-						bool foundOne = false;
-						for (auto i =_activeDefrag->_steps.begin(); i!=_activeDefrag->_steps.end(); ++i)
-							if (block.first >= i->_sourceStart && block.second <= i->_sourceEnd) {
-								foundOne = true;
-								break;
-							}
-						assert(foundOne);
-					}
+		// prioritize the small incremental defrag op
+		if (result._type == DefragOperation::Type::Incremental)
+			return result;
+
+		if (bestCompressionHeap == ~0u && largestBlockForHeapDrain > heapDrainThreshold && heaps.size() >= policy._minHeapCountForHeapDrain) {
+			// Look for the first small heap that where we can move the entire contents to another heap
+			for (unsigned h=0; h<heaps.size(); ++h) {
+				auto allocatedSpace = heaps[h]._allocatedSpace;
+				if (allocatedSpace && allocatedSpace < heapDrainThreshold && allocatedSpace <= maxBytesPerOperation) {
+					result._type = DefragOperation::Type::HeapDrain;
+					result._heapIndex = h;
+					break;
 				}
-			#endif
+			}
+		} else if (bestCompressionHeap != ~0u) {
+			result._type = DefragOperation::Type::Compression;
+			result._heapIndex = bestCompressionHeap;
+		}
+
+		if (result._type != DefragOperation::Type::None) {
+			result._steps = heaps[result._heapIndex]._heap->CalculateHeapCompression();
+			for (const auto& s:result._steps) result._byteCount += s._sourceEnd-s._sourceStart;
 		}
+		return result;
+	}
+
+	float CalculateFragmentation(size_t largestFreeBlock, size_t unallocatedSpace)
+	{
+		// 0 when all unallocated space is in a single block, approaching 1 as it becomes split into many small blocks
+		if (!unallocatedSpace) return 0.f;
+		return 1.f - float(largestFreeBlock) / float(unallocatedSpace);
+	}
+
+	float BatchedHeapMetrics::CalculateFragmentation() const
+	{
+		return BufferUploads::CalculateFragmentation(_largestFreeBlock, _unallocatedSpace);
 	}
 
 	auto BatchedResources::StartReposition(
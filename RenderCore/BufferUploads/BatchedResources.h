@@ -5,11 +5,13 @@
 #pragma once
 #include "IBufferUploads.h"
 #include "../ResourceDesc.h"
+#include "../../Utility/HeapUtils.h"
 
 namespace RenderCore { namespace BufferUploads
 {
 	class UploadsThreadContext;
 	struct BatchingSystemMetrics;
+	struct BatchedResourcesDefragPolicy;
 
 	struct Event_ResourceReposition
 	{
@@ -24,6 +26,7 @@ namespace RenderCore { namespace BufferUploads
 	{
 	public:
 		virtual void TickDefrag() = 0;
+		virtual void SetDefragPolicy(const BatchedResourcesDefragPolicy&) = 0;
 		virtual IteratorRange<const Event_ResourceReposition*> EventList_Get(EventListID id) = 0;
 		virtual void EventList_Release(EventListID id) = 0;
 		virtual EventListID EventList_GetPublishedID() const = 0;
@@ -45,6 +48,8 @@ namespace RenderCore { namespace BufferUploads
 		size_t _largestFreeBlock;
 		unsigned _spaceInReferencedCountedBlocks;
 		unsigned _referencedCountedBlockCount;
+
+		float CalculateFragmentation() const;
 	};
 
 	struct BatchingSystemMetrics
@@ -57,5 +62,43 @@ namespace RenderCore { namespace BufferUploads
 		unsigned _recentRepositionBytes;
 		unsigned _totalRepositionBytes;
 	};
-}}
 
+	/// <summary>Controls when TickDefrag() will start moving blocks around</summary>
+	/// Only a single reposition is in flight at any given time, and each one takes a few frames to complete
+	/// (the copy must finish on the GPU and clients must pick up the reposition event), so _maxBytesPerOperation
+	/// is also a bound on the number of bytes moved per frame.
+	///
+	/// Set _maxBytesPerOperation to 0 for no limit (operations are then only bounded by the size of the heap).
+	struct BatchedResourcesDefragPolicy
+	{
+		bool _enabled = true;
+		unsigned _maxBytesPerOperation = 512*1024;		// 0 means unlimited
+		float _fragmentationThreshold = 0.25f;			// heaps less fragmented than this are left alone (see CalculateFragmentation())
+		unsigned _minLargestBlockIncrease = 16*1024;	// incremental moves must grow the largest free block by at least this much
+		unsigned _minHeapCountForHeapDrain = 8;			// only empty out lightly used heaps entirely when there are at least this many heaps
+	};
+
+	struct DefragCandidateHeap
+	{
+		const Utility::SpanningHeap<uint32_t>* _heap = nullptr;
+		unsigned _allocatedSpace = 0;
+		uint64_t _hashLastDefrag = 0;					// CalculateHash() of the heap when it was last chosen for a defrag operation
+	};
+
+	struct DefragOperation
+	{
+		enum class Type { None, Incremental, Compression, HeapDrain };
+		Type _type = Type::None;
+		unsigned _heapIndex = ~0u;
+		std::vector<Utility::RepositionStep> _steps;		// destinations are relative to a new block allocated outside of the heap
+		size_t _byteCount = 0;
+	};
+
+	/// <summary>Chooses the next reposition to run within the given heaps</summary>
+	/// Prefers small incremental moves that merge free blocks (limited to the policy's byte budget), then full
+	/// compression of badly fragmented heaps, and finally draining lightly used heaps when there are many of them.
+	/// This only looks at the heap layouts, so it can be driven without a device.
+	DefragOperation PlanDefragOperation(IteratorRange<const DefragCandidateHeap*> heaps, const BatchedResourcesDefragPolicy& policy);
+
+	float CalculateFragmentation(size_t largestFreeBlock, size_t unallocatedSpace);
+}}
@@ -8,6 +8,8 @@
 
 #include "IDevice.h"
 #include <memory>
+#include <string>
+#include <chrono>
 
 namespace RenderCore
 {
@@ -51,6 +53,11 @@ namespace RenderCore
     public:
         bool _debugValidation = false;
         bool _onDemandShaderCompile = true;
+
+        // Pipeline cache data is loaded from and saved to this file, so that pipelines built in earlier runs
+        // can be reused (only where the underlying API supports it). Leave empty to disable
+        std::string _pipelineCacheFile;
+        std::chrono::seconds _pipelineCacheSaveInterval { 60 };
     };
 
     // "features" can be toggled on or off at device construction time, and
@@ -0,0 +1,584 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "AnimationCompression.h"
+#include "NascentCommandStream.h"
+#include "../Assets/RawAnimationCurve.h"
+#include "../Format.h"
+#include "../../Math/Quaternion.h"
+#include "../../Math/Interpolation.h"
+#include "../../Math/Vector.h"
+#include "../../Utility/MemoryUtils.h"
+#include <ostream>
+#include <map>
+#include <set>
+#include <tuple>
+#include <optional>
+#include <limits>
+#include <cstring>
+#include <cmath>
+
+namespace RenderCore { namespace Assets { namespace GeoProc
+{
+	uint64_t AnimationCompressionSettings::CalculateHash(uint64_t seed) const
+	{
+		float errors[] { _maxPositionalError, _shellDistance, _maxScalarError, _keyReductionShare };
+		uint64_t flags =
+				uint64_t(_minBitsPerComponent) << 0ull
+			|	uint64_t(_maxBitsPerComponent) << 8ull
+			|	uint64_t(_keyframeReduction) << 16ull
+			|	uint64_t(_quantization) << 17ull
+			|	uint64_t(_stripConstantTracks) << 18ull
+			;
+		return Hash64(errors, &errors[dimof(errors)], HashCombine(flags, seed));
+	}
+
+	enum class ErrorMetric { Positional, Angular, Scale, Scalar };
+
+	struct TrackSample { float _v[4] = {0.f, 0.f, 0.f, 0.f}; };
+
+	static ErrorMetric SelectErrorMetric(AnimSamplerComponent component, AnimSamplerType samplerType)
+	{
+		if ((component == AnimSamplerComponent::Translation || component == AnimSamplerComponent::TranslationGeoSpace) && samplerType == AnimSamplerType::Float3)
+			return ErrorMetric::Positional;
+		if (component == AnimSamplerComponent::Rotation && samplerType == AnimSamplerType::Quaternion)
+			return ErrorMetric::Angular;
+		if (component == AnimSamplerComponent::Scale && (samplerType == AnimSamplerType::Float1 || samplerType == AnimSamplerType::Float3))
+			return ErrorMetric::Scale;
+		return ErrorMetric::Scalar;
+	}
+
+	static unsigned ComponentCount(AnimSamplerType samplerType)
+	{
+		switch (samplerType) {
+		case AnimSamplerType::Float1: return 1;
+		case AnimSamplerType::Float3: return 3;
+		case AnimSamplerType::Float4:
+		case AnimSamplerType::Quaternion: return 4;
+		default: return 0;
+		}
+	}
+
+	static Format FloatFormat(unsigned componentCount)
+	{
+		switch (componentCount) {
+		case 1: return Format::R32_FLOAT;
+		case 3: return Format::R32G32B32_FLOAT;
+		default: assert(componentCount == 4); return Format::R32G32B32A32_FLOAT;
+		}
+	}
+
+	static TrackSample SampleCurve(const RawAnimationCurve& curve, float frame, CurveInterpolationType interpolationType, AnimSamplerType samplerType)
+	{
+		TrackSample result;
+		switch (samplerType) {
+		case AnimSamplerType::Float1:
+			result._v[0] = curve.Calculate<float>(frame, interpolationType);
+			break;
+		case AnimSamplerType::Float3:
+			{
+				auto v = curve.Calculate<Float3>(frame, interpolationType);
+				for (unsigned c=0; c<3; ++c) result._v[c] = v[c];
+			}
+			break;
+		case AnimSamplerType::Float4:
+			{
+				auto v = curve.Calculate<Float4>(frame, interpolationType);
+				for (unsigned c=0; c<4; ++c) result._v[c] = v[c];
+			}
+			break;
+		case AnimSamplerType::Quaternion:
+			{
+				auto q = curve.Calculate<Quaternion>(frame, interpolationType);
+				for (unsigned c=0; c<4; ++c) result._v[c] = q[c];
+			}
+			break;
+		default:
+			assert(0);
+			break;
+		}
+		return result;
+	}
+
+	static TrackSample InterpolateSample(const TrackSample& A, const TrackSample& B, float alpha, AnimSamplerType samplerType)
+	{
+		// (matches the linear interpolation in RawAnimationCurve::Calculate)
+		TrackSample result;
+		if (samplerType == AnimSamplerType::Quaternion) {
+			auto q = SphericalInterpolate(
+				Quaternion{A._v[0], A._v[1], A._v[2], A._v[3]},
+				Quaternion{B._v[0], B._v[1], B._v[2], B._v[3]}, alpha);
+			for (unsigned c=0; c<4; ++c) result._v[c] = q[c];
+		} else {
+			for (unsigned c=0; c<4; ++c) result._v[c] = LinearInterpolate(A._v[c], B._v[c], alpha);
+		}
+		return result;
+	}
+
+	static double MeasureError(const TrackSample& A, const TrackSample& B, ErrorMetric metric, float shellDistance)
+	{
+		if (metric == ErrorMetric::Angular) {
+			// Find the angle between the rotations, and convert that to the displacement of a vertex at the shell distance.
+			// q & -q are the same rotation, so take the smaller of the 2 chords
+			double a[4], b[4], aMag = 0., bMag = 0.;
+			for (unsigned c=0; c<4; ++c) { a[c] = A._v[c]; b[c] = B._v[c]; aMag += a[c]*a[c]; bMag += b[c]*b[c]; }
+			aMag = std::sqrt(aMag); bMag = std::sqrt(bMag);
+			if (aMag < 1e-12 || bMag < 1e-12) return (aMag < 1e-12 && bMag < 1e-12) ? 0. : 2.0 * shellDistance;
+			double diff = 0., sum = 0.;
+			for (unsigned c=0; c<4; ++c) {
+				auto x = a[c]/aMag, y = b[c]/bMag;
+				diff += (x-y)*(x-y); sum += (x+y)*(x+y);
+			}
+			double chord = std::sqrt(std::min(diff, sum));
+			double angle = 4.0 * std::asin(std::min(0.5 * chord, 1.0));
+			return 2.0 * shellDistance * std::sin(0.5 * angle);
+		}
+
+		double d2 = 0.;
+		for (unsigned c=0; c<4; ++c) d2 += (double(A._v[c]) - double(B._v[c])) * (double(A._v[c]) - double(B._v[c]));
+		if (metric == ErrorMetric::Scale) return std::sqrt(d2) * shellDistance;
+		return std::sqrt(d2);
+	}
+
+	static double MeasureCurveError(
+		const RawAnimationCurve& curve, IteratorRange<const TrackSample*> reference,
+		CurveInterpolationType interpolationType, AnimSamplerType samplerType,
+		ErrorMetric metric, float shellDistance, double earlyOut)
+	{
+		double result = 0.;
+		for (unsigned f=0; f<reference.size(); ++f) {
+			result = std::max(result, MeasureError(SampleCurve(curve, float(f), interpolationType, samplerType), reference[f], metric, shellDistance));
+			if (result > earlyOut) break;
+		}
+		return result;
+	}
+
+	static size_t CurveSize(const RawAnimationCurve& curve)
+	{
+		return curve.TimeMarkers().size() * sizeof(uint16_t) + curve.KeyData().size();
+	}
+
+	static bool IsCompressable(const RawAnimationCurve& curve, CurveInterpolationType interpolationType, AnimSamplerType samplerType)
+	{
+		if (interpolationType != CurveInterpolationType::Linear && interpolationType != CurveInterpolationType::None) return false;
+		if (!ComponentCount(samplerType)) return false;
+
+		const auto& desc = curve.Desc();
+		if (desc._flags & CurveDesc::Flags::BitPackedKeys) return false;		// already compressed
+		if (samplerType == AnimSamplerType::Quaternion && (desc._flags & CurveDesc::Flags::HasDequantBlock)) return false;		// can't be decompressed
+		if (desc._timeMarkerType == TimeMarkerType::FrameIndices) {
+			auto markers = curve.TimeMarkers();
+			if (markers.empty() || markers.size() != curve.KeyCount()) return false;
+			for (unsigned c=1; c<markers.size(); ++c)
+				if (markers[c] <= markers[c-1]) return false;
+			return true;
+		} else if (desc._timeMarkerType == TimeMarkerType::None) {
+			return curve.KeyCount() != 0 && curve.KeyCount() <= 0xffff;
+		}
+		return false;
+	}
+
+	static RawAnimationCurve BuildFloatCurve(
+		IteratorRange<const uint16_t*> timeMarkers, IteratorRange<const TrackSample*> keys, AnimSamplerType samplerType)
+	{
+		auto componentCount = ComponentCount(samplerType);
+		SerializableVector<uint8_t> keyData;
+		keyData.resize(keys.size()*componentCount*sizeof(float), uint8_t(0));
+		auto* dst = keyData.data();
+		for (const auto& k:keys) {
+			std::memcpy(dst, k._v, componentCount*sizeof(float));
+			dst += componentCount*sizeof(float);
+		}
+
+		CurveDesc desc;
+		desc._elementStride = componentCount*sizeof(float);
+		desc._elementFormat = FloatFormat(componentCount);
+		desc._timeMarkerType = TimeMarkerType::FrameIndices;
+		return RawAnimationCurve{
+			SerializableVector<uint16_t>{timeMarkers.begin(), timeMarkers.end()},
+			std::move(keyData), desc };
+	}
+
+	static void WriteBits(uint8_t* data, size_t bitOffset, unsigned bitCount, uint32_t value)
+	{
+		// (bit order matches ReadBits in RawAnimationCurve.cpp)
+		for (unsigned c=0; c<bitCount; ++c, ++bitOffset)
+			if (value & (1u<<c))
+				data[bitOffset>>3] |= uint8_t(1u << (bitOffset&7));
+	}
+
+	static RawAnimationCurve BuildBitPackedCurve(
+		IteratorRange<const uint16_t*> timeMarkers, IteratorRange<const TrackSample*> keys,
+		AnimSamplerType samplerType, unsigned bitsPerComponent)
+	{
+		// Quaternions store only x, y, z (keys must have already been normalized & flipped so that w is positive)
+		unsigned firstComponent = (samplerType == AnimSamplerType::Quaternion) ? 1 : 0;
+		unsigned componentCount = ComponentCount(samplerType) - firstComponent;
+
+		CurveDequantizationBlock dequant;
+		std::memset(&dequant, 0, sizeof(dequant));
+		unsigned storedComponents = 0;
+		for (unsigned c=0; c<componentCount; ++c) {
+			float minValue = std::numeric_limits<float>::max(), maxValue = -std::numeric_limits<float>::max();
+			for (const auto& k:keys) {
+				minValue = std::min(minValue, k._v[firstComponent+c]);
+				maxValue = std::max(maxValue, k._v[firstComponent+c]);
+			}
+			dequant._mins[c] = minValue;
+			dequant._maxs[c] = maxValue;
+			if (maxValue > minValue) {
+				dequant._elementFlags |= 1u<<c;
+				++storedComponents;
+			}
+		}
+		dequant._elementFlags |= bitsPerComponent << 8;
+
+		auto strideInBits = storedComponents * bitsPerComponent;
+		SerializableVector<uint8_t> keyData;
+		keyData.resize(sizeof(CurveDequantizationBlock) + (keys.size()*strideInBits+7)/8, uint8_t(0));
+		std::memcpy(keyData.data(), &dequant, sizeof(dequant));
+
+		auto* bits = keyData.data() + sizeof(CurveDequantizationBlock);
+		auto maxQuantized = (1u<<bitsPerComponent)-1;
+		size_t bitOffset = 0;
+		for (const auto& k:keys) {
+			for (unsigned c=0; c<componentCount; ++c) {
+				if (!(dequant._elementFlags & (1u<<c))) continue;
+				float alpha = (k._v[firstComponent+c] - dequant._mins[c]) / (dequant._maxs[c] - dequant._mins[c]);
+				auto q = (uint32_t)std::min(std::max(std::round(alpha * float(maxQuantized)), 0.f), float(maxQuantized));
+				WriteBits(bits, bitOffset, bitsPerComponent, q);
+				bitOffset += bitsPerComponent;
+			}
+		}
+
+		CurveDesc desc;
+		desc._flags = CurveDesc::Flags::HasDequantBlock | CurveDesc::Flags::BitPackedKeys;
+		desc._elementStride = strideInBits;
+		desc._elementFormat = FloatFormat(ComponentCount(samplerType));
+		desc._timeMarkerType = TimeMarkerType::FrameIndices;
+		return RawAnimationCurve{
+			SerializableVector<uint16_t>{timeMarkers.begin(), timeMarkers.end()},
+			std::move(keyData), desc };
+	}
+
+	struct CompressedTrack
+	{
+		enum class Type { Uncompressed, Animated, Constant, Stripped };
+		Type _type = Type::Uncompressed;
+		std::optional<RawAnimationCurve> _curve;
+		TrackSample _constantValue;
+		double _error = 0.;
+		unsigned _originalKeyCount = 0, _keyCount = 0;
+	};
+
+	static CompressedTrack CompressTrack(
+		const RawAnimationCurve& curve, CurveInterpolationType interpolationType, AnimSamplerType samplerType,
+		ErrorMetric metric, double budget, const TrackSample* defaultValue,
+		const AnimationCompressionSettings& settings)
+	{
+		CompressedTrack result;
+		result._originalKeyCount = result._keyCount = curve.KeyCount();
+		if (!IsCompressable(curve, interpolationType, samplerType)) return result;
+
+		// Sample the original curve at every frame. Keys are always on integer frames, and both the original & compressed
+		// curves either hold or interpolate linearly between keys, so the largest errors will be found at these samples
+		auto frameCount = unsigned(curve.TimeAtLastKeyframe())+1;
+		std::vector<TrackSample> reference;
+		reference.reserve(frameCount);
+		for (unsigned f=0; f<frameCount; ++f)
+			reference.push_back(SampleCurve(curve, float(f), interpolationType, samplerType));
+
+		if (settings._stripConstantTracks) {
+			double constantError = 0.;
+			for (const auto& r:reference) {
+				constantError = std::max(constantError, MeasureError(r, reference[0], metric, settings._shellDistance));
+				if (constantError > budget) break;
+			}
+			if (constantError <= budget) {
+				if (defaultValue) {
+					double defaultError = 0.;
+					for (const auto& r:reference)
+						defaultError = std::max(defaultError, MeasureError(r, *defaultValue, metric, settings._shellDistance));
+					if (defaultError <= budget) {
+						result._type = CompressedTrack::Type::Stripped;
+						result._error = defaultError;
+						result._keyCount = 0;
+						return result;
+					}
+				}
+				result._type = CompressedTrack::Type::Constant;
+				result._constantValue = reference[0];
+				result._error = constantError;
+				result._keyCount = 0;
+				return result;
+			}
+		}
+
+		std::vector<uint16_t> timeMarkers;
+		if (curve.Desc()._timeMarkerType == TimeMarkerType::FrameIndices) {
+			timeMarkers.insert(timeMarkers.end(), curve.TimeMarkers().begin(), curve.TimeMarkers().end());
+		} else {
+			timeMarkers.reserve(frameCount);
+			for (unsigned f=0; f<frameCount; ++f) timeMarkers.push_back(uint16_t(f));
+		}
+		std::vector<TrackSample> keys;
+		keys.reserve(timeMarkers.size());
+		for (auto m:timeMarkers) keys.push_back(reference[m]);
+
+		// Keyframe reduction. Grow each segment for as long as interpolating between its end points stays within
+		// the reduction budget for every frame it covers
+		std::vector<unsigned> keptKeys;
+		if (settings._keyframeReduction && keys.size() > 2) {
+			double reductionBudget = budget * settings._keyReductionShare;
+			auto segmentWithinBudget = [&](unsigned a, unsigned b) {
+				for (unsigned f=timeMarkers[a]; f<=timeMarkers[b]; ++f) {
+					TrackSample approx;
+					if (interpolationType == CurveInterpolationType::Linear) {
+						approx = InterpolateSample(keys[a], keys[b], (f - timeMarkers[a]) / float(timeMarkers[b] - timeMarkers[a]), samplerType);
+					} else
+						approx = (f < timeMarkers[b]) ? keys[a] : keys[b];
+					if (MeasureError(approx, reference[f], metric, settings._shellDistance) > reductionBudget)
+						return false;
+				}
+				return true;
+			};
+
+			keptKeys.push_back(0);
+			unsigned segmentStart = 0;
+			for (unsigned k=2; k<keys.size(); ++k)
+				if (!segmentWithinBudget(segmentStart, k)) {
+					keptKeys.push_back(k-1);
+					segmentStart = k-1;
+				}
+			keptKeys.push_back(unsigned(keys.size()-1));
+		} else {
+			for (unsigned k=0; k<keys.size(); ++k) keptKeys.push_back(k);
+		}
+
+		std::vector<uint16_t> reducedTimeMarkers;
+		std::vector<TrackSample> reducedKeys;
+		reducedTimeMarkers.reserve(keptKeys.size());
+		reducedKeys.reserve(keptKeys.size());
+		for (auto k:keptKeys) {
+			reducedTimeMarkers.push_back(timeMarkers[k]);
+			reducedKeys.push_back(keys[k]);
+		}
+
+		auto originalSize = CurveSize(curve);
+		if (settings._quantization) {
+			auto quantizedKeys = reducedKeys;
+			if (samplerType == AnimSamplerType::Quaternion) {
+				// Only x, y, z are stored, so normalize & flip each key so w is positive. Slerp always takes the shortest
+				// path, so flipping doesn't change the interpolated rotations
+				for (auto& k:quantizedKeys) {
+					float mag = std::sqrt(k._v[0]*k._v[0] + k._v[1]*k._v[1] + k._v[2]*k._v[2] + k._v[3]*k._v[3]);
+					if (mag < 1e-6f) { k = TrackSample{}; k._v[0] = 1.f; continue; }
+					float scale = (k._v[0] < 0.f) ? -1.f/mag : 1.f/mag;
+					for (unsigned c=0; c<4; ++c) k._v[c] *= scale;
+				}
+			}
+
+			auto minBits = std::max(settings._minBitsPerComponent, 1u);
+			auto maxBits = std::min(settings._maxBitsPerComponent, 24u);
+			for (unsigned bits=minBits; bits<=maxBits; ++bits) {
+				auto candidate = BuildBitPackedCurve(
+					MakeIteratorRange(reducedTimeMarkers), MakeIteratorRange(quantizedKeys),
+					samplerType, bits);
+				if (CurveSize(candidate) >= originalSize) break;
+				auto error = MeasureCurveError(candidate, MakeIteratorRange(reference), interpolationType, samplerType, metric, settings._shellDistance, budget);
+				if (error <= budget) {
+					result._type = CompressedTrack::Type::Animated;
+					result._curve = std::move(candidate);
+					result._error = error;
+					result._keyCount = (unsigned)reducedKeys.size();
+					return result;
+				}
+			}
+		}
+
+		// Couldn't quantize within budget; fall back to full precision keys, if that's still an improvement
+		auto floatCurve = BuildFloatCurve(MakeIteratorRange(reducedTimeMarkers), MakeIteratorRange(reducedKeys), samplerType);
+		if (CurveSize(floatCurve) >= originalSize) return result;
+		result._type = CompressedTrack::Type::Animated;
+		result._error = MeasureCurveError(floatCurve, MakeIteratorRange(reference), interpolationType, samplerType, metric, settings._shellDistance, std::numeric_limits<double>::max());
+		result._curve = std::move(floatCurve);
+		result._keyCount = (unsigned)reducedKeys.size();
+		return result;
+	}
+
+	static bool DecodeConstant(TrackSample& dst, const void* data, Format format)
+	{
+		unsigned componentCount;
+		switch (format) {
+		case Format::R32_FLOAT: componentCount = 1; break;
+		case Format::R32G32B32_FLOAT: componentCount = 3; break;
+		case Format::R32G32B32A32_FLOAT: componentCount = 4; break;
+		default: return false;
+		}
+		std::memcpy(dst._v, data, componentCount*sizeof(float));
+		return true;
+	}
+
+	AnimationCompressionReport CompressAnimationSet(
+		NascentAnimationSet& animSet,
+		const AnimationCompressionSettings& settings,
+		IteratorRange<const AnimationParameterDefault*> defaults)
+	{
+		AnimationCompressionReport report;
+		report._animations.resize(animSet._animations.size());
+		std::vector<unsigned> blockToAnimation(animSet._animationBlocks.size(), ~0u);
+		for (unsigned a=0; a<animSet._animations.size(); ++a) {
+			report._animations[a]._name = animSet._animations[a].first;
+			for (unsigned b=animSet._animations[a].second._startBlock; b!=animSet._animations[a].second._endBlock; ++b)
+				blockToAnimation[b] = a;
+		}
+
+		auto findDefault = [&](unsigned parameterIndex) -> std::optional<TrackSample> {
+			const auto& param = animSet._parameterInterfaceDefinition[parameterIndex];
+			for (const auto& d:defaults)
+				if (d._parameterName == param._name._hashForm && d._component == param._component) {
+					TrackSample result;
+					std::memcpy(result._v, d._value, sizeof(result._v));
+					return result;
+				}
+			return {};
+		};
+
+		std::vector<RawAnimationCurve> newCurves;
+		std::vector<NascentAnimationSet::AnimationDriver> newAnimationDrivers;
+		std::vector<NascentAnimationSet::ConstantDriver> newConstantDrivers;
+		std::vector<uint8_t> newConstantData;
+
+		// Tracks are cached by curve & parameter, since different drivers can share the same curve
+		struct CachedTrack { CompressedTrack _track; unsigned _newCurveIndex = ~0u; };
+		std::map<std::tuple<unsigned, unsigned, CurveInterpolationType>, CachedTrack> compressedTracks;
+		std::set<std::pair<unsigned, unsigned>> countedOriginalCurves, countedNewCurves;		// (animation, curve) pairs already included in the report
+
+		for (unsigned b=0; b<animSet._animationBlocks.size(); ++b) {
+			auto& block = animSet._animationBlocks[b];
+			auto animIdx = blockToAnimation[b];
+			auto* animReport = (animIdx != ~0u) ? &report._animations[animIdx] : nullptr;
+			auto beginDriver = (unsigned)newAnimationDrivers.size();
+			auto beginConstantDriver = (unsigned)newConstantDrivers.size();
+
+			for (unsigned c=block._beginConstantDriver; c!=block._endConstantDriver; ++c) {
+				const auto& driver = animSet._constantDrivers[c];
+				const auto& param = animSet._parameterInterfaceDefinition[driver._parameterIndex];
+				auto size = BitsPerPixel(driver._format)/8;
+				auto* data = PtrAdd(animSet._constantData.data(), driver._dataOffset);
+				if (animReport) animReport->_originalSize += size;
+
+				if (settings._stripConstantTracks) {
+					auto defaultValue = findDefault(driver._parameterIndex);
+					TrackSample value;
+					if (defaultValue && DecodeConstant(value, data, driver._format)) {
+						auto metric = SelectErrorMetric(param._component, param._samplerType);
+						double budget = (metric == ErrorMetric::Scalar) ? settings._maxScalarError : settings._maxPositionalError;
+						auto error = MeasureError(value, *defaultValue, metric, settings._shellDistance);
+						if (error <= budget) {
+							if (animReport) {
+								++animReport->_strippedTracks;
+								auto& maxError = (metric == ErrorMetric::Scalar) ? animReport->_maxScalarError : animReport->_maxPositionalError;
+								maxError = std::max(maxError, float(error));
+							}
+							continue;
+						}
+					}
+				}
+
+				newConstantDrivers.push_back({(unsigned)newConstantData.size(), driver._parameterIndex, driver._format});
+				newConstantData.insert(newConstantData.end(), (const uint8_t*)data, (const uint8_t*)PtrAdd(data, size));
+				if (animReport) animReport->_compressedSize += size;
+			}
+
+			std::vector<std::pair<unsigned, TrackSample>> newConstants;
+			for (unsigned d=block._beginDriver; d!=block._endDriver; ++d) {
+				const auto& driver = animSet._animationDrivers[d];
+				const auto& param = animSet._parameterInterfaceDefinition[driver._parameterIndex];
+				auto metric = SelectErrorMetric(param._component, param._samplerType);
+				double budget = (metric == ErrorMetric::Scalar) ? settings._maxScalarError : settings._maxPositionalError;
+
+				auto cacheKey = std::make_tuple(driver._curveIndex, driver._parameterIndex, driver._interpolationType);
+				auto i = compressedTracks.find(cacheKey);
+				if (i == compressedTracks.end()) {
+					auto defaultValue = findDefault(driver._parameterIndex);
+					CachedTrack newTrack;
+					newTrack._track = CompressTrack(
+						animSet._curves[driver._curveIndex], driver._interpolationType, param._samplerType,
+						metric, budget, defaultValue ? &defaultValue.value() : nullptr, settings);
+					i = compressedTracks.insert(std::make_pair(cacheKey, std::move(newTrack))).first;
+				}
+				const auto& track = i->second._track;
+
+				if (animReport) {
+					if (countedOriginalCurves.insert({animIdx, driver._curveIndex}).second)
+						animReport->_originalSize += CurveSize(animSet._curves[driver._curveIndex]);
+					animReport->_originalKeyCount += track._originalKeyCount;
+					animReport->_keyCount += track._keyCount;
+					auto& maxError = (metric == ErrorMetric::Scalar) ? animReport->_maxScalarError : animReport->_maxPositionalError;
+					maxError = std::max(maxError, float(track._error));
+				}
+
+				if (track._type == CompressedTrack::Type::Stripped) {
+					if (animReport) ++animReport->_strippedTracks;
+					continue;
+				} else if (track._type == CompressedTrack::Type::Constant) {
+					if (animReport) ++animReport->_constantTracks;
+					newConstants.push_back({driver._parameterIndex, track._constantValue});
+					continue;
+				}
+
+				if (i->second._newCurveIndex == ~0u) {
+					i->second._newCurveIndex = (unsigned)newCurves.size();
+					if (track._type == CompressedTrack::Type::Animated) {
+						newCurves.push_back(*track._curve);
+					} else
+						newCurves.push_back(animSet._curves[driver._curveIndex]);
+				}
+				if (animReport) {
+					if (track._type == CompressedTrack::Type::Animated) ++animReport->_animatedTracks;
+					else ++animReport->_uncompressedTracks;
+					if (countedNewCurves.insert({animIdx, i->second._newCurveIndex}).second)
+						animReport->_compressedSize += CurveSize(newCurves[i->second._newCurveIndex]);
+				}
+				newAnimationDrivers.push_back({i->second._newCurveIndex, driver._parameterIndex, driver._interpolationType});
+			}
+
+			for (const auto& c:newConstants) {
+				auto samplerType = animSet._parameterInterfaceDefinition[c.first]._samplerType;
+				auto size = ComponentCount(samplerType)*sizeof(float);
+				newConstantDrivers.push_back({(unsigned)newConstantData.size(), c.first, FloatFormat(ComponentCount(samplerType))});
+				newConstantData.insert(newConstantData.end(), (const uint8_t*)c.second._v, (const uint8_t*)PtrAdd(c.second._v, size));
+				if (animReport) animReport->_compressedSize += size;
+			}
+
+			block._beginDriver = beginDriver;
+			block._endDriver = (unsigned)newAnimationDrivers.size();
+			block._beginConstantDriver = beginConstantDriver;
+			block._endConstantDriver = (unsigned)newConstantDrivers.size();
+		}
+
+		animSet._curves = std::move(newCurves);
+		animSet._animationDrivers = std::move(newAnimationDrivers);
+		animSet._constantDrivers = std::move(newConstantDrivers);
+		animSet._constantData = std::move(newConstantData);
+		return report;
+	}
+
+	std::ostream& SerializationOperator(std::ostream& stream, const AnimationCompressionReport& report)
+	{
+		stream << "--- Animation compression (" << report._animations.size() << ")" << std::endl;
+		for (unsigned c=0; c<report._animations.size(); ++c) {
+			const auto& a = report._animations[c];
+			stream << "[" << c << "] " << a._name << ": " << a._originalSize << " -> " << a._compressedSize << " bytes";
+			if (a._compressedSize)
+				stream << " (ratio " << float(a._originalSize) / float(a._compressedSize) << ")";
+			stream << " keys " << a._originalKeyCount << " -> " << a._keyCount;
+			stream << " max error " << a._maxPositionalError << " (positional) " << a._maxScalarError << " (scalar)";
+			stream << " tracks: " << a._animatedTracks << " animated, " << a._constantTracks << " constant, " << a._strippedTracks << " stripped, " << a._uncompressedTracks << " uncompressed" << std::endl;
+		}
+		return stream;
+	}
+
+}}}
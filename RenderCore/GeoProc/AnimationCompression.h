@@ -0,0 +1,80 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "../Assets/AnimationSet.h"
+#include "../../Utility/IteratorUtils.h"
+#include <vector>
+#include <string>
+#include <iosfwd>
+
+namespace RenderCore { namespace Assets { namespace GeoProc
+{
+	class NascentAnimationSet;
+
+	/// <summary>Error budget & options for CompressAnimationSet()</summary>
+	/// Errors for joint transforms are measured as the displacement of a virtual vertex at _shellDistance from the
+	/// joint. Translation, rotation and scale errors all become distances in skeleton units this way, and are compared
+	/// against the same budget. Other parameters (ie, those without a Translation, Rotation or Scale component) are
+	/// compared directly against _maxScalarError.
+	///
+	/// Each track is compressed independently; errors from parent joints accumulate down the hierarchy, so for very deep
+	/// skeletons the budget should be tightened accordingly.
+	struct AnimationCompressionSettings
+	{
+		float _maxPositionalError = 0.0001f;
+		float _shellDistance = 0.03f;
+		float _maxScalarError = 0.0001f;
+		float _keyReductionShare = 0.5f;		// fraction of the budget that keyframe reduction can use; the remainder is left for quantization
+		unsigned _minBitsPerComponent = 4;
+		unsigned _maxBitsPerComponent = 24;
+		bool _keyframeReduction = true;
+		bool _quantization = true;
+		bool _stripConstantTracks = true;
+
+		uint64_t CalculateHash(uint64_t seed) const;		// (allows the settings to be passed as a compile initializer)
+	};
+
+	/// Value a parameter will take when there is no driver for it (typically from the skeleton's default pose)
+	struct AnimationParameterDefault
+	{
+		uint64_t				_parameterName;
+		AnimSamplerComponent	_component;
+		float					_value[4];			// quaternions in w, x, y, z order
+	};
+
+	struct AnimationCompressionReport
+	{
+		struct Animation
+		{
+			std::string _name;
+			size_t _originalSize = 0, _compressedSize = 0;		// bytes of curve & constant data
+			float _maxPositionalError = 0.f, _maxScalarError = 0.f;
+			unsigned _originalKeyCount = 0, _keyCount = 0;
+			unsigned _animatedTracks = 0, _constantTracks = 0, _strippedTracks = 0, _uncompressedTracks = 0;
+		};
+		std::vector<Animation> _animations;
+	};
+
+	/// <summary>Compress the curves in an animation set, within an error budget</summary>
+	/// For each animation driver:
+	///
+	///		* tracks that stay within the error budget of a single value become constant drivers, and constant tracks
+	///		  that match the parameter's default value are removed completely
+	///		* keys that can be reconstructed by interpolating their neighbours are removed (linear and stepped curves)
+	///		* the remaining keys are quantized against the range of values in the track, using the smallest number of
+	///		  bits per component that keeps the track within budget (see CurveDesc::Flags::BitPackedKeys). Quaternions
+	///		  only store x, y & z
+	///
+	/// Every compressed track is verified by sampling the output curve at each frame, so the errors in the report are
+	/// measured, not estimated. Curves with other interpolation types are copied across unchanged.
+	AnimationCompressionReport CompressAnimationSet(
+		NascentAnimationSet& animSet,
+		const AnimationCompressionSettings& settings,
+		IteratorRange<const AnimationParameterDefault*> defaults = {});
+
+	std::ostream& SerializationOperator(std::ostream& stream, const AnimationCompressionReport& report);
+
+}}}
@@ -11,12 +11,14 @@
 #include "../Types.h"
 #include "../../Math/Geometry.h"
 #include "../../Math/Transformations.h"
+#include "../../Math/RayIntersection.h"
 #include "../../OSServices/Log.h"
 #include "../../Utility/MemoryUtils.h"
 #include "../../Utility/StringUtils.h"
 #include "../../Utility/ArithmeticUtils.h"
 #include "../../Core/Exceptions.h"
 #include <cstdlib>
+#include <algorithm>
 
 namespace RenderCore { namespace Assets { namespace GeoProc
 {
@@ -880,5 +882,154 @@ namespace RenderCore { namespace Assets { namespace GeoProc
         }
     }
 
+    static uint32_t ExpandBits10(uint32_t v)
+    {
+            // spread the bottom 10 bits of v so there are 2 zero bits between each
+        v = (v * 0x00010001u) & 0xFF0000FFu;
+        v = (v * 0x00000101u) & 0x0F00F00Fu;
+        v = (v * 0x00000011u) & 0xC30C30C3u;
+        v = (v * 0x00000005u) & 0x49249249u;
+        return v;
+    }
+
+    static uint32_t MortonCode(const Float3& pt, const Float3& mins, const Float3& invExtent)
+    {
+        uint32_t q[3];
+        for (unsigned c=0; c<3; ++c)
+            q[c] = (uint32_t)std::clamp((pt[c] - mins[c]) * invExtent[c] * 1023.f, 0.f, 1023.f);
+        return (ExpandBits10(q[0]) << 2) | (ExpandBits10(q[1]) << 1) | ExpandBits10(q[2]);
+    }
+
+    void MeshRaycaster::Build(std::vector<Float3>&& triangleCorners)
+    {
+        auto triangleCount = triangleCorners.size() / 3;
+        if (!triangleCount) return;
+
+        Float3 mins(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+        Float3 maxs(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+        for (const auto& p:triangleCorners)
+            for (unsigned c=0; c<3; ++c) {
+                mins[c] = std::min(mins[c], p[c]);
+                maxs[c] = std::max(maxs[c], p[c]);
+            }
+        Float3 invExtent;
+        for (unsigned c=0; c<3; ++c)
+            invExtent[c] = (maxs[c] > mins[c]) ? 1.f / (maxs[c] - mins[c]) : 0.f;
+
+            // Sort triangles along a Morton curve through their centroids, so that consecutive triangles
+            // are close in space, and clusters of consecutive triangles have tight bounds
+        std::vector<std::pair<uint32_t, unsigned>> sortKeys;
+        sortKeys.reserve(triangleCount);
+        for (unsigned t=0; t<triangleCount; ++t) {
+            auto centroid = (triangleCorners[t*3] + triangleCorners[t*3+1] + triangleCorners[t*3+2]) / 3.f;
+            sortKeys.emplace_back(MortonCode(centroid, mins, invExtent), t);
+        }
+        std::sort(sortKeys.begin(), sortKeys.end());
+
+        _triangleCorners.reserve(triangleCount*3);
+        _triangleIndices.reserve(triangleCount);
+        for (const auto& k:sortKeys) {
+            _triangleCorners.insert(_triangleCorners.end(), &triangleCorners[k.second*3], &triangleCorners[k.second*3+3]);
+            _triangleIndices.push_back(k.second);
+        }
+
+        auto clusterCount = (triangleCount + s_clusterSize - 1) / s_clusterSize;
+        _clusterBounds.reserve(clusterCount);
+        for (size_t cluster=0; cluster<clusterCount; ++cluster) {
+            auto begin = cluster*s_clusterSize*3, end = std::min((cluster+1)*s_clusterSize, triangleCount)*3;
+            std::pair<Float3, Float3> bounds { _triangleCorners[begin], _triangleCorners[begin] };
+            for (auto i=begin+1; i<end; ++i)
+                for (unsigned c=0; c<3; ++c) {
+                    bounds.first[c] = std::min(bounds.first[c], _triangleCorners[i][c]);
+                    bounds.second[c] = std::max(bounds.second[c], _triangleCorners[i][c]);
+                }
+            _clusterBounds.push_back(bounds);
+        }
+    }
+
+    void MeshRaycaster::FindClusters(std::vector<std::pair<float, unsigned>>& result, const std::pair<Float3, Float3>& ray) const
+    {
+        std::vector<float> clusterAlphas(_clusterBounds.size());
+        RayVsAABBs(MakeIteratorRange(clusterAlphas), ray, MakeIteratorRange(_clusterBounds));
+        result.clear();
+        for (unsigned c=0; c<clusterAlphas.size(); ++c)
+            if (clusterAlphas[c] != RayIntersection_Miss)
+                result.emplace_back(clusterAlphas[c], c);
+        std::sort(result.begin(), result.end());
+    }
+
+    auto MeshRaycaster::FirstIntersection(const std::pair<Float3, Float3>& ray) const -> std::optional<Intersection>
+    {
+        std::vector<std::pair<float, unsigned>> clusters;
+        FindClusters(clusters, ray);
+
+        std::optional<Intersection> result;
+        float triangleAlphas[s_clusterSize];
+        for (const auto& cluster:clusters) {
+                // clusters are visited closest first, so once we have a hit closer than the next cluster, we're done
+            if (result && cluster.first > result->_alpha) break;
+            auto firstTriangle = cluster.second*s_clusterSize;
+            auto count = std::min(s_clusterSize, unsigned(_triangleIndices.size() - firstTriangle));
+            RayVsTriangles(
+                MakeIteratorRange(triangleAlphas, &triangleAlphas[count]), ray,
+                MakeIteratorRange(&_triangleCorners[firstTriangle*3], &_triangleCorners[(firstTriangle+count)*3]));
+            for (unsigned t=0; t<count; ++t)
+                if (triangleAlphas[t] != RayIntersection_Miss && (!result || triangleAlphas[t] < result->_alpha))
+                    result = Intersection { triangleAlphas[t], _triangleIndices[firstTriangle+t] };
+        }
+        return result;
+    }
+
+    void MeshRaycaster::AllIntersections(std::vector<Intersection>& result, const std::pair<Float3, Float3>& ray) const
+    {
+        std::vector<std::pair<float, unsigned>> clusters;
+        FindClusters(clusters, ray);
+
+        auto firstNewResult = result.size();
+        float triangleAlphas[s_clusterSize];
+        for (const auto& cluster:clusters) {
+            auto firstTriangle = cluster.second*s_clusterSize;
+            auto count = std::min(s_clusterSize, unsigned(_triangleIndices.size() - firstTriangle));
+            RayVsTriangles(
+                MakeIteratorRange(triangleAlphas, &triangleAlphas[count]), ray,
+                MakeIteratorRange(&_triangleCorners[firstTriangle*3], &_triangleCorners[(firstTriangle+count)*3]));
+            for (unsigned t=0; t<count; ++t)
+                if (triangleAlphas[t] != RayIntersection_Miss)
+                    result.push_back(Intersection { triangleAlphas[t], _triangleIndices[firstTriangle+t] });
+        }
+        std::sort(
+            result.begin() + firstNewResult, result.end(),
+            [](const Intersection& lhs, const Intersection& rhs) { return lhs._alpha < rhs._alpha; });
+    }
+
+    MeshRaycaster::MeshRaycaster(const MeshDatabase& mesh, IteratorRange<const unsigned*> flatTriList)
+    {
+        auto posElement = mesh.FindElement("POSITION");
+        if (posElement == ~0u)
+            Throw(std::runtime_error("Cannot build mesh raycaster because the position element is missing"));
+
+        std::vector<Float3> triangleCorners;
+        triangleCorners.reserve(flatTriList.size() / 3 * 3);
+        for (size_t c=0; c+2<flatTriList.size(); c+=3)
+            for (unsigned q=0; q<3; ++q)
+                triangleCorners.push_back(mesh.GetUnifiedElement<Float3>(flatTriList[c+q], posElement));
+        Build(std::move(triangleCorners));
+    }
+
+    MeshRaycaster::MeshRaycaster(IteratorRange<const Float3*> positions, IteratorRange<const unsigned*> flatTriList)
+    {
+        std::vector<Float3> triangleCorners;
+        triangleCorners.reserve(flatTriList.size() / 3 * 3);
+        for (size_t c=0; c+2<flatTriList.size(); c+=3)
+            for (unsigned q=0; q<3; ++q) {
+                assert(flatTriList[c+q] < positions.size());
+                triangleCorners.push_back(positions[flatTriList[c+q]]);
+            }
+        Build(std::move(triangleCorners));
+    }
+
+    MeshRaycaster::MeshRaycaster() = default;
+    MeshRaycaster::~MeshRaycaster() = default;
+
 }}}
 
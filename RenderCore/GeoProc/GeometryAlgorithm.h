@@ -10,6 +10,8 @@
 #include "../StateDesc.h"
 #include "../../Math/Matrix.h"
 #include "../../Utility/IteratorUtils.h"
+#include <vector>
+#include <optional>
 
 namespace RenderCore { namespace Assets { namespace GeoProc { class MeshDatabase; }}}
 namespace RenderCore { namespace Assets { struct VertexElement; }}
@@ -85,4 +87,44 @@ namespace RenderCore { namespace Assets { namespace GeoProc
 		const Float3& p0, const Float3& p1, const Float3& p2,
 		const Float2& UV0, const Float2& UV1, const Float2& UV2);
 
+    /// <summary>CPU raycasting against a triangle mesh</summary>
+    /// Triangles are sorted along a Morton curve and grouped into small clusters, each with a bounding box.
+    /// Raycasts test all cluster bounding boxes first, and then only the triangles in clusters that were hit
+    /// (closest cluster first). Both stages use the SIMD kernels in Math/RayIntersection.h.
+    ///
+    /// Rays are finite segments, given as (start, end). Triangles are double sided. The mesh data is copied
+    /// on construction, so the raycaster doesn't depend on the lifetime of the source mesh.
+    class MeshRaycaster
+    {
+    public:
+        struct Intersection
+        {
+            float _alpha;               ///< position along the ray, where 0 is the start & 1 is the end
+            unsigned _triangleIndex;    ///< index of the triangle in the original tri list
+        };
+
+        std::optional<Intersection> FirstIntersection(const std::pair<Float3, Float3>& ray) const;
+        /// Appends all intersections along the ray to "result", sorted by distance
+        void AllIntersections(std::vector<Intersection>& result, const std::pair<Float3, Float3>& ray) const;
+
+        size_t GetTriangleCount() const { return _triangleIndices.size(); }
+
+        MeshRaycaster(const MeshDatabase& mesh, IteratorRange<const unsigned*> flatTriList);     // flatTriList uses unified vertex indices
+        MeshRaycaster(IteratorRange<const Float3*> positions, IteratorRange<const unsigned*> flatTriList);
+        MeshRaycaster();
+        ~MeshRaycaster();
+        MeshRaycaster(MeshRaycaster&&) = default;
+        MeshRaycaster& operator=(MeshRaycaster&&) = default;
+
+        static constexpr unsigned s_clusterSize = 32;
+
+    private:
+        std::vector<Float3> _triangleCorners;       // 3 corners per triangle, in cluster order
+        std::vector<unsigned> _triangleIndices;     // original index for each triangle in _triangleCorners
+        std::vector<std::pair<Float3, Float3>> _clusterBounds;
+
+        void Build(std::vector<Float3>&& triangleCorners);
+        void FindClusters(std::vector<std::pair<float, unsigned>>& result, const std::pair<Float3, Float3>& ray) const;
+    };
+
 }}}
@@ -19,6 +19,10 @@ namespace RenderCore { enum class Format : int; }
 
 namespace RenderCore { namespace Assets { namespace GeoProc
 {
+    struct AnimationCompressionSettings;
+    struct AnimationCompressionReport;
+    struct AnimationParameterDefault;
+
         //
         //      "NascentAnimationSet" is a set of animations
         //      and some information to bind these animations to
@@ -88,6 +92,7 @@ namespace RenderCore { namespace Assets { namespace GeoProc
 
 		friend std::ostream& SerializationOperator(std::ostream&, const NascentAnimationSet&);
         friend void SerializationOperator(::Assets::BlockSerializer&, const NascentAnimationSet&);
+        friend AnimationCompressionReport CompressAnimationSet(NascentAnimationSet&, const AnimationCompressionSettings&, IteratorRange<const AnimationParameterDefault*>);
     private:
         std::vector<AnimationDriver>    _animationDrivers;
         std::vector<ConstantDriver>     _constantDrivers;
@@ -481,6 +481,7 @@ namespace RenderCore { namespace LightingEngine
 
 				TRY {
 					auto lightingTechnique = std::make_shared<CompiledLightingTechnique>();
+					lightingTechnique->_compilationCache = techDelBox->_compiledSequenceCache;
 					auto captures = std::make_shared<DeferredLightingCaptures>();
 					captures->_lightScene = lightScene;
 					captures->_lightingOperatorLayout = lightingOperatorLayout;
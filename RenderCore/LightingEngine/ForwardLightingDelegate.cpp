@@ -708,6 +708,7 @@ namespace RenderCore { namespace LightingEngine
 					auto balancedNoiseTexture = helper->_balancedNoiseTexture.get();
 
 					auto lightingTechnique = std::make_shared<CompiledLightingTechnique>();
+					lightingTechnique->_compilationCache = techDelBox->_compiledSequenceCache;
 					lightingTechnique->_depVal = ::Assets::GetDepValSys().Make();
 					lightingTechnique->_depVal.RegisterDependency(captures->_lightScene->GetDependencyValidation());
 					lightingTechnique->_depVal.RegisterDependency(depthMotionNormalRoughnessDelegate->GetDependencyValidation());
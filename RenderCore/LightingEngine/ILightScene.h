@@ -70,6 +70,33 @@ namespace RenderCore { namespace LightingEngine
 		virtual ~IFiniteLightSource();
 	};
 
+	/// <summary>Create and update many light sources with a single call</summary>
+	///
+	/// This is an alternative to TryGetLightSourceInterface<> + the per-light setters for scenes with a large
+	/// number of dynamic lights. Properties are passed as parallel arrays ("structure of arrays") covering the
+	/// contiguous range of light ids starting at "firstLight". All non-empty arrays must have the same number
+	/// of elements; empty arrays leave that property unchanged. Ids in the range that don't refer to a light
+	/// created with a positional light operator are skipped.
+	///
+	/// Query for this interface with ILightScene::QueryInterface()
+	class ILightSourceBulkUpdate
+	{
+	public:
+		struct Properties
+		{
+			IteratorRange<const Float3*> _positions;
+			IteratorRange<const Float3x3*> _orientations;
+			IteratorRange<const Float2*> _radii;
+			IteratorRange<const Float3*> _brightness;
+			IteratorRange<const float*> _cutoffRanges;
+		};
+		virtual void SetLightProperties(ILightScene::LightSourceId firstLight, const Properties&) = 0;
+
+		/// Creates "count" lights with sequential ids, and returns the first id
+		virtual ILightScene::LightSourceId CreateLightSources(ILightScene::LightOperatorId op, unsigned count) = 0;
+		virtual ~ILightSourceBulkUpdate();
+	};
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 	class IDepthTextureResolve
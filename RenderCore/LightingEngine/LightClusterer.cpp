@@ -0,0 +1,287 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "LightClusterer.h"
+#include "StandardLightScene.h"
+#include "../../Math/Transformations.h"
+#include "../../Utility/Threading/CompletionThreadPool.h"
+#include "../../Utility/ArithmeticUtils.h"
+#include "../../Core/Exceptions.h"
+#include <limits>
+#include <cmath>
+#include <cstring>
+
+#if (defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)) && defined(__SSE4_1__)
+	#include <immintrin.h>
+	#define HAS_SSE_INSTRUCTIONS
+#endif
+
+namespace RenderCore { namespace LightingEngine
+{
+	struct CPULightClusterer::ViewSpaceLight
+	{
+		Float3 _center;
+		float _radiusSq;
+		unsigned _sliceBegin, _sliceEnd;
+		unsigned _srcIdx;
+	};
+
+	struct CPULightClusterer::TaskOutput
+	{
+		std::vector<unsigned> _clusterCounts;
+		std::vector<std::pair<unsigned, unsigned>> _assignments;		// local cluster index, light index
+		std::vector<unsigned> _lightIndices;
+	};
+
+	static float DistanceSqToBox(Float3 pt, Float3 mins, Float3 maxs)
+	{
+		float result = 0.f;
+		for (unsigned c=0; c<3; ++c) {
+			float d = std::max(std::max(mins[c] - pt[c], pt[c] - maxs[c]), 0.f);
+			result += d*d;
+		}
+		return result;
+	}
+
+	// Returns a bit for each of the 4 clusters starting at "bounds" that intersects the sphere
+	static unsigned TestSphereVsClusters4(const float* bounds, unsigned stride, Float3 center, float radiusSq)
+	{
+		#if defined(HAS_SSE_INSTRUCTIONS)
+			auto zero = _mm_setzero_ps();
+			auto dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(bounds), _mm_set1_ps(center[0])), _mm_sub_ps(_mm_set1_ps(center[0]), _mm_loadu_ps(bounds+3*stride))), zero);
+			auto dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(bounds+stride), _mm_set1_ps(center[1])), _mm_sub_ps(_mm_set1_ps(center[1]), _mm_loadu_ps(bounds+4*stride))), zero);
+			auto dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(bounds+2*stride), _mm_set1_ps(center[2])), _mm_sub_ps(_mm_set1_ps(center[2]), _mm_loadu_ps(bounds+5*stride))), zero);
+			auto distSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+			return (unsigned)_mm_movemask_ps(_mm_cmple_ps(distSq, _mm_set1_ps(radiusSq)));
+		#else
+			unsigned result = 0;
+			for (unsigned c=0; c<4; ++c) {
+				Float3 mins { bounds[c], bounds[stride+c], bounds[2*stride+c] };
+				Float3 maxs { bounds[3*stride+c], bounds[4*stride+c], bounds[5*stride+c] };
+				if (DistanceSqToBox(center, mins, maxs) <= radiusSq)
+					result |= 1u<<c;
+			}
+			return result;
+		#endif
+	}
+
+	void CPULightClusterer::SetProjection(const Float4x4& cameraToProjection, ClipSpaceType clipSpaceType)
+	{
+		// Corners are in the order: near (left top, left bottom, right top, right bottom), then the same for far
+		Float3 corners[8];
+		CalculateAbsFrustumCorners(corners, cameraToProjection, clipSpaceType);
+		const unsigned countX = _desc._clusterCounts[0], countY = _desc._clusterCounts[1], countZ = _desc._clusterCounts[2];
+
+		// Camera space is -Z forward; depths here are positive distances in front of the camera
+		float nearDepth = -corners[0][2], farDepth = -corners[4][2];
+		_sliceDepths.resize(countZ+1);
+		bool exponential = _desc._exponentialDepthSlices && nearDepth > 0.f;
+		for (unsigned z=0; z<=countZ; ++z) {
+			float a = z / float(countZ);
+			_sliceDepths[z] = exponential ? (nearDepth * std::pow(farDepth / nearDepth, a)) : LinearInterpolate(nearDepth, farDepth, a);
+		}
+		_sliceDepths[0] = nearDepth;
+		_sliceDepths[countZ] = farDepth;
+
+		// Find the camera space lines through each tile corner, as start point and direction per unit of depth. These work for
+		// both perspective and orthogonal projections
+		std::vector<std::pair<Float3, Float3>> tileCornerLines;
+		tileCornerLines.reserve((countX+1)*(countY+1));
+		for (unsigned y=0; y<=countY; ++y)
+			for (unsigned x=0; x<=countX; ++x) {
+				float u = x / float(countX), v = y / float(countY);
+				auto nearPt = LinearInterpolate(LinearInterpolate(corners[0], corners[2], u), LinearInterpolate(corners[1], corners[3], u), v);
+				auto farPt = LinearInterpolate(LinearInterpolate(corners[4], corners[6], u), LinearInterpolate(corners[5], corners[7], u), v);
+				auto dir = (farPt - nearPt) / (nearPt[2] - farPt[2]);
+				tileCornerLines.emplace_back(nearPt, dir);
+			}
+
+		_paddedRowLength = (countX+3)&~3u;
+		_clusterBounds.resize(size_t(countZ)*countY*6*_paddedRowLength);
+		_rowBounds.resize(size_t(countZ)*countY*2);
+		const float maxFloat = std::numeric_limits<float>::max();
+		for (unsigned z=0; z<countZ; ++z)
+			for (unsigned y=0; y<countY; ++y) {
+				auto rowIdx = z*countY+y;
+				float* rowBounds = &_clusterBounds[size_t(rowIdx)*6*_paddedRowLength];
+				Float3 rowMins { maxFloat, maxFloat, maxFloat }, rowMaxs { -maxFloat, -maxFloat, -maxFloat };
+				for (unsigned x=0; x<_paddedRowLength; ++x) {
+					Float3 mins { maxFloat, maxFloat, maxFloat }, maxs { -maxFloat, -maxFloat, -maxFloat };
+					if (x < countX) {
+						const std::pair<Float3, Float3>* lines[] {
+							&tileCornerLines[y*(countX+1)+x], &tileCornerLines[y*(countX+1)+x+1],
+							&tileCornerLines[(y+1)*(countX+1)+x], &tileCornerLines[(y+1)*(countX+1)+x+1] };
+						for (auto* l:lines)
+							for (float depth:{_sliceDepths[z], _sliceDepths[z+1]}) {
+								auto pt = l->first + l->second * (depth + l->first[2]);
+								for (unsigned c=0; c<3; ++c) {
+									mins[c] = std::min(mins[c], pt[c]);
+									maxs[c] = std::max(maxs[c], pt[c]);
+								}
+							}
+						for (unsigned c=0; c<3; ++c) {
+							rowMins[c] = std::min(rowMins[c], mins[c]);
+							rowMaxs[c] = std::max(rowMaxs[c], maxs[c]);
+						}
+					}
+					// padding clusters get inverted bounds, which will never intersect anything
+					for (unsigned c=0; c<3; ++c) {
+						rowBounds[c*_paddedRowLength+x] = mins[c];
+						rowBounds[(3+c)*_paddedRowLength+x] = maxs[c];
+					}
+				}
+				_rowBounds[rowIdx*2] = rowMins;
+				_rowBounds[rowIdx*2+1] = rowMaxs;
+			}
+	}
+
+	std::pair<Float3, Float3> CPULightClusterer::GetClusterBounds(UInt3 cluster) const
+	{
+		assert(cluster[0] < _desc._clusterCounts[0] && cluster[1] < _desc._clusterCounts[1] && cluster[2] < _desc._clusterCounts[2]);
+		auto* rowBounds = &_clusterBounds[size_t(cluster[2]*_desc._clusterCounts[1]+cluster[1])*6*_paddedRowLength];
+		auto x = cluster[0];
+		return {
+			Float3 { rowBounds[x], rowBounds[_paddedRowLength+x], rowBounds[2*_paddedRowLength+x] },
+			Float3 { rowBounds[3*_paddedRowLength+x], rowBounds[4*_paddedRowLength+x], rowBounds[5*_paddedRowLength+x] } };
+	}
+
+	void CPULightClusterer::ExecuteTask(unsigned taskIdx, unsigned sliceBegin, unsigned sliceEnd)
+	{
+		const unsigned countX = _desc._clusterCounts[0], countY = _desc._clusterCounts[1];
+		const unsigned clustersPerSlice = countX*countY;
+		auto& output = _taskOutputs[taskIdx];
+		output._clusterCounts.clear();
+		output._clusterCounts.resize((sliceEnd-sliceBegin)*clustersPerSlice, 0);
+		output._assignments.clear();
+
+		for (const auto& light:_viewSpaceLights) {
+			auto zBegin = std::max(light._sliceBegin, sliceBegin), zEnd = std::min(light._sliceEnd, sliceEnd);
+			for (auto z=zBegin; z<zEnd; ++z)
+				for (unsigned y=0; y<countY; ++y) {
+					auto rowIdx = z*countY+y;
+					if (DistanceSqToBox(light._center, _rowBounds[rowIdx*2], _rowBounds[rowIdx*2+1]) > light._radiusSq) continue;
+
+					const float* rowBounds = &_clusterBounds[size_t(rowIdx)*6*_paddedRowLength];
+					auto localClusterBase = (z-sliceBegin)*clustersPerSlice + y*countX;
+					for (unsigned x=0; x<countX; x+=4) {
+						auto hits = TestSphereVsClusters4(rowBounds+x, _paddedRowLength, light._center, light._radiusSq);
+						while (hits) {
+							auto bit = xl_ctz4(hits);
+							hits ^= 1u<<bit;
+							auto localCluster = localClusterBase + x + bit;
+							++output._clusterCounts[localCluster];
+							output._assignments.emplace_back(localCluster, light._srcIdx);
+						}
+					}
+				}
+		}
+
+		// Counting sort by cluster. Assignments were generated in light order, so lights within each cluster stay sorted
+		unsigned runningOffset = 0;
+		for (auto& c:output._clusterCounts) {
+			auto count = c;
+			c = runningOffset;
+			runningOffset += count;
+		}
+		output._lightIndices.resize(output._assignments.size());
+		for (const auto& a:output._assignments)
+			output._lightIndices[output._clusterCounts[a.first]++] = a.second;
+		// _clusterCounts now contains the end offset for each cluster
+	}
+
+	void CPULightClusterer::Execute(
+		const Float4x4& worldToCamera,
+		IteratorRange<const Float3*> lightPositions,
+		IteratorRange<const float*> lightRadii,
+		Utility::ThreadPool* threadPool)
+	{
+		if (_sliceDepths.empty())
+			Throw(std::runtime_error("CPULightClusterer::SetProjection must be called before Execute"));
+		assert(lightPositions.size() == lightRadii.size());
+		const unsigned countZ = _desc._clusterCounts[2];
+
+		// Transform into camera space and find the range of depth slices for each light. Lights entirely in front of or behind
+		// the view frustum are dropped here
+		_viewSpaceLights.clear();
+		_viewSpaceLights.reserve(lightPositions.size());
+		auto* slicesBegin = AsPointer(_sliceDepths.begin());
+		for (unsigned l=0; l<lightPositions.size(); ++l) {
+			auto center = TransformPoint(worldToCamera, lightPositions[l]);
+			float radius = lightRadii[l];
+			float minDepth = -center[2] - radius, maxDepth = -center[2] + radius;
+			if (maxDepth < _sliceDepths[0] || minDepth > _sliceDepths[countZ]) continue;
+			auto sliceBegin = unsigned(std::lower_bound(slicesBegin+1, slicesBegin+countZ+1, minDepth) - (slicesBegin+1));
+			auto sliceEnd = unsigned(std::upper_bound(slicesBegin, slicesBegin+countZ, maxDepth) - slicesBegin);
+			_viewSpaceLights.push_back({center, radius*radius, sliceBegin, sliceEnd, l});
+		}
+
+		// Each task owns a contiguous range of depth slices, and so a contiguous range of clusters in the output
+		unsigned taskCount = 1;
+		if (threadPool && threadPool->IsGood() && _viewSpaceLights.size() > 64)
+			taskCount = std::min(countZ, threadPool->GetThreadContext()+1);
+		if (_taskOutputs.size() < taskCount)
+			_taskOutputs.resize(taskCount);
+
+		auto taskFn = [this, countZ, taskCount](unsigned t) {
+			ExecuteTask(t, countZ*t/taskCount, countZ*(t+1)/taskCount);
+		};
+
+		if (taskCount > 1) {
+			ParallelFor(*threadPool, taskCount, taskFn);
+		} else {
+			taskFn(0);
+		}
+
+		// Stitch the task outputs together
+		_outputs._clusterOffsets.resize(GetClusterCount()+1);
+		size_t totalAssignments = 0;
+		for (unsigned t=0; t<taskCount; ++t) totalAssignments += _taskOutputs[t]._lightIndices.size();
+		_outputs._lightIndices.resize(totalAssignments);
+
+		unsigned clusterIterator = 0, offsetIterator = 0;
+		_outputs._clusterOffsets[0] = 0;
+		for (unsigned t=0; t<taskCount; ++t) {
+			auto& task = _taskOutputs[t];
+			for (auto end:task._clusterCounts)
+				_outputs._clusterOffsets[++clusterIterator] = offsetIterator + end;
+			if (!task._lightIndices.empty())
+				std::memcpy(&_outputs._lightIndices[offsetIterator], task._lightIndices.data(), task._lightIndices.size()*sizeof(unsigned));
+			offsetIterator += (unsigned)task._lightIndices.size();
+		}
+		assert(clusterIterator == GetClusterCount());
+	}
+
+	void CPULightClusterer::Execute(
+		const Float4x4& worldToCamera,
+		Internal::StandardLightScene& lightScene,
+		Utility::ThreadPool* threadPool)
+	{
+		_gatheredPositions.clear();
+		_gatheredRadii.clear();
+		_outputs._lightOrdering.clear();
+
+		unsigned lightSetIdx = 0;
+		for (auto& lightSet:lightScene._lightSets) {
+			if (lightSet._flags & Internal::StandardPositionLightFlags::LightTiler)
+				for (auto i=lightSet._baseData.begin(); i!=lightSet._baseData.end(); ++i) {
+					_gatheredPositions.push_back(i->_position);
+					_gatheredRadii.push_back(i->_cutoffRange);
+					_outputs._lightOrdering.push_back((lightSetIdx << 16) | i.GetIndex());
+				}
+			++lightSetIdx;
+		}
+
+		Execute(worldToCamera, MakeIteratorRange(_gatheredPositions), MakeIteratorRange(_gatheredRadii), threadPool);
+	}
+
+	CPULightClusterer::CPULightClusterer(const CPULightClustererDesc& desc)
+	: _desc(desc)
+	{
+		if (!_desc._clusterCounts[0] || !_desc._clusterCounts[1] || !_desc._clusterCounts[2])
+			Throw(std::runtime_error("Invalid cluster counts for CPULightClusterer"));
+	}
+	CPULightClusterer::~CPULightClusterer() = default;
+	CPULightClusterer::CPULightClusterer(CPULightClusterer&&) = default;
+	CPULightClusterer& CPULightClusterer::operator=(CPULightClusterer&&) = default;
+}}
@@ -0,0 +1,92 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "../../Math/Vector.h"
+#include "../../Math/Matrix.h"
+#include "../../Math/ProjectionMath.h"
+#include "../../Utility/IteratorUtils.h"
+#include <vector>
+
+namespace Utility { class ThreadPool; }
+namespace RenderCore { namespace LightingEngine { namespace Internal { class StandardLightScene; }}}
+
+namespace RenderCore { namespace LightingEngine
+{
+	struct CPULightClustererDesc
+	{
+		UInt3 _clusterCounts = UInt3{16u, 9u, 24u};		// screen space tiles in X & Y, then depth slices
+		bool _exponentialDepthSlices = true;
+	};
+
+	/// <summary>Assigns lights to view space clusters ("froxels") on the CPU</summary>
+	///
+	/// The view frustum is divided into _clusterCounts[0] x _clusterCounts[1] screen space tiles and _clusterCounts[2]
+	/// depth slices. Each light sphere is tested against the camera space bounding box of the clusters it might touch,
+	/// and the result is a compact list of light indices per cluster that can be uploaded to the GPU as is:
+	///
+	///		lights for cluster c are _lightIndices[_clusterOffsets[c]] ... _lightIndices[_clusterOffsets[c+1]-1]
+	///
+	/// Clusters are ordered with X varying fastest, then Y (top to bottom), then depth (near to far). Light indices
+	/// within each cluster are in ascending order.
+	///
+	/// Sphere vs cluster tests are done 4 clusters at a time with SSE, and depth slices are distributed across the
+	/// given thread pool. This doesn't require a device, so it can be used (and benchmarked) without a GPU.
+	class CPULightClusterer
+	{
+	public:
+		void SetProjection(const Float4x4& cameraToProjection, ClipSpaceType clipSpaceType);
+
+		void Execute(
+			const Float4x4& worldToCamera,
+			IteratorRange<const Float3*> lightPositions,
+			IteratorRange<const float*> lightRadii,
+			Utility::ThreadPool* threadPool = nullptr);
+
+		/// Clusters the lights in the scene that are in light sets with the LightTiler flag, using the cutoff range as the
+		/// light radius. _outputs._lightOrdering maps from light indices back to (lightSetIdx << 16) | lightIndex, in the same
+		/// way as RasterizationLightTileOperator
+		void Execute(
+			const Float4x4& worldToCamera,
+			Internal::StandardLightScene& lightScene,
+			Utility::ThreadPool* threadPool = nullptr);
+
+		struct Outputs
+		{
+			std::vector<unsigned> _clusterOffsets;		// cluster count + 1 entries
+			std::vector<unsigned> _lightIndices;
+			std::vector<unsigned> _lightOrdering;
+		};
+		const Outputs& GetOutputs() const { return _outputs; }
+
+		unsigned GetClusterCount() const { return _desc._clusterCounts[0] * _desc._clusterCounts[1] * _desc._clusterCounts[2]; }
+		UInt3 GetClusterCounts() const { return _desc._clusterCounts; }
+		IteratorRange<const float*> GetSliceDepths() const { return MakeIteratorRange(_sliceDepths); }
+		std::pair<Float3, Float3> GetClusterBounds(UInt3 cluster) const;
+
+		CPULightClusterer(const CPULightClustererDesc& desc);
+		~CPULightClusterer();
+		CPULightClusterer(CPULightClusterer&&);
+		CPULightClusterer& operator=(CPULightClusterer&&);
+
+	private:
+		CPULightClustererDesc _desc;
+		unsigned _paddedRowLength = 0;
+		std::vector<float> _sliceDepths;			// distance from camera to the near side of each slice, plus the far side of the last
+		std::vector<float> _clusterBounds;			// per row: min x, y, z then max x, y, z, each _paddedRowLength long
+		std::vector<Float3> _rowBounds;				// min & max for each row
+
+		struct ViewSpaceLight;
+		struct TaskOutput;
+		std::vector<ViewSpaceLight> _viewSpaceLights;
+		std::vector<TaskOutput> _taskOutputs;
+		std::vector<Float3> _gatheredPositions;
+		std::vector<float> _gatheredRadii;
+
+		Outputs _outputs;
+
+		void ExecuteTask(unsigned taskIdx, unsigned sliceBegin, unsigned sliceEnd);
+	};
+}}
@@ -296,15 +296,20 @@ namespace RenderCore { namespace LightingEngine
 	void Sequence::CompleteAndSeal(
 		Techniques::IPipelineAcceleratorPool& pipelineAccelerators,
 		Techniques::FragmentStitchingContext& stitchingContext,
-		const FrameBufferProperties& fbProps)
+		const FrameBufferProperties& fbProps,
+		std::vector<std::pair<uint64_t, std::shared_ptr<Techniques::SequencerConfig>>>* sequencerConfigsToRetain,
+		LightingTechniqueCompilationMetrics* metrics)
 	{
 		if (_dynamicFn) return;
 
 		// complete all frame buffers in _fbDescsPendingStitch & fill in the sequencer configs pointed to by _sequencerConfigsPendingConstruction
+		auto startTime = std::chrono::steady_clock::now();
 		ResolvePendingCreateFragmentSteps();
 		_frozen = true;
 		PropagateReverseAttachmentDependencies(stitchingContext);
+		auto stitchStartTime = std::chrono::steady_clock::now();
 
+		unsigned stitchCacheHitsInitial = stitchingContext._cache ? stitchingContext._cache->GetMetrics()._hits : 0;
 		assert(_fbDescs.empty());
 		_fbDescs.reserve(_fbDescsPendingStitch.size());
 		for (const auto& stitchOp:_fbDescsPendingStitch) {
@@ -318,19 +323,52 @@ namespace RenderCore { namespace LightingEngine
 			_fbDescs.emplace_back(std::move(mergedFB));
 		}
 		_fbDescsPendingStitch.clear();
+		auto sequencerConfigStartTime = std::chrono::steady_clock::now();
+
+		#if defined(_DEBUG)
+			Log(Verbose) << "Transient attachments in lighting technique (potential aliasing, not applied):" << std::endl << CalculateTransientAttachmentAliasing() << std::endl;
+		#endif
 
 		for (const auto& createSequencerConfig:_sequencerConfigsPendingConstruction) {
+			const auto& fbDesc = _fbDescs[createSequencerConfig._fbDescIndex]._fbDesc;
 			auto seqCfg = pipelineAccelerators.CreateSequencerConfig(createSequencerConfig._name,createSequencerConfig._sequencerSelectors);
 			pipelineAccelerators.SetTechniqueDelegate(*seqCfg, createSequencerConfig._delegate);
-			pipelineAccelerators.SetFrameBufferDesc(*seqCfg, _fbDescs[createSequencerConfig._fbDescIndex]._fbDesc, createSequencerConfig._subpassIndex);
+			pipelineAccelerators.SetFrameBufferDesc(*seqCfg, fbDesc, createSequencerConfig._subpassIndex);
 			assert(createSequencerConfig._stepIndex < _steps.size());
 			assert(_steps[createSequencerConfig._stepIndex]._type == ExecuteStep::Type::ExecuteDrawables);
 			assert(_steps[createSequencerConfig._stepIndex]._sequencerConfig == nullptr);
+
+			if (sequencerConfigsToRetain) {
+				// Everything that goes into the pipeline accelerator pool's internal config, except for the dimensions
+				auto key = HashCombine(fbDesc.GetHashExcludingDimensions(), Hash64(createSequencerConfig._name));
+				key = HashCombine(createSequencerConfig._sequencerSelectors.GetHash(), key);
+				key = HashCombine(createSequencerConfig._sequencerSelectors.GetParameterNamesHash(), key);
+				key = HashCombine(uint64_t(size_t(createSequencerConfig._delegate.get())), key);
+				key = HashCombine(createSequencerConfig._subpassIndex, key);
+				sequencerConfigsToRetain->emplace_back(key, seqCfg);
+			}
 			_steps[createSequencerConfig._stepIndex]._sequencerConfig = std::move(seqCfg);
 		}
+
+		if (metrics) {
+			auto endTime = std::chrono::steady_clock::now();
+			metrics->_frameBufferCount += (unsigned)_fbDescs.size();
+			if (stitchingContext._cache)
+				metrics->_stitchCacheHits += stitchingContext._cache->GetMetrics()._hits - stitchCacheHitsInitial;		// approximate, if other threads are using the same cache
+			metrics->_sequencerConfigCount += (unsigned)_sequencerConfigsPendingConstruction.size();
+			metrics->_resolveStepsTime += stitchStartTime - startTime;
+			metrics->_stitchTime += sequencerConfigStartTime - stitchStartTime;
+			metrics->_sequencerConfigTime += endTime - sequencerConfigStartTime;
+		}
 		_sequencerConfigsPendingConstruction.clear();
 	}
 
+	Techniques::TransientAttachmentAliasing Sequence::CalculateTransientAttachmentAliasing() const
+	{
+		assert(_frozen);
+		return Techniques::CalculateTransientAttachmentAliasing(MakeIteratorRange(_fbDescs));
+	}
+
 	void Sequence::PropagateReverseAttachmentDependencies(Techniques::FragmentStitchingContext& stitchingContext)
 	{
 		// For each input attachment in later fragments, search backwards 
@@ -461,10 +499,22 @@ namespace RenderCore { namespace LightingEngine
 		const FrameBufferProperties& fbProps)
 	{
 		assert(!_isConstructionCompleted);
+		auto startTime = std::chrono::steady_clock::now();
+		if (_compilationCache && !stitchingContext._cache)
+			stitchingContext._cache = _compilationCache->GetStitchingCache();
+
 		_doubleBufferAttachments = { stitchingContext.GetDoubleBufferAttachments().begin(), stitchingContext.GetDoubleBufferAttachments().end() };
+		_compilationMetrics = {};
+		std::vector<std::pair<uint64_t, std::shared_ptr<Techniques::SequencerConfig>>> sequencerConfigsToRetain;
 		for (auto&s:_sequences)
-			s->CompleteAndSeal(*pipelineAccelerators, stitchingContext, fbProps);
+			s->CompleteAndSeal(*pipelineAccelerators, stitchingContext, fbProps, _compilationCache ? &sequencerConfigsToRetain : nullptr, &_compilationMetrics);
+		// all sequences are part of the same build, so their configs are retained together
+		if (_compilationCache)
+			_compilationMetrics._sequencerConfigsRetained = _compilationCache->RetainSequencerConfigs(MakeIteratorRange(sequencerConfigsToRetain));
+		_compilationMetrics._totalTime = std::chrono::steady_clock::now() - startTime;
 		_isConstructionCompleted = true;
+
+		Log(Verbose) << "Completed lighting technique construction: " << _compilationMetrics << std::endl;
 	}
 
 	void CompiledLightingTechnique::Seal(Techniques::FragmentStitchingContext& stitchingContext)
@@ -475,6 +525,55 @@ namespace RenderCore { namespace LightingEngine
 		_isConstructionCompleted = true;
 	}
 
+	std::ostream& operator<<(std::ostream& str, const LightingTechniqueCompilationMetrics& metrics)
+	{
+		using namespace std::chrono;
+		auto asMs = [](nanoseconds t) { return duration_cast<duration<float, std::milli>>(t).count(); };
+		str << metrics._frameBufferCount << " frame buffers (" << metrics._stitchCacheHits << " merged fragments from cache), ";
+		str << metrics._sequencerConfigCount << " sequencer configs (" << metrics._sequencerConfigsRetained << " retained from earlier builds). ";
+		str << "Resolve steps: " << asMs(metrics._resolveStepsTime) << "ms, stitch: " << asMs(metrics._stitchTime);
+		str << "ms, sequencer configs: " << asMs(metrics._sequencerConfigTime) << "ms, total: " << asMs(metrics._totalTime) << "ms";
+		return str;
+	}
+
+	unsigned CompiledSequenceCache::RetainSequencerConfigs(IteratorRange<const std::pair<uint64_t, std::shared_ptr<Techniques::SequencerConfig>>*> sequencerConfigs)
+	{
+		ScopedLock(_lock);
+		unsigned build = ++_buildCounter, matches = 0;
+		for (const auto& cfg:sequencerConfigs) {
+			auto i = LowerBound(_retainedConfigs, cfg.first);
+			if (i != _retainedConfigs.end() && i->first == cfg.first) {
+				// The new config will share the same internal config as the old one, so we only need to hold the newest
+				if (i->second._lastBuild != build) ++matches;
+				i->second = RetainedConfig{cfg.second, build};
+			} else
+				_retainedConfigs.insert(i, std::make_pair(cfg.first, RetainedConfig{cfg.second, build}));
+		}
+
+		// Release anything that hasn't been used recently. If nothing else holds those configs, the pipeline accelerator pool
+		// will release their pipelines
+		_retainedConfigs.erase(
+			std::remove_if(_retainedConfigs.begin(), _retainedConfigs.end(), [build, retainBuilds=_retainBuilds](const auto& c) { return (build - c.second._lastBuild) >= retainBuilds; }),
+			_retainedConfigs.end());
+		return matches;
+	}
+
+	void CompiledSequenceCache::Clear()
+	{
+		ScopedLock(_lock);
+		_retainedConfigs.clear();
+		_stitchingCache->Clear();
+	}
+
+	CompiledSequenceCache::CompiledSequenceCache(unsigned retainBuilds)
+	: _retainBuilds(retainBuilds)
+	{
+		assert(_retainBuilds != 0);
+		_stitchingCache = std::make_shared<Techniques::FragmentStitchingCache>();
+	}
+
+	CompiledSequenceCache::~CompiledSequenceCache() = default;
+
 	Sequence& CompiledLightingTechnique::CreateSequence()
 	{
 		auto newSequence = std::make_shared<Sequence>();
@@ -505,6 +604,11 @@ namespace RenderCore { namespace LightingEngine
 		return technique.GetDoubleBufferAttachments();
 	}
 
+	const LightingTechniqueCompilationMetrics& GetCompilationMetrics(CompiledLightingTechnique& technique)
+	{
+		return technique.GetCompilationMetrics();
+	}
+
 	namespace Internal
 	{
 		void* QueryInterface(CompiledLightingTechnique& technique, uint64_t typeCode)
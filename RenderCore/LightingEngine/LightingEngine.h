@@ -132,6 +132,8 @@ namespace RenderCore { namespace LightingEngine
 	ILightScene& GetLightScene(CompiledLightingTechnique&);
 	const ::Assets::DependencyValidation& GetDependencyValidation(CompiledLightingTechnique&);
 	IteratorRange<const Techniques::DoubleBufferAttachment*> GetDoubleBufferAttachments(CompiledLightingTechnique&);
+	struct LightingTechniqueCompilationMetrics;
+	const LightingTechniqueCompilationMetrics& GetCompilationMetrics(CompiledLightingTechnique&);
 	namespace Internal { void* QueryInterface(CompiledLightingTechnique&, uint64_t typeCode); }
 	template<typename Type>
 		Type* QueryInterface(CompiledLightingTechnique& technique)
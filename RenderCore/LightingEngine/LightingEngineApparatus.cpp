@@ -4,6 +4,7 @@
 
 #include "LightingEngineApparatus.h"
 #include "GBufferOperator.h"
+#include "Sequence.h"
 #include "TextureCompilerUtil.h"
 #include "../Techniques/TechniqueDelegates.h"
 #include "../Techniques/Apparatuses.h"
@@ -137,6 +138,8 @@ namespace RenderCore { namespace LightingEngine
 		if (i == forwardPipelineLayout->_descriptorSets.end())
 			Throw(std::runtime_error("Missing ForwardLighting entry in pipeline layout file"));
 		_forwardLightingDescSetTemplate = i->second;
+
+		_compiledSequenceCache = std::make_shared<CompiledSequenceCache>();
 	}
 
 	LightingEngineApparatus::LightingEngineApparatus(std::shared_ptr<Techniques::DrawingApparatus> drawingApparatus)
@@ -30,6 +30,7 @@ namespace Assets { class InitializerPack; }
 namespace RenderCore { namespace LightingEngine
 {
 	class SharedTechniqueDelegateBox;
+	class CompiledSequenceCache;
 	enum class GBufferDelegateType;
 
 	class LightingEngineApparatus
@@ -56,6 +57,7 @@ namespace RenderCore { namespace LightingEngine
 		std::shared_ptr<RenderCore::Assets::PredefinedDescriptorSetLayout> _dmShadowDescSetTemplate;
 		std::shared_ptr<RenderCore::Assets::PredefinedDescriptorSetLayout> _forwardLightingDescSetTemplate;
 		std::shared_ptr<ICompiledPipelineLayout> _lightingOperatorLayout;
+		std::shared_ptr<CompiledSequenceCache> _compiledSequenceCache;		// shared by all techniques built with these delegates
 
 		using TechniqueDelegateFuture = std::shared_future<std::shared_ptr<Techniques::ITechniqueDelegate>>;
 		TechniqueDelegateFuture GetForwardIllumDelegate_DisableDepthWrite();
@@ -499,7 +499,7 @@ namespace RenderCore { namespace LightingEngine
 		// prepare the data via the cb layout & start the copy countdown
 		ParameterBox pBox;
 		ConfigureParameterBox(pBox, _qualityParameters);
-		_paramsBufferData = _paramsCBLayout.BuildCBDataAsVector(pBox, Techniques::GetDefaultShaderLanguage());
+		_paramsBufferData = _paramsCBWriter.BuildCBDataAsVector(pBox);
 
 		// have to respect alignment rules for offsets
 		const auto cbAlignmentRules = _device->GetDeviceLimits()._constantBufferOffsetAlignment;
@@ -670,10 +670,11 @@ namespace RenderCore { namespace LightingEngine
 				strongThis->_reflectionsBlur = std::move(reflectionsBlur);
 
 				{
-					strongThis->_paramsCBLayout = FindCBLayout(*pipelineLayout, "SSRConfiguration");
+					// the parameter box always has the same signature, so we can compile the layout once here
 					ParameterBox pBox;
 					ConfigureParameterBox(pBox, strongThis->_qualityParameters);
-					strongThis->_paramsBufferData = strongThis->_paramsCBLayout.BuildCBDataAsVector(pBox, Techniques::GetDefaultShaderLanguage());
+					strongThis->_paramsCBWriter = RenderCore::Assets::CompiledCBWriter{FindCBLayout(*pipelineLayout, "SSRConfiguration"), pBox, Techniques::GetDefaultShaderLanguage()};
+					strongThis->_paramsBufferData = strongThis->_paramsCBWriter.BuildCBDataAsVector(pBox);
 				}
 
 				const auto cbAlignmentRules = strongThis->_device->GetDeviceLimits()._constantBufferOffsetAlignment;
@@ -121,7 +121,7 @@ namespace RenderCore { namespace LightingEngine
 		unsigned _paramsBufferCopyCountdown = 0;
 		std::vector<uint8_t> _paramsBufferData;
 		QualityParameters _qualityParameters;
-		RenderCore::Assets::PredefinedCBLayout _paramsCBLayout;
+		RenderCore::Assets::CompiledCBWriter _paramsCBWriter;
 		IntegrationParams _integrationParams;
 
 		struct ResolutionDependentResources;
@@ -10,16 +10,21 @@
 #include "../Techniques/RenderPass.h"
 #include "../Techniques/TechniqueUtils.h"
 #include "../../Assets/DepVal.h"
+#include "../../Utility/Threading/Mutex.h"
 #include <variant>
 #include <memory>
 #include <vector>
 #include <functional>
+#include <chrono>
+#include <iosfwd>
 
 namespace RenderCore { namespace Techniques { class ProjectionDesc; }}
 namespace RenderCore { namespace LightingEngine
 {
 	class SequenceIterator;
     class RenderStepFragmentInterface;
+	class CompiledSequenceCache;
+	struct LightingTechniqueCompilationMetrics;
 	using SequenceParseId = unsigned;
 
 	class Sequence
@@ -61,10 +66,14 @@ namespace RenderCore { namespace LightingEngine
 		std::vector<std::pair<uint64_t, std::shared_ptr<void>>> _interfaces;
 
 		void ResolvePendingCreateFragmentSteps();
+		// When "sequencerConfigsToRetain" is given, the sequencer configs created here are appended to it (keyed for
+		// CompiledSequenceCache::RetainSequencerConfigs(), which the caller should call once for the whole build)
 		void CompleteAndSeal(
 			Techniques::IPipelineAcceleratorPool& pipelineAccelerators,
 			Techniques::FragmentStitchingContext& stitchingContext,
-			const FrameBufferProperties& fbProps);
+			const FrameBufferProperties& fbProps,
+			std::vector<std::pair<uint64_t, std::shared_ptr<Techniques::SequencerConfig>>>* sequencerConfigsToRetain = nullptr,
+			LightingTechniqueCompilationMetrics* metrics = nullptr);
 		void Reset();
 		void TryDynamicInitialization(SequenceIterator&);
 		unsigned DrawablePktsToReserve() const { return _nextParseId; }
@@ -72,6 +81,9 @@ namespace RenderCore { namespace LightingEngine
 
 		std::pair<const FrameBufferDesc*, unsigned> GetResolvedFrameBufferDesc(FragmentInterfaceRegistration) const;
 
+		// Lifetimes & potential memory aliasing for the transient attachments in the stitched frame buffers (valid after CompleteAndSeal()). For reporting only
+		Techniques::TransientAttachmentAliasing CalculateTransientAttachmentAliasing() const;
+
 		using DynamicSequenceFn = std::function<void(SequenceIterator&, Sequence&)>;
 
 		Sequence();
@@ -148,6 +160,52 @@ namespace RenderCore { namespace LightingEngine
 		bool _hasPrevProjDesc = false;
 	};
 
+	struct LightingTechniqueCompilationMetrics
+	{
+		unsigned _frameBufferCount = 0;
+		unsigned _stitchCacheHits = 0;				// frame buffers that were able to skip MergeFragments()
+		unsigned _sequencerConfigCount = 0;
+		unsigned _sequencerConfigsRetained = 0;		// matched a sequencer config retained from an earlier build (and so reuse its pipelines)
+		std::chrono::nanoseconds _resolveStepsTime{0};
+		std::chrono::nanoseconds _stitchTime{0};
+		std::chrono::nanoseconds _sequencerConfigTime{0};
+		std::chrono::nanoseconds _totalTime{0};
+	};
+
+	std::ostream& operator<<(std::ostream& str, const LightingTechniqueCompilationMetrics& metrics);
+
+	/// <summary>Shares compilation work between successive builds of lighting techniques</summary>
+	/// Techniques are rebuilt from scratch when the output resolution changes, but only the dimensions in the stitched
+	/// frame buffers are actually different. The stitching cache lets those rebuilds skip merging fragments. Sequencer
+	/// configs from recent builds are also held here, so that the pipeline accelerator pool finds their (resolution
+	/// independent) internal configurations still alive and reuses the pipelines that have already been built for them.
+	class CompiledSequenceCache
+	{
+	public:
+		const std::shared_ptr<Techniques::FragmentStitchingCache>& GetStitchingCache() const { return _stitchingCache; }
+
+		// Call once per build, with all of the sequencer configs created during that build (keyed by their resolution
+		// independent properties). Returns the number that match a config retained from an earlier build
+		unsigned RetainSequencerConfigs(IteratorRange<const std::pair<uint64_t, std::shared_ptr<Techniques::SequencerConfig>>*>);
+		void Clear();
+
+		CompiledSequenceCache(unsigned retainBuilds = 4);
+		~CompiledSequenceCache();
+		CompiledSequenceCache(const CompiledSequenceCache&) = delete;
+		CompiledSequenceCache& operator=(const CompiledSequenceCache&) = delete;
+	private:
+		std::shared_ptr<Techniques::FragmentStitchingCache> _stitchingCache;
+		struct RetainedConfig
+		{
+			std::shared_ptr<Techniques::SequencerConfig> _cfg;
+			unsigned _lastBuild = 0;
+		};
+		std::vector<std::pair<uint64_t, RetainedConfig>> _retainedConfigs;
+		unsigned _buildCounter = 0;
+		unsigned _retainBuilds = 0;
+		Threading::Mutex _lock;
+	};
+
 	class CompiledLightingTechnique
 	{
 	public:
@@ -165,6 +223,10 @@ namespace RenderCore { namespace LightingEngine
 		BufferUploads::CommandListID _completionCommandList = 0;
 
 		IteratorRange<const Techniques::DoubleBufferAttachment*> GetDoubleBufferAttachments() const { return _doubleBufferAttachments; }
+		const LightingTechniqueCompilationMetrics& GetCompilationMetrics() const { return _compilationMetrics; }
+
+		// Optional; set before CompleteConstruction() to share work with other builds
+		std::shared_ptr<CompiledSequenceCache> _compilationCache;
 
 		CompiledLightingTechnique();
 		~CompiledLightingTechnique();
@@ -178,6 +240,7 @@ namespace RenderCore { namespace LightingEngine
 		std::vector<RenderCore::Techniques::DoubleBufferAttachment> _doubleBufferAttachments;
 
 		FrameToFrameProperties _frameToFrameProperties;
+		LightingTechniqueCompilationMetrics _compilationMetrics;
 
 		friend class SequenceIterator;
 		friend class SequencePlayback;
@@ -72,6 +72,53 @@ namespace RenderCore { namespace LightingEngine { namespace Internal
 		return result;
 	}
 
+	auto StandardLightScene::CreateLightSources(LightOperatorId operatorId, unsigned count) -> LightSourceId
+	{
+		auto result = _nextLightSource;
+		auto lightSetIdx = GetLightSet(operatorId, ~0u);
+		auto& lightSet = _lightSets[lightSetIdx];
+
+		// new ids are always larger than anything in the lookup table, so we can append directly
+		assert(_lookupTable.empty() || _lookupTable.back().first < result);
+		_lookupTable.reserve(_lookupTable.size() + count);
+		for (unsigned c=0; c<count; ++c) {
+			auto newLight = lightSet._baseData.Allocate();
+			auto newLightIdx = newLight.GetIndex();
+			_lookupTable.emplace_back(result+c, LightSetAndIndex{lightSetIdx, newLightIdx});
+			for (auto& comp:lightSet._boundComponents)
+				comp->RegisterLight(lightSetIdx, newLightIdx, *newLight);
+		}
+		_nextLightSource += count;
+		return result;
+	}
+
+	void StandardLightScene::SetLightProperties(LightSourceId firstLight, const Properties& props)
+	{
+		size_t count = std::max({props._positions.size(), props._orientations.size(), props._radii.size(), props._brightness.size(), props._cutoffRanges.size()});
+		assert(props._positions.empty() || props._positions.size() == count);
+		assert(props._orientations.empty() || props._orientations.size() == count);
+		assert(props._radii.empty() || props._radii.size() == count);
+		assert(props._brightness.empty() || props._brightness.size() == count);
+		assert(props._cutoffRanges.empty() || props._cutoffRanges.size() == count);
+		if (!count) return;
+
+		// The lookup table is sorted by id, so the range we want is a contiguous span of it. Write directly
+		// into the light objects, bypassing the interface lookup and virtual setters for each light
+		auto endLight = LightSourceId(firstLight + count);
+		for (auto i=LowerBound(_lookupTable, firstLight); i!=_lookupTable.end() && i->first < endLight; ++i) {
+			auto& light = _lightSets[i->second._lightSet]._baseData.GetObject(i->second._lightIndex);
+			auto idx = i->first - firstLight;
+			if (!props._positions.empty()) {
+				light._position = props._positions[idx];
+				light._unitLengthPosition = Normalize(light._position);
+			}
+			if (!props._orientations.empty()) light._orientation = props._orientations[idx];
+			if (!props._radii.empty()) light._radii = props._radii[idx];
+			if (!props._brightness.empty()) light._brightness = props._brightness[idx];
+			if (!props._cutoffRanges.empty()) light._cutoffRange = props._cutoffRanges[idx];
+		}
+	}
+
 	void StandardLightScene::DestroyLightSource(LightSourceId sourceId)
 	{
 		auto i = LowerBound(_lookupTable, sourceId);
@@ -183,6 +230,8 @@ namespace RenderCore { namespace LightingEngine { namespace Internal
 		switch (typeCode) {
 		case TypeHashCode<StandardLightScene>:
 			return this;
+		case TypeHashCode<ILightSourceBulkUpdate>:
+			return (ILightSourceBulkUpdate*)this;
 		default:
 			return nullptr;
 		}		
@@ -293,6 +342,7 @@ namespace RenderCore { namespace LightingEngine
 	IPositionalLightSource::~IPositionalLightSource() {}
 	IUniformEmittance::~IUniformEmittance() {}
 	IFiniteLightSource::~IFiniteLightSource() {}
+	ILightSourceBulkUpdate::~ILightSourceBulkUpdate() {}
 	IDepthTextureResolve::~IDepthTextureResolve() {}
 	IArbitraryShadowProjections::~IArbitraryShadowProjections() {}
 	IOrthoShadowProjections::~IOrthoShadowProjections() {}
@@ -106,7 +106,7 @@ namespace RenderCore { namespace LightingEngine { namespace Internal
 		using BitField = unsigned;
 	};
 
-	class StandardLightScene : public ILightScene
+	class StandardLightScene : public ILightScene, public ILightSourceBulkUpdate
 	{
 	public:
 		struct LightSet
@@ -137,6 +137,11 @@ namespace RenderCore { namespace LightingEngine { namespace Internal
 		virtual void Clear() override;
 		virtual void* QueryInterface(uint64_t) override;
 		virtual LightSourceId CreateAmbientLightSource() override;
+
+		// ILightSourceBulkUpdate
+		virtual void SetLightProperties(LightSourceId firstLight, const Properties&) override;
+		virtual LightSourceId CreateLightSources(LightOperatorId op, unsigned count) override;
+
 		StandardLightScene();
 		~StandardLightScene();
 
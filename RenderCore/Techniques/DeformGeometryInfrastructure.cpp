@@ -37,6 +37,7 @@ namespace RenderCore { namespace Techniques
 
 		std::vector<uint8_t> _deformStaticDataInput;
 		std::vector<uint8_t> _deformTemporaryBuffer;
+		unsigned _deformTemporaryInstanceSize = 0;
 
 		std::shared_ptr<IResource> _gpuStaticDataBuffer, _gpuTemporariesBuffer;
 		std::shared_ptr<IResourceView> _gpuStaticDataBufferView, _gpuTemporariesBufferView;
@@ -64,7 +65,11 @@ namespace RenderCore { namespace Techniques
 		{
 			if (_isCPUDeformer) {
 				auto staticDataPartRange = MakeIteratorRange(_deformStaticDataInput);
-				auto temporaryDeformRange = MakeIteratorRange(_deformTemporaryBuffer);
+				// CPU deformers get a separate block of temporaries for each instance, so they can deform instances in parallel
+				auto temporariesSize = size_t(_deformTemporaryInstanceSize) * instanceIdx.size();
+				if (_deformTemporaryBuffer.size() < temporariesSize)
+					_deformTemporaryBuffer.resize(temporariesSize, 0);
+				auto temporaryDeformRange = MakeIteratorRange(_deformTemporaryBuffer.data(), _deformTemporaryBuffer.data() + temporariesSize);
 				for (const auto&d:_deformOps)
 					d->ExecuteCPU(instanceIdx, _outputVBSize, staticDataPartRange, temporaryDeformRange, cpuBufferOutputRange);
 			} else {
@@ -301,7 +306,8 @@ namespace RenderCore { namespace Techniques
 		}
 
 		if (bufferIterators._bufferIterators[Internal::VB_CPUDeformTemporaries]) {
-			result->_deformTemporaryBuffer.resize(bufferIterators._bufferIterators[Internal::VB_CPUDeformTemporaries], 0);
+			result->_deformTemporaryInstanceSize = bufferIterators._bufferIterators[Internal::VB_CPUDeformTemporaries];
+			result->_deformTemporaryBuffer.resize(result->_deformTemporaryInstanceSize, 0);
 		}
 
 		// Unfortunately a bit of synchronization to finish off here. Can't complete until
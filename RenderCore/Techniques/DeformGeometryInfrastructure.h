@@ -40,6 +40,8 @@ namespace RenderCore { namespace Techniques
 			const IResourceView& dstVB,
 			Metrics& metrics) const;
 
+		// Output for instanceIndices[c] goes to c*outputInstanceStride in dstVB. deformTemporariesVB is divided
+		// evenly between the instances in the same way
 		virtual void ExecuteCPU(
 			IteratorRange<const unsigned*> instanceIndices,
 			unsigned outputInstanceStride,
@@ -25,8 +25,11 @@
 #include "../../Assets/AsyncMarkerGroup.h"
 #include "../../Assets/Marker.h"
 #include "../../Assets/ContinuationUtil.h"		// for PrepareResources
+#include "../../ConsoleRig/GlobalServices.h"
+#include "../../Utility/Threading/CompletionThreadPool.h"
 #include "../../Utility/ArithmeticUtils.h"
 #include "../../Utility/BitUtils.h"
+#include <future>
 
 using namespace Utility::Literals;
 
@@ -65,6 +68,15 @@ namespace RenderCore { namespace Techniques
 		}
 
 		static void ApplyPerDrawableUniforms(ParsingContext& parsingContext, RealExecuteDrawableContext& context, IShaderResourceDelegate& delegate, const Drawable& drawable, unsigned drawableIndex, unsigned uniformGroupIdx);
+
+		// When a packet is split across threads, each range writes its results here rather than directly
+		// into the ParsingContext (which is shared between all of the ranges)
+		struct ParallelDrawRange
+		{
+			Threading::Mutex* _uniformDelegateLock = nullptr;
+			BufferUploads::CommandListID _requiredCommandList = 0;
+			bool _somethingPending = false;
+		};
 	}
 
 	static void Draw(
@@ -73,14 +85,16 @@ namespace RenderCore { namespace Techniques
 		ParsingContext& parserContext,
 		const IPipelineAcceleratorPool& pipelineAccelerators,
 		const SequencerConfig& sequencerConfig,
-		const DrawablesPacket& drawablePkt,
+		VariantArray::const_iterator drawablesBegin,
+		VariantArray::const_iterator drawablesEnd,
+		unsigned firstDrawableIdx,
 		const ICompiledPipelineLayout& initialPipelineLayout,
 		const Internal::TemporaryStorageLocator& temporaryVB, 
 		const Internal::TemporaryStorageLocator& temporaryIB,
-		const DrawOptions& drawOptions)
+		const DrawOptions& drawOptions,
+		Internal::ParallelDrawRange* parallelRange = nullptr)
 	{
 		auto& uniformDelegateMan = *parserContext.GetUniformDelegateManager();
-		uniformDelegateMan.BringUpToDateGraphics(parserContext);
 
 		const UniformsStreamInterface& globalUSI = uniformDelegateMan.GetInterfaceGraphics();
 
@@ -96,7 +110,7 @@ namespace RenderCore { namespace Techniques
 		uint64_t currentSequencerUniformRules = 0;
 		const UniformsStreamInterface* currentLooseUniformsInterface = nullptr;
 		Metal::BoundUniforms* currentBoundUniforms = nullptr;
-		unsigned idx = 0;
+		unsigned idx = firstDrawableIdx;
 		const ICompiledPipelineLayout* currentPipelineLayout = &initialPipelineLayout;
 
 		Metal::CapturedStates capturedStates;
@@ -115,7 +129,7 @@ namespace RenderCore { namespace Techniques
 		bool somethingPending = false;
 
 		TRY {
-			for (auto d=drawablePkt._drawables.begin(); d!=drawablePkt._drawables.end(); ++d, ++idx) {
+			for (auto d=drawablesBegin; d!=drawablesEnd; ++d, ++idx) {
 				const auto& drawable = *(Drawable*)d.get();
 				assert(drawable._pipeline);
 				if (drawable._pipeline != currentPipelineAccelerator) {
@@ -158,9 +172,12 @@ namespace RenderCore { namespace Techniques
 					matDescSet = TryGetDescriptorSet(*drawable._descriptorSet, acceleratorVisibilityId);
 					if (expect_evaluation(!matDescSet, false)) { somethingPending = !IsInvalid_UnreliableTest(*drawable._descriptorSet, acceleratorVisibilityId); continue; }
 					// hack -- ensure the correct command list is requested (this is intended to have been done earlier)
-					parserContext._requiredBufferUploadsCommandList = std::max(parserContext._requiredBufferUploadsCommandList, matDescSet->GetCompletionCommandList());
-					assert(parserContext._requiredBufferUploadsCommandList >= matDescSet->GetCompletionCommandList());	// parser context must be configured for this completion cmd list before getting here
-					parserContext.RequireCommandList(matDescSet->GetCompletionCommandList());
+					if (expect_evaluation(!parallelRange, true)) {
+						parserContext._requiredBufferUploadsCommandList = std::max(parserContext._requiredBufferUploadsCommandList, matDescSet->GetCompletionCommandList());
+						assert(parserContext._requiredBufferUploadsCommandList >= matDescSet->GetCompletionCommandList());	// parser context must be configured for this completion cmd list before getting here
+						parserContext.RequireCommandList(matDescSet->GetCompletionCommandList());
+					} else
+						parallelRange->_requiredCommandList = std::max(parallelRange->_requiredCommandList, matDescSet->GetCompletionCommandList());
 				}
 
 				////////////////////////////////////////////////////////////////////////////// 
@@ -203,7 +220,12 @@ namespace RenderCore { namespace Techniques
 				//////////////////////////////////////////////////////////////////////////////
 
 				if (currentBoundUniforms->GetGroupRulesHash(0) != currentSequencerUniformRules) {
-					ApplyUniformsGraphics(uniformDelegateMan, metalContext, encoder, parserContext, *currentBoundUniforms, s_uniformGroupSequencer);
+					if (expect_evaluation(!parallelRange, true)) {
+						ApplyUniformsGraphics(uniformDelegateMan, metalContext, encoder, parserContext, *currentBoundUniforms, s_uniformGroupSequencer);
+					} else {
+						ScopedLock(*parallelRange->_uniformDelegateLock);
+						ApplyUniformsGraphics(uniformDelegateMan, metalContext, encoder, parserContext, *currentBoundUniforms, s_uniformGroupSequencer);
+					}
 					currentSequencerUniformRules = currentBoundUniforms->GetGroupRulesHash(0);
 					++fullDescSetCount;
 				} 
@@ -236,23 +258,20 @@ namespace RenderCore { namespace Techniques
 			throw;
 		} CATCH_END
 
-		if (somethingPending)		// Ensure we mark the parser content to indicate that something is pending (this can cause GUI windows to refresh, etc)
+		if (parallelRange)
+			parallelRange->_somethingPending |= somethingPending;
+		else if (somethingPending)		// Ensure we mark the parser content to indicate that something is pending (this can cause GUI windows to refresh, etc)
 			StringMeldAppend(parserContext._stringHelpers->_pendingAssets) << "Drawables pipeline or material\n";
 		encoder.SetStencilRef(0,0);	// reset to avoid state leakage type issues
 		encoder.EndStateCapture();
 	}
 
-	void Draw(
+	static void MapPacketStorage(
 		RenderCore::Metal::DeviceContext& metalContext,
-		RenderCore::Metal::GraphicsEncoder_Optimized& encoder,
-        ParsingContext& parserContext,
-		const IPipelineAcceleratorPool& pipelineAccelerators,
-		const SequencerConfig& sequencerConfig,
 		const DrawablesPacket& drawablePkt,
-		const ICompiledPipelineLayout& initialPipelineLayout,
-		const DrawOptions& drawOptions)
+		Internal::TemporaryStorageLocator& temporaryVB,
+		Internal::TemporaryStorageLocator& temporaryIB)
 	{
-		Internal::TemporaryStorageLocator temporaryVB, temporaryIB;
 		if (!drawablePkt.GetStorage(DrawablesPacket::Storage::Vertex).empty()) {
 			auto srcData = drawablePkt.GetStorage(DrawablesPacket::Storage::Vertex);
 			auto mappedData = metalContext.MapTemporaryStorage(srcData.size(), BindFlag::VertexBuffer);
@@ -268,11 +287,27 @@ namespace RenderCore { namespace Techniques
 			temporaryIB = { mappedData.GetResource().get(), mappedData.GetBeginAndEndInResource().first, mappedData.GetBeginAndEndInResource().second };
 		}
 		assert(drawablePkt.GetStorage(DrawablesPacket::Storage::Uniform).empty());
+	}
+
+	void Draw(
+		RenderCore::Metal::DeviceContext& metalContext,
+		RenderCore::Metal::GraphicsEncoder_Optimized& encoder,
+        ParsingContext& parserContext,
+		const IPipelineAcceleratorPool& pipelineAccelerators,
+		const SequencerConfig& sequencerConfig,
+		const DrawablesPacket& drawablePkt,
+		const ICompiledPipelineLayout& initialPipelineLayout,
+		const DrawOptions& drawOptions)
+	{
+		Internal::TemporaryStorageLocator temporaryVB, temporaryIB;
+		MapPacketStorage(metalContext, drawablePkt, temporaryVB, temporaryIB);
 		assert(drawOptions._pipelineAcceleratorsVisibility.has_value() || &pipelineAccelerators == parserContext.GetTechniqueContext()._pipelineAccelerators.get());		// if we're not using the default pipeline accelerators, we should explicitly specify the visibility
 
+		parserContext.GetUniformDelegateManager()->BringUpToDateGraphics(parserContext);
 		Draw(
-			metalContext, encoder, parserContext, pipelineAccelerators, sequencerConfig, drawablePkt, initialPipelineLayout, temporaryVB, temporaryIB, 
-			drawOptions);
+			metalContext, encoder, parserContext, pipelineAccelerators, sequencerConfig, 
+			drawablePkt._drawables.begin(), drawablePkt._drawables.end(), 0,
+			initialPipelineLayout, temporaryVB, temporaryIB, drawOptions);
 	}
 
 	void Draw(
@@ -301,6 +336,116 @@ namespace RenderCore { namespace Techniques
 		pipelineAccelerators.UnlockForReading();
 	}
 
+	namespace Internal
+	{
+		static const unsigned s_maxParallelDrawRanges = 32;
+	}
+
+	ParallelDrawMetrics DrawParallel(
+		ParsingContext& parserContext,
+		const IPipelineAcceleratorPool& pipelineAccelerators,
+		const SequencerConfig& sequencerConfig,
+		const DrawablesPacket& drawablePkt,
+		const DrawOptions& drawOptions,
+		const ParallelDrawOptions& parallelOptions)
+	{
+		auto startTime = std::chrono::steady_clock::now();
+		ParallelDrawMetrics metrics;
+
+		auto& threadContext = parserContext.GetThreadContext();
+		auto& primaryContext = *Metal::DeviceContext::Get(threadContext);
+
+		// Packet storage is mapped once on the primary command list and shared between all ranges
+		Internal::TemporaryStorageLocator temporaryVB, temporaryIB;
+		MapPacketStorage(primaryContext, drawablePkt, temporaryVB, temporaryIB);
+		assert(drawOptions._pipelineAcceleratorsVisibility.has_value() || &pipelineAccelerators == parserContext.GetTechniqueContext()._pipelineAccelerators.get());
+
+		auto drawableCount = (unsigned)drawablePkt._drawables.size_entries();
+		auto& pool = ConsoleRig::GlobalServices::GetInstance().GetShortTaskThreadPool();
+		unsigned rangeCount = 1;
+		if (pool.IsGood()) {
+			unsigned maxRanges = parallelOptions._maxThreadCount ? parallelOptions._maxThreadCount : (pool.GetThreadContext()+1);
+			maxRanges = std::min(maxRanges, Internal::s_maxParallelDrawRanges);
+			rangeCount = std::max(1u, std::min(maxRanges, drawableCount / std::max(1u, parallelOptions._minDrawablesPerRange)));
+		}
+
+		struct Range
+		{
+			VariantArray::const_iterator _begin, _end;
+			unsigned _firstDrawableIdx;
+			std::unique_ptr<IThreadContext> _workerThreadContext;		// (command pools can't be shared between threads, so each worker range gets its own)
+			std::shared_ptr<Metal::DeviceContext> _metalContext;
+			Internal::ParallelDrawRange _result;
+			std::chrono::steady_clock::duration _recordTime { 0 };
+		};
+		std::vector<Range> ranges;
+		ranges.reserve(rangeCount);
+		Threading::Mutex uniformDelegateLock;
+
+		pipelineAccelerators.LockForReading();
+		TRY {
+			uint32_t acceleratorVisibilityId = ~0u;
+			auto* pipelineLayout = TryGetCompiledPipelineLayout(sequencerConfig, acceleratorVisibilityId);
+			assert(pipelineLayout);
+			parserContext.GetUniformDelegateManager()->BringUpToDateGraphics(parserContext);
+
+			auto d = drawablePkt._drawables.begin();
+			unsigned idx = 0;
+			for (unsigned r=0; r<rangeCount; ++r) {
+				auto rangeBegin = d;
+				unsigned firstIdx = idx;
+				for (unsigned rangeEnd=drawableCount*(r+1)/rangeCount; idx<rangeEnd; ++idx) ++d;
+				std::unique_ptr<IThreadContext> workerThreadContext;
+				if (r != 0) workerThreadContext = threadContext.GetDevice()->CreateDeferredContext();
+				auto metalContext = Metal::DeviceContext::BeginSecondaryCommandList(workerThreadContext ? *workerThreadContext : threadContext, primaryContext);
+				ranges.push_back(Range{rangeBegin, d, firstIdx, std::move(workerThreadContext), std::move(metalContext)});
+				ranges.back()._result._uniformDelegateLock = &uniformDelegateLock;
+			}
+
+			auto viewport = parserContext.GetViewport();
+			Rect2D scissorRect { (int)viewport._x, (int)viewport._y, (unsigned)viewport._width, (unsigned)viewport._height };
+			auto recordRange = [&](unsigned r) {
+				auto rangeStartTime = std::chrono::steady_clock::now();
+				auto& range = ranges[r];
+				auto encoder = range._metalContext->BeginGraphicsEncoder(*pipelineLayout);
+				encoder.Bind(MakeIteratorRange(&viewport, &viewport+1), MakeIteratorRange(&scissorRect, &scissorRect+1));
+				Draw(
+					*range._metalContext, encoder, parserContext, pipelineAccelerators, sequencerConfig,
+					range._begin, range._end, range._firstDrawableIdx,
+					*pipelineLayout, temporaryVB, temporaryIB, drawOptions, &range._result);
+				range._recordTime = std::chrono::steady_clock::now() - rangeStartTime;
+			};
+			if (rangeCount > 1) {
+				ParallelFor(pool, rangeCount, recordRange);
+			} else
+				recordRange(0);
+
+			// Execute in packet order, so the result is the same as recording the packet serially
+			bool somethingPending = false;
+			for (auto& range:ranges) {
+				auto cmdList = range._metalContext->ResolveCommandList();
+				primaryContext.ExecuteCommandList(std::move(*cmdList));
+				if (range._result._requiredCommandList) {
+					parserContext._requiredBufferUploadsCommandList = std::max(parserContext._requiredBufferUploadsCommandList, range._result._requiredCommandList);
+					parserContext.RequireCommandList(range._result._requiredCommandList);
+				}
+				somethingPending |= range._result._somethingPending;
+				metrics._longestRangeTime = std::max(metrics._longestRangeTime, std::chrono::duration_cast<std::chrono::nanoseconds>(range._recordTime));
+				metrics._sumRangeTime += std::chrono::duration_cast<std::chrono::nanoseconds>(range._recordTime);
+			}
+			if (somethingPending)
+				StringMeldAppend(parserContext._stringHelpers->_pendingAssets) << "Drawables pipeline or material\n";
+		} CATCH (...) {
+			pipelineAccelerators.UnlockForReading();
+			throw;
+		} CATCH_END
+		pipelineAccelerators.UnlockForReading();
+
+		metrics._rangeCount = rangeCount;
+		metrics._totalTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime);
+		return metrics;
+	}
+
 	static const std::string s_graphicsPipeline { "graphics-pipeline" };
 	static const std::string s_descriptorSet { "descriptor-set" };
 
@@ -15,6 +15,7 @@
 #include <vector>
 #include <memory>
 #include <string>
+#include <chrono>
 
 namespace Utility { class ParameterBox; }
 namespace RenderCore { class IThreadContext; class MiniInputElementDesc; class InputElementDesc; class UniformsStreamInterface; class UniformsStream; class DescriptorSetSignature; }
@@ -218,6 +219,41 @@ namespace RenderCore { namespace Techniques
 		const DrawablesPacket& drawablePkt,
 		const DrawOptions& drawOptions = {});
 
+	struct ParallelDrawOptions
+	{
+		unsigned _maxThreadCount = 0;			// 0 means all of the short task thread pool workers, plus the calling thread
+		unsigned _minDrawablesPerRange = 256;	// packets smaller than this are recorded on the calling thread only
+	};
+
+	struct ParallelDrawMetrics
+	{
+		unsigned _rangeCount = 0;
+		std::chrono::nanoseconds _totalTime { 0 };			// wall clock, from splitting the packet until every range has been executed
+		std::chrono::nanoseconds _longestRangeTime { 0 };
+		std::chrono::nanoseconds _sumRangeTime { 0 };
+	};
+
+	/// <summary>Draw a packet by recording ranges of it concurrently into secondary command lists</summary>
+	/// The drawables are split into contiguous ranges, and each range is recorded into its own secondary command
+	/// list (with its own temporary storage) on the short task thread pool. The command lists are then executed in
+	/// packet order on the thread context's primary command list, so the result matches Draw().
+	///
+	/// The current subpass must have been begun for secondary command lists (see RenderPassBeginDesc::_secondaryCommandListSubpasses),
+	/// which means that everything else drawn in that subpass must also go via secondary command lists.
+	/// Drawable draw functions and DrawOptions::_perDrawableUniforms are called from multiple threads at the same
+	/// time, so they must be thread safe, must not write to the ParsingContext and must only record commands via the
+	/// ExecuteDrawableContext they're given. Drawables that use loose uniforms
+	/// with shared descriptor set builders can't be recorded in parallel.
+	///
+	/// Small packets are still recorded into a (single) secondary command list, on the calling thread.
+	ParallelDrawMetrics DrawParallel(
+		ParsingContext& parserContext,
+		const IPipelineAcceleratorPool& pipelineAccelerators,
+		const SequencerConfig& sequencerConfig,
+		const DrawablesPacket& drawablePkt,
+		const DrawOptions& drawOptions = {},
+		const ParallelDrawOptions& parallelOptions = {});
+
 	struct PreparedResourcesVisibility
 	{
 		VisibilityMarkerId _pipelineAcceleratorsVisibility = 0;
@@ -19,11 +19,14 @@
 #include "../../Utility/ArithmeticUtils.h"
 #include "../../Utility/StreamUtils.h"
 #include "../../Utility/StringFormat.h"
+#include "../../Utility/Threading/Mutex.h"
 #include <cmath>
 #include <sstream>
 #include <iostream>
 #include <unordered_map>
 #include <set>
+#include <algorithm>
+#include <type_traits>
 
 #pragma GCC diagnostic ignored "-Wmicrosoft-sealed"
 
@@ -1691,7 +1694,7 @@ namespace RenderCore { namespace Techniques
         #if defined(_DEBUG)
             _attachedContext->BeginLabel(_layout->GetSubpasses()[0]._name.empty() ? "<<unnnamed subpass>>" : _layout->GetSubpasses()[0]._name.c_str());
         #endif
-        _attachedContext->BeginRenderPass(*_frameBuffer, beginInfo._clearValues);
+        _attachedContext->BeginRenderPass(*_frameBuffer, beginInfo._clearValues, beginInfo._secondaryCommandListSubpasses);
         _attachedParsingContext = nullptr;
     }
 
@@ -1714,7 +1717,7 @@ namespace RenderCore { namespace Techniques
         #if defined(_DEBUG)
             _attachedContext->BeginLabel(_layout->GetSubpasses()[0]._name.empty() ? "<<unnnamed subpass>>" : _layout->GetSubpasses()[0]._name.c_str());
         #endif
-        _attachedContext->BeginRenderPass(*_frameBuffer, beginInfo._clearValues);
+        _attachedContext->BeginRenderPass(*_frameBuffer, beginInfo._clearValues, beginInfo._secondaryCommandListSubpasses);
         _attachedParsingContext = nullptr;
     }
 
@@ -2661,8 +2664,176 @@ namespace RenderCore { namespace Techniques
     static void PatchInDefaultLayouts(FrameBufferDescFragment& fragment);
     static void CheckNonFrameBufferAttachmentLayouts(FrameBufferDescFragment& fragment);
 
+    class FragmentStitchingCache::Pimpl
+    {
+    public:
+        struct Entry
+        {
+            std::vector<uint8_t> _key;
+            std::shared_ptr<const MergeFragmentsResult> _merged;
+            unsigned _lastUsed = 0;
+        };
+        std::vector<std::pair<uint64_t, Entry>> _entries;
+        unsigned _usageCounter = 0;
+        unsigned _maxEntries = 0;
+        Metrics _metrics;
+        mutable Threading::Mutex _lock;
+
+        std::shared_ptr<const MergeFragmentsResult> TryGet(uint64_t hash, IteratorRange<const uint8_t*> key)
+        {
+            ScopedLock(_lock);
+            auto i = LowerBound(_entries, hash);
+            // confirm the key, so that a hash collision is just a miss
+            if (i == _entries.end() || i->first != hash || !std::equal(key.begin(), key.end(), i->second._key.begin(), i->second._key.end())) {
+                ++_metrics._misses;
+                return nullptr;
+            }
+            ++_metrics._hits;
+            i->second._lastUsed = ++_usageCounter;
+            return i->second._merged;
+        }
+
+        void Add(uint64_t hash, std::vector<uint8_t>&& key, std::shared_ptr<const MergeFragmentsResult> merged, std::chrono::nanoseconds mergeTime)
+        {
+            ScopedLock(_lock);
+            _metrics._mergeTime += mergeTime;
+            auto i = LowerBound(_entries, hash);
+            if (i != _entries.end() && i->first == hash) {
+                if (i->second._key == key) {
+                    // another thread merged the same fragments at the same time
+                    i->second._lastUsed = ++_usageCounter;
+                } else {
+                    // hash collision; just replace the previous entry
+                    i->second = Entry{std::move(key), std::move(merged), ++_usageCounter};
+                }
+                return;
+            }
+            if (_entries.size() >= _maxEntries) {
+                auto lru = std::min_element(_entries.begin(), _entries.end(), [](const auto& lhs, const auto& rhs) { return lhs.second._lastUsed < rhs.second._lastUsed; });
+                _entries.erase(lru);
+                i = LowerBound(_entries, hash);
+            }
+            _entries.insert(i, std::make_pair(hash, Entry{std::move(key), std::move(merged), ++_usageCounter}));
+        }
+    };
+
+    auto FragmentStitchingCache::GetMetrics() const -> Metrics
+    {
+        ScopedLock(_pimpl->_lock);
+        return _pimpl->_metrics;
+    }
+
+    void FragmentStitchingCache::Clear()
+    {
+        ScopedLock(_pimpl->_lock);
+        _pimpl->_entries.clear();
+    }
+
+    FragmentStitchingCache::FragmentStitchingCache(unsigned maxEntries)
+    {
+        assert(maxEntries != 0);
+        _pimpl = std::make_unique<Pimpl>();
+        _pimpl->_maxEntries = maxEntries;
+    }
+
+    FragmentStitchingCache::~FragmentStitchingCache() = default;
+
+    // Everything that MergeFragments() depends on (excluding dimensions), packed into a blob so that the cache
+    // can compare keys exactly
+    static std::vector<uint8_t> MakeStitchingCacheKey(
+        IteratorRange<const PreregisteredAttachment*> preregisteredAttachments,
+        const FrameBufferProperties& fbProps,
+        IteratorRange<const Format*> systemFormats,
+        IteratorRange<const FrameBufferDescFragment*> fragments)
+    {
+        std::vector<uint8_t> result;
+        result.reserve(1024);
+        auto append = [&result](const auto& value) {
+            static_assert(std::is_trivially_copyable_v<std::decay_t<decltype(value)>>);
+            auto* bytes = (const uint8_t*)&value;
+            result.insert(result.end(), bytes, bytes+sizeof(value));
+        };
+        auto appendRange = [&append](auto range) {
+            append(uint64_t(range.size()));
+            for (const auto& e:range) append(e);
+        };
+
+        append(fbProps.GetHashResolutionIndependent());
+        append(uint64_t(preregisteredAttachments.size()));
+        for (const auto& a:preregisteredAttachments) {
+            append(a._semantic);
+            append(uint64_t(a._desc._type) | (uint64_t(a._desc._bindFlags) << 2ull) | (uint64_t(a._desc._allocationRules) << 18ull));
+            if (a._desc._type == ResourceDesc::Type::Texture)
+                append(a._desc._textureDesc.CalculateHashResolutionIndependent());
+            append(a._state);
+            append(a._layout);
+            append(a._defaultView);
+        }
+        appendRange(systemFormats);
+
+        for (const auto& f:fragments) {
+            append(uint64_t(f._attachments.size()) | (uint64_t(f._subpasses.size()) << 32ull) | (uint64_t(f._pipelineType) << 48ull));
+            for (const auto& a:f._attachments) {
+                append(a._semantic);
+
+                // only the matching rules that have been set are meaningful
+                const auto& rules = a._matchingRules;
+                append(uint64_t(rules._flagsSet) | (uint64_t(rules._requiredBindFlags) << 32ull));
+                if (rules._flagsSet & (uint32_t)AttachmentMatchingRules::Flags::FixedFormat)
+                    append(rules._fixedFormat);
+                if (rules._flagsSet & (uint32_t)AttachmentMatchingRules::Flags::SystemFormat)
+                    append(rules._systemFormat);
+                if (rules._flagsSet & (uint32_t)AttachmentMatchingRules::Flags::MultisamplingMode)
+                    append(rules._multisamplingMode);
+                if (rules._flagsSet & (uint32_t)AttachmentMatchingRules::Flags::CopyFormatFromSemantic)
+                    append(rules._copyFormatSrc);
+
+                append(
+                    uint64_t(a._loadFromPreviousPhase) | (uint64_t(a._storeToNextPhase) << 8ull)
+                    | (uint64_t(a._initialLayout.has_value()) << 16ull) | (uint64_t(a._finalLayout.has_value()) << 17ull));
+                if (a._initialLayout) append(*a._initialLayout);
+                if (a._finalLayout) append(*a._finalLayout);
+            }
+            for (const auto& sp:f._subpasses) {
+                appendRange(sp.GetOutputs());
+                appendRange(sp.GetInputs());
+                appendRange(sp.GetResolveOutputs());
+                append(sp.GetDepthStencil());
+                append(sp.GetResolveDepthStencil());
+                append(sp.GetViewInstanceMask());
+                append(uint64_t(sp._nonfbViews.size()));
+                for (const auto& v:sp._nonfbViews) {
+                    append(v._resourceName);
+                    append(v._usage);
+                    append(v._window);
+                }
+            }
+        }
+        return result;
+    }
+
     auto FragmentStitchingContext::TryStitchFrameBufferDesc(IteratorRange<const FrameBufferDescFragment*> fragments, const FrameBufferProperties& fbProps) -> StitchResult
     {
+        if (_cache) {
+            // MergeFragments() doesn't depend on any dimensions, so we can key the cache on only the resolution independent properties
+            auto key = MakeStitchingCacheKey(MakeIteratorRange(_workingAttachments), fbProps, MakeIteratorRange(_systemFormats), fragments);
+            auto hash = Hash64(AsPointer(key.begin()), AsPointer(key.end()));
+
+            auto merged = _cache->_pimpl->TryGet(hash, key);
+            if (!merged) {
+                auto startTime = std::chrono::steady_clock::now();
+                auto newMerged = std::make_shared<MergeFragmentsResult>(MergeFragments(MakeIteratorRange(_workingAttachments), fragments, fbProps, MakeIteratorRange(_systemFormats)));
+                PatchInDefaultLayouts(newMerged->_mergedFragment);
+                CheckNonFrameBufferAttachmentLayouts(newMerged->_mergedFragment);
+                _cache->_pimpl->Add(hash, std::move(key), newMerged, std::chrono::steady_clock::now() - startTime);
+                merged = std::move(newMerged);
+            }
+
+            auto stitched = TryStitchFrameBufferDescInternal(merged->_mergedFragment, fbProps);
+            stitched._log = merged->_log;
+            return stitched;
+        }
+
         auto merged = MergeFragments(MakeIteratorRange(_workingAttachments), fragments, fbProps, MakeIteratorRange(_systemFormats));
         PatchInDefaultLayouts(merged._mergedFragment);
         CheckNonFrameBufferAttachmentLayouts(merged._mergedFragment);
@@ -3246,6 +3417,168 @@ namespace RenderCore { namespace Techniques
         return result;
     }
 
+    std::pair<unsigned, size_t> TransientAttachmentAliasing::Find(unsigned frameBufferIdx, AttachmentName attachment) const
+    {
+        for (const auto& t:_transients)
+            for (const auto& r:t._references)
+                if (r.first == frameBufferIdx && r.second == attachment)
+                    return {t._block, t._blockOffset};
+        return {~0u, 0};
+    }
+
+    TransientAttachmentAliasing CalculateTransientAttachmentAliasing(
+        IteratorRange<const FragmentStitchingContext::StitchResult*> stitchedFrameBuffers,
+        size_t blockAlignment)
+    {
+        assert(blockAlignment != 0);
+        auto calculateByteCount = [blockAlignment](const ResourceDesc& desc) {
+            size_t byteCount = ByteCount(desc);
+            if (desc._type == ResourceDesc::Type::Texture)
+                byteCount *= std::max(1u, (unsigned)desc._textureDesc._samples._sampleCount);
+            return (byteCount + blockAlignment - 1) / blockAlignment * blockAlignment;
+        };
+
+        // Walk through the sequence, following each semantic from the frame buffer that generates it to
+        // the last one that loads it. "openSemantics" holds the attachments whose contents are retained
+        // for later frame buffers
+        const unsigned persistentMarker = ~0u;
+        std::vector<TransientAttachmentAliasing::Transient> candidates;
+        std::vector<std::pair<uint64_t, unsigned>> openSemantics;
+        std::vector<uint64_t> countedPersistentSemantics;
+        size_t persistentBytes = 0;
+        for (unsigned fbIdx=0; fbIdx<stitchedFrameBuffers.size(); ++fbIdx) {
+            const auto& fb = stitchedFrameBuffers[fbIdx];
+            assert(fb._fullAttachmentDescriptions.size() == fb._attachmentTransforms.size());
+            for (unsigned aIdx=0; aIdx<fb._attachmentTransforms.size(); ++aIdx) {
+                const auto& attachment = fb._fullAttachmentDescriptions[aIdx];
+                auto type = fb._attachmentTransforms[aIdx]._type;
+                bool loads = type == AttachmentTransform::LoadedAndStored || type == AttachmentTransform::Consumed;
+                bool retains = type == AttachmentTransform::LoadedAndStored || type == AttachmentTransform::Generated;
+
+                auto open = attachment._semantic ? LowerBound(openSemantics, attachment._semantic) : openSemantics.end();
+                bool isOpen = open != openSemantics.end() && open->first == attachment._semantic;
+                unsigned candidateIdx = persistentMarker;
+                if (loads) {
+                    if (isOpen) {
+                        candidateIdx = open->second;
+                        if (!retains) openSemantics.erase(open);
+                    } else {
+                        // loaded from outside of the sequence, so we don't control its lifetime
+                        if (retains && attachment._semantic) openSemantics.insert(open, {attachment._semantic, persistentMarker});
+                    }
+                } else {
+                    // contents are not required on entry, so this is the start of a new lifetime, even if the semantic was used before
+                    candidateIdx = (unsigned)candidates.size();
+                    TransientAttachmentAliasing::Transient newTransient;
+                    newTransient._semantic = attachment._semantic;
+                    newTransient._desc = attachment._desc;
+                    newTransient._firstFrameBuffer = newTransient._lastFrameBuffer = fbIdx;
+                    newTransient._byteCount = calculateByteCount(attachment._desc);
+                    candidates.push_back(std::move(newTransient));
+                    if (retains && attachment._semantic) {
+                        if (isOpen) open->second = candidateIdx;
+                        else openSemantics.insert(open, {attachment._semantic, candidateIdx});
+                    } else if (isOpen)
+                        openSemantics.erase(open);
+                }
+
+                if (candidateIdx != persistentMarker) {
+                    candidates[candidateIdx]._lastFrameBuffer = fbIdx;
+                    candidates[candidateIdx]._references.emplace_back(fbIdx, aIdx);
+                } else {
+                    auto i = std::lower_bound(countedPersistentSemantics.begin(), countedPersistentSemantics.end(), attachment._semantic);
+                    if (i == countedPersistentSemantics.end() || *i != attachment._semantic) {
+                        countedPersistentSemantics.insert(i, attachment._semantic);
+                        persistentBytes += calculateByteCount(attachment._desc);
+                    }
+                }
+            }
+        }
+
+        // Anything still retained at the end of the sequence is an output, and must have it's own memory
+        std::vector<bool> isOutput(candidates.size(), false);
+        for (const auto& o:openSemantics)
+            if (o.second != persistentMarker) {
+                isOutput[o.second] = true;
+                persistentBytes += candidates[o.second]._byteCount;
+            }
+
+        TransientAttachmentAliasing result;
+        result._persistentBytes = persistentBytes;
+        result._transients.reserve(candidates.size());
+        for (unsigned c=0; c<candidates.size(); ++c)
+            if (!isOutput[c])
+                result._transients.push_back(std::move(candidates[c]));
+
+        for (const auto& t:result._transients) result._unaliasedBytes += t._byteCount;
+        for (unsigned fbIdx=0; fbIdx<stitchedFrameBuffers.size(); ++fbIdx) {
+            size_t liveBytes = 0;
+            for (const auto& t:result._transients)
+                if (t._firstFrameBuffer <= fbIdx && fbIdx <= t._lastFrameBuffer)
+                    liveBytes += t._byteCount;
+            result._peakLiveBytes = std::max(result._peakLiveBytes, liveBytes);
+        }
+
+        // Pack largest first. Each block is sized by the first (and so largest) transient placed in it; later
+        // transients go at the lowest offset that doesn't collide with a transient alive at the same time
+        std::vector<unsigned> packingOrder;
+        packingOrder.reserve(result._transients.size());
+        for (unsigned c=0; c<result._transients.size(); ++c) packingOrder.push_back(c);
+        std::stable_sort(
+            packingOrder.begin(), packingOrder.end(),
+            [&transients=result._transients](unsigned lhs, unsigned rhs) { return transients[lhs]._byteCount > transients[rhs]._byteCount; });
+
+        std::vector<std::vector<unsigned>> blockMembers;
+        std::vector<std::pair<size_t, size_t>> occupied;
+        for (auto t:packingOrder) {
+            auto& transient = result._transients[t];
+            for (unsigned b=0; b<result._blockSizes.size() && transient._block == ~0u; ++b) {
+                occupied.clear();
+                for (auto m:blockMembers[b]) {
+                    const auto& member = result._transients[m];
+                    if (member._firstFrameBuffer <= transient._lastFrameBuffer && transient._firstFrameBuffer <= member._lastFrameBuffer)
+                        occupied.emplace_back(member._blockOffset, member._blockOffset + member._byteCount);
+                }
+                std::sort(occupied.begin(), occupied.end());
+
+                size_t offset = 0;
+                for (const auto& o:occupied) {
+                    if (offset + transient._byteCount <= o.first) break;
+                    offset = std::max(offset, o.second);
+                }
+                if (offset + transient._byteCount <= result._blockSizes[b]) {
+                    transient._block = b;
+                    transient._blockOffset = offset;
+                    blockMembers[b].push_back(t);
+                }
+            }
+
+            if (transient._block == ~0u) {
+                transient._block = (unsigned)result._blockSizes.size();
+                transient._blockOffset = 0;
+                result._blockSizes.push_back(transient._byteCount);
+                blockMembers.push_back({t});
+            }
+        }
+
+        for (auto b:result._blockSizes) result._aliasedBytes += b;
+        return result;
+    }
+
+    std::ostream& operator<<(std::ostream& str, const TransientAttachmentAliasing& aliasing)
+    {
+        auto toMB = [](size_t bytes) { return bytes / (1024.f*1024.f); };
+        str << "Transient attachments: " << aliasing._transients.size() << " in " << aliasing._blockSizes.size() << " block(s)" << std::endl;
+        str << "  Without aliasing: " << toMB(aliasing._unaliasedBytes) << "MB, with aliasing: " << toMB(aliasing._aliasedBytes) << "MB, peak live: " << toMB(aliasing._peakLiveBytes) << "MB" << std::endl;
+        str << "  Persistent (not aliased): " << toMB(aliasing._persistentBytes) << "MB" << std::endl;
+        for (const auto& t:aliasing._transients) {
+            str << "  [" << AttachmentSemantic{t._semantic} << "] " << t._desc
+                << ", frame buffers " << t._firstFrameBuffer << "-" << t._lastFrameBuffer
+                << ", block " << t._block << " at " << toMB(t._blockOffset) << "MB (" << toMB(t._byteCount) << "MB)" << std::endl;
+        }
+        return str;
+    }
+
     static Format FallbackChain(IDevice& device, std::initializer_list<Format> fmts, BindFlag::BitField bindFlags)
     {
         for (auto f:fmts)
@@ -15,6 +15,8 @@
 #include "../../Utility/IteratorUtils.h"
 #include "../../Utility/MemoryUtils.h"
 #include <memory>
+#include <chrono>
+#include <iosfwd>
 
 namespace RenderCore 
 {
@@ -31,6 +33,7 @@ namespace RenderCore
 namespace RenderCore { namespace Techniques
 {
     struct PreregisteredAttachment;
+    class FragmentStitchingCache;
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -229,6 +232,9 @@ namespace RenderCore { namespace Techniques
 
         Format _systemFormats[(unsigned)SystemAttachmentFormat::Max];
 
+        // Optional. When set, the resolution independent part of stitching (MergeFragments) is looked up here first
+        std::shared_ptr<FragmentStitchingCache> _cache;
+
         FragmentStitchingContext(
             IteratorRange<const PreregisteredAttachment*> preregAttachments = {}, 
             IteratorRange<const Format*> systemFormats = {});
@@ -257,6 +263,75 @@ namespace RenderCore { namespace Techniques
 		const FrameBufferProperties& fbProps,
         IteratorRange<const Format*> systemAttachmentFormats);      // systemAttachmentFormats indexed by SystemAttachmentFormat
 
+    /// <summary>Retains merged fragments so that stitching can skip MergeFragments() when only dimensions change</summary>
+    /// The result of MergeFragments() depends on the fragments, the system formats and the resolution independent
+    /// parts of the preregistered attachments and FrameBufferProperties; but not on the dimensions of anything.
+    /// So when a technique is rebuilt for a new output resolution, the merge can be reused and only the (much cheaper)
+    /// final stitch must be redone. A single cache can be shared by many FragmentStitchingContexts (and threads).
+    class FragmentStitchingCache
+    {
+    public:
+        struct Metrics
+        {
+            unsigned _hits = 0, _misses = 0;
+            std::chrono::nanoseconds _mergeTime{0};         // time spent in MergeFragments() for misses
+        };
+        Metrics GetMetrics() const;
+        void Clear();
+
+        FragmentStitchingCache(unsigned maxEntries = 128);
+        ~FragmentStitchingCache();
+        FragmentStitchingCache(const FragmentStitchingCache&) = delete;
+        FragmentStitchingCache& operator=(const FragmentStitchingCache&) = delete;
+    private:
+        class Pimpl;
+        std::unique_ptr<Pimpl> _pimpl;
+        friend class FragmentStitchingContext;
+    };
+
+    /// <summary>Lifetimes of the transient attachments in a sequence of stitched frame buffers, and how they can share memory</summary>
+    /// An attachment is transient if it's created within the sequence and its contents are not required after it. An attachment
+    /// passed from one frame buffer to a later one (via a semantic) is treated as a single transient with a lifetime that covers
+    /// both. Attachments that are loaded from outside of the sequence, or still retained at the end of it are persistent, and
+    /// are not candidates for aliasing.
+    ///
+    /// Lifetimes are tracked per frame buffer (not per subpass), since every attachment in a render pass is bound for the entire
+    /// render pass. Transients with non-overlapping lifetimes are packed into shared memory blocks. Everything here is calculated
+    /// from the descriptions alone; there's no interaction with the device.
+    ///
+    /// This is an analysis only; nothing consumes the plan yet. The device layer has no way to create a resource within
+    /// memory owned by another (ie, placed/aliased allocations), so AttachmentPool still creates a separate resource for each
+    /// attachment it can't satisfy by reusing an unlocked attachment with a matching desc. Use the results to measure what
+    /// aliasing would save before adding that path.
+    struct TransientAttachmentAliasing
+    {
+        struct Transient
+        {
+            uint64_t _semantic = 0;
+            ResourceDesc _desc;
+            unsigned _firstFrameBuffer = 0, _lastFrameBuffer = 0;      // inclusive, indices into the stitched sequence
+            size_t _byteCount = 0;          // rounded up to the block alignment
+            unsigned _block = ~0u;
+            size_t _blockOffset = 0;
+            std::vector<std::pair<unsigned, AttachmentName>> _references;       // (frame buffer index, attachment index in that frame buffer)
+        };
+        std::vector<Transient> _transients;
+        std::vector<size_t> _blockSizes;
+
+        size_t _unaliasedBytes = 0;         // every transient with its own allocation
+        size_t _aliasedBytes = 0;           // sum of _blockSizes
+        size_t _peakLiveBytes = 0;          // largest total of transients alive at the same time (the lower bound for any packing)
+        size_t _persistentBytes = 0;        // attachments excluded from aliasing
+
+        std::pair<unsigned, size_t> Find(unsigned frameBufferIdx, AttachmentName attachment) const;     // returns (block, offset)
+    };
+
+    TransientAttachmentAliasing CalculateTransientAttachmentAliasing(
+        IteratorRange<const FragmentStitchingContext::StitchResult*> stitchedFrameBuffers,
+        size_t blockAlignment = 64*1024);
+
+    std::ostream& operator<<(std::ostream& str, const TransientAttachmentAliasing& aliasing);
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
     class AttachmentReservation;
@@ -396,6 +471,7 @@ namespace RenderCore { namespace Techniques
     struct RenderPassBeginDesc
     {
         IteratorRange<const ClearValue*>    _clearValues;
+        uint64_t                            _secondaryCommandListSubpasses = 0;     // bit per subpass drawn only via secondary command lists (eg, DrawParallel)
     };
 
     /// <summary>Stores a set of retained frame buffers, which can be reused frame-to-frame</summary>
@@ -21,9 +21,18 @@
 #include "../../Assets/ContinuationUtil.h"
 #include "../../Assets/Assets.h"
 #include "../../Math/Transformations.h"
+#include "../../ConsoleRig/GlobalServices.h"
+#include "../../Utility/Threading/CompletionThreadPool.h"
 #include "../../xleres/FileList.h"
+#include <future>
+#include <cstring>
 #include <assert.h>
 
+#if (defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)) && defined(__SSE4_1__)
+	#include <immintrin.h>			// MSVC & clang intrinsic
+	#define HAS_SSE_INSTRUCTIONS
+#endif
+
 using namespace Utility::Literals;
 
 namespace RenderCore { namespace Techniques
@@ -43,28 +52,189 @@ namespace RenderCore { namespace Techniques
 		return {src.begin(), src.end()};
 	}
 
-	void CPUSkinDeformer::WriteJointTransforms(
-		const Section& section,
-		IteratorRange<Float3x4*>		destination,
-		IteratorRange<const Float4x4*>	skeletonMachineResult) const
+	namespace Internal
 	{
-		unsigned c=0;
-		if (_skeletonBinding.GetModelJointCount()) {
-			for (; c<std::min(section._jointMatrices.size(), destination.size()); ++c) {
-				auto transMachineOutput = (section._jointMatrices[c] != uint16_t(~0u)) ? _skeletonBinding.ModelJointToMachineOutput(section._jointMatrices[c]) : ~0u;
-				if (transMachineOutput != ~unsigned(0x0)) {
-					destination[c] = Truncate(Combine(Combine(section._bindShapeByInverseBindMatrices[c], skeletonMachineResult[transMachineOutput]), section._postSkinningBindMatrix));
-				} else {
-					destination[c] = Truncate(section._bindShapeMatrix);
-				}
+		struct SkinStream
+		{
+			const void* _src = nullptr;
+			void* _dst = nullptr;
+			size_t _srcStride = 0, _dstStride = 0;
+		};
+
+		struct SkinStreams
+		{
+			SkinStream _position, _normal, _tangent;
+			bool _tangentHasHandiness = false;
+		};
+
+		static bool IsFloat32Format(Format fmt, unsigned minComponents, unsigned maxComponents)
+		{
+			auto componentCount = GetComponentCount(GetComponents(fmt));
+			return GetComponentType(fmt) == FormatComponentType::Float
+				&& componentCount >= minComponents && componentCount <= maxComponents
+				&& BitsPerPixel(fmt) == componentCount*32;
+		}
+
+		static SkinStream MakeSkinStream(
+			IteratorRange<VertexElementIterator> src, IteratorRange<VertexElementIterator> dst,
+			unsigned firstVertex)
+		{
+			SkinStream result;
+			result._src = PtrAdd(src.begin()._data.begin(), firstVertex*src.begin()._stride);
+			result._dst = PtrAdd(dst.begin()._data.begin(), firstVertex*dst.begin()._stride);
+			result._srcStride = src.begin()._stride;
+			result._dstStride = dst.begin()._stride;
+			return result;
+		}
+
+		static void CopyUnskinnedVertices(const SkinStreams& streams, unsigned vertexCount)
+		{
+			// the tangent handiness is only copied when both the source & destination have it
+			const unsigned tangentSize = streams._tangentHasHandiness ? 4*sizeof(float) : 3*sizeof(float);
+			for (unsigned v=0; v<vertexCount; ++v) {
+				std::memcpy(PtrAdd(streams._position._dst, v*streams._position._dstStride), PtrAdd(streams._position._src, v*streams._position._srcStride), 3*sizeof(float));
+				if (streams._normal._dst)
+					std::memcpy(PtrAdd(streams._normal._dst, v*streams._normal._dstStride), PtrAdd(streams._normal._src, v*streams._normal._srcStride), 3*sizeof(float));
+				if (streams._tangent._dst)
+					std::memcpy(PtrAdd(streams._tangent._dst, v*streams._tangent._dstStride), PtrAdd(streams._tangent._src, v*streams._tangent._srcStride), tangentSize);
 			}
-		} else {
-			for (; c<std::min(section._jointMatrices.size(), destination.size()); ++c)
-				destination[c] = Truncate(section._bindShapeMatrix);
 		}
 
-		for (; c<destination.size(); ++c)
-			destination[c] = Identity<Float3x4>();
+		/// <summary>Skin a run of vertices that all have the same number of influences</summary>
+		/// WeightCount is a compile time constant for the common 1, 2 & 4 influence cases (so the blend loop
+		/// unrolls), or 0 to use "runtimeWeightCount". Each vertex blends its joint transforms into a single
+		/// transform first, and then applies that to the position, normal & tangent. Like the GPU deformer,
+		/// normals & tangents are transformed by the rotation/scale part only and aren't renormalized
+		template<unsigned WeightCount>
+			static void SkinVertices(
+				const CPUSkinDeformer::JointTransform* jointTransforms, size_t jointTransformCount,
+				const float* weights, const unsigned* jointIndices, size_t influencesPerVertex, unsigned runtimeWeightCount,
+				const SkinStreams& streams, unsigned vertexCount)
+		{
+			const unsigned weightCount = WeightCount ? WeightCount : runtimeWeightCount;
+			(void)jointTransformCount;
+			for (unsigned v=0; v<vertexCount; ++v, weights+=influencesPerVertex, jointIndices+=influencesPerVertex) {
+				const auto* srcPosition = (const float*)PtrAdd(streams._position._src, v*streams._position._srcStride);
+				auto* dstPosition = (float*)PtrAdd(streams._position._dst, v*streams._position._dstStride);
+
+				#if defined(HAS_SSE_INSTRUCTIONS)
+					__m128 c0, c1, c2, c3;
+					{
+						assert(jointIndices[0] < jointTransformCount);
+						const auto& j = jointTransforms[jointIndices[0]];
+						auto w = _mm_set1_ps(weights[0]);
+						c0 = _mm_mul_ps(w, _mm_load_ps(j._columns[0]));
+						c1 = _mm_mul_ps(w, _mm_load_ps(j._columns[1]));
+						c2 = _mm_mul_ps(w, _mm_load_ps(j._columns[2]));
+						c3 = _mm_mul_ps(w, _mm_load_ps(j._columns[3]));
+					}
+					for (unsigned b=1; b<weightCount; ++b) {
+						assert(jointIndices[b] < jointTransformCount);
+						const auto& j = jointTransforms[jointIndices[b]];
+						auto w = _mm_set1_ps(weights[b]);
+						c0 = _mm_add_ps(c0, _mm_mul_ps(w, _mm_load_ps(j._columns[0])));
+						c1 = _mm_add_ps(c1, _mm_mul_ps(w, _mm_load_ps(j._columns[1])));
+						c2 = _mm_add_ps(c2, _mm_mul_ps(w, _mm_load_ps(j._columns[2])));
+						c3 = _mm_add_ps(c3, _mm_mul_ps(w, _mm_load_ps(j._columns[3])));
+					}
+
+					auto transform3x3 = [&c0, &c1, &c2](const float* src) {
+						return _mm_add_ps(
+							_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(src[0])), _mm_mul_ps(c1, _mm_set1_ps(src[1]))),
+							_mm_mul_ps(c2, _mm_set1_ps(src[2])));
+					};
+					auto storeFloat3 = [](float* dst, __m128 value) {
+						_mm_storel_pi((__m64*)dst, value);
+						_mm_store_ss(dst+2, _mm_movehl_ps(value, value));
+					};
+
+					storeFloat3(dstPosition, _mm_add_ps(transform3x3(srcPosition), c3));
+					if (streams._normal._dst)
+						storeFloat3(
+							(float*)PtrAdd(streams._normal._dst, v*streams._normal._dstStride),
+							transform3x3((const float*)PtrAdd(streams._normal._src, v*streams._normal._srcStride)));
+					if (streams._tangent._dst) {
+						const auto* srcTangent = (const float*)PtrAdd(streams._tangent._src, v*streams._tangent._srcStride);
+						auto* dstTangent = (float*)PtrAdd(streams._tangent._dst, v*streams._tangent._dstStride);
+						storeFloat3(dstTangent, transform3x3(srcTangent));
+						if (streams._tangentHasHandiness) dstTangent[3] = srcTangent[3];
+					}
+				#else
+					float c[4][3];
+					for (unsigned col=0; col<4; ++col)
+						for (unsigned r=0; r<3; ++r)
+							c[col][r] = 0.f;
+					for (unsigned b=0; b<weightCount; ++b) {
+						assert(jointIndices[b] < jointTransformCount);
+						const auto& j = jointTransforms[jointIndices[b]];
+						for (unsigned col=0; col<4; ++col)
+							for (unsigned r=0; r<3; ++r)
+								c[col][r] += weights[b] * j._columns[col][r];
+					}
+
+					auto transform3x3 = [&c](float* dst, const float* src) {
+						for (unsigned r=0; r<3; ++r)
+							dst[r] = c[0][r] * src[0] + c[1][r] * src[1] + c[2][r] * src[2];
+					};
+
+					float position[3];
+					transform3x3(position, srcPosition);
+					for (unsigned r=0; r<3; ++r) dstPosition[r] = position[r] + c[3][r];
+					if (streams._normal._dst)
+						transform3x3(
+							(float*)PtrAdd(streams._normal._dst, v*streams._normal._dstStride),
+							(const float*)PtrAdd(streams._normal._src, v*streams._normal._srcStride));
+					if (streams._tangent._dst) {
+						const auto* srcTangent = (const float*)PtrAdd(streams._tangent._src, v*streams._tangent._srcStride);
+						auto* dstTangent = (float*)PtrAdd(streams._tangent._dst, v*streams._tangent._dstStride);
+						transform3x3(dstTangent, srcTangent);
+						if (streams._tangentHasHandiness) dstTangent[3] = srcTangent[3];
+					}
+				#endif
+			}
+		}
+
+		static const unsigned s_maxParallelSkinningChunks = 32;
+		static const unsigned s_minParallelSkinningVertices = 16*1024;
+	}
+
+	static void SetJointTransform(CPUSkinDeformer::JointTransform& dst, const Float3x4& src)
+	{
+		for (unsigned c=0; c<4; ++c) {
+			dst._columns[c][0] = src(0, c);
+			dst._columns[c][1] = src(1, c);
+			dst._columns[c][2] = src(2, c);
+			dst._columns[c][3] = 0.f;
+		}
+	}
+
+	void CPUSkinDeformer::CopySkeletonMachineResults(
+		IteratorRange<JointTransform*> dst,
+		IteratorRange<const Float4x4*> skeletonMachineOutput,
+		const RenderCore::Assets::SkeletonBinding& binding) const
+	{
+		assert(dst.size() == _jointMatricesInstanceStride);
+		for (const auto& geo:_geos)
+			for (const auto& section:geo._sections) {
+				auto destination = MakeIteratorRange(
+					dst.begin()+section._rangeInJointMatrices.first, 
+					dst.begin()+section._rangeInJointMatrices.second);
+
+				unsigned c=0;
+				if (binding.GetModelJointCount()) {
+					for (; c<std::min(section._jointMatrices.size(), destination.size()); ++c) {
+						auto transMachineOutput = (section._jointMatrices[c] != uint16_t(~0u)) ? binding.ModelJointToMachineOutput(section._jointMatrices[c]) : ~0u;
+						if (transMachineOutput != ~unsigned(0x0)) {
+							SetJointTransform(destination[c], Truncate(Combine(Combine(section._bindShapeByInverseBindMatrices[c], skeletonMachineOutput[transMachineOutput]), section._postSkinningBindMatrix)));
+						} else {
+							SetJointTransform(destination[c], Truncate(section._bindShapeMatrix));
+						}
+					}
+				}
+
+				for (; c<destination.size(); ++c)
+					SetJointTransform(destination[c], Truncate(section._bindShapeMatrix));
+			}
 	}
 
 	RenderCore::Assets::SkeletonBinding CPUSkinDeformer::CreateBinding(
@@ -78,21 +248,39 @@ namespace RenderCore { namespace Techniques
 		IteratorRange<const Float4x4*> skeletonMachineOutput,
 		const RenderCore::Assets::SkeletonBinding& binding)
 	{
-		_skeletonMachineOutput.clear();
-		_skeletonMachineOutput.insert(_skeletonMachineOutput.end(), skeletonMachineOutput.begin(), skeletonMachineOutput.end());
-		_skeletonBinding = binding;
+		if (_jointMatrices.size() < (instanceIdx+1)*_jointMatricesInstanceStride) {
+			_jointMatrices.reserve((instanceIdx+1)*_jointMatricesInstanceStride);
+			while (_jointMatrices.size() < (instanceIdx+1)*_jointMatricesInstanceStride)
+				_jointMatrices.insert(_jointMatrices.end(), _defaultInstanceJointMatrices.begin(), _defaultInstanceJointMatrices.end());
+		}
+
+		CopySkeletonMachineResults(
+			MakeIteratorRange(
+				_jointMatrices.begin()+instanceIdx*_jointMatricesInstanceStride, 
+				_jointMatrices.begin()+(instanceIdx+1)*_jointMatricesInstanceStride),
+			skeletonMachineOutput, binding);
 	}
 
-	void CPUSkinDeformer::ExecuteCPU(
-		IteratorRange<const unsigned*> instanceIndices,
-		unsigned outputInstanceStride,
+	void CPUSkinDeformer::SetDefaultSkeletonMachineResults(
+		IteratorRange<const Float4x4*> skeletonMachineOutput,
+		const RenderCore::Assets::SkeletonBinding& binding)
+	{
+		// as with the GPUSkinDeformer, this won't effect instances that have already been expanded in _jointMatrices
+		CopySkeletonMachineResults(MakeIteratorRange(_defaultInstanceJointMatrices), skeletonMachineOutput, binding);
+	}
+
+	void CPUSkinDeformer::ExecuteInstance(
+		unsigned instanceIdx,
 		IteratorRange<const void*> srcVB,
 		IteratorRange<const void*> deformTemporariesVB,
 		IteratorRange<const void*> dstVB) const
 	{
-		assert(instanceIndices.size() == 1);
-		auto instanceIdx = instanceIndices[0];
-		assert(instanceIdx == 0);
+		// fallback to the default instance data if FeedInSkeletonMachineResults() has never been called for this instance
+		const JointTransform* instanceJointTransforms;
+		if ((instanceIdx+1)*_jointMatricesInstanceStride <= _jointMatrices.size())
+			instanceJointTransforms = _jointMatrices.data() + instanceIdx*_jointMatricesInstanceStride;
+		else
+			instanceJointTransforms = _defaultInstanceJointMatrices.data();
 
 		IteratorRange<VertexElementIterator> sourceElements[16];
 		IteratorRange<VertexElementIterator> destinationElements[16];
@@ -103,19 +291,49 @@ namespace RenderCore { namespace Techniques
 				MakeIteratorRange(sourceElements, &sourceElements[dimof(sourceElements)]),
 				MakeIteratorRange(destinationElements, &destinationElements[dimof(destinationElements)]),
 				geo._geoId, srcVB, deformTemporariesVB, dstVB);
+			if (!binding) continue;
+
+			// Find the attributes we're going to deform. Normals & tangents are optional, but if we're generating
+			// them we must also have them as input
+			unsigned inputPos = ~0u, inputNormal = ~0u, inputTangent = ~0u;
+			for (unsigned c=0; c<binding->_inputElements.size(); ++c) {
+				const auto& e = binding->_inputElements[c];
+				if (e._semanticIndex != 0) continue;
+				if (e._semanticName == s_positionEleName) inputPos = c;
+				else if (e._semanticName == s_normalEleName) inputNormal = c;
+				else if (e._semanticName == s_tangentEleName) inputTangent = c;
+			}
+			unsigned outputPos = ~0u, outputNormal = ~0u, outputTangent = ~0u;
+			for (unsigned c=0; c<binding->_outputElements.size(); ++c) {
+				const auto& e = binding->_outputElements[c];
+				if (e._semanticIndex != 0) continue;
+				if (e._semanticName == s_positionEleName) outputPos = c;
+				else if (e._semanticName == s_normalEleName) outputNormal = c;
+				else if (e._semanticName == s_tangentEleName) outputTangent = c;
+			}
 
-			auto& inputPosElement = sourceElements[0];
-			auto& outputPosElement = destinationElements[0];
+			assert(inputPos != ~0u && outputPos != ~0u);
+			auto& inputPosElement = sourceElements[inputPos];
+			auto& outputPosElement = destinationElements[outputPos];
 			assert(inputPosElement.begin().Format() == Format::R32G32B32_FLOAT);
 			assert(outputPosElement.begin().Format() == Format::R32G32B32_FLOAT);
 			assert(outputPosElement.size() <= inputPosElement.size());
+
+			bool deformNormals = inputNormal != ~0u && outputNormal != ~0u
+				&& Internal::IsFloat32Format(sourceElements[inputNormal].begin().Format(), 3, 3)
+				&& Internal::IsFloat32Format(destinationElements[outputNormal].begin().Format(), 3, 3);
+			bool deformTangents = inputTangent != ~0u && outputTangent != ~0u
+				&& Internal::IsFloat32Format(sourceElements[inputTangent].begin().Format(), 3, 4)
+				&& Internal::IsFloat32Format(destinationElements[outputTangent].begin().Format(), 3, 4);
+			assert(deformNormals == (outputNormal != ~0u));			// CPUSkinDeformConfigure always requests R32G32B32_FLOAT normals
+			assert(deformTangents == (outputTangent != ~0u));
+			bool tangentHasHandiness = deformTangents
+				&& GetComponentCount(GetComponents(sourceElements[inputTangent].begin().Format())) == 4
+				&& GetComponentCount(GetComponents(destinationElements[outputTangent].begin().Format())) == 4;
 			
 			for (const auto&section:geo._sections) {
-				std::vector<Float3x4> jointTransform(section._jointMatrices.size());
-				WriteJointTransforms(
-					section,
-					MakeIteratorRange(jointTransform),
-					MakeIteratorRange(_skeletonMachineOutput));
+				auto* sectionJointTransforms = instanceJointTransforms + section._rangeInJointMatrices.first;
+				auto sectionJointTransformCount = section._rangeInJointMatrices.second - section._rangeInJointMatrices.first;
 
 				assert(section._preskinningDrawCalls.size() == section._drawCallWeightsPerVertex.size());
 				for (unsigned dc=0; dc<section._preskinningDrawCalls.size(); ++dc) {
@@ -123,36 +341,85 @@ namespace RenderCore { namespace Techniques
 					auto weightsPerVertex = section._drawCallWeightsPerVertex[dc];
 					assert((drawCall._firstVertex + drawCall._indexCount) <= outputPosElement.size());
 
-					auto srcPosition = inputPosElement.begin() + drawCall._firstVertex;
+					Internal::SkinStreams streams;
+					streams._position = Internal::MakeSkinStream(inputPosElement, outputPosElement, drawCall._firstVertex);
+					if (deformNormals)
+						streams._normal = Internal::MakeSkinStream(sourceElements[inputNormal], destinationElements[outputNormal], drawCall._firstVertex);
+					if (deformTangents)
+						streams._tangent = Internal::MakeSkinStream(sourceElements[inputTangent], destinationElements[outputTangent], drawCall._firstVertex);
+					streams._tangentHasHandiness = tangentHasHandiness;
 
 					// drawCall._subMaterialIndex is 0, 1, 2 or 4 depending on the number of weights we have to proces
 					if (weightsPerVertex == 0) {
 						// in this case, we just copy
-						for (auto p=outputPosElement.begin() + drawCall._firstVertex; p < (outputPosElement.begin() + drawCall._firstVertex + drawCall._indexCount); ++p, ++srcPosition)
-							*p = (*srcPosition).ReinterpretCast<Float3>();
+						Internal::CopyUnskinnedVertices(streams, drawCall._indexCount);
 						continue;
 					}
 
-					auto srcJointWeight = geo._jointWeights.begin() + drawCall._firstVertex * geo._influencesPerVertex;
-					auto srcJointIndex = geo._jointIndices.begin() + drawCall._firstVertex * geo._influencesPerVertex;
-
-					for (auto p=outputPosElement.begin() + drawCall._firstVertex; 
-						p < (outputPosElement.begin() + drawCall._firstVertex + drawCall._indexCount); 
-						++p, ++srcPosition, srcJointWeight+=geo._influencesPerVertex, srcJointIndex+=geo._influencesPerVertex) {
-					
-						Float3 deformedPosition { 0.f, 0.f, 0.f };
-						for (unsigned b=0; b<weightsPerVertex; ++b) {
-							assert(srcJointIndex[b] < jointTransform.size());
-							deformedPosition += srcJointWeight[b] * TransformPoint(jointTransform[srcJointIndex[b]], (*srcPosition).ReinterpretCast<Float3>());
-						}
-
-						*p = deformedPosition;
+					assert(weightsPerVertex <= geo._influencesPerVertex);
+					auto* srcJointWeight = geo._jointWeights.data() + drawCall._firstVertex * geo._influencesPerVertex;
+					auto* srcJointIndex = geo._jointIndices.data() + drawCall._firstVertex * geo._influencesPerVertex;
+					switch (weightsPerVertex) {
+					case 1:
+						Internal::SkinVertices<1>(sectionJointTransforms, sectionJointTransformCount, srcJointWeight, srcJointIndex, geo._influencesPerVertex, 1, streams, drawCall._indexCount);
+						break;
+					case 2:
+						Internal::SkinVertices<2>(sectionJointTransforms, sectionJointTransformCount, srcJointWeight, srcJointIndex, geo._influencesPerVertex, 2, streams, drawCall._indexCount);
+						break;
+					case 4:
+						Internal::SkinVertices<4>(sectionJointTransforms, sectionJointTransformCount, srcJointWeight, srcJointIndex, geo._influencesPerVertex, 4, streams, drawCall._indexCount);
+						break;
+					default:
+						Internal::SkinVertices<0>(sectionJointTransforms, sectionJointTransformCount, srcJointWeight, srcJointIndex, geo._influencesPerVertex, weightsPerVertex, streams, drawCall._indexCount);
+						break;
 					}
 				}
 			}
 		}
 	}
 
+	void CPUSkinDeformer::ExecuteCPU(
+		IteratorRange<const unsigned*> instanceIndices,
+		unsigned outputInstanceStride,
+		IteratorRange<const void*> srcVB,
+		IteratorRange<const void*> deformTemporariesVB,
+		IteratorRange<const void*> dstVB) const
+	{
+		if (instanceIndices.empty()) return;
+
+		// Output for instanceIndices[c] is written at c*outputInstanceStride in dstVB (as per the GPU deformers).
+		// The deform temporaries are also split evenly between the instances
+		const unsigned instanceCount = (unsigned)instanceIndices.size();
+		const size_t temporariesInstanceStride = deformTemporariesVB.size() / instanceCount;
+		assert(dstVB.size() >= size_t(outputInstanceStride)*instanceCount);
+
+		auto executeInstanceRange = [&](unsigned firstInstance, unsigned endInstance) {
+			for (unsigned c=firstInstance; c<endInstance; ++c)
+				ExecuteInstance(
+					instanceIndices[c], srcVB,
+					MakeIteratorRange(PtrAdd(deformTemporariesVB.begin(), c*temporariesInstanceStride), PtrAdd(deformTemporariesVB.begin(), (c+1)*temporariesInstanceStride)),
+					MakeIteratorRange(PtrAdd(dstVB.begin(), size_t(c)*outputInstanceStride), PtrAdd(dstVB.begin(), size_t(c+1)*outputInstanceStride)));
+		};
+
+		// Instances are independent, so we can split them across the thread pool when there's enough work
+		unsigned chunkCount = 1;
+		if (instanceCount > 1 && size_t(_skinnedVertexCount)*instanceCount >= Internal::s_minParallelSkinningVertices) {
+			auto& pool = ConsoleRig::GlobalServices::GetInstance().GetShortTaskThreadPool();
+			if (pool.IsGood()) {
+				chunkCount = std::min(instanceCount, std::min(pool.GetThreadContext()+1, Internal::s_maxParallelSkinningChunks));
+				if (chunkCount > 1) {
+					auto chunkFn = [&](unsigned chunk) {
+						executeInstanceRange(instanceCount*chunk/chunkCount, instanceCount*(chunk+1)/chunkCount);
+					};
+					ParallelFor(pool, chunkCount, chunkFn);
+					return;
+				}
+			}
+		}
+
+		executeInstanceRange(0, instanceCount);
+	}
+
 	CPUSkinDeformer::CPUSkinDeformer(
 		const RenderCore::Assets::ModelScaffold& modelScaffold,
 		const std::string& modelScaffoldName)
@@ -160,6 +427,7 @@ namespace RenderCore { namespace Techniques
 		auto largeBlocks = modelScaffold.OpenLargeBlocks();
 		auto base = largeBlocks->TellP();
 
+		unsigned jointMatrixBufferCount = 0;
 		auto geoCount = modelScaffold.GetGeoCount();
 		for (unsigned geoIdx=0; geoIdx<geoCount; ++geoIdx) {
 			auto geoMachine = modelScaffold.GetGeoMachine(geoIdx);
@@ -235,12 +503,22 @@ namespace RenderCore { namespace Techniques
 				section._bindShapeMatrix = sourceSection._bindShapeMatrix;
 				section._postSkinningBindMatrix = sourceSection._postSkinningBindMatrix;
 				section._jointMatrices = { sourceSection._jointMatrices, sourceSection._jointMatrices + sourceSection._jointMatrixCount };
+				section._rangeInJointMatrices = { jointMatrixBufferCount, jointMatrixBufferCount + (unsigned)sourceSection._jointMatrixCount };
 				constructedGeo._sections.push_back(section);
+				jointMatrixBufferCount += sourceSection._jointMatrixCount;
+
+				for (const auto& dc:sourceSection._preskinningDrawCalls)
+					_skinnedVertexCount += dc._indexCount;
 			}
 
 			_geos.emplace_back(std::move(constructedGeo));
 		}
 
+		// Until we get some skeleton machine results, every joint just gets the bind shape matrix
+		_jointMatricesInstanceStride = jointMatrixBufferCount;
+		_defaultInstanceJointMatrices.resize(_jointMatricesInstanceStride);
+		CopySkeletonMachineResults(MakeIteratorRange(_defaultInstanceJointMatrices), {}, {});
+
 		_jointInputInterface = CopyCmdStreamInputInterface(modelScaffold);
 	}
 
@@ -302,9 +580,24 @@ namespace RenderCore { namespace Techniques
 					}
 					if (!skinningData) break;
 
+					// The CPU deformer always works with 32 bit float attributes. Tangents keep their handiness
+					// component, if they have one
+					auto& animVB = skinningData->_animatedVertexElements;
+					auto tangentsElement = Internal::FindElement(MakeIteratorRange(animVB._ia._elements), s_tangentEleName);
+					auto normalsElement = Internal::FindElement(MakeIteratorRange(animVB._ia._elements), s_normalEleName);
+
 					DeformOperationInstantiation deformOp;
 					deformOp._generatedElements = {DeformOperationInstantiation::SemanticNameAndFormat{s_positionEleName, 0, Format::R32G32B32_FLOAT}};
 					deformOp._upstreamSourceElements = {DeformOperationInstantiation::SemanticNameAndFormat{s_positionEleName, 0, Format::R32G32B32_FLOAT}};
+					if (normalsElement) {
+						deformOp._upstreamSourceElements.push_back({s_normalEleName, 0, Format::R32G32B32_FLOAT});
+						deformOp._generatedElements.push_back({s_normalEleName, 0, Format::R32G32B32_FLOAT});
+					}
+					if (tangentsElement) {
+						auto tangentFormat = (GetComponentCount(GetComponents(tangentsElement->_format)) == 4) ? Format::R32G32B32A32_FLOAT : Format::R32G32B32_FLOAT;
+						deformOp._upstreamSourceElements.push_back({s_tangentEleName, 0, tangentFormat});
+						deformOp._generatedElements.push_back({s_tangentEleName, 0, tangentFormat});
+					}
 					deformOp._suppressElements = {s_weightsEle, s_jointIndicesEle};
 					instantiations.emplace_back(c, std::move(deformOp));
 				}
@@ -312,6 +605,21 @@ namespace RenderCore { namespace Techniques
 				// create the deformer if necessary and add the instantiations we just find
 				if (!instantiations.empty()) {
 					auto deformer = std::make_shared<CPUSkinDeformer>(*modelScaffold, ele.GetModelScaffoldName());
+
+					// as with the GPU deformer, instances that never receive skeleton machine results use the default pose
+					const Assets::SkeletonMachine* skeletonMachine = nullptr;
+					if (auto* skeleton=deformerConstruction.GetModelRendererConstruction().GetSkeletonScaffold().get())
+						skeletonMachine = &skeleton->GetSkeletonMachine();
+					if (!skeletonMachine)
+						skeletonMachine = modelScaffold->EmbeddedSkeleton();
+					if (skeletonMachine) {
+						RenderCore::Assets::SkeletonBinding defaultSkeletonBinding{skeletonMachine->GetOutputInterface(), modelScaffold->FindCommandStreamInputInterface()};
+						std::vector<Float4x4> defaultSkeletonMachineOutput;
+						defaultSkeletonMachineOutput.resize(skeletonMachine->GetOutputMatrixCount(), Identity<Float4x4>());
+						skeletonMachine->GenerateOutputTransforms(MakeIteratorRange(defaultSkeletonMachineOutput));
+						deformer->SetDefaultSkeletonMachineResults(defaultSkeletonMachineOutput, defaultSkeletonBinding);
+					}
+
 					for (auto& inst:instantiations)
 						deformerConstruction.Add(deformer, std::move(inst.second), elementIdx, inst.first);
 				}
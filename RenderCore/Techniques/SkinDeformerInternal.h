@@ -36,6 +36,10 @@ namespace RenderCore { namespace Techniques
 			IteratorRange<const Float4x4*> skeletonMachineOutput,
 			const RenderCore::Assets::SkeletonBinding& binding) override;
 
+		void SetDefaultSkeletonMachineResults(
+			IteratorRange<const Float4x4*> skeletonMachineOutput,
+			const RenderCore::Assets::SkeletonBinding& binding);
+
 		virtual void Bind(const DeformerInputBinding& binding) override;
 		virtual bool IsCPUDeformer() const override;
 		virtual std::future<void> GetInitializationFuture() const override;
@@ -46,6 +50,10 @@ namespace RenderCore { namespace Techniques
 		~CPUSkinDeformer();
 
 		Internal::DeformerInputBindingHelper _bindingHelper;
+
+		// Joint transforms are stored column major, with the translation in the last column. This lets the
+		// skinning kernel blend the influencing transforms 4 components at a time
+		struct alignas(16) JointTransform { float _columns[4][4]; };
 	private:
 		struct Section
 		{
@@ -53,6 +61,7 @@ namespace RenderCore { namespace Techniques
 			IteratorRange<const unsigned*> _drawCallWeightsPerVertex;
 			IteratorRange<const Float4x4*> _bindShapeByInverseBindMatrices;
 			IteratorRange<const uint16_t*> _jointMatrices;
+			std::pair<unsigned, unsigned> _rangeInJointMatrices;
 			Float4x4 _bindShapeMatrix;
 			Float4x4 _postSkinningBindMatrix;
 		};
@@ -67,21 +76,23 @@ namespace RenderCore { namespace Techniques
 			size_t					_influencesPerVertex;
 		};
 		std::vector<Geo> _geos;
+		unsigned _skinnedVertexCount = 0;
 
-		struct Instance
-		{
-			IteratorRange<const Float4x4*> _skeletonMachineOutput;
-			const RenderCore::Assets::SkeletonBinding* _binding;
-		};
-		std::vector<Instance> _instanceData;
-		std::vector<Float4x4> _skeletonMachineOutput;
+		std::vector<JointTransform> _jointMatrices;
+		unsigned _jointMatricesInstanceStride = 0;
+		std::vector<JointTransform> _defaultInstanceJointMatrices;
 		std::vector<uint64_t> _jointInputInterface;
-		RenderCore::Assets::SkeletonBinding _skeletonBinding;
 
-		void WriteJointTransforms(
-			const Section& section,
-			IteratorRange<Float3x4*>		destination,
-			IteratorRange<const Float4x4*>	skeletonMachineResult) const;
+		void CopySkeletonMachineResults(
+			IteratorRange<JointTransform*> dst,
+			IteratorRange<const Float4x4*> skeletonMachineOutput,
+			const RenderCore::Assets::SkeletonBinding& binding) const;
+
+		void ExecuteInstance(
+			unsigned instanceIdx,
+			IteratorRange<const void*> srcVB,
+			IteratorRange<const void*> deformTemporariesVB,
+			IteratorRange<const void*> dstVB) const;
 	};
 
 	namespace Internal { struct GPUDeformerIAParams; class DeformerPipelineCollection; }
@@ -2047,7 +2047,8 @@ namespace RenderCore { namespace ImplVulkan
 		pools._mainDescriptorPool = Metal_Vulkan::DescriptorPool(objFactory, _graphicsQueue->GetTracker(), "main-descriptor-pool");
 		pools._longTermDescriptorPool = Metal_Vulkan::DescriptorPool(objFactory, _graphicsQueue->GetTracker(), "long-term-descriptor-pool");
 		pools._renderPassPool = Metal_Vulkan::VulkanRenderPassPool(objFactory);
-		pools._mainPipelineCache = objFactory.CreatePipelineCache();
+		pools._pipelineCache = std::make_unique<Metal_Vulkan::PipelineCache>(objFactory, apiFeatures._pipelineCacheFile, apiFeatures._pipelineCacheSaveInterval);
+		pools._descriptorSetCache = std::make_unique<Metal_Vulkan::DescriptorSetCache>(objFactory, _graphicsQueue->GetTracker());
 		pools._dummyResources = Metal_Vulkan::DummyResources(objFactory);
 		pools._temporaryStorageManager = std::make_unique<Metal_Vulkan::TemporaryStorageManager>(objFactory, _graphicsQueue->GetTracker());
 
@@ -2392,6 +2393,18 @@ namespace RenderCore { namespace ImplVulkan
 			}
 			break;
 
+		case InternalMetricsType::PipelineCacheMetrics:
+			if (dst.size() != sizeof(Metal_Vulkan::PipelineCacheMetrics))
+				Throw(std::runtime_error("Bad metrics structure size in Vulkan Device::GetInternalMetrics"));
+			*(Metal_Vulkan::PipelineCacheMetrics*)dst.begin() = _globalsContainer.get()->_pools._pipelineCache->GetMetrics();
+			break;
+
+		case InternalMetricsType::DescriptorSetCacheMetrics:
+			if (dst.size() != sizeof(Metal_Vulkan::DescriptorSetCacheMetrics))
+				Throw(std::runtime_error("Bad metrics structure size in Vulkan Device::GetInternalMetrics"));
+			*(Metal_Vulkan::DescriptorSetCacheMetrics*)dst.begin() = _globalsContainer.get()->_pools._descriptorSetCache->GetMetrics();
+			break;
+
 		default:
 			Throw(std::runtime_error("Unknown metrics type"));
 		}
@@ -2952,6 +2965,8 @@ namespace RenderCore { namespace ImplVulkan
 		} CATCH_END
 
 		PumpDestructionQueues();
+		if (_globalPools->_descriptorSetCache)
+			_globalPools->_descriptorSetCache->OnFrameBarrier();
 
 		//////////////////////////////////////////////////////////////////
 		// Finally, we can queue the present
@@ -3020,6 +3035,8 @@ namespace RenderCore { namespace ImplVulkan
 			_destrQueue->Flush();
 			_globalPools->_mainDescriptorPool.FlushDestroys();
 			_globalPools->_longTermDescriptorPool.FlushDestroys();
+			if (_globalPools->_descriptorSetCache)
+				_globalPools->_descriptorSetCache->FlushDestroys();
 			_globalPools->_temporaryStorageManager->FlushDestroys();
 			if (_commandBufferPool)
 				_commandBufferPool->FlushDestroys();
@@ -3171,11 +3188,15 @@ namespace RenderCore { namespace ImplVulkan
         return deviceContext;
     }
 
-	std::shared_ptr<Metal_Vulkan::DeviceContext> ThreadContext::BeginSecondaryCommandList()
+	std::shared_ptr<Metal_Vulkan::DeviceContext> ThreadContext::BeginSecondaryCommandList(const Metal_Vulkan::DeviceContext* renderPassParent)
     {
 		auto cmdBuffer = _commandBufferPool->Allocate(Metal_Vulkan::CommandBufferType::Secondary);
 		auto deviceContext = std::make_shared<Metal_Vulkan::DeviceContext>(*_factory, *_globalPools);
-		deviceContext->BeginCommandList(std::move(cmdBuffer), _submissionQueue->GetTracker());
+		if (renderPassParent) {
+			deviceContext->BeginCommandList(std::move(cmdBuffer), _submissionQueue->GetTracker(), *renderPassParent);
+		} else {
+			deviceContext->BeginCommandList(std::move(cmdBuffer), _submissionQueue->GetTracker());
+		}
 		#if defined(_DEBUG)
 			_submissionQueue->GetTracker()->AttachName(deviceContext->GetActiveCommandList().GetPrimaryTrackerMarker(), "BeginSecondaryCommandList");
 		#endif
@@ -154,7 +154,7 @@ namespace RenderCore { namespace ImplVulkan
         const std::shared_ptr<Metal_Vulkan::DeviceContext>& GetMetalContext() override;
         std::shared_ptr<Metal_Vulkan::DeviceContext> BeginFrameRenderingCommandList() override;
         std::shared_ptr<Metal_Vulkan::DeviceContext> BeginPrimaryCommandList() override;
-        std::shared_ptr<Metal_Vulkan::DeviceContext> BeginSecondaryCommandList() override;
+        std::shared_ptr<Metal_Vulkan::DeviceContext> BeginSecondaryCommandList(const Metal_Vulkan::DeviceContext* renderPassParent) override;
 
 		void AttachDestroyer(const std::shared_ptr<Metal_Vulkan::IDestructionQueue>&);
         void PumpDestructionQueues();
@@ -36,7 +36,7 @@ namespace RenderCore
 
 		virtual std::unique_ptr<IThreadContext> CreateDedicatedTransferContext() = 0;
 
-		enum InternalMetricsType { MainDescriptorPoolMetrics, LongTermDescriptorPoolMetrics };
+		enum InternalMetricsType { MainDescriptorPoolMetrics, LongTermDescriptorPoolMetrics, PipelineCacheMetrics, DescriptorSetCacheMetrics };
 		virtual void GetInternalMetrics(InternalMetricsType type, IteratorRange<void*> dst) const = 0;
 
 		virtual ~IDeviceVulkan();
@@ -50,7 +50,7 @@ namespace RenderCore
 		virtual const std::shared_ptr<Metal_Vulkan::DeviceContext>& GetMetalContext() = 0;
 		virtual std::shared_ptr<Metal_Vulkan::DeviceContext> BeginFrameRenderingCommandList() = 0;
 		virtual std::shared_ptr<Metal_Vulkan::DeviceContext> BeginPrimaryCommandList() = 0;
-		virtual std::shared_ptr<Metal_Vulkan::DeviceContext> BeginSecondaryCommandList() = 0;
+		virtual std::shared_ptr<Metal_Vulkan::DeviceContext> BeginSecondaryCommandList(const Metal_Vulkan::DeviceContext* renderPassParent) = 0;
 
 		virtual void AddPreFrameCommandList(Metal_Vulkan::CommandList&& cmdList) = 0;
 		virtual void QueuePrimaryCommandList(Metal_Vulkan::CommandList&& cmdList) = 0;
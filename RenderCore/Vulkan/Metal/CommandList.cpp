@@ -209,6 +209,7 @@ namespace RenderCore { namespace Metal_Vulkan
 		cmdList._attachedStorage = {};
 		cmdList._asyncTracker = nullptr;
 		cmdList._asyncTrackerMarkers.clear();
+		cmdList._renderPassParentGUID = 0;
 	}
 
 	void CommandList::ValidateVisibility(ObjectFactory& factory, IteratorRange<const uint64_t*> resourceGuids)
@@ -396,6 +397,7 @@ namespace RenderCore { namespace Metal_Vulkan
 		_waitBeforeBegin = std::move(moveFrom._waitBeforeBegin);
 		_signalOnCompletion = std::move(moveFrom._signalOnCompletion);
 		_guid = moveFrom._guid; moveFrom._guid = 0;
+		_renderPassParentGUID = moveFrom._renderPassParentGUID; moveFrom._renderPassParentGUID = 0;
 		return *this;
 	}
 
@@ -126,6 +126,7 @@ namespace RenderCore { namespace Metal_Vulkan
 		void ExecuteSecondaryCommandList(CommandList&& cmdList);
 
 		uint64_t GetGUID() const { assert(_guid); return _guid; }
+		bool SatisfiesRestriction(uint64_t commandListRestriction) const { return !commandListRestriction || commandListRestriction == _guid || commandListRestriction == _renderPassParentGUID; }
 
 		CommandList();
 		CommandList(
@@ -151,6 +152,7 @@ namespace RenderCore { namespace Metal_Vulkan
 		std::vector<std::pair<VulkanSharedPtr<VkSemaphore>, uint64_t>> _signalOnCompletion;
 
 		uint64_t _guid = 0;
+		uint64_t _renderPassParentGUID = 0;		// for secondary command lists executed within a render pass on another command list
 
 		friend class DeviceContext;
 		friend class SharedEncoder;
@@ -825,6 +825,76 @@ namespace RenderCore { namespace Metal_Vulkan
 			_pendingWrites, _writes, 
 			copyCount, copies);
 
+		return CompleteFlush(VULKAN_VERBOSE_DEBUG_ONLY(description));
+	}
+
+	uint64_t	ProgressiveDescriptorSetBuilder::FlushChanges(
+		ObjectFactory& factory,
+		VkDescriptorSet destination,
+		const CompiledDescriptorSetLayout& layout
+		VULKAN_VERBOSE_DEBUG_ONLY(, DescriptorSetDebugInfo& description))
+	{
+		// Descriptor update templates let the driver skip decoding a VkWriteDescriptorSet per binding. The
+		// template only depends on which bindings are written (and how), so the same few templates tend to
+		// get reused for every draw with a given layout.
+		// The descriptor infos can point into this object or into caller memory, so we pack them into a
+		// staging buffer here and describe the packed layout in the template
+		static const unsigned stagingBufferSize = 2048;
+		alignas(8) uint8_t stagingBuffer[stagingBufferSize];
+		VkDescriptorUpdateTemplateEntry entries[s_pendingBufferLength];
+		uint64_t writeSignature = DefaultSeed64;
+		size_t stagingIterator = 0;
+		bool useTemplate = _pendingWrites != 0;
+		for (unsigned c=0; c<_pendingWrites && useTemplate; ++c) {
+			const auto& w = _writes[c];
+			const void* src; size_t stride;
+			switch (w.descriptorType) {
+			case VK_DESCRIPTOR_TYPE_SAMPLER:
+			case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+			case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+			case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+			case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
+				src = w.pImageInfo; stride = sizeof(VkDescriptorImageInfo); break;
+			case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+			case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+			case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+			case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+				src = w.pBufferInfo; stride = sizeof(VkDescriptorBufferInfo); break;
+			case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+			case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+				src = w.pTexelBufferView; stride = sizeof(VkBufferView); break;
+			default:
+				src = nullptr; stride = 0; break;
+			}
+			auto size = stride * w.descriptorCount;
+			if (!src || (stagingIterator + size) > stagingBufferSize) {
+				useTemplate = false;
+				break;
+			}
+			std::memcpy(&stagingBuffer[stagingIterator], src, size);
+			entries[c] = VkDescriptorUpdateTemplateEntry { w.dstBinding, w.dstArrayElement, w.descriptorCount, w.descriptorType, stagingIterator, stride };
+			stagingIterator += size;
+			writeSignature = HashCombine((uint64_t(w.dstBinding) << 32ull) | uint64_t(w.dstArrayElement), writeSignature);
+			writeSignature = HashCombine((uint64_t(w.descriptorType) << 32ull) | uint64_t(w.descriptorCount), writeSignature);
+		}
+
+		VkDescriptorUpdateTemplate updateTemplate = nullptr;
+		if (useTemplate)
+			updateTemplate = layout.GetUpdateTemplate(factory, writeSignature, MakeIteratorRange(entries, &entries[_pendingWrites]));
+
+		if (updateTemplate) {
+			vkUpdateDescriptorSetWithTemplate(factory.GetDevice().get(), destination, updateTemplate, stagingBuffer);
+		} else {
+			for (unsigned c=0; c<_pendingWrites; ++c)
+				_writes[c].dstSet = destination;
+			vkUpdateDescriptorSets(factory.GetDevice().get(), _pendingWrites, _writes, 0, nullptr);
+		}
+
+		return CompleteFlush(VULKAN_VERBOSE_DEBUG_ONLY(description));
+	}
+
+	uint64_t	ProgressiveDescriptorSetBuilder::CompleteFlush(VULKAN_VERBOSE_DEBUG_ONLY(DescriptorSetDebugInfo& description))
+	{
 		_pendingWrites = 0;
 		_pendingImageInfos = _pendingBufferInfos = _pendingBufferViews = 0;
 		auto result = _sinceLastFlush;
@@ -1160,6 +1230,8 @@ namespace RenderCore { namespace Metal_Vulkan
 		}
 		_layout = factory.CreateDescriptorSetLayout(MakeIteratorRange(bindings));
 		_dummyMask = dummyMask;
+		_updateTemplatesSupported = factory.GetPhysicalDeviceProperties().apiVersion >= VK_API_VERSION_1_1;
+		_updateTemplatesLock = std::make_unique<Threading::Mutex>();
 
 		#if defined(VULKAN_ENABLE_DEBUG_EXTENSIONS)
 			if (factory.GetExtensionFunctions()._setObjectName && !name.empty()) {
@@ -1201,6 +1273,28 @@ namespace RenderCore { namespace Metal_Vulkan
 		return (slotIdx < _fixedSamplers.size()) && (_fixedSamplers[slotIdx] != nullptr);
 	}
 
+	VkDescriptorUpdateTemplate CompiledDescriptorSetLayout::GetUpdateTemplate(
+		ObjectFactory& factory,
+		uint64_t writeSignature,
+		IteratorRange<const VkDescriptorUpdateTemplateEntry*> entries) const
+	{
+		if (!_updateTemplatesSupported) return nullptr;
+
+		ScopedLock(*_updateTemplatesLock);
+		auto i = LowerBound(_updateTemplates, writeSignature);
+		if (i != _updateTemplates.end() && i->first == writeSignature)
+			return i->second.get();
+
+		VkDescriptorUpdateTemplateCreateInfo createInfo = {};
+		createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+		createInfo.descriptorUpdateEntryCount = (uint32_t)entries.size();
+		createInfo.pDescriptorUpdateEntries = entries.begin();
+		createInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+		createInfo.descriptorSetLayout = _layout.get();
+		i = _updateTemplates.insert(i, std::make_pair(writeSignature, factory.CreateDescriptorUpdateTemplate(createInfo)));
+		return i->second.get();
+	}
+
 	namespace Internal
 	{
 		static const std::string s_dummyDescriptorString{"<DummyDescriptor>"};
@@ -1416,9 +1510,9 @@ namespace RenderCore { namespace Metal_Vulkan
 		#endif
 
 		builder.FlushChanges(
-			factory.GetDevice().get(),
+			factory,
 			_underlying.get(),
-			nullptr, 0
+			*_layout
 			VULKAN_VERBOSE_DEBUG_ONLY(, _description));
 	}
 
@@ -10,11 +10,13 @@
 #include "../../UniformsStream.h"
 #include "../../../Utility/StringUtils.h"
 #include "../../../Utility/IteratorUtils.h"
+#include "../../../Utility/Threading/Mutex.h"
 
 #include "IncludeVulkan.h"
 #include <iosfwd>
 #include <string>
 #include <vector>
+#include <memory>
 
 namespace RenderCore { class CompiledShaderByteCode; class UniformsStream; enum class PipelineType; struct DescriptorSlot; class LegacyRegisterBindingDesc; class IResource; }
 
@@ -70,6 +72,14 @@ namespace RenderCore { namespace Metal_Vulkan
 			VkDescriptorSet copyPrevDescriptors, uint64_t prevDescriptorMask
 			VULKAN_VERBOSE_DEBUG_ONLY(, DescriptorSetDebugInfo& description));
 
+		// Flush via a descriptor update template cached on the layout (falls back to vkUpdateDescriptorSets
+		// when templates aren't available). "destination" must have been allocated with "layout"
+		uint64_t	FlushChanges(
+			ObjectFactory& factory,
+			VkDescriptorSet destination,
+			const CompiledDescriptorSetLayout& layout
+			VULKAN_VERBOSE_DEBUG_ONLY(, DescriptorSetDebugInfo& description));
+
 		#if defined(VULKAN_VALIDATE_RESOURCE_VISIBILITY)
 			std::vector<uint64_t> _pendingResourceVisibilityChanges;
 			std::vector<std::pair<unsigned, unsigned>> _pendingResourceVisibilityChangesSlotAndCount;
@@ -124,6 +134,7 @@ namespace RenderCore { namespace Metal_Vulkan
 			BindingInfo* AllocateInfos(unsigned count);
 		VkDescriptorImageInfo* AllocateBlankImageInfos(GlobalPools&, ResourceDims, unsigned count);
 		VkDescriptorImageInfo* AllocateBlankUavImageInfos(GlobalPools&, ResourceDims, unsigned count);
+		uint64_t CompleteFlush(VULKAN_VERBOSE_DEBUG_ONLY(DescriptorSetDebugInfo& description));
 	};
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -151,6 +162,13 @@ namespace RenderCore { namespace Metal_Vulkan
 		bool IsFixedSampler(unsigned slotIdx);
 		const unsigned* GetDescriptorTypesCount() const { return _descriptorTypesCount; }
 
+		// Returns a template matching "entries", built on first use. "writeSignature" must uniquely identify
+		// the content of "entries". Returns nullptr if the device doesn't support update templates
+		VkDescriptorUpdateTemplate GetUpdateTemplate(
+			ObjectFactory& factory,
+			uint64_t writeSignature,
+			IteratorRange<const VkDescriptorUpdateTemplateEntry*> entries) const;
+
 		#if defined(_DEBUG)
 			const std::string& GetName() const { return _name; }
 		#endif
@@ -174,6 +192,10 @@ namespace RenderCore { namespace Metal_Vulkan
 		uint64_t _hashCode = 0;
 		unsigned _descriptorTypesCount[11];
 
+		mutable std::vector<std::pair<uint64_t, VulkanUniquePtr<VkDescriptorUpdateTemplate>>> _updateTemplates;
+		mutable std::unique_ptr<Threading::Mutex> _updateTemplatesLock;
+		bool _updateTemplatesSupported = false;
+
 		#if defined(_DEBUG)
 			std::string _name;
 		#endif
@@ -64,6 +64,11 @@ namespace RenderCore { namespace Metal_Vulkan
 		VkRenderPass	_renderPass = 0;
 		TextureSamples	_renderPassSamples = TextureSamples::Create(0);
 		unsigned		_renderPassSubpass = 0;
+		VkFramebuffer	_framebuffer = nullptr;
+		uint64_t		_secondaryCommandListSubpasses = 0;		// bit per subpass, set when the subpass contents are secondary command lists
+		bool			_renderPassInherited = false;			// this is a secondary command list continuing a render pass begun elsewhere
+		VkViewport		_defaultViewport = {};
+		VkRect2D		_defaultScissor = {};
 
 		float			_renderTargetWidth = 0.f;
 		float			_renderTargetHeight = 0.f;
@@ -195,7 +200,7 @@ namespace RenderCore { namespace Metal_Vulkan
 		if (_currentGraphicsPipeline && !GraphicsPipelineBuilder::IsPipelineStale()) return true;
 
 		_currentGraphicsPipeline = GraphicsPipelineBuilder::CreatePipeline(
-			*_factory, _globalPools->_mainPipelineCache.get(),
+			*_factory, _globalPools->_pipelineCache->GetUnderlying(),
 			_sharedState->_renderPass, _sharedState->_renderPassSubpass, _sharedState->_renderPassSamples);
 		assert(_currentGraphicsPipeline);
 		LogPipeline();
@@ -832,10 +837,17 @@ namespace RenderCore { namespace Metal_Vulkan
 	{
 	}
 
+	static bool InSecondaryCommandListSubpass(const VulkanEncoderSharedState& sharedState)
+	{
+		return sharedState._renderPass && ((sharedState._secondaryCommandListSubpasses >> uint64_t(sharedState._renderPassSubpass)) & 1ull);
+	}
+
 	GraphicsEncoder_Optimized DeviceContext::BeginGraphicsEncoder(ICompiledPipelineLayout& pipelineLayout)
 	{
 		if (_sharedState->_inBltPass)
 			Throw(::Exceptions::BasicLabel("Attempting to begin a graphics encoder while a blt encoder is in progress"));
+		if (InSecondaryCommandListSubpass(*_sharedState))
+			Throw(::Exceptions::BasicLabel("Attempting to begin a graphics encoder in a subpass that can only contain secondary command lists"));
 		return GraphicsEncoder_Optimized { *checked_cast<CompiledPipelineLayout*>(&pipelineLayout), _sharedState };
 	}
 
@@ -843,6 +855,8 @@ namespace RenderCore { namespace Metal_Vulkan
 	{
 		if (_sharedState->_inBltPass)
 			Throw(::Exceptions::BasicLabel("Attempting to begin a graphics encoder while a blt encoder is in progress"));
+		if (InSecondaryCommandListSubpass(*_sharedState))
+			Throw(::Exceptions::BasicLabel("Attempting to begin a graphics encoder in a subpass that can only contain secondary command lists"));
 		return GraphicsEncoder_ProgressivePipeline { *checked_cast<CompiledPipelineLayout*>(&pipelineLayout), _sharedState, *_sharedState->_objectFactory, *_sharedState->_globalPools };
 	}
 
@@ -913,7 +927,16 @@ namespace RenderCore { namespace Metal_Vulkan
 		IThreadContextVulkan* vulkanContext = 
 			(IThreadContextVulkan*)threadContext.QueryInterface(s_threadContextVulkanInterface);
 		if (vulkanContext)
-			return vulkanContext->BeginSecondaryCommandList();
+			return vulkanContext->BeginSecondaryCommandList(nullptr);
+		Throw(std::runtime_error("Incorrect thread context type passed to DeviceContext accessor"));
+	}
+
+	std::shared_ptr<DeviceContext> DeviceContext::BeginSecondaryCommandList(IThreadContext& threadContext, const DeviceContext& renderPassParent)
+	{
+		IThreadContextVulkan* vulkanContext = 
+			(IThreadContextVulkan*)threadContext.QueryInterface(s_threadContextVulkanInterface);
+		if (vulkanContext)
+			return vulkanContext->BeginSecondaryCommandList(&renderPassParent);
 		Throw(std::runtime_error("Incorrect thread context type passed to DeviceContext accessor"));
 	}
 
@@ -962,9 +985,58 @@ namespace RenderCore { namespace Metal_Vulkan
 			Throw(VulkanAPIFailure(res, "Failure while beginning command buffer"));
 	}
 
+	void		DeviceContext::BeginCommandList(VulkanSharedPtr<VkCommandBuffer> cmdList, std::shared_ptr<IAsyncTrackerVulkan> asyncTracker, const DeviceContext& renderPassParent)
+	{
+		assert(_sharedState && _sharedState->_globalPools);
+		assert(!_sharedState->_commandList.GetUnderlying());
+		assert(!_sharedState->_renderPass && !_sharedState->_currentEncoder);
+		auto& parentState = *renderPassParent._sharedState;
+		if (!InSecondaryCommandListSubpass(parentState))
+			Throw(::Exceptions::BasicLabel("Attempting to begin a render pass secondary command list, but the parent context is not in a subpass for secondary command lists"));
+
+		_sharedState->_commandList = CommandList(std::move(cmdList), std::move(asyncTracker));
+		_sharedState->_commandList._renderPassParentGUID = parentState._commandList.GetGUID();
+		_sharedState->_ibBound = false;
+
+		VkCommandBufferInheritanceInfo inheritInfo = {};
+		inheritInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritInfo.pNext = nullptr;
+		inheritInfo.renderPass = parentState._renderPass;
+		inheritInfo.subpass = parentState._renderPassSubpass;
+		inheritInfo.framebuffer = parentState._framebuffer;
+		inheritInfo.occlusionQueryEnable = false;
+		inheritInfo.queryFlags = 0;
+		inheritInfo.pipelineStatistics = 0;
+
+		VkCommandBufferBeginInfo cmd_buf_info = {};
+		cmd_buf_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		cmd_buf_info.pNext = nullptr;
+		cmd_buf_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		cmd_buf_info.pInheritanceInfo = &inheritInfo;
+		auto res = vkBeginCommandBuffer(_sharedState->_commandList.GetUnderlying().get(), &cmd_buf_info);
+		if (res != VK_SUCCESS)
+			Throw(VulkanAPIFailure(res, "Failure while beginning command buffer"));
+
+		_sharedState->_renderPass = parentState._renderPass;
+		_sharedState->_renderPassSamples = parentState._renderPassSamples;
+		_sharedState->_renderPassSubpass = parentState._renderPassSubpass;
+		_sharedState->_framebuffer = parentState._framebuffer;
+		_sharedState->_renderTargetWidth = parentState._renderTargetWidth;
+		_sharedState->_renderTargetHeight = parentState._renderTargetHeight;
+		_sharedState->_defaultViewport = parentState._defaultViewport;
+		_sharedState->_defaultScissor = parentState._defaultScissor;
+		_sharedState->_secondaryCommandListSubpasses = 0;
+		_sharedState->_renderPassInherited = true;
+
+		// dynamic state isn't inherited from the primary command list
+		SetDefaultDynamicState();
+	}
+
 	void		DeviceContext::ExecuteCommandList(CommandList&& cmdList)
 	{
 		assert(_sharedState->_commandList.GetUnderlying());
+		assert(!_sharedState->_renderPass || InSecondaryCommandListSubpass(*_sharedState));
+		assert(!_sharedState->_renderPass || cmdList._renderPassParentGUID == _sharedState->_commandList.GetGUID());
 		_sharedState->_commandList.ExecuteSecondaryCommandList(std::move(cmdList));
 	}
 
@@ -974,10 +1046,19 @@ namespace RenderCore { namespace Metal_Vulkan
 		assert(_sharedState->_commandList._asyncTracker);
 		if (_captureForBindRecords)
 			Internal::ValidateIsEmpty(*_captureForBindRecords);		// always complete these captures before completing a command list
+		assert(!_sharedState->_renderPass || _sharedState->_renderPassInherited);
 		auto res = vkEndCommandBuffer(_sharedState->_commandList.GetUnderlying().get());
 		if (res != VK_SUCCESS)
 			Throw(VulkanAPIFailure(res, "Failure while ending command buffer"));
 
+		if (_sharedState->_renderPassInherited) {
+			_sharedState->_renderPass = nullptr;
+			_sharedState->_renderPassSamples = TextureSamples::Create();
+			_sharedState->_renderPassSubpass = 0u;
+			_sharedState->_framebuffer = nullptr;
+			_sharedState->_renderPassInherited = false;
+		}
+
 		// We will release our reference on _command list here.
 		auto result = std::make_shared<CommandList>(std::move(_sharedState->_commandList));
 		assert(!_sharedState->_commandList.GetUnderlying() && !_sharedState->_commandList._attachedStorage);
@@ -988,7 +1069,8 @@ namespace RenderCore { namespace Metal_Vulkan
 		const FrameBuffer& fb,
 		TextureSamples samples,
 		VectorPattern<int, 2> offset, VectorPattern<unsigned, 2> extent,
-		IteratorRange<const ClearValue*> clearValues)
+		IteratorRange<const ClearValue*> clearValues,
+		uint64_t secondaryCommandListSubpasses)
 	{
 		if (_sharedState->_renderPass)
 			Throw(::Exceptions::BasicLabel("Attempting to begin a render pass while another render pass is already in progress"));
@@ -1018,28 +1100,43 @@ namespace RenderCore { namespace Metal_Vulkan
 		rp_begin.pClearValues = vkClearValues;
 		rp_begin.clearValueCount = (uint32_t)fb._clearValuesOrdering.size();
 
-		vkCmdBeginRenderPass(_sharedState->_commandList.GetUnderlying().get(), &rp_begin, VK_SUBPASS_CONTENTS_INLINE);
+		bool firstSubpassSecondary = secondaryCommandListSubpasses & 1ull;
+		vkCmdBeginRenderPass(_sharedState->_commandList.GetUnderlying().get(), &rp_begin, firstSubpassSecondary ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
 		_sharedState->_renderPass = fb.GetLayout();
 		_sharedState->_renderPassSamples = samples;
 		_sharedState->_renderPassSubpass = 0u;
+		_sharedState->_framebuffer = fb.GetUnderlying();
+		_sharedState->_secondaryCommandListSubpasses = secondaryCommandListSubpasses;
+		_sharedState->_renderTargetWidth = extent[0];
 		_sharedState->_renderTargetHeight = extent[1];
+		_sharedState->_defaultViewport = AsVkViewport(fb.GetDefaultViewport(), _sharedState->_renderTargetHeight);
+		_sharedState->_defaultScissor = VkRect2D { {offset[0], offset[1]}, {extent[0], extent[1]} };
+
+		// Only vkCmdExecuteCommands is allowed in a subpass with secondary command list contents; in that case
+		// the secondary command lists set the dynamic state themselves
+		if (!firstSubpassSecondary)
+			SetDefaultDynamicState();
+	}
 
-		// Set the default viewport & scissor
-		VkViewport defaultViewport = AsVkViewport(fb.GetDefaultViewport(), _sharedState->_renderTargetHeight);
-		VkRect2D defaultScissor { {offset[0], offset[1]}, {extent[0], extent[1]} };
-		vkCmdSetViewport(_sharedState->_commandList.GetUnderlying().get(), 0, 1, &defaultViewport);
-		vkCmdSetScissor(_sharedState->_commandList.GetUnderlying().get(), 0, 1, &defaultScissor);
-		vkCmdSetStencilReference(_sharedState->_commandList.GetUnderlying().get(), VK_STENCIL_FACE_FRONT_AND_BACK, 0);		// we must set this to something, because all the pipelines we use have this marked as a dynamic state
-		vkCmdSetDepthBounds(_sharedState->_commandList.GetUnderlying().get(), 0.0f, 1.0f);
+	void DeviceContext::SetDefaultDynamicState()
+	{
+		auto cmdList = _sharedState->_commandList.GetUnderlying().get();
+		vkCmdSetViewport(cmdList, 0, 1, &_sharedState->_defaultViewport);
+		vkCmdSetScissor(cmdList, 0, 1, &_sharedState->_defaultScissor);
+		vkCmdSetStencilReference(cmdList, VK_STENCIL_FACE_FRONT_AND_BACK, 0);		// we must set this to something, because all the pipelines we use have this marked as a dynamic state
+		vkCmdSetDepthBounds(cmdList, 0.0f, 1.0f);
 	}
 
 	void DeviceContext::EndRenderPass()
 	{
 		assert(!_sharedState->_currentEncoder);
+		assert(!_sharedState->_renderPassInherited);
 		vkCmdEndRenderPass(_sharedState->_commandList.GetUnderlying().get());
 		_sharedState->_renderPass = nullptr;
 		_sharedState->_renderPassSamples = TextureSamples::Create();
 		_sharedState->_renderPassSubpass = 0u;
+		_sharedState->_framebuffer = nullptr;
+		_sharedState->_secondaryCommandListSubpasses = 0;
 	}
 
 	bool DeviceContext::IsInRenderPass() const
@@ -1050,8 +1147,20 @@ namespace RenderCore { namespace Metal_Vulkan
 	void DeviceContext::NextSubpass(VkSubpassContents contents)
 	{
 		assert(!_sharedState->_currentEncoder);
+		assert(!_sharedState->_renderPassInherited);
+		bool prevSubpassSecondary = InSecondaryCommandListSubpass(*_sharedState);
 		vkCmdNextSubpass(_sharedState->_commandList.GetUnderlying().get(), contents);
 		++_sharedState->_renderPassSubpass;
+
+		auto subpassBit = 1ull << uint64_t(_sharedState->_renderPassSubpass);
+		if (contents == VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS) {
+			_sharedState->_secondaryCommandListSubpasses |= subpassBit;
+		} else {
+			_sharedState->_secondaryCommandListSubpasses &= ~subpassBit;
+			// state in the primary command list is undefined after executing secondary command lists
+			if (prevSubpassSecondary)
+				SetDefaultDynamicState();
+		}
 	}
 
 	unsigned DeviceContext::GetCurrentSubpassIndex() const
@@ -1061,17 +1170,19 @@ namespace RenderCore { namespace Metal_Vulkan
 
 	void DeviceContext::BeginRenderPass(
         FrameBuffer& frameBuffer,
-        IteratorRange<const ClearValue*> clearValues)
+        IteratorRange<const ClearValue*> clearValues,
+        uint64_t secondaryCommandListSubpasses)
     {
         BeginRenderPass(
             frameBuffer, TextureSamples::Create(),
             frameBuffer.GetDefaultOffset(), frameBuffer.GetDefaultExtent(),
-            clearValues);
+            clearValues, secondaryCommandListSubpasses);
     }
 
     void DeviceContext::BeginNextSubpass(FrameBuffer& frameBuffer)
     {
-		NextSubpass(VK_SUBPASS_CONTENTS_INLINE);
+		bool nextSubpassSecondary = (_sharedState->_secondaryCommandListSubpasses >> uint64_t(_sharedState->_renderPassSubpass+1)) & 1ull;
+		NextSubpass(nextSubpassSecondary ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
     }
 
 	BlitEncoder DeviceContext::BeginBlitEncoder()
@@ -322,9 +322,12 @@ namespace RenderCore { namespace Metal_Vulkan
 	public:
 		// --------------- Cross-GFX-API interface --------------- 
 
+		// Each bit in "secondaryCommandListSubpasses" marks a subpass whose contents will be recorded into
+		// secondary command lists (see BeginSecondaryCommandList()). Those subpasses can only contain ExecuteCommandList()
 		void BeginRenderPass(
 			FrameBuffer& frameBuffer,
-			IteratorRange<const ClearValue*> clearValues = {});
+			IteratorRange<const ClearValue*> clearValues = {},
+			uint64_t secondaryCommandListSubpasses = 0);
 		void BeginNextSubpass(FrameBuffer& frameBuffer);
 		void EndRenderPass();
 		unsigned GetCurrentSubpassIndex() const;
@@ -352,7 +355,12 @@ namespace RenderCore { namespace Metal_Vulkan
 		static std::shared_ptr<DeviceContext> BeginPrimaryCommandList(IThreadContext& threadContext);
 		static std::shared_ptr<DeviceContext> BeginSecondaryCommandList(IThreadContext& threadContext);
 
+		// Begins a secondary command list that continues the current subpass of "renderPassParent". That subpass must have
+		// been begun for secondary command lists, and the result must be executed on "renderPassParent" before that subpass ends
+		static std::shared_ptr<DeviceContext> BeginSecondaryCommandList(IThreadContext& threadContext, const DeviceContext& renderPassParent);
+
 		void		BeginCommandList(VulkanSharedPtr<VkCommandBuffer> cmdList, std::shared_ptr<IAsyncTrackerVulkan> asyncTracker);
+		void		BeginCommandList(VulkanSharedPtr<VkCommandBuffer> cmdList, std::shared_ptr<IAsyncTrackerVulkan> asyncTracker, const DeviceContext& renderPassParent);
 		void		ExecuteCommandList(CommandList&&);
 		auto        ResolveCommandList() -> std::shared_ptr<CommandList>;
 
@@ -367,7 +375,8 @@ namespace RenderCore { namespace Metal_Vulkan
 			const FrameBuffer& fb,
 			TextureSamples samples,
 			VectorPattern<int, 2> offset, VectorPattern<unsigned, 2> extent,
-			IteratorRange<const ClearValue*> clearValues);
+			IteratorRange<const ClearValue*> clearValues,
+			uint64_t secondaryCommandListSubpasses = 0);
 		bool IsInRenderPass() const;
 		void NextSubpass(VkSubpassContents);
 
@@ -386,6 +395,7 @@ namespace RenderCore { namespace Metal_Vulkan
 		friend class BlitEncoder;
 		void EndBlitEncoder();
 		void ResetDescriptorSetState();
+		void SetDefaultDynamicState();
 	};
 
 }}
@@ -1415,9 +1415,62 @@ namespace RenderCore { namespace Metal_Vulkan
 
 			return bindingsWrittenTo;
 		}
+
+		template<typename Fn>
+			static void ForEachBoundStreamIndex(IteratorRange<const uint32_t*> bindingIndicies, Fn&& fn)
+		{
+			for (auto bind=bindingIndicies.begin(); bind!=bindingIndicies.end();) {
+				if (!(bind[1]&s_arrayBindingFlag)) {
+					fn(bind[1]);
+					bind += 2;
+				} else {
+					auto count = bind[1]&~s_arrayBindingFlag;
+					for (unsigned c=0; c<count; ++c) fn(bind[2+c]);
+					bind += 2+count;
+				}
+			}
+		}
+
+		static uint64_t CalculateDescriptorSetCacheKey(
+			std::vector<uint64_t>& keyData,
+			const AdaptiveSetBindingRules& adaptiveSet,
+			const UniformsStream& stream)
+		{
+			// The key must capture everything that goes into the descriptor writes. The layout hash covers the
+			// descriptor types, and the bind arrays cover which stream entry goes to which slot (and so also which
+			// slots get dummies). For the views themselves we use the Vulkan handles, rather than the ResourceView
+			// pointer, because views are frequently recreated for the same underlying object.
+			// All of these values are written to "keyData", so that the cache can compare them in full, rather than
+			// relying on the hash alone
+			keyData.clear();
+			keyData.push_back(adaptiveSet._layout->GetHashCode());
+			keyData.push_back(adaptiveSet._resourceViewBinds.size());
+			keyData.insert(keyData.end(), adaptiveSet._resourceViewBinds.begin(), adaptiveSet._resourceViewBinds.end());
+			keyData.push_back(adaptiveSet._samplerBinds.size());
+			keyData.insert(keyData.end(), adaptiveSet._samplerBinds.begin(), adaptiveSet._samplerBinds.end());
+			ForEachBoundStreamIndex(
+				MakeIteratorRange(adaptiveSet._resourceViewBinds),
+				[&keyData, &stream](unsigned streamIdx) {
+					auto& view = *checked_cast<const ResourceView*>(stream._resourceViews[streamIdx]);
+					auto range = view.GetBufferRangeOffsetAndSize();
+					auto* res = view.GetVulkanResource();
+					keyData.push_back((uint64_t)view.GetImageView());
+					keyData.push_back((uint64_t)view.GetBufferView());
+					keyData.push_back(res ? (uint64_t)res->GetBuffer() : 0ull);
+					keyData.push_back((uint64_t(range.first) << 32ull) | uint64_t(range.second));
+					keyData.push_back((uint64_t)view.GetImageLayout());
+				});
+			ForEachBoundStreamIndex(
+				MakeIteratorRange(adaptiveSet._samplerBinds),
+				[&keyData, &stream](unsigned streamIdx) {
+					keyData.push_back((uint64_t)checked_cast<const SamplerState*>(stream._samplers[streamIdx])->GetUnderlying());
+				});
+			return Hash64(AsPointer(keyData.begin()), AsPointer(keyData.end()));
+		}
 	};
 
 	static std::string s_looseUniforms = "loose-uniforms";
+	static std::string s_cachedLooseUniforms = "cached-loose-uniforms";
 
 	void BoundUniforms::ApplyLooseUniforms(
 		DeviceContext& context,
@@ -1425,8 +1478,7 @@ namespace RenderCore { namespace Metal_Vulkan
 		const UniformsStream& stream,
 		unsigned groupIdx) const
 	{
-		// todo -- consider using VK_KHR_descriptor_update_template as an optimized way of updating many descriptors
-		// in one go
+		auto startTime = std::chrono::steady_clock::now();
 
 		// We can hit the following exception in some cases when we have a BoundUniforms with multiple groups, but
 		// do not all ApplyLooseUniforms for every group in that bound uniforms. When multiple groups contribute to the
@@ -1439,6 +1491,7 @@ namespace RenderCore { namespace Metal_Vulkan
 
 		// assert(encoder.GetPipelineLayout().get() == _pipelineLayout.get()); todo -- pipeline layout compatibility validation
 		assert(groupIdx < dimof(_group));
+		std::vector<uint64_t> cacheKeyData;
 		for (const auto& adaptiveSet:_group[groupIdx]._adaptiveSetRules) {
 
 			// Descriptor sets can't be written to again after they've been bound to a command buffer (unless we're
@@ -1450,11 +1503,58 @@ namespace RenderCore { namespace Metal_Vulkan
 			// Because each uniform stream can be set independently, and at different rates, we'll use a separate
 			// descriptor set for each uniform stream. 
 			//
-			// In this call, we could attempt to reuse another descriptor set that was created from exactly the same
-			// inputs and already used earlier this frame...? But that may not be worth it. It seems like it will
-			// make more sense to just create and set a full descriptor set for every call to this function.
+			// When the set is built only from resource views & samplers (ie, no immediate data, which is written
+			// into temporary storage), the result is fully determined by the inputs. In that case we look for a set
+			// built from the same inputs in the DescriptorSetCache, and bind that instead of writing a new one.
+			// Otherwise we allocate a single use set from the reusable group, which is recycled in bulk as the GPU
+			// completes frames.
+
+			// If we haven't been given enough uniform binding objects, throw an exception
+			// (particularly since this only tracks the uniforms required for this adaptive sets, and doesn't count
+			// bindings given that we're needed by the shader)
+			char buffer[128];
+			if (stream._immediateData.size() < adaptiveSet._immediateDataUniformStreamCount)
+				Throw(std::runtime_error(StringMeldInPlace(buffer) << "Too few immediate data objects provided to ApplyLooseUniforms (expected " << adaptiveSet._immediateDataUniformStreamCount << " but got " << stream._immediateData.size() <<  ")"));
+			if (stream._resourceViews.size() < adaptiveSet._resourceViewUniformStreamCount)
+				Throw(std::runtime_error(StringMeldInPlace(buffer) << "Too few resource views provided to ApplyLooseUniforms (expected " << adaptiveSet._resourceViewUniformStreamCount << " but got " << stream._resourceViews.size() <<  ")"));
+			if (stream._samplers.size() < adaptiveSet._samplerUniformStreamCount)
+				Throw(std::runtime_error(StringMeldInPlace(buffer) << "Too few samplers provided to ApplyLooseUniforms (expected " << adaptiveSet._samplerUniformStreamCount << " but got " << stream._samplers.size() <<  ")"));
+
+			auto* descriptorSetCache = context.GetGlobalPools()._descriptorSetCache.get();
+			bool cacheable = descriptorSetCache && adaptiveSet._immediateDataBinds.empty() && adaptiveSet._sharedBuilder == ~0u;
+			uint64_t cacheKey = 0;
+			VkDescriptorSet descriptorSet = nullptr;
+			VulkanUniquePtr<VkDescriptorSet> newCachedSet;
+			if (cacheable) {
+				cacheKey = BindingHelper::CalculateDescriptorSetCacheKey(cacheKeyData, adaptiveSet, stream);
+				descriptorSet = descriptorSetCache->Find(cacheKey, MakeIteratorRange(cacheKeyData));
+				if (descriptorSet) {
+					#if defined(VULKAN_VALIDATE_RESOURCE_VISIBILITY)
+						// rebuild the visibility list by running the writes into a scratch builder; it's never flushed
+						ProgressiveDescriptorSetBuilder visibilityBuilder { adaptiveSet._layout->GetDescriptorSlots() };
+						BindingHelper::WriteResourceViewBindings(visibilityBuilder, stream._resourceViews, MakeIteratorRange(adaptiveSet._resourceViewBinds), {});
+						if (!visibilityBuilder._pendingResourceVisibilityChanges.empty())
+							context.GetActiveCommandList().RequireResourceVisibility(visibilityBuilder._pendingResourceVisibilityChanges);
+					#endif
+
+					unsigned dynamicOffsetCount = adaptiveSet._layoutDynamicOffsetCount;
+					VLA(unsigned, dynamicOffsets, dynamicOffsetCount);
+					for (unsigned c=0; c<dynamicOffsetCount; ++c) dynamicOffsets[c] = 0;
+					encoder.BindDescriptorSet(
+						adaptiveSet._descriptorSetIdx, descriptorSet,
+						MakeIteratorRange(dynamicOffsets, &dynamicOffsets[dynamicOffsetCount])
+						VULKAN_VERBOSE_DEBUG_ONLY(, DescriptorSetDebugInfo{s_cachedLooseUniforms}));
+					continue;
+				}
+				newCachedSet = descriptorSetCache->Allocate(*adaptiveSet._layout);
+				descriptorSet = newCachedSet.get();
+			}
+			if (!descriptorSet) {
+				// not cacheable, or the cache's pools are exhausted -- fall back to a set that's only used once
+				descriptorSet = adaptiveSet._reusableDescriptorSetGroup->AllocateSingleImmediateUse();
+				if (descriptorSetCache) descriptorSetCache->RecordTransientSet();
+			}
 
-			auto descriptorSet = adaptiveSet._reusableDescriptorSetGroup->AllocateSingleImmediateUse();
 			#if defined(VULKAN_VERBOSE_DEBUG)
 				DescriptorSetDebugInfo verboseDescription;
 				verboseDescription._descriptorSetInfo = s_looseUniforms;
@@ -1484,17 +1584,6 @@ namespace RenderCore { namespace Metal_Vulkan
 				assert(!sharedBuilder._tiedToCommandList || sharedBuilder._tiedToCommandList == context.GetActiveCommandList().GetGUID());
 				sharedBuilder._tiedToCommandList = context.GetActiveCommandList().GetGUID();
 			}
-
-			// If we haven't been given enough uniform binding objects, throw an exception
-			// (particularly since this only tracks the uniforms required for this adaptive sets, and doesn't count
-			// bindings given that we're needed by the shader)
-			char buffer[128];
-			if (stream._immediateData.size() < adaptiveSet._immediateDataUniformStreamCount)
-				Throw(std::runtime_error(StringMeldInPlace(buffer) << "Too few immediate data objects provided to ApplyLooseUniforms (expected " << adaptiveSet._immediateDataUniformStreamCount << " but got " << stream._immediateData.size() <<  ")"));
-			if (stream._resourceViews.size() < adaptiveSet._resourceViewUniformStreamCount)
-				Throw(std::runtime_error(StringMeldInPlace(buffer) << "Too few resource views provided to ApplyLooseUniforms (expected " << adaptiveSet._resourceViewUniformStreamCount << " but got " << stream._resourceViews.size() <<  ")"));
-			if (stream._samplers.size() < adaptiveSet._samplerUniformStreamCount)
-				Throw(std::runtime_error(StringMeldInPlace(buffer) << "Too few samplers provided to ApplyLooseUniforms (expected " << adaptiveSet._samplerUniformStreamCount << " but got " << stream._samplers.size() <<  ")"));
 			
 			auto descSetSlots = BindingHelper::WriteImmediateDataBindings(
 				context,
@@ -1555,10 +1644,22 @@ namespace RenderCore { namespace Metal_Vulkan
 					#endif
 
 					builder->FlushChanges(
-						context.GetUnderlyingDevice(), descriptorSet, nullptr, 0
+						context.GetFactory(), descriptorSet, *adaptiveSet._layout
 						VULKAN_VERBOSE_DEBUG_ONLY(, verboseDescription));
 				}
 
+				if (newCachedSet) {
+					std::vector<ResourceView> retainedViews;
+					std::vector<SamplerState> retainedSamplers;
+					BindingHelper::ForEachBoundStreamIndex(
+						MakeIteratorRange(adaptiveSet._resourceViewBinds),
+						[&retainedViews, &stream](unsigned streamIdx) { retainedViews.push_back(*checked_cast<const ResourceView*>(stream._resourceViews[streamIdx])); });
+					BindingHelper::ForEachBoundStreamIndex(
+						MakeIteratorRange(adaptiveSet._samplerBinds),
+						[&retainedSamplers, &stream](unsigned streamIdx) { retainedSamplers.push_back(*checked_cast<const SamplerState*>(stream._samplers[streamIdx])); });
+					descriptorSetCache->Insert(cacheKey, MakeIteratorRange(cacheKeyData), std::move(newCachedSet), std::move(retainedViews), std::move(retainedSamplers));
+				}
+
 				unsigned dynamicOffsetCount = adaptiveSet._layoutDynamicOffsetCount;		// we should prefer this to be zero in the majority of cases
 				VLA(unsigned, dynamicOffsets, dynamicOffsetCount);
 				for (unsigned c=0; c<dynamicOffsetCount; ++c) dynamicOffsets[c] = 0;
@@ -1584,6 +1685,9 @@ namespace RenderCore { namespace Metal_Vulkan
 			assert(cb.size() == pushConstants._size);
 			encoder.PushConstants(pushConstants._shaderStageBind, pushConstants._offset, cb);
 		}
+
+		if (auto* descriptorSetCache = context.GetGlobalPools()._descriptorSetCache.get())
+			descriptorSetCache->RecordCPUTime(std::chrono::steady_clock::now() - startTime);
 	}
 
 	void BoundUniforms::ApplyDescriptorSets(
@@ -1604,7 +1708,7 @@ namespace RenderCore { namespace Metal_Vulkan
 					assert(encoder.GetEncoderType() == SharedEncoder::EncoderType::Graphics || encoder.GetEncoderType() == SharedEncoder::EncoderType::ProgressiveGraphics);
 					assert((descSet->GetLayout().GetVkShaderStageMask() & VK_SHADER_STAGE_ALL_GRAPHICS) != 0);
 				}
-				assert(!descSet->GetCommandListRestriction() || descSet->GetCommandListRestriction() == context.GetActiveCommandList().GetGUID());
+				assert(context.GetActiveCommandList().SatisfiesRestriction(descSet->GetCommandListRestriction()));
 			#endif
 			assert(fixedSet._expectedDynamicOffsetCount == 0);
 			encoder.BindDescriptorSet(
@@ -1638,7 +1742,7 @@ namespace RenderCore { namespace Metal_Vulkan
 						assert(encoder.GetEncoderType() == SharedEncoder::EncoderType::Graphics || encoder.GetEncoderType() == SharedEncoder::EncoderType::ProgressiveGraphics);
 						assert((descSet->GetLayout().GetVkShaderStageMask() & VK_SHADER_STAGE_ALL_GRAPHICS) != 0);
 					}
-					assert(!descSet->GetCommandListRestriction() || descSet->GetCommandListRestriction() == context.GetActiveCommandList().GetGUID());
+					assert(context.GetActiveCommandList().SatisfiesRestriction(descSet->GetCommandListRestriction()));
 				#endif
 				// assert(fixedSet._expectedDynamicOffsetCount == dynamicOffsets.size());
 				encoder.BindDescriptorSet(
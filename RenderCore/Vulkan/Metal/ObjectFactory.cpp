@@ -284,6 +284,20 @@ namespace RenderCore { namespace Metal_Vulkan
         return std::move(pool);
     }
 
+    VulkanUniquePtr<VkDescriptorUpdateTemplate> ObjectFactory::CreateDescriptorUpdateTemplate(
+        const VkDescriptorUpdateTemplateCreateInfo& createInfo) const
+    {
+        auto d = _destruction.get();
+        VkDescriptorUpdateTemplate rawTemplate = nullptr;
+        auto res = vkCreateDescriptorUpdateTemplate(_device.get(), &createInfo, g_allocationCallbacks, &rawTemplate);
+        auto updateTemplate = VulkanUniquePtr<VkDescriptorUpdateTemplate>(
+            rawTemplate,
+            [d](VkDescriptorUpdateTemplate updateTemplate) { d->Destroy(updateTemplate); });
+        if (res != VK_SUCCESS)
+            Throw(VulkanAPIFailure(res, "Failed while creating descriptor update template"));
+        return std::move(updateTemplate);
+    }
+
     VulkanUniquePtr<VkPipeline> ObjectFactory::CreateGraphicsPipeline(
         VkPipelineCache pipelineCache,
         const VkGraphicsPipelineCreateInfo& createInfo) const
@@ -332,7 +346,7 @@ namespace RenderCore { namespace Metal_Vulkan
             rawCache,
             [d](VkPipelineCache cache) { d->Destroy(cache); });
         if (res != VK_SUCCESS)
-            Throw(VulkanAPIFailure(res, "Failed while creating descriptor set layout"));
+            Throw(VulkanAPIFailure(res, "Failed while creating pipeline cache"));
         return std::move(cache);
     }
 
@@ -746,6 +760,7 @@ namespace RenderCore { namespace Metal_Vulkan
         void    Destroy(VkShaderModule) override;
         void    Destroy(VkDescriptorSetLayout) override;
         void    Destroy(VkDescriptorPool) override;
+        void    Destroy(VkDescriptorUpdateTemplate) override;
         void    Destroy(VkPipeline) override;
         void    Destroy(VkPipelineCache) override;
         void    Destroy(VkPipelineLayout) override;
@@ -801,6 +816,7 @@ namespace RenderCore { namespace Metal_Vulkan
 			, Queue<VkEvent>					// 18
             , Queue<std::pair<VkImage, VmaAllocation>>     // 19
             , Queue<std::pair<VkBuffer, VmaAllocation>>     // 20
+            , Queue<VkDescriptorUpdateTemplate> // 21
         > _queues;
 
         template<int Index, typename Type>
@@ -843,6 +859,7 @@ namespace RenderCore { namespace Metal_Vulkan
     template<> inline void DestroyObjectImmediate(VkDevice device, VmaAllocator, VkShaderModule obj)          { vkDestroyShaderModule(device, obj, g_allocationCallbacks ); }
     template<> inline void DestroyObjectImmediate(VkDevice device, VmaAllocator, VkDescriptorSetLayout obj)   { vkDestroyDescriptorSetLayout(device, obj, g_allocationCallbacks ); }
     template<> inline void DestroyObjectImmediate(VkDevice device, VmaAllocator, VkDescriptorPool obj)        { vkDestroyDescriptorPool(device, obj, g_allocationCallbacks ); }
+    template<> inline void DestroyObjectImmediate(VkDevice device, VmaAllocator, VkDescriptorUpdateTemplate obj) { vkDestroyDescriptorUpdateTemplate(device, obj, g_allocationCallbacks ); }
     template<> inline void DestroyObjectImmediate(VkDevice device, VmaAllocator, VkPipeline obj)              { vkDestroyPipeline(device, obj, g_allocationCallbacks ); }
     template<> inline void DestroyObjectImmediate(VkDevice device, VmaAllocator, VkPipelineCache obj)         { vkDestroyPipelineCache(device, obj, g_allocationCallbacks ); }
     template<> inline void DestroyObjectImmediate(VkDevice device, VmaAllocator, VkPipelineLayout obj)        { vkDestroyPipelineLayout(device, obj, g_allocationCallbacks ); }
@@ -894,6 +911,7 @@ namespace RenderCore { namespace Metal_Vulkan
 	void    DeferredDestruction::Destroy(VkEvent obj) { DoDestroy<18>(obj); }
     void    DeferredDestruction::Destroy(VkImage image, VmaAllocation allocation) { DoDestroy<19>(std::make_pair(image, allocation)); }
     void    DeferredDestruction::Destroy(VkBuffer buffer, VmaAllocation allocation) { DoDestroy<20>(std::make_pair(buffer, allocation)); }
+    void    DeferredDestruction::Destroy(VkDescriptorUpdateTemplate obj) { DoDestroy<21>(obj); }
 
     void    DeferredDestruction::Flush(FlushFlags::BitField flags)
     {
@@ -923,6 +941,7 @@ namespace RenderCore { namespace Metal_Vulkan
         FlushQueue<18>(marker);
         FlushQueue<19>(marker);
         FlushQueue<20>(marker);
+        FlushQueue<21>(marker);
     }
 
     DeferredDestruction::DeferredDestruction(VulkanSharedPtr<VkDevice> device, const std::shared_ptr<IAsyncTracker>& tracker, VmaAllocator vmaAllocator)
@@ -964,6 +983,7 @@ namespace RenderCore { namespace Metal_Vulkan
 		void    Destroy(VkShaderModule) override;
 		void    Destroy(VkDescriptorSetLayout) override;
 		void    Destroy(VkDescriptorPool) override;
+		void    Destroy(VkDescriptorUpdateTemplate) override;
 		void    Destroy(VkPipeline) override;
 		void    Destroy(VkPipelineCache) override;
 		void    Destroy(VkPipelineLayout) override;
@@ -995,6 +1015,7 @@ namespace RenderCore { namespace Metal_Vulkan
 	void    ImmediateDestruction::Destroy(VkShaderModule obj) { DestroyObjectImmediate(_device.get(), _allocator, obj); }
 	void    ImmediateDestruction::Destroy(VkDescriptorSetLayout obj) { DestroyObjectImmediate(_device.get(), _allocator, obj); }
 	void    ImmediateDestruction::Destroy(VkDescriptorPool obj) { DestroyObjectImmediate(_device.get(), _allocator, obj); }
+	void    ImmediateDestruction::Destroy(VkDescriptorUpdateTemplate obj) { DestroyObjectImmediate(_device.get(), _allocator, obj); }
 	void    ImmediateDestruction::Destroy(VkPipeline obj) { DestroyObjectImmediate(_device.get(), _allocator, obj); }
 	void    ImmediateDestruction::Destroy(VkPipelineCache obj) { DestroyObjectImmediate(_device.get(), _allocator, obj); }
 	void    ImmediateDestruction::Destroy(VkPipelineLayout obj) { DestroyObjectImmediate(_device.get(), _allocator, obj); }
@@ -55,6 +55,7 @@ namespace RenderCore { namespace Metal_Vulkan
         virtual void    Destroy(VkShaderModule) = 0;
         virtual void    Destroy(VkDescriptorSetLayout) = 0;
         virtual void    Destroy(VkDescriptorPool) = 0;
+        virtual void    Destroy(VkDescriptorUpdateTemplate) = 0;
         virtual void    Destroy(VkPipeline) = 0;
         virtual void    Destroy(VkPipelineCache) = 0;
         virtual void    Destroy(VkPipelineLayout) = 0;
@@ -130,6 +131,9 @@ namespace RenderCore { namespace Metal_Vulkan
         VulkanUniquePtr<VkDescriptorPool> CreateDescriptorPool(
             const VkDescriptorPoolCreateInfo& createInfo) const;
 
+        VulkanUniquePtr<VkDescriptorUpdateTemplate> CreateDescriptorUpdateTemplate(
+            const VkDescriptorUpdateTemplateCreateInfo& createInfo) const;
+
         // misc
         VulkanUniquePtr<VkCommandPool> CreateCommandPool(
             unsigned queueFamilyIndex, VkCommandPoolCreateFlags flags = 0) const;
@@ -12,6 +12,7 @@
 #include "PipelineLayout.h"
 #include "../../../Utility/MemoryUtils.h"
 #include "../../../Utility/ArithmeticUtils.h"
+#include <chrono>
 
 namespace RenderCore { namespace Metal_Vulkan
 {
@@ -222,7 +223,10 @@ namespace RenderCore { namespace Metal_Vulkan
 		pipeline.subpass = subpass;
 
 		TRY {
+			auto buildStart = std::chrono::steady_clock::now();
 			auto vkPipeline = factory.CreateGraphicsPipeline(pipelineCache, pipeline);
+			if (auto* persistentCache = GetGlobalPools()._pipelineCache.get())
+				persistentCache->RecordPipelineBuild(std::chrono::steady_clock::now() - buildStart, false);
 			auto result = std::make_shared<GraphicsPipeline>(std::move(vkPipeline));
 			result->_shader = *_shaderProgram;
 			_pipelineStale = false;
@@ -244,7 +248,7 @@ namespace RenderCore { namespace Metal_Vulkan
 	{
 		assert(_currentSubpassIndex != ~0u && _currentRenderPass);
 		return CreatePipeline(
-			factory, GetGlobalPools()._mainPipelineCache.get(),
+			factory, GetGlobalPools()._pipelineCache->GetUnderlying(),
 			_currentRenderPass.get(), _currentSubpassIndex, _currentTextureSamples);
 	}
 
@@ -338,7 +342,10 @@ namespace RenderCore { namespace Metal_Vulkan
 		pipeline.stage = BuildShaderStage(_shader->GetModule().get(), VK_SHADER_STAGE_COMPUTE_BIT, csEntryPoint);
 
 		TRY {
+			auto buildStart = std::chrono::steady_clock::now();
 			auto vkPipeline = factory.CreateComputePipeline(pipelineCache, pipeline);
+			if (auto* persistentCache = GetGlobalPools()._pipelineCache.get())
+				persistentCache->RecordPipelineBuild(std::chrono::steady_clock::now() - buildStart, true);
 			auto result = std::make_shared<ComputePipeline>(std::move(vkPipeline));
 			result->_shader = *_shader;
 			_pipelineStale = false;
@@ -353,7 +360,7 @@ namespace RenderCore { namespace Metal_Vulkan
 
 	std::shared_ptr<ComputePipeline> ComputePipelineBuilder::CreatePipeline(ObjectFactory& factory)
 	{
-		return CreatePipeline(factory, GetGlobalPools()._mainPipelineCache.get());
+		return CreatePipeline(factory, GetGlobalPools()._pipelineCache->GetUnderlying());
 	}
 
 	ComputePipelineBuilder::ComputePipelineBuilder()
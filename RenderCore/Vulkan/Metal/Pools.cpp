@@ -11,6 +11,9 @@
 #include "../../OSServices/Log.h"
 #include "../../Utility/BitUtils.h"
 #include "../../Utility/MemoryUtils.h"
+#include "../../../OSServices/RawFS.h"
+#include <filesystem>
+#include <algorithm>
 
 namespace RenderCore { namespace Metal_Vulkan
 {
@@ -159,6 +162,15 @@ namespace RenderCore { namespace Metal_Vulkan
     void DescriptorPool::AllocateAlreadyLocked(
         IteratorRange<VulkanUniquePtr<VkDescriptorSet>*> dst,
         IteratorRange<const CompiledDescriptorSetLayout*const*> layouts)
+    {
+        auto res = TryAllocateAlreadyLocked(dst, layouts);
+        if (res != VK_SUCCESS)
+            Throw(VulkanAPIFailure(res, "Vulkan descriptor set allocation failed because pool memory is exhausted")); 
+    }
+
+    VkResult DescriptorPool::TryAllocateAlreadyLocked(
+        IteratorRange<VulkanUniquePtr<VkDescriptorSet>*> dst,
+        IteratorRange<const CompiledDescriptorSetLayout*const*> layouts)
     {
         assert(dst.size() == layouts.size());
         assert(dst.size() > 0);
@@ -180,8 +192,8 @@ namespace RenderCore { namespace Metal_Vulkan
 
         VkResult res;
         res = vkAllocateDescriptorSets(_device.get(), &desc_alloc_info, rawDescriptorSets);
-        if (res == VK_ERROR_OUT_OF_POOL_MEMORY) {
-            Throw(VulkanAPIFailure(res, "Vulkan descriptor set allocation failed because pool memory is exhausted")); 
+        if (res == VK_ERROR_OUT_OF_POOL_MEMORY || res == VK_ERROR_FRAGMENTED_POOL) {
+            return res;
         } else if (res != VK_SUCCESS)
 			Throw(VulkanAPIFailure(res, "Failure while allocating descriptor set")); 
 
@@ -217,6 +229,7 @@ namespace RenderCore { namespace Metal_Vulkan
                 }
 			}
 		#endif
+        return VK_SUCCESS;
     }
 
     void DescriptorPool::Allocate(
@@ -235,6 +248,16 @@ namespace RenderCore { namespace Metal_Vulkan
 		return std::move(result[0]);
 	}
 
+    VulkanUniquePtr<VkDescriptorSet> DescriptorPool::TryAllocate(const CompiledDescriptorSetLayout& layout)
+    {
+        VulkanUniquePtr<VkDescriptorSet> result[1];
+        const CompiledDescriptorSetLayout* layouts[] { &layout };
+        ScopedLock(_lock);
+        if (TryAllocateAlreadyLocked(MakeIteratorRange(result), MakeIteratorRange(layouts)) != VK_SUCCESS)
+            return nullptr;
+        return std::move(result[0]);
+    }
+
     VkDescriptorSet DescriptorPoolReusableGroup::AllocateSingleImmediateUse()
     {
         assert(_parent->_gpuTracker);
@@ -426,7 +449,7 @@ namespace RenderCore { namespace Metal_Vulkan
             {VK_DESCRIPTOR_TYPE_SAMPLER, 16*256},
             {VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 16*128}
         };
-        const unsigned maxSets = 4096;
+        const unsigned maxSets = MaxSets;
 
         VkDescriptorPoolCreateInfo descriptor_pool = {};
         descriptor_pool.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
@@ -654,6 +677,417 @@ namespace RenderCore { namespace Metal_Vulkan
     DummyResources::DummyResources(DummyResources&& moveFrom) never_throws = default;
     DummyResources& DummyResources::operator=(DummyResources&& moveFrom) never_throws = default;
 
+    VkDescriptorSet DescriptorSetCache::Find(uint64_t hash, IteratorRange<const uint64_t*> keyData)
+    {
+        ScopedLock(_lock);
+        auto i = LowerBound(_entries, hash);
+        if (i != _entries.end() && i->first == hash
+            && std::equal(keyData.begin(), keyData.end(), i->second._keyData.begin(), i->second._keyData.end())) {
+            i->second._lastUsedFrame = _frameCount;
+            ++_cacheHits;
+            return i->second._descriptorSet.get();
+        }
+        ++_cacheMisses;
+        return nullptr;
+    }
+
+    void DescriptorSetCache::Insert(
+        uint64_t hash, IteratorRange<const uint64_t*> keyData,
+        VulkanUniquePtr<VkDescriptorSet>&& descriptorSet,
+        std::vector<ResourceView>&& retainedViews, std::vector<SamplerState>&& retainedSamplers)
+    {
+        ScopedLock(_lock);
+        auto i = LowerBound(_entries, hash);
+        if (i != _entries.end() && i->first == hash) {
+            // Either another thread built the same set between our Find() & Insert(), or this is a hash
+            // collision with a different set. Either way the caller may have already bound the set it built,
+            // so it must live as long as the existing entry (which also keeps the views it references alive)
+            i->second._duplicates.emplace_back(std::move(descriptorSet));
+            if (!std::equal(keyData.begin(), keyData.end(), i->second._keyData.begin(), i->second._keyData.end())) {
+                i->second._retainedViews.insert(i->second._retainedViews.end(), std::make_move_iterator(retainedViews.begin()), std::make_move_iterator(retainedViews.end()));
+                i->second._retainedSamplers.insert(i->second._retainedSamplers.end(), std::make_move_iterator(retainedSamplers.begin()), std::make_move_iterator(retainedSamplers.end()));
+            }
+            i->second._lastUsedFrame = _frameCount;
+            return;
+        }
+
+        if (_entries.size() >= _maxEntries) {
+            // Over budget without a frame barrier to age entries out (or the working set is just very large).
+            // Drop the least recently used half in one go, so we don't hit this path again immediately
+            std::vector<unsigned> lastUsedFrames;
+            lastUsedFrames.reserve(_entries.size());
+            for (const auto& e:_entries) lastUsedFrames.push_back(e.second._lastUsedFrame);
+            auto median = lastUsedFrames.begin() + lastUsedFrames.size()/2;
+            std::nth_element(lastUsedFrames.begin(), median, lastUsedFrames.end());
+            EvictAlreadyLocked(*median+1);
+            i = LowerBound(_entries, hash);
+        }
+
+        Entry newEntry;
+        newEntry._keyData = std::vector<uint64_t>(keyData.begin(), keyData.end());
+        newEntry._descriptorSet = std::move(descriptorSet);
+        newEntry._retainedViews = std::move(retainedViews);
+        newEntry._retainedSamplers = std::move(retainedSamplers);
+        newEntry._lastUsedFrame = _frameCount;
+        _entries.emplace(i, hash, std::move(newEntry));
+    }
+
+    VulkanUniquePtr<VkDescriptorSet> DescriptorSetCache::Allocate(const CompiledDescriptorSetLayout& layout)
+    {
+        ScopedLock(_poolsLock);
+        for (auto& p:_pools)
+            if (auto result = p->TryAllocate(layout))
+                return result;
+
+        if (_pools.size() >= _maxPools)
+            return nullptr;
+
+        _pools.emplace_back(std::make_unique<DescriptorPool>(*_factory, _tracker, "DescriptorSetCache"));
+        return _pools.back()->TryAllocate(layout);
+    }
+
+    void DescriptorSetCache::FlushDestroys()
+    {
+        ScopedLock(_poolsLock);
+        for (auto& p:_pools)
+            p->FlushDestroys();
+    }
+
+    void DescriptorSetCache::RecordCPUTime(std::chrono::steady_clock::duration duration)
+    {
+        _cpuTime += std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    }
+
+    void DescriptorSetCache::EvictAlreadyLocked(unsigned oldestFrameToKeep)
+    {
+        auto newEnd = std::remove_if(
+            _entries.begin(), _entries.end(),
+            [oldestFrameToKeep](const auto& e) { return e.second._lastUsedFrame < oldestFrameToKeep; });
+        _evictions += unsigned(_entries.end() - newEnd);
+        _entries.erase(newEnd, _entries.end());
+    }
+
+    void DescriptorSetCache::OnFrameBarrier()
+    {
+        ScopedLock(_lock);
+        ++_frameCount;
+        if (_frameCount > _maxIdleFrames)
+            EvictAlreadyLocked(_frameCount - _maxIdleFrames);
+
+        _lastFrame._transientSetsWritten = _transientSetsWritten.exchange(0);
+        _lastFrame._cacheHits = _cacheHits.exchange(0);
+        _lastFrame._cacheMisses = _cacheMisses.exchange(0);
+        _lastFrame._cpuTime = std::chrono::nanoseconds { _cpuTime.exchange(0) };
+    }
+
+    DescriptorSetCacheMetrics DescriptorSetCache::GetMetrics() const
+    {
+        DescriptorSetCacheMetrics result;
+        result._currentFrame._transientSetsWritten = _transientSetsWritten.load();
+        result._currentFrame._cacheHits = _cacheHits.load();
+        result._currentFrame._cacheMisses = _cacheMisses.load();
+        result._currentFrame._cpuTime = std::chrono::nanoseconds { _cpuTime.load() };
+
+        ScopedLock(_lock);
+        result._lastFrame = _lastFrame;
+        result._frameCount = _frameCount;
+        result._cachedSetCount = (unsigned)_entries.size();
+        result._evictions = _evictions;
+        return result;
+    }
+
+    DescriptorSetCache::DescriptorSetCache(
+        ObjectFactory& factory, const std::shared_ptr<IAsyncTracker>& tracker,
+        unsigned maxIdleFrames, unsigned maxEntries, unsigned maxPools)
+    : _factory(&factory), _tracker(tracker), _maxPools(std::max(maxPools, 1u))
+    , _maxIdleFrames(maxIdleFrames)
+    , _transientSetsWritten(0), _cacheHits(0), _cacheMisses(0), _cpuTime(0)
+    {
+        // Evicted sets aren't returned to the pool until the GPU is finished with them, so keep the entry
+        // count well below the pool capacity
+        auto maxSets = _maxPools * DescriptorPool::MaxSets;
+        _maxEntries = std::max(std::min(maxEntries, maxSets - maxSets/4), 2u);
+    }
+
+    DescriptorSetCache::~DescriptorSetCache() = default;
+
+    namespace Internal
+    {
+        struct PipelineCacheFileHeader
+        {
+            uint32_t _magic;
+            uint32_t _version;
+            uint32_t _vendorID;
+            uint32_t _deviceID;
+            uint32_t _driverVersion;
+            uint8_t _pipelineCacheUUID[VK_UUID_SIZE];
+            uint64_t _dataSize;
+            uint64_t _dataHash;
+        };
+        static constexpr uint32_t s_pipelineCacheFileMagic = 0x4C504358;   // 'XCPL'
+        static constexpr uint32_t s_pipelineCacheFileVersion = 1;
+
+        static bool MatchesDevice(const PipelineCacheFileHeader& hdr, const VkPhysicalDeviceProperties& physDevProps)
+        {
+            return hdr._vendorID == physDevProps.vendorID
+                && hdr._deviceID == physDevProps.deviceID
+                && hdr._driverVersion == physDevProps.driverVersion
+                && !std::memcmp(hdr._pipelineCacheUUID, physDevProps.pipelineCacheUUID, VK_UUID_SIZE);
+        }
+
+        static bool DriverHeaderMatchesDevice(IteratorRange<const void*> data, const VkPhysicalDeviceProperties& physDevProps)
+        {
+            // This is the VkPipelineCacheHeaderVersionOne structure that begins all pipeline cache data. It's
+            // read piecewise, because older Vulkan headers don't declare it
+            const unsigned driverHeaderSize = 4*sizeof(uint32_t) + VK_UUID_SIZE;
+            if (data.size() < driverHeaderSize) return false;
+            uint32_t headerSize, headerVersion, vendorID, deviceID;
+            auto* d = (const uint8_t*)data.begin();
+            std::memcpy(&headerSize, d, sizeof(uint32_t));
+            std::memcpy(&headerVersion, d+4, sizeof(uint32_t));
+            std::memcpy(&vendorID, d+8, sizeof(uint32_t));
+            std::memcpy(&deviceID, d+12, sizeof(uint32_t));
+            return headerSize >= driverHeaderSize && headerSize <= data.size()
+                && headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+                && vendorID == physDevProps.vendorID
+                && deviceID == physDevProps.deviceID
+                && !std::memcmp(d+16, physDevProps.pipelineCacheUUID, VK_UUID_SIZE);
+        }
+    }
+
+    VkPipelineCache PipelineCache::GetUnderlying()
+    {
+        auto threadId = std::this_thread::get_id();
+        ScopedLock(_threadCachesLock);
+        for (auto& c:_threadCaches)
+            if (c._threadId == threadId) {
+                c._lastUsedSave = _saveGeneration;
+                return c._cache.get();
+            }
+
+        // First pipeline built on this thread -- give it it's own cache, seeded with the data we loaded from disk
+        ThreadCache newCache;
+        newCache._threadId = threadId;
+        newCache._cache = _factory->CreatePipelineCache(_initialData.data(), _initialData.size());
+        newCache._lastUsedSave = _saveGeneration;
+        auto result = newCache._cache.get();
+        _threadCaches.emplace_back(std::move(newCache));
+        return result;
+    }
+
+    void PipelineCache::RecordPipelineBuild(std::chrono::steady_clock::duration buildTime, bool computePipeline)
+    {
+        auto ns = (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(buildTime).count();
+        if (computePipeline) {
+            ++_computePipelinesBuilt;
+            _computePipelineBuildTime += ns;
+        } else {
+            ++_graphicsPipelinesBuilt;
+            _graphicsPipelineBuildTime += ns;
+        }
+        auto longest = _longestPipelineBuildTime.load();
+        while (ns > longest && !_longestPipelineBuildTime.compare_exchange_weak(longest, ns)) {}
+        ++_buildsSinceLastSave;
+    }
+
+    void PipelineCache::Save()
+    {
+        if (_filename.empty()) return;
+
+        ScopedLock(_saveLock);
+        _buildsSinceLastSave.store(0);
+
+        // Merge every thread's cache into _mergedCache. vkMergePipelineCaches requires external synchronization
+        // only on the destination (which is protected by _saveLock), so the source caches can continue to be
+        // used by other threads while this happens
+        std::vector<VkPipelineCache> srcCaches;
+        {
+            ScopedLock(_threadCachesLock);
+            srcCaches.reserve(_threadCaches.size());
+            for (const auto& c:_threadCaches) srcCaches.push_back(c._cache.get());
+        }
+        if (srcCaches.empty()) return;
+
+        if (!_mergedCache)
+            _mergedCache = _factory->CreatePipelineCache(_initialData.data(), _initialData.size());
+        auto mergedCache = _mergedCache.get();
+
+        auto res = vkMergePipelineCaches(_device.get(), mergedCache, (uint32_t)srcCaches.size(), srcCaches.data());
+        if (res != VK_SUCCESS)
+            Throw(VulkanAPIFailure(res, "Failed while merging pipeline caches"));
+
+        {
+            // Everything in the thread caches is now also in _mergedCache, so we can release the caches for threads
+            // that haven't built a pipeline since before the previous save. Otherwise thread churn (eg, from
+            // short lived loading threads) would cause this list to grow without bound. We wait for an extra
+            // save, in case the thread is still in the middle of a build with the handle it got earlier
+            ScopedLock(_threadCachesLock);
+            auto newEnd = std::remove_if(
+                _threadCaches.begin(), _threadCaches.end(),
+                [gen=_saveGeneration](const auto& c) { return c._lastUsedSave+1 < gen; });
+            _threadCaches.erase(newEnd, _threadCaches.end());
+            ++_saveGeneration;
+        }
+
+        // VK_INCOMPLETE is possible if the cache grows between the two calls; just retry in that case
+        std::vector<uint8_t> data;
+        for (;;) {
+            size_t dataSize = 0;
+            res = vkGetPipelineCacheData(_device.get(), mergedCache, &dataSize, nullptr);
+            if (res != VK_SUCCESS)
+                Throw(VulkanAPIFailure(res, "Failed while querying pipeline cache data size"));
+            data.resize(dataSize);
+            res = vkGetPipelineCacheData(_device.get(), mergedCache, &dataSize, data.data());
+            if (res == VK_INCOMPLETE) continue;
+            if (res != VK_SUCCESS)
+                Throw(VulkanAPIFailure(res, "Failed while retrieving pipeline cache data"));
+            data.resize(dataSize);
+            break;
+        }
+
+        const auto& physDevProps = _factory->GetPhysicalDeviceProperties();
+        Internal::PipelineCacheFileHeader hdr;
+        std::memset(&hdr, 0, sizeof(hdr));
+        hdr._magic = Internal::s_pipelineCacheFileMagic;
+        hdr._version = Internal::s_pipelineCacheFileVersion;
+        hdr._vendorID = physDevProps.vendorID;
+        hdr._deviceID = physDevProps.deviceID;
+        hdr._driverVersion = physDevProps.driverVersion;
+        std::memcpy(hdr._pipelineCacheUUID, physDevProps.pipelineCacheUUID, VK_UUID_SIZE);
+        hdr._dataSize = data.size();
+        hdr._dataHash = Hash64(MakeIteratorRange(data));
+
+        // Write to a staging file and rename it over the top of the previous cache, so an interrupted
+        // write can never leave behind a partial file
+        auto stagingFilename = _filename + ".staging";
+        {
+            OSServices::BasicFile file;
+            if (file.TryOpen((const utf8*)stagingFilename.c_str(), "wb", 0) != OSServices::Exceptions::IOException::Reason::Success) {
+                Log(Warning) << "Could not open pipeline cache file (" << stagingFilename << ") for writing" << std::endl;
+                return;
+            }
+            if (file.Write(&hdr, sizeof(hdr), 1) != 1 || (!data.empty() && file.Write(data.data(), data.size(), 1) != 1)) {
+                Log(Warning) << "Failed while writing pipeline cache file (" << stagingFilename << ")" << std::endl;
+                return;
+            }
+        }
+        std::error_code ec;
+        std::filesystem::remove(_filename, ec);
+        std::filesystem::rename(stagingFilename, _filename, ec);
+        if (ec) {
+            Log(Warning) << "Failed while renaming pipeline cache file (" << stagingFilename << ") to (" << _filename << "): " << ec.message() << std::endl;
+            return;
+        }
+
+        _lastSaveSize = data.size();
+        ++_saveCount;
+    }
+
+    PipelineCacheMetrics PipelineCache::GetMetrics() const
+    {
+        PipelineCacheMetrics result;
+        result._graphicsPipelinesBuilt = _graphicsPipelinesBuilt.load();
+        result._computePipelinesBuilt = _computePipelinesBuilt.load();
+        result._graphicsPipelineBuildTime = std::chrono::nanoseconds{_graphicsPipelineBuildTime.load()};
+        result._computePipelineBuildTime = std::chrono::nanoseconds{_computePipelineBuildTime.load()};
+        result._longestPipelineBuildTime = std::chrono::nanoseconds{_longestPipelineBuildTime.load()};
+        result._initialDataAccepted = _initialDataAccepted;
+        result._initialDataSize = _initialData.size();
+        {
+            ScopedLock(_saveLock);
+            result._lastSaveSize = _lastSaveSize;
+            result._saveCount = _saveCount;
+        }
+        ScopedLock(_threadCachesLock);
+        result._threadCacheCount = (unsigned)_threadCaches.size();
+        return result;
+    }
+
+    void PipelineCache::LoadInitialData(const VkPhysicalDeviceProperties& physDevProps)
+    {
+        OSServices::BasicFile file;
+        if (file.TryOpen((const utf8*)_filename.c_str(), "rb", OSServices::FileShareMode::Read) != OSServices::Exceptions::IOException::Reason::Success)
+            return;     // no cache yet; this is normal on the first run
+
+        Internal::PipelineCacheFileHeader hdr;
+        auto fileSize = file.GetSize();
+        if (fileSize < sizeof(hdr) || file.Read(&hdr, sizeof(hdr), 1) != 1
+            || hdr._magic != Internal::s_pipelineCacheFileMagic || hdr._version != Internal::s_pipelineCacheFileVersion
+            || hdr._dataSize != fileSize - sizeof(hdr)) {
+            Log(Warning) << "Ignoring pipeline cache file (" << _filename << ") because it is corrupt or from an incompatible version" << std::endl;
+            return;
+        }
+
+        // A driver update, or moving the file to another machine, is the usual reason for a mismatch here. We must
+        // not give data from another driver to vkCreatePipelineCache
+        if (!Internal::MatchesDevice(hdr, physDevProps)) {
+            Log(Verbose) << "Ignoring pipeline cache file (" << _filename << ") because it was created with a different device or driver" << std::endl;
+            return;
+        }
+
+        std::vector<uint8_t> data(hdr._dataSize);
+        if ((!data.empty() && file.Read(data.data(), data.size(), 1) != 1)
+            || Hash64(MakeIteratorRange(data)) != hdr._dataHash
+            || !Internal::DriverHeaderMatchesDevice(MakeIteratorRange(data), physDevProps)) {
+            Log(Warning) << "Ignoring pipeline cache file (" << _filename << ") because the data failed validation" << std::endl;
+            return;
+        }
+
+        _initialData = std::move(data);
+        _initialDataAccepted = true;
+    }
+
+    void PipelineCache::BackgroundThreadFunction(std::chrono::seconds saveInterval)
+    {
+        std::unique_lock<Threading::Mutex> l(_backgroundThreadLock);
+        for (;;) {
+            _backgroundThreadWakeup.wait_for(l, saveInterval, [this]() { return _backgroundThreadQuit; });
+            if (_backgroundThreadQuit) break;
+            if (!_buildsSinceLastSave.load()) continue;
+
+            l.unlock();
+            TRY {
+                Save();
+            } CATCH(const std::exception& e) {
+                Log(Warning) << "Failed while saving pipeline cache in background: " << e.what() << std::endl;
+            } CATCH_END
+            l.lock();
+        }
+    }
+
+    PipelineCache::PipelineCache(ObjectFactory& factory, std::string filename, std::chrono::seconds saveInterval)
+    : _factory(&factory), _device(factory.GetDevice()), _filename(std::move(filename))
+    , _graphicsPipelinesBuilt(0), _computePipelinesBuilt(0)
+    , _graphicsPipelineBuildTime(0), _computePipelineBuildTime(0), _longestPipelineBuildTime(0)
+    , _buildsSinceLastSave(0)
+    {
+        if (!_filename.empty()) {
+            LoadInitialData(factory.GetPhysicalDeviceProperties());
+            if (saveInterval.count() != 0)
+                _backgroundThread = std::make_unique<std::thread>([this, saveInterval]() { BackgroundThreadFunction(saveInterval); });
+        }
+    }
+
+    PipelineCache::~PipelineCache()
+    {
+        if (_backgroundThread) {
+            {
+                ScopedLock(_backgroundThreadLock);
+                _backgroundThreadQuit = true;
+            }
+            _backgroundThreadWakeup.notify_all();
+            _backgroundThread->join();
+        }
+
+        if (_buildsSinceLastSave.load()) {
+            TRY {
+                Save();
+            } CATCH(const std::exception& e) {
+                Log(Warning) << "Failed while saving pipeline cache on shutdown: " << e.what() << std::endl;
+            } CATCH_END
+        }
+    }
+
     GlobalPools::GlobalPools() {}
     GlobalPools::~GlobalPools() {}
 
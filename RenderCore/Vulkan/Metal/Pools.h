@@ -14,6 +14,10 @@
 #include "../../../Utility/HeapUtils.h"
 #include "../../../Utility/Threading/Mutex.h"
 #include <vector>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <memory>
 
 namespace RenderCore { namespace Metal_Vulkan
 {
@@ -80,6 +84,7 @@ namespace RenderCore { namespace Metal_Vulkan
             IteratorRange<VulkanUniquePtr<VkDescriptorSet>*> dst,
             IteratorRange<const CompiledDescriptorSetLayout*const*> layouts);
 		VulkanUniquePtr<VkDescriptorSet> Allocate(const CompiledDescriptorSetLayout& layout);
+        VulkanUniquePtr<VkDescriptorSet> TryAllocate(const CompiledDescriptorSetLayout& layout);       // returns null when the pool is exhausted, rather than throwing
 
         const std::shared_ptr<DescriptorPoolReusableGroup>& GetReusableGroup(
             const std::shared_ptr<CompiledDescriptorSetLayout>&);
@@ -89,6 +94,8 @@ namespace RenderCore { namespace Metal_Vulkan
 
         DescriptorPoolMetrics GetMetrics() const;
 
+        static constexpr unsigned MaxSets = 4096;
+
         DescriptorPool(ObjectFactory& factory, const std::shared_ptr<IAsyncTracker>& tracker, StringSection<> poolName);
         DescriptorPool();
         ~DescriptorPool();
@@ -119,6 +126,9 @@ namespace RenderCore { namespace Metal_Vulkan
         std::string _poolName;
 
         void AllocateAlreadyLocked(
+            IteratorRange<VulkanUniquePtr<VkDescriptorSet>*> dst,
+            IteratorRange<const CompiledDescriptorSetLayout*const*> layouts);
+        VkResult TryAllocateAlreadyLocked(
             IteratorRange<VulkanUniquePtr<VkDescriptorSet>*> dst,
             IteratorRange<const CompiledDescriptorSetLayout*const*> layouts);
 
@@ -210,6 +220,172 @@ namespace RenderCore { namespace Metal_Vulkan
         DummyResources& operator=(DummyResources&& moveFrom) never_throws;
     };
 
+    struct DescriptorSetCacheMetrics
+    {
+        struct Frame
+        {
+            unsigned _transientSetsWritten = 0;
+            unsigned _cacheHits = 0;
+            unsigned _cacheMisses = 0;
+            std::chrono::nanoseconds _cpuTime { 0 };        // time spent building & binding loose uniform descriptor sets
+        };
+        Frame _currentFrame;
+        Frame _lastFrame;
+        unsigned _frameCount = 0;
+        unsigned _cachedSetCount = 0;
+        unsigned _evictions = 0;
+    };
+
+    /// <summary>Reuses descriptor sets built from identical inputs across frames</summary>
+    /// A descriptor set written from only resource views & samplers is fully determined by its layout and
+    /// the views & samplers bound. Rather than allocating & writing a new set for every draw, we can look
+    /// for a set that was built from the same inputs earlier, and bind that instead.
+    ///
+    /// Cached sets are never written to again after they are inserted, so they can be bound by multiple
+    /// command lists at the same time. Each entry retains the views & samplers it references, which
+    /// ensures that the underlying Vulkan objects (and so their handles) can't be recycled while the entry
+    /// exists. Entries that haven't been used for a number of frames are released in OnFrameBarrier()
+    ///
+    /// Entries are looked up by a hash of their inputs, but the inputs themselves ("keyData") are also stored
+    /// and compared, so a hash collision is just a cache miss. Cached sets come from pools owned by the cache
+    /// (rather than the long term pool shared with materials). When those are exhausted, Allocate() returns
+    /// null, and the caller should fall back to a transient set
+    class DescriptorSetCache
+    {
+    public:
+        VkDescriptorSet Find(uint64_t hash, IteratorRange<const uint64_t*> keyData);
+        void Insert(
+            uint64_t hash, IteratorRange<const uint64_t*> keyData,
+            VulkanUniquePtr<VkDescriptorSet>&& descriptorSet,
+            std::vector<ResourceView>&& retainedViews, std::vector<SamplerState>&& retainedSamplers);
+
+        VulkanUniquePtr<VkDescriptorSet> Allocate(const CompiledDescriptorSetLayout& layout);
+
+        void RecordTransientSet() { ++_transientSetsWritten; }
+        void RecordCPUTime(std::chrono::steady_clock::duration);
+        void OnFrameBarrier();
+        void FlushDestroys();
+
+        DescriptorSetCacheMetrics GetMetrics() const;
+
+        DescriptorSetCache(
+            ObjectFactory& factory, const std::shared_ptr<IAsyncTracker>& tracker,
+            unsigned maxIdleFrames = 16, unsigned maxEntries = 6144, unsigned maxPools = 2);
+        ~DescriptorSetCache();
+        DescriptorSetCache(const DescriptorSetCache&) = delete;
+        DescriptorSetCache& operator=(const DescriptorSetCache&) = delete;
+    private:
+        // (pools must be declared before the entries, so the sets are released before the pools are destroyed)
+        std::vector<std::unique_ptr<DescriptorPool>> _pools;
+        Threading::Mutex _poolsLock;
+        ObjectFactory* _factory;
+        std::shared_ptr<IAsyncTracker> _tracker;
+        unsigned _maxPools;
+
+        struct Entry
+        {
+            std::vector<uint64_t> _keyData;
+            VulkanUniquePtr<VkDescriptorSet> _descriptorSet;
+            std::vector<ResourceView> _retainedViews;
+            std::vector<SamplerState> _retainedSamplers;
+            std::vector<VulkanUniquePtr<VkDescriptorSet>> _duplicates;      // from Insert() races & hash collisions; may already be bound, so can't be released immediately
+            unsigned _lastUsedFrame = 0;
+        };
+        std::vector<std::pair<uint64_t, Entry>> _entries;
+        mutable Threading::Mutex _lock;
+
+        unsigned _maxIdleFrames, _maxEntries;
+        unsigned _frameCount = 0;
+        unsigned _evictions = 0;
+        DescriptorSetCacheMetrics::Frame _lastFrame;
+
+        std::atomic<unsigned> _transientSetsWritten;
+        std::atomic<unsigned> _cacheHits;
+        std::atomic<unsigned> _cacheMisses;
+        std::atomic<int64_t> _cpuTime;
+
+        void EvictAlreadyLocked(unsigned oldestFrameToKeep);
+    };
+
+    struct PipelineCacheMetrics
+    {
+        unsigned _graphicsPipelinesBuilt = 0;
+        unsigned _computePipelinesBuilt = 0;
+        std::chrono::nanoseconds _graphicsPipelineBuildTime { 0 };
+        std::chrono::nanoseconds _computePipelineBuildTime { 0 };
+        std::chrono::nanoseconds _longestPipelineBuildTime { 0 };
+
+        bool _initialDataAccepted = false;      // false if there was no file, or it was rejected
+        size_t _initialDataSize = 0;
+        size_t _lastSaveSize = 0;
+        unsigned _saveCount = 0;
+        unsigned _threadCacheCount = 0;
+    };
+
+    /// <summary>VkPipelineCache that persists between runs</summary>
+    /// The cache data is loaded from disk on construction and written back periodically by a background
+    /// thread (and again on destruction). The file carries its own header with the vendor id, device id,
+    /// driver version & pipelineCacheUUID of the physical device that wrote it, and the data is only handed
+    /// to the driver when they all match (and the data's hash & the driver's own cache header check out).
+    /// Otherwise we just start from an empty cache.
+    ///
+    /// Each thread that builds pipelines gets its own VkPipelineCache (seeded with the same initial data), so
+    /// concurrent pipeline compiles don't contend on a lock within the driver. They are merged together
+    /// only when saving. Caches for threads that have stopped building pipelines are released after a
+    /// couple of saves (their contents are kept in the merged cache).
+    ///
+    /// Pass an empty filename to disable persistence.
+    class PipelineCache
+    {
+    public:
+        VkPipelineCache GetUnderlying();
+
+        void RecordPipelineBuild(std::chrono::steady_clock::duration buildTime, bool computePipeline);
+        void Save();
+
+        PipelineCacheMetrics GetMetrics() const;
+
+        PipelineCache(ObjectFactory& factory, std::string filename, std::chrono::seconds saveInterval);
+        ~PipelineCache();
+        PipelineCache(const PipelineCache&) = delete;
+        PipelineCache& operator=(const PipelineCache&) = delete;
+    private:
+        ObjectFactory* _factory;
+        VulkanSharedPtr<VkDevice> _device;
+        std::string _filename;
+        std::vector<uint8_t> _initialData;
+
+        struct ThreadCache
+        {
+            std::thread::id _threadId;
+            VulkanUniquePtr<VkPipelineCache> _cache;
+            unsigned _lastUsedSave = 0;
+        };
+        mutable Threading::Mutex _threadCachesLock;
+        std::vector<ThreadCache> _threadCaches;
+        unsigned _saveGeneration = 0;
+
+        mutable Threading::Mutex _saveLock;
+        VulkanUniquePtr<VkPipelineCache> _mergedCache;      // accumulates the contents of every thread cache, including those that have been released
+        std::unique_ptr<std::thread> _backgroundThread;
+        Threading::Mutex _backgroundThreadLock;
+        Threading::Conditional _backgroundThreadWakeup;
+        bool _backgroundThreadQuit = false;
+
+        std::atomic<unsigned> _graphicsPipelinesBuilt;
+        std::atomic<unsigned> _computePipelinesBuilt;
+        std::atomic<int64_t> _graphicsPipelineBuildTime;
+        std::atomic<int64_t> _computePipelineBuildTime;
+        std::atomic<int64_t> _longestPipelineBuildTime;
+        std::atomic<unsigned> _buildsSinceLastSave;
+        bool _initialDataAccepted = false;
+        size_t _lastSaveSize = 0;
+        unsigned _saveCount = 0;
+
+        void LoadInitialData(const VkPhysicalDeviceProperties& physDevProps);
+        void BackgroundThreadFunction(std::chrono::seconds saveInterval);
+    };
+
     namespace Internal { class CompiledDescriptorSetLayoutCache; }
     class TemporaryStorageManager;
 
@@ -220,7 +396,8 @@ namespace RenderCore { namespace Metal_Vulkan
         DescriptorPool                      _mainDescriptorPool;
 		DescriptorPool                      _longTermDescriptorPool;
         VulkanRenderPassPool                _renderPassPool;
-        VulkanSharedPtr<VkPipelineCache>    _mainPipelineCache;
+        std::unique_ptr<PipelineCache>      _pipelineCache;
+        std::unique_ptr<DescriptorSetCache> _descriptorSetCache;
         DummyResources                      _dummyResources;
 
         Threading::Mutex _idleCommandBufferPoolsLock;
@@ -50,6 +50,7 @@ extern "C"
     VK_DEFINE_NON_DISPATCHABLE_HANDLE(VkDescriptorSet)
     VK_DEFINE_NON_DISPATCHABLE_HANDLE(VkFramebuffer)
     VK_DEFINE_NON_DISPATCHABLE_HANDLE(VkCommandPool)
+    VK_DEFINE_NON_DISPATCHABLE_HANDLE(VkDescriptorUpdateTemplate)
 
     #undef VK_DEFINE_NON_DISPATCHABLE_HANDLE
     #undef VK_DEFINE_HANDLE
@@ -76,6 +77,7 @@ extern "C"
     typedef struct VkFramebufferCreateInfo VkFramebufferCreateInfo;
     typedef struct VkComputePipelineCreateInfo VkComputePipelineCreateInfo;
     typedef struct VkDescriptorSetLayoutBinding VkDescriptorSetLayoutBinding;
+    typedef struct VkDescriptorUpdateTemplateCreateInfo VkDescriptorUpdateTemplateCreateInfo;
     typedef struct VkPushConstantRange VkPushConstantRange;
     typedef struct VkFormatProperties VkFormatProperties;
 
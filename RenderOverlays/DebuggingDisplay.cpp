@@ -7,6 +7,7 @@
 #include "DebuggingDisplay.h"
 #include "Font.h"
 #include "FontRendering.h"
+#include "TextRunCache.h"
 #include "ShapesRendering.h"
 #include "DrawText.h"
 #include "ShapesInternal.h"
@@ -569,7 +570,11 @@ namespace RenderOverlays { namespace DebuggingDisplay
             assert(i->second);
 
             // calculate rectangles for the label area
-            auto labelWidth = StringWidth(fnt, MakeStringSection(i->first));
+            // headers are usually the same every frame, so measure via the TextRunCache where we can
+            auto* fontRenderingManager = context.GetFontRenderingManager();
+            auto labelWidth = fontRenderingManager
+                ? fontRenderingManager->GetTextRunCache().StringWidth(fnt, MakeStringSection(i->first))
+                : StringWidth(fnt, MakeStringSection(i->first));
             unsigned additionalPadding = 0;
             if (i!=fieldHeaders.begin()) additionalPadding += staticData._valueHorizPadding/2;
             if ((i+1)!=fieldHeaders.end()) additionalPadding += staticData._valueHorizPadding/2;
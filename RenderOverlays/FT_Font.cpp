@@ -26,12 +26,14 @@
 #include "../Utility/Threading/Mutex.h"
 #include "../Utility/Conversion.h"
 #include "../Utility/FastParseValue.h"
-#include "../Utility/Threading/Mutex.h"
+#include "../Utility/Threading/CompletionThreadPool.h"
+#include "../Core/Exceptions.h"
 #include <set>
 #include <algorithm>
 #include <unordered_map>
 #include <assert.h>
 #include <locale>
+#include <atomic>
 
 #if XLE_FREETYPE_ENABLE
 	#include "ft2build.h"
@@ -84,6 +86,7 @@ namespace RenderOverlays
 	public:
 		virtual FontProperties GetFontProperties() const;
 		virtual Bitmap GetBitmap(ucs4 ch) const;
+		virtual void GetBitmaps(IteratorRange<Bitmap*> result, IteratorRange<const ucs4*> chrs, Utility::ThreadPool* pool) const;
 		virtual GlyphProperties GetGlyphProperties(ucs4 ch) const;
 		virtual void GetGlyphPropertiesSorted(
 			IteratorRange<GlyphProperties*> result,
@@ -102,10 +105,17 @@ namespace RenderOverlays
 		std::shared_ptr<FT_FaceRec_> _face;
 		::Assets::Blob _pBuffer;
 		::Assets::DependencyValidation _depVal;
+		FT_Library _library;
+		int _faceSize;
 
 		struct LoadedChar;
 		mutable std::vector<std::pair<ucs4, LoadedChar>> _cachedLoadedChars;
 		FontProperties _fontProperties;
+
+		// FT_Face objects can only be used by one thread at a time, so batched rasterization uses one extra face per worker
+		mutable std::vector<std::shared_ptr<FT_FaceRec_>> _workerFaces;
+		std::shared_ptr<FT_FaceRec_> CreateFace() const;
+		static FT_Error LoadAndRenderChar(FT_Face face, ucs4 ch, LoadedChar& dst);
 	};
 
 	// NOTE -- AUTOHINT creates problems with fixed width fonts
@@ -134,18 +144,14 @@ namespace RenderOverlays
 				_depVal,
 				StringMeld<256>() << "Failed to load font (" << finalPath << ")"));
 
-		FT_Face face;
-		FT_New_Memory_Face(library, _pBuffer->data(), (FT_Long)_pBuffer->size(), 0, &face);
-		_face = std::shared_ptr<FT_FaceRec_>{
-			face,
-			[](FT_Face f) { FT_Done_Face(f); } };
-
-		FT_Error error = FT_Set_Pixel_Sizes(_face.get(), 0, faceSize);
-		if (error)
+		_library = library;
+		_faceSize = faceSize;
+		_face = CreateFace();
+		if (!_face)
 			Throw(::Assets::Exceptions::ConstructionError(
 				::Assets::Exceptions::ConstructionError::Reason::FormatNotUnderstood,
 				_depVal,
-				StringMeld<256>() << "Failed to set pixel size while initializing font (" << finalPath << ")"));
+				StringMeld<256>() << "Failed to create face or set pixel size while initializing font (" << finalPath << ")"));
 
 		_fontProperties._descender = _face->size->metrics.descender / 64.0f;
 		_fontProperties._ascender = _face->size->metrics.ascender / 64.0f;
@@ -154,7 +160,7 @@ namespace RenderOverlays
 		_fontProperties._ascenderExcludingAccent = _fontProperties._ascender;
 		_fontProperties._fixedWidthAdvance = 0.f;
 
-		error = FT_Load_Char(_face.get(), 'X', loadFlags);
+		FT_Error error = FT_Load_Char(_face.get(), 'X', loadFlags);
 		if (!error) {
 			_fontProperties._ascenderExcludingAccent = (float)_face->glyph->bitmap_top;
 			if (FT_IS_FIXED_WIDTH(_face.get()))
@@ -166,6 +172,20 @@ namespace RenderOverlays
 	{
 	}
 
+	std::shared_ptr<FT_FaceRec_> FTFont::CreateFace() const
+	{
+		FT_Face face;
+		FT_Error error = FT_New_Memory_Face(_library, (const FT_Byte*)_pBuffer->data(), (FT_Long)_pBuffer->size(), 0, &face);
+		if (error) return nullptr;
+		std::shared_ptr<FT_FaceRec_> result {
+			face,
+			[](FT_Face f) { FT_Done_Face(f); } };
+
+		error = FT_Set_Pixel_Sizes(result.get(), 0, _faceSize);
+		if (error) return nullptr;
+		return result;
+	}
+
 	auto FTFont::GetFontProperties() const -> FontProperties { return _fontProperties; }
 
 	Float2 FTFont::GetKerning(int prevGlyph, ucs4 ch, int* curGlyph) const
@@ -278,29 +298,35 @@ namespace RenderOverlays
 		}	
 	}
 
+	FT_Error FTFont::LoadAndRenderChar(FT_Face face, ucs4 ch, LoadedChar& dst)
+	{
+		FT_Error error = FT_Load_Char(face, ch, FT_LOAD_RENDER | loadFlags);
+		if (!error) {
+			auto glyph = face->glyph;
+			dst._glyphProps._xAdvance = (float)glyph->advance.x / 64.0f;
+			#if XLE_FONT_AUTOHINT_FRACTIONAL_WIDTHS
+				dst._glyphProps._lsbDelta = glyph->lsb_delta;
+				dst._glyphProps._rsbDelta = glyph->rsb_delta;
+			#endif
+			dst._glyphProps._bitmapOffsetX = glyph->bitmap_left;
+			dst._glyphProps._bitmapOffsetY = -glyph->bitmap_top;
+			dst._glyphProps._width = glyph->bitmap.width;
+			dst._glyphProps._height = glyph->bitmap.rows;
+
+			auto src = MakeIteratorRange(glyph->bitmap.buffer, PtrAdd(glyph->bitmap.buffer, glyph->bitmap.width*glyph->bitmap.rows));
+			dst._renderedBits = std::vector<uint8_t>{src.begin(), src.end()};
+			dst._hasBeenRendered = true;
+		}
+		return error;
+	}
+
 	auto FTFont::GetBitmap(ucs4 ch) const -> Bitmap
 	{
 		auto i = LowerBound(_cachedLoadedChars, ch);
 		if (i == _cachedLoadedChars.end() || i->first != ch) {
 			LoadedChar loadedChar;
-			FT_Error error = FT_Load_Char(_face.get(), ch, FT_LOAD_RENDER | loadFlags);
-			if (!error) {
-				auto glyph = _face->glyph;
-				loadedChar._glyphProps._xAdvance = (float)glyph->advance.x / 64.0f;
-				#if XLE_FONT_AUTOHINT_FRACTIONAL_WIDTHS
-					loadedChar._glyphProps._lsbDelta = glyph->lsb_delta;
-					loadedChar._glyphProps._rsbDelta = glyph->rsb_delta;
-				#endif
-				loadedChar._glyphProps._bitmapOffsetX = glyph->bitmap_left;
-				loadedChar._glyphProps._bitmapOffsetY = -glyph->bitmap_top;
-				loadedChar._glyphProps._width = glyph->bitmap.width;
-				loadedChar._glyphProps._height = glyph->bitmap.rows;
-
-				auto src = MakeIteratorRange(glyph->bitmap.buffer, PtrAdd(glyph->bitmap.buffer, glyph->bitmap.width*glyph->bitmap.rows));
-				loadedChar._renderedBits = std::vector<uint8_t>{src.begin(), src.end()};
-				loadedChar._hasBeenRendered = true;
-			}
-			i = _cachedLoadedChars.insert(i, std::make_pair(ch, loadedChar));
+			FT_Error error = LoadAndRenderChar(_face.get(), ch, loadedChar);
+			i = _cachedLoadedChars.insert(i, std::make_pair(ch, std::move(loadedChar)));
 			if (error)
 				return Bitmap {};
 		} else if (!i->second._hasBeenRendered) {
@@ -330,6 +356,73 @@ namespace RenderOverlays
 		return result;
 	}
 
+	void FTFont::GetBitmaps(IteratorRange<Bitmap*> result, IteratorRange<const ucs4*> chrs, Utility::ThreadPool* pool) const
+	{
+		assert(result.size() == chrs.size());
+
+		// Find the characters that still need to be rendered. FT_Load_Char() dominates the cost here, so those are
+		// rasterized on the pool, each worker using its own face. Only the calling thread touches _cachedLoadedChars
+		std::vector<std::pair<ucs4, LoadedChar>> toRender;
+		toRender.reserve(chrs.size());
+		for (auto ch:chrs) {
+			auto i = LowerBound(_cachedLoadedChars, ch);
+			if (i == _cachedLoadedChars.end() || i->first != ch || !i->second._hasBeenRendered)
+				toRender.emplace_back(ch, LoadedChar{});
+		}
+		std::sort(toRender.begin(), toRender.end(), [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+		toRender.erase(std::unique(toRender.begin(), toRender.end(), [](const auto& lhs, const auto& rhs) { return lhs.first == rhs.first; }), toRender.end());
+
+		const unsigned minGlyphsPerThread = 16;
+		unsigned threadCount = 1;
+		if (pool && pool->IsGood())
+			threadCount = std::max(1u, std::min(pool->GetThreadContext()+1, unsigned(toRender.size() / minGlyphsPerThread)));
+
+		if (threadCount > 1 && _workerFaces.size() < threadCount-1) {
+			// FT_New_Memory_Face() isn't thread safe with respect to the library, so this must be done under the resources lock
+			auto res = s_mainFontResourcesInstance.lock();
+			if (res) {
+				ScopedLock(res->_mutex);
+				while (_workerFaces.size() < threadCount-1) {
+					auto face = CreateFace();
+					if (!face) break;
+					_workerFaces.emplace_back(std::move(face));
+				}
+			}
+			threadCount = std::min(threadCount, unsigned(_workerFaces.size()+1));
+		}
+
+		std::atomic<unsigned> nextGlyph{0};
+		auto workerFn = [&toRender, &nextGlyph](FT_Face face) {
+			for (;;) {
+				auto g = nextGlyph.fetch_add(1, std::memory_order_relaxed);
+				if (g >= toRender.size()) break;
+				LoadAndRenderChar(face, toRender[g].first, toRender[g].second);
+			}
+		};
+
+		if (threadCount > 1) {
+			// each worker needs its own face; the calling thread uses the main one
+			ParallelFor(
+				*pool, threadCount,
+				[&workerFn, this](unsigned t) { workerFn(t ? _workerFaces[t-1].get() : _face.get()); });
+		} else
+			workerFn(_face.get());
+
+		// merge into the cache (both lists are sorted, so we only ever move forward)
+		auto i = _cachedLoadedChars.begin();
+		for (auto& r:toRender) {
+			i = LowerBound2(MakeIteratorRange(i, _cachedLoadedChars.end()), r.first);
+			if (i == _cachedLoadedChars.end() || i->first != r.first) {
+				i = _cachedLoadedChars.insert(i, std::move(r));
+			} else if (r.second._hasBeenRendered)
+				i->second = std::move(r.second);
+		}
+
+		// everything is now cached (other than characters that failed to render, which GetBitmap() will retry)
+		for (unsigned c=0; c<chrs.size(); ++c)
+			result[c] = GetBitmap(chrs[c]);
+	}
+
 	struct FontDef { std::string path; int size; };
 	struct FontDefLessPred
 	{
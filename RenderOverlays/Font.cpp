@@ -6,6 +6,7 @@
 
 #include "Font.h"
 #include "FontRendering.h"		// for FontRenderingControlStatement
+#include "TextRunCache.h"
 #include "../Utility/UTFUtils.h"
 #include <assert.h>
 
@@ -14,6 +15,13 @@ namespace RenderOverlays
 
 	Font::~Font() {}
 
+	void Font::GetBitmaps(IteratorRange<Bitmap*> result, IteratorRange<const ucs4*> chrs, Utility::ThreadPool*) const
+	{
+		assert(result.size() == chrs.size());
+		for (unsigned c=0; c<chrs.size(); ++c)
+			result[c] = GetBitmap(chrs[c]);
+	}
+
 	template<typename CharType>
 		static ucs4 NextCharacter(StringSection<CharType>& text)
 		{
@@ -1204,23 +1212,8 @@ namespace RenderOverlays
 		return pos;
 	}
 
-	template<typename CharType>
-		static Float2 AlignText(const Quad& q, const Font& font, StringSection<CharType> text, float indent, TextAlignment align)
+	static Float2 AlignTextWithExtent(const Quad& q, const Font::FontProperties& fontProps, Float2 extent, float indent, TextAlignment align)
 	{
-		auto fontProps = font.GetFontProperties();
-		Float2 extent{0,0};
-
-		// do we need the width, height, or both?
-		if (align == TextAlignment::Top || align == TextAlignment::TopRight) {
-			extent[0] = StringWidth(font, text);
-		} else if (align == TextAlignment::Left || align == TextAlignment::BottomLeft) {
-			extent[1] = NewLineCount(font, text) * fontProps._lineHeight + fontProps._ascenderExcludingAccent;
-		} else if (align == TextAlignment::Center || align == TextAlignment::Right || align == TextAlignment::Bottom || align == TextAlignment::BottomRight) {
-			auto measurements = StringWidthAndNewLineCount(font, text);
-			extent[0] = measurements.first;
-			extent[1] = measurements.second * fontProps._lineHeight + fontProps._ascenderExcludingAccent;
-		}
-
 		Float2 pos = GetAlignPos(q, extent, align);
 		pos[0] += indent;
 
@@ -1244,6 +1237,42 @@ namespace RenderOverlays
 		return pos;
 	}
 
+	template<typename CharType>
+		static Float2 AlignText(const Quad& q, const Font& font, StringSection<CharType> text, float indent, TextAlignment align)
+	{
+		auto fontProps = font.GetFontProperties();
+		Float2 extent{0,0};
+
+		// do we need the width, height, or both?
+		if (align == TextAlignment::Top || align == TextAlignment::TopRight) {
+			extent[0] = StringWidth(font, text);
+		} else if (align == TextAlignment::Left || align == TextAlignment::BottomLeft) {
+			extent[1] = NewLineCount(font, text) * fontProps._lineHeight + fontProps._ascenderExcludingAccent;
+		} else if (align == TextAlignment::Center || align == TextAlignment::Right || align == TextAlignment::Bottom || align == TextAlignment::BottomRight) {
+			auto measurements = StringWidthAndNewLineCount(font, text);
+			extent[0] = measurements.first;
+			extent[1] = measurements.second * fontProps._lineHeight + fontProps._ascenderExcludingAccent;
+		}
+
+		return AlignTextWithExtent(q, fontProps, extent, indent, align);
+	}
+
+	template<typename CharType>
+		static Float2 AlignText(TextRunCache& cache, const Quad& q, const Font& font, StringSection<CharType> text, float indent, TextAlignment align)
+	{
+		auto fontProps = font.GetFontProperties();
+		Float2 extent{0,0};
+
+		// the cache stores width & new line count together, so there's no benefit to calculating only one
+		if (align != TextAlignment::TopLeft) {
+			auto measurements = cache.StringWidthAndNewLineCount(font, text);
+			extent[0] = measurements.first;
+			extent[1] = measurements.second * fontProps._lineHeight + fontProps._ascenderExcludingAccent;
+		}
+
+		return AlignTextWithExtent(q, fontProps, extent, indent, align);
+	}
+
 	Float2 AlignText(const Font& font, const Quad& q, TextAlignment align, StringSection<ucs4> text)
 	{
 		return AlignText(q, font, text, 0, align);
@@ -1254,11 +1283,26 @@ namespace RenderOverlays
 		return AlignText(q, font, text, 0, align);
 	}
 
+	Float2 AlignText(TextRunCache& cache, const Font& font, const Quad& q, TextAlignment align, StringSection<ucs4> text)
+	{
+		return AlignText(cache, q, font, text, 0, align);
+	}
+
+	Float2 AlignText(TextRunCache& cache, const Font& font, const Quad& q, TextAlignment align, StringSection<> text)
+	{
+		return AlignText(cache, q, font, text, 0, align);
+	}
+
 	template float StringWidth(const Font&, StringSection<utf8>, float, bool);
 	template float StringWidth(const Font&, StringSection<char>, float, bool);
 	template float StringWidth(const Font&, StringSection<ucs2>, float, bool);
 	template float StringWidth(const Font&, StringSection<ucs4>, float, bool);
 
+	template std::pair<float, unsigned> StringWidthAndNewLineCount(const Font&, StringSection<utf8>, float, bool);
+	template std::pair<float, unsigned> StringWidthAndNewLineCount(const Font&, StringSection<char>, float, bool);
+	template std::pair<float, unsigned> StringWidthAndNewLineCount(const Font&, StringSection<ucs2>, float, bool);
+	template std::pair<float, unsigned> StringWidthAndNewLineCount(const Font&, StringSection<ucs4>, float, bool);
+
 	template int CharCountFromWidth(const Font&, StringSection<utf8> text, float width, float spaceExtra, bool outline);
 	template int CharCountFromWidth(const Font&, StringSection<char> text, float width, float spaceExtra, bool outline);
 	template int CharCountFromWidth(const Font&, StringSection<ucs2> text, float width, float spaceExtra, bool outline);
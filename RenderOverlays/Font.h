@@ -15,6 +15,8 @@
 #include <memory>
 #include <utility>
 
+namespace Utility { class ThreadPool; }
+
 #if !defined(XLE_FONT_AUTOHINT_FRACTIONAL_WIDTHS)
 	#define XLE_FONT_AUTOHINT_FRACTIONAL_WIDTHS 0
 #endif
@@ -58,6 +60,14 @@ namespace RenderOverlays
 		virtual FontProperties		GetFontProperties() const = 0;
 		virtual Bitmap				GetBitmap(ucs4 ch) const = 0;
 
+		/// Rasterize a batch of glyphs. Implementations may use the given pool to rasterize on multiple threads
+		/// (the default implementation just calls GetBitmap() for each). As with GetBitmap(), the "_data" members
+		/// of the results point into storage owned by the font
+		virtual void		GetBitmaps(
+			IteratorRange<Bitmap*> result,
+			IteratorRange<const ucs4*> chrs,
+			Utility::ThreadPool* pool = nullptr) const;
+
 		virtual Float2		GetKerning(int prevGlyph, ucs4 ch, int* curGlyph) const = 0;
 		virtual Float2 		GetKerningReverse(int prevGlyph, ucs4 ch, int* curGlyph) const = 0;
 		virtual float       GetKerning(ucs4 prev, ucs4 ch) const = 0;
@@ -241,5 +251,10 @@ namespace RenderOverlays
 
     Float2		AlignText(const Font& font, const Quad& q, TextAlignment align, StringSection<ucs4> text);
 	Float2		AlignText(const Font& font, const Quad& q, TextAlignment align, StringSection<> text);
+
+	class TextRunCache;
+	// As above, but measurements are looked up in (and added to) the given cache
+	Float2		AlignText(TextRunCache& cache, const Font& font, const Quad& q, TextAlignment align, StringSection<ucs4> text);
+	Float2		AlignText(TextRunCache& cache, const Font& font, const Quad& q, TextAlignment align, StringSection<> text);
 }
 
@@ -3,6 +3,7 @@
 // http://www.opensource.org/licenses/mit-license.php)
 
 #include "FontRendering.h"
+#include "TextRunCache.h"
 #include "ShapesInternal.h"
 #include "../RenderCore/Techniques/ImmediateDrawables.h"
 #include "../RenderCore/Techniques/CommonBindings.h"
@@ -18,6 +19,7 @@
 #include "../Math/RectanglePacking.h"
 #include "../Math/Transformations.h"
 #include "../ConsoleRig/ResourceBox.h"
+#include "../ConsoleRig/GlobalServices.h"
 #include "../Utility/MemoryUtils.h"
 #include "../Utility/StringUtils.h"
 #include "../Utility/PtrUtils.h"
@@ -25,6 +27,7 @@
 #include "../Math/Vector.h"
 #include <assert.h>
 #include <algorithm>
+#include <chrono>
 
 using namespace Utility::Literals;
 
@@ -35,6 +38,9 @@ namespace RenderOverlays
 	public:
 		void UpdateToTexture(RenderCore::IThreadContext& threadContext, IteratorRange<const void*> data, const RenderCore::Box2D& destBox);
 		void UpdateToTexture(RenderCore::IThreadContext& threadContext, IteratorRange<const void*> data, unsigned offset);
+
+		struct UploadRegion { RenderCore::Box2D _destBox; size_t _srcOffset; };
+		void UpdateToTexture(RenderCore::IThreadContext& threadContext, IteratorRange<const void*> data, IteratorRange<const UploadRegion*> regions);
 		const std::shared_ptr<RenderCore::IResource>& GetUnderlying() const { return _resource; }
 		const std::shared_ptr<RenderCore::IResourceView>& GetSRV() const { return _srv; }
 
@@ -495,7 +501,7 @@ namespace RenderOverlays
 	}
 
 	template<bool SnapCoords, bool CheckMaxXY, typename Instance>
-		static unsigned FindFirstRenderInstance(Instance** sortedInstances, unsigned instanceCount, const FontRenderingManager::Bitmap** bitmaps, float xScale, float yScale, float maxX)
+		static unsigned FindFirstRenderInstance(Instance* const* sortedInstances, unsigned instanceCount, const FontRenderingManager::Bitmap* const* bitmaps, float xScale, float yScale, float maxX)
 	{
 		unsigned firstRenderInstance = 0;
 		for (; firstRenderInstance<instanceCount; ++firstRenderInstance) {
@@ -520,34 +526,26 @@ namespace RenderOverlays
 		return firstRenderInstance;
 	}
 
-	template<typename CharType, typename WorkingSetType, bool CheckMaxXY, bool SnapCoords>
-		static bool DrawTemplate_Section(
-			RenderCore::IThreadContext& threadContext,
-			WorkingSetType& workingVertices,
-			FontRenderingManager& textureMan,
-			const Font& font, DrawTextFlags::BitField flags,
-			Float2& iterator, float xAtLineStart, float maxX, float maxY,
-			StringSection<CharType>& text,
-			float scale,
-			ColorB color, ColorB& colorOverride)
+	struct GlyphLayoutInstance
 	{
-		using namespace RenderCore;
-		assert(!text.IsEmpty());
+		ucs4 _chr;
+		Float2 _xy;
+		ColorB _colorOverride;
+		unsigned _lineIdx = 0;
+		unsigned _glyphIdx = ~0u;
+	};
 
-		struct Instance
-		{
-			ucs4 _chr;
-			Float2 _xy;
-			ColorB _color;
-			unsigned _lineIdx = 0;
-			unsigned _glyphIdx = ~0u;
-		};
-		// Split very long strings into smaller ones. Since we're using stack based allocations frequently
-		// we might blow out the stack otherwise
-		const size_t maxInstancePerCall = 1024;
-		VLA_UNSAFE_FORCE(Instance, instances, std::min(maxInstancePerCall, text.size()));
+	template<typename CharType, bool CheckMaxXY, bool SnapCoords>
+		static unsigned LayoutGlyphInstances(
+			GlyphLayoutInstance instances[], unsigned maxInstances,
+			const Font& font,
+			Float2& iterator, float xAtLineStart, float maxY,
+			StringSection<CharType>& text,
+			float scale, ColorB& colorOverride)
+	{
+		// Position each character, ignoring the advance (which we don't know until we have the bitmaps)
+		// On return "iterator" is at the (kerned) position of the last instance
 		unsigned instanceCount = 0;
-
 		float x = iterator[0], y = iterator[1];
 		float xScale = scale, yScale = scale;
 		if (!CheckMaxXY || (y + yScale * font.GetFontProperties()._lineHeight) <= maxY) {
@@ -559,7 +557,7 @@ namespace RenderOverlays
 				x = xScale * (int)(0.5f + x / xScale);
 				y = yScale * (int)(0.5f + y / yScale);
 			}
-			while (instanceCount < maxInstancePerCall) {
+			while (instanceCount < maxInstances) {
 				if (!text.IsEmpty() && expect_evaluation(*text._start == '{', false)) {
 					FontRenderingControlStatement ctrl;
 					text = ctrl.TryParse(text);
@@ -598,88 +596,93 @@ namespace RenderOverlays
 				y += yScale * v[1];
 				prevGlyph = curGlyph;
 
-				instances[instanceCount++] = { ch, Float2{x, y}, colorOverride.a?colorOverride:color, lineIdx };
+				instances[instanceCount++] = { ch, Float2{x, y}, colorOverride, lineIdx };
 			}
 		} else {
 			text._start = text._end;		// end iteration
 		}
 
-		if (!instanceCount) {
-			iterator = {x, y};
-			return true;
-		}
+		iterator = {x, y};
+		return instanceCount;
+	}
 
-		VLA(Instance*, sortedInstances, instanceCount);
+	static unsigned SortAndFindUniqueGlyphs(
+		GlyphLayoutInstance* sortedInstances[], ucs4 uniqueChrs[],
+		GlyphLayoutInstance instances[], unsigned instanceCount)
+	{
 		for (unsigned c=0; c<instanceCount; ++c) sortedInstances[c] = &instances[c];
 		std::sort(sortedInstances, &sortedInstances[instanceCount], [](auto* lhs, auto* rhs) { return lhs->_chr < rhs->_chr; });
 
-		VLA(ucs4, chrsToLookup, instanceCount);
-		unsigned chrsToLookupCount = 0;
+		unsigned uniqueChrCount = 0;
 		ucs4 lastChar = ~ucs4(0);
 		for (auto* i=sortedInstances; i!=&sortedInstances[instanceCount]; ++i) {
 			if ((*i)->_chr != lastChar)
-				chrsToLookup[chrsToLookupCount++] = lastChar = (*i)->_chr;		// get unique chars
-			(*i)->_glyphIdx = chrsToLookupCount-1;
+				uniqueChrs[uniqueChrCount++] = lastChar = (*i)->_chr;		// get unique chars
+			(*i)->_glyphIdx = uniqueChrCount-1;
 		}
+		return uniqueChrCount;
+	}
 
-		assert(chrsToLookupCount);
-		VLA(const FontRenderingManager::Bitmap*, bitmaps, chrsToLookupCount);
-		bool queryResult = textureMan.GetBitmaps(bitmaps, threadContext, font, MakeIteratorRange(chrsToLookup, &chrsToLookup[chrsToLookupCount]));
-		if (!queryResult)
-			return false;
-
+	static float ApplyGlyphAdvances(
+		IteratorRange<GlyphLayoutInstance*> instances,
+		const FontRenderingManager::Bitmap* const* bitmaps,
+		DrawTextFlags::BitField flags, float xScale)
+	{
 		// update the x values for each instance, now we know the set of bitmaps
+		// returns the advance accumulated on the last line
 		float xIterator = 0;
-		{
-			// unsigned prev_rsb_delta = 0;
-			unsigned lineIdx = 0;
-			for (auto& inst:MakeIteratorRange(instances, &instances[instanceCount])) {
-				auto& bitmap = *bitmaps[inst._glyphIdx];
-
-				/*
-				The freetype library suggests 2 different ways to use the lsb & rsb delta values. This method is
-				sounds like it is intended when for maintaining pixel alignment is needed
-				if (prev_rsb_delta - bitmap._lsbDelta > 32)
-					x -= 1.0f;
-				else if (prev_rsb_delta - bitmap._lsbDelta < -31)
-					x += 1.0f;
-				prev_rsb_delta = bitmap._rsbDelta;
-				*/
-
-				if (inst._lineIdx != lineIdx) {
-					lineIdx = inst._lineIdx;
-					xIterator = 0;		// reset because we just had a line break
-				}
+		// unsigned prev_rsb_delta = 0;
+		unsigned lineIdx = 0;
+		for (auto& inst:instances) {
+			auto& bitmap = *bitmaps[inst._glyphIdx];
+
+			/*
+			The freetype library suggests 2 different ways to use the lsb & rsb delta values. This method is
+			sounds like it is intended when for maintaining pixel alignment is needed
+			if (prev_rsb_delta - bitmap._lsbDelta > 32)
+				x -= 1.0f;
+			else if (prev_rsb_delta - bitmap._lsbDelta < -31)
+				x += 1.0f;
+			prev_rsb_delta = bitmap._rsbDelta;
+			*/
+
+			if (inst._lineIdx != lineIdx) {
+				lineIdx = inst._lineIdx;
+				xIterator = 0;		// reset because we just had a line break
+			}
 
-				inst._xy[0] += xIterator;
+			inst._xy[0] += xIterator;
 
-				xIterator += bitmap._xAdvance * xScale;
-				#if XLE_FONT_AUTOHINT_FRACTIONAL_WIDTHS
-					xIterator += float(bitmap._lsbDelta - bitmap._rsbDelta) / 64.f;
-				#endif
-				if (flags & DrawTextFlags::Outline) {
-					xIterator += 2 * xScale;
-				}
+			xIterator += bitmap._xAdvance * xScale;
+			#if XLE_FONT_AUTOHINT_FRACTIONAL_WIDTHS
+				xIterator += float(bitmap._lsbDelta - bitmap._rsbDelta) / 64.f;
+			#endif
+			if (flags & DrawTextFlags::Outline) {
+				xIterator += 2 * xScale;
 			}
 		}
+		return xIterator;
+	}
 
-		// Advance until we find the first character that is actually going to render
-		// this is important because we don't want to start the WorkingSetType if absolutely nothing renders (eg, all whitespace)
-		unsigned firstRenderInstance = FindFirstRenderInstance<SnapCoords, CheckMaxXY>(sortedInstances, instanceCount, bitmaps, xScale, yScale, maxX);
-		if (firstRenderInstance == instanceCount) {
-			iterator = { x + xIterator, y };
-			return true;
-		}
-
-		auto estimatedQuadCount = instanceCount - firstRenderInstance;
-		if (flags & DrawTextFlags::Shadow) estimatedQuadCount += text.size();
-		if (flags & DrawTextFlags::Outline) estimatedQuadCount += 8 * text.size();
+	template<bool SnapCoords, bool CheckMaxXY, typename WorkingSetType, typename Instance>
+		static void PushGlyphQuads(
+			WorkingSetType& workingVertices,
+			Instance* const* sortedInstancesBegin, Instance* const* sortedInstancesEnd,
+			const FontRenderingManager::Bitmap* const* bitmaps,
+			DrawTextFlags::BitField flags,
+			float xScale, float yScale, float maxX,
+			ColorB color)
+	{
+		auto instances = MakeIteratorRange(sortedInstancesBegin, sortedInstancesEnd);
+		auto estimatedQuadCount = instances.size();
+		if (flags & DrawTextFlags::Shadow) estimatedQuadCount += instances.size();
+		if (flags & DrawTextFlags::Outline) estimatedQuadCount += 8 * instances.size();
 
 		workingVertices.ReserveQuads((unsigned)estimatedQuadCount);
 		
 		auto shadowColor = ColorB{0, 0, 0, color.a};
 		if (flags & DrawTextFlags::Outline) {
-			for (auto* inst:MakeIteratorRange(&sortedInstances[firstRenderInstance], &sortedInstances[instanceCount])) {
+			for (auto* inst:instances) {
 				auto& bitmap = *bitmaps[inst->_glyphIdx];
 				if (!bitmap._width || !bitmap._height) continue;
 
@@ -748,7 +751,7 @@ namespace RenderOverlays
 		}
 
 		if (flags & DrawTextFlags::Shadow) {
-			for (auto* inst:MakeIteratorRange(&sortedInstances[firstRenderInstance], &sortedInstances[instanceCount])) {
+			for (auto* inst:instances) {
 				auto& bitmap = *bitmaps[inst->_glyphIdx];
 				if (!bitmap._width || !bitmap._height) continue;
 
@@ -774,7 +777,7 @@ namespace RenderOverlays
 			}
 		}
 
-		for (auto* inst:MakeIteratorRange(&sortedInstances[firstRenderInstance], &sortedInstances[instanceCount])) {
+		for (auto* inst:instances) {
 			auto& bitmap = *bitmaps[inst->_glyphIdx];
 			if (!bitmap._width || !bitmap._height) continue;
 
@@ -790,8 +793,56 @@ namespace RenderOverlays
 				baseX + bitmap._width * xScale, baseY + bitmap._height * yScale);
 
 			if (expect_evaluation(!CheckMaxXY || (pos.max[0] <= maxX), true))
-				workingVertices.PushQuad(pos, inst->_color, bitmap);
+				workingVertices.PushQuad(pos, inst->_colorOverride.a?inst->_colorOverride:color, bitmap);
 		}
+	}
+
+	template<typename CharType, typename WorkingSetType, bool CheckMaxXY, bool SnapCoords>
+		static bool DrawTemplate_Section(
+			RenderCore::IThreadContext& threadContext,
+			WorkingSetType& workingVertices,
+			FontRenderingManager& textureMan,
+			const Font& font, DrawTextFlags::BitField flags,
+			Float2& iterator, float xAtLineStart, float maxX, float maxY,
+			StringSection<CharType>& text,
+			float scale,
+			ColorB color, ColorB& colorOverride)
+	{
+		using namespace RenderCore;
+		assert(!text.IsEmpty());
+
+		// Split very long strings into smaller ones. Since we're using stack based allocations frequently
+		// we might blow out the stack otherwise
+		const size_t maxInstancePerCall = 1024;
+		VLA_UNSAFE_FORCE(GlyphLayoutInstance, instances, std::min(maxInstancePerCall, text.size()));
+		unsigned instanceCount = LayoutGlyphInstances<CharType, CheckMaxXY, SnapCoords>(
+			instances, (unsigned)std::min(maxInstancePerCall, text.size()),
+			font, iterator, xAtLineStart, maxY, text, scale, colorOverride);
+		if (!instanceCount)
+			return true;
+
+		float x = iterator[0], y = iterator[1];
+		float xScale = scale, yScale = scale;
+
+		VLA(GlyphLayoutInstance*, sortedInstances, instanceCount);
+		VLA(ucs4, chrsToLookup, instanceCount);
+		unsigned chrsToLookupCount = SortAndFindUniqueGlyphs(sortedInstances, chrsToLookup, instances, instanceCount);
+
+		assert(chrsToLookupCount);
+		VLA(const FontRenderingManager::Bitmap*, bitmaps, chrsToLookupCount);
+		bool queryResult = textureMan.GetBitmaps(bitmaps, threadContext, font, MakeIteratorRange(chrsToLookup, &chrsToLookup[chrsToLookupCount]));
+		if (!queryResult)
+			return false;
+
+		float xIterator = ApplyGlyphAdvances(MakeIteratorRange(instances, &instances[instanceCount]), bitmaps, flags, xScale);
+
+		// Advance until we find the first character that is actually going to render
+		// this is important because we don't want to start the WorkingSetType if absolutely nothing renders (eg, all whitespace)
+		unsigned firstRenderInstance = FindFirstRenderInstance<SnapCoords, CheckMaxXY>(sortedInstances, instanceCount, bitmaps, xScale, yScale, maxX);
+		if (firstRenderInstance != instanceCount)
+			PushGlyphQuads<SnapCoords, CheckMaxXY>(
+				workingVertices, &sortedInstances[firstRenderInstance], &sortedInstances[instanceCount],
+				bitmaps, flags, xScale, yScale, maxX, color);
 
 		iterator = { x + xIterator, y };		// y is at the baseline here
 		return true;
@@ -825,6 +876,100 @@ namespace RenderOverlays
 		return iterator;
 	}
 
+	template<typename CharType, bool CheckMaxXY>
+		static bool BuildTextRun(
+			TextRunCache::Run& run,
+			RenderCore::IThreadContext& threadContext,
+			FontRenderingManager& textureMan,
+			const Font& font, DrawTextFlags::BitField flags,
+			float relativeMaxY,
+			StringSection<CharType> text,
+			float scale)
+	{
+		// Lay out the text relative to the origin, so the result can be drawn anywhere
+		VLA_UNSAFE_FORCE(GlyphLayoutInstance, instances, text.size());
+		Float2 iterator { 0.f, 0.f };
+		ColorB colorOverride = 0x0;
+		unsigned instanceCount = LayoutGlyphInstances<CharType, CheckMaxXY, false>(
+			instances, (unsigned)text.size(),
+			font, iterator, 0.f, relativeMaxY, text, scale, colorOverride);
+		assert(text.IsEmpty());
+		if (!instanceCount) {
+			run._endIterator = iterator;
+			return true;
+		}
+
+		VLA(GlyphLayoutInstance*, sortedInstances, instanceCount);
+		VLA(ucs4, uniqueChrs, instanceCount);
+		unsigned uniqueChrCount = SortAndFindUniqueGlyphs(sortedInstances, uniqueChrs, instances, instanceCount);
+		run._glyphs = std::vector<ucs4>(uniqueChrs, &uniqueChrs[uniqueChrCount]);
+		run._bitmaps.resize(uniqueChrCount);
+		if (!textureMan.GetBitmaps(run._bitmaps.data(), run._bitmapsInvalidationIdx, threadContext, font, run._glyphs))
+			return false;
+
+		float xIterator = ApplyGlyphAdvances(MakeIteratorRange(instances, &instances[instanceCount]), run._bitmaps.data(), flags, scale);
+
+		run._instances.reserve(instanceCount);
+		for (auto* inst:MakeIteratorRange(sortedInstances, &sortedInstances[instanceCount]))
+			run._instances.push_back({inst->_xy, inst->_colorOverride, inst->_glyphIdx});
+		run._endIterator = { iterator[0] + xIterator, iterator[1] };
+		return true;
+	}
+
+	template<typename CharType, typename WorkingSetType, bool CheckMaxXY>
+		static Float2 DrawCachedTemplate(
+			RenderCore::IThreadContext& threadContext,
+			RenderCore::Techniques::IImmediateDrawables& immediateDrawables,
+			FontRenderingManager& textureMan,
+			const Font& font, DrawTextFlags::BitField flags,
+			float x, float y, float maxX, float maxY,
+			StringSection<CharType> text,
+			float scale, float depth,
+			ColorB color)
+	{
+		// Draw using a run from the TextRunCache. Layout, kerning & glyph lookups are skipped when the same text
+		// has been drawn recently with the same font & parameters
+		auto startTime = std::chrono::steady_clock::now();
+		auto& cache = textureMan.GetTextRunCache();
+		float relativeMaxY = CheckMaxXY ? (maxY - y) : 0.f;
+		auto key = TextRunCache::MakeRunKey(font, flags, text, scale, relativeMaxY);
+		auto* run = cache.FindRun(key);
+		bool hit = run != nullptr;
+		if (!run) {
+			TextRunCache::Run newRun;
+			if (!BuildTextRun<CharType, CheckMaxXY>(newRun, threadContext, textureMan, font, flags, relativeMaxY, text, scale))
+				return {0,0};
+			run = &cache.InsertRun(key, std::move(newRun));
+		} else if (!run->_glyphs.empty()) {
+			if (!textureMan.GetBitmaps(run->_bitmaps.data(), run->_bitmapsInvalidationIdx, threadContext, font, run->_glyphs))
+				return {0,0};
+		}
+
+		if (!run->_instances.empty()) {
+			auto instanceCount = (unsigned)run->_instances.size();
+			VLA_UNSAFE_FORCE(TextRunCache::GlyphInstance, instances, instanceCount);
+			VLA(TextRunCache::GlyphInstance*, sortedInstances, instanceCount);
+			for (unsigned c=0; c<instanceCount; ++c) {
+				instances[c] = run->_instances[c];
+				instances[c]._xy[0] += x;
+				instances[c]._xy[1] += y;
+				sortedInstances[c] = &instances[c];
+			}
+
+			unsigned firstRenderInstance = FindFirstRenderInstance<false, CheckMaxXY>(sortedInstances, instanceCount, run->_bitmaps.data(), scale, scale, maxX);
+			if (firstRenderInstance != instanceCount) {
+				WorkingSetType workingSet { immediateDrawables, textureMan.GetImmediateDrawableMaterial(), textureMan.GetImmediateDrawableUniforms(), depth, true };
+				PushGlyphQuads<false, CheckMaxXY>(
+					workingSet, &sortedInstances[firstRenderInstance], &sortedInstances[instanceCount],
+					run->_bitmaps.data(), flags, scale, scale, maxX, color);
+				workingSet.Complete();
+			}
+		}
+
+		cache.RecordRunLookup(hit, std::chrono::steady_clock::now() - startTime);
+		return { x + run->_endIterator[0], y + run->_endIterator[1] };
+	}
+
 	template<typename CharType, typename WorkingSetType>
 		static Float2 DrawTemplate(
 			RenderCore::IThreadContext& threadContext,
@@ -852,6 +997,9 @@ namespace RenderOverlays
 		return iterator;
 	}
 
+	// strings longer than this are drawn without the TextRunCache
+	static const size_t s_maxCachedRunLength = 1024;
+
 	Float2		Draw(   RenderCore::IThreadContext& threadContext,
 						RenderCore::Techniques::IImmediateDrawables& immediateDrawables,
 						FontRenderingManager& textureMan,
@@ -862,6 +1010,22 @@ namespace RenderOverlays
 						ColorB col)
 	{
 		assert(!(flags & DrawTextFlags::Snap));		// we could support this by using the SnapCoords template parameter to DrawTemplate<>
+		if (!text.IsEmpty() && text.size() <= s_maxCachedRunLength) {
+			if (maxX || maxY) {
+				if (expect_evaluation(textureMan.GetMode() == FontRenderingManager::Mode::LinearBuffer, true)) {
+					return DrawCachedTemplate<utf8, WorkingVertexSetFontResource, true>(threadContext, immediateDrawables, textureMan, font, flags, x, y, maxX, maxY, text, scale, depth, col);
+				} else {
+					return DrawCachedTemplate<utf8, WorkingVertexSetPCT, true>(threadContext, immediateDrawables, textureMan, font, flags, x, y, maxX, maxY, text, scale, depth, col);
+				}
+			} else {
+				if (expect_evaluation(textureMan.GetMode() == FontRenderingManager::Mode::LinearBuffer, true)) {
+					return DrawCachedTemplate<utf8, WorkingVertexSetFontResource, false>(threadContext, immediateDrawables, textureMan, font, flags, x, y, maxX, maxY, text, scale, depth, col);
+				} else {
+					return DrawCachedTemplate<utf8, WorkingVertexSetPCT, false>(threadContext, immediateDrawables, textureMan, font, flags, x, y, maxX, maxY, text, scale, depth, col);
+				}
+			}
+		}
+
 		if (maxX || maxY) {
 			// checking maximum extents
 			if (expect_evaluation(textureMan.GetMode() == FontRenderingManager::Mode::LinearBuffer, true)) {
@@ -888,6 +1052,22 @@ namespace RenderOverlays
 						ColorB col)
 	{
 		assert(!(flags & DrawTextFlags::Snap));
+		if (!text.IsEmpty() && text.size() <= s_maxCachedRunLength) {
+			if (maxX || maxY) {
+				if (expect_evaluation(textureMan.GetMode() == FontRenderingManager::Mode::LinearBuffer, true)) {
+					return DrawCachedTemplate<ucs4, WorkingVertexSetFontResource, true>(threadContext, immediateDrawables, textureMan, font, flags, x, y, maxX, maxY, text, scale, depth, col);
+				} else {
+					return DrawCachedTemplate<ucs4, WorkingVertexSetPCT, true>(threadContext, immediateDrawables, textureMan, font, flags, x, y, maxX, maxY, text, scale, depth, col);
+				}
+			} else {
+				if (expect_evaluation(textureMan.GetMode() == FontRenderingManager::Mode::LinearBuffer, true)) {
+					return DrawCachedTemplate<ucs4, WorkingVertexSetFontResource, false>(threadContext, immediateDrawables, textureMan, font, flags, x, y, maxX, maxY, text, scale, depth, col);
+				} else {
+					return DrawCachedTemplate<ucs4, WorkingVertexSetPCT, false>(threadContext, immediateDrawables, textureMan, font, flags, x, y, maxX, maxY, text, scale, depth, col);
+				}
+			}
+		}
+
 		if (maxX || maxY) {
 			// checking maximum extents
 			if (expect_evaluation(textureMan.GetMode() == FontRenderingManager::Mode::LinearBuffer, true)) {
@@ -1375,7 +1555,11 @@ namespace RenderOverlays
 
 	///////////////////////////////////////////////////////////////////////////////////////////////////
 
-	FontRenderingManager::FontRenderingManager(RenderCore::IDevice& device, Mode mode) { _pimpl = std::make_unique<Pimpl>(device, mode, 128, 256, 16); }
+	FontRenderingManager::FontRenderingManager(RenderCore::IDevice& device, Mode mode)
+	{
+		_pimpl = std::make_unique<Pimpl>(device, mode, 128, 256, 16);
+		_textRunCache = std::make_unique<TextRunCache>();
+	}
 	FontRenderingManager::~FontRenderingManager() {}
 
 	FontRenderingManager::Mode FontRenderingManager::GetMode() const { return _pimpl->_mode; }
@@ -1428,13 +1612,40 @@ namespace RenderOverlays
 		blitEncoder.Write(CopyPartial_Dest { *_resource, offset }, data);
 	}
 
-	static std::vector<uint8_t> GlyphAsDataPacket(
+	void FontTexture2D::UpdateToTexture(
+		RenderCore::IThreadContext& threadContext,
+		IteratorRange<const void*> data, IteratorRange<const UploadRegion*> regions)
+	{
+		// Each region is packed tightly within "data", starting at _srcOffset. All regions are written with a single
+		// blit encoder
+		using namespace RenderCore;
+		auto& metalContext = *Metal::DeviceContext::Get(threadContext);
+		auto* res = _resource.get();
+		Metal::CompleteInitialization(*Metal::DeviceContext::Get(threadContext), {&res, &res+1});
+		auto blitEncoder = metalContext.BeginBlitEncoder();
+		auto bytesPerPixel = BitsPerPixel(_format) / 8;
+		for (const auto& r:regions) {
+			unsigned width = r._destBox._right - r._destBox._left, height = r._destBox._bottom - r._destBox._top;
+			auto byteCount = width * height * bytesPerPixel;
+			assert((r._srcOffset + byteCount) <= data.size());
+			TexturePitches pitches { width * bytesPerPixel, byteCount, byteCount };
+			blitEncoder.Write(
+				CopyPartial_Dest {
+					*_resource, {}, VectorPattern<unsigned, 3>{ unsigned(r._destBox._left), unsigned(r._destBox._top), 0u }
+				},
+				SubResourceInitData { MakeIteratorRange(PtrAdd(data.begin(), r._srcOffset), PtrAdd(data.begin(), r._srcOffset + byteCount)) },
+				_format,
+				VectorPattern<unsigned, 3>{ width, height, 1u },
+				pitches);
+		}
+	}
+
+	static void WriteGlyphDataPacket(
+		uint8_t* packet,
 		unsigned srcWidth, unsigned srcHeight,
 		IteratorRange<const void*> srcData,
-		int offX, int offY, int width, int height)
+		int width, int height)
 	{
-		std::vector<uint8_t> packet(width*height);
-
 		int j = 0;
 		for (; j < std::min(height, (int)srcHeight); ++j) {
 			int i = 0;
@@ -1446,7 +1657,15 @@ namespace RenderOverlays
 		for (; j < height; ++j)
 			for (int i=0; i < width; ++i)
 				packet[i + j*width] = 0;
+	}
 
+	static std::vector<uint8_t> GlyphAsDataPacket(
+		unsigned srcWidth, unsigned srcHeight,
+		IteratorRange<const void*> srcData,
+		int offX, int offY, int width, int height)
+	{
+		std::vector<uint8_t> packet(width*height);
+		WriteGlyphDataPacket(packet.data(), srcWidth, srcHeight, srcData, width, height);
 		return packet;
 	}
 
@@ -1458,7 +1677,6 @@ namespace RenderOverlays
 		RenderCore::IThreadContext& threadContext,
 		const Font& font,
 		ucs4 ch,
-		std::vector<std::pair<uint64_t, Bitmap>>::iterator insertPoint,
 		uint64_t code, bool alreadyAttemptedFree) -> const Bitmap&
 	{
 		assert(_pimpl->_mode == Mode::Texture2D);
@@ -1468,8 +1686,7 @@ namespace RenderOverlays
 			Bitmap result = {};
 			result._xAdvance = newData._xAdvance;		// still need xAdvance here for characters that aren't drawn (ie, whitespace)
 			result._lastAccessFrame = _currentFrameIdx;
-			auto i = _glyphs.insert(insertPoint, std::make_pair(code, result));
-			return i->second;
+			return _glyphs.insert({code, result}).first->second;
 		}
 
 		if (newData._width > _pimpl->_pageWidth || newData._height > _pimpl->_pageHeight)
@@ -1490,9 +1707,7 @@ namespace RenderOverlays
 			if (alreadyAttemptedFree) return s_emptyBitmap;		// maybe too big to fit on a page?
 			FreeUpHeapSpace_2D({newData._width, newData._height});
 			SynchronousDefrag_2D(threadContext);
-			auto code = HashCombine(ch, font.GetHash());
-			insertPoint = LowerBound(_glyphs, code);		// FreeUpHeapSpace invalidates this vector
-			return InitializeNewGlyph(threadContext, font, ch, insertPoint, code, true);
+			return InitializeNewGlyph(threadContext, font, ch, code, true);
 		}
 
 		_pimpl->_activePages[bestPage]._packer.Allocate(bestAllocation);
@@ -1533,12 +1748,141 @@ namespace RenderOverlays
 		#endif
 		result._lastAccessFrame = _currentFrameIdx;
 
-		auto i = _glyphs.insert(insertPoint, std::make_pair(code, result));
+		auto i = _glyphs.insert({code, result}).first;
 		++_getBitmapsInvalidationIdx;
 		return i->second;
 	}
 
-	bool FontRenderingManager::InitializeNewGlyphs(
+	static Utility::ThreadPool* GetRasterizationPool()
+	{
+		return &ConsoleRig::GlobalServices::GetInstance().GetShortTaskThreadPool();
+	}
+
+	bool FontRenderingManager::InitializeNewGlyphs_2D(
+		RenderCore::IThreadContext& threadContext,
+		const Font& font,
+		IteratorRange<const ucs4*> chrs, bool alreadyAttemptedFree)
+	{
+		assert(_pimpl->_mode == Mode::Texture2D);
+		assert(!chrs.empty());
+
+		// Rasterize all of the glyphs up front (the font may spread this across the thread pool), then pack them
+		// in a single pass, largest first, and finally write them into the texture with a single blit encoder
+		std::vector<Font::Bitmap> bitmaps(chrs.size());
+		font.GetBitmaps(MakeIteratorRange(bitmaps), chrs, GetRasterizationPool());
+
+		uint64_t fontHash = (font.GetHash() & 0xffffffffull) << 32ull;
+		std::vector<unsigned> packingOrder;
+		packingOrder.reserve(chrs.size());
+		for (unsigned c=0; c<chrs.size(); ++c) {
+			const auto& newData = bitmaps[c];
+			if ((newData._width * newData._height) == 0 || newData._width > _pimpl->_pageWidth || newData._height > _pimpl->_pageHeight) {
+				// Either no bitmap content (ie, whitespace) or a glyph that can't fit even when using an entire page
+				// We still need xAdvance here for characters that aren't drawn
+				Bitmap result = {};
+				result._xAdvance = newData._xAdvance;
+				result._lastAccessFrame = _currentFrameIdx;
+				_glyphs.insert({fontHash|chrs[c], result});
+				continue;
+			}
+			packingOrder.push_back(c);
+		}
+		std::sort(
+			packingOrder.begin(), packingOrder.end(),
+			[&bitmaps](auto lhs, auto rhs)
+			{
+				return std::max(bitmaps[lhs]._width, bitmaps[lhs]._height) > std::max(bitmaps[rhs]._width, bitmaps[rhs]._height);
+			});
+
+		std::vector<std::pair<unsigned, FontTexture2D::UploadRegion>> uploads;
+		std::vector<ucs4> overflowChrs;
+		uploads.reserve(packingOrder.size());
+		size_t stagingSize = 0;
+		UInt2 largestOverflow{0, 0};
+		for (auto c:packingOrder) {
+			const auto& newData = bitmaps[c];
+			unsigned bestPage = ~0u;
+			RectanglePacker_MaxRects::PreviewedAllocation bestAllocation;
+			bestAllocation._score = std::numeric_limits<int>::max();
+			for (unsigned p=0; p<_pimpl->_activePages.size(); ++p) {
+				auto allocation = _pimpl->_activePages[p]._packer.PreviewAllocation({newData._width, newData._height});
+				if (allocation._score < bestAllocation._score) {
+					bestPage = p;
+					bestAllocation = allocation;
+				}
+			}
+			if (bestPage == ~0u) {
+				overflowChrs.push_back(chrs[c]);
+				largestOverflow = UInt2{std::max(largestOverflow[0], newData._width), std::max(largestOverflow[1], newData._height)};
+				continue;
+			}
+
+			_pimpl->_activePages[bestPage]._packer.Allocate(bestAllocation);
+			auto rect = bestAllocation._rectangle;
+			rect.first += _pimpl->_activePages[bestPage]._spaceInTexture._topLeft;
+			rect.second += _pimpl->_activePages[bestPage]._spaceInTexture._topLeft;
+			_pimpl->_activePages[bestPage]._texelsAllocated += (rect.second[0] - rect.first[0]) * (rect.second[1] - rect.first[1]);
+			assert(_pimpl->_activePages[bestPage]._texelsAllocated >= 0);
+			assert((rect.second[0]-rect.first[0]) >= newData._width);
+			assert((rect.second[1]-rect.first[1]) >= newData._height);
+
+			FontTexture2D::UploadRegion region;
+			region._destBox = RenderCore::Box2D{(int)rect.first[0], (int)rect.first[1], (int)rect.second[0], (int)rect.second[1]};
+			region._srcOffset = stagingSize;
+			stagingSize += (rect.second[0] - rect.first[0]) * (rect.second[1] - rect.first[1]);
+			uploads.emplace_back(c, region);
+		}
+
+		// Upload before anything else can happen to the pages (since a defrag below would copy from the new locations)
+		if (!uploads.empty() && _pimpl->_texture) {
+			std::vector<uint8_t> staging(stagingSize);
+			std::vector<FontTexture2D::UploadRegion> regions;
+			regions.reserve(uploads.size());
+			for (const auto& u:uploads) {
+				const auto& newData = bitmaps[u.first];
+				WriteGlyphDataPacket(
+					PtrAdd(staging.data(), u.second._srcOffset),
+					newData._width, newData._height, newData._data,
+					u.second._destBox._right - u.second._destBox._left, u.second._destBox._bottom - u.second._destBox._top);
+				regions.push_back(u.second);
+			}
+			_pimpl->_texture->UpdateToTexture(threadContext, staging, regions);
+		}
+
+		for (const auto& u:uploads) {
+			const auto& newData = bitmaps[u.first];
+			const auto& box = u.second._destBox;
+			Bitmap result;
+			result._xAdvance = newData._xAdvance;
+			result._bitmapOffsetX = newData._bitmapOffsetX;
+			result._bitmapOffsetY = newData._bitmapOffsetY;
+			result._width = newData._width;
+			result._height = newData._height;
+			result._tcTopLeft[0] = box._left / float(_pimpl->_texWidth);
+			result._tcTopLeft[1] = box._top / float(_pimpl->_texHeight);
+			result._tcBottomRight[0] = (box._left + newData._width) / float(_pimpl->_texWidth);
+			result._tcBottomRight[1] = (box._top + newData._height) / float(_pimpl->_texHeight);
+			#if XLE_FONT_AUTOHINT_FRACTIONAL_WIDTHS
+				result._lsbDelta = newData._lsbDelta;
+				result._rsbDelta = newData._rsbDelta;
+			#endif
+			result._lastAccessFrame = _currentFrameIdx;
+			_glyphs.insert({fontHash|chrs[u.first], result});
+		}
+		++_getBitmapsInvalidationIdx;
+
+		if (!overflowChrs.empty()) {
+			// could not fit everything in -- we need to release some space and try to do a defrag
+			if (alreadyAttemptedFree) return false;
+			FreeUpHeapSpace_2D(largestOverflow);
+			SynchronousDefrag_2D(threadContext);
+			return InitializeNewGlyphs_2D(threadContext, font, overflowChrs, true);
+		}
+
+		return true;
+	}
+
+	bool FontRenderingManager::InitializeNewGlyphs_Linear(
 		RenderCore::IThreadContext& threadContext,
 		const Font& font,
 		IteratorRange<const ucs4*> chrs, bool alreadyAttemptedFree)
@@ -1549,20 +1893,20 @@ namespace RenderOverlays
 		// Initialize multiple new glyphs at once. We'll allocate all of the space for the new glyphs in one go
 		// only works with linear buffer resources
 
-		VLA_UNSAFE_FORCE(RenderOverlays::Font::Bitmap, bitmaps, chrs.size());
+		std::vector<RenderOverlays::Font::Bitmap> bitmaps(chrs.size());
+		font.GetBitmaps(MakeIteratorRange(bitmaps), chrs, GetRasterizationPool());
 		std::vector<uint8_t> storageBuffer;
 		std::vector<ucs4> overflowChrs;
 		unsigned maxPageSize = _pimpl->_pageWidth;
 		storageBuffer.reserve(maxPageSize);
 		unsigned cnt=0;
 		for (auto chr:chrs) {
-			bitmaps[cnt] = font.GetBitmap(chr);
 			auto start = storageBuffer.size();
 			assert(!bitmaps[cnt]._data.empty() || (bitmaps[cnt]._width == 0 && bitmaps[cnt]._height == 0));
 			if (start+bitmaps[cnt]._data.size() > maxPageSize) {
+				if (bitmaps[cnt]._data.size() <= maxPageSize) overflowChrs.emplace_back(chr);
 				bitmaps[cnt]._data = MakeIteratorRange((const void*)1, (const void*)0);
 				++cnt;
-				if (bitmaps[cnt]._data.size() <= maxPageSize) overflowChrs.emplace_back(chr);
 				continue;
 			}
 			storageBuffer.insert(storageBuffer.end(), (const uint8_t*)bitmaps[cnt]._data.begin(), (const uint8_t*)bitmaps[cnt]._data.end());
@@ -1588,7 +1932,7 @@ namespace RenderOverlays
 					return false;		// maybe too big to fit on a page?
 				FreeUpHeapSpace_Linear(storageBuffer.size());
 				SynchronousDefrag_Linear(threadContext);
-				return InitializeNewGlyphs(threadContext, font, chrs, true);
+				return InitializeNewGlyphs_Linear(threadContext, font, chrs, true);
 			}
 
 			auto allocation = _pimpl->_activePages[bestPage]._spanningHeap.Allocate(allocationSize);
@@ -1604,7 +1948,6 @@ namespace RenderOverlays
 		}
 
 		uint64_t fontHash = (font.GetHash() & 0xffffffffull) << 32ull;
-		auto i = _glyphs.begin();
 		for (unsigned c=0; c<chrs.size(); ++c) {
 			if (bitmaps[c]._data.begin() > bitmaps[c]._data.end()) continue;		// skipped chr
 
@@ -1621,16 +1964,14 @@ namespace RenderOverlays
 			result._width = bitmaps[c]._width;
 			result._height = bitmaps[c]._height;
 
-			// expecting 'chrs' in sorted order, so we always move 'i' forward
-			i = LowerBound2(MakeIteratorRange(i, _glyphs.end()), fontHash | chrs[c]);
-			i = _glyphs.insert(i, std::make_pair(fontHash | chrs[c], result));
+			_glyphs.insert({fontHash | chrs[c], result});
 		}
 
 		++_getBitmapsInvalidationIdx;
 
 		// If the allocation exceeded a page size, we might need to come back for some new characters
 		if (!overflowChrs.empty())
-			return InitializeNewGlyphs(threadContext,font, overflowChrs, alreadyAttemptedFree);
+			return InitializeNewGlyphs_Linear(threadContext,font, overflowChrs, alreadyAttemptedFree);
 
 		return true;
 	}
@@ -1644,16 +1985,16 @@ namespace RenderOverlays
 		auto glyphsToErase = _glyphs.size() / _pimpl->_activePages.size();
 		if (glyphsToErase == 0) return;
 		
-		using GlyphPair = std::pair<unsigned, unsigned>;
-		VLA_UNSAFE_FORCE(GlyphPair, glyphsByAge, _glyphs.size());
-		for (unsigned c=0; c<_glyphs.size(); ++c)
-			glyphsByAge[c] = {c, _glyphs[c].second._lastAccessFrame};
-		std::sort(glyphsByAge, &glyphsByAge[_glyphs.size()], [](const auto&lhs, const auto& rhs) { return lhs.second < rhs.second; });
-		std::sort(glyphsByAge, &glyphsByAge[glyphsToErase], [](const auto&lhs, const auto& rhs) { return lhs.first > rhs.first; });
+		using GlyphPair = std::pair<decltype(_glyphs)::iterator, unsigned>;
+		std::vector<GlyphPair> glyphsByAge;
+		glyphsByAge.reserve(_glyphs.size());
+		for (auto i=_glyphs.begin(); i!=_glyphs.end(); ++i)
+			glyphsByAge.emplace_back(i, i->second._lastAccessFrame);
+		std::sort(glyphsByAge.begin(), glyphsByAge.end(), [](const auto&lhs, const auto& rhs) { return lhs.second < rhs.second; });
 
 		bool foundBigEnoughGap = false;
 		for (unsigned c=0; c<glyphsToErase; ++c) {
-			auto& glyph = _glyphs[glyphsByAge[c].first];
+			auto& glyph = *glyphsByAge[c].first;
 			Rect rectangle {
 				{
 					unsigned(glyph.second._tcTopLeft[0] * _pimpl->_texWidth + 0.5f),
@@ -1677,7 +2018,7 @@ namespace RenderOverlays
 					break;
 				}
 			assert(foundPage);
-			_glyphs.erase(_glyphs.begin()+glyphsByAge[c].first);
+			_glyphs.erase(glyphsByAge[c].first);
 
 			foundBigEnoughGap |= (rectangle.Width() >= requestedSpace[0]) && (rectangle.Height() >= requestedSpace[1]);
 		}
@@ -1688,11 +2029,12 @@ namespace RenderOverlays
 			// if it does, at least we know we'll find some space for it
 			// The issue here is it might start causing thrashing if there are only a few very large glyphs
 			// This is going to be a little expensive, because we have to do another sort & search
-			for (unsigned c=0; c<_glyphs.size(); ++c)
-				glyphsByAge[c] = {c, _glyphs[c].second._lastAccessFrame};
-			std::sort(glyphsByAge, &glyphsByAge[_glyphs.size()], [](const auto&lhs, const auto& rhs) { return lhs.second < rhs.second; });
-			for (unsigned c=0; c<_glyphs.size(); ++c) {
-				auto& glyph = _glyphs[glyphsByAge[c].first];
+			glyphsByAge.clear();
+			for (auto i=_glyphs.begin(); i!=_glyphs.end(); ++i)
+				glyphsByAge.emplace_back(i, i->second._lastAccessFrame);
+			std::sort(glyphsByAge.begin(), glyphsByAge.end(), [](const auto&lhs, const auto& rhs) { return lhs.second < rhs.second; });
+			for (unsigned c=0; c<glyphsByAge.size(); ++c) {
+				auto& glyph = *glyphsByAge[c].first;
 				Rect rectangle {
 					{
 						unsigned(glyph.second._tcTopLeft[0] * _pimpl->_texWidth + 0.5f),
@@ -1715,12 +2057,13 @@ namespace RenderOverlays
 							break;
 						}
 					assert(foundPage);
-					_glyphs.erase(_glyphs.begin()+glyphsByAge[c].first);
+					_glyphs.erase(glyphsByAge[c].first);
 					foundBigEnoughGap = true;
 					break;
 				}
 			}
 		}
+		++_getBitmapsInvalidationIdx;		// pointers to erased glyphs are now dangling
 		// caller should generally call SynchronousDefrag after this
 		// when we return, we should have space for a lot more glyphs
 	}
@@ -1747,11 +2090,12 @@ namespace RenderOverlays
 		auto& srcPage = _pimpl->_activePages[worstPage];
 
 		// Find all of the glyphs & all of the rectangles that are on this page. We will reallocate them and try to get an optimal packing
-		std::vector<std::pair<unsigned, Rect>> associatedRectangles;
+		using GlyphIterator = decltype(_glyphs)::iterator;
+		std::vector<std::pair<GlyphIterator, Rect>> associatedRectangles;
 		associatedRectangles.reserve(_glyphs.size() / (_pimpl->_activePages.size()) * 2);
 
-		for (unsigned g=0; g<_glyphs.size(); ++g) {
-			auto& glyph = _glyphs[g];
+		for (auto g=_glyphs.begin(); g!=_glyphs.end(); ++g) {
+			auto& glyph = *g;
 			Rect rectangle {
 				{
 					unsigned(glyph.second._tcTopLeft[0] * _pimpl->_texWidth + 0.5f),
@@ -1777,7 +2121,7 @@ namespace RenderOverlays
 			});
 		
 		std::vector<Rect> newPacking;
-		std::vector<unsigned> glyphsToDelete;
+		std::vector<GlyphIterator> glyphsToDelete;
 		newPacking.reserve(associatedRectangles.size());
 		RectanglePacker_MaxRects packer{UInt2{_pimpl->_pageWidth, _pimpl->_pageHeight}};
 		unsigned allocatedTexels = 0;
@@ -1823,7 +2167,7 @@ namespace RenderOverlays
 
 		// reassign glyphs table and make the new page active
 		for (unsigned c=0; c<associatedRectangles.size(); ++c) {
-			auto& glyph = _glyphs[associatedRectangles[c].first].second;
+			auto& glyph = associatedRectangles[c].first->second;
 			auto rect = newPacking[c];
 			glyph._tcTopLeft[0] = rect._topLeft[0] / float(_pimpl->_texWidth);
 			glyph._tcTopLeft[1] = rect._topLeft[1] / float(_pimpl->_texHeight);
@@ -1832,8 +2176,8 @@ namespace RenderOverlays
 		}
 
 		// delete any glyphs that didn't be successfully packed into the new texture
-		std::sort(glyphsToDelete.begin(), glyphsToDelete.end(), [](auto lhs, auto rhs) { return rhs > lhs; });
-		for (auto g:glyphsToDelete) _glyphs.erase(_glyphs.begin()+g);
+		for (auto g:glyphsToDelete) _glyphs.erase(g);
+		if (!glyphsToDelete.empty()) ++_getBitmapsInvalidationIdx;
 
 		_pimpl->_reservedPage._packer = std::move(packer);
 		_pimpl->_reservedPage._texelsAllocated = allocatedTexels;
@@ -1862,12 +2206,11 @@ namespace RenderOverlays
 			const unsigned gracePeriod = 4;
 			if (_currentFrameIdx < gracePeriod || oldestFrame > _currentFrameIdx-gracePeriod) return;
 
-			for (unsigned g=0; g<_glyphs.size();) {
-				auto idx = _glyphs.size() - g - 1;
-				if (_glyphs[idx].second._lastAccessFrame == oldestFrame) {
+			for (auto g=_glyphs.begin(); g!=_glyphs.end();) {
+				if (g->second._lastAccessFrame == oldestFrame) {
 
-					auto start = _glyphs[idx].second._encodingOffset;
-					auto end = start+_glyphs[idx].second._width*_glyphs[idx].second._height;
+					auto start = g->second._encodingOffset;
+					auto end = start+g->second._width*g->second._height;
 					bool foundPage = false;
 					for (auto& p:_pimpl->_activePages)
 						if (start >= p._spaceInTexture._topLeft[0] && end <= p._spaceInTexture._bottomRight[0]) {
@@ -1878,8 +2221,9 @@ namespace RenderOverlays
 						}
 					assert(foundPage);
 
-					_glyphs.erase(_glyphs.begin()+idx);
+					g = _glyphs.erase(g);
 					++glyphsErased;
+					++_getBitmapsInvalidationIdx;		// pointers to erased glyphs are now dangling
 				} else
 					++g;
 			}
@@ -1936,8 +2280,8 @@ namespace RenderOverlays
 		}
 
 		// reassign glyphs table and make the new page active
-		for (unsigned g=0; g<_glyphs.size(); ++g) {
-			auto& glyph = _glyphs[g].second;
+		for (auto& g:_glyphs) {
+			auto& glyph = g.second;
 			if (glyph._encodingOffset >= srcPageStart && glyph._encodingOffset < srcPageEnd) {
 				auto startInSrcHeap = glyph._encodingOffset - srcPageStart;
 				auto endInSrcHeap = startInSrcHeap + glyph._width*glyph._height;
@@ -1964,42 +2308,29 @@ namespace RenderOverlays
 		IteratorRange<const ucs4*> chrs)
 	{
 		// first - check if all of the characters are already in the glyphs list
-		// expecting "chrs" to be in sorted order already
-		uint64_t fontHash = (font.GetHash() & 0xffffffffull) << 32ull;	// we only use the lower 32 bits of the font hash (because we're going to use the fact that the input chrs are in sorted order)
-		auto chrIterator = chrs.begin();
+		// expecting "chrs" to be in sorted order already (which groups together duplicates)
+		uint64_t fontHash = (font.GetHash() & 0xffffffffull) << 32ull;
 		VLA(ucs4, missingGlyphs, chrs.size());
 		unsigned missingGlyphCount = 0;
-		const Bitmap** bitmapIterator = bitmaps;
-		auto i = LowerBound(_glyphs, fontHash|uint64_t(*chrIterator));
-		auto endi = LowerBound2(MakeIteratorRange(i, _glyphs.end()), fontHash|0xffffffffull);
-		while (chrIterator != chrs.end()) {
-			auto code = fontHash | *chrIterator;
-			i = LowerBound2(MakeIteratorRange(i, endi), code);
-			if (i == endi) break;
-			if (i->first != code) {
-				missingGlyphs[missingGlyphCount++] = *chrIterator;
-			} else {
-				*bitmapIterator++ = &i->second;
+		for (unsigned c=0; c<chrs.size(); ++c) {
+			auto i = _glyphs.find(fontHash|uint64_t(chrs[c]));
+			if (i != _glyphs.end()) {
+				bitmaps[c] = &i->second;
 				i->second._lastAccessFrame = _currentFrameIdx;	// update _lastAccessFrame before we call InitializeNewGlyphs below
-			}
-			++chrIterator;
+			} else if (!missingGlyphCount || missingGlyphs[missingGlyphCount-1] != chrs[c])
+				missingGlyphs[missingGlyphCount++] = chrs[c];
 		}
-		for (; chrIterator != chrs.end(); ++chrIterator) missingGlyphs[missingGlyphCount++] = *chrIterator;
 
-		// Note that InitializeNewGlyphs changes the _glyphs vector, thereby invalidating everything returned from GetBitmaps()
-		// from this call, and all previous calls.
+		// Note that InitializeNewGlyphs can free glyphs to make space, thereby invalidating everything returned from
+		// GetBitmaps() from this call, and all previous calls.
 		if (missingGlyphCount) {
+			auto missing = MakeIteratorRange(missingGlyphs, &missingGlyphs[missingGlyphCount]);
 			if (_pimpl->_mode == Mode::LinearBuffer) {
-				if (!InitializeNewGlyphs(threadContext, font, MakeIteratorRange(missingGlyphs, &missingGlyphs[missingGlyphCount]), false))
+				if (!InitializeNewGlyphs_Linear(threadContext, font, missing, false))
 					return false;
 			} else {
-				// in the (older) Texture2D mode, we must initialize each glyph separately
-				for(auto ch:MakeIteratorRange(missingGlyphs, &missingGlyphs[missingGlyphCount])) {
-					auto code = fontHash|uint64_t(ch);
-					auto i = LowerBound(_glyphs, code);
-					assert(i == _glyphs.end() || i->first != code);
-					InitializeNewGlyph(threadContext, font, ch, i, code, false);
-				}
+				if (!InitializeNewGlyphs_2D(threadContext, font, missing, false))
+					return false;
 			}
 
 			// We have to redo everything from scratch after calling InitializeNewGlyphs
@@ -2008,6 +2339,26 @@ namespace RenderOverlays
 		return true;
 	}
 
+	bool FontRenderingManager::GetBitmaps(
+		const Bitmap* bitmaps[],
+		unsigned& invalidationIdx,
+		RenderCore::IThreadContext& threadContext,
+		const Font& font,
+		IteratorRange<const ucs4*> chrs)
+	{
+		if (invalidationIdx == _getBitmapsInvalidationIdx) {
+			// nothing has been added or removed since "bitmaps" was filled in; we just need to mark them as used
+			for (unsigned c=0; c<chrs.size(); ++c)
+				const_cast<Bitmap*>(bitmaps[c])->_lastAccessFrame = _currentFrameIdx;
+			return true;
+		}
+
+		if (!GetBitmaps(bitmaps, threadContext, font, chrs))
+			return false;
+		invalidationIdx = _getBitmapsInvalidationIdx;
+		return true;
+	}
+
 	void FontRenderingManager::AddUploadBarrier(RenderCore::IThreadContext& threadContext)
 	{
 		RenderCore::Metal::BarrierHelper(threadContext).Add(*_pimpl->_texture->GetUnderlying(), RenderCore::BindFlag::TransferDst, RenderCore::BindFlag::ShaderResource);
@@ -2031,6 +2382,12 @@ namespace RenderOverlays
 	void FontRenderingManager::OnFrameBarrier()
 	{
 		++_currentFrameIdx;
+		_textRunCache->OnFrameBarrier();
+	}
+
+	TextRunCache& FontRenderingManager::GetTextRunCache()
+	{
+		return *_textRunCache;
 	}
 
 	const RenderCore::Techniques::ImmediateDrawableMaterial& FontRenderingManager::GetImmediateDrawableMaterial()
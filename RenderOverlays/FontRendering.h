@@ -9,6 +9,7 @@
 #include "../Math/Matrix.h"
 #include <vector>
 #include <memory>
+#include <unordered_map>
 
 namespace RenderCore { class IResource; class IResourceView; class IThreadContext; class IDevice; }
 namespace RenderCore { namespace Techniques { class IImmediateDrawables; class ImmediateDrawableMaterial; class RetainedUniformsStream; }}
@@ -19,6 +20,7 @@ namespace RenderOverlays
 	class Font;
 	class FontTexture2D;
 	class FontRenderingManager;
+	class TextRunCache;
 
 	Float2		Draw(   RenderCore::IThreadContext& threadContext,
 						RenderCore::Techniques::IImmediateDrawables& immediateDrawables,
@@ -113,6 +115,17 @@ namespace RenderOverlays
 			const Font& font,
 			IteratorRange<const ucs4*> chrs);
 
+		/// As above, but when "bitmaps" was filled by a previous call and no glyphs have been added or removed since
+		/// (as tracked by "invalidationIdx"), the lookup is skipped and the existing pointers are reused
+		bool GetBitmaps(
+			const Bitmap* bitmaps[],
+			unsigned& invalidationIdx,
+			RenderCore::IThreadContext& threadContext,
+			const Font& font,
+			IteratorRange<const ucs4*> chrs);
+
+		TextRunCache& GetTextRunCache();
+
 		const std::shared_ptr<RenderCore::IResourceView>& GetSRV() const;
 		const FontTexture2D& GetFontTexture();
 		UInt2 GetTextureDimensions();
@@ -133,19 +146,25 @@ namespace RenderOverlays
 		~FontRenderingManager();
 
 	private:
-		std::vector<std::pair<uint64_t, Bitmap>> _glyphs;
+		// keyed on (bottom 32 bits of font hash << 32) | character. Element addresses are stable across insertions,
+		// but not across FreeUpHeapSpace_...() calls
+		std::unordered_map<uint64_t, Bitmap> _glyphs;
 		unsigned _currentFrameIdx = 0;
 		
 		class Pimpl;
 		std::shared_ptr<Pimpl> _pimpl;
+		std::unique_ptr<TextRunCache> _textRunCache;
 
 		const Bitmap& InitializeNewGlyph(
 			RenderCore::IThreadContext& threadContext,
 			const Font& font,
 			ucs4 ch,
-			std::vector<std::pair<uint64_t, Bitmap>>::iterator insertPoint,
 			uint64_t code, bool alreadyAttemptedFree);
-		bool InitializeNewGlyphs(
+		bool InitializeNewGlyphs_2D(
+			RenderCore::IThreadContext& threadContext,
+			const Font& font,
+			IteratorRange<const ucs4*> chrs, bool alreadyAttemptedFree);
+		bool InitializeNewGlyphs_Linear(
 			RenderCore::IThreadContext& threadContext,
 			const Font& font,
 			IteratorRange<const ucs4*> chrs, bool alreadyAttemptedFree);
@@ -161,16 +180,16 @@ namespace RenderOverlays
 		const Font& font,
 		ucs4 ch) -> const Bitmap&
 	{
-		// we only use the bottom 32 bits of the font so that glyphs from the same font remain contiguous
+		// we only use the bottom 32 bits of the font hash, so the character can occupy the bottom 32 bits of the key
 		uint64_t fontHash = (font.GetHash() & 0xffffffffull) << 32ull;
 		auto code = fontHash|uint64_t(ch);
-		auto i = LowerBound(_glyphs, code);
-		if (expect_evaluation(i != _glyphs.end() && i->first == code, true)) {
+		auto i = _glyphs.find(code);
+		if (expect_evaluation(i != _glyphs.end(), true)) {
 			i->second._lastAccessFrame = _currentFrameIdx;
 			return i->second;
 		}
 
-		return InitializeNewGlyph(threadContext, font, ch, i, code, false);
+		return InitializeNewGlyph(threadContext, font, ch, code, false);
 	}
 
 }
@@ -887,7 +887,7 @@ namespace RenderOverlays
 		Quad q;
 		q.min = Float2(std::get<0>(quad)[0], std::get<0>(quad)[1]);
 		q.max = Float2(std::get<1>(quad)[0], std::get<1>(quad)[1]);
-		Float2 alignedPosition = AlignText(font, q, alignment, text);
+		Float2 alignedPosition = AlignText(context.GetFontRenderingManager()->GetTextRunCache(), font, q, alignment, text);
 		if (!(flags & DrawTextFlags::Clip))
 			q.max = {0,0};
 		return Draw(
@@ -0,0 +1,152 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "TextRunCache.h"
+#include "Font.h"
+#include <algorithm>
+#include <assert.h>
+
+namespace RenderOverlays
+{
+	template<typename CharType>
+		std::pair<float, unsigned> TextRunCache::StringWidthAndNewLineCountInternal(const Font& font, StringSection<CharType> text, float spaceExtra, bool outline)
+	{
+		auto startTime = std::chrono::steady_clock::now();
+
+		uint32_t spaceExtraBits;
+		std::memcpy(&spaceExtraBits, &spaceExtra, sizeof(spaceExtraBits));
+		auto seed = HashCombine(font.GetHash(), uint64_t(spaceExtraBits) | (uint64_t(outline) << 32ull) | (uint64_t(sizeof(CharType)) << 40ull));
+		auto key = Hash64(text.begin(), text.end(), seed);
+		auto* textBytes = (const uint8_t*)text.begin();
+		auto* textBytesEnd = (const uint8_t*)text.end();
+
+		++_metrics._measurements._lookups;
+		auto i = _measurements.find(key);
+		if (i != _measurements.end()
+			&& i->second._fontHash == font.GetHash() && i->second._spaceExtraBits == spaceExtraBits
+			&& i->second._outline == outline && i->second._charSize == sizeof(CharType)
+			&& std::equal(textBytes, textBytesEnd, i->second._text.begin(), i->second._text.end())) {
+			i->second._lastAccessFrame = _currentFrameIdx;
+			++_metrics._measurements._hits;
+			_metrics._measurements._hitTime += std::chrono::steady_clock::now() - startTime;
+			return i->second._result;
+		}
+
+		Measurement newMeasurement;
+		newMeasurement._result = RenderOverlays::StringWidthAndNewLineCount(font, text, spaceExtra, outline);
+		newMeasurement._lastAccessFrame = _currentFrameIdx;
+		newMeasurement._fontHash = font.GetHash();
+		newMeasurement._spaceExtraBits = spaceExtraBits;
+		newMeasurement._outline = outline;
+		newMeasurement._charSize = sizeof(CharType);
+		newMeasurement._text = std::vector<uint8_t>(textBytes, textBytesEnd);
+		auto result = newMeasurement._result;
+		_measurements.insert_or_assign(key, std::move(newMeasurement));		// replaces the existing entry on a hash collision
+		_metrics._measurements._missTime += std::chrono::steady_clock::now() - startTime;
+		return result;
+	}
+
+	std::pair<float, unsigned> TextRunCache::StringWidthAndNewLineCount(const Font& font, StringSection<> text, float spaceExtra, bool outline)
+	{
+		return StringWidthAndNewLineCountInternal(font, text, spaceExtra, outline);
+	}
+
+	std::pair<float, unsigned> TextRunCache::StringWidthAndNewLineCount(const Font& font, StringSection<ucs4> text, float spaceExtra, bool outline)
+	{
+		return StringWidthAndNewLineCountInternal(font, text, spaceExtra, outline);
+	}
+
+	auto TextRunCache::FindRun(const RunKey& key) -> Run*
+	{
+		auto i = _runs.find(key._hash);
+		if (i == _runs.end()) return nullptr;
+		auto& run = i->second;
+		auto* textBytes = (const uint8_t*)key._text.begin();
+		if (run._fontHash != key._fontHash || run._flags != key._flags
+			|| run._scaleBits != key._scaleBits || run._relativeMaxYBits != key._relativeMaxYBits || run._charSize != key._charSize
+			|| !std::equal(textBytes, textBytes+key._text.size(), run._text.begin(), run._text.end()))
+			return nullptr;		// hash collision
+		run._lastAccessFrame = _currentFrameIdx;
+		return &run;
+	}
+
+	auto TextRunCache::InsertRun(const RunKey& key, Run&& run) -> Run&
+	{
+		run._lastAccessFrame = _currentFrameIdx;
+		run._fontHash = key._fontHash;
+		run._flags = key._flags;
+		run._scaleBits = key._scaleBits;
+		run._relativeMaxYBits = key._relativeMaxYBits;
+		run._charSize = key._charSize;
+		auto* textBytes = (const uint8_t*)key._text.begin();
+		run._text = std::vector<uint8_t>(textBytes, textBytes+key._text.size());
+		auto i = _runs.insert_or_assign(key._hash, std::move(run)).first;		// replaces the existing entry on a hash collision
+		return i->second;
+	}
+
+	void TextRunCache::RecordRunLookup(bool hit, std::chrono::nanoseconds duration)
+	{
+		++_metrics._runs._lookups;
+		if (hit) {
+			++_metrics._runs._hits;
+			_metrics._runs._hitTime += duration;
+		} else {
+			_metrics._runs._missTime += duration;
+		}
+	}
+
+	void TextRunCache::OnFrameBarrier()
+	{
+		++_currentFrameIdx;
+
+		// Sweep for stale entries only periodically, since this must visit everything in the cache
+		const unsigned sweepInterval = 16;
+		if ((_currentFrameIdx % sweepInterval) != 0 || _currentFrameIdx < _framesBeforeEviction) return;
+		auto oldestToKeep = _currentFrameIdx - _framesBeforeEviction;
+		for (auto i=_measurements.begin(); i!=_measurements.end();)
+			if (i->second._lastAccessFrame < oldestToKeep) {
+				i = _measurements.erase(i);
+			} else
+				++i;
+		for (auto i=_runs.begin(); i!=_runs.end();)
+			if (i->second._lastAccessFrame < oldestToKeep) {
+				i = _runs.erase(i);
+			} else
+				++i;
+	}
+
+	auto TextRunCache::GetMetrics() const -> Metrics
+	{
+		auto result = _metrics;
+		result._cachedMeasurements = _measurements.size();
+		result._cachedRuns = _runs.size();
+		return result;
+	}
+
+	void TextRunCache::ResetMetrics()
+	{
+		_metrics = {};
+	}
+
+	float TextRunCache::Counters::GetHitRate() const
+	{
+		return _lookups ? float(_hits) / float(_lookups) : 0.f;
+	}
+
+	std::chrono::nanoseconds TextRunCache::Counters::GetEstimatedTimeSaved() const
+	{
+		auto misses = _lookups - _hits;
+		if (!misses || !_hits) return std::chrono::nanoseconds{0};
+		auto averageMissCost = _missTime / int64_t(misses);
+		return std::max(averageMissCost * int64_t(_hits) - _hitTime, std::chrono::nanoseconds{0});
+	}
+
+	TextRunCache::TextRunCache(unsigned framesBeforeEviction)
+	: _framesBeforeEviction(framesBeforeEviction)
+	{
+		assert(_framesBeforeEviction != 0);
+	}
+
+	TextRunCache::~TextRunCache() {}
+}
@@ -0,0 +1,141 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "FontRendering.h"
+#include "../Utility/MemoryUtils.h"
+#include "../Utility/StringUtils.h"
+#include <unordered_map>
+#include <vector>
+#include <chrono>
+#include <cstring>
+
+namespace RenderOverlays
+{
+	/// <summary>Caches measurements and laid out glyph runs for overlay text</summary>
+	/// Most debugging & HUD text is identical from frame to frame. Measuring or drawing it normally means walking
+	/// the string, calling Font::GetKerning() for every character pair and looking up every glyph in the
+	/// FontRenderingManager. This cache stores the results of that work, keyed on the font, the text and the
+	/// parameters that affect layout. Entries are found by hash, but keep a copy of the full key so a hit can be
+	/// confirmed; a hash collision is just treated as a miss.
+	///
+	/// Laid out runs hold pointers to FontRenderingManager::Bitmap objects; these are revalidated against
+	/// FontRenderingManager::_getBitmapsInvalidationIdx before use, so cached runs stay correct when glyphs are
+	/// evicted or moved by a defrag.
+	///
+	/// Entries that aren't used for a number of frames are released in OnFrameBarrier(). Like the
+	/// FontRenderingManager itself, this is not thread safe.
+	class TextRunCache
+	{
+	public:
+		std::pair<float, unsigned> StringWidthAndNewLineCount(const Font& font, StringSection<> text, float spaceExtra=0.f, bool outline=false);
+		std::pair<float, unsigned> StringWidthAndNewLineCount(const Font& font, StringSection<ucs4> text, float spaceExtra=0.f, bool outline=false);
+		float StringWidth(const Font& font, StringSection<> text, float spaceExtra=0.f, bool outline=false) { return StringWidthAndNewLineCount(font, text, spaceExtra, outline).first; }
+		float StringWidth(const Font& font, StringSection<ucs4> text, float spaceExtra=0.f, bool outline=false) { return StringWidthAndNewLineCount(font, text, spaceExtra, outline).first; }
+
+		struct Counters
+		{
+			uint64_t _lookups = 0, _hits = 0;
+			std::chrono::nanoseconds _missTime { 0 }, _hitTime { 0 };
+
+			float GetHitRate() const;
+			/// Estimate of time saved by hits, based on the average cost of a miss
+			std::chrono::nanoseconds GetEstimatedTimeSaved() const;
+		};
+		struct Metrics
+		{
+			Counters _measurements, _runs;
+			size_t _cachedMeasurements = 0, _cachedRuns = 0;
+		};
+		Metrics GetMetrics() const;
+		void ResetMetrics();
+
+		void OnFrameBarrier();
+
+		///////////////////////////////////////////////////////////////////////////////////
+
+		struct GlyphInstance
+		{
+			Float2 _xy;						// relative to the origin of the run
+			ColorB _colorOverride;			// zero alpha for no override
+			unsigned _glyphIdx;				// index into _glyphs & _bitmaps
+		};
+		struct Run
+		{
+			std::vector<GlyphInstance> _instances;		// sorted by glyph
+			std::vector<ucs4> _glyphs;					// unique & sorted
+			std::vector<const FontRenderingManager::Bitmap*> _bitmaps;
+			unsigned _bitmapsInvalidationIdx = ~0u;
+			Float2 _endIterator { 0.f, 0.f };			// where drawing finished, relative to the origin of the run
+			unsigned _lastAccessFrame = 0;
+
+			// copy of the key, to confirm hits
+			uint64_t _fontHash = 0;
+			DrawTextFlags::BitField _flags = 0;
+			uint32_t _scaleBits = 0, _relativeMaxYBits = 0;
+			unsigned _charSize = 0;
+			std::vector<uint8_t> _text;
+		};
+
+		struct RunKey
+		{
+			uint64_t _hash = 0;
+			uint64_t _fontHash = 0;
+			DrawTextFlags::BitField _flags = 0;
+			uint32_t _scaleBits = 0, _relativeMaxYBits = 0;
+			unsigned _charSize = 0;
+			IteratorRange<const void*> _text;			// not retained; InsertRun() copies it into the Run
+		};
+
+		template<typename CharType>
+			static RunKey MakeRunKey(const Font& font, DrawTextFlags::BitField flags, StringSection<CharType> text, float scale, float relativeMaxY);
+		Run* FindRun(const RunKey& key);
+		Run& InsertRun(const RunKey& key, Run&& run);
+		void RecordRunLookup(bool hit, std::chrono::nanoseconds duration);
+
+		TextRunCache(unsigned framesBeforeEviction = 64);
+		~TextRunCache();
+		TextRunCache(const TextRunCache&) = delete;
+		TextRunCache& operator=(const TextRunCache&) = delete;
+
+	private:
+		struct Measurement
+		{
+			std::pair<float, unsigned> _result;
+			unsigned _lastAccessFrame = 0;
+
+			// copy of the key, to confirm hits
+			uint64_t _fontHash = 0;
+			uint32_t _spaceExtraBits = 0;
+			bool _outline = false;
+			unsigned _charSize = 0;
+			std::vector<uint8_t> _text;
+		};
+		std::unordered_map<uint64_t, Measurement> _measurements;
+		std::unordered_map<uint64_t, Run> _runs;
+		Metrics _metrics;
+		unsigned _currentFrameIdx = 0;
+		unsigned _framesBeforeEviction;
+
+		template<typename CharType>
+			std::pair<float, unsigned> StringWidthAndNewLineCountInternal(const Font& font, StringSection<CharType> text, float spaceExtra, bool outline);
+	};
+
+	template<typename CharType>
+		auto TextRunCache::MakeRunKey(const Font& font, DrawTextFlags::BitField flags, StringSection<CharType> text, float scale, float relativeMaxY) -> RunKey
+	{
+		RunKey result;
+		result._fontHash = font.GetHash();
+		result._flags = flags;
+		std::memcpy(&result._scaleBits, &scale, sizeof(result._scaleBits));
+		std::memcpy(&result._relativeMaxYBits, &relativeMaxY, sizeof(result._relativeMaxYBits));
+		result._charSize = sizeof(CharType);
+		result._text = { (const void*)text.begin(), (const void*)text.end() };
+		auto seed = HashCombine(result._fontHash, (uint64_t(result._scaleBits) << 32ull) | uint64_t(result._relativeMaxYBits));
+		seed = HashCombine(seed, (uint64_t(flags) << 8ull) | sizeof(CharType));
+		result._hash = Hash64(text.begin(), text.end(), seed);
+		return result;
+	}
+}
@@ -37,6 +37,7 @@
 #include "../Math/Transformations.h"
 #include "../Math/ProjectionMath.h"
 #include "../Math/Geometry.h"
+#include "../Math/RayIntersection.h"
 #include "../Math/MathSerialization.h"
 #include "../Utility/PtrUtils.h"
 #include "../Utility/MemoryUtils.h"
@@ -2119,16 +2120,20 @@ namespace SceneEngine
         auto objectReferences = p->GetObjectReferences();
         auto cellSpaceBoundaries = p->GetCellSpaceBoundaries();
 
+            //  We're only doing a very rough cell space bounding box vs ray test here (with all of the
+            //  boxes in the cell tested at once). Objects that pass are tested again with their local
+            //  space bounding box below
+        std::vector<float> boundaryIntersections;
+        if (!cellSpaceBoundaries.empty()) {
+            assert(cellSpaceBoundaries.size() == objectReferences.size());
+            boundaryIntersections.resize(cellSpaceBoundaries.size());
+            RayVsAABBs(MakeIteratorRange(boundaryIntersections), cellSpaceRay, cellSpaceBoundaries);
+        }
+
         for (unsigned c=0; c<objectReferences.size(); ++c) {
             auto& obj = objectReferences[c];
-            if (!cellSpaceBoundaries.empty()) {
-                auto& cellSpaceBoundary = cellSpaceBoundaries[c];
-                    //  We're only doing a very rough world space bounding box vs ray test here...
-                    //  Ideally, we should follow up with a more accurate test using the object local
-                    //  space bounding box
-                if (!RayVsAABB(cellSpaceRay, cellSpaceBoundary.first, cellSpaceBoundary.second))
-                    continue;
-            }
+            if (!boundaryIntersections.empty() && boundaryIntersections[c] == RayIntersection_Miss)
+                continue;
 
             PlacementsScaffold::BoundingBox localBoundingBox;
             auto assetState = TryGetBoundingBox(localBoundingBox, _placementsCache->GetRigidModelScene(), *p, c);
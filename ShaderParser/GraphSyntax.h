@@ -10,6 +10,7 @@
 #include "../Utility/StringUtils.h"
 #include <string>
 #include <unordered_map>
+#include <chrono>
 
 namespace Assets { class DirectorySearchRules; }
 namespace GraphLanguage
@@ -34,10 +35,25 @@ namespace GraphLanguage
 	std::shared_ptr<INodeGraphProvider> MakeGraphSyntaxProvider(
 		const std::shared_ptr<GraphSyntaxFile>& parsedGraphFile,
 		const ::Assets::DirectorySearchRules& searchRules,
-		const ::Assets::DependencyValidation& dependencyValidation);
+		const ::Assets::DependencyValidation& dependencyValidation,
+		uint64_t graphFileHash = 0);
 
+	/// <summary>Load a graph from a graph syntax file</summary>
+	/// Parsed files are cached (keyed on the content hash of the file) along with the provider used
+	/// to resolve references from within the file. So repeated loads of the same file skip parsing,
+	/// until the file's dependency validation is invalidated.
 	INodeGraphProvider::NodeGraph LoadGraphSyntaxFile(StringSection<> filename, StringSection<> entryPoint);
 
+	struct GraphSyntaxCacheMetrics
+	{
+		unsigned _lookups = 0, _hits = 0;
+		unsigned _invalidations = 0;
+		std::chrono::nanoseconds _parseTime { 0 };		///< total time spent parsing on cache misses
+	};
+	GraphSyntaxCacheMetrics GetGraphSyntaxCacheMetrics();
+	void ResetGraphSyntaxCacheMetrics();
+	void ClearGraphSyntaxCache();
+
 	std::string GenerateGraphSyntax(const NodeGraph& graph, const NodeGraphSignature& interf, StringSection<> name);
 	std::string GenerateSignature(const NodeGraphSignature& sig, StringSection<char> name, bool useReturnType = true, bool includeTemplateParameters = false);
 }
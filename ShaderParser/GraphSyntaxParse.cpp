@@ -17,11 +17,15 @@
 #endif
 #include "../Assets/RawFileAsset.h"
 #include "../Assets/Assets.h"
+#include "../Assets/DepVal.h"
 #include "../Utility/FunctionUtils.h"
+#include "../Utility/ContentHash.h"
+#include "../Utility/Threading/Mutex.h"
 #include "../Utility/Streams/PathUtils.h"
 #include "../OSServices/Log.h"
 #include <unordered_map>
 #include <stack>
+#include <optional>
 
 #include <iostream>
 #include <sstream>
@@ -144,11 +148,13 @@ namespace GraphLanguage
         GraphNodeGraphProvider(
 			const std::shared_ptr<GraphSyntaxFile>& parsedGraphFile,
 			const ::Assets::DirectorySearchRules& searchRules,
-			const ::Assets::DependencyValidation& parsedGraphFileDepVal);
+			const ::Assets::DependencyValidation& parsedGraphFileDepVal,
+			uint64_t graphFileHash);
         ~GraphNodeGraphProvider();
     protected:
 		std::shared_ptr<GraphSyntaxFile> _parsedGraphFile;
 		::Assets::DependencyValidation _parsedGraphFileDepVal;
+		uint64_t _graphFileHash;
     };
 
 	auto GraphNodeGraphProvider::FindSignatures(StringSection<> name) -> std::vector<Signature>
@@ -175,26 +181,185 @@ namespace GraphLanguage
 		return result;
 	}
 
+	namespace Internal
+	{
+		class GraphSyntaxCache
+		{
+		public:
+			struct LoadedFile
+			{
+				std::shared_ptr<GraphSyntaxFile> _parsedFile;
+				std::shared_ptr<GraphNodeGraphProvider> _provider;
+				::Assets::DependencyValidation _depVal;
+				uint64_t _graphFileHash;
+			};
+
+			std::optional<LoadedFile> TryGetLoadedFile(uint64_t graphFileHash)
+			{
+				ScopedLock(_lock);
+				BindToDepValSysAlreadyLocked();
+				++_metrics._lookups;
+				auto i = LowerBound(_loadedFiles, graphFileHash);
+				if (i == _loadedFiles.end() || i->first != graphFileHash)
+					return {};
+				if (!IsValid(i->second)) {
+					++_metrics._invalidations;
+					_loadedFiles.erase(i);
+					return {};
+				}
+				++_metrics._hits;
+				return i->second;
+			}
+
+			std::shared_ptr<GraphSyntaxFile> TryGetParsedFile(uint64_t contentHash)
+			{
+				ScopedLock(_lock);
+				auto i = LowerBound(_parsedFiles, contentHash);
+				if (i != _parsedFiles.end() && i->first == contentHash)
+					return i->second.lock();
+				return nullptr;
+			}
+
+			LoadedFile AddLoadedFile(uint64_t contentHash, LoadedFile&& loadedFile)
+			{
+				ScopedLock(_lock);
+				BindToDepValSysAlreadyLocked();
+				auto p = LowerBound(_parsedFiles, contentHash);
+				if (p != _parsedFiles.end() && p->first == contentHash) {
+					p->second = loadedFile._parsedFile;
+				} else
+					_parsedFiles.insert(p, std::make_pair(contentHash, std::weak_ptr<GraphSyntaxFile>{loadedFile._parsedFile}));
+
+				auto i = LowerBound(_loadedFiles, loadedFile._graphFileHash);
+				if (i != _loadedFiles.end() && i->first == loadedFile._graphFileHash) {
+					// another thread might have loaded the same file at the same time; prefer the existing entry
+					// if it's still valid, so everyone ends up sharing the same provider
+					if (IsValid(i->second))
+						return i->second;
+					i->second = std::move(loadedFile);
+				} else {
+					i = _loadedFiles.insert(i, std::make_pair(loadedFile._graphFileHash, std::move(loadedFile)));
+				}
+
+				// drop invalidated files (which will never be looked up again, since their content hash
+				// will have changed) & parsed files that are no longer referenced by any loaded file
+				auto result = i->second;
+				auto preEraseSize = _loadedFiles.size();
+				_loadedFiles.erase(
+					std::remove_if(_loadedFiles.begin(), _loadedFiles.end(), [](const auto& q) { return !IsValid(q.second); }),
+					_loadedFiles.end());
+				_metrics._invalidations += unsigned(preEraseSize - _loadedFiles.size());
+				_parsedFiles.erase(
+					std::remove_if(_parsedFiles.begin(), _parsedFiles.end(), [](const auto& q) { return q.second.expired(); }),
+					_parsedFiles.end());
+				return result;
+			}
+
+			void RecordParseTime(std::chrono::nanoseconds duration)
+			{
+				ScopedLock(_lock);
+				_metrics._parseTime += duration;
+			}
+
+			GraphSyntaxCacheMetrics GetMetrics() { ScopedLock(_lock); return _metrics; }
+			void ResetMetrics() { ScopedLock(_lock); _metrics = {}; }
+			void Clear()
+			{
+				ScopedLock(_lock);
+				_loadedFiles.clear();
+				_parsedFiles.clear();
+			}
+
+			~GraphSyntaxCache()
+			{
+				if (_boundDepValSys)
+					_boundDepValSys->UnbindShutdownSignal(_shutdownSignal);
+			}
+
+		private:
+			Threading::Mutex _lock;
+			std::vector<std::pair<uint64_t, LoadedFile>> _loadedFiles;						// keyed on filename & content hash
+			std::vector<std::pair<uint64_t, std::weak_ptr<GraphSyntaxFile>>> _parsedFiles;		// keyed on content hash only
+			GraphSyntaxCacheMetrics _metrics;
+			::Assets::IDependencyValidationSystem* _boundDepValSys = nullptr;
+			::Assets::IDependencyValidationSystem::ShutdownSignalId _shutdownSignal = 0;
+
+			static bool IsValid(const LoadedFile& loadedFile)
+			{
+				// the provider caches the signature files it resolves, so those must be valid as well as the graph file itself
+				return loadedFile._depVal.GetValidationIndex() == 0 && !loadedFile._provider->HasInvalidatedSignatures();
+			}
+
+			void BindToDepValSysAlreadyLocked()
+			{
+				// Our entries hold DependencyValidations, which only mean something to the system that created them.
+				// So we must drop everything when that system is shut down (eg, between unit tests)
+				auto& depValSys = ::Assets::GetDepValSys();
+				if (&depValSys == _boundDepValSys) return;
+				_loadedFiles.clear();
+				_parsedFiles.clear();
+				_shutdownSignal = depValSys.BindShutdownSignal(
+					[this]() {
+						ScopedLock(_lock);
+						_loadedFiles.clear();
+						_parsedFiles.clear();
+						_boundDepValSys = nullptr;
+					});
+				_boundDepValSys = &depValSys;
+			}
+		};
+
+		static GraphSyntaxCache& GetGraphSyntaxCache()
+		{
+			static GraphSyntaxCache s_cache;
+			return s_cache;
+		}
+	}
+
 	INodeGraphProvider::NodeGraph LoadGraphSyntaxFile(StringSection<> filename, StringSection<> entryPoint)
 	{
 		auto& asset = ::Assets::Legacy::GetAsset<::Assets::RawFileAsset>(filename);
-		auto inputStr = MakeStringSection((const char*)asset.GetData().begin(), (const char*)asset.GetData().end());
 
-		auto graphSyntax = std::make_shared<GraphLanguage::GraphSyntaxFile>(ParseGraphSyntax(inputStr));
-		auto main = graphSyntax->_subGraphs.find(entryPoint.AsString());
-		if (main == graphSyntax->_subGraphs.end())
-			Throw(::Exceptions::BasicLabel("Couldn't find entry point (%s) in input file (%s)", entryPoint.AsString().c_str(), filename.AsString().c_str()));
+		// The same file content can resolve references differently depending on where it lives, so the loaded
+		// file (which includes the provider) is keyed on the filename as well as the content. But the parsed
+		// result depends only on the content
+		auto contentHash = ContentHash64(asset.GetData());
+		auto graphFileHash = Hash64(filename, contentHash);
+
+		auto& cache = Internal::GetGraphSyntaxCache();
+		auto loadedFile = cache.TryGetLoadedFile(graphFileHash);
+		if (!loadedFile) {
+			auto parsedFile = cache.TryGetParsedFile(contentHash);
+			if (!parsedFile) {
+				auto startTime = std::chrono::steady_clock::now();
+				auto inputStr = MakeStringSection((const char*)asset.GetData().begin(), (const char*)asset.GetData().end());
+				parsedFile = std::make_shared<GraphLanguage::GraphSyntaxFile>(ParseGraphSyntax(inputStr));
+				cache.RecordParseTime(std::chrono::steady_clock::now() - startTime);
+			}
+
+			auto sigProvider = std::make_shared<GraphNodeGraphProvider>(parsedFile, ::Assets::DefaultDirectorySearchRules(filename), asset.GetDependencyValidation(), graphFileHash);
+			loadedFile = cache.AddLoadedFile(
+				contentHash,
+				Internal::GraphSyntaxCache::LoadedFile { std::move(parsedFile), std::move(sigProvider), asset.GetDependencyValidation(), graphFileHash });
+		}
 
-		auto sigProvider = MakeGraphSyntaxProvider(graphSyntax, ::Assets::DefaultDirectorySearchRules(filename), asset.GetDependencyValidation());
+		auto main = loadedFile->_parsedFile->_subGraphs.find(entryPoint.AsString());
+		if (main == loadedFile->_parsedFile->_subGraphs.end())
+			Throw(::Exceptions::BasicLabel("Couldn't find entry point (%s) in input file (%s)", entryPoint.AsString().c_str(), filename.AsString().c_str()));
 
 		return INodeGraphProvider::NodeGraph {
 			main->first,
 			main->second._graph,
 			main->second._signature,
-			std::move(sigProvider),
-			asset.GetDependencyValidation() };
+			loadedFile->_provider,
+			loadedFile->_depVal,
+			Hash64(main->first, loadedFile->_graphFileHash) };
 	}
 
+	GraphSyntaxCacheMetrics GetGraphSyntaxCacheMetrics() { return Internal::GetGraphSyntaxCache().GetMetrics(); }
+	void ResetGraphSyntaxCacheMetrics() { Internal::GetGraphSyntaxCache().ResetMetrics(); }
+	void ClearGraphSyntaxCache() { Internal::GetGraphSyntaxCache().Clear(); }
+
 	auto GraphNodeGraphProvider::FindGraph(StringSection<> name) -> std::optional<NodeGraph>
 	{
 		// Interpret the given string to find a function signature that matches it
@@ -218,7 +383,7 @@ namespace GraphLanguage
 		// Look for the function within the parsed graph syntax file
 		auto i = _parsedGraphFile->_subGraphs.find(name.AsString());
 		if (i != _parsedGraphFile->_subGraphs.end())
-			return NodeGraph{ i->first, i->second._graph, i->second._signature, shared_from_this(), _parsedGraphFileDepVal };
+			return NodeGraph{ i->first, i->second._graph, i->second._signature, shared_from_this(), _parsedGraphFileDepVal, _graphFileHash ? Hash64(i->first, _graphFileHash) : 0 };
 
 		return BasicNodeGraphProvider::FindGraph(name);
 	}
@@ -243,10 +408,12 @@ namespace GraphLanguage
 	GraphNodeGraphProvider::GraphNodeGraphProvider(
 		const std::shared_ptr<GraphSyntaxFile>& parsedGraphFile,
 		const ::Assets::DirectorySearchRules& searchRules,
-		const ::Assets::DependencyValidation& parsedGraphFileDepVal)
+		const ::Assets::DependencyValidation& parsedGraphFileDepVal,
+		uint64_t graphFileHash)
 	: BasicNodeGraphProvider(searchRules)
 	, _parsedGraphFile(parsedGraphFile)
 	, _parsedGraphFileDepVal(parsedGraphFileDepVal)
+	, _graphFileHash(graphFileHash)
 	{
 	}
 
@@ -256,9 +423,10 @@ namespace GraphLanguage
 	std::shared_ptr<INodeGraphProvider> MakeGraphSyntaxProvider(
 		const std::shared_ptr<GraphSyntaxFile>& parsedGraphFile,
 		const ::Assets::DirectorySearchRules& searchRules,
-		const ::Assets::DependencyValidation& dependencyValidation)
+		const ::Assets::DependencyValidation& dependencyValidation,
+		uint64_t graphFileHash)
 	{
-		return std::make_shared<GraphNodeGraphProvider>(parsedGraphFile, searchRules, dependencyValidation);
+		return std::make_shared<GraphNodeGraphProvider>(parsedGraphFile, searchRules, dependencyValidation, graphFileHash);
 	}
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
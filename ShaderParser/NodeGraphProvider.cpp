@@ -11,6 +11,7 @@
 #include "../Assets/AssetUtils.h"
 #include "../Assets/ChunkFileContainer.h"
 #include "../Assets/IArtifact.h"
+#include "../Utility/Threading/Mutex.h"
 
 namespace GraphLanguage
 {
@@ -57,6 +58,7 @@ namespace GraphLanguage
 			std::string _fn;
 		};
         std::vector<std::pair<uint64_t, CachedItem>> _cache;
+		Threading::Mutex _cacheLock;		// providers can be shared between threads (see LoadGraphSyntaxFile)
 	};
 
     auto BasicNodeGraphProvider::FindSignatures(StringSection<> name) -> std::vector<Signature>
@@ -65,34 +67,54 @@ namespace GraphLanguage
 			return {};
 
         auto hash = Hash64(name.begin(), name.end());
-        auto existing = LowerBound(_pimpl->_cache, hash);
-        if (existing == _pimpl->_cache.end() || existing->first != hash || existing->second._signature->GetDependencyValidation().GetValidationIndex() > 0) {
+		Pimpl::CachedItem item;
+		{
+			ScopedLock(_pimpl->_cacheLock);
+			auto existing = LowerBound(_pimpl->_cache, hash);
+			if (existing != _pimpl->_cache.end() && existing->first == hash && existing->second._signature->GetDependencyValidation().GetValidationIndex() == 0)
+				item = existing->second;
+		}
+
+		if (!item._signature) {
 			char resolvedFile[MaxPath];
 			_pimpl->_searchRules.ResolveFile(resolvedFile, name);
 			if (!resolvedFile[0])
 				return {};
 
-			// note -- synchronized construction!
+			// note -- synchronized construction! (and done outside of the lock, since it can be slow)
 			auto fragment = ::Assets::ActualizeAssetPtr<ShaderSourceParser::SignatureAsset>(resolvedFile);
+			item = Pimpl::CachedItem{fragment, resolvedFile};
+
+			ScopedLock(_pimpl->_cacheLock);
+			auto existing = LowerBound(_pimpl->_cache, hash);
 			if (existing == _pimpl->_cache.end() || existing->first != hash)
-				existing = _pimpl->_cache.emplace(existing, hash, Pimpl::CachedItem{fragment, resolvedFile});
+				_pimpl->_cache.emplace(existing, hash, item);
 			else
-				existing->second = Pimpl::CachedItem{fragment, resolvedFile};
+				existing->second = item;
 		}
 
 		std::vector<Signature> result;
-		for (const auto&fn:existing->second._signature->GetSignature()._functions) {
+		for (const auto&fn:item._signature->GetSignature()._functions) {
 			INodeGraphProvider::Signature rSig;
 			rSig._name = fn.first;
 			rSig._signature = fn.second;
-			rSig._sourceFile = existing->second._fn;
-			rSig._isGraphSyntax = existing->second._signature->IsGraphSyntaxFile();
-			rSig._depVal = existing->second._signature->GetDependencyValidation();
+			rSig._sourceFile = item._fn;
+			rSig._isGraphSyntax = item._signature->IsGraphSyntaxFile();
+			rSig._depVal = item._signature->GetDependencyValidation();
 			result.push_back(rSig);
 		}
 		return result;
     }
 
+	bool BasicNodeGraphProvider::HasInvalidatedSignatures() const
+	{
+		ScopedLock(_pimpl->_cacheLock);
+		for (const auto& c:_pimpl->_cache)
+			if (c.second._signature->GetDependencyValidation().GetValidationIndex() > 0)
+				return true;
+		return false;
+	}
+
 	auto BasicNodeGraphProvider::FindGraph(StringSection<> name) -> std::optional<NodeGraph>
 	{
 		assert(0);		// note -- requires GraphSyntax parsing code, which we're trying to avoid
@@ -33,6 +33,7 @@ namespace GraphLanguage
 			NodeGraphSignature _signature;
 			std::shared_ptr<INodeGraphProvider> _subProvider;
 			::Assets::DependencyValidation _depVal;
+			uint64_t _contentHash = 0;		///< identifies the graph's source content & load context (or zero when unknown). Graphs with equal non-zero hashes generate identical functions
         };
         virtual std::optional<NodeGraph> FindGraph(StringSection<> name) = 0;
 
@@ -50,6 +51,9 @@ namespace GraphLanguage
 		std::optional<NodeGraph> FindGraph(StringSection<> name) override;
 		std::string TryFindAttachedFile(StringSection<> name) override;
 
+		/// Returns true if any of the signature files resolved by this provider have been invalidated since they were loaded
+		bool HasInvalidatedSignatures() const;
+
         BasicNodeGraphProvider(const ::Assets::DirectorySearchRules& searchRules);
         ~BasicNodeGraphProvider();
     protected:
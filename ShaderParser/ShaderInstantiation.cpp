@@ -7,13 +7,18 @@
 #include "DescriptorSetInstantiation.h"
 #include "NodeGraphSignature.h"
 #include "Assets/AssetUtils.h"
+#include "../Assets/DepVal.h"
 #include "../Utility/StringUtils.h"
 #include "../Utility/StringFormat.h"
+#include "../Utility/Streams/PreprocessorInterpreter.h"
+#include "../Utility/Threading/Mutex.h"
 #include "../xleres/FileList.h"
 #include <stack>
 #include <sstream>
 #include <regex>
 
+using namespace Utility::Literals;
+
 namespace ShaderSourceParser
 {
 	static std::string MakeGraphName(const std::string& baseName, uint64_t instantiationHash = 0)
@@ -180,6 +185,224 @@ namespace ShaderSourceParser
 		};
 	}
 
+	namespace Internal
+	{
+		struct GeneratedFunction
+		{
+			GenerateFunctionResult _function;
+			std::unordered_map<std::string, std::string> _selectorRelevance;
+			std::vector<::Assets::DependencyValidation> _validationDepVals;
+		};
+
+		class GeneratedFunctionCache
+		{
+		public:
+			std::shared_ptr<const GeneratedFunction> TryGet(uint64_t key)
+			{
+				ScopedLock(_lock);
+				BindToDepValSysAlreadyLocked();
+				++_metrics._lookups;
+				auto i = LowerBound(_entries, key);
+				if (i == _entries.end() || i->first != key)
+					return nullptr;
+				if (!IsValid(*i->second._function)) {
+					++_metrics._invalidations;
+					_entries.erase(i);
+					return nullptr;
+				}
+				++_metrics._hits;
+				i->second._lastUse = ++_useCounter;
+				return i->second._function;
+			}
+
+			void Add(uint64_t key, std::shared_ptr<const GeneratedFunction> fn)
+			{
+				ScopedLock(_lock);
+				BindToDepValSysAlreadyLocked();
+				auto i = LowerBound(_entries, key);
+				if (i != _entries.end() && i->first == key) {
+					i->second = CachedItem { std::move(fn), ++_useCounter };
+					return;
+				}
+				_entries.insert(i, std::make_pair(key, CachedItem { std::move(fn), ++_useCounter }));
+				if (_entries.size() > s_maxEntries)
+					Trim();
+			}
+
+			void RecordGeneration(bool cacheable, std::chrono::nanoseconds duration)
+			{
+				ScopedLock(_lock);
+				if (!cacheable) ++_metrics._uncacheable;
+				_metrics._generationTime += duration;
+			}
+
+			void RecordHit(std::chrono::nanoseconds duration)
+			{
+				ScopedLock(_lock);
+				_metrics._hitTime += duration;
+			}
+
+			InstantiationCacheMetrics GetMetrics() { ScopedLock(_lock); return _metrics; }
+			void ResetMetrics() { ScopedLock(_lock); _metrics = {}; }
+			void Clear() { ScopedLock(_lock); _entries.clear(); }
+
+			~GeneratedFunctionCache()
+			{
+				if (_boundDepValSys)
+					_boundDepValSys->UnbindShutdownSignal(_shutdownSignal);
+			}
+
+		private:
+			struct CachedItem
+			{
+				std::shared_ptr<const GeneratedFunction> _function;
+				unsigned _lastUse;
+			};
+			Threading::Mutex _lock;
+			std::vector<std::pair<uint64_t, CachedItem>> _entries;
+			unsigned _useCounter = 0;
+			InstantiationCacheMetrics _metrics;
+			::Assets::IDependencyValidationSystem* _boundDepValSys = nullptr;
+			::Assets::IDependencyValidationSystem::ShutdownSignalId _shutdownSignal = 0;
+
+			void BindToDepValSysAlreadyLocked()
+			{
+				// Entries hold DependencyValidations from the current dep val system, and can't outlive it
+				auto& depValSys = ::Assets::GetDepValSys();
+				if (&depValSys == _boundDepValSys) return;
+				_entries.clear();
+				_shutdownSignal = depValSys.BindShutdownSignal(
+					[this]() {
+						ScopedLock(_lock);
+						_entries.clear();
+						_boundDepValSys = nullptr;
+					});
+				_boundDepValSys = &depValSys;
+			}
+
+			static constexpr unsigned s_maxEntries = 4096;
+
+			static bool IsValid(const GeneratedFunction& fn)
+			{
+				for (const auto& d:fn._validationDepVals)
+					if (d.GetValidationIndex() > 0)
+						return false;
+				return true;
+			}
+
+			void Trim()
+			{
+				// drop anything that is invalidated, and then the least recently used quarter of what remains
+				auto originalSize = _entries.size();
+				_entries.erase(
+					std::remove_if(_entries.begin(), _entries.end(), [](const auto& e) { return !IsValid(*e.second._function); }),
+					_entries.end());
+				_metrics._invalidations += unsigned(originalSize - _entries.size());
+				if (_entries.size() > s_maxEntries*3/4) {
+					std::vector<unsigned> lastUses;
+					lastUses.reserve(_entries.size());
+					for (const auto& e:_entries) lastUses.push_back(e.second._lastUse);
+					auto cutoffIterator = lastUses.begin() + _entries.size()/4;
+					std::nth_element(lastUses.begin(), cutoffIterator, lastUses.end());
+					auto cutoff = *cutoffIterator;
+					auto preEvictionSize = _entries.size();
+					_entries.erase(
+						std::remove_if(_entries.begin(), _entries.end(), [cutoff](const auto& e) { return e.second._lastUse < cutoff; }),
+						_entries.end());
+					_metrics._evictions += unsigned(preEvictionSize - _entries.size());
+				}
+			}
+		};
+
+		static GeneratedFunctionCache& GetGeneratedFunctionCache()
+		{
+			static GeneratedFunctionCache s_cache;
+			return s_cache;
+		}
+
+		static bool HasCustomProvider(const InstantiationRequest& request)
+		{
+			if (request._customProvider) return true;
+			for (const auto& b:request._parameterBindings)
+				if (HasCustomProvider(*b.second))
+					return true;
+			return false;
+		}
+
+		static uint64_t CalculateGeneratedFunctionKey(
+			const GraphLanguage::INodeGraphProvider::NodeGraph& graph,
+			StringSection<> name,
+			const InstantiationRequest& instantiationParameters,
+			const GenerateFunctionOptions& generateOptions)
+		{
+			auto result = Hash64(name, graph._contentHash);
+			result = HashCombine(instantiationParameters.CalculateInstanceHash(), result);
+			result = HashCombine((uint64_t(generateOptions._generateDanglingInputs) << 32ull) | uint64_t(generateOptions._generateDanglingOutputs), result);
+			if (generateOptions._filterWithSelectors) {
+				// Selectors only influence the generated function by way of the connections they filter out. So
+				// rather than hashing the selectors themselves, we hash which conditional connections pass. That
+				// way selector sets that result in the same filtered graph share the same cache entry
+				const ParameterBox* selectorsAsArray[] = { &generateOptions._selectors };
+				uint64_t passMask = 0;
+				unsigned conditionCount = 0;
+				result = HashCombine("filter-with-selectors"_h, result);
+				for (const auto&c:graph._graph.GetConnections()) {
+					if (c._condition.empty()) continue;
+					if (EvaluatePreprocessorExpression(c._condition, MakeIteratorRange(selectorsAsArray)))
+						passMask |= 1ull << uint64_t(conditionCount&63);
+					if ((++conditionCount & 63) == 0) {
+						result = HashCombine(passMask, result);
+						passMask = 0;
+					}
+				}
+				result = HashCombine(passMask, result);
+			}
+			return result;
+		}
+
+		static std::shared_ptr<const GeneratedFunction> GenerateFunctionCached(
+			const GraphLanguage::INodeGraphProvider::NodeGraph& graph,
+			StringSection<> name,
+			const InstantiationRequest& instantiationParameters,
+			const GenerateFunctionOptions& generateOptions)
+		{
+			auto& cache = GetGeneratedFunctionCache();
+			auto startTime = std::chrono::steady_clock::now();
+
+			bool cacheable = graph._contentHash != 0 && !HasCustomProvider(instantiationParameters);
+			uint64_t key = 0;
+			if (cacheable) {
+				key = CalculateGeneratedFunctionKey(graph, name, instantiationParameters, generateOptions);
+				if (auto existing = cache.TryGet(key)) {
+					cache.RecordHit(std::chrono::steady_clock::now() - startTime);
+					return existing;
+				}
+			}
+
+			auto result = std::make_shared<GeneratedFunction>();
+			result->_function = GenerateFunction(graph._graph, name, instantiationParameters, generateOptions, *graph._subProvider);
+			ExtractSelectorRelevance(result->_selectorRelevance, graph._graph);
+
+			if (cacheable) {
+				result->_validationDepVals.reserve(result->_function._depVals.size()+1);
+				if (graph._depVal) result->_validationDepVals.push_back(graph._depVal);
+				for (const auto& d:result->_function._depVals)
+					if (d) result->_validationDepVals.push_back(d);
+				cache.Add(key, result);
+			}
+			cache.RecordGeneration(cacheable, std::chrono::steady_clock::now() - startTime);
+			return result;
+		}
+	}
+
+	InstantiationCacheMetrics GetInstantiationCacheMetrics() { return Internal::GetGeneratedFunctionCache().GetMetrics(); }
+	void ResetInstantiationCacheMetrics() { Internal::GetGeneratedFunctionCache().ResetMetrics(); }
+	void ClearInstantiationCaches()
+	{
+		Internal::GetGeneratedFunctionCache().Clear();
+		GraphLanguage::ClearGraphSyntaxCache();
+	}
+
 	static InstantiatedShader InstantiateShader(
 		Internal::PendingInstantiationsHelper& pendingInst,
 		const GenerateFunctionOptions& generateOptions)
@@ -198,9 +421,10 @@ namespace ShaderSourceParser
 			// to have the same name as the original request
 			auto scaffoldName = MakeGraphName(inst._graph._name, inst._instantiationParams.CalculateInstanceHash());
 			auto implementationName = inst._useScaffoldFunction ? (scaffoldName + "_impl") : scaffoldName;
-			auto instFn = GenerateFunction(
-				inst._graph._graph, implementationName,
-				inst._instantiationParams, generateOptions, *inst._graph._subProvider);
+			auto generatedFunction = Internal::GenerateFunctionCached(
+				inst._graph, implementationName,
+				inst._instantiationParams, generateOptions);
+			const auto& instFn = generatedFunction->_function;
 
 			if (inst._useScaffoldFunction) {
 				auto scaffoldSignature = inst._graph._signature;
@@ -264,9 +488,8 @@ namespace ShaderSourceParser
 				}
 			}
 
-			Internal::ExtractSelectorRelevance(
-				result._selectorRelevance,
-				inst._graph._graph);
+			for (const auto& r:generatedFunction->_selectorRelevance)
+				result._selectorRelevance[r.first] = r.second;
                 
 			// Queue up all of the dependencies that we got out of the GenerateFunction() call
 			pendingInst.QueueUp(MakeIteratorRange(instFn._dependencies._dependencies), *inst._graph._subProvider);
@@ -14,6 +14,7 @@
 #include <set>
 #include <unordered_map>
 #include <memory>
+#include <chrono>
 
 namespace RenderCore { namespace Assets { class PredefinedCBLayout; class PredefinedDescriptorSetLayout; } }
 namespace GraphLanguage { class INodeGraphProvider; class NodeGraph; }
@@ -155,6 +156,31 @@ namespace ShaderSourceParser
 		const GenerateFunctionOptions& generateOptions,
         GraphLanguage::INodeGraphProvider& sigProvider);
 
+        ///////////////////////////////////////////////////////////////
+
+	/// <summary>Statistics for the generated function cache used by InstantiateShader()</summary>
+	/// InstantiateShader() memoizes the functions it generates from node graphs. Results are keyed
+	/// on the graph's content hash, the function name, InstantiationRequest::CalculateInstanceHash()
+	/// and the outcome of the selector filtering, so instantiating the same graph with different
+	/// selectors reuses the generated function whenever the selectors don't change the graph.
+	/// Entries are dropped when any of their dependency validations are invalidated.
+	/// Graphs without a content hash (eg, from custom providers) are never cached.
+	struct InstantiationCacheMetrics
+	{
+		unsigned _lookups = 0, _hits = 0;
+		unsigned _uncacheable = 0;
+		unsigned _invalidations = 0, _evictions = 0;
+		std::chrono::nanoseconds _generationTime { 0 };		///< total time spent in GenerateFunction() for lookups that missed (or weren't cacheable)
+		std::chrono::nanoseconds _hitTime { 0 };
+
+		float GetHitRate() const { return _lookups ? _hits / float(_lookups) : 0.f; }
+	};
+	InstantiationCacheMetrics GetInstantiationCacheMetrics();
+	void ResetInstantiationCacheMetrics();
+
+	/// Clears both the generated function cache and the parsed graph syntax cache
+	void ClearInstantiationCaches();
+
 	namespace Internal
 	{
 		/// <summary>Build a selector relevance map from a node graph</summary>
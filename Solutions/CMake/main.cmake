@@ -211,6 +211,7 @@ endif()
 option(XLE_FILE_SYSTEM_MONITORING_ENABLE "Enable file system monitoring support" ON)
 option(XLE_ATTACHABLE_LIBRARIES_ENABLE "Enable support for attachable plugins and libraries" ON)
 option(XLE_COMPRESSONATOR_ENABLE "Enables texture compression during processing using Compressonator" ON)
+option(XLE_ISPCTEX_ENABLE "Enables the ISPC texture compression kernels for BC1/3/6H/7 (Windows only)" ON)
 
 if (MSVC)
     if ("${CMAKE_SIZEOF_VOID_P}" EQUAL "8")
@@ -35,6 +35,7 @@
 #include "../../ConsoleRig/ResourceBox.h"
 #include "../../Math/Transformations.h"
 #include "../../Math/Geometry.h"
+#include "../../Math/RayIntersection.h"
 #include "../../Math/MathSerialization.h"
 #include "../../Utility/StringUtils.h"
 #include "../../Utility/StringFormat.h"
@@ -590,19 +591,35 @@ namespace ToolsRig
     {
         using namespace SceneEngine;
 
-		// note -- we always return the first intersection encountered. We should be finding the intersection
-		//		closest to the start of the ray!
+		// note -- other than for the box shaped placeholders, we return the first intersection encountered.
+		//		We should be finding the intersection closest to the start of the ray!
 
-        for (const auto& a:_placeHolders->_cubeAnnotations) {
-            for (const auto& o: _placeHolders->_objects->FindEntitiesOfType(a._typeNameHash))
-                if (RayVsAABB(worldSpaceRay, AsFloat3x4(GetTransform(*o)), Float3(-1.f, -1.f, -1.f), Float3(1.f, 1.f, 1.f)))
-					return AsResult(worldSpaceRay.first, *o);
-        }
-
-		for (const auto& a : _placeHolders->_directionalAnnotations) {
-			for (const auto& o : _placeHolders->_objects->FindEntitiesOfType(a._typeNameHash))
-				if (RayVsAABB(worldSpaceRay, AsFloat3x4(GetTransform(*o)), Float3(-1.f, -1.f, -1.f), Float3(1.f, 1.f, 1.f)))
-					return AsResult(worldSpaceRay.first, *o);
+		{
+			// Cube & directional placeholders are all unit boxes in their local space. Transform the ray into
+			// the local space of each, and test them all together, so we can take the closest
+			std::vector<const RetainedEntity*> boxObjects;
+			std::vector<std::pair<Float3, Float3>> localSpaceRays;
+			auto addBoxObjects = [&](const auto& annotations) {
+				for (const auto& a:annotations)
+					for (const auto& o: _placeHolders->_objects->FindEntitiesOfType(a._typeNameHash)) {
+						auto localToWorld = AsFloat3x4(GetTransform(*o));
+						assert(IsOrthonormal(Truncate3x3(localToWorld)));
+						boxObjects.push_back(o);
+						localSpaceRays.emplace_back(
+							TransformPointByOrthonormalInverse(localToWorld, worldSpaceRay.first),
+							TransformPointByOrthonormalInverse(localToWorld, worldSpaceRay.second));
+					}
+			};
+			addBoxObjects(_placeHolders->_cubeAnnotations);
+			addBoxObjects(_placeHolders->_directionalAnnotations);
+
+			if (!boxObjects.empty()) {
+				std::vector<float> alphas(boxObjects.size());
+				RaysVsAABB(MakeIteratorRange(alphas), MakeIteratorRange(localSpaceRays), Float3(-1.f, -1.f, -1.f), Float3(1.f, 1.f, 1.f));
+				auto closest = std::min_element(alphas.begin(), alphas.end());
+				if (*closest != RayIntersection_Miss)
+					return AsResult(LinearInterpolate(worldSpaceRay.first, worldSpaceRay.second, *closest), *boxObjects[closest-alphas.begin()]);
+			}
 		}
 
 		for (const auto& a : _placeHolders->_areaLightAnnotation) {
@@ -0,0 +1,359 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../UnitTestHelper.h"
+#include "../../Assets/ConcurrentAssetHeap.h"
+#include "../../Assets/AssetHeapNew.h"
+#include <stdexcept>
+#include <random>
+#include <future>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include "catch2/catch_test_macros.hpp"
+
+using namespace Catch::literals;
+using namespace std::chrono_literals;
+namespace UnitTests
+{
+	struct HeapTestAsset { uint64_t _value = 0; };
+	struct HeapTestAsset2 { unsigned _value = 0; };
+
+	TEST_CASE( "ConcurrentAssetHeap-Basic", "[assets]" )
+	{
+		AssetsNew::ConcurrentAssetHeap heap;
+
+		SECTION("Insert completed and pending")
+		{
+			heap.Insert<HeapTestAsset>(1, "one", HeapTestAsset{1});
+			auto one = heap.Lookup<HeapTestAsset>(1);
+			REQUIRE(one);
+			REQUIRE(one.GetState() == ::Assets::AssetState::Ready);
+			REQUIRE(one.Actualize()._value == 1);
+			REQUIRE(one.GetInitializer() == "one");
+			REQUIRE(!heap.Lookup<HeapTestAsset>(2));
+			REQUIRE(!heap.Lookup<HeapTestAsset2>(1));		// tables are separate for each type
+
+			std::promise<HeapTestAsset> promise;
+			heap.Insert<HeapTestAsset>(2, "two", promise.get_future());
+			REQUIRE(heap.Lookup<HeapTestAsset>(2).GetState() == ::Assets::AssetState::Pending);
+			REQUIRE(heap.Lookup<HeapTestAsset>(2).TryActualize() == nullptr);
+			REQUIRE_THROWS(heap.Lookup<HeapTestAsset>(2).Actualize());
+
+			// completion is only visible after a visibility barrier
+			promise.set_value(HeapTestAsset{2});
+			REQUIRE(heap.Lookup<HeapTestAsset>(2).GetState() == ::Assets::AssetState::Pending);
+			auto barrier = heap.VisibilityBarrier();
+			auto two = heap.Lookup<HeapTestAsset>(2);
+			REQUIRE(two.GetState() == ::Assets::AssetState::Ready);
+			REQUIRE(two.GetVisibilityMarker() == barrier);
+			REQUIRE(two->_value == 2);
+			REQUIRE(heap.GetCount<HeapTestAsset>() == 2);
+
+			// exceptions become invalid assets
+			std::promise<HeapTestAsset> failingPromise;
+			heap.Insert<HeapTestAsset>(3, "three", failingPromise.get_future());
+			failingPromise.set_exception(std::make_exception_ptr(std::runtime_error("Failed construction")));
+			heap.VisibilityBarrier();
+			auto three = heap.Lookup<HeapTestAsset>(3);
+			REQUIRE(three.GetState() == ::Assets::AssetState::Invalid);
+			REQUIRE_THROWS(three.TryActualize());
+			REQUIRE(::Assets::AsString(three.GetActualizationLog()) == "Failed construction");
+		}
+
+		SECTION("References are snapshots")
+		{
+			heap.Insert<HeapTestAsset>(1, "first", HeapTestAsset{1});
+			auto first = heap.Lookup<HeapTestAsset>(1);
+			heap.Insert<HeapTestAsset>(1, "second", HeapTestAsset{2});
+			auto second = heap.Lookup<HeapTestAsset>(1);
+			REQUIRE(first->_value == 1);
+			REQUIRE(second->_value == 2);
+
+			REQUIRE(heap.Erase<HeapTestAsset>(1));
+			REQUIRE(!heap.Erase<HeapTestAsset>(1));
+			REQUIRE(!heap.Lookup<HeapTestAsset>(1));
+			heap.VisibilityBarrier();
+			heap.VisibilityBarrier();
+			REQUIRE(first->_value == 1);		// erased entries stay alive while referenced
+			REQUIRE(second->_value == 2);
+			auto copy = second;
+			second = {};
+			heap.VisibilityBarrier();
+			REQUIRE(copy->_value == 2);
+
+			first = {};
+			copy = {};
+			heap.GetReclaimer().Reclaim();
+			heap.GetReclaimer().Reclaim();
+			heap.GetReclaimer().Reclaim();
+			REQUIRE(heap.GetReclaimer().GetRetiredCount() == 0);
+		}
+
+		SECTION("CompareAndInsert")
+		{
+			std::promise<HeapTestAsset> p0, p1, p2, p3;
+			REQUIRE(heap.CompareAndInsert<HeapTestAsset>(5, {}, "five", p0.get_future()));
+			REQUIRE(!heap.CompareAndInsert<HeapTestAsset>(5, {}, "five", p1.get_future()));		// already exists
+			auto existing = heap.Lookup<HeapTestAsset>(5);
+			heap.Insert<HeapTestAsset>(5, "five", HeapTestAsset{5});
+			REQUIRE(!heap.CompareAndInsert<HeapTestAsset>(5, existing, "five", p3.get_future()));	// replaced in the meantime
+			existing = heap.Lookup<HeapTestAsset>(5);
+			REQUIRE(heap.CompareAndInsert<HeapTestAsset>(5, existing, "five", p2.get_future()));
+			REQUIRE(heap.Lookup<HeapTestAsset>(5).GetState() == ::Assets::AssetState::Pending);
+
+			// completing the future for a replaced entry does nothing
+			p0.set_value(HeapTestAsset{50});
+			heap.VisibilityBarrier();
+			REQUIRE(heap.Lookup<HeapTestAsset>(5).GetState() == ::Assets::AssetState::Pending);
+			p2.set_value(HeapTestAsset{52});
+			heap.VisibilityBarrier();
+			REQUIRE(heap.Lookup<HeapTestAsset>(5)->_value == 52);
+		}
+
+		SECTION("StallWhilePending")
+		{
+			std::promise<HeapTestAsset> promise;
+			heap.Insert<HeapTestAsset>(7, "seven", promise.get_future());
+			auto pending = heap.Lookup<HeapTestAsset>(7);
+			REQUIRE(pending.StallWhilePendingFor(1ms).GetState() == ::Assets::AssetState::Pending);
+
+			std::thread completer([&promise]() { std::this_thread::sleep_for(10ms); promise.set_value(HeapTestAsset{7}); });
+			auto completed = pending.StallWhilePending();
+			completer.join();
+			REQUIRE(pending.GetState() == ::Assets::AssetState::Pending);		// original reference doesn't change
+			REQUIRE(completed.GetState() == ::Assets::AssetState::Ready);
+			REQUIRE(completed->_value == 7);
+			REQUIRE(heap.Lookup<HeapTestAsset>(7).GetState() == ::Assets::AssetState::Ready);		// visible without a barrier
+
+			// the barrier still processes the future, but shouldn't change the entry
+			heap.VisibilityBarrier();
+			REQUIRE(heap.Lookup<HeapTestAsset>(7).GetVisibilityMarker() == completed.GetVisibilityMarker());
+		}
+
+		SECTION("ForEach")
+		{
+			for (unsigned c=0; c<1000; ++c)
+				heap.Insert<HeapTestAsset>(c, std::to_string(c), HeapTestAsset{c*3});
+			for (unsigned c=0; c<1000; c+=2)
+				heap.Erase<HeapTestAsset>(c);
+			unsigned visited = 0;
+			uint64_t sum = 0;
+			heap.ForEach<HeapTestAsset>(
+				[&](const auto& ref) {
+					REQUIRE(ref.Id() & 1);
+					REQUIRE(ref->_value == ref.Id()*3);
+					++visited;
+					sum += ref.Id();
+				});
+			REQUIRE(visited == 500);
+			REQUIRE(sum == 250000);
+			REQUIRE(heap.GetCount<HeapTestAsset>() == 500);
+		}
+
+		SECTION("Many long lived references")
+		{
+			// References are reference counted handles, and don't hold onto any of the reclaimer's (limited
+			// number of) reader slots. So we can hold as many as we like, and they don't delay reclamation
+			// of entries they don't refer to
+			for (unsigned c=0; c<64; ++c)
+				heap.Insert<HeapTestAsset>(c, std::to_string(c), HeapTestAsset{c*3});
+			std::vector<AssetsNew::ConcurrentAssetHeap::Reference<HeapTestAsset>> refs;
+			for (unsigned c=0; c<2048; ++c) {
+				refs.push_back(heap.Lookup<HeapTestAsset>(c%64));
+				REQUIRE(refs.back());
+			}
+			std::thread otherThread([&heap]() {
+				auto ref = heap.Lookup<HeapTestAsset>(5);
+				REQUIRE(ref->_value == 15);
+			});
+			otherThread.join();
+
+			for (unsigned c=0; c<64; ++c)
+				heap.Insert<HeapTestAsset>(c, std::to_string(c), HeapTestAsset{c*3+1});
+			heap.GetReclaimer().Reclaim();
+			heap.GetReclaimer().Reclaim();
+			heap.GetReclaimer().Reclaim();
+			REQUIRE(heap.GetReclaimer().GetRetiredCount() == 0);
+			for (unsigned c=0; c<refs.size(); ++c)
+				REQUIRE(refs[c]->_value == (c%64)*3);		// replaced entries stay alive while referenced
+			REQUIRE(heap.Lookup<HeapTestAsset>(5)->_value == 16);
+		}
+	}
+
+	TEST_CASE( "ConcurrentAssetHeap-ThrashTest", "[assets]" )
+	{
+		// Readers continuously look up entries while writers insert, replace and erase them. Every value
+		// we see must be consistent with the id it was found under (value == id*3), even if the entry is
+		// being replaced or erased by another thread at the same time
+		AssetsNew::ConcurrentAssetHeap heap;
+		const unsigned idRange = 4096;
+		const unsigned writerCount = 2, readerCount = 4;
+		std::atomic<bool> stop { false };
+		std::atomic<unsigned> badValues { 0 };
+		std::atomic<uint64_t> readyLookups { 0 };
+
+		std::vector<std::thread> threads;
+		for (unsigned w=0; w<writerCount; ++w)
+			threads.emplace_back(
+				[&, w]() {
+					std::mt19937_64 rng(0x6a3c2b1ull + w);
+					std::vector<std::promise<HeapTestAsset>> promises;
+					std::vector<uint64_t> promiseIds;
+					for (unsigned c=0; c<100000; ++c) {
+						auto id = rng() % idRange;
+						switch (rng() % 4) {
+						case 0: heap.Insert<HeapTestAsset>(id, std::to_string(id), HeapTestAsset{id*3}); break;
+						case 1: heap.Erase<HeapTestAsset>(id); break;
+						default:
+							promises.emplace_back();
+							promiseIds.push_back(id);
+							heap.Insert<HeapTestAsset>(id, std::to_string(id), promises.back().get_future());
+							break;
+						}
+						if (promises.size() > 64) {
+							for (size_t p=0; p<promises.size(); ++p)
+								promises[p].set_value(HeapTestAsset{promiseIds[p]*3});
+							promises.clear();
+							promiseIds.clear();
+						}
+					}
+					for (size_t p=0; p<promises.size(); ++p)
+						promises[p].set_value(HeapTestAsset{promiseIds[p]*3});
+				});
+
+		std::vector<std::thread> readers;
+		for (unsigned r=0; r<readerCount; ++r)
+			readers.emplace_back(
+				[&, r]() {
+					std::mt19937_64 rng(0x1f2e3d4ull + r);
+					while (!stop.load()) {
+						auto id = rng() % idRange;
+						if (auto ref = heap.Lookup<HeapTestAsset>(id)) {
+							if (ref.Id() != id) ++badValues;
+							if (auto* v = ref.TryActualize()) {
+								if (v->_value != id*3) ++badValues;
+								++readyLookups;
+							}
+						}
+					}
+				});
+
+		std::thread barrierThread(
+			[&]() {
+				while (!stop.load()) {
+					heap.VisibilityBarrier();
+					std::this_thread::sleep_for(100us);
+				}
+			});
+
+		for (auto& t:threads) t.join();
+		stop.store(true);
+		for (auto& t:readers) t.join();
+		barrierThread.join();
+
+		heap.VisibilityBarrier();
+		REQUIRE(badValues.load() == 0);
+		REQUIRE(readyLookups.load() != 0);
+
+		// everything should have completed by now
+		unsigned pendingCount = 0;
+		heap.ForEach<HeapTestAsset>(
+			[&](const auto& ref) {
+				pendingCount += ref.GetState() == ::Assets::AssetState::Pending;
+				REQUIRE(ref.Actualize()._value == ref.Id()*3);
+			});
+		REQUIRE(pendingCount == 0);
+
+		// with no readers, all retired entries can be reclaimed
+		heap.GetReclaimer().Reclaim();
+		heap.GetReclaimer().Reclaim();
+		heap.GetReclaimer().Reclaim();
+		REQUIRE(heap.GetReclaimer().GetRetiredCount() == 0);
+	}
+
+	template<typename Heap, typename LookupFn, typename InsertFn>
+		static std::pair<double, double> MeasureLookupInsertRates(Heap& heap, unsigned readerCount, bool withWriter, LookupFn&& lookupFn, InsertFn&& insertFn)
+	{
+		std::atomic<bool> stop { false };
+		std::atomic<uint64_t> lookupCount { 0 }, insertCount { 0 };
+		std::vector<std::thread> threads;
+		for (unsigned r=0; r<readerCount; ++r)
+			threads.emplace_back(
+				[&, r]() {
+					std::mt19937_64 rng(0x44a1ull + r);
+					uint64_t count = 0, sum = 0;
+					while (!stop.load(std::memory_order_relaxed)) {
+						for (unsigned c=0; c<256; ++c)
+							sum += lookupFn(heap, rng() % 65536);
+						count += 256;
+					}
+					lookupCount += count;
+					if (sum == 0) std::cout << "";		// prevent the lookups from being optimized out
+				});
+		if (withWriter)
+			threads.emplace_back(
+				[&]() {
+					std::mt19937_64 rng(0x9b7ull);
+					uint64_t count = 0;
+					while (!stop.load(std::memory_order_relaxed)) {
+						insertFn(heap, 65536 + rng() % 65536);
+						++count;
+					}
+					insertCount += count;
+				});
+
+		const auto duration = 250ms;
+		std::this_thread::sleep_for(duration);
+		stop.store(true);
+		for (auto& t:threads) t.join();
+
+		auto seconds = std::chrono::duration_cast<std::chrono::duration<double>>(duration).count();
+		return { lookupCount.load() / seconds, insertCount.load() / seconds };
+	}
+
+	TEST_CASE( "ConcurrentAssetHeap-Performance", "[assets]" )
+	{
+		const unsigned readerCount = std::max(2u, std::thread::hardware_concurrency()/2);
+
+		AssetsNew::ConcurrentAssetHeap concurrentHeap;
+		AssetsNew::AssetHeap lockingHeap;
+		for (uint64_t c=0; c<65536; ++c) {
+			concurrentHeap.Insert<HeapTestAsset>(c, std::to_string(c), HeapTestAsset{c});
+			lockingHeap.Insert<HeapTestAsset>(c, std::to_string(c), HeapTestAsset{c});
+		}
+
+		auto concurrentLookup = [](AssetsNew::ConcurrentAssetHeap& heap, uint64_t id) -> uint64_t {
+			auto ref = heap.Lookup<HeapTestAsset>(id);
+			return ref ? ref->_value : 0;
+		};
+		auto concurrentInsert = [](AssetsNew::ConcurrentAssetHeap& heap, uint64_t id) {
+			heap.Insert<HeapTestAsset>(id, {}, HeapTestAsset{id});
+		};
+		auto lockingLookup = [](AssetsNew::AssetHeap& heap, uint64_t id) -> uint64_t {
+			auto i = heap.Lookup<HeapTestAsset>(id);
+			return i ? i->_value : 0;
+		};
+		auto lockingInsert = [](AssetsNew::AssetHeap& heap, uint64_t id) {
+			heap.Insert<HeapTestAsset>(id, {}, HeapTestAsset{id});
+		};
+
+		for (bool withWriter:{false, true}) {
+			auto concurrent = MeasureLookupInsertRates(concurrentHeap, readerCount, withWriter, concurrentLookup, concurrentInsert);
+			auto locking = MeasureLookupInsertRates(lockingHeap, readerCount, withWriter, lockingLookup, lockingInsert);
+			concurrentHeap.VisibilityBarrier();
+			lockingHeap.VisibilityBarrier();
+
+			std::cout << "AssetHeap lookups with " << readerCount << " readers" << (withWriter ? " and 1 writer" : "") << std::endl;
+			std::cout << "\tConcurrentAssetHeap: " << concurrent.first / 1e6 << "M lookups/s";
+			if (withWriter) std::cout << ", " << concurrent.second / 1e3 << "K inserts/s";
+			std::cout << std::endl;
+			std::cout << "\tAssetHeap: " << locking.first / 1e6 << "M lookups/s";
+			if (withWriter) std::cout << ", " << locking.second / 1e3 << "K inserts/s";
+			std::cout << std::endl;
+		}
+	}
+}
@@ -3,8 +3,11 @@
 // http://www.opensource.org/licenses/mit-license.php)
 
 #include "../../Formatters/BinaryFormatter.h"
+#include "../../Formatters/BinaryDecodeProgram.h"
 #include <string>
 #include <sstream>
+#include <chrono>
+#include <iostream>
 #include "catch2/catch_test_macros.hpp"
 #include "catch2/catch_approx.hpp"
 
@@ -73,4 +76,303 @@ namespace UnitTests
 		REQUIRE(blockMatch["SomeValue"].As<int64_t>() == ((templ*)bigBuffer.data())->SomeValue);
 		REQUIRE(blockMatch["NestedTemplate2"]["InternalMember3"]["InternalMember1"].As<int64_t>() == 0);
     }
+
+	static void RecordFormatterValue(Formatters::BinaryInputFormatter& formatter, uint64_t name, std::vector<std::string>& events);
+
+	static void RecordFormatterBlock(Formatters::BinaryInputFormatter& formatter, std::vector<std::string>& events)
+	{
+		uint64_t name;
+		while (formatter.TryKeyedItem(name))
+			RecordFormatterValue(formatter, name, events);
+	}
+
+	static void RecordFormatterValue(Formatters::BinaryInputFormatter& formatter, uint64_t name, std::vector<std::string>& events)
+	{
+		unsigned evaluatedTypeId, count;
+		IteratorRange<const void*> data;
+		ImpliedTyping::TypeDesc typeDesc;
+		if (formatter.TryBeginBlock(evaluatedTypeId)) {
+			events.push_back("BeginBlock " + std::to_string(name) + " " + std::to_string(evaluatedTypeId));
+			RecordFormatterBlock(formatter, events);
+			Formatters::RequireEndBlock(formatter);
+			events.push_back("EndBlock");
+		} else if (formatter.TryRawValue(data, typeDesc, evaluatedTypeId)) {
+			events.push_back("Value " + std::to_string(name) + " " + std::to_string(evaluatedTypeId) + " " + ImpliedTyping::AsString(data, typeDesc));
+		} else if (formatter.TryBeginArray(count, evaluatedTypeId)) {
+			events.push_back("BeginArray " + std::to_string(name) + " " + std::to_string(count) + " " + std::to_string(evaluatedTypeId));
+			for (unsigned c=0; c<count; ++c)
+				RecordFormatterValue(formatter, 0, events);
+			Formatters::RequireEndArray(formatter);
+			events.push_back("EndArray");
+		} else
+			FAIL("Unexpected blob");
+	}
+
+	class RecordingDecodeVisitor : public Formatters::IBinaryDecodeVisitor
+	{
+	public:
+		std::vector<std::string> _events;
+		void OnValue(uint64_t name, const ImpliedTyping::VariantNonRetained& value, EvaluatedTypeToken evaluatedType) override
+		{
+			_events.push_back("Value " + std::to_string(name) + " " + std::to_string(evaluatedType) + " " + ImpliedTyping::AsString(value._data, value._type));
+		}
+		bool OnBeginBlock(uint64_t name, EvaluatedTypeToken evaluatedType) override
+		{
+			_events.push_back("BeginBlock " + std::to_string(name) + " " + std::to_string(evaluatedType));
+			return true;
+		}
+		void OnEndBlock() override { _events.push_back("EndBlock"); }
+		bool OnBeginArray(uint64_t name, unsigned count, EvaluatedTypeToken elementType) override
+		{
+			_events.push_back("BeginArray " + std::to_string(name) + " " + std::to_string(count) + " " + std::to_string(elementType));
+			return true;
+		}
+		void OnEndArray() override { _events.push_back("EndArray"); }
+	};
+
+	TEST_CASE( "BinarySchemata-CompiledDecoder", "[formatters]" )
+	{
+		const char* testBlock = R"(
+		alias Index = uint16;
+
+		block TemplatedType {
+			uint16 InternalMember0[4];
+			uint8 InternalMember1;
+		};
+
+		block template(typename T) TemplatedType2 {
+			float32 InternalMember2;
+			T InternalMember3;
+		};
+
+		block template(expr N) DynamicTemplate {
+			uint8 Values[N];
+		};
+
+		block TestBlock {
+			uint32 SomeValue;
+			float32 AnotherValue;
+			#if SomeValue == 3
+				uint16 thisShouldntBeHere;
+			#elif SomeValue > 4 && Version > 32
+				uint16 butThisShouldBeHere;
+			#endif
+			#if Version < 32
+				uint32 removedByGlobal;
+			#endif
+			TemplatedType SimpleBlock;
+			TemplatedType ArrayMember[5];
+			TemplatedType ComplexArrayMember[SomeValue & 0xf];
+			TemplatedType2(typename uint32) NestedTemplate;
+			TemplatedType2(typename TemplatedType) NestedTemplate2;
+			DynamicTemplate(expr SomeValue & 0x7) DynamicTemplateMember;
+			Index Indices[3];
+			char Name[4];
+			uint8 Count;
+			uint32 Tail[Count];
+		};
+		)";
+
+		auto decl = std::make_shared<Formatters::BinarySchemata>(testBlock, ::Assets::DirectorySearchRules{}, ::Assets::DependencyValidation{});
+
+		std::vector<uint8_t> buffer(4096, 0);
+		for (unsigned c=0; c<buffer.size(); ++c) buffer[c] = uint8_t(c*7);
+		*(uint32_t*)&buffer[0] = 5 + 0x30;
+		*(float*)&buffer[4] = 32.5f;
+		buffer[4+4+2+9+9*5+9*5+(4+4)+(4+9)+5+2*3+4] = 3;		// "Count", when Version is 48
+
+		auto context = std::make_shared<Formatters::EvaluationContext>();
+		context->SetGlobalParameter("Version", 48);
+
+		std::vector<std::string> formatterEvents;
+		{
+			Formatters::BinaryInputFormatter formatter(buffer, context);
+			formatter.PushPattern(decl, decl->FindBlockDefinition("TestBlock"));
+			RecordFormatterBlock(formatter, formatterEvents);
+		}
+
+		Formatters::BinaryDecoder decoder(context);
+		RecordingDecodeVisitor visitor;
+		auto remaining = decoder.Decode(buffer, decl, decl->FindBlockDefinition("TestBlock"), visitor);
+
+		REQUIRE(visitor._events == formatterEvents);
+		REQUIRE(remaining.end() == AsPointer(buffer.end()));
+
+		// The nested block types have no dynamic members, and so should compile to a single fixed run
+		auto& templatedTypeProgram = decoder.GetProgram(decoder.GetBlockType(decl, decl->FindBlockDefinition("TemplatedType")));
+		REQUIRE(templatedTypeProgram.IsFixedSize());
+		REQUIRE(templatedTypeProgram._fixedSize.value() == 9);
+
+		// changing global parameters should cause the decoder to recompile
+		context->SetGlobalParameter("Version", 16);
+		formatterEvents.clear();
+		{
+			Formatters::BinaryInputFormatter formatter(buffer, context);
+			formatter.PushPattern(decl, decl->FindBlockDefinition("TestBlock"));
+			RecordFormatterBlock(formatter, formatterEvents);
+		}
+		visitor._events.clear();
+		decoder.Decode(buffer, decl, decl->FindBlockDefinition("TestBlock"), visitor);
+		REQUIRE(visitor._events == formatterEvents);
+		REQUIRE(std::find_if(formatterEvents.begin(), formatterEvents.end(), [](const auto& e) { return e.find(std::to_string(Hash64("removedByGlobal"))) != std::string::npos; }) != formatterEvents.end());
+
+		// reading past the end of the data should throw, as it does for BinaryInputFormatter
+		REQUIRE_THROWS(decoder.Decode(MakeIteratorRange(buffer.data(), buffer.data()+32), decl, decl->FindBlockDefinition("TestBlock"), visitor));
+	}
+
+	TEST_CASE( "BinarySchemata-CompiledDecoderShadowing", "[formatters]" )
+	{
+		// "Count" is both a global parameter and a member of the enclosing block. BinaryInputFormatter
+		// searches enclosing blocks before globals, so the decoder must not fold in the global within "Inner"
+		const char* testBlock = R"(
+		block Inner {
+			uint8 Values[Count];
+			#if Count > 2
+				uint16 Extra;
+			#endif
+		};
+
+		block Outer {
+			uint8 Count;
+			Inner First;
+			Inner Array[2];
+		};
+		)";
+
+		auto decl = std::make_shared<Formatters::BinarySchemata>(testBlock, ::Assets::DirectorySearchRules{}, ::Assets::DependencyValidation{});
+
+		std::vector<uint8_t> buffer(64, 0);
+		for (unsigned c=0; c<buffer.size(); ++c) buffer[c] = uint8_t(c+1);
+		buffer[0] = 2;
+
+		auto context = std::make_shared<Formatters::EvaluationContext>();
+		context->SetGlobalParameter("Count", 7);
+
+		Formatters::BinaryDecoder decoder(context);
+		for (auto blockName:{"Outer", "Inner"}) {
+			std::vector<std::string> formatterEvents;
+			{
+				Formatters::BinaryInputFormatter formatter(buffer, context);
+				formatter.PushPattern(decl, decl->FindBlockDefinition(blockName));
+				RecordFormatterBlock(formatter, formatterEvents);
+			}
+
+			RecordingDecodeVisitor visitor;
+			decoder.Decode(buffer, decl, decl->FindBlockDefinition(blockName), visitor);
+			REQUIRE(visitor._events == formatterEvents);
+		}
+
+		// Decoded at the top level, nothing shadows the global
+		auto& innerProgram = decoder.GetProgram(decoder.GetBlockType(decl, decl->FindBlockDefinition("Inner")));
+		REQUIRE(innerProgram.IsFixedSize());
+		REQUIRE(innerProgram._fixedSize.value() == 7+2);
+	}
+
+	namespace Internal
+	{
+		class ChecksumDecodeVisitor : public Formatters::IBinaryDecodeVisitor
+		{
+		public:
+			uint64_t _checksum = 0;
+			void OnValue(uint64_t name, const ImpliedTyping::VariantNonRetained& value, EvaluatedTypeToken) override
+			{
+				_checksum += name ^ *(const uint8_t*)value._data.begin();
+			}
+			bool OnBeginBlock(uint64_t, EvaluatedTypeToken) override { return true; }
+			void OnEndBlock() override {}
+			bool OnBeginArray(uint64_t, unsigned, EvaluatedTypeToken) override { return true; }
+			void OnEndArray() override {}
+		};
+
+		static void ChecksumFormatterBlock(Formatters::BinaryInputFormatter& formatter, uint64_t& checksum);
+		static void ChecksumFormatterValue(Formatters::BinaryInputFormatter& formatter, uint64_t name, uint64_t& checksum)
+		{
+			unsigned evaluatedTypeId, count;
+			IteratorRange<const void*> data;
+			ImpliedTyping::TypeDesc typeDesc;
+			if (formatter.TryBeginBlock(evaluatedTypeId)) {
+				ChecksumFormatterBlock(formatter, checksum);
+				Formatters::RequireEndBlock(formatter);
+			} else if (formatter.TryRawValue(data, typeDesc, evaluatedTypeId)) {
+				checksum += name ^ *(const uint8_t*)data.begin();
+			} else if (formatter.TryBeginArray(count, evaluatedTypeId)) {
+				for (unsigned c=0; c<count; ++c)
+					ChecksumFormatterValue(formatter, 0, checksum);
+				Formatters::RequireEndArray(formatter);
+			}
+		}
+
+		static void ChecksumFormatterBlock(Formatters::BinaryInputFormatter& formatter, uint64_t& checksum)
+		{
+			uint64_t name;
+			while (formatter.TryKeyedItem(name))
+				ChecksumFormatterValue(formatter, name, checksum);
+		}
+	}
+
+	TEST_CASE( "BinarySchemata-CompiledDecoderPerformance", "[formatters]" )
+	{
+		// Compare the interpreted BinaryInputFormatter against BinaryDecoder on a large synthetic mesh-like file
+		const char* testBlock = R"(
+		block Vertex {
+			float32 Position[3];
+			float32 Normal[3];
+			uint8 Color[4];
+			float32 TexCoord[2];
+		};
+
+		block Mesh {
+			uint32 VertexCount;
+			uint32 IndexCount;
+			Vertex Vertices[VertexCount];
+			uint16 Indices[IndexCount];
+		};
+
+		block File {
+			uint32 MeshCount;
+			Mesh Meshes[MeshCount];
+		};
+		)";
+
+		#if defined(_DEBUG)
+			const unsigned meshCount = 4, verticesPerMesh = 16*1024;
+		#else
+			const unsigned meshCount = 16, verticesPerMesh = 64*1024;
+		#endif
+		const unsigned vertexSize = 4*3+4*3+4+4*2, indicesPerMesh = verticesPerMesh*3;
+		std::vector<uint8_t> buffer;
+		buffer.reserve(4 + meshCount * (8 + verticesPerMesh*vertexSize + indicesPerMesh*2));
+		auto append = [&buffer](uint32_t value) { buffer.insert(buffer.end(), (const uint8_t*)&value, (const uint8_t*)(&value+1)); };
+		append(meshCount);
+		for (unsigned m=0; m<meshCount; ++m) {
+			append(verticesPerMesh);
+			append(indicesPerMesh);
+			for (unsigned c=0; c<verticesPerMesh*vertexSize + indicesPerMesh*2; ++c)
+				buffer.push_back(uint8_t(c*13+m));
+		}
+
+		auto decl = std::make_shared<Formatters::BinarySchemata>(testBlock, ::Assets::DirectorySearchRules{}, ::Assets::DependencyValidation{});
+		auto context = std::make_shared<Formatters::EvaluationContext>();
+
+		uint64_t formatterChecksum = 0;
+		auto start = std::chrono::steady_clock::now();
+		{
+			Formatters::BinaryInputFormatter formatter(buffer, context);
+			formatter.PushPattern(decl, decl->FindBlockDefinition("File"));
+			Internal::ChecksumFormatterBlock(formatter, formatterChecksum);
+		}
+		auto middle = std::chrono::steady_clock::now();
+
+		Formatters::BinaryDecoder decoder(context);
+		Internal::ChecksumDecodeVisitor visitor;
+		decoder.Decode(buffer, decl, decl->FindBlockDefinition("File"), visitor);
+		auto end = std::chrono::steady_clock::now();
+
+		REQUIRE(visitor._checksum == formatterChecksum);
+
+		auto formatterMicros = std::chrono::duration_cast<std::chrono::microseconds>(middle-start).count();
+		auto decoderMicros = std::chrono::duration_cast<std::chrono::microseconds>(end-middle).count();
+		std::cout << "BinaryInputFormatter: " << formatterMicros << " micros (" << buffer.size() / std::max(formatterMicros, decltype(formatterMicros)(1)) << " bytes/micro)" << std::endl;
+		std::cout << "BinaryDecoder: " << decoderMicros << " micros (" << buffer.size() / std::max(decoderMicros, decltype(decoderMicros)(1)) << " bytes/micro)" << std::endl;
+	}
 }
@@ -0,0 +1,103 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../UnitTestHelper.h"
+#include "../../ColladaConversion/ScaffoldParsingUtil.h"
+#include "../../ConsoleRig/GlobalServices.h"
+#include "../../Utility/Threading/CompletionThreadPool.h"
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include "catch2/catch_test_macros.hpp"
+
+namespace UnitTests
+{
+    template<typename Type>
+        static void RequireParallelParseMatches(const std::string& list, unsigned destCount)
+    {
+        Formatters::XmlInputFormatter<utf8>::InteriorSection section { list.data(), list.data() + list.size() };
+        std::vector<Type> serial(destCount, Type(0)), parallel(destCount, Type(0));
+        unsigned serialCount = 0;
+        ColladaConversion::ParseXMLList(serial.data(), destCount, section, &serialCount);
+        auto parallelCount = ColladaConversion::ParseXMLListParallel(parallel.data(), destCount, section);
+        REQUIRE(parallelCount == serialCount);
+        REQUIRE(std::memcmp(serial.data(), parallel.data(), destCount*sizeof(Type)) == 0);
+    }
+
+    template<typename GenerateToken>
+        static std::string MakeXMLList(std::mt19937& rng, unsigned elementCount, const char trailing[], GenerateToken&& generateToken)
+    {
+        const char* separators[] { " ", "\t", "\r\n", "  \n    " };
+        std::string result;
+        char buffer[64];
+        for (unsigned c=0; c<elementCount; ++c) {
+            if (c != 0) result += separators[rng()%dimof(separators)];
+            generateToken(buffer, sizeof(buffer));
+            result += buffer;
+        }
+        result += trailing;
+        return result;
+    }
+
+    TEST_CASE( "ColladaConversion-ParseXMLListParallel", "[formatters]" )
+    {
+            // With 8 worker threads the largest lists here are split into 9 chunks. The split points are
+            // arbitrary byte offsets, so almost all of them begin in the middle of a token, and must be
+            // moved forward to the next whitespace
+        auto cfg = GetStartupConfig();
+        cfg._shortTaskThreadPoolCount = 8;
+        auto globalServices = ConsoleRig::MakeGlobalServices(cfg);
+        REQUIRE(globalServices->GetShortTaskThreadPool().IsGood());
+
+        std::mt19937 rng(5723462);
+        const unsigned elementCount = 320*1024;
+        const char* trailingWhitespace[] { "", " ", "\r\n", "\n\t\t  \n" };
+
+        SECTION("Floats")
+        {
+            std::uniform_real_distribution<float> values(-1e4f, 1e4f);
+            std::uniform_int_distribution<int> precision(1, 9);
+            for (auto trailing:trailingWhitespace) {
+                auto list = MakeXMLList(rng, elementCount, trailing,
+                    [&](char buffer[], size_t bufferSize) { std::snprintf(buffer, bufferSize, "%.*g", precision(rng), values(rng)); });
+                RequireParallelParseMatches<float>(list, elementCount);
+                RequireParallelParseMatches<float>(list, elementCount/3);       // (more elements than the destination can hold)
+                RequireParallelParseMatches<float>(list, elementCount+17);      // (fewer elements than the destination can hold)
+            }
+        }
+
+        SECTION("Unsigned")
+        {
+            std::uniform_int_distribution<unsigned> digits(1, 9);
+            for (auto trailing:trailingWhitespace) {
+                auto list = MakeXMLList(rng, elementCount, trailing,
+                    [&](char buffer[], size_t bufferSize) {
+                        auto digitCount = digits(rng);
+                        unsigned limit = 1; for (unsigned d=0; d<digitCount; ++d) limit *= 10;
+                        std::snprintf(buffer, bufferSize, "%u", unsigned(rng()%limit));
+                    });
+                RequireParallelParseMatches<unsigned>(list, elementCount);
+                RequireParallelParseMatches<unsigned>(list, elementCount/3);
+                RequireParallelParseMatches<unsigned>(list, elementCount+17);
+            }
+        }
+
+        SECTION("Chunk boundaries at every offset within a token")
+        {
+                // Fixed width tokens, shifted by a different amount of leading whitespace each time, so
+                // that the split points fall at each position within a token (and on the separators)
+            std::string fixedWidthList;
+            for (unsigned c=0; c<elementCount; ++c) {
+                char buffer[64];
+                std::snprintf(buffer, sizeof(buffer), "%+.8e ", std::uniform_real_distribution<float>(-1.f, 1.f)(rng));
+                fixedWidthList += buffer;
+            }
+            auto tokenWidth = (unsigned)std::strlen("+1.00000000e+00 ");
+            for (unsigned shift=0; shift<tokenWidth; ++shift)
+                RequireParallelParseMatches<float>(std::string(shift, ' ') + fixedWidthList, elementCount);
+        }
+    }
+}
@@ -3,6 +3,8 @@
 // http://www.opensource.org/licenses/mit-license.php)
 
 #include "InteractiveTestHelper.h"
+#include "../UnitTestHelper.h"
+#include "../EmbeddedRes.h"
 #include "../../PlatformRig/OverlaySystem.h"
 #include "../../PlatformRig/InputContext.h"
 #include "../../RenderCore/Techniques/TechniqueUtils.h"
@@ -19,11 +21,18 @@
 #include "../../RenderOverlays/LayoutEngine.h"
 #include "../../Math/Transformations.h"
 #include "../../Assets/Marker.h"
+#include "../../Assets/IFileSystem.h"
+#include "../../Assets/MountingTree.h"
+#include "../../ConsoleRig/AttachablePtr.h"
+#include "../../Utility/Threading/CompletionThreadPool.h"
+#include "../../xleres/FileList.h"
 #include "../../Utility/StringFormat.h"
 #include "../../Utility/HeapUtils.h"
 #include "catch2/catch_test_macros.hpp"
 #include "catch2/catch_approx.hpp"
 #include <random>
+#include <iostream>
+#include <cstring>
 
 #include "../../RenderCore/Metal/Resource.h"		// required for CompleteInitialization
 #include "../../RenderCore/Metal/DeviceContext.h"
@@ -273,4 +282,61 @@ namespace UnitTests
 		testHelper->Run(visCamera, tester);
 	}
 
+	TEST_CASE( "FontRasterization-Headless", "[renderoverlays]" )
+	{
+		// Rasterize thousands of glyphs without a device; comparing GetBitmap() one glyph at a time against the batched
+		// GetBitmaps() interface running on the thread pool. The same font files are loaded via two different names, so
+		// each side gets its own font objects (and glyph caches)
+		auto globalServices = ConsoleRig::MakeGlobalServices(GetStartupConfig());
+		auto xleresmnt = ::Assets::MainFileSystem::GetMountingTree()->Mount("xleres", UnitTests::CreateEmbeddedResFileSystem());
+		ConsoleRig::AttachablePtr<RenderOverlays::FTFontResources> fontResources = RenderOverlays::CreateFTFontResources();
+		RenderOverlays::RegisterFontLibraryFile(FONTS_DAT);
+		auto& pool = globalServices->GetShortTaskThreadPool();
+
+		std::vector<ucs4> chrs;
+		for (ucs4 c=33; c<0x250; ++c) chrs.push_back(c);		// basic latin, latin-1 supplement & latin extended A/B
+		const int sizes[] { 12, 16, 20, 32, 38, 46 };
+
+		auto loadFont = [](StringSection<> name, int size) {
+			auto m = RenderOverlays::MakeFont(name, size);
+			m->StallWhilePending();
+			return m->Actualize();
+		};
+
+		std::chrono::steady_clock::duration singleThreadedTime{0}, batchedTime{0};
+		unsigned glyphCount = 0;
+		std::vector<RenderOverlays::Font::Bitmap> serialBitmaps(chrs.size()), batchedBitmaps(chrs.size());
+		for (auto size:sizes) {
+			auto serialFont = loadFont("Petra", size);
+			auto batchedFont = loadFont("xleres/DefaultResources/fonts/PetraSans/PetraSans-Regular.ttf", size);
+			REQUIRE(serialFont != batchedFont);
+
+			auto start = std::chrono::steady_clock::now();
+			for (unsigned c=0; c<chrs.size(); ++c)
+				serialBitmaps[c] = serialFont->GetBitmap(chrs[c]);
+			auto mid = std::chrono::steady_clock::now();
+			batchedFont->GetBitmaps(MakeIteratorRange(batchedBitmaps), chrs, &pool);
+			auto end = std::chrono::steady_clock::now();
+			singleThreadedTime += mid-start;
+			batchedTime += end-mid;
+			glyphCount += (unsigned)chrs.size();
+
+			for (unsigned c=0; c<chrs.size(); ++c) {
+				REQUIRE(serialBitmaps[c]._width == batchedBitmaps[c]._width);
+				REQUIRE(serialBitmaps[c]._height == batchedBitmaps[c]._height);
+				REQUIRE(serialBitmaps[c]._xAdvance == batchedBitmaps[c]._xAdvance);
+				REQUIRE(serialBitmaps[c]._bitmapOffsetX == batchedBitmaps[c]._bitmapOffsetX);
+				REQUIRE(serialBitmaps[c]._bitmapOffsetY == batchedBitmaps[c]._bitmapOffsetY);
+				REQUIRE(serialBitmaps[c]._data.size() == batchedBitmaps[c]._data.size());
+				REQUIRE(std::memcmp(serialBitmaps[c]._data.begin(), batchedBitmaps[c]._data.begin(), serialBitmaps[c]._data.size()) == 0);
+			}
+		}
+
+		auto asGlyphsPerSecond = [glyphCount](auto duration) { return glyphCount / std::chrono::duration_cast<std::chrono::duration<double>>(duration).count(); };
+		std::cout << "Rasterized " << glyphCount << " glyphs: " << asGlyphsPerSecond(singleThreadedTime) << " glyphs/s single threaded, ";
+		std::cout << asGlyphsPerSecond(batchedTime) << " glyphs/s batched on " << pool.GetThreadContext() << " worker threads" << std::endl;
+
+		::Assets::MainFileSystem::GetMountingTree()->Unmount(xleresmnt);
+	}
+
 }
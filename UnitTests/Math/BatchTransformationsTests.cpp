@@ -0,0 +1,245 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../../Math/BatchTransformations.h"
+#include "../../Math/Transformations.h"
+#include "../../Math/Geometry.h"
+#include <random>
+#include <vector>
+#include <iostream>
+#include <chrono>
+#include "catch2/catch_test_macros.hpp"
+
+namespace UnitTests
+{
+        // absolute tolerance for small values, relative for large ones
+    static bool CloseTo(float a, float b, float tolerance)
+    {
+        return std::abs(a-b) <= tolerance * std::max(1.f, std::abs(b));
+    }
+
+    template<int Rows, int Cols>
+        static bool CloseTo(const cml::matrix<float, cml::fixed<Rows, Cols>, cml::col_basis>& a, const cml::matrix<float, cml::fixed<Rows, Cols>, cml::col_basis>& b, float tolerance)
+    {
+        for (int r=0; r<Rows; ++r)
+            for (int c=0; c<Cols; ++c)
+                if (!CloseTo(a(r,c), b(r,c), tolerance))
+                    return false;
+        return true;
+    }
+
+    static bool CloseTo(Float3 a, Float3 b, float tolerance) { return CloseTo(a[0], b[0], tolerance) && CloseTo(a[1], b[1], tolerance) && CloseTo(a[2], b[2], tolerance); }
+    static bool CloseTo(const Quaternion& a, const Quaternion& b, float tolerance) { return CloseTo(a[0], b[0], tolerance) && CloseTo(a[1], b[1], tolerance) && CloseTo(a[2], b[2], tolerance) && CloseTo(a[3], b[3], tolerance); }
+
+    static Quaternion RandomRotation(std::mt19937& rng)
+    {
+        auto axis = SphericalToCartesian(Float3(
+            Deg2Rad(std::uniform_real_distribution<float>(-180.f, 180.f)(rng)),
+            Deg2Rad(std::uniform_real_distribution<float>(-180.f, 180.f)(rng)),
+            1.f));
+        return MakeRotationQuaternion(axis, Deg2Rad(std::uniform_real_distribution<float>(-180.f, 180.f)(rng)));
+    }
+
+    static ScaleRotationTranslationQ RandomScaleRotationTranslation(std::mt19937& rng)
+    {
+        std::uniform_real_distribution<float> scale(0.1f, 10.f), translation(-1000.f, 1000.f);
+        auto sign = [&rng]() { return (rng() & 1) ? -1.f : 1.f; };
+        return ScaleRotationTranslationQ(
+            Float3(sign() * scale(rng), sign() * scale(rng), sign() * scale(rng)),
+            RandomRotation(rng),
+            Float3(translation(rng), translation(rng), translation(rng)));
+    }
+
+    static Float4x4 RandomGeneralMatrix(std::mt19937& rng)
+    {
+            // diagonally dominant, so never close to singular
+        std::uniform_real_distribution<float> d(-1.f, 1.f);
+        Float4x4 result;
+        for (unsigned r=0; r<4; ++r)
+            for (unsigned c=0; c<4; ++c)
+                result(r,c) = d(rng) + ((r==c) ? 4.f : 0.f);
+        return result;
+    }
+
+    static Float4x4 RandomTransform(std::mt19937& rng)
+    {
+        return ((rng()%4) == 0) ? RandomGeneralMatrix(rng) : AsFloat4x4(RandomScaleRotationTranslation(rng));
+    }
+
+    static Float3 RandomPoint(std::mt19937& rng)
+    {
+        std::uniform_real_distribution<float> d(-100.f, 100.f);
+        return Float3(d(rng), d(rng), d(rng));
+    }
+
+    TEST_CASE( "BatchTransformations-MatchesPerElement", "[math]" )
+    {
+        std::mt19937 rng(7346235);
+        const float tolerance = 1e-4f;
+
+            // odd sizes to exercise the partial final batch
+        for (size_t count:{ 1, 3, 7, 8, 17, 1021 }) {
+            std::vector<Float4x4> first, second, batchResult(count);
+            std::vector<Float3x4> first3x4, second3x4, batchResult3x4(count);
+            for (size_t c=0; c<count; ++c) {
+                first.push_back(RandomTransform(rng));
+                second.push_back(RandomTransform(rng));
+                first3x4.push_back(Truncate(AsFloat4x4(RandomScaleRotationTranslation(rng))));
+                second3x4.push_back(Truncate(AsFloat4x4(RandomScaleRotationTranslation(rng))));
+            }
+
+                // combine
+            {
+                BatchCombine(MakeIteratorRange(batchResult), MakeIteratorRange(first), MakeIteratorRange(second));
+                for (size_t c=0; c<count; ++c)
+                    REQUIRE(CloseTo(batchResult[c], Combine(first[c], second[c]), tolerance));
+
+                BatchCombine(MakeIteratorRange(batchResult), MakeIteratorRange(first), second[0]);
+                for (size_t c=0; c<count; ++c)
+                    REQUIRE(CloseTo(batchResult[c], Combine(first[c], second[0]), tolerance));
+
+                BatchCombine(MakeIteratorRange(batchResult), first[0], MakeIteratorRange(second));
+                for (size_t c=0; c<count; ++c)
+                    REQUIRE(CloseTo(batchResult[c], Combine(first[0], second[c]), tolerance));
+
+                BatchCombine(MakeIteratorRange(batchResult3x4), MakeIteratorRange(first3x4), MakeIteratorRange(second3x4));
+                for (size_t c=0; c<count; ++c)
+                    REQUIRE(CloseTo(batchResult3x4[c], Combine(first3x4[c], second3x4[c]), tolerance));
+
+                    // output aliasing one of the inputs
+                auto inPlace = first;
+                BatchCombine(MakeIteratorRange(inPlace), MakeIteratorRange(inPlace), MakeIteratorRange(second));
+                for (size_t c=0; c<count; ++c)
+                    REQUIRE(CloseTo(inPlace[c], Combine(first[c], second[c]), tolerance));
+            }
+
+                // inverse
+            {
+                BatchInverse(MakeIteratorRange(batchResult), MakeIteratorRange(first));
+                for (size_t c=0; c<count; ++c)
+                    REQUIRE(CloseTo(batchResult[c], Inverse(first[c]), tolerance));
+
+                auto inPlace = first;
+                BatchInverse(MakeIteratorRange(inPlace), MakeIteratorRange(inPlace));
+                for (size_t c=0; c<count; ++c)
+                    REQUIRE(CloseTo(inPlace[c], batchResult[c], 0.f));
+            }
+
+                // transform points, direction vectors & normals
+            {
+                std::vector<Float3> points, batchPoints(count);
+                for (size_t c=0; c<count; ++c) points.push_back(RandomPoint(rng));
+                auto transform = AsFloat4x4(RandomScaleRotationTranslation(rng));
+
+                BatchTransformPoints(MakeIteratorRange(batchPoints), transform, MakeIteratorRange(points));
+                for (size_t c=0; c<count; ++c)
+                    REQUIRE(CloseTo(batchPoints[c], TransformPoint(transform, points[c]), tolerance));
+
+                BatchTransformDirectionVectors(MakeIteratorRange(batchPoints), transform, MakeIteratorRange(points));
+                for (size_t c=0; c<count; ++c)
+                    REQUIRE(CloseTo(batchPoints[c], TransformDirectionVector(transform, points[c]), tolerance));
+
+                auto normalTransform = Transpose(Inverse(Truncate3x3(transform)));
+                BatchTransformNormals(MakeIteratorRange(batchPoints), transform, MakeIteratorRange(points));
+                for (size_t c=0; c<count; ++c)
+                    REQUIRE(CloseTo(batchPoints[c], Normalize(TransformDirectionVector(normalTransform, points[c])), tolerance));
+
+                std::vector<float> x, y, z;
+                for (auto p:points) { x.push_back(p[0]); y.push_back(p[1]); z.push_back(p[2]); }
+                BatchTransformPoints(transform, x.data(), y.data(), z.data(), count);
+                for (size_t c=0; c<count; ++c)
+                    REQUIRE(CloseTo(Float3(x[c], y[c], z[c]), TransformPoint(transform, points[c]), tolerance));
+            }
+
+                // quaternions
+            {
+                std::vector<Quaternion> lhs, rhs, batchQuaternions(count, Identity<Quaternion>());
+                for (size_t c=0; c<count; ++c) {
+                    lhs.push_back(RandomRotation(rng));
+                    rhs.push_back(((rng()%8) == 0) ? lhs.back() : RandomRotation(rng));       // sometimes identical, to hit the linear interpolation path
+                }
+
+                std::vector<Float3x3> batchRotations(count);
+                BatchAsFloat3x3(MakeIteratorRange(batchRotations), MakeIteratorRange(lhs));
+                for (size_t c=0; c<count; ++c)
+                    REQUIRE(CloseTo(batchRotations[c], AsFloat3x3(lhs[c]), tolerance));
+
+                for (float alpha:{ 0.f, 0.25f, 0.5f, 0.9f, 1.f }) {
+                    BatchSphericalInterpolate(MakeIteratorRange(batchQuaternions), MakeIteratorRange(lhs), MakeIteratorRange(rhs), alpha);
+                    for (size_t c=0; c<count; ++c)
+                        REQUIRE(CloseTo(batchQuaternions[c], SphericalInterpolate(lhs[c], rhs[c], alpha), tolerance));
+                }
+            }
+
+                // decompose
+            {
+                std::vector<ScaleRotationTranslationQ> batchDecomposed(count, ScaleRotationTranslationQ(Identity<Float4x4>()));
+                auto skewed = first;
+                for (size_t c=0; c<count; c+=5)
+                    skewed[c] = Combine(skewed[c], MakeFloat4x4(1.f, 0.5f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f));
+                for (auto& s:skewed) s(3,0) = s(3,1) = s(3,2) = 0.f, s(3,3) = 1.f;
+
+                BatchDecompose(MakeIteratorRange(batchDecomposed), MakeIteratorRange(skewed));
+                for (size_t c=0; c<count; ++c) {
+                    ScaleRotationTranslationQ expected(skewed[c]);
+                    REQUIRE(CloseTo(batchDecomposed[c]._scale, expected._scale, tolerance));
+                    REQUIRE(CloseTo(batchDecomposed[c]._translation, expected._translation, tolerance));
+                        // (q & -q are the same rotation; the sign can differ when the choice of branch is marginal)
+                    REQUIRE((CloseTo(batchDecomposed[c]._rotation, expected._rotation, tolerance) || CloseTo(batchDecomposed[c]._rotation, -expected._rotation, tolerance)));
+                }
+            }
+        }
+    }
+
+    TEST_CASE( "BatchTransformations-Performance", "[math]" )
+    {
+        #if defined(_DEBUG)
+            const size_t count = 16*1024;
+        #else
+            const size_t count = 256*1024;
+        #endif
+        std::mt19937 rng(2385623);
+        std::vector<Float4x4> first, second, result(count);
+        std::vector<ScaleRotationTranslationQ> srts, decomposed(count, ScaleRotationTranslationQ(Identity<Float4x4>()));
+        std::vector<Quaternion> lhs, rhs, slerped(count);
+        std::vector<Float3> points, transformedPoints(count);
+        for (size_t c=0; c<count; ++c) {
+            first.push_back(RandomTransform(rng));
+            second.push_back(RandomTransform(rng));
+            srts.push_back(RandomScaleRotationTranslation(rng));
+            lhs.push_back(RandomRotation(rng));
+            rhs.push_back(RandomRotation(rng));
+            points.push_back(RandomPoint(rng));
+        }
+        std::vector<Float4x4> srtMatrices;
+        for (const auto& s:srts) srtMatrices.push_back(AsFloat4x4(s));
+        auto transform = srtMatrices[0];
+
+        auto time = [](auto&& fn) {
+            fn();       // (warm up)
+            auto start = std::chrono::steady_clock::now();
+            fn();
+            return std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - start).count();
+        };
+        auto report = [count](const char* name, double batch, double perElement) {
+            std::cout << name << ": " << double(count) / 1e6 / batch << " M/s (per element: " << double(count) / 1e6 / perElement << " M/s, " << perElement / batch << "x)" << std::endl;
+        };
+
+        report("Combine",
+            time([&]() { BatchCombine(MakeIteratorRange(result), MakeIteratorRange(first), MakeIteratorRange(second)); }),
+            time([&]() { for (size_t c=0; c<count; ++c) result[c] = Combine(first[c], second[c]); }));
+        report("Inverse",
+            time([&]() { BatchInverse(MakeIteratorRange(result), MakeIteratorRange(first)); }),
+            time([&]() { for (size_t c=0; c<count; ++c) result[c] = Inverse(first[c]); }));
+        report("TransformPoints",
+            time([&]() { BatchTransformPoints(MakeIteratorRange(transformedPoints), transform, MakeIteratorRange(points)); }),
+            time([&]() { for (size_t c=0; c<count; ++c) transformedPoints[c] = TransformPoint(transform, points[c]); }));
+        report("SphericalInterpolate",
+            time([&]() { BatchSphericalInterpolate(MakeIteratorRange(slerped), MakeIteratorRange(lhs), MakeIteratorRange(rhs), 0.3f); }),
+            time([&]() { for (size_t c=0; c<count; ++c) slerped[c] = SphericalInterpolate(lhs[c], rhs[c], 0.3f); }));
+        report("Decompose",
+            time([&]() { BatchDecompose(MakeIteratorRange(decomposed), MakeIteratorRange(srtMatrices)); }),
+            time([&]() { for (size_t c=0; c<count; ++c) decomposed[c] = ScaleRotationTranslationQ(srtMatrices[c]); }));
+    }
+}
@@ -0,0 +1,318 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../../Math/RayIntersection.h"
+#include "../../Math/Geometry.h"
+#include <random>
+#include <vector>
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include "catch2/catch_test_macros.hpp"
+
+namespace UnitTests
+{
+    using Ray = std::pair<Float3, Float3>;
+
+    static Float3 RandomPoint(std::mt19937& rng, float range)
+    {
+        std::uniform_real_distribution<float> d(-range, range);
+        return Float3(d(rng), d(rng), d(rng));
+    }
+
+    static Ray RandomRay(std::mt19937& rng)
+    {
+        auto start = RandomPoint(rng, 10.f);
+        return { start, start + RandomPoint(rng, 20.f) };
+    }
+
+    static std::pair<Float3, Float3> RandomAABB(std::mt19937& rng)
+    {
+        auto center = RandomPoint(rng, 8.f);
+        std::uniform_real_distribution<float> size(0.1f, 4.f);
+        Float3 halfSize(size(rng), size(rng), size(rng));
+        return { center - halfSize, center + halfSize };
+    }
+
+    static Float4 RandomSphere(std::mt19937& rng)
+    {
+        auto center = RandomPoint(rng, 8.f);
+        return Float4(center[0], center[1], center[2], std::uniform_real_distribution<float>(0.1f, 4.f)(rng));
+    }
+
+    static std::vector<Float3> RandomTriangles(std::mt19937& rng, size_t count)
+    {
+        std::vector<Float3> result;
+        result.reserve(count*3);
+        for (size_t c=0; c<count; ++c) {
+            auto center = RandomPoint(rng, 8.f);
+            for (unsigned q=0; q<3; ++q)
+                result.push_back(center + RandomPoint(rng, 4.f));
+        }
+        return result;
+    }
+
+    static Float3 PointOnRay(const Ray& ray, float alpha) { return LinearInterpolate(ray.first, ray.second, alpha); }
+
+    static bool IsInside(Float3 pt, Float3 mins, Float3 maxs)
+    {
+        return pt[0] >= mins[0] && pt[1] >= mins[1] && pt[2] >= mins[2] && pt[0] <= maxs[0] && pt[1] <= maxs[1] && pt[2] <= maxs[2];
+    }
+
+    static bool RayVsAABBScalar(const Ray& ray, const std::pair<Float3, Float3>& aabb, float expand)
+    {
+        Float3 e(expand, expand, expand);
+        return RayVsAABB(ray, aabb.first - e, aabb.second + e);
+    }
+
+    static bool RayVsSphereScalar(const Ray& ray, Float3 center, float radius, float expand)
+    {
+        auto r = std::max(radius + expand, 0.f);
+        return RayVsSphere(ray.first - center, ray.second - center, r*r);
+    }
+
+        //  The packet functions use different algorithms to the scalar versions for boxes & spheres, so results
+        //  may legitimately differ for rays that graze the surface. In those cases, the scalar test must agree
+        //  with the packet result when the primitive is slightly expanded or shrunk
+    static const float s_grazingTolerance = 1e-3f;
+
+    static void CheckAABBResult(const Ray& ray, const std::pair<Float3, Float3>& aabb, float alpha)
+    {
+        bool hit = alpha != RayIntersection_Miss;
+        if (hit != RayVsAABBScalar(ray, aabb, 0.f)) {
+            REQUIRE(RayVsAABBScalar(ray, aabb, s_grazingTolerance));
+            REQUIRE(!RayVsAABBScalar(ray, aabb, -s_grazingTolerance));
+        }
+        if (hit) {
+            REQUIRE(alpha >= 0.f);
+            REQUIRE(alpha <= 1.f);
+            auto pt = PointOnRay(ray, alpha);
+            Float3 e(s_grazingTolerance, s_grazingTolerance, s_grazingTolerance);
+            REQUIRE(IsInside(pt, aabb.first - e, aabb.second + e));
+            if (alpha > 0.f) {
+                    // entry point must be on a face of the box
+                float distanceToFace = std::numeric_limits<float>::max();
+                for (unsigned c=0; c<3; ++c)
+                    distanceToFace = std::min(distanceToFace, std::min(std::abs(pt[c] - aabb.first[c]), std::abs(pt[c] - aabb.second[c])));
+                REQUIRE(distanceToFace < s_grazingTolerance);
+            }
+        }
+    }
+
+    static void CheckSphereResult(const Ray& ray, Float3 center, float radius, float alpha)
+    {
+        bool hit = alpha != RayIntersection_Miss;
+        if (hit != RayVsSphereScalar(ray, center, radius, 0.f)) {
+            REQUIRE(RayVsSphereScalar(ray, center, radius, s_grazingTolerance));
+            REQUIRE(!RayVsSphereScalar(ray, center, radius, -s_grazingTolerance));
+        }
+        if (hit) {
+            REQUIRE(alpha >= 0.f);
+            REQUIRE(alpha <= 1.f);
+            auto distance = Magnitude(PointOnRay(ray, alpha) - center);
+            if (alpha > 0.f) {
+                REQUIRE(std::abs(distance - radius) < s_grazingTolerance);
+            } else
+                REQUIRE(distance <= radius + s_grazingTolerance);
+        }
+    }
+
+    static void CheckTriangleResult(const Ray& ray, const Float3 corners[], float alpha)
+    {
+            // the packet triangle test matches the scalar test exactly
+        float scalarAlpha = RayIntersection_Miss;
+        bool scalarHit = RayVsTriangle(scalarAlpha, ray, corners[0], corners[1], corners[2]);
+        REQUIRE(scalarHit == (alpha != RayIntersection_Miss));
+        if (scalarHit)
+            REQUIRE(std::abs(alpha - scalarAlpha) <= 1e-5f);
+    }
+
+    TEST_CASE( "RayIntersection-MatchesScalar", "[math]" )
+    {
+        std::mt19937 rng(762349);
+        const size_t count = 4099;      // (not a multiple of the SIMD width)
+        std::vector<Ray> rays;
+        std::vector<std::pair<Float3, Float3>> aabbs;
+        std::vector<Float4> spheres;
+        for (size_t c=0; c<count; ++c) {
+            rays.push_back(RandomRay(rng));
+            aabbs.push_back(RandomAABB(rng));
+            spheres.push_back(RandomSphere(rng));
+        }
+        auto triangles = RandomTriangles(rng, count);
+        std::vector<float> results(count);
+
+        // One ray vs many primitives
+        unsigned aabbHits = 0, sphereHits = 0, triangleHits = 0;
+        for (unsigned r=0; r<64; ++r) {
+            const auto& ray = rays[r];
+            RayVsAABBs(MakeIteratorRange(results), ray, MakeIteratorRange(aabbs));
+            for (size_t c=0; c<count; ++c) {
+                CheckAABBResult(ray, aabbs[c], results[c]);
+                aabbHits += results[c] != RayIntersection_Miss;
+            }
+
+            RayVsSpheres(MakeIteratorRange(results), ray, MakeIteratorRange(spheres));
+            for (size_t c=0; c<count; ++c) {
+                CheckSphereResult(ray, Truncate(spheres[c]), spheres[c][3], results[c]);
+                sphereHits += results[c] != RayIntersection_Miss;
+            }
+
+            RayVsTriangles(MakeIteratorRange(results), ray, MakeIteratorRange(triangles));
+            for (size_t c=0; c<count; ++c) {
+                CheckTriangleResult(ray, &triangles[c*3], results[c]);
+                triangleHits += results[c] != RayIntersection_Miss;
+            }
+        }
+            // make sure we're testing a reasonable mix of hits & misses
+        REQUIRE(aabbHits > 1000); REQUIRE(aabbHits < 64*count/2);
+        REQUIRE(sphereHits > 1000); REQUIRE(sphereHits < 64*count/2);
+        REQUIRE(triangleHits > 500); REQUIRE(triangleHits < 64*count/2);
+
+        // Many rays vs one primitive
+        for (unsigned p=0; p<64; ++p) {
+            RaysVsAABB(MakeIteratorRange(results), MakeIteratorRange(rays), aabbs[p].first, aabbs[p].second);
+            for (size_t c=0; c<count; ++c)
+                CheckAABBResult(rays[c], aabbs[p], results[c]);
+
+            RaysVsSphere(MakeIteratorRange(results), MakeIteratorRange(rays), Truncate(spheres[p]), spheres[p][3]);
+            for (size_t c=0; c<count; ++c)
+                CheckSphereResult(rays[c], Truncate(spheres[p]), spheres[p][3], results[c]);
+
+            RaysVsTriangle(MakeIteratorRange(results), MakeIteratorRange(rays), triangles[p*3], triangles[p*3+1], triangles[p*3+2]);
+            for (size_t c=0; c<count; ++c)
+                CheckTriangleResult(rays[c], &triangles[p*3], results[c]);
+        }
+
+        // Zero length rays & empty ranges
+        {
+            Ray zeroLength { Float3(0.f, 0.f, 0.f), Float3(0.f, 0.f, 0.f) };
+            std::vector<float> tri(1);
+            const Float3 corners[] { Float3(-1.f, -1.f, 0.f), Float3(1.f, -1.f, 0.f), Float3(0.f, 1.f, 0.f) };
+            RayVsTriangles(MakeIteratorRange(tri), zeroLength, MakeIteratorRange(corners));
+            REQUIRE(tri[0] == RayIntersection_Miss);
+            RaysVsTriangle(MakeIteratorRange(tri), MakeIteratorRange(&zeroLength, &zeroLength+1), corners[0], corners[1], corners[2]);
+            REQUIRE(tri[0] == RayIntersection_Miss);
+
+                // a zero length ray inside of a box or sphere is considered an intersection
+            RaysVsAABB(MakeIteratorRange(tri), MakeIteratorRange(&zeroLength, &zeroLength+1), Float3(-1.f, -1.f, -1.f), Float3(1.f, 1.f, 1.f));
+            REQUIRE(tri[0] == 0.f);
+            RaysVsSphere(MakeIteratorRange(tri), MakeIteratorRange(&zeroLength, &zeroLength+1), Float3(0.f, 0.f, 0.f), 1.f);
+            REQUIRE(tri[0] == 0.f);
+
+            RayVsAABBs({}, rays[0], {});
+            RayVsTriangles({}, rays[0], {});
+            RaysVsSphere({}, {}, Float3(0.f, 0.f, 0.f), 1.f);
+        }
+
+        // Axis aligned rays, and rays starting exactly on the face of a box
+        {
+            std::pair<Float3, Float3> unitBox { Float3(-1.f, -1.f, -1.f), Float3(1.f, 1.f, 1.f) };
+            Ray axisRays[] {
+                { Float3(0.f, 0.f, -5.f), Float3(0.f, 0.f, 5.f) },
+                { Float3(0.5f, -5.f, 0.5f), Float3(0.5f, 5.f, 0.5f) },
+                { Float3(-1.f, 0.f, 0.f), Float3(-1.f, 3.f, 0.f) },
+                { Float3(0.f, 2.f, 0.f), Float3(0.f, 5.f, 0.f) },
+                { Float3(1.5f, 0.f, -5.f), Float3(1.5f, 0.f, 5.f) },
+            };
+            float axisResults[dimof(axisRays)];
+            RaysVsAABB(MakeIteratorRange(axisResults), MakeIteratorRange(axisRays), unitBox.first, unitBox.second);
+            REQUIRE(std::abs(axisResults[0] - 0.4f) < 1e-6f);
+            REQUIRE(std::abs(axisResults[1] - 0.4f) < 1e-6f);
+            REQUIRE(axisResults[2] == 0.f);
+            REQUIRE(axisResults[3] == RayIntersection_Miss);
+            REQUIRE(axisResults[4] == RayIntersection_Miss);
+        }
+    }
+
+    TEST_CASE( "RayIntersection-Watertight", "[math]" )
+    {
+        // A grid of triangles, and rays that pass exactly through the shared edges & vertices. Every one
+        // of these rays must hit at least one triangle
+        const unsigned gridSize = 8;
+        std::vector<Float3> triangles;
+        for (unsigned y=0; y<gridSize; ++y)
+            for (unsigned x=0; x<gridSize; ++x) {
+                Float3 p00(float(x), float(y), 0.f), p10(float(x+1), float(y), 0.f), p01(float(x), float(y+1), 0.f), p11(float(x+1), float(y+1), 0.f);
+                triangles.insert(triangles.end(), { p00, p10, p11, p00, p11, p01 });
+            }
+
+        std::vector<Ray> rays;
+        for (unsigned y=1; y<gridSize; ++y)
+            for (unsigned x=1; x<gridSize; ++x) {
+                rays.push_back({ Float3(float(x), float(y), 5.f), Float3(float(x), float(y), -5.f) });                     // through a vertex
+                rays.push_back({ Float3(float(x) + 0.5f, float(y), -5.f), Float3(float(x) + 0.5f, float(y), 5.f) });      // along a horizontal edge
+                rays.push_back({ Float3(float(x) + 0.25f, float(y) + 0.25f, 5.f), Float3(float(x) + 0.25f, float(y) + 0.25f, -5.f) });   // along a diagonal edge
+                rays.push_back({ Float3(float(x) + 0.1f, float(y) + 0.2f, 3.f), Float3(float(x) - 0.1f, float(y) - 0.2f, -3.f) });         // slanted, through a vertex
+            }
+
+        std::vector<float> results(triangles.size()/3);
+        for (const auto& ray:rays) {
+            RayVsTriangles(MakeIteratorRange(results), ray, MakeIteratorRange(triangles));
+            auto closest = *std::min_element(results.begin(), results.end());
+            REQUIRE(closest != RayIntersection_Miss);
+            REQUIRE(std::abs(closest - 0.5f) < 1e-6f);
+        }
+
+        for (size_t t=0; t<results.size(); ++t) {
+            std::vector<float> rayResults(rays.size());
+            RaysVsTriangle(MakeIteratorRange(rayResults), MakeIteratorRange(rays), triangles[t*3], triangles[t*3+1], triangles[t*3+2]);
+            for (size_t r=0; r<rays.size(); ++r)
+                CheckTriangleResult(rays[r], &triangles[t*3], rayResults[r]);
+        }
+    }
+
+    TEST_CASE( "RayIntersection-Performance", "[math]" )
+    {
+        #if defined(_DEBUG)
+            const size_t count = 16*1024;
+        #else
+            const size_t count = 256*1024;
+        #endif
+        std::mt19937 rng(9823471);
+        std::vector<Ray> rays;
+        std::vector<std::pair<Float3, Float3>> aabbs;
+        std::vector<Float4> spheres;
+        for (size_t c=0; c<count; ++c) {
+            rays.push_back(RandomRay(rng));
+            aabbs.push_back(RandomAABB(rng));
+            spheres.push_back(RandomSphere(rng));
+        }
+        auto triangles = RandomTriangles(rng, count);
+        std::vector<float> results(count);
+        auto ray = rays[0];
+        auto aabb = aabbs[0];
+        auto sphere = spheres[0];
+
+        auto time = [](auto&& fn) {
+            fn();       // (warm up)
+            auto start = std::chrono::steady_clock::now();
+            fn();
+            return std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - start).count();
+        };
+        auto report = [count](const char* name, double packet, double scalar) {
+            std::cout << name << ": " << double(count) / 1e6 / packet << " M tests/s (scalar: " << double(count) / 1e6 / scalar << " M tests/s, " << scalar / packet << "x)" << std::endl;
+        };
+        float alpha;
+
+        report("RayVsAABBs",
+            time([&]() { RayVsAABBs(MakeIteratorRange(results), ray, MakeIteratorRange(aabbs)); }),
+            time([&]() { for (size_t c=0; c<count; ++c) results[c] = RayVsAABB(ray, aabbs[c].first, aabbs[c].second) ? 0.f : RayIntersection_Miss; }));
+        report("RayVsSpheres",
+            time([&]() { RayVsSpheres(MakeIteratorRange(results), ray, MakeIteratorRange(spheres)); }),
+            time([&]() { for (size_t c=0; c<count; ++c) results[c] = RayVsSphere(ray.first - Truncate(spheres[c]), ray.second - Truncate(spheres[c]), spheres[c][3]*spheres[c][3]) ? 0.f : RayIntersection_Miss; }));
+        report("RayVsTriangles",
+            time([&]() { RayVsTriangles(MakeIteratorRange(results), ray, MakeIteratorRange(triangles)); }),
+            time([&]() { for (size_t c=0; c<count; ++c) results[c] = RayVsTriangle(alpha, ray, triangles[c*3], triangles[c*3+1], triangles[c*3+2]) ? alpha : RayIntersection_Miss; }));
+        report("RaysVsAABB",
+            time([&]() { RaysVsAABB(MakeIteratorRange(results), MakeIteratorRange(rays), aabb.first, aabb.second); }),
+            time([&]() { for (size_t c=0; c<count; ++c) results[c] = RayVsAABB(rays[c], aabb.first, aabb.second) ? 0.f : RayIntersection_Miss; }));
+        report("RaysVsSphere",
+            time([&]() { RaysVsSphere(MakeIteratorRange(results), MakeIteratorRange(rays), Truncate(sphere), sphere[3]); }),
+            time([&]() { for (size_t c=0; c<count; ++c) results[c] = RayVsSphere(rays[c].first - Truncate(sphere), rays[c].second - Truncate(sphere), sphere[3]*sphere[3]) ? 0.f : RayIntersection_Miss; }));
+        report("RaysVsTriangle",
+            time([&]() { RaysVsTriangle(MakeIteratorRange(results), MakeIteratorRange(rays), triangles[0], triangles[1], triangles[2]); }),
+            time([&]() { for (size_t c=0; c<count; ++c) results[c] = RayVsTriangle(alpha, rays[c], triangles[0], triangles[1], triangles[2]) ? alpha : RayIntersection_Miss; }));
+    }
+}
@@ -400,6 +400,42 @@ namespace UnitTests
         }
     }
 
+    TEST_CASE( "ThreadPool-ParallelFor", "[osservices]" )
+    {
+        ThreadPool threadPool(4);
+        const unsigned count = 16;
+
+        SECTION("every index is called once")
+        {
+            std::atomic<unsigned> callCounts[count];
+            for (auto& c:callCounts) c.store(0);
+            ParallelFor(threadPool, count, [&callCounts](unsigned c) { ++callCounts[c]; });
+            for (auto& c:callCounts) REQUIRE(c.load() == 1);
+        }
+
+        SECTION("exceptions propagate after all calls complete")
+        {
+            // Calls that throw finish quickly, while the others are still running. ParallelFor must wait
+            // for the slow calls before rethrowing, because they still reference state on this stack frame
+            std::atomic<unsigned> completedCount{0};
+            auto fn = [&completedCount](unsigned c) {
+                if (c == 0 || c == 5) {
+                    ++completedCount;
+                    Throw(std::runtime_error("ParallelFor test exception"));
+                }
+                std::this_thread::sleep_for(20ms);
+                ++completedCount;
+            };
+            REQUIRE_THROWS(ParallelFor(threadPool, count, fn));
+            REQUIRE(completedCount.load() == count);
+
+            // also when only a pool task throws
+            completedCount.store(0);
+            REQUIRE_THROWS(ParallelFor(threadPool, count, [&fn](unsigned c) { fn(c+1); }));
+            REQUIRE(completedCount.load() == count);
+        }
+    }
+
 	struct YieldToFutureItem
 	{
 		std::shared_future<unsigned> _rootFuture;
@@ -0,0 +1,274 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../../../RenderCore/GeoProc/AnimationCompression.h"
+#include "../../../RenderCore/GeoProc/NascentCommandStream.h"
+#include "../../../RenderCore/Assets/AnimationSampling.h"
+#include "../../../RenderCore/Assets/RawAnimationCurve.h"
+#include "../../../Assets/BlockSerializer.h"
+#include "../../../Math/Quaternion.h"
+#include "catch2/catch_test_macros.hpp"
+#include <vector>
+#include <random>
+#include <sstream>
+#include <cmath>
+#include <cstring>
+#include <functional>
+
+using namespace RenderCore;
+using namespace RenderCore::Assets;
+
+namespace UnitTests
+{
+	namespace Internal
+	{
+		struct CompressionTestSet
+		{
+			std::unique_ptr<uint8_t[], PODAlignedDeletor> _block;
+			std::vector<AnimationSet::ParameterBindingRules> _bindingRules;
+			std::vector<float> _defaults;		// output block with default values (identity rotations, unit scales)
+
+			const AnimationSet& Get() const { return *(const AnimationSet*)::Assets::Block_GetFirstObject(_block.get()); }
+
+			CompressionTestSet(GeoProc::NascentAnimationSet& nascent)
+			{
+				::Assets::BlockSerializer serializer;
+				SerializationOperator(serializer, nascent);
+				_block = serializer.AsMemoryBlock();
+				::Assets::Block_Initialize(_block.get());
+
+				for (const auto& p:Get().GetOutputInterface()) {
+					_bindingRules.push_back({(unsigned)_defaults.size()*(unsigned)sizeof(float), p._samplerType});
+					switch (p._samplerType) {
+					case AnimSamplerType::Float1: _defaults.push_back((p._component == AnimSamplerComponent::Scale) ? 1.f : 0.f); break;
+					case AnimSamplerType::Float3: _defaults.insert(_defaults.end(), 3, 0.f); break;
+					case AnimSamplerType::Quaternion: _defaults.push_back(1.f); _defaults.insert(_defaults.end(), 3, 0.f); break;
+					default: _defaults.insert(_defaults.end(), 4, 0.f); break;
+					}
+				}
+			}
+		};
+
+		static RawAnimationCurve MakeSampledCurve(unsigned frameCount, unsigned keySpacing, unsigned dimension, std::function<void(float*, unsigned)> fn)
+		{
+			// keys either on every frame (no time markers) or every "keySpacing" frames (always including the last frame)
+			SerializableVector<uint16_t> timeMarkers;
+			SerializableVector<uint8_t> keyData;
+			CurveDesc desc;
+			desc._timeMarkerType = (keySpacing > 1) ? TimeMarkerType::FrameIndices : TimeMarkerType::None;
+			desc._elementStride = dimension*sizeof(float);
+			desc._elementFormat = (dimension == 1) ? Format::R32_FLOAT : ((dimension == 3) ? Format::R32G32B32_FLOAT : Format::R32G32B32A32_FLOAT);
+			for (unsigned f=0; f<frameCount; f+=std::min(keySpacing, std::max(frameCount-1-f, 1u))) {
+				if (keySpacing > 1) timeMarkers.push_back((uint16_t)f);
+				float value[4];
+				fn(value, f);
+				keyData.insert(keyData.end(), (const uint8_t*)value, (const uint8_t*)&value[dimension]);
+			}
+			return RawAnimationCurve{std::move(timeMarkers), std::move(keyData), desc};
+		}
+
+		static void AddCompressionTestDrivers(
+			GeoProc::NascentAnimationSet::NascentBlock& block, std::mt19937& rng,
+			unsigned jointCount, unsigned frameCount)
+		{
+			auto random = [&rng](float min, float max) { return (float)std::uniform_real_distribution<>(min, max)(rng); };
+			for (unsigned j=0; j<jointCount; ++j) {
+				auto name = "joint" + std::to_string(j);
+				unsigned keySpacing = (j%3) ? 1 : 2;
+
+				// smooth motion, with a little noise on some joints
+				float amplitude = random(0.05f, 0.5f), frequency = random(0.02f, 0.2f), phase = random(0.f, 6.f), noise = (j%4==1) ? 0.0005f : 0.f;
+				block.AddAnimationDriver(
+					name, AnimSamplerComponent::Translation, AnimSamplerType::Float3,
+					block.AddCurve(MakeSampledCurve(frameCount, keySpacing, 3,
+						[&](float* dst, unsigned f) {
+							dst[0] = amplitude * std::sin(frequency*f + phase) + random(-noise, noise);
+							dst[1] = 0.5f * amplitude * std::cos(0.5f*frequency*f);
+							dst[2] = (j%2) ? 0.25f : amplitude * frequency * f;
+						})),
+					CurveInterpolationType::Linear);
+
+				Float3 axis{random(-1.f, 1.f), random(-1.f, 1.f), random(-1.f, 1.f)};
+				axis = Normalize(axis);
+				float angleScale = random(0.2f, 2.f);
+				block.AddAnimationDriver(
+					name, AnimSamplerComponent::Rotation, AnimSamplerType::Quaternion,
+					block.AddCurve(MakeSampledCurve(frameCount, keySpacing, 4,
+						[&](float* dst, unsigned f) {
+							float angle = angleScale * std::sin(frequency*f + phase) + 0.5f;
+							float sign = ((f/7)%3 == 1) ? -1.f : 1.f;		// (q & -q are the same rotation)
+							dst[0] = sign * std::cos(0.5f*angle);
+							for (unsigned c=0; c<3; ++c) dst[c+1] = sign * axis[c] * std::sin(0.5f*angle);
+						})),
+					CurveInterpolationType::Linear);
+
+				// scale is constant (at the default) on most joints
+				float scale = (j%5==3) ? 1.2f : 1.f;
+				block.AddAnimationDriver(
+					name, AnimSamplerComponent::Scale, AnimSamplerType::Float1,
+					block.AddCurve(MakeSampledCurve(frameCount, keySpacing, 1,
+						[&](float* dst, unsigned f) { dst[0] = scale + ((j%5==4) ? 0.2f * std::sin(frequency*f) : 0.f); })),
+					CurveInterpolationType::Linear);
+			}
+
+			// a stepped parameter without a spatial meaning
+			block.AddAnimationDriver(
+				std::string{"visibility"}, AnimSamplerComponent::None, AnimSamplerType::Float4,
+				block.AddCurve(MakeSampledCurve(frameCount, 1, 4,
+					[&](float* dst, unsigned f) { dst[0] = float((f/10)%2); dst[1] = dst[2] = 0.f; dst[3] = 1.f; })),
+				CurveInterpolationType::None);
+		}
+
+		static GeoProc::NascentAnimationSet BuildCompressionTestSet(std::mt19937& rng)
+		{
+			GeoProc::NascentAnimationSet result;
+			{
+				GeoProc::NascentAnimationSet::BlockSpan spans[] { {0, 120} };
+				auto blocks = result.AddAnimation("idle", MakeIteratorRange(spans), 30.f);
+				AddCompressionTestDrivers(blocks[0], rng, 12, 120);
+				Float3 constantValue{0.f, 1.f, 0.f};
+				blocks[0].AddConstantDriver(std::string{"root"}, AnimSamplerComponent::Translation, AnimSamplerType::Float3, &constantValue, sizeof(constantValue), Format::R32G32B32_FLOAT);
+			}
+			{
+				GeoProc::NascentAnimationSet::BlockSpan spans[] { {0, 61}, {61, 122} };
+				auto blocks = result.AddAnimation("walk", MakeIteratorRange(spans), 24.f);
+				for (unsigned b=0; b<2; ++b)
+					AddCompressionTestDrivers(blocks[b], rng, 9, 61);
+			}
+			return result;
+		}
+
+		static double OutputError(const float* A, const float* B, AnimSamplerComponent component, AnimSamplerType samplerType, float shellDistance)
+		{
+			if (samplerType == AnimSamplerType::Quaternion) {
+				// (in double precision, since acos is poorly conditioned for small angles)
+				double aMag = 0., bMag = 0., diff = 0., sum = 0.;
+				for (unsigned c=0; c<4; ++c) { aMag += double(A[c])*A[c]; bMag += double(B[c])*B[c]; }
+				aMag = std::sqrt(aMag); bMag = std::sqrt(bMag);
+				for (unsigned c=0; c<4; ++c) {
+					diff += (A[c]/aMag - B[c]/bMag) * (A[c]/aMag - B[c]/bMag);
+					sum += (A[c]/aMag + B[c]/bMag) * (A[c]/aMag + B[c]/bMag);
+				}
+				double angle = 4.0 * std::asin(std::min(0.5 * std::sqrt(std::min(diff, sum)), 1.0));
+				return 2.0 * shellDistance * std::sin(0.5 * angle);
+			}
+			unsigned count = (samplerType == AnimSamplerType::Float1) ? 1 : ((samplerType == AnimSamplerType::Float3) ? 3 : 4);
+			double d2 = 0.;
+			for (unsigned c=0; c<count; ++c) d2 += (A[c]-B[c])*(A[c]-B[c]);
+			return std::sqrt(d2) * ((component == AnimSamplerComponent::Scale) ? shellDistance : 1.0);
+		}
+
+		static bool IsSpatial(AnimSamplerComponent component, AnimSamplerType samplerType)
+		{
+			return (samplerType == AnimSamplerType::Float3 && (component == AnimSamplerComponent::Translation || component == AnimSamplerComponent::TranslationGeoSpace))
+				|| (samplerType == AnimSamplerType::Quaternion && component == AnimSamplerComponent::Rotation)
+				|| ((samplerType == AnimSamplerType::Float1 || samplerType == AnimSamplerType::Float3) && component == AnimSamplerComponent::Scale);
+		}
+
+		static void CompareCompressedOutput(
+			const CompressionTestSet& original, const CompressionTestSet& compressed,
+			const GeoProc::AnimationCompressionSettings& settings,
+			std::pair<uint64_t, float> animation)
+		{
+			const auto& interf = original.Get().GetOutputInterface();
+			REQUIRE(interf.size() == compressed.Get().GetOutputInterface().size());
+
+			AnimationSamplingContext context(compressed.Get(), MakeIteratorRange(compressed._bindingRules));
+			std::vector<float> expected, actual, sampled;
+			// sample at fractional frames; the original curves without time markers can't be sampled past their last key
+			for (float t=0.f; t<animation.second; t+=1.f/97.f) {
+				expected = original._defaults; actual = compressed._defaults; sampled = compressed._defaults;
+				AnimationState state;
+				state._animation = animation.first;
+				state._time = t;
+				original.Get().CalculateOutput(MakeIteratorRange(expected), state, MakeIteratorRange(original._bindingRules));
+				compressed.Get().CalculateOutput(MakeIteratorRange(actual), state, MakeIteratorRange(compressed._bindingRules));
+				context.CalculateOutput(MakeIteratorRange(sampled), sampled.size()*sizeof(float), MakeIteratorRange(&state, &state+1));
+
+				for (unsigned p=0; p<interf.size(); ++p) {
+					auto offset = original._bindingRules[p]._outputOffset / sizeof(float);
+					auto error = OutputError(&expected[offset], &actual[offset], interf[p]._component, interf[p]._samplerType, settings._shellDistance);
+					auto budget = IsSpatial(interf[p]._component, interf[p]._samplerType) ? settings._maxPositionalError : settings._maxScalarError;
+					INFO("Parameter " << p << " at time " << t);
+					// (small allowance for slerp and float precision between the integer frames where errors were measured)
+					REQUIRE(error <= budget * 1.01 + 1e-6);
+					REQUIRE(OutputError(&actual[offset], &sampled[offset], interf[p]._component, interf[p]._samplerType, 1.f) <= 1e-4);
+				}
+			}
+		}
+	}
+
+	TEST_CASE( "AnimationCompression-ErrorBound", "[rendercore_assets]" )
+	{
+		std::mt19937 rng(89127431);
+		auto nascent = Internal::BuildCompressionTestSet(rng);
+		Internal::CompressionTestSet original(nascent);
+
+		const std::pair<uint64_t, float> animations[] { { Hash64("idle"), 119.f/30.f }, { Hash64("walk"), 121.f/24.f } };
+
+		SECTION("Default settings")
+		{
+			GeoProc::AnimationCompressionSettings settings;
+			auto compressedNascent = nascent;
+			auto report = GeoProc::CompressAnimationSet(compressedNascent, settings);
+			Internal::CompressionTestSet compressed(compressedNascent);
+
+			REQUIRE(report._animations.size() == 2);
+			for (const auto& a:report._animations) {
+				REQUIRE(a._compressedSize * 2 < a._originalSize);
+				REQUIRE(a._keyCount < a._originalKeyCount);
+				REQUIRE(a._maxPositionalError <= settings._maxPositionalError);
+				REQUIRE(a._maxScalarError <= settings._maxScalarError);
+				REQUIRE(a._constantTracks != 0);
+				REQUIRE(a._strippedTracks == 0);
+				REQUIRE(a._uncompressedTracks == 0);
+			}
+			for (auto c:compressedNascent.GetCurves())
+				REQUIRE(c.Desc()._flags & CurveDesc::Flags::BitPackedKeys);
+
+			for (const auto& a:animations)
+				Internal::CompareCompressedOutput(original, compressed, settings, a);
+
+			std::stringstream str;
+			SerializationOperator(str, report);
+			REQUIRE(str.str().find("idle") != std::string::npos);
+		}
+
+		SECTION("Tight budget")
+		{
+			GeoProc::AnimationCompressionSettings settings;
+			settings._maxPositionalError = 1e-6f;
+			settings._maxScalarError = 1e-6f;
+			auto compressedNascent = nascent;
+			auto report = GeoProc::CompressAnimationSet(compressedNascent, settings);
+			Internal::CompressionTestSet compressed(compressedNascent);
+			for (const auto& a:animations)
+				Internal::CompareCompressedOutput(original, compressed, settings, a);
+		}
+
+		SECTION("Strip defaults")
+		{
+			// constant tracks that match the default pose are removed entirely
+			GeoProc::AnimationCompressionSettings settings;
+			std::vector<GeoProc::AnimationParameterDefault> defaults;
+			for (unsigned j=0; j<12; ++j)
+				defaults.push_back({Hash64("joint" + std::to_string(j)), AnimSamplerComponent::Scale, {1.f, 0.f, 0.f, 0.f}});
+			defaults.push_back({Hash64("root"), AnimSamplerComponent::Translation, {0.f, 1.f, 0.f, 0.f}});
+
+			auto compressedNascent = nascent;
+			auto report = GeoProc::CompressAnimationSet(compressedNascent, settings, MakeIteratorRange(defaults));
+			Internal::CompressionTestSet compressed(compressedNascent);
+			for (auto* testSet:{&original, &compressed}) {
+				auto p = testSet->Get().FindParameter(Hash64("root"), AnimSamplerComponent::Translation);
+				testSet->_defaults[testSet->_bindingRules[p]._outputOffset/sizeof(float)+1] = 1.f;
+			}
+
+			for (const auto& a:report._animations)
+				REQUIRE(a._strippedTracks != 0);
+			REQUIRE(compressedNascent.GetConstantDrivers().size() < nascent.GetConstantDrivers().size() + report._animations[0]._constantTracks + report._animations[1]._constantTracks);
+			for (const auto& a:animations)
+				Internal::CompareCompressedOutput(original, compressed, settings, a);
+		}
+	}
+}
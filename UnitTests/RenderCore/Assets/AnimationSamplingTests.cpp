@@ -0,0 +1,321 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../../../RenderCore/Assets/AnimationSampling.h"
+#include "../../../RenderCore/Assets/RawAnimationCurve.h"
+#include "../../../RenderCore/GeoProc/NascentCommandStream.h"
+#include "../../../Assets/BlockSerializer.h"
+#include "../../../Math/Quaternion.h"
+#include "../../../Math/Transformations.h"
+#include "../../../Utility/Threading/CompletionThreadPool.h"
+#include "catch2/catch_test_macros.hpp"
+#include <vector>
+#include <random>
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <cstring>
+
+using namespace RenderCore;
+using namespace RenderCore::Assets;
+
+namespace UnitTests
+{
+	namespace Internal
+	{
+		struct CurveBuilder
+		{
+			std::mt19937& _rng;
+
+			float RandomFloat(float min=-10.f, float max=10.f) { return (float)std::uniform_real_distribution<>(min, max)(_rng); }
+
+			SerializableVector<uint16_t> TimeMarkers(TimeMarkerType markerType, unsigned frameCount)
+			{
+				SerializableVector<uint16_t> result;
+				if (markerType != TimeMarkerType::FrameIndices) return result;
+				// irregular key spacing, with the first key sometimes after the start of the block
+				unsigned f = std::uniform_int_distribution<>(0, 1)(_rng);
+				while (f < frameCount) {
+					result.push_back((uint16_t)f);
+					f += std::uniform_int_distribution<>(1, 4)(_rng);
+				}
+				return result;
+			}
+
+			std::vector<Quaternion> QuaternionKeys(unsigned keyCount)
+			{
+				// a random walk, so neighbouring keys are close (as they would be in real data). Signs are flipped
+				// randomly to check that interpolation takes the shorter path
+				std::vector<Quaternion> result;
+				Quaternion q = cml::normalize(Quaternion{RandomFloat(-1.f, 1.f), RandomFloat(-1.f, 1.f), RandomFloat(-1.f, 1.f), RandomFloat(-1.f, 1.f)});
+				for (unsigned c=0; c<keyCount; ++c) {
+					Quaternion d{1.f, RandomFloat(-.2f, .2f), RandomFloat(-.2f, .2f), RandomFloat(-.2f, .2f)};
+					q = cml::normalize(q * cml::normalize(d));
+					result.push_back((std::uniform_int_distribution<>(0, 3)(_rng) == 0) ? Quaternion(-q) : q);
+				}
+				return result;
+			}
+
+			RawAnimationCurve MakeCurve(AnimSamplerType samplerType, TimeMarkerType markerType, unsigned frameCount, bool quantize = false, bool tangents = false)
+			{
+				auto timeMarkers = TimeMarkers(markerType, frameCount);
+				unsigned keyCount = (markerType == TimeMarkerType::FrameIndices) ? (unsigned)timeMarkers.size() : frameCount;
+
+				CurveDesc desc;
+				desc._timeMarkerType = markerType;
+				SerializableVector<uint8_t> keyData;
+				auto append = [&keyData](const void* data, size_t size) { keyData.insert(keyData.end(), (const uint8_t*)data, (const uint8_t*)PtrAdd(data, size)); };
+
+				if (samplerType == AnimSamplerType::Quaternion) {
+					desc._elementFormat = Format::R32G32B32A32_FLOAT;
+					desc._elementStride = sizeof(Quaternion);
+					for (const auto& q:QuaternionKeys(keyCount)) append(&q, sizeof(q));
+				} else if (quantize) {
+					// R16_UNORM elements after a dequantization block. Leave out one element to check the defaulting to the min value
+					assert(samplerType == AnimSamplerType::Float3);
+					CurveDequantizationBlock dequantBlock;
+					dequantBlock._elementFlags = (1<<0) | (1<<2);
+					for (unsigned c=0; c<3; ++c) { dequantBlock._mins[c] = RandomFloat(-10.f, 0.f); dequantBlock._maxs[c] = RandomFloat(0.f, 10.f); }
+					dequantBlock._mins[3] = dequantBlock._maxs[3] = 0.f;
+					append(&dequantBlock, sizeof(dequantBlock));
+					for (unsigned k=0; k<keyCount; ++k) {
+						uint16_t values[2] = { (uint16_t)std::uniform_int_distribution<>(0, 0xffff)(_rng), (uint16_t)std::uniform_int_distribution<>(0, 0xffff)(_rng) };
+						append(values, sizeof(values));
+					}
+					desc._flags |= CurveDesc::Flags::HasDequantBlock;
+					desc._elementFormat = Format::R16_UNORM;
+					desc._elementStride = 2*sizeof(uint16_t);
+				} else {
+					unsigned dimension = (samplerType == AnimSamplerType::Float1) ? 1 : ((samplerType == AnimSamplerType::Float3) ? 3 : 4);
+					desc._elementFormat = (dimension == 1) ? Format::R32_FLOAT : ((dimension == 3) ? Format::R32G32B32_FLOAT : Format::R32G32B32A32_FLOAT);
+					unsigned elementsPerKey = tangents ? 3 : 1;
+					desc._elementStride = dimension*sizeof(float)*elementsPerKey;
+					if (tangents) desc._flags |= CurveDesc::Flags::HasInTangent | CurveDesc::Flags::HasOutTangent;
+					for (unsigned k=0; k<keyCount*elementsPerKey*dimension; ++k) {
+						float f = RandomFloat();
+						append(&f, sizeof(f));
+					}
+				}
+
+				return RawAnimationCurve{std::move(timeMarkers), std::move(keyData), desc};
+			}
+		};
+
+		struct TestAnimationSet
+		{
+			std::unique_ptr<uint8_t[], PODAlignedDeletor> _block;
+			std::vector<AnimationSet::ParameterBindingRules> _bindingRules;
+			size_t _outputBlockSize = 0;
+
+			const AnimationSet& Get() const { return *(const AnimationSet*)::Assets::Block_GetFirstObject(_block.get()); }
+
+			TestAnimationSet(GeoProc::NascentAnimationSet& nascent)
+			{
+				::Assets::BlockSerializer serializer;
+				SerializationOperator(serializer, nascent);
+				_block = serializer.AsMemoryBlock();
+				::Assets::Block_Initialize(_block.get());
+
+				for (const auto& p:Get().GetOutputInterface()) {
+					_bindingRules.push_back({(unsigned)_outputBlockSize, p._samplerType});
+					switch (p._samplerType) {
+					case AnimSamplerType::Float1: _outputBlockSize += sizeof(float); break;
+					case AnimSamplerType::Float3: _outputBlockSize += sizeof(Float3); break;
+					case AnimSamplerType::Float4: _outputBlockSize += sizeof(Float4); break;
+					case AnimSamplerType::Float4x4: _outputBlockSize += sizeof(Float4x4); break;
+					case AnimSamplerType::Quaternion: _outputBlockSize += sizeof(Quaternion); break;
+					}
+				}
+			}
+		};
+
+		static void AddJointDrivers(
+			GeoProc::NascentAnimationSet::NascentBlock& block, CurveBuilder& builder,
+			unsigned jointCount, unsigned frameCount)
+		{
+			for (unsigned j=0; j<jointCount; ++j) {
+				auto name = "joint" + std::to_string(j);
+				auto markerType = (j%3) ? TimeMarkerType::FrameIndices : TimeMarkerType::None;
+				block.AddAnimationDriver(
+					name, AnimSamplerComponent::Translation, AnimSamplerType::Float3,
+					block.AddCurve(builder.MakeCurve(AnimSamplerType::Float3, markerType, frameCount, (j%4)==1)),
+					CurveInterpolationType::Linear);
+				block.AddAnimationDriver(
+					name, AnimSamplerComponent::Rotation, AnimSamplerType::Quaternion,
+					block.AddCurve(builder.MakeCurve(AnimSamplerType::Quaternion, markerType, frameCount)),
+					CurveInterpolationType::Linear);
+				block.AddAnimationDriver(
+					name, AnimSamplerComponent::Scale, AnimSamplerType::Float1,
+					block.AddCurve(builder.MakeCurve(AnimSamplerType::Float1, markerType, frameCount)),
+					(j%5)==2 ? CurveInterpolationType::None : CurveInterpolationType::Linear);
+			}
+		}
+
+		static GeoProc::NascentAnimationSet BuildTestAnimationSet(std::mt19937& rng)
+		{
+			GeoProc::NascentAnimationSet result;
+			CurveBuilder builder{rng};
+
+			{
+				// 2 blocks, with the same parameters driven in each
+				GeoProc::NascentAnimationSet::BlockSpan spans[] { {0, 40}, {40, 90} };
+				auto blocks = result.AddAnimation("walk", MakeIteratorRange(spans), 30.f);
+				for (unsigned b=0; b<2; ++b) {
+					auto frameCount = spans[b]._endFrame - spans[b]._beginFrame;
+					AddJointDrivers(blocks[b], builder, 9, frameCount);
+					blocks[b].AddAnimationDriver(
+						std::string{"extra"}, AnimSamplerComponent::None, AnimSamplerType::Float4,
+						blocks[b].AddCurve(builder.MakeCurve(AnimSamplerType::Float4, TimeMarkerType::FrameIndices, frameCount)),
+						b ? CurveInterpolationType::None : CurveInterpolationType::Linear);
+					blocks[b].AddAnimationDriver(		// (Bezier curves aren't handled by the batched paths)
+						std::string{"bezier"}, AnimSamplerComponent::Translation, AnimSamplerType::Float3,
+						blocks[b].AddCurve(builder.MakeCurve(AnimSamplerType::Float3, TimeMarkerType::FrameIndices, frameCount, false, true)),
+						CurveInterpolationType::Bezier);
+				}
+			}
+
+			{
+				GeoProc::NascentAnimationSet::BlockSpan spans[] { {0, 65} };
+				auto blocks = result.AddAnimation("run", MakeIteratorRange(spans), 24.f);
+				AddJointDrivers(blocks[0], builder, 7, 65);
+				Float3 constantValue{1.f, 2.f, 3.f};
+				blocks[0].AddConstantDriver(std::string{"joint8"}, AnimSamplerComponent::Translation, AnimSamplerType::Float3, &constantValue, sizeof(constantValue), Format::R32G32B32_FLOAT);
+				Quaternion constantRotation{0.f, 1.f, 0.f, 0.f};
+				blocks[0].AddConstantDriver(std::string{"joint8"}, AnimSamplerComponent::Rotation, AnimSamplerType::Quaternion, &constantRotation, sizeof(constantRotation), Format::R32G32B32A32_FLOAT);
+			}
+
+			return result;
+		}
+
+		static bool EquivalentOutput(IteratorRange<const float*> lhs, IteratorRange<const float*> rhs, float tolerance)
+		{
+			for (unsigned c=0; c<lhs.size(); ++c)
+				if (std::abs(lhs[c] - rhs[c]) > tolerance * std::max(1.f, std::abs(lhs[c])))
+					return false;
+			return true;
+		}
+	}
+
+	TEST_CASE( "AnimationSampling-MatchesCalculateOutput", "[rendercore_assets]" )
+	{
+		std::mt19937 rng(6238721);
+		auto nascent = Internal::BuildTestAnimationSet(rng);
+		Internal::TestAnimationSet testSet(nascent);
+		const auto& animSet = testSet.Get();
+
+		// leave one parameter unbound
+		auto bindingRules = testSet._bindingRules;
+		bindingRules[animSet.FindParameter(Hash64("joint3"), AnimSamplerComponent::Translation)]._outputOffset = ~0u;
+
+		AnimationSamplingContext context(animSet, bindingRules);
+		AnimationSamplingContext threadedContext(animSet, bindingRules);
+		REQUIRE(context.GetFallbackDriverCount() == 2);		// the Bezier curves
+
+		ThreadPool threadPool(4);
+		const unsigned instanceCount = 77;
+		const auto outputFloats = testSet._outputBlockSize / sizeof(float);
+		std::vector<AnimationState> states(instanceCount);
+		std::vector<float> timeScales(instanceCount);
+		const uint64_t animations[] { Hash64("walk"), Hash64("run"), Hash64("unknown"), 0 };
+		for (unsigned c=0; c<instanceCount; ++c) {
+			states[c]._animation = animations[std::uniform_int_distribution<>(0, 3)(rng)];
+			states[c]._time = (float)std::uniform_real_distribution<>(0.f, 2.f)(rng);
+			timeScales[c] = (float)std::uniform_real_distribution<>(0.25f, 3.f)(rng);
+		}
+
+		std::vector<float> expected(instanceCount*outputFloats), batched(instanceCount*outputFloats), threaded(instanceCount*outputFloats);
+		for (unsigned frame=0; frame<200; ++frame) {
+			std::fill(expected.begin(), expected.end(), 0.f);
+			std::fill(batched.begin(), batched.end(), 0.f);
+			std::fill(threaded.begin(), threaded.end(), 0.f);
+
+			for (unsigned c=0; c<instanceCount; ++c)
+				animSet.CalculateOutput(MakeIteratorRange(&expected[c*outputFloats], &expected[(c+1)*outputFloats]), states[c], MakeIteratorRange(bindingRules));
+			context.CalculateOutput(MakeIteratorRange(batched), testSet._outputBlockSize, MakeIteratorRange(states));
+			threadedContext.CalculateOutput(MakeIteratorRange(threaded), testSet._outputBlockSize, MakeIteratorRange(states), &threadPool);
+
+			for (unsigned c=0; c<instanceCount; ++c) {
+				INFO("Instance " << c << " at frame " << frame);
+				REQUIRE(Internal::EquivalentOutput(
+					MakeIteratorRange(&expected[c*outputFloats], &expected[(c+1)*outputFloats]),
+					MakeIteratorRange(&batched[c*outputFloats], &batched[(c+1)*outputFloats]),
+					1e-5f));
+			}
+			REQUIRE(std::memcmp(batched.data(), threaded.data(), batched.size()*sizeof(float)) == 0);
+
+			// Mostly advance forward, with animations looping and occasionally jumping back or switching animation
+			// (loop before the end of the shortest animation, because curves without time markers can't be sampled past their last key)
+			for (unsigned c=0; c<instanceCount; ++c) {
+				states[c]._time += timeScales[c] / 60.f;
+				if (states[c]._time > 2.6f) states[c]._time -= 2.6f;
+				if (std::uniform_int_distribution<>(0, 99)(rng) == 0)
+					states[c]._time = (float)std::uniform_real_distribution<>(0.f, 2.6f)(rng);
+				if (std::uniform_int_distribution<>(0, 149)(rng) == 0)
+					states[c]._animation = animations[std::uniform_int_distribution<>(0, 3)(rng)];
+			}
+
+			if (frame == 100) {
+				context.ResetCursors();
+				std::shuffle(states.begin(), states.end(), rng);		// cursors are per index, so this just makes the next sample slower
+			}
+		}
+	}
+
+	TEST_CASE( "AnimationSampling-Performance", "[rendercore_assets]" )
+	{
+		std::mt19937 rng(8572634);
+		GeoProc::NascentAnimationSet nascent;
+		{
+			Internal::CurveBuilder builder{rng};
+			GeoProc::NascentAnimationSet::BlockSpan spans[] { {0, 300} };
+			auto blocks = nascent.AddAnimation("idle", MakeIteratorRange(spans), 30.f);
+			Internal::AddJointDrivers(blocks[0], builder, 64, 300);
+		}
+		Internal::TestAnimationSet testSet(nascent);
+		const auto& animSet = testSet.Get();
+		AnimationSamplingContext context(animSet, testSet._bindingRules);
+		ThreadPool threadPool(std::max(1u, std::thread::hardware_concurrency()-1));
+
+		const unsigned frameCount = 120;
+		auto toMs = [](auto duration) { return std::chrono::duration_cast<std::chrono::microseconds>(duration).count() / 1000.f; };
+		for (unsigned characterCount:{1u, 100u, 1000u}) {
+			std::vector<AnimationState> states(characterCount);
+			for (auto& s:states) {
+				s._animation = Hash64("idle");
+				s._time = (float)std::uniform_real_distribution<>(0.f, 9.f)(rng);
+			}
+			std::vector<uint8_t> outputs(characterCount*testSet._outputBlockSize, 0);
+			context.ResetCursors();
+
+			auto start = std::chrono::steady_clock::now();
+			for (unsigned f=0; f<frameCount; ++f) {
+				for (unsigned c=0; c<characterCount; ++c) {
+					auto* o = PtrAdd(outputs.data(), c*testSet._outputBlockSize);
+					animSet.CalculateOutput(MakeIteratorRange(o, PtrAdd(o, testSet._outputBlockSize)), states[c], MakeIteratorRange(testSet._bindingRules));
+				}
+				for (auto& s:states) s._time = std::fmod(s._time + 1.f/60.f, 9.f);
+			}
+			auto perCharacterTime = std::chrono::steady_clock::now() - start;
+
+			start = std::chrono::steady_clock::now();
+			for (unsigned f=0; f<frameCount; ++f) {
+				context.CalculateOutput(MakeIteratorRange(outputs), testSet._outputBlockSize, MakeIteratorRange(states));
+				for (auto& s:states) s._time = std::fmod(s._time + 1.f/60.f, 9.f);
+			}
+			auto contextTime = std::chrono::steady_clock::now() - start;
+
+			start = std::chrono::steady_clock::now();
+			for (unsigned f=0; f<frameCount; ++f) {
+				context.CalculateOutput(MakeIteratorRange(outputs), testSet._outputBlockSize, MakeIteratorRange(states), &threadPool);
+				for (auto& s:states) s._time = std::fmod(s._time + 1.f/60.f, 9.f);
+			}
+			auto threadedTime = std::chrono::steady_clock::now() - start;
+
+			std::cout << "Animation sampling for " << characterCount << " characters of 64 joints (" << frameCount << " frames)" << std::endl;
+			std::cout << "  AnimationSet::CalculateOutput:    " << toMs(perCharacterTime) << "ms" << std::endl;
+			std::cout << "  sampling context:                 " << toMs(contextTime) << "ms" << std::endl;
+			std::cout << "  sampling context & threaded:      " << toMs(threadedTime) << "ms" << std::endl;
+		}
+	}
+}
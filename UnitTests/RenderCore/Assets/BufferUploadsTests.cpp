@@ -7,6 +7,7 @@
 #include "../../UnitTestHelper.h"
 #include "../../../RenderCore/BufferUploads/IBufferUploads.h"
 #include "../../../RenderCore/BufferUploads/Metrics.h"
+#include "../../../RenderCore/BufferUploads/BatchedResources.h"
 #include "../../../RenderCore/Assets/TextureLoaders.h"
 #include "../../../RenderCore/ResourceDesc.h"
 #include "../../../RenderCore/Format.h"
@@ -818,5 +819,185 @@ namespace UnitTests
 			REQUIRE(layer.GetEntryCount() == 0);
 		}
 	}
+
+	TEST_CASE( "BufferUploads-DefragPolicySimulation", "[rendercore_techniques]" )
+	{
+		// Drive the defrag planner against a CPU-only model of BatchedResources, with a workload that grows and
+		// shrinks over time. We check that the per-frame budget is respected, that the heaps remain consistent, and that
+		// defragging actually reduces the number of pages we're holding onto
+		using namespace RenderCore::BufferUploads;
+		const unsigned pageSize = 1024*1024;
+		const unsigned framesPerOperation = 3;		// latency for the GPU copy & clients to process the reposition event
+		#if defined(_DEBUG)
+			const unsigned frameCount = 20*1000;
+		#else
+			const unsigned frameCount = 60*60*60;		// an hour at 60fps
+		#endif
+
+		struct SimHeap
+		{
+			SpanningHeap<uint32_t> _heap;
+			unsigned _allocatedSpace = 0;
+			uint64_t _hashLastDefrag = 0;
+			bool _locked = false;
+			SimHeap(unsigned size) : _heap(size) {}
+		};
+		struct SimAllocation { SimHeap* _heap; unsigned _offset, _size; };
+		struct SimResults { double _averageExcessPages = 0.0; unsigned _operationCount = 0; size_t _bytesMoved = 0; };
+
+		auto runSimulation = [&](const BatchedResourcesDefragPolicy& policy) {
+			std::mt19937 rng(6723462);
+			std::vector<std::unique_ptr<SimHeap>> heaps;
+			std::vector<SimAllocation> allocations;
+			size_t liveBytes = 0;
+
+			// best fit amongst the unlocked heaps, as per BatchedResources::Allocate
+			auto allocate = [&](unsigned size) -> SimAllocation {
+				SimHeap* bestHeap = nullptr;
+				unsigned bestHeapLargestBlock = ~0u;
+				for (auto i=heaps.rbegin(); i!=heaps.rend(); ++i) {
+					if ((*i)->_locked) continue;
+					auto largestBlock = (*i)->_heap.CalculateLargestFreeBlock();
+					if (largestBlock >= size && largestBlock < bestHeapLargestBlock) {
+						bestHeap = i->get();
+						bestHeapLargestBlock = largestBlock;
+					}
+				}
+				if (!bestHeap) {
+					heaps.push_back(std::make_unique<SimHeap>(pageSize));
+					bestHeap = heaps.back().get();
+				}
+				auto offset = bestHeap->_heap.Allocate(size);
+				REQUIRE(offset != ~0u);
+				bestHeap->_allocatedSpace += size;
+				return {bestHeap, offset, size};
+			};
+			auto removeIfEmpty = [&heaps](SimHeap* heap) {
+				if (heap->_allocatedSpace || heap->_locked) return;
+				auto i = std::find_if(heaps.begin(), heaps.end(), [heap](const auto& h) { return h.get() == heap; });
+				heaps.erase(i);
+			};
+
+			struct ActiveOperation { SimHeap* _srcHeap; std::vector<RepositionStep> _steps; SimAllocation _uberBlock; unsigned _completionFrame; };
+			std::optional<ActiveOperation> activeOperation;
+			SimResults result;
+			double excessPagesSum = 0.0;
+			std::uniform_real_distribution<float> logSizeDistribution(std::log(256.f), std::log(128.f*1024.f));
+			std::uniform_int_distribution<unsigned> opDistribution(0, 9);
+
+			for (unsigned f=0; f<frameCount; ++f) {
+				// The target live size oscillates between roughly 6MB and 18MB with a period of about 3 minutes,
+				// so the tail of each shrink leaves sparsely populated pages behind
+				auto target = size_t(12.0*pageSize + 6.0*pageSize*std::sin(f * 2.0 * 3.14159265 / (180.0*60.0)));
+				for (unsigned c=0; c<4; ++c) {
+					bool doAllocate = (liveBytes < target) ? (opDistribution(rng) < 7) : (opDistribution(rng) < 3);
+					if (doAllocate || allocations.empty()) {
+						auto size = (unsigned)std::exp(logSizeDistribution(rng));
+						allocations.push_back(allocate(size));
+						liveBytes += size;
+					} else {
+						auto i = allocations.begin() + std::uniform_int_distribution<size_t>(0, allocations.size()-1)(rng);
+						auto a = *i;
+						std::swap(*i, allocations.back());
+						allocations.pop_back();
+						REQUIRE(a._heap->_heap.Deallocate(a._offset, a._size));
+						a._heap->_allocatedSpace -= a._size;
+						liveBytes -= a._size;
+						removeIfEmpty(a._heap);
+					}
+				}
+
+				if (activeOperation && activeOperation->_completionFrame == f) {
+					// Clients pick up the reposition event: everything still alive within the moved ranges switches over to the
+					// destination, and the parts of the uber block that were released in the meantime are returned to the heap
+					auto& op = *activeOperation;
+					auto* dstHeap = op._uberBlock._heap;
+					REQUIRE(dstHeap->_heap.Deallocate(op._uberBlock._offset, op._uberBlock._size));
+					dstHeap->_allocatedSpace -= op._uberBlock._size;
+					for (auto& a:allocations) {
+						if (a._heap != op._srcHeap) continue;
+						auto s = std::find_if(op._steps.begin(), op._steps.end(), [&a](const auto& s) { return a._offset >= s._sourceStart && a._offset < s._sourceEnd; });
+						if (s == op._steps.end()) continue;
+						REQUIRE((a._offset + a._size) <= s->_sourceEnd);
+						REQUIRE(op._srcHeap->_heap.Deallocate(a._offset, a._size));
+						op._srcHeap->_allocatedSpace -= a._size;
+						a._heap = dstHeap;
+						a._offset = op._uberBlock._offset + s->_destination + a._offset - s->_sourceStart;
+						REQUIRE(dstHeap->_heap.Allocate(a._offset, a._size));
+						dstHeap->_allocatedSpace += a._size;
+					}
+					op._srcHeap->_locked = false;
+					auto* srcHeap = op._srcHeap;
+					activeOperation.reset();
+					removeIfEmpty(srcHeap);
+					removeIfEmpty(dstHeap);
+				}
+
+				if (!activeOperation) {
+					std::vector<DefragCandidateHeap> candidates;
+					for (const auto& h:heaps)
+						candidates.push_back({&h->_heap, h->_allocatedSpace, h->_hashLastDefrag});
+					auto plan = PlanDefragOperation(candidates, policy);
+					if (plan._type != DefragOperation::Type::None) {
+						REQUIRE(!policy._maxBytesPerOperation || plan._byteCount <= policy._maxBytesPerOperation);
+						size_t byteCount = 0, dstSize = 0;
+						for (const auto& s:plan._steps) {
+							byteCount += s._sourceEnd - s._sourceStart;
+							dstSize = std::max(dstSize, size_t(s._destination + s._sourceEnd - s._sourceStart));
+						}
+						REQUIRE(byteCount == plan._byteCount);
+						REQUIRE(dstSize < pageSize);
+
+						auto* srcHeap = heaps[plan._heapIndex].get();
+						srcHeap->_locked = true;
+						srcHeap->_hashLastDefrag = srcHeap->_heap.CalculateHash();
+						auto uberBlock = allocate((unsigned)dstSize);
+						activeOperation = ActiveOperation{srcHeap, std::move(plan._steps), uberBlock, f+framesPerOperation};
+						++result._operationCount;
+						result._bytesMoved += byteCount;
+					}
+				}
+
+				auto minimumPages = (liveBytes + pageSize - 1) / pageSize;
+				excessPagesSum += double(heaps.size()) - double(minimumPages);
+
+				if ((f % 1000) == 0) {
+					for (const auto& h:heaps) {
+						REQUIRE(h->_heap.CalculateAllocatedSpace() == h->_allocatedSpace);
+						REQUIRE((h->_allocatedSpace != 0 || h->_locked || (activeOperation && activeOperation->_uberBlock._heap == h.get())));
+					}
+				}
+			}
+
+			result._averageExcessPages = excessPagesSum / double(frameCount);
+			return result;
+		};
+
+		BatchedResourcesDefragPolicy disabledPolicy;
+		disabledPolicy._enabled = false;
+		auto baseline = runSimulation(disabledPolicy);
+		REQUIRE(baseline._operationCount == 0);
+
+		BatchedResourcesDefragPolicy defaultPolicy;
+		auto withDefrag = runSimulation(defaultPolicy);
+		REQUIRE(withDefrag._operationCount != 0);
+		REQUIRE(withDefrag._averageExcessPages < baseline._averageExcessPages);
+
+		BatchedResourcesDefragPolicy tightBudget;
+		tightBudget._maxBytesPerOperation = 64*1024;
+		auto withTightBudget = runSimulation(tightBudget);
+		REQUIRE(withTightBudget._bytesMoved <= size_t(withTightBudget._operationCount) * tightBudget._maxBytesPerOperation);
+
+		// a budget of 0 means unlimited
+		BatchedResourcesDefragPolicy noBudget;
+		noBudget._maxBytesPerOperation = 0;
+		auto withNoBudget = runSimulation(noBudget);
+		REQUIRE(withNoBudget._operationCount != 0);
+		REQUIRE(withNoBudget._averageExcessPages < baseline._averageExcessPages);
+
+		Log(Verbose) << "Defrag simulation over " << frameCount << " frames. Average excess pages without defrag: " << baseline._averageExcessPages
+			<< ", with defrag: " << withDefrag._averageExcessPages << " (" << withDefrag._operationCount << " operations, " << withDefrag._bytesMoved << " bytes moved)"
+			<< ", with 64KB budget: " << withTightBudget._averageExcessPages << std::endl;
+	}
 }
 
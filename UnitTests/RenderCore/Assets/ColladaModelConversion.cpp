@@ -10,6 +10,7 @@
 #include "../../../Assets/ICompileOperation.h"
 #include "../../../Assets/MountingTree.h"
 #include "../../../Assets/IFileSystem.h"
+#include "../../../Assets/OSFileSystem.h"
 #include "../../../ConsoleRig/Console.h"
 #include "../../../ConsoleRig/AttachablePtr.h"
 #include "../../../ConsoleRig/GlobalServices.h"
@@ -25,6 +26,11 @@
 #include "../../../Core/SelectConfiguration.h"
 #include "catch2/catch_test_macros.hpp"
 #include "catch2/catch_approx.hpp"
+#include <filesystem>
+#include <fstream>
+#include <chrono>
+#include <cmath>
+#include <iostream>
 
 namespace UnitTests
 {
@@ -119,6 +125,110 @@ namespace UnitTests
 
         ::Assets::MainFileSystem::GetMountingTree()->Unmount(xlresmnt);
     }
+
+    static void WriteLargeColladaFile(std::ostream& str, unsigned geometryCount, unsigned gridDim)
+    {
+        // Generate a document dominated by large <float_array> and <p> elements (which is typical of
+        // architectural scenes exported from DCC tools). Each geometry is a distorted grid of gridDim x gridDim vertices
+        str << R"(<?xml version="1.0" encoding="utf-8"?>
+<COLLADA xmlns="http://www.collada.org/2005/11/COLLADASchema" version="1.4.1">
+<asset><unit name="meter" meter="1"/><up_axis>Z_UP</up_axis></asset>
+<library_geometries>
+)";
+        char buffer[128];
+        auto vertexCount = gridDim*gridDim;
+        auto triangleCount = (gridDim-1)*(gridDim-1)*2;
+        for (unsigned g=0; g<geometryCount; ++g) {
+            str << "<geometry id=\"geo" << g << "\" name=\"geo" << g << "\"><mesh>" << std::endl;
+
+            str << "<source id=\"geo" << g << "-pos\"><float_array id=\"geo" << g << "-pos-array\" count=\"" << vertexCount*3 << "\">";
+            for (unsigned y=0; y<gridDim; ++y)
+                for (unsigned x=0; x<gridDim; ++x) {
+                    auto len = std::snprintf(buffer, sizeof(buffer), " %.6f %.6f %.6f", float(x) * 0.1f, float(y) * 0.1f, std::sin(float(x+y+g) * 0.01f));
+                    str.write(buffer, len);
+                }
+            str << "</float_array><technique_common><accessor source=\"#geo" << g << "-pos-array\" count=\"" << vertexCount << "\" stride=\"3\">"
+                << "<param name=\"X\" type=\"float\"/><param name=\"Y\" type=\"float\"/><param name=\"Z\" type=\"float\"/></accessor></technique_common></source>" << std::endl;
+
+            str << "<source id=\"geo" << g << "-uv\"><float_array id=\"geo" << g << "-uv-array\" count=\"" << vertexCount*2 << "\">";
+            for (unsigned y=0; y<gridDim; ++y)
+                for (unsigned x=0; x<gridDim; ++x) {
+                    auto len = std::snprintf(buffer, sizeof(buffer), " %.6f %.6f", float(x) / float(gridDim-1), float(y) / float(gridDim-1));
+                    str.write(buffer, len);
+                }
+            str << "</float_array><technique_common><accessor source=\"#geo" << g << "-uv-array\" count=\"" << vertexCount << "\" stride=\"2\">"
+                << "<param name=\"S\" type=\"float\"/><param name=\"T\" type=\"float\"/></accessor></technique_common></source>" << std::endl;
+
+            str << "<vertices id=\"geo" << g << "-vtx\"><input semantic=\"POSITION\" source=\"#geo" << g << "-pos\"/></vertices>" << std::endl;
+            str << "<triangles count=\"" << triangleCount << "\" material=\"mat0\">"
+                << "<input semantic=\"VERTEX\" source=\"#geo" << g << "-vtx\" offset=\"0\"/>"
+                << "<input semantic=\"TEXCOORD\" source=\"#geo" << g << "-uv\" offset=\"1\" set=\"0\"/><p>";
+            for (unsigned y=0; y<gridDim-1; ++y)
+                for (unsigned x=0; x<gridDim-1; ++x) {
+                    unsigned i0 = y*gridDim+x, i1 = i0+1, i2 = i0+gridDim, i3 = i2+1;
+                    auto len = std::snprintf(buffer, sizeof(buffer), " %u %u %u %u %u %u %u %u %u %u %u %u", i0, i0, i1, i1, i2, i2, i2, i2, i1, i1, i3, i3);
+                    str.write(buffer, len);
+                }
+            str << "</p></triangles></mesh></geometry>" << std::endl;
+        }
+        str << "</library_geometries>" << std::endl;
+
+        str << "<library_visual_scenes><visual_scene id=\"scene\">" << std::endl;
+        for (unsigned g=0; g<geometryCount; ++g)
+            str << "<node id=\"node" << g << "\" name=\"node" << g << "\"><instance_geometry url=\"#geo" << g << "\"/></node>" << std::endl;
+        str << "</visual_scene></library_visual_scenes>" << std::endl;
+        str << "<scene><instance_visual_scene url=\"#scene\"/></scene>" << std::endl;
+        str << "</COLLADA>" << std::endl;
+    }
+
+    TEST_CASE("RenderCoreCompilation-ColladaLargeFilePerformance", "[rendercore_assets]")
+    {
+        auto globalServices = ConsoleRig::MakeGlobalServices(GetStartupConfig());
+
+        // Generates a few hundred MB of .dae file, and measures the time for the scaffold pass
+        // (which only records the location of large arrays), and the time for converting the model
+        // (which parses those arrays and converts geometries in parallel)
+        auto tempDirPath = std::filesystem::temp_directory_path() / "xle-unit-tests";
+        std::filesystem::create_directories(tempDirPath);
+        const unsigned geometryCount = 32, gridDim = 362;
+        {
+            std::ofstream daeOut(tempDirPath / "large-collada-test.dae", std::ios::binary);
+            WriteLargeColladaFile(daeOut, geometryCount, gridDim);
+        }
+        auto fileSize = std::filesystem::file_size(tempDirPath / "large-collada-test.dae");
+
+        auto tempMnt = ::Assets::MainFileSystem::GetMountingTree()->Mount("ut-collada", ::Assets::CreateFileSystem_OS(tempDirPath.string()));
+
+        {
+            OSServices::AttachableLibrary lib("ColladaConversion.dll");
+            std::string attachError;
+            bool attachResult = lib.TryAttach(attachError);
+            INFO(attachError);
+            REQUIRE(attachResult);
+            auto createScaffold = lib.GetFunction<Assets::CreateCompileOperationFn*>("CreateCompileOperation");
+
+            auto start = std::chrono::steady_clock::now();
+            auto compileOp = (*createScaffold)("ut-collada/large-collada-test.dae");
+            auto scaffoldEnd = std::chrono::steady_clock::now();
+            REQUIRE(compileOp);
+
+            auto targets = compileOp->GetTargets();
+            REQUIRE(!targets.empty());
+            auto serializedModel = compileOp->SerializeTarget(0);
+            auto convertEnd = std::chrono::steady_clock::now();
+            REQUIRE(!serializedModel._artifacts.empty());
+
+            compileOp.reset();
+            auto scaffoldMs = std::chrono::duration_cast<std::chrono::milliseconds>(scaffoldEnd-start).count();
+            auto convertMs = std::chrono::duration_cast<std::chrono::milliseconds>(convertEnd-scaffoldEnd).count();
+            std::cout << "Collada large file (" << fileSize / (1024*1024) << " MB, " << geometryCount << " geometries)" << std::endl;
+            std::cout << "  Scaffold: " << scaffoldMs << "ms (" << (fileSize / 1024.0 / 1024.0) / std::max(scaffoldMs / 1000.0, 1e-3) << " MB/s)" << std::endl;
+            std::cout << "  Convert model: " << convertMs << "ms (" << (fileSize / 1024.0 / 1024.0) / std::max(convertMs / 1000.0, 1e-3) << " MB/s)" << std::endl;
+        }
+
+        ::Assets::MainFileSystem::GetMountingTree()->Unmount(tempMnt);
+        std::filesystem::remove(tempDirPath / "large-collada-test.dae");
+    }
 #endif
 
 #if 0
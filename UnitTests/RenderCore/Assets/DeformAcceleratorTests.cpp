@@ -34,6 +34,8 @@
 
 #include "catch2/catch_test_macros.hpp"
 #include "catch2/catch_approx.hpp"
+#include <chrono>
+#include <iostream>
 using namespace Catch::literals;
 using namespace Utility::Literals;
 
@@ -76,6 +78,63 @@ namespace UnitTests
 		return result;
 	}
 
+	static std::shared_ptr<GeoProc::UnboundSkinController> CreateCubeSkinController()
+	{
+		// 8 joints, one at each corner of the cube
+		std::vector<Float4x4> inverseBindMatrices;
+		inverseBindMatrices.resize(8, Identity<Float4x4>());
+		std::vector<std::string> jointNames {
+			"bone-0", "bone-1", "bone-2", "bone-3",
+			"bone-4", "bone-5", "bone-6", "bone-7"
+		};
+		return std::make_shared<GeoProc::UnboundSkinController>(std::move(inverseBindMatrices), Identity<Float4x4>(), Identity<Float4x4>(), std::move(jointNames));
+	}
+
+	static std::shared_ptr<RenderCore::Assets::ModelScaffold> SerializeTestSkinnedModel(
+		std::shared_ptr<GeoProc::MeshDatabase> meshDatabase,
+		std::vector<GeoProc::NascentModel::DrawCallDesc> drawCalls,
+		std::vector<uint8_t> indicesVector, Format indexFormat,
+		std::shared_ptr<GeoProc::UnboundSkinController> skinController)
+	{
+		GeoProc::NascentModel model;
+		auto mainObjId = model.Add(
+			GeoProc::NascentModel::GeometryBlock {
+				meshDatabase,
+				std::move(drawCalls),
+				{}, Identity<Float4x4>(),
+				std::move(indicesVector), indexFormat
+			});
+
+		auto controllerId = model.Add(
+			GeoProc::NascentModel::SkinControllerBlock {
+				std::move(skinController),
+				"skinning"
+			});
+
+		std::vector<std::string> materialBindingSymbols { "Material0" };
+		model.Add(
+			GeoProc::NascentModel::Command {
+				mainObjId, {controllerId},
+				"geo-model", std::move(materialBindingSymbols)});
+
+		GeoProc::NascentSkeleton skeleton;
+		skeleton.WriteOutputMarker({}, "geo-model");
+		for (unsigned bone=0; bone<8; ++bone) {
+			skeleton.WritePushLocalToWorld();
+			skeleton.WriteStaticTransform(AsFloat4x4(s_cubeCorners[bone]));
+			skeleton.WriteOutputMarker("skinning", (StringMeld<256>() << "bone-" << bone).AsStringSection());
+			skeleton.WritePopLocalToWorld();
+		}
+
+		RenderCore::Assets::ModelCompilationConfiguration cfg;
+		auto serializedChunk = GeoProc::SerializeSkinToChunks("skin", model, skeleton, cfg);
+		auto artifactCollection = std::make_shared<::Assets::BlobArtifactCollection>(
+			MakeIteratorRange(serializedChunk),
+			::Assets::AssetState::Ready, ::Assets::DependencyValidation{});
+
+		return ::Assets::AutoConstructAsset<std::shared_ptr<RenderCore::Assets::ModelScaffold>>(*artifactCollection);
+	}
+
 	std::shared_ptr<RenderCore::Assets::ModelScaffold> MakeTestAnimatedModel()
 	{
 		// Create a model scaffold from a very simple cube model
@@ -105,22 +164,7 @@ namespace UnitTests
 		};
 		std::vector<uint8_t> indicesVector{(const uint8_t*)indices, (const uint8_t*)ArrayEnd(indices)};
 
-		GeoProc::NascentModel model;
-		auto mainObjId = model.Add(
-			GeoProc::NascentModel::GeometryBlock {
-				meshDatabase,
-				std::move(drawCalls),
-				{}, Identity<Float4x4>(),
-				std::move(indicesVector), Format::R16_UINT
-			});
-
-		std::vector<Float4x4> inverseBindMatrices;
-		inverseBindMatrices.resize(8, Identity<Float4x4>());
-		std::vector<std::string> jointNames {
-			"bone-0", "bone-1", "bone-2", "bone-3",
-			"bone-4", "bone-5", "bone-6", "bone-7"
-		};
-		auto skinController = std::make_shared<GeoProc::UnboundSkinController>(std::move(inverseBindMatrices), Identity<Float4x4>(), Identity<Float4x4>(), std::move(jointNames));
+		auto skinController = CreateCubeSkinController();
 		for (unsigned vertex=0; vertex<8; ++vertex) {
 			float weights[8];
 			unsigned indices[] { 0, 1, 2, 3, 4, 5, 6, 7 };
@@ -133,34 +177,63 @@ namespace UnitTests
 				weights[bone] /= weightTotal;
 			skinController->AddInfluences(vertex, weights, indices);
 		}
-		auto controllerId = model.Add(
-			GeoProc::NascentModel::SkinControllerBlock {
-				std::move(skinController),
-				"skinning"
-			});
 
-		std::vector<std::string> materialBindingSymbols { "Material0" };
-		model.Add(
-			GeoProc::NascentModel::Command {
-				mainObjId, {controllerId},
-				"geo-model", std::move(materialBindingSymbols)});
+		return SerializeTestSkinnedModel(std::move(meshDatabase), std::move(drawCalls), std::move(indicesVector), Format::R16_UINT, std::move(skinController));
+	}
 
-		GeoProc::NascentSkeleton skeleton;
-		skeleton.WriteOutputMarker({}, "geo-model");
-		for (unsigned bone=0; bone<8; ++bone) {
-			skeleton.WritePushLocalToWorld();
-			skeleton.WriteStaticTransform(AsFloat4x4(s_cubeCorners[bone]));
-			skeleton.WriteOutputMarker("skinning", (StringMeld<256>() << "bone-" << bone).AsStringSection());
-			skeleton.WritePopLocalToWorld();
-		}
+	static std::shared_ptr<RenderCore::Assets::ModelScaffold> MakeTestAnimatedGridModel(unsigned gridDim, unsigned influencesPerVertex)
+	{
+		// A flat grid of gridDim x gridDim vertices inside of the cube, bound to the same 8 joints as MakeTestAnimatedModel()
+		// Each vertex is influenced by the "influencesPerVertex" closest joints
+		assert(gridDim >= 2 && influencesPerVertex >= 1 && influencesPerVertex <= 8);
+		auto vertexCount = gridDim*gridDim;
+		std::vector<Float3> positions, normals;
+		std::vector<Float4> tangents;
+		positions.reserve(vertexCount); normals.reserve(vertexCount); tangents.reserve(vertexCount);
+		for (unsigned y=0; y<gridDim; ++y)
+			for (unsigned x=0; x<gridDim; ++x) {
+				positions.push_back(Float3{-1.f + 2.f * x / float(gridDim-1), -1.f + 2.f * y / float(gridDim-1), 0.f});
+				normals.push_back(Float3{0.f, 0.f, 1.f});
+				tangents.push_back(Float4{1.f, 0.f, 0.f, -1.f});
+			}
 
-		RenderCore::Assets::ModelCompilationConfiguration cfg;
-		auto serializedChunk = GeoProc::SerializeSkinToChunks("skin", model, skeleton, cfg);
-		auto artifactCollection = std::make_shared<::Assets::BlobArtifactCollection>(
-			MakeIteratorRange(serializedChunk),
-			::Assets::AssetState::Ready, ::Assets::DependencyValidation{});
+		auto meshDatabase = std::make_shared<GeoProc::MeshDatabase>();
+		meshDatabase->AddStream(GeoProc::CreateRawDataSource(MakeIteratorRange(positions), Format::R32G32B32_FLOAT), {}, "POSITION", 0);
+		meshDatabase->AddStream(GeoProc::CreateRawDataSource(MakeIteratorRange(normals), Format::R32G32B32_FLOAT), {}, "NORMAL", 0);
+		meshDatabase->AddStream(GeoProc::CreateRawDataSource(MakeIteratorRange(tangents), Format::R32G32B32A32_FLOAT), {}, "TEXTANGENT", 0);
+
+		std::vector<unsigned> indices;
+		indices.reserve((gridDim-1)*(gridDim-1)*6);
+		for (unsigned y=0; y<gridDim-1; ++y)
+			for (unsigned x=0; x<gridDim-1; ++x) {
+				unsigned i0 = y*gridDim+x, i1 = i0+1, i2 = i0+gridDim, i3 = i2+1;
+				indices.insert(indices.end(), {i0, i1, i2, i2, i1, i3});
+			}
+		std::vector<GeoProc::NascentModel::DrawCallDesc> drawCalls {
+			GeoProc::NascentModel::DrawCallDesc{0, (unsigned)indices.size(), Topology::TriangleList},
+		};
+		std::vector<uint8_t> indicesVector{(const uint8_t*)AsPointer(indices.begin()), (const uint8_t*)AsPointer(indices.end())};
 
-		return ::Assets::AutoConstructAsset<std::shared_ptr<RenderCore::Assets::ModelScaffold>>(*artifactCollection);
+		auto skinController = CreateCubeSkinController();
+		for (unsigned vertex=0; vertex<vertexCount; ++vertex) {
+			std::pair<float, unsigned> bonesByDistance[8];
+			for (unsigned bone=0; bone<8; ++bone)
+				bonesByDistance[bone] = {Magnitude(s_cubeCorners[bone] - positions[vertex]), bone};
+			std::sort(bonesByDistance, &bonesByDistance[8]);
+
+			float weights[8];
+			unsigned jointIndices[8];
+			float weightTotal = 0.f;
+			for (unsigned c=0; c<influencesPerVertex; ++c) {
+				weightTotal += weights[c] = 1.f / (1e-3f + bonesByDistance[c].first);
+				jointIndices[c] = bonesByDistance[c].second;
+			}
+			for (unsigned c=0; c<influencesPerVertex; ++c)
+				weights[c] /= weightTotal;
+			skinController->AddInfluences(vertex, MakeIteratorRange(weights, &weights[influencesPerVertex]), MakeIteratorRange(jointIndices, &jointIndices[influencesPerVertex]));
+		}
+
+		return SerializeTestSkinnedModel(std::move(meshDatabase), std::move(drawCalls), std::move(indicesVector), Format::R32_UINT, std::move(skinController));
 	}
 
 	static IResourcePtr LoadStorageBuffer(
@@ -353,6 +426,60 @@ namespace UnitTests
 		return AsFloat3s(destinationElements);
 	}
 
+	struct CPUSkinningTestData
+	{
+		std::shared_ptr<RenderCore::Assets::ModelScaffold> _modelScaffold;		// deformer holds pointers into the scaffold
+		std::unique_ptr<Techniques::CPUSkinDeformer> _deformer;
+		std::vector<Float3> _positions, _normals;
+		std::vector<Float4> _tangents;
+		std::vector<uint8_t> _staticData;
+		unsigned _vertexStride = 0;
+	};
+
+	static CPUSkinningTestData PrepareCPUSkinning(std::shared_ptr<RenderCore::Assets::ModelScaffold> modelScaffold)
+	{
+		// Setup a CPUSkinDeformer that deforms position, normal & tangent, with the same interleaved layout for
+		// the static input & deformed output
+		CPUSkinningTestData result;
+		result._modelScaffold = modelScaffold;
+		result._deformer = std::make_unique<Techniques::CPUSkinDeformer>(*modelScaffold, std::string{});
+
+		auto* skinningData = GetSkinningDataAtGeo0(*modelScaffold);
+		REQUIRE(skinningData);
+		auto& animVb = skinningData->_animatedVertexElements;
+		auto rawInputBuffer = LoadCPUVertexBuffer(*modelScaffold, animVb);
+		auto* positionEle = Techniques::Internal::FindElement(animVb._ia._elements, "POSITION"_h);
+		auto* normalEle = Techniques::Internal::FindElement(animVb._ia._elements, "NORMAL"_h);
+		auto* tangentEle = Techniques::Internal::FindElement(animVb._ia._elements, "TEXTANGENT"_h);
+		REQUIRE(positionEle); REQUIRE(normalEle); REQUIRE(tangentEle);
+		result._positions = AsFloat3s(Techniques::Internal::AsVertexElementIteratorRange(MakeIteratorRange(rawInputBuffer), *positionEle, animVb._ia._vertexStride));
+		result._normals = AsFloat3s(Techniques::Internal::AsVertexElementIteratorRange(MakeIteratorRange(rawInputBuffer), *normalEle, animVb._ia._vertexStride));
+		result._tangents = AsFloat4s(Techniques::Internal::AsVertexElementIteratorRange(MakeIteratorRange(rawInputBuffer), *tangentEle, animVb._ia._vertexStride));
+
+		result._vertexStride = sizeof(Float3) + sizeof(Float3) + sizeof(Float4);
+		result._staticData.resize(result._positions.size() * result._vertexStride);
+		for (unsigned v=0; v<result._positions.size(); ++v) {
+			auto* dst = PtrAdd(result._staticData.data(), v*result._vertexStride);
+			std::memcpy(dst, &result._positions[v], sizeof(Float3));
+			std::memcpy(PtrAdd(dst, sizeof(Float3)), &result._normals[v], sizeof(Float3));
+			std::memcpy(PtrAdd(dst, 2*sizeof(Float3)), &result._tangents[v], sizeof(Float4));
+		}
+
+		Techniques::DeformerInputBinding::GeoBinding geoBinding;
+		geoBinding._inputElements.push_back({"POSITION", 0, Format::R32G32B32_FLOAT, Techniques::Internal::VB_CPUStaticData, 0});
+		geoBinding._inputElements.push_back({"NORMAL", 0, Format::R32G32B32_FLOAT, Techniques::Internal::VB_CPUStaticData, sizeof(Float3)});
+		geoBinding._inputElements.push_back({"TEXTANGENT", 0, Format::R32G32B32A32_FLOAT, Techniques::Internal::VB_CPUStaticData, 2*sizeof(Float3)});
+		geoBinding._outputElements.push_back({"POSITION", 0, Format::R32G32B32_FLOAT, Techniques::Internal::VB_PostDeform, 0});
+		geoBinding._outputElements.push_back({"NORMAL", 0, Format::R32G32B32_FLOAT, Techniques::Internal::VB_PostDeform, sizeof(Float3)});
+		geoBinding._outputElements.push_back({"TEXTANGENT", 0, Format::R32G32B32A32_FLOAT, Techniques::Internal::VB_PostDeform, 2*sizeof(Float3)});
+		for (auto& o:geoBinding._bufferOffsets) o = 0;
+		for (auto& s:geoBinding._bufferStrides) s = 0;
+		geoBinding._bufferStrides[Techniques::Internal::VB_CPUStaticData] = result._vertexStride;
+		geoBinding._bufferStrides[Techniques::Internal::VB_PostDeform] = result._vertexStride;
+		result._deformer->_bindingHelper._inputBinding._geoBindings.push_back({std::make_pair(0,0), std::move(geoBinding)});
+		return result;
+	}
+
 	static std::vector<Float3> GetFloat3sFromVertexBuffer(
 		IteratorRange<void*> rawVB,
 		const RenderCore::Assets::GeoInputAssembly& ia, 
@@ -622,5 +749,101 @@ namespace UnitTests
 			REQUIRE(bufferIterators._bufferIterators[Techniques::Internal::VB_GPUDeformTemporaries] == 0);
 		}
 	}
-	
+
+	TEST_CASE( "Deform-CPUSkinMultiInstance", "[rendercore_techniques]" )
+	{
+		auto globalServices = ConsoleRig::MakeGlobalServices(GetStartupConfig());
+		auto testData = PrepareCPUSkinning(MakeTestAnimatedGridModel(64, 4));
+		auto& skeleton = *testData._modelScaffold->EmbeddedSkeleton();
+		auto binding = testData._deformer->CreateBinding(skeleton.GetOutputInterface());
+
+		// Every joint in an instance gets the same transform. Since the weights sum to 1, each instance should
+		// come out as a rigid transform of the bind pose
+		const unsigned instanceCount = 64;
+		std::vector<Float4x4> instanceTransforms;
+		std::vector<Float4x4> skeletonMachineOutput(skeleton.GetOutputMatrixCount());
+		for (unsigned c=0; c<instanceCount; ++c) {
+			auto transform = AsFloat4x4(RotationY{0.1f * c});
+			SetTranslation(transform, Float3{float(c), 0.5f, -float(c)});
+			instanceTransforms.push_back(transform);
+			std::fill(skeletonMachineOutput.begin(), skeletonMachineOutput.end(), transform);
+			testData._deformer->FeedInSkeletonMachineResults(c, skeletonMachineOutput, binding);
+		}
+
+		// deform in reverse order, to check that the outputs follow the order of the instance indices
+		std::vector<unsigned> instances;
+		for (unsigned c=0; c<instanceCount; ++c) instances.push_back(instanceCount-1-c);
+
+		const auto outputInstanceStride = unsigned(testData._staticData.size());
+		std::vector<uint8_t> outputBufferData(outputInstanceStride * instanceCount);
+		testData._deformer->ExecuteCPU(MakeIteratorRange(instances), outputInstanceStride, MakeIteratorRange(testData._staticData), {}, outputBufferData);
+
+		for (unsigned c=0; c<instanceCount; ++c) {
+			auto& transform = instanceTransforms[instances[c]];
+			for (unsigned v=0; v<testData._positions.size(); ++v) {
+				auto* dst = PtrAdd(outputBufferData.data(), c*outputInstanceStride + v*testData._vertexStride);
+				auto& position = *(const Float3*)dst;
+				auto& normal = *(const Float3*)PtrAdd(dst, sizeof(Float3));
+				auto& tangent = *(const Float4*)PtrAdd(dst, 2*sizeof(Float3));
+				REQUIRE(Equivalent(position, TransformPoint(transform, testData._positions[v]), 1e-3f));
+				REQUIRE(Equivalent(normal, TransformDirectionVector(transform, testData._normals[v]), 1e-3f));
+				REQUIRE(Equivalent(Truncate(tangent), TransformDirectionVector(transform, Truncate(testData._tangents[v])), 1e-3f));
+				REQUIRE(tangent[3] == testData._tangents[v][3]);
+			}
+		}
+
+		// Instances without skeleton machine results fall back to the default pose
+		unsigned unfedInstance[] { instanceCount };
+		std::vector<uint8_t> unfedOutput(outputInstanceStride);
+		testData._deformer->ExecuteCPU(MakeIteratorRange(unfedInstance), outputInstanceStride, MakeIteratorRange(testData._staticData), {}, unfedOutput);
+		for (unsigned v=0; v<testData._positions.size(); ++v)
+			REQUIRE(Equivalent(*(const Float3*)PtrAdd(unfedOutput.data(), v*testData._vertexStride), testData._positions[v], 1e-3f));
+	}
+
+	TEST_CASE( "Deform-CPUSkinPerformance", "[rendercore_techniques]" )
+	{
+		auto globalServices = ConsoleRig::MakeGlobalServices(GetStartupConfig());
+		#if defined(_DEBUG)
+			const unsigned gridDim = 32, instanceCount = 16, iterationCount = 2;
+		#else
+			const unsigned gridDim = 96, instanceCount = 256, iterationCount = 8;
+		#endif
+
+		for (unsigned influences:{1u, 2u, 4u}) {
+			auto testData = PrepareCPUSkinning(MakeTestAnimatedGridModel(gridDim, influences));
+			auto& skeleton = *testData._modelScaffold->EmbeddedSkeleton();
+			auto binding = testData._deformer->CreateBinding(skeleton.GetOutputInterface());
+			std::vector<Float4x4> skeletonMachineOutput(skeleton.GetOutputMatrixCount());
+			for (unsigned c=0; c<instanceCount; ++c) {
+				for (unsigned j=0; j<skeletonMachineOutput.size(); ++j) {
+					skeletonMachineOutput[j] = AsFloat4x4(RotationY{0.01f * (c+j)});
+					SetTranslation(skeletonMachineOutput[j], Float3{float(c), float(j), 0.f});
+				}
+				testData._deformer->FeedInSkeletonMachineResults(c, skeletonMachineOutput, binding);
+			}
+
+			std::vector<unsigned> instances;
+			for (unsigned c=0; c<instanceCount; ++c) instances.push_back(c);
+			const auto outputInstanceStride = unsigned(testData._staticData.size());
+			std::vector<uint8_t> outputBufferData(outputInstanceStride * instanceCount);
+
+			// one instance per call (which is all that the CPU deformer used to support) vs all instances in one call
+			auto start = std::chrono::steady_clock::now();
+			for (unsigned i=0; i<iterationCount; ++i)
+				for (unsigned c=0; c<instanceCount; ++c)
+					testData._deformer->ExecuteCPU(
+						MakeIteratorRange(&instances[c], &instances[c+1]), outputInstanceStride, MakeIteratorRange(testData._staticData), {},
+						MakeIteratorRange(PtrAdd(outputBufferData.data(), c*outputInstanceStride), PtrAdd(outputBufferData.data(), (c+1)*outputInstanceStride)));
+			auto perInstanceEnd = std::chrono::steady_clock::now();
+			for (unsigned i=0; i<iterationCount; ++i)
+				testData._deformer->ExecuteCPU(MakeIteratorRange(instances), outputInstanceStride, MakeIteratorRange(testData._staticData), {}, outputBufferData);
+			auto batchedEnd = std::chrono::steady_clock::now();
+
+			auto verticesPerSecond = [&](auto duration) {
+				auto seconds = std::chrono::duration_cast<std::chrono::duration<double>>(duration).count();
+				return unsigned(double(testData._positions.size()) * instanceCount * iterationCount / seconds / 1e6);
+			};
+			std::cout << "CPU skinning (" << influences << " influences, " << instanceCount << " x " << testData._positions.size() << " vertices), per instance calls: " << verticesPerSecond(perInstanceEnd-start) << "M verts/s, batched: " << verticesPerSecond(batchedEnd-perInstanceEnd) << "M verts/s" << std::endl;
+		}
+	}
 }
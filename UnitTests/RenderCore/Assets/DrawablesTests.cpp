@@ -42,6 +42,7 @@
 #include "catch2/catch_approx.hpp"
 #include <thread>
 #include <chrono>
+#include <iostream>
 
 using namespace Catch::literals;
 using namespace std::chrono_literals;
@@ -266,6 +267,175 @@ namespace UnitTests
 			fbHelper.SaveImage(*threadContext, "drawables-render-sphere");
 		}
 
+		SECTION("Draw parallel")
+		{
+			// Draw many small spheres, both serially and recorded in parallel into secondary command lists. The
+			// results should be identical, regardless of the thread count.
+			// Each sphere is at a different position, and each contiguous block of drawables has its own grey level
+			// (used as an id), so a range that is dropped, duplicated or drawn with the wrong drawables will change
+			// the image. The packet is made from several overlapping layers, one after the other; so where the
+			// layers overlap, the image also depends on the ranges being submitted in order
+			const unsigned cellsPerSide = 32;
+			const unsigned cellCount = cellsPerSide*cellsPerSide;
+			const unsigned drawableCount = 8*1024;
+			const unsigned layerCount = drawableCount / cellCount;
+			const unsigned idCount = 2*layerCount;
+			static_assert((drawableCount % cellCount) == 0);
+
+			auto sphereGeo = ToolsRig::BuildGeodesicSphere(1);
+			const unsigned sphereVertexCount = (unsigned)sphereGeo.size();
+			std::vector<ToolsRig::Internal::Vertex3D> sphereCells;
+			sphereCells.reserve(cellCount*layerCount*sphereVertexCount);
+			{
+				// The camera is orthogonal & looking at the origin, covering [-2, 2] in both directions. Arrange the
+				// spheres in a grid in the plane facing the camera, with each layer shifted by one pixel diagonally
+				Float3 fwd = Normalize(Float3 { 1.0f, -1.0f, 1.0f });
+				auto cameraToWorld = MakeCameraToWorld(fwd, Float3{0.f, 1.f, 0.f}, -5.0f * fwd);
+				auto right = ExtractRight_Cam(cameraToWorld), up = ExtractUp_Cam(cameraToWorld);
+				const float pixelSize = 4.0f / float(targetDesc._textureDesc._width);
+				const float cellSize = 4.0f / float(cellsPerSide);
+				const float radius = 2.5f * pixelSize;
+				for (unsigned layer=0; layer<layerCount; ++layer)
+					for (unsigned cell=0; cell<cellCount; ++cell) {
+						float layerOffset = (float(layer) - .5f * float(layerCount-1)) * pixelSize;
+						float x = -2.0f + (float(cell%cellsPerSide) + .5f) * cellSize + layerOffset;
+						float y = -2.0f + (float(cell/cellsPerSide) + .5f) * cellSize + layerOffset;
+						for (auto v:sphereGeo) {
+							v._position = radius * v._position + x * right + y * up;
+							sphereCells.push_back(v);
+						}
+					}
+			}
+			auto sphereVb = testHelper->CreateVB(sphereCells);
+			auto drawableGeo = techniqueTestApparatus._drawablesPool->CreateGeo();
+			drawableGeo->_vertexStreams[0]._resource = sphereVb;
+			drawableGeo->_vertexStreamCount = 1;
+
+			auto patches = GetPatchCollectionFromText(s_patchCollectionBasicTexturing);
+
+			// One material per id. "Multiplier" removes the texture, so the output is just the grey level in "Adder"
+			std::vector<std::shared_ptr<Techniques::ManualMaterialMachine>> matMachines;
+			std::vector<std::shared_ptr<Techniques::DescriptorSetAccelerator>> descriptorSetAccelerators;
+			for (unsigned id=0; id<idCount; ++id) {
+				ParameterBox constantBindings;
+				constantBindings.SetParameter("CoordFreq", Float2{.025f, .025f});
+				constantBindings.SetParameter("Multiplier", Float3{0.f, 0.f, 0.f});
+				constantBindings.SetParameter("Adder", float(id+1) / float(idCount+1));
+				ParameterBox resourceBindings;
+				resourceBindings.SetParameter("BoundTexture", "xleres/DefaultResources/waternoise.png");
+				std::vector<std::pair<uint64_t, SamplerDesc>> samplerBindings;
+				samplerBindings.push_back(std::make_pair("BoundSampler"_h, SamplerDesc{}));
+				auto matMachine = std::make_shared<RenderCore::Techniques::ManualMaterialMachine>(
+					constantBindings, resourceBindings, samplerBindings);
+				descriptorSetAccelerators.push_back(pipelineAcceleratorPool->CreateDescriptorSetAccelerator(
+					nullptr, patches, nullptr,
+					matMachine->GetMaterialMachine(), matMachine,
+					"unittest"));
+				matMachines.push_back(std::move(matMachine));
+			}
+
+			std::promise<std::shared_ptr<Techniques::ITechniqueDelegate>> promisedTechDel;
+			auto futureTechDel = promisedTechDel.get_future();
+			Techniques::CreateTechniqueDelegate_Utility(
+				std::move(promisedTechDel),
+				::Assets::GetAssetFuturePtr<Techniques::TechniqueSetFile>("ut-data/basic.tech"), 
+				Techniques::UtilityDelegateType::CopyDiffuseAlbedo);
+			auto cfgId = pipelineAcceleratorPool->CreateSequencerConfig("test");
+			pipelineAcceleratorPool->SetTechniqueDelegate(*cfgId, std::move(futureTechDel));
+			pipelineAcceleratorPool->SetFrameBufferDesc(*cfgId, fbHelper.GetDesc());
+
+			auto pipeline = pipelineAcceleratorPool->CreatePipelineAccelerator(
+				patches, nullptr,
+				ParameterBox {},
+				ToolsRig::Vertex3D_InputLayout,
+				Topology::TriangleList,
+				RenderCore::Assets::RenderStateSet{});
+
+			for (const auto& descriptorSetAccelerator:descriptorSetAccelerators) {
+				auto descSetFuture = pipelineAcceleratorPool->GetDescriptorSetMarker(*descriptorSetAccelerator);
+				REQUIRE(descSetFuture.valid());
+				StallForDescriptorSet(*threadContext, descSetFuture);
+			}
+			auto pipelineFuture = pipelineAcceleratorPool->GetPipelineMarker(*pipeline, *cfgId);
+			REQUIRE(pipelineFuture.valid());
+			pipelineAcceleratorPool->VisibilityBarrier(pipelineFuture.get());
+
+			struct CustomDrawable : public Techniques::Drawable { unsigned _vertexCount, _firstVertex; };
+			Techniques::DrawablesPacket pkt;
+			for (unsigned c=0; c<drawableCount; ++c) {
+				auto* drawable = pkt._drawables.Allocate<CustomDrawable>();
+				drawable->_pipeline = pipeline.get();
+				drawable->_descriptorSet = descriptorSetAccelerators[c * idCount / drawableCount].get();
+				drawable->_geo = drawableGeo.get();
+				drawable->_vertexCount = sphereVertexCount;
+				drawable->_firstVertex = c * sphereVertexCount;
+				drawable->_drawFn = [](Techniques::ParsingContext&, const Techniques::ExecuteDrawableContext& drawFnContext, const Techniques::Drawable& drawable)
+					{
+						drawFnContext.Draw(((CustomDrawable&)drawable)._vertexCount, ((CustomDrawable&)drawable)._firstVertex);
+					};
+			}
+
+			auto globalDelegate = std::make_shared<UnitTestGlobalUniforms>(targetDesc);
+			auto newVisibility = PrepareAndStall(techniqueTestApparatus, *cfgId, pkt);
+
+			std::chrono::steady_clock::duration serialTime;
+			{
+				auto rpi = fbHelper.BeginRenderPass(*threadContext);
+				auto parsingContext = BeginParsingContext(techniqueTestApparatus, *threadContext);
+				parsingContext.GetUniformDelegateManager()->BindShaderResourceDelegate(globalDelegate);
+				parsingContext.GetViewport() = fbHelper.GetDefaultViewport();
+				parsingContext.SetPipelineAcceleratorsVisibility(newVisibility._pipelineAcceleratorsVisibility);
+				parsingContext.RequireCommandList(newVisibility._bufferUploadsVisibility);
+				auto start = std::chrono::steady_clock::now();
+				Techniques::Draw(parsingContext, *pipelineAcceleratorPool, *cfgId, pkt);
+				serialTime = std::chrono::steady_clock::now() - start;
+				if (parsingContext._requiredBufferUploadsCommandList)
+					techniqueTestApparatus._bufferUploads->StallAndMarkCommandListDependency(*threadContext, parsingContext._requiredBufferUploadsCommandList);
+			}
+			auto serialPixels = fbHelper.GetMainTarget()->ReadBackSynchronized(*threadContext);
+			auto serialBreakdown = fbHelper.GetFullColorBreakdown(*threadContext);
+			REQUIRE(serialBreakdown.size() == idCount+1);		// every id is visible somewhere, plus the background
+
+			auto toMs = [](auto d) { return std::chrono::duration_cast<std::chrono::microseconds>(d).count() / 1000.f; };
+			std::cout << "Recording " << drawableCount << " drawables" << std::endl;
+			std::cout << "  serial: " << toMs(serialTime) << "ms" << std::endl;
+
+			unsigned maxThreadCount = std::max(2u, std::min(std::thread::hardware_concurrency(), 8u));
+			for (unsigned threadCount=1; threadCount<=maxThreadCount; ++threadCount) {
+				Techniques::ParallelDrawMetrics metrics;
+				{
+					auto rpi = fbHelper.BeginRenderPass(*threadContext, {}, 1ull);
+					auto parsingContext = BeginParsingContext(techniqueTestApparatus, *threadContext);
+					parsingContext.GetUniformDelegateManager()->BindShaderResourceDelegate(globalDelegate);
+					parsingContext.GetViewport() = fbHelper.GetDefaultViewport();
+					parsingContext.SetPipelineAcceleratorsVisibility(newVisibility._pipelineAcceleratorsVisibility);
+					parsingContext.RequireCommandList(newVisibility._bufferUploadsVisibility);
+					Techniques::ParallelDrawOptions parallelOptions;
+					parallelOptions._maxThreadCount = threadCount;
+					parallelOptions._minDrawablesPerRange = 1;
+					metrics = Techniques::DrawParallel(parsingContext, *pipelineAcceleratorPool, *cfgId, pkt, {}, parallelOptions);
+					if (parsingContext._requiredBufferUploadsCommandList)
+						techniqueTestApparatus._bufferUploads->StallAndMarkCommandListDependency(*threadContext, parsingContext._requiredBufferUploadsCommandList);
+				}
+				REQUIRE(metrics._rangeCount >= 1);
+				REQUIRE(metrics._rangeCount <= threadCount);
+
+				INFO("Thread count: " << threadCount << ", range count: " << metrics._rangeCount);
+				// pixel counts for each id must match, as well as the individual pixels
+				REQUIRE(fbHelper.GetFullColorBreakdown(*threadContext) == serialBreakdown);
+				auto parallelPixels = fbHelper.GetMainTarget()->ReadBackSynchronized(*threadContext);
+				REQUIRE(parallelPixels.size() == serialPixels.size());
+				auto* serialColors = (const unsigned*)serialPixels.data();
+				auto* parallelColors = (const unsigned*)parallelPixels.data();
+				unsigned mismatchedPixels = 0;
+				for (size_t p=0; p<serialPixels.size()/sizeof(unsigned); ++p)
+					if (serialColors[p] != parallelColors[p]) ++mismatchedPixels;
+				REQUIRE(mismatchedPixels == 0);
+
+				std::cout << "  " << metrics._rangeCount << " range(s): " << toMs(metrics._totalTime) << "ms (longest range " << toMs(metrics._longestRangeTime) << "ms, sum of ranges " << toMs(metrics._sumRangeTime) << "ms)" << std::endl;
+			}
+		}
+
 		SECTION("Draw model file")
 		{
 			auto matRegistration = RenderCore::Assets::RegisterMaterialCompiler(compilers);
@@ -4,10 +4,19 @@
 
 #include "../../UnitTestHelper.h"
 #include "../../EmbeddedRes.h"
+#include "../Metal/MetalTestHelper.h"
 #include "../../../RenderCore/Assets/PredefinedCBLayout.h"
+#include "../../../RenderCore/Techniques/ImmediateDrawables.h"
+#include "../../../RenderCore/Techniques/PipelineAccelerator.h"
+#include "../../../RenderCore/Techniques/PipelineCollection.h"
+#include "../../../RenderCore/IDevice.h"
 #include "../../../RenderCore/Types.h"
 #include "../../../RenderCore/Format.h"
+#include "../../../RenderCore/GeoProc/GeometryAlgorithm.h"
+#include "../../../RenderCore/GeoProc/MeshDatabase.h"
 #include "../../../RenderOverlays/Font.h"
+#include "../../../RenderOverlays/TextRunCache.h"
+#include "../../../RenderOverlays/ShapesRendering.h"
 #include "../../../Tools/ToolsRig/VisualisationGeo.h"
 #include "../../../Assets/Marker.h"
 #include "../../../Assets/MountingTree.h"
@@ -16,11 +25,14 @@
 #include "../../../Utility/ImpliedTyping.h"
 #include "../../../Utility/MemoryUtils.h"
 #include "../../../Math/Vector.h"
+#include "../../../Math/Geometry.h"
 #include "../../../Math/MathSerialization.h"
 #include "catch2/catch_test_macros.hpp"
 #include "catch2/catch_approx.hpp"
 #include <algorithm>
 #include <random>
+#include <iostream>
+#include <chrono>
 
 using namespace Catch::literals;
 using namespace Utility::Literals;
@@ -85,6 +97,122 @@ namespace UnitTests
 		REQUIRE(reorderedWell.CalculateHash() == reorderedPoor.CalculateHash());
 	}
 
+	static RenderCore::Assets::PredefinedCBLayout MakeMaterialCBLayout()
+	{
+		// similar to a typical material constant buffer, with a mix of types & an array
+		std::vector<NameAndType> elements {
+			NameAndType { "DiffuseColor", ImpliedTyping::TypeOf<Float3>() },
+			NameAndType { "Opacity", ImpliedTyping::TypeOf<float>() },
+			NameAndType { "SpecularColor", ImpliedTyping::TypeOf<Float4>() },
+			NameAndType { "Roughness", ImpliedTyping::TypeOf<float>() },
+			NameAndType { "Metal", ImpliedTyping::TypeOf<float>() },
+			NameAndType { "Flags", ImpliedTyping::TypeOf<unsigned>() },
+			NameAndType { "UVScale", ImpliedTyping::TypeOf<Float2>() },
+			NameAndType { "Weights", ImpliedTyping::TypeOf<float>(), 4 },
+			NameAndType { "Tint", ImpliedTyping::TypeOf<Float4>() },
+			NameAndType { "Scale", ImpliedTyping::TypeOf<int>() }
+		};
+		ParameterBox defaults;
+		defaults.SetParameter("Roughness", 0.5f);
+		defaults.SetParameter("Metal", 1);
+		defaults.SetParameter(ParameterBox::MakeParameterNameHash("Weights")+2, 0.25f);
+		defaults.SetParameter("Tint", Float3(1.f, 2.f, 3.f));
+		return RenderCore::Assets::PredefinedCBLayout { MakeIteratorRange(elements), defaults };
+	}
+
+	static ParameterBox MakeMaterialParameters()
+	{
+		// parameters with types that don't always match the layout, as is common for material files
+		ParameterBox params;
+		params.SetParameter("DiffuseColor", Float3(0.1f, 0.2f, 0.3f));
+		params.SetParameter("Opacity", 1);
+		params.SetParameter("SpecularColor", Float3(0.4f, 0.5f, 0.6f));
+		params.SetParameter("Flags", true);
+		params.SetParameter("UVScale", Float4(2.f, 3.f, 4.f, 5.f));
+		params.SetParameter(ParameterBox::MakeParameterNameHash("Weights")+1, 7.0);
+		params.SetParameter(ParameterBox::MakeParameterNameHash("Weights")+3, 9u);
+		params.SetParameter("Scale", 2.5f);
+		params.SetParameter("Unrelated", 3);
+		return params;
+	}
+
+	TEST_CASE( "PredefinedCBLayout-CompiledWriter", "[rendercore_assets]" )
+	{
+		auto layout = MakeMaterialCBLayout();
+		auto params = MakeMaterialParameters();
+
+		for (auto lang:{RenderCore::ShaderLanguage::HLSL, RenderCore::ShaderLanguage::GLSL, RenderCore::ShaderLanguage::MetalShaderLanguage}) {
+			RenderCore::Assets::CompiledCBWriter writer(layout, params, lang);
+			REQUIRE(writer.GetSize() == layout.GetSize(lang));
+			REQUIRE(writer.IsCompatible(params));
+			REQUIRE(writer.BuildCBDataAsVector(params) == layout.BuildCBDataAsVector(params, lang));
+
+			// new values with the same signature use the compiled steps
+			auto changedValues = params;
+			changedValues.SetParameter("Opacity", 5);
+			changedValues.SetParameter("DiffuseColor", Float3(3.f, 4.f, 5.f));
+			REQUIRE(writer.IsCompatible(changedValues));
+			REQUIRE(writer.BuildCBDataAsVector(changedValues) == layout.BuildCBDataAsVector(changedValues, lang));
+
+			// different types or names fall back to the layout
+			auto changedTypes = params;
+			changedTypes.SetParameter("Opacity", 0.75f);
+			REQUIRE(!writer.IsCompatible(changedTypes));
+			REQUIRE(writer.BuildCBDataAsVector(changedTypes) == layout.BuildCBDataAsVector(changedTypes, lang));
+
+			auto changedNames = params;
+			changedNames.SetParameter("Roughness", 0.1f);
+			REQUIRE(!writer.IsCompatible(changedNames));
+			REQUIRE(writer.BuildCBDataAsVector(changedNames) == layout.BuildCBDataAsVector(changedNames, lang));
+
+			// only defaults
+			RenderCore::Assets::CompiledCBWriter defaultsWriter(layout, {}, lang);
+			REQUIRE(defaultsWriter.IsCompatible({}));
+			REQUIRE(defaultsWriter.BuildCBDataAsVector({}) == layout.BuildCBDataAsVector({}, lang));
+		}
+
+		// Copies of adjacent elements should be merged into single steps
+		{
+			std::vector<NameAndType> elements {
+				NameAndType { "A", ImpliedTyping::TypeOf<Float4>() },
+				NameAndType { "B", ImpliedTyping::TypeOf<Float4>() },
+				NameAndType { "C", ImpliedTyping::TypeOf<Float4>() }
+			};
+			ParameterBox defaults;
+			defaults.SetParameter("A", Float4(1.f, 2.f, 3.f, 4.f));
+			defaults.SetParameter("B", Float4(5.f, 6.f, 7.f, 8.f));
+			defaults.SetParameter("C", Float4(9.f, 10.f, 11.f, 12.f));
+			RenderCore::Assets::PredefinedCBLayout allDefaults { MakeIteratorRange(elements), defaults };
+			RenderCore::Assets::CompiledCBWriter writer(allDefaults, {}, RenderCore::ShaderLanguage::HLSL);
+			REQUIRE(writer.GetStepCount() == 1);
+			REQUIRE(writer.BuildCBDataAsVector({}) == allDefaults.BuildCBDataAsVector({}, RenderCore::ShaderLanguage::HLSL));
+		}
+	}
+
+	TEST_CASE( "PredefinedCBLayout-CompiledWriterPerformance", "[rendercore_assets]" )
+	{
+		auto layout = MakeMaterialCBLayout();
+		auto params = MakeMaterialParameters();
+		auto lang = RenderCore::ShaderLanguage::HLSL;
+		RenderCore::Assets::CompiledCBWriter writer(layout, params, lang);
+		std::vector<uint8_t> buffer(writer.GetSize());
+
+		#if defined(_DEBUG)
+			const unsigned count = 10*1000;
+		#else
+			const unsigned count = 200*1000;
+		#endif
+		auto time = [&](auto&& fn) {
+			fn();		// (warm up)
+			auto start = std::chrono::steady_clock::now();
+			for (unsigned c=0; c<count; ++c) fn();
+			return std::chrono::duration_cast<std::chrono::duration<double, std::nano>>(std::chrono::steady_clock::now() - start).count() / count;
+		};
+		auto layoutTime = time([&]() { layout.BuildCB(MakeIteratorRange(buffer), params, lang); });
+		auto compiledTime = time([&]() { writer.BuildCB(MakeIteratorRange(buffer), params); });
+		std::cout << "Material CB (" << layout._elements.size() << " elements, " << writer.GetStepCount() << " compiled steps): PredefinedCBLayout::BuildCB: " << layoutTime << "ns, CompiledCBWriter::BuildCB: " << compiledTime << "ns (" << layoutTime / compiledTime << "x)" << std::endl;
+	}
+
 	static void TestHashingNormalizingAndScrambling(IteratorRange<const RenderCore::InputElementDesc*> inputAssembly)
 	{
 		using namespace RenderCore;
@@ -314,5 +442,224 @@ namespace UnitTests
 		}
 
 	}
+
+	TEST_CASE( "TextRunCache-Measurement", "[renderoverlays]" )
+	{
+		auto globalServices = ConsoleRig::MakeGlobalServices(GetStartupConfig());
+		auto mnt0 = ::Assets::MainFileSystem::GetMountingTree()->Mount("xleres", UnitTests::CreateEmbeddedResFileSystem());
+
+		auto futureFont = RenderOverlays::MakeFont("Petra", 16);
+		futureFont->StallWhilePending();
+		auto font = futureFont->Actualize();
+
+		const char* strings[] = {
+			"Frame time: 16.6ms",
+			"multi\nline\r\ntext",
+			"{Color:ff7f7f}colored{Color:} text",
+			""
+		};
+
+		const unsigned framesBeforeEviction = 32;
+		RenderOverlays::TextRunCache cache { framesBeforeEviction };
+		const unsigned repeats = 8;
+		for (unsigned r=0; r<repeats; ++r) {
+			for (auto s:strings) {
+				auto expected = RenderOverlays::StringWidthAndNewLineCount(*font, MakeStringSectionNullTerm(s));
+				auto cached = cache.StringWidthAndNewLineCount(*font, MakeStringSectionNullTerm(s));
+				REQUIRE(cached.first == expected.first);
+				REQUIRE(cached.second == expected.second);
+			}
+			cache.OnFrameBarrier();
+		}
+
+		// changing any of the parameters that effect the measurement should give a separate entry
+		REQUIRE(cache.StringWidth(*font, MakeStringSectionNullTerm(strings[0]), 1.f) == RenderOverlays::StringWidth(*font, MakeStringSectionNullTerm(strings[0]), 1.f));
+		REQUIRE(cache.StringWidth(*font, MakeStringSectionNullTerm(strings[0]), 0.f, true) == RenderOverlays::StringWidth(*font, MakeStringSectionNullTerm(strings[0]), 0.f, true));
+
+		auto metrics = cache.GetMetrics();
+		REQUIRE(metrics._measurements._lookups == repeats * dimof(strings) + 2);
+		REQUIRE(metrics._measurements._hits == (repeats-1) * dimof(strings));
+		REQUIRE(metrics._cachedMeasurements == dimof(strings) + 2);
+		std::cout << "Measurement hit rate: " << metrics._measurements.GetHitRate() << ", estimated time saved: " << metrics._measurements.GetEstimatedTimeSaved().count() << "ns" << std::endl;
+
+		// alignment via the cache should match the uncached path
+		auto q = RenderOverlays::Quad::MinMax(0.f, 0.f, 256.f, 128.f);
+		for (auto s:strings)
+			for (auto align:{RenderOverlays::TextAlignment::TopLeft, RenderOverlays::TextAlignment::Top, RenderOverlays::TextAlignment::Left, RenderOverlays::TextAlignment::Center, RenderOverlays::TextAlignment::BottomRight}) {
+				auto expected = RenderOverlays::AlignText(*font, q, align, MakeStringSectionNullTerm(s));
+				auto cached = RenderOverlays::AlignText(cache, *font, q, align, MakeStringSectionNullTerm(s));
+				REQUIRE(cached[0] == expected[0]);
+				REQUIRE(cached[1] == expected[1]);
+			}
+
+		// entries not used for a while should be evicted
+		for (unsigned c=0; c<2*framesBeforeEviction; ++c) {
+			cache.StringWidth(*font, MakeStringSectionNullTerm(strings[0]));
+			cache.OnFrameBarrier();
+		}
+		metrics = cache.GetMetrics();
+		REQUIRE(metrics._cachedMeasurements == 1);
+
+		cache.ResetMetrics();
+		REQUIRE(cache.GetMetrics()._measurements._lookups == 0);
+	}
+
+	TEST_CASE( "TextRunCache-GlyphInvalidation", "[renderoverlays]" )
+	{
+		// Cached runs hold pointers to the FontRenderingManager's glyph bitmaps. Those pointers can only be reused
+		// while _getBitmapsInvalidationIdx is unchanged; after glyphs are added or erased they must be looked up again
+		using namespace RenderCore;
+		auto globalServices = ConsoleRig::MakeGlobalServices(GetStartupConfig());
+		auto mnt0 = ::Assets::MainFileSystem::GetMountingTree()->Mount("xleres", UnitTests::CreateEmbeddedResFileSystem());
+		auto testHelper = MakeTestHelper();
+		auto threadContext = testHelper->_device->GetImmediateContext();
+
+		auto shapeRenderingDelegates = std::make_shared<RenderOverlays::ShapesRenderingDelegate>();
+		auto pipelineCollection = std::make_shared<Techniques::PipelineCollection>(testHelper->_device);
+		auto pipelineAccelerators = Techniques::CreatePipelineAcceleratorPool(testHelper->_device, nullptr, pipelineCollection, shapeRenderingDelegates->GetPipelineLayoutDelegate(), 0);
+		auto immediateDrawables = Techniques::CreateImmediateDrawables(pipelineAccelerators);
+
+		auto futureFont = RenderOverlays::MakeFont("Petra", 16);
+		futureFont->StallWhilePending();
+		auto font = futureFont->Actualize();
+
+		RenderOverlays::FontRenderingManager textureMan { *testHelper->_device };
+		auto& cache = textureMan.GetTextRunCache();
+
+		const char text[] = "Frame time: 16.6ms";
+		auto draw = [&]() {
+			return RenderOverlays::Draw(
+				*threadContext, *immediateDrawables, textureMan, *font, 0,
+				10.f, 20.f, 0.f, 0.f, MakeStringSectionNullTerm(text),
+				1.f, 0.f, RenderOverlays::ColorB::White);
+		};
+		auto expectedEnd = draw();
+		auto runKey = RenderOverlays::TextRunCache::MakeRunKey(*font, 0, MakeStringSectionNullTerm(text), 1.f, 0.f);
+		auto* run = cache.FindRun(runKey);
+		REQUIRE(run);
+
+		// a different string that happens to land on the same hash must not match
+		auto collidingKey = RenderOverlays::TextRunCache::MakeRunKey(*font, 0, MakeStringSectionNullTerm("Frame time: 33.3ms"), 1.f, 0.f);
+		collidingKey._hash = runKey._hash;
+		REQUIRE(!cache.FindRun(collidingKey));
+		REQUIRE(!run->_glyphs.empty());
+		REQUIRE(run->_bitmapsInvalidationIdx == textureMan._getBitmapsInvalidationIdx);
+
+		auto requireCurrentBitmaps = [&]() {
+			std::vector<const RenderOverlays::FontRenderingManager::Bitmap*> expected(run->_glyphs.size(), nullptr);
+			REQUIRE(textureMan.GetBitmaps(expected.data(), *threadContext, *font, run->_glyphs));
+			REQUIRE(run->_bitmaps == expected);
+			REQUIRE(run->_bitmapsInvalidationIdx == textureMan._getBitmapsInvalidationIdx);
+		};
+		requireCurrentBitmaps();
+
+		// Stand-in for a bitmap pointer that has gone stale. If the cache reuses it, the run will still
+		// reference it after the next draw
+		RenderOverlays::FontRenderingManager::Bitmap staleBitmap;
+		auto makeStale = [&]() { std::fill(run->_bitmaps.begin(), run->_bitmaps.end(), &staleBitmap); };
+
+		SECTION("Reused while the glyphs are unchanged")
+		{
+			auto bitmapsBefore = run->_bitmaps;
+			auto invalidationIdxBefore = textureMan._getBitmapsInvalidationIdx;
+			REQUIRE(draw() == expectedEnd);
+			REQUIRE(textureMan._getBitmapsInvalidationIdx == invalidationIdxBefore);
+			REQUIRE(run->_bitmaps == bitmapsBefore);
+			REQUIRE(cache.GetMetrics()._runs._hits == 1);
+		}
+
+		SECTION("Revalidated after new glyphs are added")
+		{
+			auto invalidationIdxBefore = textureMan._getBitmapsInvalidationIdx;
+			const ucs4 newGlyphs[] { 'Q', 'W', 'X', 'Z' };		// none of these are in "text"
+			const RenderOverlays::FontRenderingManager::Bitmap* newBitmaps[dimof(newGlyphs)];
+			REQUIRE(textureMan.GetBitmaps(newBitmaps, *threadContext, *font, MakeIteratorRange(newGlyphs)));
+			REQUIRE(textureMan._getBitmapsInvalidationIdx != invalidationIdxBefore);
+
+			makeStale();
+			REQUIRE(draw() == expectedEnd);
+			REQUIRE(cache.GetMetrics()._runs._hits == 1);
+			requireCurrentBitmaps();
+		}
+
+		SECTION("Revalidated after glyphs are erased")
+		{
+			// Every place that erases or moves glyphs increments _getBitmapsInvalidationIdx; do the same here
+			// to simulate an eviction, without having to fill the font heap
+			++textureMan._getBitmapsInvalidationIdx;
+			makeStale();
+			REQUIRE(draw() == expectedEnd);
+			REQUIRE(cache.GetMetrics()._runs._hits == 1);
+			requireCurrentBitmaps();
+
+			// with the pointers revalidated, they can be reused again
+			auto bitmapsBefore = run->_bitmaps;
+			REQUIRE(draw() == expectedEnd);
+			REQUIRE(run->_bitmaps == bitmapsBefore);
+			REQUIRE(cache.GetMetrics()._runs._hits == 2);
+		}
+
+		immediateDrawables->AbandonDraws();
+	}
+
+	TEST_CASE( "MeshRaycaster", "[rendercore_assets]" )
+	{
+		// compare the clustered raycaster against testing every triangle
+		std::mt19937 rng(3426781);
+		std::uniform_real_distribution<float> position(-10.f, 10.f), offset(-1.f, 1.f);
+		std::vector<Float3> vertexPositions;
+		std::vector<unsigned> flatTriList;
+		const unsigned triangleCount = 2000;
+		for (unsigned t=0; t<triangleCount; ++t) {
+			Float3 center { position(rng), position(rng), position(rng) };
+			for (unsigned c=0; c<3; ++c) {
+				flatTriList.push_back((unsigned)vertexPositions.size());
+				vertexPositions.push_back(center + Float3{offset(rng), offset(rng), offset(rng)});
+			}
+		}
+		std::shuffle(flatTriList.begin(), flatTriList.end(), rng);
+
+		RenderCore::Assets::GeoProc::MeshDatabase mesh;
+		mesh.AddStream(
+			RenderCore::Assets::GeoProc::CreateRawDataSource(vertexPositions, RenderCore::Format::R32G32B32_FLOAT),
+			{}, "POSITION", 0);
+		RenderCore::Assets::GeoProc::MeshRaycaster raycaster{mesh, MakeIteratorRange(flatTriList)};
+		REQUIRE(raycaster.GetTriangleCount() == triangleCount);
+
+		unsigned hitCount = 0;
+		std::vector<RenderCore::Assets::GeoProc::MeshRaycaster::Intersection> allIntersections;
+		for (unsigned r=0; r<500; ++r) {
+			std::pair<Float3, Float3> ray { Float3{position(rng), position(rng), position(rng)}, Float3{position(rng), position(rng), position(rng)} };
+
+			float closestAlpha = std::numeric_limits<float>::max();
+			unsigned closestTriangle = ~0u, expectedHitCount = 0;
+			for (unsigned t=0; t<triangleCount; ++t) {
+				float alpha;
+				if (RayVsTriangle(alpha, ray, vertexPositions[flatTriList[t*3]], vertexPositions[flatTriList[t*3+1]], vertexPositions[flatTriList[t*3+2]])) {
+					++expectedHitCount;
+					if (alpha < closestAlpha) { closestAlpha = alpha; closestTriangle = t; }
+				}
+			}
+
+			auto first = raycaster.FirstIntersection(ray);
+			REQUIRE(first.has_value() == (closestTriangle != ~0u));
+			if (first) {
+				REQUIRE(first->_triangleIndex == closestTriangle);
+				REQUIRE(first->_alpha == closestAlpha);
+				++hitCount;
+			}
+
+			allIntersections.clear();
+			raycaster.AllIntersections(allIntersections, ray);
+			REQUIRE(allIntersections.size() == expectedHitCount);
+			REQUIRE(std::is_sorted(allIntersections.begin(), allIntersections.end(), [](const auto& lhs, const auto& rhs) { return lhs._alpha < rhs._alpha; }));
+			if (!allIntersections.empty())
+				REQUIRE(allIntersections[0]._alpha == closestAlpha);
+		}
+		REQUIRE(hitCount > 50);
+
+		RenderCore::Assets::GeoProc::MeshRaycaster emptyRaycaster;
+		REQUIRE(!emptyRaycaster.FirstIntersection({Float3{0,0,-1}, Float3{0,0,1}}).has_value());
+	}
 }
 
@@ -169,4 +169,172 @@ namespace UnitTests
 			REQUIRE(finalFBDesc.GetAttachments().size() == 4);
 		}
 	}
+
+	TEST_CASE( "RenderPassManagement-TransientAliasing", "[rendercore_techniques]" )
+	{
+		using namespace RenderCore;
+		using namespace RenderCore::Techniques;
+
+		// Sequence of 3 frame buffers
+		//		0: write "Lighting" (retained) and a temporary
+		//		1: read and discard "Lighting", write a second temporary
+		//		2: write ColorLDR (retained after the sequence) and a third temporary
+		// Only ColorLDR is persistent. The temporaries in frame buffers 0 & 2 don't overlap, and nor
+		// do "Lighting" and the temporary in frame buffer 2
+		const uint64_t lightingSemantic = 0x7e57a71a5ull;
+		FragmentStitchingContext stitchingContext;
+		FrameBufferProperties fbProps { 1024, 1024 };
+		DefineTestAttachments(stitchingContext, 0, UInt2(1024, 1024));
+
+		std::vector<FragmentStitchingContext::StitchResult> stitched;
+		{
+			FrameBufferDescFragment fragment;
+			SubpassDesc subpass;
+			subpass.AppendOutput(fragment.DefineAttachment(lightingSemantic).FixedFormat(Format::R16G16B16A16_FLOAT).RequireBindFlags(BindFlag::InputAttachment).NoInitialState());
+			subpass.AppendOutput(fragment.DefineAttachment(0).FixedFormat(Format::R8G8B8A8_UNORM).NoInitialState().Discard());
+			fragment.AddSubpass(std::move(subpass));
+			stitched.push_back(stitchingContext.TryStitchFrameBufferDesc(fragment, fbProps));
+			stitchingContext.UpdateAttachments(stitched.back());
+		}
+		{
+			FrameBufferDescFragment fragment;
+			SubpassDesc subpass;
+			subpass.AppendInput(fragment.DefineAttachment(lightingSemantic).Discard());
+			subpass.AppendOutput(fragment.DefineAttachment(0).FixedFormat(Format::R32_FLOAT).NoInitialState().Discard());
+			fragment.AddSubpass(std::move(subpass));
+			stitched.push_back(stitchingContext.TryStitchFrameBufferDesc(fragment, fbProps));
+			stitchingContext.UpdateAttachments(stitched.back());
+		}
+		{
+			FrameBufferDescFragment fragment;
+			SubpassDesc subpass;
+			subpass.AppendOutput(fragment.DefineAttachment(AttachmentSemantics::ColorLDR).NoInitialState());
+			subpass.AppendOutput(fragment.DefineAttachment(0).FixedFormat(Format::R16G16B16A16_FLOAT).NoInitialState().Discard());
+			fragment.AddSubpass(std::move(subpass));
+			stitched.push_back(stitchingContext.TryStitchFrameBufferDesc(fragment, fbProps));
+			stitchingContext.UpdateAttachments(stitched.back());
+		}
+
+		auto aliasing = CalculateTransientAttachmentAliasing(MakeIteratorRange(stitched));
+		INFO(aliasing);
+		REQUIRE(aliasing._transients.size() == 4);
+
+		const size_t fullRes32bpp = 1024*1024*4, fullRes64bpp = 1024*1024*8;
+		REQUIRE(aliasing._unaliasedBytes == 2*fullRes64bpp + 2*fullRes32bpp);
+		REQUIRE(aliasing._persistentBytes == fullRes32bpp);
+		REQUIRE(aliasing._peakLiveBytes == fullRes64bpp + fullRes32bpp);
+		REQUIRE(aliasing._aliasedBytes == aliasing._peakLiveBytes);		// simple enough that packing is optimal
+		REQUIRE(aliasing._aliasedBytes < aliasing._unaliasedBytes);
+
+		// "Lighting" is a single transient that covers frame buffers 0 & 1
+		auto lighting = std::find_if(aliasing._transients.begin(), aliasing._transients.end(), [](const auto& t) { return t._semantic == lightingSemantic; });
+		REQUIRE(lighting != aliasing._transients.end());
+		REQUIRE(lighting->_firstFrameBuffer == 0);
+		REQUIRE(lighting->_lastFrameBuffer == 1);
+		REQUIRE(lighting->_references.size() == 2);
+
+		// Transients alive at the same time must not overlap in memory
+		for (const auto& a:aliasing._transients)
+			for (const auto& b:aliasing._transients) {
+				if (&a == &b || a._block != b._block) continue;
+				if (a._lastFrameBuffer < b._firstFrameBuffer || b._lastFrameBuffer < a._firstFrameBuffer) continue;
+				REQUIRE((a._blockOffset + a._byteCount <= b._blockOffset || b._blockOffset + b._byteCount <= a._blockOffset));
+			}
+
+		// the 64bpp temporary in frame buffer 2 can take the memory used by "Lighting"
+		auto lightingPlacement = aliasing.Find(0, lighting->_references[0].second);
+		auto finalTemporary = std::find_if(aliasing._transients.begin(), aliasing._transients.end(), [](const auto& t) { return t._firstFrameBuffer == 2; });
+		REQUIRE(finalTemporary != aliasing._transients.end());
+		REQUIRE(finalTemporary->_block == lightingPlacement.first);
+		REQUIRE(finalTemporary->_blockOffset == lightingPlacement.second);
+	}
+
+	static std::vector<RenderCore::Techniques::FragmentStitchingContext::StitchResult> StitchCacheTestSequence(
+		std::shared_ptr<RenderCore::Techniques::FragmentStitchingCache> cache,
+		UInt2 dims)
+	{
+		using namespace RenderCore;
+		using namespace RenderCore::Techniques;
+
+		const uint64_t lightingSemantic = 0x7e57a71a5ull;
+		FragmentStitchingContext stitchingContext;
+		stitchingContext._cache = std::move(cache);
+		FrameBufferProperties fbProps { dims[0], dims[1] };
+		DefineTestAttachments(stitchingContext, 0, dims);
+
+		std::vector<FragmentStitchingContext::StitchResult> stitched;
+		{
+			// 2 fragments merged into the same frame buffer
+			FrameBufferDescFragment fragments[2];
+			SubpassDesc subpass0;
+			subpass0.SetDepthStencil(fragments[0].DefineAttachment(AttachmentSemantics::MultisampleDepth).Clear());
+			subpass0.AppendOutput(fragments[0].DefineAttachment(lightingSemantic).FixedFormat(Format::R16G16B16A16_FLOAT).RequireBindFlags(BindFlag::InputAttachment).NoInitialState());
+			fragments[0].AddSubpass(std::move(subpass0));
+			SubpassDesc subpass1;
+			subpass1.AppendInput(fragments[1].DefineAttachment(lightingSemantic).Discard());
+			subpass1.AppendOutput(fragments[1].DefineAttachment(AttachmentSemantics::ColorLDR).NoInitialState());
+			fragments[1].AddSubpass(std::move(subpass1));
+			stitched.push_back(stitchingContext.TryStitchFrameBufferDesc(MakeIteratorRange(fragments), fbProps));
+			stitchingContext.UpdateAttachments(stitched.back());
+		}
+		{
+			FrameBufferDescFragment fragment;
+			SubpassDesc subpass;
+			subpass.AppendOutput(fragment.DefineAttachment(AttachmentSemantics::ColorLDR));
+			subpass.AppendOutput(fragment.DefineAttachment(0).FixedFormat(Format::R8G8B8A8_UNORM).NoInitialState().Discard());
+			fragment.AddSubpass(std::move(subpass));
+			stitched.push_back(stitchingContext.TryStitchFrameBufferDesc(fragment, fbProps));
+			stitchingContext.UpdateAttachments(stitched.back());
+		}
+		return stitched;
+	}
+
+	TEST_CASE( "RenderPassManagement-StitchingCache", "[rendercore_techniques]" )
+	{
+		using namespace RenderCore;
+		using namespace RenderCore::Techniques;
+
+		auto cache = std::make_shared<FragmentStitchingCache>();
+		auto initial = StitchCacheTestSequence(cache, UInt2(1024, 1024));
+		REQUIRE(cache->GetMetrics()._misses == 2);
+		REQUIRE(cache->GetMetrics()._hits == 0);
+
+		// Rebuilding at a new resolution should reuse the merged fragments and give the same result as
+		// stitching from scratch
+		auto resized = StitchCacheTestSequence(cache, UInt2(640, 480));
+		REQUIRE(cache->GetMetrics()._misses == 2);
+		REQUIRE(cache->GetMetrics()._hits == 2);
+
+		auto uncached = StitchCacheTestSequence(nullptr, UInt2(640, 480));
+		REQUIRE(resized.size() == uncached.size());
+		for (unsigned c=0; c<resized.size(); ++c) {
+			REQUIRE(resized[c]._fbDesc.GetHash() == uncached[c]._fbDesc.GetHash());
+			REQUIRE(resized[c]._fbDesc.GetHashExcludingDimensions() == initial[c]._fbDesc.GetHashExcludingDimensions());
+			REQUIRE(resized[c]._fbDesc.GetHash() != initial[c]._fbDesc.GetHash());
+			REQUIRE(resized[c]._fullAttachmentDescriptions.size() == uncached[c]._fullAttachmentDescriptions.size());
+			for (unsigned a=0; a<resized[c]._fullAttachmentDescriptions.size(); ++a) {
+				REQUIRE(resized[c]._fullAttachmentDescriptions[a].CalculateHash() == uncached[c]._fullAttachmentDescriptions[a].CalculateHash());
+				REQUIRE(resized[c]._fullAttachmentDescriptions[a]._desc._textureDesc._width == 640);
+				REQUIRE(resized[c]._fullAttachmentDescriptions[a]._desc._textureDesc._height == 480);
+			}
+		}
+
+		// A change to the formats of the attachments can't use the cached merges
+		{
+			FragmentStitchingContext stitchingContext;
+			stitchingContext._cache = cache;
+			FrameBufferProperties fbProps { 640, 480 };
+			stitchingContext.DefineAttachment(
+				AttachmentSemantics::ColorLDR,
+				CreateDesc(BindFlag::RenderTarget | BindFlag::TransferSrc | BindFlag::PresentationSrc, TextureDesc::Plain2D(640, 480, Format::R10G10B10A2_UNORM)),
+				"color-ldr", PreregisteredAttachment::State::Uninitialized, BindFlag::PresentationSrc);
+			FrameBufferDescFragment fragment;
+			SubpassDesc subpass;
+			subpass.AppendOutput(fragment.DefineAttachment(AttachmentSemantics::ColorLDR).NoInitialState());
+			fragment.AddSubpass(std::move(subpass));
+			stitchingContext.TryStitchFrameBufferDesc(fragment, fbProps);
+			REQUIRE(cache->GetMetrics()._misses == 3);
+			REQUIRE(cache->GetMetrics()._hits == 2);
+		}
+	}
 }
@@ -360,6 +360,95 @@ static const int NonPreprocessorLine0 = 0;
 		::Assets::MainFileSystem::GetMountingTree()->Unmount(utDataMount);
 	}
 
+	TEST_CASE( "ShaderParser-InstantiationCache", "[shader_parser]" )
+	{
+		auto globalServices = ConsoleRig::MakeGlobalServices(GetStartupConfig());
+		auto utDataMount = ::Assets::MainFileSystem::GetMountingTree()->Mount("ut-data", ::Assets::CreateFileSystem_Memory(s_utData, s_defaultFilenameRules, ::Assets::FileSystemMemoryFlags::UseModuleModificationTime));
+		auto mnt0 = ::Assets::MainFileSystem::GetMountingTree()->Mount("xleres", UnitTests::CreateEmbeddedResFileSystem());
+
+		// Instantiating the same graph repeatedly (eg, for different selector sets) should reuse both the
+		// parsed graph file and the generated functions, and produce the same result each time
+		using namespace ShaderSourceParser;
+		ClearInstantiationCaches();
+		ResetInstantiationCacheMetrics();
+		GraphLanguage::ResetGraphSyntaxCacheMetrics();
+
+		ShaderSourceParser::InstantiationRequest instRequests[] { { "ut-data/example.graph" } };
+		ShaderSourceParser::GenerateFunctionOptions generateOptions;
+		generateOptions._shaderLanguage = RenderCore::ShaderLanguage::GLSL;
+		generateOptions._filterWithSelectors = true;
+		generateOptions._selectors.SetParameter("UNRELATED_SELECTOR", 1);
+		auto firstInst = InstantiateShader(MakeIteratorRange(instRequests), generateOptions);
+
+		auto metrics = GetInstantiationCacheMetrics();
+		REQUIRE(metrics._lookups != 0);
+		REQUIRE(metrics._hits == 0);
+
+		// The selectors don't influence this graph, so a different selector set should still hit the cache
+		generateOptions._selectors.SetParameter("UNRELATED_SELECTOR", 2);
+		generateOptions._selectors.SetParameter("ANOTHER_SELECTOR", 1);
+		auto secondInst = InstantiateShader(MakeIteratorRange(instRequests), generateOptions);
+
+		metrics = GetInstantiationCacheMetrics();
+		REQUIRE(metrics._hits != 0);
+		REQUIRE(metrics._hits == metrics._lookups / 2);
+		REQUIRE(GraphLanguage::GetGraphSyntaxCacheMetrics()._hits != 0);
+
+		REQUIRE(firstInst._sourceFragments == secondInst._sourceFragments);
+		REQUIRE(firstInst._entryPoints.size() == secondInst._entryPoints.size());
+		REQUIRE(firstInst._selectorRelevance == secondInst._selectorRelevance);
+		REQUIRE(firstInst._depVals == secondInst._depVals);
+
+		// After clearing, we should regenerate everything again
+		ClearInstantiationCaches();
+		ResetInstantiationCacheMetrics();
+		auto thirdInst = InstantiateShader(MakeIteratorRange(instRequests), generateOptions);
+		REQUIRE(GetInstantiationCacheMetrics()._hits == 0);
+		REQUIRE(firstInst._sourceFragments == thirdInst._sourceFragments);
+
+		::Assets::MainFileSystem::GetMountingTree()->Unmount(mnt0);
+		::Assets::MainFileSystem::GetMountingTree()->Unmount(utDataMount);
+	}
+
+	TEST_CASE( "ShaderParser-InstantiationCacheLifetime", "[shader_parser]" )
+	{
+		// The instantiation caches hold dependency validations, so they must not carry entries over from one
+		// dep val system to the next (ie, from one set of global services to the next)
+		using namespace ShaderSourceParser;
+		auto instantiate = []() {
+			auto utDataMount = ::Assets::MainFileSystem::GetMountingTree()->Mount("ut-data", ::Assets::CreateFileSystem_Memory(s_utData, s_defaultFilenameRules, ::Assets::FileSystemMemoryFlags::UseModuleModificationTime));
+			auto mnt0 = ::Assets::MainFileSystem::GetMountingTree()->Mount("xleres", UnitTests::CreateEmbeddedResFileSystem());
+			ShaderSourceParser::InstantiationRequest instRequests[] { { "ut-data/example.graph" } };
+			ShaderSourceParser::GenerateFunctionOptions generateOptions;
+			generateOptions._shaderLanguage = RenderCore::ShaderLanguage::GLSL;
+			auto result = InstantiateShader(MakeIteratorRange(instRequests), generateOptions);
+			::Assets::MainFileSystem::GetMountingTree()->Unmount(mnt0);
+			::Assets::MainFileSystem::GetMountingTree()->Unmount(utDataMount);
+			return result._sourceFragments;
+		};
+
+		std::vector<std::string> firstFragments;
+		{
+			auto globalServices = ConsoleRig::MakeGlobalServices(GetStartupConfig());
+			firstFragments = instantiate();
+			ResetInstantiationCacheMetrics();
+			GraphLanguage::ResetGraphSyntaxCacheMetrics();
+			instantiate();
+			REQUIRE(GetInstantiationCacheMetrics()._hits != 0);
+			REQUIRE(GraphLanguage::GetGraphSyntaxCacheMetrics()._hits != 0);
+		}
+
+		{
+			auto globalServices = ConsoleRig::MakeGlobalServices(GetStartupConfig());
+			ResetInstantiationCacheMetrics();
+			GraphLanguage::ResetGraphSyntaxCacheMetrics();
+			auto secondFragments = instantiate();
+			REQUIRE(GetInstantiationCacheMetrics()._hits == 0);
+			REQUIRE(GraphLanguage::GetGraphSyntaxCacheMetrics()._hits == 0);
+			REQUIRE(firstFragments == secondFragments);
+		}
+	}
+
 	TEST_CASE( "ShaderParser-SelectorPreconfiguration", "[shader_parser]" )
 	{
 		auto globalServices = ConsoleRig::MakeGlobalServices(GetStartupConfig());
@@ -0,0 +1,305 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../../../RenderCore/Assets/TextureCompression.h"
+#include "../../../RenderCore/Assets/MipGeneration.h"
+#include "../../../RenderCore/ResourceUtils.h"
+#include "../../../RenderCore/Format.h"
+#include "../../../Utility/Threading/CompletionThreadPool.h"
+#include "../../../Utility/PtrUtils.h"
+#include "catch2/catch_test_macros.hpp"
+#include <vector>
+#include <random>
+#include <iostream>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+using namespace RenderCore;
+using namespace RenderCore::Assets;
+
+namespace UnitTests
+{
+	namespace Internal
+	{
+		static std::vector<uint8_t> MakeSyntheticTexture(unsigned width, unsigned height, std::mt19937& rng)
+		{
+			// smooth gradients with a little noise, which is roughly what block compressors see in practice
+			std::vector<uint8_t> result(width*height*4);
+			std::uniform_int_distribution<int> noise(-6, 6);
+			for (unsigned y=0; y<height; ++y)
+				for (unsigned x=0; x<width; ++x) {
+					auto* p = &result[(y*width+x)*4];
+					p[0] = (uint8_t)std::clamp(int(x*255/width) + noise(rng), 0, 255);
+					p[1] = (uint8_t)std::clamp(int(y*255/height) + noise(rng), 0, 255);
+					p[2] = (uint8_t)std::clamp(int(127.f + 127.f*std::sin((x+y)/37.f)) + noise(rng), 0, 255);
+					p[3] = (uint8_t)std::clamp(int((x^y)&0xff) , 0, 255);
+				}
+			return result;
+		}
+
+		static void Decode565(uint16_t c, int rgb[3])
+		{
+			rgb[0] = ((c >> 11) & 0x1f) * 255 / 31;
+			rgb[1] = ((c >> 5) & 0x3f) * 255 / 63;
+			rgb[2] = (c & 0x1f) * 255 / 31;
+		}
+
+		static float BC1RootMeanSquareError(const uint8_t* blocks, const uint8_t* rgba, unsigned width, unsigned height)
+		{
+			double sumSq = 0.;
+			for (unsigned by=0; by<height/4; ++by)
+				for (unsigned bx=0; bx<width/4; ++bx) {
+					const auto* block = blocks + (by*(width/4)+bx)*8;
+					uint16_t c0, c1; uint32_t indices;
+					std::memcpy(&c0, block, 2); std::memcpy(&c1, block+2, 2); std::memcpy(&indices, block+4, 4);
+					int palette[4][3];
+					Decode565(c0, palette[0]); Decode565(c1, palette[1]);
+					for (unsigned c=0; c<3; ++c) {
+						if (c0 > c1) {
+							palette[2][c] = (2*palette[0][c] + palette[1][c]) / 3;
+							palette[3][c] = (palette[0][c] + 2*palette[1][c]) / 3;
+						} else {
+							palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+							palette[3][c] = 0;
+						}
+					}
+					for (unsigned p=0; p<16; ++p) {
+						auto idx = (indices >> (p*2)) & 3;
+						const auto* src = rgba + (((by*4+p/4)*width) + bx*4+p%4)*4;
+						for (unsigned c=0; c<3; ++c) {
+							auto d = double(palette[idx][c]) - double(src[c]);
+							sumSq += d*d;
+						}
+					}
+				}
+			return (float)std::sqrt(sumSq / double(width*height*3));
+		}
+
+		static float BC4RootMeanSquareError(const uint8_t* blocks, const uint8_t* rgba, unsigned width, unsigned height)
+		{
+			double sumSq = 0.;
+			for (unsigned by=0; by<height/4; ++by)
+				for (unsigned bx=0; bx<width/4; ++bx) {
+					const auto* block = blocks + (by*(width/4)+bx)*8;
+					int a0 = block[0], a1 = block[1];
+					int palette[8] = { a0, a1 };
+					if (a0 > a1) {
+						for (int c=1; c<7; ++c) palette[c+1] = ((7-c)*a0 + c*a1) / 7;
+					} else {
+						for (int c=1; c<5; ++c) palette[c+1] = ((5-c)*a0 + c*a1) / 5;
+						palette[6] = 0; palette[7] = 255;
+					}
+					uint64_t indices = 0;
+					std::memcpy(&indices, block+2, 6);
+					for (unsigned p=0; p<16; ++p) {
+						auto idx = (indices >> (p*3)) & 7;
+						const auto* src = rgba + (((by*4+p/4)*width) + bx*4+p%4)*4;
+						auto d = double(palette[idx]) - double(src[0]);
+						sumSq += d*d;
+					}
+				}
+			return (float)std::sqrt(sumSq / double(width*height));
+		}
+	}
+
+	TEST_CASE( "TextureCompression-Correctness", "[rendercore_assets]" )
+	{
+		std::mt19937 rng(6492751);
+		const unsigned width = 256, height = 256;
+		auto srcPixels = Internal::MakeSyntheticTexture(width, height, rng);
+		auto srcDesc = TextureDesc::Plain2D(width, height, Format::R8G8B8A8_UNORM);
+		auto srcRange = MakeIteratorRange(srcPixels);
+		ThreadPool threadPool(4);
+
+		SECTION("BC1 & BC4 error")
+		{
+			auto bc1Desc = TextureDesc::Plain2D(width, height, Format::BC1_UNORM);
+			std::vector<uint8_t> bc1(ByteCount(bc1Desc));
+			CompressTextureParallel(MakeIteratorRange(bc1), bc1Desc, srcRange, srcDesc, {}, &threadPool);
+			auto bc1Error = Internal::BC1RootMeanSquareError(bc1.data(), srcPixels.data(), width, height);
+			REQUIRE(bc1Error < 8.f);
+
+			auto bc4Desc = TextureDesc::Plain2D(width, height, Format::BC4_UNORM);
+			std::vector<uint8_t> bc4(ByteCount(bc4Desc));
+			CompressTextureParallel(MakeIteratorRange(bc4), bc4Desc, srcRange, srcDesc, {}, &threadPool);
+			auto bc4Error = Internal::BC4RootMeanSquareError(bc4.data(), srcPixels.data(), width, height);
+			REQUIRE(bc4Error < 4.f);
+		}
+
+		SECTION("Threaded output matches single threaded output")
+		{
+			// includes generated mips, so this also checks that compression jobs wait for their mip level
+			MipGenerationSettings lanczosWithCoverage;
+			lanczosWithCoverage._filter = MipFilter::Lanczos;
+			lanczosWithCoverage._alphaCoverageReference = 0.5f;
+			for (auto fmt:{Format::BC1_UNORM, Format::BC3_UNORM, Format::BC4_UNORM, Format::BC5_UNORM, Format::R8G8B8A8_UNORM, Format::BC3_UNORM_SRGB})
+				for (const auto& mipSettings:{MipGenerationSettings{}, lanczosWithCoverage}) {
+					auto dstDesc = TextureDesc::Plain2D(width, height, fmt, 9);
+					std::vector<uint8_t> singleThreaded(ByteCount(dstDesc), 0xcd), threaded(ByteCount(dstDesc), 0xab);
+					CompressTextureParallel(MakeIteratorRange(singleThreaded), dstDesc, srcRange, srcDesc, mipSettings, nullptr);
+					TextureCompressionMetrics metrics;
+					CompressTextureParallel(MakeIteratorRange(threaded), dstDesc, srcRange, srcDesc, mipSettings, &threadPool, &metrics);
+					REQUIRE(singleThreaded == threaded);
+					REQUIRE(metrics._generatedMipLevels == 8);
+				}
+		}
+
+		SECTION("Unsupported conversions")
+		{
+			REQUIRE(!CanCompressTextureParallel(srcDesc, Format::R32G32B32A32_FLOAT));
+			REQUIRE(!UsesBuiltInBlockEncoder(srcDesc, Format::R32G32B32A32_FLOAT));
+			REQUIRE(!UsesBuiltInBlockEncoder(srcDesc, srcDesc._format));		// just a copy (plus mip generation)
+			REQUIRE(UsesBuiltInBlockEncoder(srcDesc, Format::BC4_UNORM));		// no ISPC kernel for BC4
+			auto dstDesc = TextureDesc::Plain2D(width, height, Format::R32G32B32A32_FLOAT);
+			std::vector<uint8_t> dst(ByteCount(dstDesc));
+			REQUIRE_THROWS(CompressTextureParallel(MakeIteratorRange(dst), dstDesc, srcRange, srcDesc, {}, &threadPool));
+
+			auto smallDesc = TextureDesc::Plain2D(width, height, Format::BC1_UNORM);
+			std::vector<uint8_t> small(ByteCount(smallDesc)/2);
+			REQUIRE_THROWS(CompressTextureParallel(MakeIteratorRange(small), smallDesc, srcRange, srcDesc, {}, &threadPool));
+		}
+	}
+
+	TEST_CASE( "TextureCompression-MipGeneration", "[rendercore_assets]" )
+	{
+		ThreadPool threadPool(4);
+
+		SECTION("sRGB data is filtered in linear space")
+		{
+			// 1 pixel checkerboard of black & white; the average in linear space is 0.5, which is 188 in sRGB
+			const unsigned width = 64, height = 64;
+			std::vector<uint8_t> checker(width*height*4);
+			for (unsigned y=0; y<height; ++y)
+				for (unsigned x=0; x<width; ++x)
+					std::memset(&checker[(y*width+x)*4], ((x^y)&1) ? 0xff : 0, 4);
+			for (auto fmt:{Format::R8G8B8A8_UNORM, Format::R8G8B8A8_UNORM_SRGB}) {
+				auto srcDesc = TextureDesc::Plain2D(width, height, fmt);
+				auto dstDesc = TextureDesc::Plain2D(width, height, fmt, 2);
+				std::vector<uint8_t> dst(ByteCount(dstDesc));
+				CompressTextureParallel(MakeIteratorRange(dst), dstDesc, MakeIteratorRange(checker), srcDesc, {}, &threadPool);
+				auto mip1 = GetSubResourceOffset(dstDesc, 1, 0);
+				auto expected = (fmt == Format::R8G8B8A8_UNORM_SRGB) ? 188 : 128;
+				REQUIRE(std::abs(int(dst[mip1._offset]) - expected) <= 1);
+				REQUIRE(std::abs(int(dst[mip1._offset+3]) - 128) <= 1);		// alpha is never gamma encoded
+			}
+		}
+
+		SECTION("Filters preserve constant images")
+		{
+			const unsigned width = 37, height = 20;		// (also checks non power of 2 dimensions)
+			std::vector<uint8_t> constant(width*height*4);
+			for (unsigned c=0; c<constant.size(); ++c) constant[c] = uint8_t(40 + (c%4)*50);
+			auto srcDesc = TextureDesc::Plain2D(width, height, Format::R8G8B8A8_UNORM);
+			for (auto filter:{MipFilter::Box, MipFilter::Kaiser, MipFilter::Lanczos}) {
+				MipGenerationSettings settings;
+				settings._filter = filter;
+				auto dstDesc = TextureDesc::Plain2D(width, height, Format::R8G8B8A8_UNORM, 6);
+				std::vector<uint8_t> dst(ByteCount(dstDesc));
+				CompressTextureParallel(MakeIteratorRange(dst), dstDesc, MakeIteratorRange(constant), srcDesc, settings, &threadPool);
+				for (unsigned c=0; c<dst.size(); ++c)
+					REQUIRE(std::abs(int(dst[c]) - int(40 + (c%4)*50)) <= 1);
+			}
+		}
+
+		SECTION("Normal maps are renormalized")
+		{
+			const unsigned width = 128, height = 128;
+			std::mt19937 rng(9385721);
+			std::uniform_real_distribution<float> angle(0.f, 1.2f), rotation(0.f, 6.283f);
+			std::vector<uint8_t> normals(width*height*4);
+			for (unsigned p=0; p<width*height; ++p) {
+				float a = angle(rng), r = rotation(rng);
+				float n[3] { std::sin(a)*std::cos(r), std::sin(a)*std::sin(r), std::cos(a) };
+				for (unsigned c=0; c<3; ++c) normals[p*4+c] = uint8_t((n[c]*0.5f+0.5f)*255.f + 0.5f);
+				normals[p*4+3] = 0xff;
+			}
+			auto srcDesc = TextureDesc::Plain2D(width, height, Format::R8G8B8A8_UNORM);
+			auto dstDesc = TextureDesc::Plain2D(width, height, Format::R8G8B8A8_UNORM, 8);
+			MipGenerationSettings settings;
+			settings._filter = MipFilter::Kaiser;
+			settings._normalMap = true;
+			std::vector<uint8_t> dst(ByteCount(dstDesc));
+			CompressTextureParallel(MakeIteratorRange(dst), dstDesc, MakeIteratorRange(normals), srcDesc, settings, &threadPool);
+			for (unsigned m=1; m<8; ++m) {
+				auto offset = GetSubResourceOffset(dstDesc, m, 0);
+				for (unsigned p=0; p<offset._size/4; ++p) {
+					auto* texel = &dst[offset._offset+p*4];
+					float n[3] { texel[0]/255.f*2.f-1.f, texel[1]/255.f*2.f-1.f, texel[2]/255.f*2.f-1.f };
+					REQUIRE(std::abs(std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]) - 1.f) < 0.02f);
+				}
+			}
+		}
+
+		SECTION("Alpha coverage is preserved")
+		{
+			// noisy alpha, which converges on the mean under normal filtering and so fades away when alpha tested
+			const unsigned width = 256, height = 256;
+			std::mt19937 rng(5729384);
+			std::vector<uint8_t> foliage(width*height*4, 0x80);
+			for (unsigned p=0; p<width*height; ++p)
+				foliage[p*4+3] = uint8_t(std::uniform_int_distribution<>(0, 255)(rng));
+			auto srcDesc = TextureDesc::Plain2D(width, height, Format::R8G8B8A8_UNORM);
+			auto dstDesc = TextureDesc::Plain2D(width, height, Format::R8G8B8A8_UNORM, 7);
+			MipGenerationSettings settings;
+			settings._alphaCoverageReference = 0.75f;
+			std::vector<uint8_t> preserved(ByteCount(dstDesc)), plain(ByteCount(dstDesc));
+			CompressTextureParallel(MakeIteratorRange(preserved), dstDesc, MakeIteratorRange(foliage), srcDesc, settings, &threadPool);
+			CompressTextureParallel(MakeIteratorRange(plain), dstDesc, MakeIteratorRange(foliage), srcDesc, {}, &threadPool);
+
+			MipGenerator generator(Format::R8G8B8A8_UNORM, settings, false);
+			auto levelView = [&](std::vector<uint8_t>& data, unsigned m) {
+				auto offset = GetSubResourceOffset(dstDesc, m, 0);
+				return MipGenerator::LevelView { &data[offset._offset], offset._pitches._rowPitch, std::max(1u, width>>m), std::max(1u, height>>m) };
+			};
+			// coverage can only change in steps at low resolutions, so just require it to be no worse than plain filtering, and much better overall
+			auto topCoverage = generator.CalculateAlphaCoverage(levelView(preserved, 0));
+			float preservedErrorSum = 0.f, plainErrorSum = 0.f;
+			for (unsigned m=1; m<7; ++m) {
+				auto preservedError = std::abs(generator.CalculateAlphaCoverage(levelView(preserved, m)) - topCoverage);
+				auto plainError = std::abs(generator.CalculateAlphaCoverage(levelView(plain, m)) - topCoverage);
+				REQUIRE(preservedError <= plainError);
+				preservedErrorSum += preservedError;
+				plainErrorSum += plainError;
+			}
+			REQUIRE(preservedErrorSum < 0.5f * plainErrorSum);
+		}
+	}
+
+	TEST_CASE( "TextureCompression-Performance", "[rendercore_assets]" )
+	{
+		std::mt19937 rng(2384756);
+		const unsigned width = 1024, height = 1024;
+		auto srcPixels = Internal::MakeSyntheticTexture(width, height, rng);
+		auto srcDesc = TextureDesc::Plain2D(width, height, Format::R8G8B8A8_UNORM);
+		ThreadPool threadPool(std::max(1u, std::thread::hardware_concurrency()-1));
+
+		std::cout << "Texture compression of " << width << "x" << height << " " << AsString(srcDesc._format) << " source with full mip chain" << std::endl;
+		for (auto fmt:{Format::BC1_UNORM, Format::BC3_UNORM, Format::BC4_UNORM, Format::BC5_UNORM, Format::BC7_UNORM, Format::R8G8B8A8_UNORM}) {
+			if (!CanCompressTextureParallel(srcDesc, fmt)) {
+				std::cout << "  " << AsString(fmt) << ": not supported in this build" << std::endl;
+				continue;
+			}
+			auto dstDesc = TextureDesc::Plain2D(width, height, fmt, 11);
+			std::vector<uint8_t> dst(ByteCount(dstDesc));
+			TextureCompressionMetrics singleThreaded, threaded;
+			CompressTextureParallel(MakeIteratorRange(dst), dstDesc, MakeIteratorRange(srcPixels), srcDesc, {}, nullptr, &singleThreaded);
+			CompressTextureParallel(MakeIteratorRange(dst), dstDesc, MakeIteratorRange(srcPixels), srcDesc, {}, &threadPool, &threaded);
+			std::cout << "  " << AsString(fmt) << ": " << singleThreaded.GetMegapixelsPerSecond() << " MP/s single threaded, "
+				<< threaded.GetMegapixelsPerSecond() << " MP/s with " << threaded._threadCount << " threads (" << threaded._jobCount << " jobs)" << std::endl;
+		}
+
+		std::cout << "Mip generation only (" << AsString(Format::R8G8B8A8_UNORM_SRGB) << ")" << std::endl;
+		auto srgbDesc = TextureDesc::Plain2D(width, height, Format::R8G8B8A8_UNORM_SRGB);
+		for (auto filter:{MipFilter::Box, MipFilter::Kaiser, MipFilter::Lanczos}) {
+			MipGenerationSettings settings;
+			settings._filter = filter;
+			auto dstDesc = TextureDesc::Plain2D(width, height, srgbDesc._format, 11);
+			std::vector<uint8_t> dst(ByteCount(dstDesc));
+			TextureCompressionMetrics metrics;
+			CompressTextureParallel(MakeIteratorRange(dst), dstDesc, MakeIteratorRange(srcPixels), srgbDesc, settings, &threadPool, &metrics);
+			std::cout << "  " << AsString(filter) << ": " << metrics.GetMegapixelsPerSecond() << " MP/s with " << metrics._threadCount << " threads" << std::endl;
+		}
+	}
+}
@@ -6,12 +6,16 @@
 #include "../../../Math/Geometry.h"
 #include "../../../Math/Transformations.h"
 #include "../../../OSServices/Log.h"
+#include "../../../Utility/Threading/CompletionThreadPool.h"
 #include "catch2/catch_test_macros.hpp"
 #include "catch2/catch_approx.hpp"
 #include <vector>
 #include <random>
 #include <iostream>
 #include <sstream>
+#include <chrono>
+#include <thread>
+#include <cstring>
 
 using namespace Catch::literals;
 namespace UnitTests
@@ -203,4 +207,268 @@ namespace UnitTests
             }
         }
     }
+
+    static bool EquivalentRelativeToMagnitude(const Float4x4& lhs, const Float4x4& rhs, float threshold)
+    {
+        float magnitude = 1.f;
+        for (unsigned j=0;j<4;++j)
+            for (unsigned i=0;i<4;++i)
+                magnitude = std::max(magnitude, XlAbs(lhs(i, j)));
+        for (unsigned j=0;j<4;++j)
+            for (unsigned i=0;i<4;++i)
+                if (XlAbs(lhs(i, j) - rhs(i, j)) > threshold * magnitude)
+                    return false;
+        return true;
+    }
+
+    namespace Internal
+    {
+        struct ParameterWriter
+        {
+            enum class Type { Float, Float3, Float4, Quaternion, Float4x4 };
+            std::vector<std::pair<unsigned, Type>> _parameters;
+            unsigned _size = 0;
+
+            unsigned Add(Type type)
+            {
+                auto offset = _size;
+                _parameters.emplace_back(offset, type);
+                _size += (type == Type::Float) ? 4 : (type == Type::Float3) ? 12 : (type == Type::Float4x4) ? 64 : 16;
+                return offset;
+            }
+
+            void Fill(void* block, std::mt19937& rng) const
+            {
+                for (const auto& p:_parameters) {
+                    auto* dst = PtrAdd(block, p.first);
+                    switch (p.second) {
+                    case Type::Float: *(float*)dst = RandomScaleValue(rng); break;
+                    case Type::Float3: *(Float3*)dst = RandomScaleVector(rng); break;
+                    case Type::Float4: *(Float4*)dst = Expand(RandomUnitVector(rng), (float)std::uniform_real_distribution<>(-180.f, 180.f)(rng)); break;
+                    case Type::Quaternion:
+                        {
+                            Float4 q { (float)std::uniform_real_distribution<>(-1.f, 1.f)(rng), (float)std::uniform_real_distribution<>(-1.f, 1.f)(rng), (float)std::uniform_real_distribution<>(-1.f, 1.f)(rng), 1.f };
+                            q = Normalize(q);
+                            std::memcpy(dst, &q, sizeof(q));
+                        }
+                        break;
+                    case Type::Float4x4: *(Float4x4*)dst = RandomComplexTransform(rng); break;
+                    }
+                }
+            }
+        };
+
+        static void PushFloats(std::vector<uint32_t>& machine, const float* floats, unsigned count)
+        {
+            machine.insert(machine.end(), (const uint32_t*)floats, (const uint32_t*)(floats+count));
+        }
+
+            // Build a random skeleton-like hierarchy that uses every type of command
+        static std::vector<uint32_t> BuildRandomSkeleton(std::mt19937& rng, ParameterWriter& params, unsigned jointCount, unsigned outputMatrixCount)
+        {
+            using namespace RenderCore::Assets;
+            std::vector<uint32_t> machine;
+            unsigned depth = 0;
+            for (unsigned j=0; j<jointCount; ++j) {
+                if (depth < 20 && std::uniform_int_distribution<>(0, 2)(rng) != 0) {
+                    machine.push_back((uint32_t)TransformCommand::PushLocalToWorld);
+                    ++depth;
+                }
+
+                auto opCount = std::uniform_int_distribution<>(1, 4)(rng);
+                for (int o=0; o<opCount; ++o) {
+                    auto type = std::uniform_int_distribution<>(0, 17)(rng);
+                    if (type == 0) {
+                        auto transform = RandomComplexTransform(rng);
+                        machine.push_back((uint32_t)TransformCommand::TransformFloat4x4_Static);
+                        PushFloats(machine, (const float*)&transform, 16);
+                    } else if (type == 1) {
+                        auto t = RandomTranslationVector(rng);
+                        machine.push_back((uint32_t)TransformCommand::Translate_Static);
+                        PushFloats(machine, &t[0], 3);
+                    } else if (type <= 4) {
+                        float angle = (float)std::uniform_real_distribution<>(-180.f, 180.f)(rng);
+                        machine.push_back((uint32_t)TransformCommand::RotateX_Static + type - 2);
+                        PushFloats(machine, &angle, 1);
+                    } else if (type == 5) {
+                        auto s = RandomScaleVector(rng);
+                        machine.push_back((uint32_t)TransformCommand::ArbitraryScale_Static);
+                        PushFloats(machine, &s[0], 3);
+                    } else if (type == 6) {
+                        machine.push_back((uint32_t)TransformCommand::TransformFloat4x4_Parameter);
+                        machine.push_back(params.Add(ParameterWriter::Type::Float4x4));
+                    } else if (type <= 8) {
+                        machine.push_back((uint32_t)((type == 7) ? TransformCommand::Translate_Parameter : TransformCommand::Translate_ParameterGeoSpace));
+                        machine.push_back(params.Add(ParameterWriter::Type::Float3));
+                    } else if (type <= 11) {
+                        machine.push_back((uint32_t)TransformCommand::RotateX_Parameter + type - 9);
+                        machine.push_back(params.Add(ParameterWriter::Type::Float));
+                    } else if (type == 12) {
+                        machine.push_back((uint32_t)TransformCommand::RotateAxisAngle_Parameter);
+                        machine.push_back(params.Add(ParameterWriter::Type::Float4));
+                    } else if (type <= 14) {
+                        machine.push_back((uint32_t)TransformCommand::RotateQuaternion_Parameter);
+                        machine.push_back(params.Add(ParameterWriter::Type::Quaternion));
+                    } else if (type == 15) {
+                        machine.push_back((uint32_t)TransformCommand::UniformScale_Parameter);
+                        machine.push_back(params.Add(ParameterWriter::Type::Float));
+                    } else {
+                        machine.push_back((uint32_t)TransformCommand::ArbitraryScale_Parameter);
+                        machine.push_back(params.Add(ParameterWriter::Type::Float3));
+                    }
+                }
+
+                auto outputIndex = std::uniform_int_distribution<>(0, outputMatrixCount-1)(rng);
+                auto writeType = std::uniform_int_distribution<>(0, 5)(rng);
+                if (writeType == 0) {
+                    auto transform = RandomComplexTransform(rng);
+                    machine.push_back((uint32_t)TransformCommand::TransformFloat4x4AndWrite_Static);
+                    machine.push_back(outputIndex);
+                    PushFloats(machine, (const float*)&transform, 16);
+                } else if (writeType == 1) {
+                    machine.push_back((uint32_t)TransformCommand::TransformFloat4x4AndWrite_Parameter);
+                    machine.push_back(outputIndex);
+                    machine.push_back(params.Add(ParameterWriter::Type::Float4x4));
+                } else {
+                    machine.push_back((uint32_t)TransformCommand::WriteOutputMatrix);
+                    machine.push_back(outputIndex);
+                }
+
+                if (depth && std::uniform_int_distribution<>(0, 2)(rng) == 0) {
+                    auto popCount = std::uniform_int_distribution<>(1, std::min(depth, 3u))(rng);
+                    machine.push_back((uint32_t)TransformCommand::PopLocalToWorld);
+                    machine.push_back(popCount);
+                    depth -= popCount;
+                }
+            }
+            return machine;
+        }
+
+            // Typical animated skeleton: each joint has a static bind offset, followed by animated translation, rotation & scale
+        static std::vector<uint32_t> BuildAnimatedSkeleton(unsigned jointIdx, unsigned jointCount, ParameterWriter& params)
+        {
+            using namespace RenderCore::Assets;
+            std::vector<uint32_t> machine;
+            machine.push_back((uint32_t)TransformCommand::PushLocalToWorld);
+            Float3 bindOffset { 0.f, 1.f, 0.f };
+            machine.push_back((uint32_t)TransformCommand::Translate_Static);
+            PushFloats(machine, &bindOffset[0], 3);
+            machine.push_back((uint32_t)TransformCommand::Translate_Parameter);
+            machine.push_back(params.Add(ParameterWriter::Type::Float3));
+            machine.push_back((uint32_t)TransformCommand::RotateQuaternion_Parameter);
+            machine.push_back(params.Add(ParameterWriter::Type::Quaternion));
+            machine.push_back((uint32_t)TransformCommand::UniformScale_Parameter);
+            machine.push_back(params.Add(ParameterWriter::Type::Float));
+            machine.push_back((uint32_t)TransformCommand::WriteOutputMatrix);
+            machine.push_back(jointIdx);
+            for (unsigned child=jointIdx*2+1; child<std::min(jointIdx*2+3, jointCount); ++child) {
+                auto childMachine = BuildAnimatedSkeleton(child, jointCount, params);
+                machine.insert(machine.end(), childMachine.begin(), childMachine.end());
+            }
+            machine.push_back((uint32_t)TransformCommand::PopLocalToWorld);
+            machine.push_back(1);
+            return machine;
+        }
+    }
+
+    TEST_CASE( "TransformationMachineOpt-BatchedEvaluation", "[rendercore_assets]" )
+    {
+        using namespace RenderCore::Assets;
+        std::mt19937 rng { 3462956u };
+        ThreadPool threadPool(4);
+
+        for (unsigned c=0; c<50; ++c) {
+            const unsigned outputMatrixCount = 32;
+            Internal::ParameterWriter params;
+            auto machine = Internal::BuildRandomSkeleton(rng, params, 48, outputMatrixCount);
+
+            // instance counts that don't fill the last group of 4, and some large enough to be split across threads
+            const unsigned instanceCount = (c%5 == 0) ? 203 : (1 + c%7);
+            const size_t stride = CeilToMultiplePow2(std::max(params._size, 4u), 16);
+            std::vector<uint8_t> parameterBlocks(stride*instanceCount);
+            for (unsigned i=0; i<instanceCount; ++i)
+                params.Fill(PtrAdd(parameterBlocks.data(), i*stride), rng);
+
+            BatchedTransformationMachine batched(MakeIteratorRange(machine), outputMatrixCount);
+            REQUIRE(batched.GetOutputMatrixCount() == outputMatrixCount);
+            REQUIRE(batched.GetMinimumParameterBlockSize() <= params._size);
+
+            std::vector<Float4x4> batchedResult(instanceCount*outputMatrixCount), threadedResult(instanceCount*outputMatrixCount);
+            batched.GenerateOutputTransforms(MakeIteratorRange(batchedResult), MakeIteratorRange(parameterBlocks), stride, instanceCount);
+            batched.GenerateOutputTransforms(MakeIteratorRange(threadedResult), MakeIteratorRange(parameterBlocks), stride, instanceCount, &threadPool);
+
+            for (unsigned i=0; i<instanceCount; ++i) {
+                Float4x4 expected[outputMatrixCount];
+                auto* block = PtrAdd(parameterBlocks.data(), i*stride);
+                GenerateOutputTransforms(MakeIteratorRange(expected), MakeIteratorRange(block, PtrAdd(block, stride)), MakeIteratorRange(machine));
+                for (unsigned o=0; o<outputMatrixCount; ++o) {
+                    const float tolerance = 1e-3f;
+                    REQUIRE(EquivalentRelativeToMagnitude(expected[o], batchedResult[i*outputMatrixCount+o], tolerance));
+                    REQUIRE(std::memcmp(&batchedResult[i*outputMatrixCount+o], &threadedResult[i*outputMatrixCount+o], sizeof(Float4x4)) == 0);
+                }
+            }
+        }
+
+        // static only machines collapse down to constants
+        {
+            std::vector<uint32_t> machine;
+            InsertRandomTransforms(machine, rng, 10, false);
+            machine.push_back((uint32_t)TransformCommand::WriteOutputMatrix);
+            machine.push_back(0);
+            BatchedTransformationMachine batched(MakeIteratorRange(machine), 2);
+            REQUIRE(batched.GetStepCount() == 0);
+            Float4x4 expected[2], batchedResult[2];
+            GenerateOutputTransforms(MakeIteratorRange(expected), {}, MakeIteratorRange(machine));
+            batched.GenerateOutputTransforms(MakeIteratorRange(batchedResult), {}, 0, 1);
+            REQUIRE(Equivalent(expected[0], batchedResult[0], 1e-3f));
+            REQUIRE(Equivalent(batchedResult[1], Identity<Float4x4>(), 1e-6f));
+        }
+    }
+
+    TEST_CASE( "TransformationMachineOpt-BatchedPerformance", "[rendercore_assets]" )
+    {
+        using namespace RenderCore::Assets;
+        std::mt19937 rng { 5723945u };
+        ThreadPool threadPool(std::max(1u, std::thread::hardware_concurrency()-1));
+
+        const unsigned jointCount = 64, instanceCount = 2048, iterations = 10;
+        Internal::ParameterWriter params;
+        auto machine = Internal::BuildAnimatedSkeleton(0, jointCount, params);
+        const size_t stride = CeilToMultiplePow2(params._size, 16);
+        std::vector<uint8_t> parameterBlocks(stride*instanceCount);
+        for (unsigned i=0; i<instanceCount; ++i)
+            params.Fill(PtrAdd(parameterBlocks.data(), i*stride), rng);
+
+        BatchedTransformationMachine batched(MakeIteratorRange(machine), jointCount);
+        std::vector<Float4x4> perInstanceResult(instanceCount*jointCount), batchedResult(instanceCount*jointCount);
+
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned it=0; it<iterations; ++it)
+            for (unsigned i=0; i<instanceCount; ++i) {
+                auto* block = PtrAdd(parameterBlocks.data(), i*stride);
+                GenerateOutputTransforms(
+                    MakeIteratorRange(perInstanceResult.data()+i*jointCount, perInstanceResult.data()+(i+1)*jointCount),
+                    MakeIteratorRange(block, PtrAdd(block, stride)), MakeIteratorRange(machine));
+            }
+        auto perInstanceTime = std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        for (unsigned it=0; it<iterations; ++it)
+            batched.GenerateOutputTransforms(MakeIteratorRange(batchedResult), MakeIteratorRange(parameterBlocks), stride, instanceCount);
+        auto batchedTime = std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        for (unsigned it=0; it<iterations; ++it)
+            batched.GenerateOutputTransforms(MakeIteratorRange(batchedResult), MakeIteratorRange(parameterBlocks), stride, instanceCount, &threadPool);
+        auto threadedTime = std::chrono::steady_clock::now() - start;
+
+        for (unsigned c=0; c<instanceCount*jointCount; ++c)
+            REQUIRE(EquivalentRelativeToMagnitude(perInstanceResult[c], batchedResult[c], 1e-3f));
+
+        auto toMs = [](auto duration) { return std::chrono::duration_cast<std::chrono::microseconds>(duration).count() / 1000.f; };
+        std::cout << "Skeleton evaluation for " << instanceCount << " instances of " << jointCount << " joints (" << iterations << " iterations)" << std::endl;
+        std::cout << "  per instance:          " << toMs(perInstanceTime) << "ms" << std::endl;
+        std::cout << "  batched:               " << toMs(batchedTime) << "ms" << std::endl;
+        std::cout << "  batched & threaded:    " << toMs(threadedTime) << "ms" << std::endl;
+    }
 }
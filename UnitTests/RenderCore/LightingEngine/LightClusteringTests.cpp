@@ -0,0 +1,247 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../../../RenderCore/LightingEngine/LightClusterer.h"
+#include "../../../RenderCore/LightingEngine/StandardLightScene.h"
+#include "../../../RenderCore/LightingEngine/ILightScene.h"
+#include "../../../Math/Transformations.h"
+#include "../../../Math/ProjectionMath.h"
+#include "../../../Utility/Threading/CompletionThreadPool.h"
+#include "catch2/catch_test_macros.hpp"
+#include "catch2/catch_approx.hpp"
+#include <random>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+using namespace Catch::literals;
+
+namespace LightingEngine = RenderCore::LightingEngine;
+using namespace RenderCore::LightingEngine;
+
+namespace UnitTests
+{
+	static const float s_verticalFOV = gPI/3.f, s_aspectRatio = 16.f/9.f, s_nearClip = 0.1f, s_farClip = 200.f;
+
+	static void GenerateRandomLights(std::mt19937_64& rng, unsigned count, std::vector<Float3>& positions, std::vector<float>& radii)
+	{
+		positions.resize(count);
+		radii.resize(count);
+		for (unsigned c=0; c<count; ++c) {
+			positions[c] = Float3 {
+				std::uniform_real_distribution<float>(-150.f, 150.f)(rng),
+				std::uniform_real_distribution<float>(-150.f, 150.f)(rng),
+				std::uniform_real_distribution<float>(-20.f, 20.f)(rng) };
+			radii[c] = std::uniform_real_distribution<float>(0.5f, 8.f)(rng);
+		}
+	}
+
+	static Float4x4 GetTestCameraToWorld()
+	{
+		return MakeCameraToWorld(Normalize(Float3{1.f, 0.2f, -0.1f}), Float3{0.f, 0.f, 1.f}, Float3{-120.f, -10.f, 3.f});
+	}
+
+	TEST_CASE( "LightingEngine-CPULightClusterer", "[rendercore_lighting_engine]" )
+	{
+		std::mt19937_64 rng(0x2ab1e1b5d9c3f27full);
+		std::vector<Float3> positions;
+		std::vector<float> radii;
+		GenerateRandomLights(rng, 2048, positions, radii);
+
+		CPULightClustererDesc desc;
+		desc._clusterCounts = UInt3{15u, 9u, 21u};		// deliberately not a multiple of the SIMD width in X
+		CPULightClusterer clusterer{desc};
+		clusterer.SetProjection(
+			PerspectiveProjection(s_verticalFOV, s_aspectRatio, s_nearClip, s_farClip, GeometricCoordinateSpace::RightHanded, ClipSpaceType::Positive),
+			ClipSpaceType::Positive);
+
+		auto cameraToWorld = GetTestCameraToWorld();
+		auto worldToCamera = InvertOrthonormalTransform(cameraToWorld);
+		clusterer.Execute(worldToCamera, MakeIteratorRange(positions), MakeIteratorRange(radii));
+		auto singleThreaded = clusterer.GetOutputs();
+		REQUIRE(singleThreaded._clusterOffsets.size() == clusterer.GetClusterCount()+1);
+		REQUIRE(singleThreaded._clusterOffsets.back() == singleThreaded._lightIndices.size());
+		REQUIRE(!singleThreaded._lightIndices.empty());
+
+		SECTION("Matches brute force")
+		{
+			auto counts = clusterer.GetClusterCounts();
+			unsigned clusterIdx = 0;
+			for (unsigned z=0; z<counts[2]; ++z)
+				for (unsigned y=0; y<counts[1]; ++y)
+					for (unsigned x=0; x<counts[0]; ++x, ++clusterIdx) {
+						auto bounds = clusterer.GetClusterBounds({x, y, z});
+						std::vector<unsigned> expected;
+						for (unsigned l=0; l<positions.size(); ++l) {
+							auto center = TransformPoint(worldToCamera, positions[l]);
+							float distSq = 0.f;
+							for (unsigned c=0; c<3; ++c) {
+								float d = std::max(std::max(bounds.first[c] - center[c], center[c] - bounds.second[c]), 0.f);
+								distSq += d*d;
+							}
+							if (distSq <= radii[l]*radii[l]) expected.push_back(l);
+						}
+						auto begin = singleThreaded._lightIndices.begin() + singleThreaded._clusterOffsets[clusterIdx];
+						auto end = singleThreaded._lightIndices.begin() + singleThreaded._clusterOffsets[clusterIdx+1];
+						REQUIRE(std::vector<unsigned>(begin, end) == expected);
+					}
+		}
+
+		SECTION("Clusters are conservative")
+		{
+			// Pick random points within the view frustum, and ensure that every light touching that point
+			// is in the list for the cluster containing it
+			auto counts = clusterer.GetClusterCounts();
+			auto sliceDepths = clusterer.GetSliceDepths();
+			float tanHalfFOV = std::tan(s_verticalFOV/2.f);
+			for (unsigned t=0; t<20000; ++t) {
+				float u = std::uniform_real_distribution<float>(0.f, 1.f)(rng);
+				float v = std::uniform_real_distribution<float>(0.f, 1.f)(rng);
+				float depth = std::uniform_real_distribution<float>(s_nearClip, 60.f)(rng);
+				Float3 cameraSpace { (2.f*u-1.f)*depth*tanHalfFOV*s_aspectRatio, (1.f-2.f*v)*depth*tanHalfFOV, -depth };
+				auto worldSpace = TransformPoint(cameraToWorld, cameraSpace);
+
+				unsigned x = std::min(unsigned(u*counts[0]), counts[0]-1), y = std::min(unsigned(v*counts[1]), counts[1]-1);
+				unsigned z = unsigned(std::upper_bound(sliceDepths.begin(), sliceDepths.end(), depth) - sliceDepths.begin()) - 1;
+				auto clusterIdx = (z*counts[1]+y)*counts[0]+x;
+				auto begin = singleThreaded._lightIndices.begin() + singleThreaded._clusterOffsets[clusterIdx];
+				auto end = singleThreaded._lightIndices.begin() + singleThreaded._clusterOffsets[clusterIdx+1];
+
+				for (unsigned l=0; l<positions.size(); ++l)
+					if (MagnitudeSquared(worldSpace - positions[l]) < radii[l]*radii[l] * 0.999f)
+						REQUIRE(std::binary_search(begin, end, l));
+			}
+		}
+
+		SECTION("Multithreaded")
+		{
+			ThreadPool threadPool(4);
+			clusterer.Execute(worldToCamera, MakeIteratorRange(positions), MakeIteratorRange(radii), &threadPool);
+			REQUIRE(clusterer.GetOutputs()._clusterOffsets == singleThreaded._clusterOffsets);
+			REQUIRE(clusterer.GetOutputs()._lightIndices == singleThreaded._lightIndices);
+		}
+	}
+
+	TEST_CASE( "LightingEngine-LightSceneBulkUpdate", "[rendercore_lighting_engine]" )
+	{
+		const unsigned lightCount = 300;
+		std::mt19937_64 rng(0x5e3cb1b0a7a5bd33ull);
+		std::vector<Float3> positions, brightness;
+		std::vector<float> radii;
+		GenerateRandomLights(rng, lightCount, positions, radii);
+		brightness.resize(lightCount);
+		for (auto& b:brightness) b = Float3{std::uniform_real_distribution<float>(0.f, 10.f)(rng), 1.f, 2.f};
+
+		LightingEngine::Internal::StandardLightScene lightScene;
+		ILightScene& scene = lightScene;
+		const ILightScene::LightOperatorId tiledOperator = 0;
+		lightScene.AssociateFlag(tiledOperator, LightingEngine::Internal::StandardPositionLightFlags::LightTiler|LightingEngine::Internal::StandardPositionLightFlags::SupportFiniteRange);
+		auto* bulkUpdate = (ILightSourceBulkUpdate*)lightScene.QueryInterface(TypeHashCode<ILightSourceBulkUpdate>);
+		REQUIRE(bulkUpdate);
+
+		auto untouchedLight = lightScene.CreateLightSource(tiledOperator);
+		auto firstLight = bulkUpdate->CreateLightSources(tiledOperator, lightCount);
+		REQUIRE(firstLight == untouchedLight+1);
+		lightScene.DestroyLightSource(firstLight+7);
+
+		ILightSourceBulkUpdate::Properties props;
+		props._positions = MakeIteratorRange(positions);
+		props._brightness = MakeIteratorRange(brightness);
+		props._cutoffRanges = MakeIteratorRange(radii);
+		bulkUpdate->SetLightProperties(firstLight, props);
+
+		for (unsigned c=0; c<lightCount; ++c) {
+			if (c == 7) {
+				REQUIRE(!scene.TryGetLightSourceInterface<IPositionalLightSource>(firstLight+c));
+				continue;
+			}
+			auto* positional = scene.TryGetLightSourceInterface<IPositionalLightSource>(firstLight+c);
+			auto* emittance = scene.TryGetLightSourceInterface<IUniformEmittance>(firstLight+c);
+			auto* finite = scene.TryGetLightSourceInterface<IFiniteLightSource>(firstLight+c);
+			REQUIRE(positional); REQUIRE(emittance); REQUIRE(finite);
+			auto translation = ExtractTranslation(positional->GetLocalToWorld());
+			REQUIRE(translation[0] == Catch::Approx(positions[c][0]));
+			REQUIRE(translation[1] == Catch::Approx(positions[c][1]));
+			REQUIRE(translation[2] == Catch::Approx(positions[c][2]));
+			REQUIRE(emittance->GetBrightness()[0] == brightness[c][0]);
+			REQUIRE(finite->GetCutoffRange() == radii[c]);
+		}
+		// lights outside of the range aren't changed
+		REQUIRE(scene.TryGetLightSourceInterface<IFiniteLightSource>(untouchedLight)->GetCutoffRange() == 10000.f);
+
+		// partial updates only change the properties given
+		std::vector<Float2> newRadii(10, Float2{3.f, 4.f});
+		ILightSourceBulkUpdate::Properties radiiOnly;
+		radiiOnly._radii = MakeIteratorRange(newRadii);
+		bulkUpdate->SetLightProperties(firstLight+100, radiiOnly);
+		auto* light105 = scene.TryGetLightSourceInterface<LightingEngine::Internal::StandardPositionalLight>(firstLight+105);
+		REQUIRE(light105->_radii[0] == 3.f);
+		REQUIRE(light105->_cutoffRange == radii[105]);
+
+		// cluster directly from the light scene
+		CPULightClusterer clusterer{CPULightClustererDesc{}};
+		clusterer.SetProjection(
+			PerspectiveProjection(s_verticalFOV, s_aspectRatio, s_nearClip, s_farClip, GeometricCoordinateSpace::RightHanded, ClipSpaceType::Positive),
+			ClipSpaceType::Positive);
+		clusterer.Execute(InvertOrthonormalTransform(GetTestCameraToWorld()), lightScene);
+		REQUIRE(clusterer.GetOutputs()._lightOrdering.size() == lightCount);
+		for (auto idx:clusterer.GetOutputs()._lightIndices)
+			REQUIRE(idx < lightCount);
+	}
+
+	TEST_CASE( "LightingEngine-LightClustering-Performance", "[rendercore_lighting_engine]" )
+	{
+		#if defined(_DEBUG)
+			const unsigned lightCount = 1024, iterationCount = 4;
+		#else
+			const unsigned lightCount = 16*1024, iterationCount = 32;
+		#endif
+		std::mt19937_64 rng(0x7c51b0d5c3b9a8e1ull);
+		std::vector<Float3> positions;
+		std::vector<float> radii;
+		GenerateRandomLights(rng, lightCount, positions, radii);
+
+		LightingEngine::Internal::StandardLightScene lightScene;
+		ILightScene& scene = lightScene;
+		lightScene.AssociateFlag(0, LightingEngine::Internal::StandardPositionLightFlags::LightTiler|LightingEngine::Internal::StandardPositionLightFlags::SupportFiniteRange);
+		auto& bulkUpdate = *(ILightSourceBulkUpdate*)lightScene.QueryInterface(TypeHashCode<ILightSourceBulkUpdate>);
+		auto firstLight = bulkUpdate.CreateLightSources(0, lightCount);
+
+		auto start = std::chrono::steady_clock::now();
+		for (unsigned i=0; i<iterationCount; ++i)
+			for (unsigned c=0; c<lightCount; ++c) {
+				scene.TryGetLightSourceInterface<IPositionalLightSource>(firstLight+c)->SetLocalToWorld(AsFloat4x4(positions[c]));
+				scene.TryGetLightSourceInterface<IFiniteLightSource>(firstLight+c)->SetCutoffRange(radii[c]);
+			}
+		auto perLightEnd = std::chrono::steady_clock::now();
+
+		ILightSourceBulkUpdate::Properties props;
+		props._positions = MakeIteratorRange(positions);
+		props._cutoffRanges = MakeIteratorRange(radii);
+		for (unsigned i=0; i<iterationCount; ++i)
+			bulkUpdate.SetLightProperties(firstLight, props);
+		auto bulkEnd = std::chrono::steady_clock::now();
+
+		CPULightClusterer clusterer{CPULightClustererDesc{}};
+		clusterer.SetProjection(
+			PerspectiveProjection(s_verticalFOV, s_aspectRatio, s_nearClip, s_farClip, GeometricCoordinateSpace::RightHanded, ClipSpaceType::Positive),
+			ClipSpaceType::Positive);
+		auto worldToCamera = InvertOrthonormalTransform(GetTestCameraToWorld());
+
+		auto clusterStart = std::chrono::steady_clock::now();
+		for (unsigned i=0; i<iterationCount; ++i)
+			clusterer.Execute(worldToCamera, lightScene);
+		auto singleThreadedEnd = std::chrono::steady_clock::now();
+
+		ThreadPool threadPool(std::max(1u, std::thread::hardware_concurrency()-1));
+		auto multiThreadedStart = std::chrono::steady_clock::now();
+		for (unsigned i=0; i<iterationCount; ++i)
+			clusterer.Execute(worldToCamera, lightScene, &threadPool);
+		auto multiThreadedEnd = std::chrono::steady_clock::now();
+
+		auto perIteration = [iterationCount](auto duration) { return std::chrono::duration_cast<std::chrono::microseconds>(duration).count() / iterationCount; };
+		std::cout << "Light update (" << lightCount << " lights), per light interfaces: " << perIteration(perLightEnd-start) << "us, bulk update: " << perIteration(bulkEnd-perLightEnd) << "us" << std::endl;
+		std::cout << "Light clustering (" << clusterer.GetOutputs()._lightIndices.size() << " assignments), single threaded: " << perIteration(singleThreadedEnd-clusterStart) << "us, thread pool: " << perIteration(multiThreadedEnd-multiThreadedStart) << "us" << std::endl;
+	}
+}
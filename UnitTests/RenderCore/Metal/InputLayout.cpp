@@ -18,6 +18,9 @@
 #include "../../../RenderCore/BufferView.h"
 #include "../../../RenderCore/IDevice.h"
 #include "../../../RenderCore/IAnnotator.h"
+#if GFXAPI_TARGET == GFXAPI_VULKAN
+	#include "../../../RenderCore/Vulkan/Metal/Pools.h"
+#endif
 #include "../../../Math/Vector.h"
 #include "../../../Utility/MemoryUtils.h"
 #include <map>
@@ -1876,6 +1879,108 @@ namespace UnitTests
 		}
 	}
 
+#if GFXAPI_TARGET == GFXAPI_VULKAN
+	TEST_CASE( "InputLayout-DescriptorSetCache", "[rendercore_metal]" )
+	{
+		using namespace RenderCore;
+		auto testHelper = MakeTestHelper();
+		auto threadContext = testHelper->_device->GetImmediateContext();
+
+		DescriptorSetSignature descSet
+			{
+				std::make_pair(DescriptorSlot{DescriptorType::SampledTexture}, "tex"_h),
+				std::make_pair(DescriptorSlot{DescriptorType::Sampler}, "smp"_h)
+			};
+		PipelineLayoutInitializer plInit;
+		plInit.AppendDescriptorSet("d0", descSet, PipelineType::Graphics);
+		auto pipelineLayout = testHelper->_device->CreatePipelineLayout(plInit, "descriptor-set-cache");
+		auto& layout = *checked_cast<Metal_Vulkan::CompiledPipelineLayout*>(pipelineLayout.get())->GetDescriptorSetLayout(0);
+
+		TestTexture testTexture0(*testHelper->_device, *threadContext), testTexture1(*testHelper->_device, *threadContext);
+		auto srv0 = testTexture0._res->CreateTextureView(BindFlag::ShaderResource);
+		auto srv1 = testTexture1._res->CreateTextureView(BindFlag::ShaderResource);
+		auto sampler = testHelper->_device->CreateSampler(SamplerDesc{ FilterMode::Point, AddressMode::Clamp, AddressMode::Clamp });
+		auto& view0 = *checked_cast<Metal::ResourceView*>(srv0.get());
+		auto& view1 = *checked_cast<Metal::ResourceView*>(srv1.get());
+		auto& samplerState = *checked_cast<Metal::SamplerState*>(sampler.get());
+
+		// The key data is normally the Vulkan handles for the views & samplers (see ApplyLooseUniforms)
+		uint64_t keyData0[] { (uint64_t)view0.GetImageView(), (uint64_t)samplerState.GetUnderlying() };
+		uint64_t keyData1[] { (uint64_t)view1.GetImageView(), (uint64_t)samplerState.GetUnderlying() };
+		const uint64_t hash0 = 0x1234, hash1 = 0x5678;
+
+		const unsigned maxIdleFrames = 2;
+		Metal_Vulkan::DescriptorSetCache cache { Metal::GetObjectFactory(), nullptr, maxIdleFrames, 64, 1 };
+
+		SECTION("Hit and miss")
+		{
+			REQUIRE(cache.Find(hash0, MakeIteratorRange(keyData0)) == nullptr);
+			auto newSet = cache.Allocate(layout);
+			REQUIRE(newSet);
+			auto rawSet = newSet.get();
+			cache.Insert(hash0, MakeIteratorRange(keyData0), std::move(newSet), {view0}, {samplerState});
+
+			REQUIRE(cache.Find(hash0, MakeIteratorRange(keyData0)) == rawSet);
+			REQUIRE(cache.Find(hash1, MakeIteratorRange(keyData1)) == nullptr);
+
+			// same hash, but built from different views -- must not return the cached set
+			REQUIRE(cache.Find(hash0, MakeIteratorRange(keyData1)) == nullptr);
+			cache.Insert(hash0, MakeIteratorRange(keyData1), cache.Allocate(layout), {view1}, {samplerState});
+			REQUIRE(cache.Find(hash0, MakeIteratorRange(keyData0)) == rawSet);
+
+			auto metrics = cache.GetMetrics();
+			REQUIRE(metrics._currentFrame._cacheHits == 2);
+			REQUIRE(metrics._currentFrame._cacheMisses == 3);
+			REQUIRE(metrics._cachedSetCount == 1);
+		}
+
+		SECTION("Eviction")
+		{
+			cache.Insert(hash0, MakeIteratorRange(keyData0), cache.Allocate(layout), {view0}, {samplerState});
+			cache.Insert(hash1, MakeIteratorRange(keyData1), cache.Allocate(layout), {view1}, {samplerState});
+			REQUIRE(cache.GetMetrics()._cachedSetCount == 2);
+
+			// entries that are still being used survive; idle ones are evicted after maxIdleFrames
+			for (unsigned c=0; c<maxIdleFrames+1; ++c) {
+				REQUIRE(cache.Find(hash0, MakeIteratorRange(keyData0)) != nullptr);
+				cache.OnFrameBarrier();
+			}
+			REQUIRE(cache.Find(hash0, MakeIteratorRange(keyData0)) != nullptr);
+			REQUIRE(cache.Find(hash1, MakeIteratorRange(keyData1)) == nullptr);
+			auto metrics = cache.GetMetrics();
+			REQUIRE(metrics._cachedSetCount == 1);
+			REQUIRE(metrics._evictions == 1);
+
+			// inserting past the entry limit drops the least recently used entries
+			for (unsigned c=0; c<64; ++c) {
+				uint64_t keyData[] { c };
+				cache.Insert(0x10000+c, MakeIteratorRange(keyData), cache.Allocate(layout), {}, {});
+			}
+			REQUIRE(cache.GetMetrics()._cachedSetCount <= 64);
+			REQUIRE(cache.Find(hash0, MakeIteratorRange(keyData0)) == nullptr);
+		}
+
+		SECTION("Pool exhaustion")
+		{
+			// Allocate() returns null (rather than throwing) once the cache's own pools are exhausted, and
+			// recovers once sets are released back to the pool
+			std::vector<Metal_Vulkan::VulkanUniquePtr<VkDescriptorSet>> sets;
+			for (;;) {
+				auto newSet = cache.Allocate(layout);
+				if (!newSet) break;
+				sets.emplace_back(std::move(newSet));
+				REQUIRE(sets.size() <= Metal_Vulkan::DescriptorPool::MaxSets);
+			}
+			REQUIRE(!sets.empty());
+			REQUIRE(!cache.Allocate(layout));
+
+			sets.clear();
+			cache.FlushDestroys();
+			REQUIRE(cache.Allocate(layout));
+		}
+	}
+#endif
+
 	// error cases we could try:
 	//      * not binding all attributes
 	//      * refering to a vertex buffer in the InputElementDesc, and then not providing it
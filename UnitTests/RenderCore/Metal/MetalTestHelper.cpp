@@ -185,10 +185,10 @@ namespace UnitTests
 		}
 	};
 
-	auto UnitTestFBHelper::BeginRenderPass(RenderCore::IThreadContext& threadContext, IteratorRange<const RenderCore::ClearValue*> clearValues) -> std::shared_ptr<IRenderPassToken>
+	auto UnitTestFBHelper::BeginRenderPass(RenderCore::IThreadContext& threadContext, IteratorRange<const RenderCore::ClearValue*> clearValues, uint64_t secondaryCommandListSubpasses) -> std::shared_ptr<IRenderPassToken>
 	{
 		auto devContext = RenderCore::Metal::DeviceContext::Get(threadContext);
-		devContext->BeginRenderPass(*_pimpl->_fb, clearValues);
+		devContext->BeginRenderPass(*_pimpl->_fb, clearValues, secondaryCommandListSubpasses);
 		return std::make_shared<RenderPassToken>(devContext, _pimpl->_fb);
 	}
 
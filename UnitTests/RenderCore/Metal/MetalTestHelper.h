@@ -87,7 +87,8 @@ namespace UnitTests
 
         std::shared_ptr<IRenderPassToken> BeginRenderPass(
             RenderCore::IThreadContext& threadContext,
-            IteratorRange<const RenderCore::ClearValue*> clearValues = {});
+            IteratorRange<const RenderCore::ClearValue*> clearValues = {},
+            uint64_t secondaryCommandListSubpasses = 0);
         std::map<unsigned, unsigned> GetFullColorBreakdown(RenderCore::IThreadContext& threadContext);
         std::shared_ptr<RenderCore::IResource> GetMainTarget() const;
         const RenderCore::FrameBufferDesc& GetDesc() const;
@@ -9,6 +9,9 @@
 #include "../../../RenderCore/Metal/TextureView.h"
 #include "../../../RenderCore/Metal/ObjectFactory.h"
 #include "../../../RenderCore/Vulkan/IDeviceVulkan.h"
+#if GFXAPI_TARGET == GFXAPI_VULKAN
+	#include "../../../RenderCore/Vulkan/Metal/Pools.h"
+#endif
 #include "../../../RenderCore/Format.h"
 #include "../../../RenderCore/BufferView.h"
 #include "../../../RenderCore/MinimalShaderSource.h"
@@ -19,6 +22,10 @@
 #include "../../../Assets/AssetUtils.h"
 #include "catch2/catch_test_macros.hpp"
 #include "catch2/catch_approx.hpp"
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <atomic>
 
 using namespace Catch::literals;
 using namespace Utility::Literals;
@@ -465,4 +472,110 @@ namespace UnitTests
 		////////////////////////////////////////////////////////////////////////////////////////
 	}
 
+#if GFXAPI_TARGET == GFXAPI_VULKAN
+	static std::vector<uint8_t> ReadFileBytes(const std::string& filename)
+	{
+		std::ifstream file{filename, std::ios::in|std::ios::binary};
+		return std::vector<uint8_t>{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+	}
+
+	static void WriteFileBytes(const std::string& filename, const std::vector<uint8_t>& data)
+	{
+		std::ofstream file{filename, std::ios::out|std::ios::binary|std::ios::trunc};
+		file.write((const char*)data.data(), data.size());
+	}
+
+	TEST_CASE( "Pipeline-PersistentPipelineCache", "[rendercore_metal]" )
+	{
+		using namespace RenderCore;
+		auto testHelper = MakeTestHelper();
+		auto tempDir = std::filesystem::temp_directory_path() / "xle-unit-tests";
+		std::filesystem::create_directories(tempDir);
+		auto filename = (tempDir / "pipeline-cache-test.bin").string();
+		std::filesystem::remove(filename);
+
+		size_t savedSize = 0;
+		{
+			Metal_Vulkan::PipelineCache cache { Metal::GetObjectFactory(), filename, std::chrono::seconds(0) };
+			REQUIRE(!cache.GetMetrics()._initialDataAccepted);
+			REQUIRE(cache.GetUnderlying() != nullptr);
+			cache.Save();
+			auto metrics = cache.GetMetrics();
+			REQUIRE(metrics._saveCount == 1);
+			REQUIRE(metrics._lastSaveSize != 0);
+			savedSize = metrics._lastSaveSize;
+		}
+		auto savedFile = ReadFileBytes(filename);
+		REQUIRE(savedFile.size() > savedSize);
+
+		auto loadAccepted = [&]() {
+			Metal_Vulkan::PipelineCache cache { Metal::GetObjectFactory(), filename, std::chrono::seconds(0) };
+			return cache.GetMetrics()._initialDataAccepted;
+		};
+
+		SECTION("Round trip")
+		{
+			Metal_Vulkan::PipelineCache cache { Metal::GetObjectFactory(), filename, std::chrono::seconds(0) };
+			auto metrics = cache.GetMetrics();
+			REQUIRE(metrics._initialDataAccepted);
+			REQUIRE(metrics._initialDataSize == savedSize);
+		}
+
+		SECTION("Corrupt or mismatched files are rejected")
+		{
+			// The file begins with our own header: magic, version, vendor id, device id, ...
+			auto badMagic = savedFile;
+			badMagic[0] ^= 0xff;
+			WriteFileBytes(filename, badMagic);
+			REQUIRE(!loadAccepted());
+
+			auto otherDevice = savedFile;
+			otherDevice[12] ^= 0xff;
+			WriteFileBytes(filename, otherDevice);
+			REQUIRE(!loadAccepted());
+
+			auto badData = savedFile;
+			badData.back() ^= 0xff;
+			WriteFileBytes(filename, badData);
+			REQUIRE(!loadAccepted());
+
+			auto truncated = savedFile;
+			truncated.pop_back();
+			WriteFileBytes(filename, truncated);
+			REQUIRE(!loadAccepted());
+
+			WriteFileBytes(filename, savedFile);
+			REQUIRE(loadAccepted());
+		}
+
+		SECTION("Caches for idle threads are released")
+		{
+			Metal_Vulkan::PipelineCache cache { Metal::GetObjectFactory(), filename, std::chrono::seconds(0) };
+
+			// keep all of the threads alive until they've all got a cache, so they have distinct thread ids
+			const unsigned threadCount = 8;
+			std::atomic<unsigned> readyCount{0};
+			std::vector<std::thread> threads;
+			for (unsigned c=0; c<threadCount; ++c)
+				threads.emplace_back([&cache, &readyCount]() {
+					cache.GetUnderlying();
+					++readyCount;
+					while (readyCount.load() != threadCount) std::this_thread::yield();
+				});
+			for (auto& t:threads) t.join();
+			REQUIRE(cache.GetMetrics()._threadCacheCount == threadCount);
+
+			// only this thread continues to build pipelines
+			for (unsigned c=0; c<3; ++c) {
+				cache.GetUnderlying();
+				cache.Save();
+			}
+			REQUIRE(cache.GetMetrics()._threadCacheCount == 1);
+			REQUIRE(cache.GetMetrics()._lastSaveSize >= savedSize);
+		}
+
+		std::filesystem::remove(filename);
+	}
+#endif
+
 }
@@ -0,0 +1,467 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../../Utility/StringUtils.h"
+#include "../../Utility/UTFUtils.h"
+#include <random>
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <cstring>
+
+#include "catch2/catch_test_macros.hpp"
+#include "catch2/catch_approx.hpp"
+
+using namespace Catch::literals;
+using namespace Utility::Literals;
+
+namespace UnitTests
+{
+	//
+	//		Straightforward byte-at-a-time implementations, used as references for the vectorized versions
+	//
+
+	static bool ReferenceUtf8Validate(const uint8_t* s, size_t len)
+	{
+		// See the Unicode standard, table 3-7 "Well-Formed UTF-8 Byte Sequences"
+		size_t i = 0;
+		while (i < len) {
+			auto c = s[i];
+			if (c < 0x80) { ++i; continue; }
+			unsigned trailing; uint8_t lo = 0x80, hi = 0xBF;
+			if (c >= 0xC2 && c <= 0xDF) trailing = 1;
+			else if (c == 0xE0) { trailing = 2; lo = 0xA0; }
+			else if (c >= 0xE1 && c <= 0xEC) trailing = 2;
+			else if (c == 0xED) { trailing = 2; hi = 0x9F; }
+			else if (c >= 0xEE && c <= 0xEF) trailing = 2;
+			else if (c == 0xF0) { trailing = 3; lo = 0x90; }
+			else if (c >= 0xF1 && c <= 0xF3) trailing = 3;
+			else if (c == 0xF4) { trailing = 3; hi = 0x8F; }
+			else return false;
+			if ((len - i - 1) < trailing) return false;
+			if (s[i+1] < lo || s[i+1] > hi) return false;
+			for (unsigned t=2; t<=trailing; ++t)
+				if (s[i+t] < 0x80 || s[i+t] > 0xBF) return false;
+			i += trailing+1;
+		}
+		return true;
+	}
+
+	static unsigned ReferenceUtf8SequenceLength(const uint8_t* s, size_t len)
+	{
+		// length of the sequence at "s", assuming the remaining string is valid up to this point
+		auto c = s[0];
+		unsigned l = (c < 0x80) ? 1 : (c < 0xE0) ? 2 : (c < 0xF0) ? 3 : 4;
+		return (l <= len && ReferenceUtf8Validate(s, l)) ? l : 0;
+	}
+
+	static ucs4 ReferenceUtf8Decode(const uint8_t* s, unsigned l)
+	{
+		switch (l) {
+		case 1: return s[0];
+		case 2: return ((s[0]&0x1f)<<6) | (s[1]&0x3f);
+		case 3: return ((s[0]&0x0f)<<12) | ((s[1]&0x3f)<<6) | (s[2]&0x3f);
+		default: return ((s[0]&0x07)<<18) | ((s[1]&0x3f)<<12) | ((s[2]&0x3f)<<6) | (s[3]&0x3f);
+		}
+	}
+
+	// same results (including the error codes and the order they're checked in) as utf8_2_ucs4
+	static int ReferenceUtf8ToUcs4(const uint8_t* s, size_t sl, ucs4* dst, size_t dl)
+	{
+		size_t i = 0, d = 0;
+		int err = 0;
+		while (i < sl) {
+			auto c = s[i];
+			unsigned expectedLength = (c < 0x80) ? 1 : (c < 0xC0) ? 1 : (c < 0xE0) ? 2 : (c < 0xF0) ? 3 : (c < 0xF8) ? 4 : (c < 0xFC) ? 5 : 6;
+			if (i + expectedLength > sl) { err = -1; break; }
+			auto l = ReferenceUtf8SequenceLength(s+i, sl-i);
+			if (l != expectedLength) { err = -2; break; }
+			auto ch = ReferenceUtf8Decode(s+i, l);
+			if (d >= dl) { err = -2; break; }
+			if (ch == 0) break;
+			dst[d++] = ch;
+			i += l;
+		}
+		dst[d] = 0;
+		return err ? err : int(d);
+	}
+
+	// same results as utf8_2_ucs2 (characters outside of the BMP become surrogate pairs)
+	static int ReferenceUtf8ToUcs2(const uint8_t* s, size_t sl, ucs2* dst, size_t dl)
+	{
+		size_t i = 0, d = 0;
+		int err = 0;
+		while (i < sl) {
+			auto c = s[i];
+			unsigned expectedLength = (c < 0x80) ? 1 : (c < 0xC0) ? 1 : (c < 0xE0) ? 2 : (c < 0xF0) ? 3 : (c < 0xF8) ? 4 : (c < 0xFC) ? 5 : 6;
+			if (i + expectedLength > sl) { err = -1; break; }
+			auto l = ReferenceUtf8SequenceLength(s+i, sl-i);
+			if (l != expectedLength) { err = -2; break; }
+			auto ch = ReferenceUtf8Decode(s+i, l);
+			if (d >= dl) { err = -2; break; }
+			if (ch <= 0xffff) {
+				if (ch == 0) break;
+				dst[d++] = ucs2(ch);
+			} else {
+				if (d + 1 >= dl) break;
+				ch -= 0x10000;
+				dst[d++] = ucs2((ch >> 10) + 0xD800);
+				dst[d++] = ucs2((ch & 0x3ff) + 0xDC00);
+			}
+			i += l;
+		}
+		dst[d] = 0;
+		return err ? err : int(d);
+	}
+
+	static size_t ReferenceUtf8Strlen(const utf8* s)
+	{
+		size_t cnt = 0, i = 0;
+		while (utf8_nextchar(s, &i) != 0) ++cnt;
+		return cnt;
+	}
+
+	static const char* ReferenceFindAnyChar(StringSection<> s, const char delims[])
+	{
+		for (const auto& chr:s)
+			for (const char *d = delims; *d; ++d)
+				if (chr == *d) return &chr;
+		return nullptr;
+	}
+
+	static const char* ReferenceFindNot(StringSection<> s, const char delims[])
+	{
+		for (auto* i = s.begin(); i!=s.end(); ++i) {
+			const char *d = delims;
+			for (; *d; ++d)
+				if (*i == *d) break;
+			if (*d == '\0') return i;
+		}
+		return nullptr;
+	}
+
+	static char ReferenceToLower(char c) { return (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c; }
+
+	static const char* ReferenceFindString(StringSection<> s, StringSection<> x, bool caseInsensitive)
+	{
+		if (s.size() < x.size()) return nullptr;
+		for (size_t i=0; i<=s.size()-x.size(); ++i) {
+			size_t c=0;
+			for (; c<x.size(); ++c)
+				if (caseInsensitive ? (ReferenceToLower(s[i+c]) != ReferenceToLower(x[c])) : (s[i+c] != x[c]))
+					break;
+			if (c == x.size()) return s.begin()+i;
+		}
+		return nullptr;
+	}
+
+	static int ReferenceCompareStringI(StringSection<> a, StringSection<> b)
+	{
+		auto len = std::min(a.size(), b.size());
+		for (size_t i=0; i<len; ++i) {
+			int ca = (uint8_t)ReferenceToLower(a[i]), cb = (uint8_t)ReferenceToLower(b[i]);
+			if (ca != cb) return ca - cb;
+			if (!ca) return (a.size() == b.size()) ? 0 : (a.size() < b.size()) ? -int(ReferenceToLower(b[a.size()])) : int(ReferenceToLower(a[b.size()]));
+		}
+		if (a.size() == b.size()) return 0;
+		if (a.size() < b.size()) return -int(ReferenceToLower(b[a.size()]));
+		return ReferenceToLower(a[b.size()]);
+	}
+
+	static int Sign(int v) { return (v > 0) - (v < 0); }
+
+	static void AppendUtf8(std::vector<uint8_t>& dst, ucs4 ch)
+	{
+		utf8 buffer[4];
+		auto len = ucs4_2_utf8(ch, buffer);
+		dst.insert(dst.end(), buffer, buffer+len);
+	}
+
+	static ucs4 RandomCodePoint(std::mt19937_64& rng)
+	{
+		// mostly ascii, with a mix of each of the longer sequence lengths
+		switch (rng()%8) {
+		case 0: return std::uniform_int_distribution<ucs4>(0x80, 0x7ff)(rng);
+		case 1: { auto ch = std::uniform_int_distribution<ucs4>(0x800, 0xffff)(rng); return (ch >= 0xD800 && ch <= 0xDFFF) ? 0xE000 : ch; }
+		case 2: return std::uniform_int_distribution<ucs4>(0x10000, 0x10ffff)(rng);
+		default: return std::uniform_int_distribution<ucs4>(1, 0x7f)(rng);
+		}
+	}
+
+	TEST_CASE( "Utilities-UTF8Validation", "[utility]" )
+	{
+		#if defined(_DEBUG)
+			const unsigned exhaustiveStride = 7;		// (too slow to test every case in debug builds)
+		#else
+			const unsigned exhaustiveStride = 1;
+		#endif
+
+		SECTION("Short sequences, at every position within a block")
+		{
+			// every 1 and 2 byte combination, surrounded by ascii, at every offset within 2 SIMD blocks
+			uint8_t buffer[48];
+			for (unsigned offset=0; offset<32; ++offset)
+				for (unsigned c=0; c<65536; c+=(offset==15 ? 1 : exhaustiveStride)) {
+					std::memset(buffer, 'a', sizeof(buffer));
+					buffer[offset] = uint8_t(c); buffer[offset+1] = uint8_t(c>>8);
+					for (auto len:{offset+1, offset+2, (unsigned)sizeof(buffer)})
+						if (utf8_validate((const utf8*)buffer, len) != ReferenceUtf8Validate(buffer, len)) {
+							std::cout << "Mismatch on sequence " << std::hex << c << std::dec << " at offset " << offset << " length " << len << std::endl;
+							REQUIRE(utf8_validate((const utf8*)buffer, len) == ReferenceUtf8Validate(buffer, len));
+						}
+				}
+		}
+
+		SECTION("Every 3 byte sequence")
+		{
+			// straddling the boundary between blocks, and at the very end of the input
+			uint8_t buffer[32];
+			std::memset(buffer, 'a', sizeof(buffer));
+			for (unsigned c=0; c<(1u<<24); c+=exhaustiveStride) {
+				buffer[14] = uint8_t(c); buffer[15] = uint8_t(c>>8); buffer[16] = uint8_t(c>>16);
+				REQUIRE(utf8_validate((const utf8*)buffer, sizeof(buffer)) == ReferenceUtf8Validate(buffer, sizeof(buffer)));
+				REQUIRE(utf8_validate((const utf8*)buffer, 17) == ReferenceUtf8Validate(buffer, 17));
+			}
+		}
+
+		SECTION("4 byte sequences")
+		{
+			// every lead & second byte combination, with the interesting values for the remaining bytes
+			const uint8_t tailValues[] { 0x00, 0x41, 0x7f, 0x80, 0x8f, 0x90, 0x9f, 0xa0, 0xbf, 0xc0, 0xc2, 0xe0, 0xf0, 0xff };
+			uint8_t buffer[32];
+			std::memset(buffer, 'a', sizeof(buffer));
+			for (unsigned lead=0xc0; lead<0x100; ++lead)
+				for (unsigned second=0; second<0x100; ++second)
+					for (auto third:tailValues)
+						for (auto fourth:tailValues)
+							for (unsigned offset:{0u, 13u, 14u, 28u}) {
+								buffer[offset] = uint8_t(lead); buffer[offset+1] = uint8_t(second); buffer[offset+2] = third; buffer[offset+3] = fourth;
+								REQUIRE(utf8_validate((const utf8*)buffer, sizeof(buffer)) == ReferenceUtf8Validate(buffer, sizeof(buffer)));
+								std::memset(buffer+offset, 'a', 4);
+							}
+		}
+
+		SECTION("Random text with mutations")
+		{
+			std::mt19937_64 rng(0x7e57f00d);
+			std::vector<uint8_t> text;
+			for (unsigned trial=0; trial<20000; ++trial) {
+				text.clear();
+				auto charCount = std::uniform_int_distribution<unsigned>(0, 100)(rng);
+				for (unsigned c=0; c<charCount; ++c) AppendUtf8(text, RandomCodePoint(rng));
+				REQUIRE(utf8_validate((const utf8*)text.data(), text.size()));
+				REQUIRE(ReferenceUtf8Validate(text.data(), text.size()));
+
+				auto mutations = std::uniform_int_distribution<unsigned>(0, 2)(rng);
+				for (unsigned m=0; m<mutations && !text.empty(); ++m)
+					text[rng()%text.size()] = uint8_t(rng());
+				auto len = text.empty() ? 0 : std::uniform_int_distribution<size_t>(0, text.size())(rng);
+				REQUIRE(utf8_validate((const utf8*)text.data(), len) == ReferenceUtf8Validate(text.data(), len));
+			}
+		}
+	}
+
+	TEST_CASE( "Utilities-UTF8Transcoding", "[utility]" )
+	{
+		SECTION("Every code point, between runs of ascii")
+		{
+			std::vector<uint8_t> text;
+			ucs4 ucs4Result[64], ucs4Expected[64];
+			ucs2 ucs2Result[64], ucs2Expected[64];
+			for (ucs4 ch=1; ch<0x110000; ++ch) {
+				if (ch >= 0xD800 && ch <= 0xDFFF) continue;
+				text.clear();
+				for (unsigned c=0; c<(ch%23); ++c) text.push_back(uint8_t('A' + c));
+				AppendUtf8(text, ch);
+				for (unsigned c=0; c<20; ++c) text.push_back(uint8_t('a' + c));
+
+				auto r = utf8_2_ucs4((const utf8*)text.data(), text.size(), ucs4Result, 63);
+				REQUIRE(r == ReferenceUtf8ToUcs4(text.data(), text.size(), ucs4Expected, 63));
+				REQUIRE(std::memcmp(ucs4Result, ucs4Expected, (r+1)*sizeof(ucs4)) == 0);
+
+				r = utf8_2_ucs2((const utf8*)text.data(), text.size(), ucs2Result, 63);
+				REQUIRE(r == ReferenceUtf8ToUcs2(text.data(), text.size(), ucs2Expected, 63));
+				REQUIRE(std::memcmp(ucs2Result, ucs2Expected, (r+1)*sizeof(ucs2)) == 0);
+
+				text.push_back(0);
+				REQUIRE(utf8_strlen((const utf8*)text.data()) == ReferenceUtf8Strlen((const utf8*)text.data()));
+			}
+		}
+
+		SECTION("Random text, with limited destination space, nulls and invalid sequences")
+		{
+			std::mt19937_64 rng(0x5eed1e55);
+			std::vector<uint8_t> text;
+			std::vector<ucs4> ucs4Result, ucs4Expected;
+			std::vector<ucs2> ucs2Result, ucs2Expected;
+			for (unsigned trial=0; trial<20000; ++trial) {
+				text.clear();
+				auto charCount = std::uniform_int_distribution<unsigned>(0, 200)(rng);
+				bool asciiHeavy = rng()&1;
+				for (unsigned c=0; c<charCount; ++c)
+					AppendUtf8(text, (asciiHeavy && (rng()%16) != 0) ? ucs4('a' + rng()%26) : RandomCodePoint(rng));
+				switch (rng()%4) {
+				case 0: if (!text.empty()) text[rng()%text.size()] = 0; break;
+				case 1: if (!text.empty()) text[rng()%text.size()] = uint8_t(rng()); break;
+				default: break;
+				}
+
+				auto dl = std::uniform_int_distribution<size_t>(0, text.size()+1)(rng);
+				ucs4Result.assign(dl+1, 0xcdcdcdcd); ucs4Expected.assign(dl+1, 0xcdcdcdcd);
+				ucs2Result.assign(dl+1, 0xcdcd); ucs2Expected.assign(dl+1, 0xcdcd);
+				REQUIRE(utf8_2_ucs4((const utf8*)text.data(), text.size(), ucs4Result.data(), dl) == ReferenceUtf8ToUcs4(text.data(), text.size(), ucs4Expected.data(), dl));
+				REQUIRE(ucs4Result == ucs4Expected);
+				REQUIRE(utf8_2_ucs2((const utf8*)text.data(), text.size(), ucs2Result.data(), dl) == ReferenceUtf8ToUcs2(text.data(), text.size(), ucs2Expected.data(), dl));
+				REQUIRE(ucs2Result == ucs2Expected);
+			}
+		}
+
+		SECTION("utf8_strlen at every alignment")
+		{
+			std::mt19937_64 rng(0x57231e);
+			alignas(16) uint8_t buffer[512];
+			for (unsigned trial=0; trial<20000; ++trial) {
+				std::vector<uint8_t> text;
+				if (rng()%8 == 0) text.push_back(0x80);		// (leading continuation is counted as a character)
+				auto charCount = std::uniform_int_distribution<unsigned>(0, 100)(rng);
+				for (unsigned c=0; c<charCount; ++c) AppendUtf8(text, RandomCodePoint(rng));
+				text.push_back(0);
+				auto offset = rng()%32;
+				std::memset(buffer, 0xff, sizeof(buffer));
+				std::memcpy(buffer+offset, text.data(), text.size());
+				REQUIRE(utf8_strlen((const utf8*)buffer+offset) == ReferenceUtf8Strlen((const utf8*)buffer+offset));
+			}
+		}
+	}
+
+	TEST_CASE( "Utilities-StringSearch", "[utility]" )
+	{
+		std::mt19937_64 rng(0x5ea4c4);
+		const char* delimSets[] {
+			" \t\r\n", ",;", "=", "/\\", "aZ", "{}[]()<>", "0123456789", "\x01\x7f\x80\xff",
+			"\x01\x11\x21\x31\x41\x51\x61\x71\x81\x91\xa1",		// (too many high nibbles for the nibble tables)
+			"abcdefghijklmnopqrstuvwxyz"
+		};
+		// small alphabet, so we get plenty of matches and near-matches
+		const char alphabet[] { 'a', 'b', 'A', 'B', ' ', '\t', ',', '=', '/', '{', '0', '9', 'z', 'Z', '\x80', '\xff', '\x01' };
+
+		alignas(16) char buffer[320];
+		for (unsigned trial=0; trial<50000; ++trial) {
+			auto offset = rng()%32;
+			auto len = std::uniform_int_distribution<size_t>(0, 260)(rng);
+			std::memset(buffer, 0x20, sizeof(buffer));
+			for (size_t c=0; c<len; ++c) buffer[offset+c] = alphabet[rng()%dimof(alphabet)];
+			buffer[offset+len] = 0;
+			StringSection<> s { buffer+offset, buffer+offset+len };
+
+			// character class search
+			auto* delims = delimSets[rng()%dimof(delimSets)];
+			REQUIRE(XlFindAnyChar(s, delims) == ReferenceFindAnyChar(s, delims));
+			REQUIRE(XlFindNot(s, delims) == ReferenceFindNot(s, delims));
+			REQUIRE(XlFindAnyChar((const char*)s.begin(), delims) == ReferenceFindAnyChar(s, delims));
+			REQUIRE(XlFindNot((const char*)s.begin(), delims) == ReferenceFindNot(s, delims));
+			auto ch = alphabet[rng()%dimof(alphabet)];
+			REQUIRE(XlFindChar(s, ch) == ReferenceFindAnyChar(s, std::string(1, ch).c_str()));
+
+			// substring search, with a substring that's usually taken from "s" (and then maybe modified)
+			auto xlen = std::uniform_int_distribution<size_t>(0, 20)(rng);
+			std::string x;
+			if (len >= xlen && (rng()%4) != 0) {
+				auto start = std::uniform_int_distribution<size_t>(0, len-xlen)(rng);
+				x = std::string(s.begin()+start, s.begin()+start+xlen);
+				if (!x.empty() && (rng()%2)) x[rng()%x.size()] = alphabet[rng()%dimof(alphabet)];
+			} else {
+				for (size_t c=0; c<xlen; ++c) x.push_back(alphabet[rng()%dimof(alphabet)]);
+			}
+			REQUIRE(XlFindString(s, MakeStringSection(x)) == ReferenceFindString(s, MakeStringSection(x), false));
+			REQUIRE(XlFindStringI(s, MakeStringSection(x)) == ReferenceFindString(s, MakeStringSection(x), true));
+			REQUIRE(XlFindStringI(s.begin(), x.c_str()) == ReferenceFindString(s, MakeStringSection(x), true));
+
+			// case insensitive comparison, against a copy with random case changes (and maybe a different length)
+			std::string other = s.AsString();
+			for (auto& c:other)
+				if ((rng()%4) == 0) c = (c >= 'a' && c <= 'z') ? char(c - 'a' + 'A') : (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c;
+			switch (rng()%4) {
+			case 0: if (!other.empty()) other[rng()%other.size()] = alphabet[rng()%dimof(alphabet)]; break;
+			case 1: if (!other.empty()) other.resize(rng()%other.size()); break;
+			case 2: other.push_back(alphabet[rng()%dimof(alphabet)]); break;
+			default: break;
+			}
+			REQUIRE(XlEqStringI(s, MakeStringSection(other)) == (ReferenceCompareStringI(s, MakeStringSection(other)) == 0));
+			REQUIRE(Sign(XlCompareStringI(s, MakeStringSection(other))) == Sign(ReferenceCompareStringI(s, MakeStringSection(other))));
+			REQUIRE(Sign(XlCompareStringI(MakeStringSection(other), s)) == Sign(ReferenceCompareStringI(MakeStringSection(other), s)));
+		}
+	}
+
+	TEST_CASE( "Utilities-StringSearch-Performance", "[utility]" )
+	{
+		#if defined(_DEBUG)
+			const size_t textSize = 1024*1024;
+		#else
+			const size_t textSize = 32*1024*1024;
+		#endif
+		std::mt19937_64 rng(0x9e4f);
+
+		// mostly ascii text, similar to config files & paths, with some multibyte characters
+		std::vector<uint8_t> text;
+		text.reserve(textSize+4);
+		const char* words[] { "Position", "Color", "Texture", "Shader", "TechniqueDelegate", "0.5", "Material", "xleres/Objects", "Skinning", "Depth" };
+		while (text.size() < textSize) {
+			if ((rng()%32) == 0) { AppendUtf8(text, RandomCodePoint(rng) | 0x80); continue; }
+			auto* w = words[rng()%dimof(words)];
+			text.insert(text.end(), w, w+std::strlen(w));
+			text.push_back(" \t=/,\n"[rng()%6]);
+		}
+		text.push_back(0);
+		auto* textBegin = (const char*)text.data();
+		auto* textEnd = textBegin + text.size() - 1;
+		auto textLength = size_t(textEnd - textBegin);
+
+		auto gbPerSecond = [textLength](auto duration) { return double(textLength) / 1e9 / std::chrono::duration_cast<std::chrono::duration<double>>(duration).count(); };
+		auto time = [](auto&& fn) {
+			auto start = std::chrono::steady_clock::now();
+			fn();
+			return std::chrono::steady_clock::now() - start;
+		};
+
+		size_t sink = 0;
+		auto validateTime = time([&]() { sink += utf8_validate(textBegin, textLength); });
+		auto referenceValidateTime = time([&]() { sink += ReferenceUtf8Validate((const uint8_t*)textBegin, textLength); });
+		std::cout << "UTF8 validation: " << gbPerSecond(validateTime) << " GB/s (reference: " << gbPerSecond(referenceValidateTime) << " GB/s)" << std::endl;
+
+		std::vector<ucs4> ucs4Buffer(textLength+1);
+		auto transcodeTime = time([&]() { sink += utf8_2_ucs4(textBegin, textLength, ucs4Buffer.data(), ucs4Buffer.size()-1); });
+		auto referenceTranscodeTime = time([&]() { sink += ReferenceUtf8ToUcs4((const uint8_t*)textBegin, textLength, ucs4Buffer.data(), ucs4Buffer.size()-1); });
+		std::cout << "UTF8 to UCS4: " << gbPerSecond(transcodeTime) << " GB/s (reference: " << gbPerSecond(referenceTranscodeTime) << " GB/s)" << std::endl;
+
+		auto strlenTime = time([&]() { sink += utf8_strlen(textBegin); });
+		auto referenceStrlenTime = time([&]() { sink += ReferenceUtf8Strlen(textBegin); });
+		std::cout << "utf8_strlen: " << gbPerSecond(strlenTime) << " GB/s (reference: " << gbPerSecond(referenceStrlenTime) << " GB/s)" << std::endl;
+
+		// tokenizing the entire text on delimiters, as a simple parser would
+		auto tokenize = [&](auto&& findAny) {
+			StringSection<> remaining { textBegin, textEnd };
+			while (auto* d = findAny(remaining, " \t\n=,")) {
+				++sink;
+				remaining._start = d+1;
+			}
+		};
+		auto findAnyTime = time([&]() { tokenize([](StringSection<> s, const char* delims) { return XlFindAnyChar(s, delims); }); });
+		auto referenceFindAnyTime = time([&]() { tokenize([](StringSection<> s, const char* delims) { return ReferenceFindAnyChar(s, delims); }); });
+		std::cout << "XlFindAnyChar (tokenizing): " << gbPerSecond(findAnyTime) << " GB/s (reference: " << gbPerSecond(referenceFindAnyTime) << " GB/s)" << std::endl;
+
+		const char needle[] = "techniquedelegate/missing";
+		auto findTime = time([&]() { sink += size_t(XlFindStringI(MakeStringSection(textBegin, textEnd), MakeStringSectionLiteral(needle))); });
+		auto referenceFindTime = time([&]() { sink += size_t(ReferenceFindString(MakeStringSection(textBegin, textEnd), MakeStringSectionLiteral(needle), true)); });
+		std::cout << "XlFindStringI (no match): " << gbPerSecond(findTime) << " GB/s (reference: " << gbPerSecond(referenceFindTime) << " GB/s)" << std::endl;
+
+		std::string upper { textBegin, textEnd };
+		for (auto& c:upper) if (c >= 'a' && c <= 'z') c = char(c - 'a' + 'A');
+		auto compareTime = time([&]() { sink += XlEqStringI(MakeStringSection(textBegin, textEnd), MakeStringSection(upper)); });
+		auto referenceCompareTime = time([&]() { sink += ReferenceCompareStringI(MakeStringSection(textBegin, textEnd), MakeStringSection(upper)) == 0; });
+		std::cout << "XlEqStringI: " << gbPerSecond(compareTime) << " GB/s (reference: " << gbPerSecond(referenceCompareTime) << " GB/s)" << std::endl;
+
+		REQUIRE(sink != 0);
+	}
+}
@@ -9,10 +9,18 @@
 #include "../../Utility/Streams/PathUtils.h"
 #include "../../Utility/FunctionUtils.h"
 #include "../../Utility/MemoryUtils.h"
+#include "../../Utility/ContentHash.h"
+#include "../../Utility/ArithmeticUtils.h"
 #include "../../Utility/Conversion.h"
 #include "../../Utility/FastParseValue.h"
 #include <stdexcept>
 #include <iostream>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <cstring>
 #include "catch2/catch_test_macros.hpp"
 #include "catch2/catch_approx.hpp"
 
@@ -316,6 +324,161 @@ namespace UnitTests
             ConstHash64LegacyFromString(s1.begin(), s1.end()));
     }
 
+    static std::vector<uint8_t> MakeHashTestData(size_t size)
+    {
+        // std::mt19937_64 is fully specified by the standard, so this is the same on every platform
+        std::mt19937_64 rng(1);
+        std::vector<uint8_t> result(size);
+        for (auto& b:result) b = uint8_t(rng());
+        return result;
+    }
+
+    TEST_CASE( "Utilities-ContentHash", "[utility]" )
+    {
+        auto data = MakeHashTestData(70000);
+        auto range = [&data](size_t size) { return MakeIteratorRange(data.data(), data.data()+size); };
+
+        SECTION("Known values")
+        {
+            // These values are expected to be stable across platforms & instruction sets, and must not
+            // change, since they may be written to disk
+            struct Expected { size_t _size; uint64_t _hash64; Hash128 _hash128Seeded; };
+            const Expected expected[] {
+                { 0,        0x892eca380324f440ull, { 0xe8f9108085b469fbull, 0xfe6620b1d02ac4dcull } },
+                { 3,        0xc40f7b71ca43632dull, { 0xdb52724574819825ull, 0xa187099f64165989ull } },
+                { 16,       0x4d461908e2c0987aull, { 0xcbf0d4c9818187dbull, 0x0a60ff0b870894c6ull } },
+                { 17,       0x3320cb0a5c67b75full, { 0xc5f42ddea22a41edull, 0x97a19b1e82c4b80full } },
+                { 128,      0x8df5ca2a9a258b36ull, { 0x41fb31a92dd56a52ull, 0xd84bcbd649318de4ull } },
+                { 129,      0x2d57039a8259d094ull, { 0xc0976a58b881f565ull, 0xabc35050879559a7ull } },
+                { 1024,     0x5c9c53e368355246ull, { 0x028fb4dc49c4c34full, 0x7bb70ea5ce36db04ull } },
+                { 1088,     0xd31fc485e9101d86ull, { 0x698312c4c0524077ull, 0x21e78dfb937537b5ull } },
+                { 65536,    0xdafc82dc01f05589ull, { 0xec072eca889f3db5ull, 0x26c2072cc7db718full } }
+            };
+            for (const auto& e:expected) {
+                REQUIRE(ContentHash64(range(e._size)) == e._hash64);
+                REQUIRE(ContentHash128(range(e._size), 12345) == e._hash128Seeded);
+                REQUIRE(ContentHash128(range(e._size))._low == e._hash64);
+            }
+        }
+
+        SECTION("Streaming matches single call")
+        {
+            std::mt19937_64 rng(0x51a7e5ull);
+            // sizes around the short/long boundary, stripe boundaries and block (16 stripe) boundaries
+            const size_t sizes[] { 0, 1, 7, 8, 15, 16, 17, 63, 64, 65, 127, 128, 129, 191, 192, 193, 1023, 1024, 1025, 1087, 1088, 4096, 69999 };
+            for (auto size:sizes) {
+                auto expected64 = ContentHash64(range(size));
+                auto expected128 = ContentHash128(range(size));
+                for (unsigned trial=0; trial<16; ++trial) {
+                    ContentHasher hasher;
+                    size_t maxChunk = (trial < 8) ? 17 : 300;
+                    size_t offset = 0;
+                    while (offset < size) {
+                        auto chunk = std::min(size - offset, size_t(rng() % maxChunk));
+                        hasher.Update(data.data()+offset, data.data()+offset+chunk);
+                        offset += chunk;
+                    }
+                    REQUIRE(hasher.GetTotalLength() == size);
+                    REQUIRE(hasher.Finalize64() == expected64);
+                    REQUIRE(hasher.Finalize128() == expected128);
+                }
+            }
+
+            // finalizing doesn't disturb the state
+            ContentHasher hasher;
+            hasher.Update(range(100));
+            REQUIRE(hasher.Finalize64() == ContentHash64(range(100)));
+            hasher.Update(data.data()+100, data.data()+3000);
+            REQUIRE(hasher.Finalize64() == ContentHash64(range(3000)));
+            hasher.Reset();
+            hasher.Update(range(10));
+            REQUIRE(hasher.Finalize64() == ContentHash64(range(10)));
+        }
+
+        SECTION("Seeds, lengths & single bit changes")
+        {
+            REQUIRE(ContentHash64(range(1000), 0) != ContentHash64(range(1000), 1));
+            REQUIRE(ContentHash64(range(200)) != ContentHash64(range(201)));
+            // zero padding of the last stripe must not cause collisions with explicit zeroes
+            std::vector<uint8_t> zeroes(256, 0);
+            REQUIRE(ContentHash64(MakeIteratorRange(zeroes.data(), zeroes.data()+130)) != ContentHash64(MakeIteratorRange(zeroes.data(), zeroes.data()+192)));
+
+            std::mt19937_64 rng(0x0b17ull);
+            double totalBitsChanged = 0;
+            unsigned trialCount = 0;
+            for (size_t size:{3, 8, 16, 40, 100, 200, 3000}) {
+                std::vector<uint8_t> modified { data.begin(), data.begin()+size };
+                auto base = ContentHash64(MakeIteratorRange(modified));
+                for (unsigned trial=0; trial<128; ++trial) {
+                    auto bit = rng() % (size*8);
+                    modified[bit/8] ^= uint8_t(1u<<(bit%8));
+                    totalBitsChanged += popcount(ContentHash64(MakeIteratorRange(modified)) ^ base);
+                    modified[bit/8] ^= uint8_t(1u<<(bit%8));
+                    ++trialCount;
+                }
+            }
+            auto averageBitsChanged = totalBitsChanged / trialCount;
+            REQUIRE(averageBitsChanged > 30.0);
+            REQUIRE(averageBitsChanged < 34.0);
+        }
+    }
+
+    TEST_CASE( "Utilities-ContentHash-Performance", "[utility]" )
+    {
+        #if defined(_DEBUG)
+            const size_t maxSize = 16ull*1024*1024;
+        #else
+            const size_t maxSize = 1024ull*1024*1024;
+        #endif
+        // each size hashes roughly the same total number of bytes
+        const size_t bytesPerSize = std::min(maxSize, size_t(256ull*1024*1024));
+
+        std::unique_ptr<uint8_t[]> data;
+        size_t dataSize = maxSize;
+        while (!data && dataSize >= bytesPerSize/16) {
+            data.reset(new (std::nothrow) uint8_t[dataSize]);
+            if (!data) dataSize /= 2;
+        }
+        REQUIRE(data);
+        uint64_t x = 0x9E3779B97F4A7C15ull;
+        for (size_t c=0; c<dataSize/8; ++c) {
+            x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+            std::memcpy(&data[c*8], &x, 8);
+        }
+
+        auto gbPerSecond = [](size_t bytes, auto duration) { return double(bytes) / 1e9 / std::chrono::duration_cast<std::chrono::duration<double>>(duration).count(); };
+        uint64_t sink = 0;
+        for (size_t size=8; size<=dataSize; size*=8) {
+            auto iterations = std::max(bytesPerSize / size, size_t(1));
+            auto start = std::chrono::steady_clock::now();
+            for (size_t c=0; c<iterations; ++c)
+                sink += Hash64(data.get(), data.get()+size, c);
+            auto hash64End = std::chrono::steady_clock::now();
+            for (size_t c=0; c<iterations; ++c)
+                sink += ContentHash64(MakeIteratorRange(data.get(), data.get()+size), c);
+            auto contentHashEnd = std::chrono::steady_clock::now();
+            for (size_t c=0; c<iterations; ++c)
+                sink += ContentHash128(MakeIteratorRange(data.get(), data.get()+size), c)._high;
+            auto contentHash128End = std::chrono::steady_clock::now();
+
+            auto totalBytes = iterations * size;
+            std::cout << "Size " << size << " bytes: Hash64 " << gbPerSecond(totalBytes, hash64End-start) << " GB/s, ContentHash64 " << gbPerSecond(totalBytes, contentHashEnd-hash64End) << " GB/s, ContentHash128 " << gbPerSecond(totalBytes, contentHash128End-contentHashEnd) << " GB/s" << std::endl;
+        }
+
+        // streaming over the entire buffer in 1MB chunks (as if reading a file)
+        {
+            auto start = std::chrono::steady_clock::now();
+            ContentHasher hasher;
+            const size_t chunkSize = 1024*1024;
+            for (size_t offset=0; offset<dataSize; offset+=chunkSize)
+                hasher.Update(&data[offset], &data[std::min(offset+chunkSize, dataSize)]);
+            sink += hasher.Finalize64();
+            auto end = std::chrono::steady_clock::now();
+            std::cout << "ContentHasher (1MB updates over " << dataSize << " bytes): " << gbPerSecond(dataSize, end-start) << " GB/s" << std::endl;
+        }
+        REQUIRE(sink != 0);
+    }
+
     TEST_CASE( "Utilities-FastParseValue (integer)", "[utility]" )
     {
         const uint32_t testCount = 100000;
@@ -360,6 +523,167 @@ namespace UnitTests
         }
     }
 
+    TEST_CASE( "Utilities-FastParseValue (float)", "[utility]" )
+    {
+        // Round trip random bit patterns through printf, and compare against the standard library
+        std::mt19937_64 rng(0x4f1bbcdcbfa53e0aull);
+        const unsigned testCount = 200000;
+        for (unsigned t=0; t<testCount; ++t) {
+            auto doubleBits = rng();
+            double d;
+            std::memcpy(&d, &doubleBits, sizeof(d));
+            if (!std::isfinite(d)) continue;
+
+            const char* fmts[] = { "%.17g", "%.6g", "%.25e" };
+            char buffer[64];
+            std::snprintf(buffer, dimof(buffer), fmts[t%dimof(fmts)], d);
+            double parsed = 0., expected = std::strtod(buffer, nullptr);
+            REQUIRE(*FastParseValue(MakeStringSectionNullTerm(buffer), parsed) == '\0');
+            REQUIRE(std::memcmp(&parsed, &expected, sizeof(double)) == 0);
+
+            auto floatBits = uint32_t(doubleBits);
+            float f;
+            std::memcpy(&f, &floatBits, sizeof(f));
+            if (!std::isfinite(f)) continue;
+
+            const char* floatFmts[] = { "%.9g", "%.4g", "%.30f" };
+            std::snprintf(buffer, dimof(buffer), floatFmts[t%dimof(floatFmts)], f);
+            float parsedFloat = 0.f, expectedFloat = std::strtof(buffer, nullptr);
+            REQUIRE(*FastParseValue(MakeStringSectionNullTerm(buffer), parsedFloat) == '\0');
+            REQUIRE(std::memcmp(&parsedFloat, &expectedFloat, sizeof(float)) == 0);
+        }
+
+        // Long random digit sequences, which exercise the truncated mantissa path
+        for (unsigned t=0; t<testCount; ++t) {
+            std::string str;
+            if (rng()&1) str += '-';
+            auto integerDigits = 1+rng()%30, fractionalDigits = rng()%30;
+            for (unsigned c=0; c<integerDigits; ++c) str += char('0' + rng()%10);
+            if (fractionalDigits) {
+                str += '.';
+                for (unsigned c=0; c<fractionalDigits; ++c) str += char('0' + rng()%10);
+            }
+            if (rng()&1) str += "e" + std::to_string(int(rng()%700) - 350);
+
+            double parsed = 0., expected = std::strtod(str.c_str(), nullptr);
+            REQUIRE(FastParseValue(MakeStringSection(str), parsed) == AsPointer(str.end()));
+            REQUIRE(std::memcmp(&parsed, &expected, sizeof(double)) == 0);
+            float parsedFloat = 0.f, expectedFloat = std::strtof(str.c_str(), nullptr);
+            REQUIRE(FastParseValue(MakeStringSection(str), parsedFloat) == AsPointer(str.end()));
+            REQUIRE(std::memcmp(&parsedFloat, &expectedFloat, sizeof(float)) == 0);
+        }
+
+        // Special cases
+        float f = 1.f;
+        REQUIRE(*FastParseValue(MakeStringSectionNullTerm("-1.#IND"), f) == '\0');
+        REQUIRE(std::isnan(f));
+        REQUIRE(*FastParseValue(MakeStringSectionNullTerm("-inf"), f) == '\0');
+        REQUIRE(f == -std::numeric_limits<float>::infinity());
+        REQUIRE(*FastParseValue(MakeStringSectionNullTerm("1e40"), f) == '\0');
+        REQUIRE(f == std::numeric_limits<float>::infinity());
+        REQUIRE(*FastParseValue(MakeStringSectionNullTerm("1e-50"), f) == '\0');
+        REQUIRE(f == 0.f);
+        REQUIRE(*FastParseValue(MakeStringSectionNullTerm("1e+"), f) == 'e');
+        REQUIRE(f == 1.f);
+        const char notANumber[] = "abc";
+        REQUIRE(FastParseValue(MakeStringSectionNullTerm(notANumber), f) == notANumber);
+    }
+
+    TEST_CASE( "Utilities-FastParseValueList", "[utility]" )
+    {
+        const char input[] = "  1 2.5\t-3e2\n\r\n 4.000000000000000000000001 7 abc 8";
+        float floats[16];
+        size_t parsedCount = 0;
+        auto end = FastParseValueList(MakeStringSectionNullTerm(input), MakeIteratorRange(floats), parsedCount);
+        REQUIRE(parsedCount == 5);
+        REQUIRE(XlEqString(MakeStringSectionNullTerm(end), " abc 8"));
+        REQUIRE(floats[0] == 1.f); REQUIRE(floats[1] == 2.5f); REQUIRE(floats[2] == -300.f); REQUIRE(floats[3] == 4.f); REQUIRE(floats[4] == 7.f);
+
+        // stops when the destination is full
+        end = FastParseValueList(MakeStringSectionNullTerm(input), MakeIteratorRange(floats, &floats[2]), parsedCount);
+        REQUIRE(parsedCount == 2);
+        REQUIRE(XlEqString(MakeStringSectionNullTerm(end), "\t-3e2\n\r\n 4.000000000000000000000001 7 abc 8"));
+
+        // integers stop at the first character that isn't part of an integer
+        uint32_t uints[16];
+        end = FastParseValueList(MakeStringSectionNullTerm(input), MakeIteratorRange(uints), parsedCount);
+        REQUIRE(parsedCount == 2);
+        REQUIRE(uints[0] == 1); REQUIRE(uints[1] == 2);
+        REQUIRE(*end == '.');
+
+        const char longIntegers[] = "12345678901234567 -9 0000000000000000000000042 9223372036854775807";
+        int64_t int64s[16];
+        FastParseValueList(MakeStringSectionNullTerm(longIntegers), MakeIteratorRange(int64s), parsedCount);
+        REQUIRE(parsedCount == 4);
+        REQUIRE(int64s[0] == 12345678901234567ll); REQUIRE(int64s[1] == -9); REQUIRE(int64s[2] == 42); REQUIRE(int64s[3] == std::numeric_limits<int64_t>::max());
+
+        // results should match parsing one element at a time
+        std::mt19937_64 rng(0x6a7b0a3a0e1ec4c9ull);
+        std::string longList;
+        std::vector<double> expected;
+        for (unsigned c=0; c<10000; ++c) {
+            char buffer[64];
+            std::snprintf(buffer, dimof(buffer), (c%2) ? "%.17g\n" : "%.3f  ", std::uniform_real_distribution<double>(-1e6, 1e6)(rng));
+            longList += buffer;
+            expected.push_back(std::strtod(buffer, nullptr));
+        }
+        std::vector<double> doubles(expected.size()+1);
+        end = FastParseValueList(MakeStringSection(longList), MakeIteratorRange(doubles), parsedCount);
+        REQUIRE(parsedCount == expected.size());
+        REQUIRE(std::memcmp(doubles.data(), expected.data(), expected.size()*sizeof(double)) == 0);
+    }
+
+    TEST_CASE( "Utilities-FastParseValueList-Performance", "[utility]" )
+    {
+        #if defined(_DEBUG)
+            const unsigned elementCount = 100000;
+        #else
+            const unsigned elementCount = 4000000;
+        #endif
+        std::mt19937_64 rng(0x1d5f5b2e6c0b33a1ull);
+        std::string input;
+        for (unsigned c=0; c<elementCount; ++c) {
+            char buffer[32];
+            std::snprintf(buffer, dimof(buffer), "%.6f ", std::uniform_real_distribution<float>(-1000.f, 1000.f)(rng));
+            input += buffer;
+        }
+        std::vector<float> dst0(elementCount), dst1(elementCount), dst2(elementCount);
+        auto gbPerSecond = [&input](auto duration) { return double(input.size()) / 1e9 / std::chrono::duration_cast<std::chrono::duration<double>>(duration).count(); };
+
+        auto start = std::chrono::steady_clock::now();
+        size_t parsedCount = 0;
+        FastParseValueList(MakeStringSection(input), MakeIteratorRange(dst0), parsedCount);
+        auto listEnd = std::chrono::steady_clock::now();
+
+        {
+            auto* i = AsPointer(input.begin());
+            auto* end = AsPointer(input.end());
+            for (auto& d:dst1) {
+                while (i < end && IsWhitespace(*i)) ++i;
+                i = FastParseValue(MakeStringSection(i, end), d);
+            }
+        }
+        auto singleEnd = std::chrono::steady_clock::now();
+
+        {
+            const char* i = input.c_str();
+            for (auto& d:dst2) {
+                char* e;
+                d = std::strtof(i, &e);
+                i = e;
+            }
+        }
+        auto strtofEnd = std::chrono::steady_clock::now();
+
+        REQUIRE(parsedCount == elementCount);
+        REQUIRE(std::memcmp(dst0.data(), dst2.data(), elementCount*sizeof(float)) == 0);
+        REQUIRE(std::memcmp(dst1.data(), dst2.data(), elementCount*sizeof(float)) == 0);
+
+        std::cout << "FastParseValueList: " << gbPerSecond(listEnd-start) << " GB/s" << std::endl;
+        std::cout << "FastParseValue per element: " << gbPerSecond(singleEnd-listEnd) << " GB/s" << std::endl;
+        std::cout << "std::strtof: " << gbPerSecond(strtofEnd-singleEnd) << " GB/s" << std::endl;
+    }
+
     TEST_CASE( "SignalParameterForwarding", "[utility]" )
     {
         struct Uncopyable
@@ -0,0 +1,375 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "ContentHash.h"
+#include "PtrUtils.h"
+#include "../Core/SelectConfiguration.h"
+#include <algorithm>
+#include <cstring>
+#include <assert.h>
+
+#if (defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)) && defined(__SSE4_1__)
+	#include <immintrin.h>			// MSVC & clang intrinsic
+	#define HAS_SSE_INSTRUCTIONS
+	#if defined(__AVX2__)
+		#define HAS_AVX2_INSTRUCTIONS
+	#endif
+#endif
+
+namespace Utility
+{
+	//
+	//		The structure here is similar to XXH3 (see https://github.com/Cyan4973/xxHash) -- long inputs are
+	//		processed in 64 byte stripes, with each 64 bit lane accumulating a 32x32->64 multiply of the data
+	//		mixed with a key, plus the raw data of the neighbouring lane. Every "s_stripesPerBlock" stripes the
+	//		accumulators are scrambled. Short inputs go through a separate multiply-fold path.
+	//
+	//		The constants & details are our own, however, so the values are not compatible with XXH3.
+	//
+	//		Unlike XXH3, the final partial stripe is zero padded (rather than overlapping the previous stripe);
+	//		since the total length is mixed into the result, this doesn't introduce collisions, and it means
+	//		ContentHasher never needs to look back at data it has already consumed.
+	//
+
+	static constexpr unsigned s_stripesPerBlock = 16;
+	static constexpr unsigned s_laneCount = 8;
+
+	static constexpr uint64_t s_prime32_1 = 0x9E3779B1u;
+	static constexpr uint64_t s_prime32_2 = 0x85EBCA77u;
+	static constexpr uint64_t s_prime32_3 = 0xC2B2AE3Du;
+	static constexpr uint64_t s_prime64_1 = 0x9E3779B185EBCA87ull;
+	static constexpr uint64_t s_prime64_2 = 0xC2B2AE3D27D4EB4Full;
+	static constexpr uint64_t s_prime64_3 = 0x165667B19E3779F9ull;
+	static constexpr uint64_t s_prime64_4 = 0x85EBCA77C2B2AE63ull;
+	static constexpr uint64_t s_prime64_5 = 0x27D4EB2F165667C5ull;
+
+	// Layout of the key table:
+	//		[0, 24)		per-stripe keys (stripe n within the block uses [n, n+8))
+	//		[24, 32)	scramble keys
+	//		[32, 40)	merge keys for the low 64 bits
+	//		[40, 48)	merge keys for the high 64 bits
+	//		[48, 64)	short input keys
+	static constexpr unsigned s_scrambleKeys = s_stripesPerBlock + s_laneCount;
+	static constexpr unsigned s_mergeKeysLow = s_scrambleKeys + s_laneCount;
+	static constexpr unsigned s_mergeKeysHigh = s_mergeKeysLow + s_laneCount;
+	static constexpr unsigned s_shortKeys = s_mergeKeysHigh + s_laneCount;
+	static constexpr unsigned s_keyCount = s_shortKeys + 16;
+
+	struct KeyTable { uint64_t _keys[s_keyCount]; };
+	static constexpr KeyTable GenerateKeyTable()
+	{
+		// splitmix64 sequence; fixed so that the results are stable
+		KeyTable result {};
+		uint64_t state = 0x6A09E667F3BCC908ull;
+		for (unsigned c=0; c<s_keyCount; ++c) {
+			state += 0x9E3779B97F4A7C15ull;
+			uint64_t z = state;
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+			result._keys[c] = z ^ (z >> 31);
+		}
+		return result;
+	}
+	alignas(32) static constexpr KeyTable s_keyTable = GenerateKeyTable();
+
+	static uint64_t Read64(const void* ptr)
+	{
+		uint64_t result;
+		std::memcpy(&result, ptr, sizeof(result));
+		#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+			result = __builtin_bswap64(result);
+		#endif
+		return result;
+	}
+
+	static uint32_t Read32(const void* ptr)
+	{
+		uint32_t result;
+		std::memcpy(&result, ptr, sizeof(result));
+		#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+			result = __builtin_bswap32(result);
+		#endif
+		return result;
+	}
+
+	static uint64_t Mul128Fold64(uint64_t a, uint64_t b)
+	{
+		#if defined(__SIZEOF_INT128__)
+			auto r = (unsigned __int128)a * (unsigned __int128)b;
+			return uint64_t(r) ^ uint64_t(r >> 64);
+		#elif COMPILER_ACTIVE == COMPILER_TYPE_MSVC && defined(_M_X64)
+			uint64_t high;
+			uint64_t low = _umul128(a, b, &high);
+			return low ^ high;
+		#else
+			uint64_t aLo = uint32_t(a), aHi = a >> 32, bLo = uint32_t(b), bHi = b >> 32;
+			uint64_t ll = aLo * bLo, lh = aLo * bHi, hl = aHi * bLo, hh = aHi * bHi;
+			uint64_t middle = (ll >> 32) + uint32_t(lh) + uint32_t(hl);
+			uint64_t low = (middle << 32) | uint32_t(ll);
+			uint64_t high = hh + (lh >> 32) + (hl >> 32) + (middle >> 32);
+			return low ^ high;
+		#endif
+	}
+
+	static uint64_t Avalanche(uint64_t h)
+	{
+		h ^= h >> 37;
+		h *= s_prime64_3;
+		h ^= h >> 32;
+		return h;
+	}
+
+	///////////////////////////////////////////////////////////////////////////////////////////////////
+
+	static void InitAccumulators(uint64_t acc[s_laneCount], uint64_t seed)
+	{
+		const uint64_t init[] { s_prime32_3, s_prime64_1, s_prime64_2, s_prime64_3, s_prime64_4, s_prime32_2, s_prime64_5, s_prime32_1 };
+		for (unsigned c=0; c<s_laneCount; ++c)
+			acc[c] = (c&1) ? (init[c] - seed) : (init[c] + seed);
+	}
+
+	static void AccumulateStripes(uint64_t* __restrict acc, const uint8_t* __restrict data, unsigned stripeCount, unsigned firstStripeInBlock)
+	{
+		assert(firstStripeInBlock + stripeCount <= s_stripesPerBlock);
+		const uint64_t* keys = &s_keyTable._keys[firstStripeInBlock];
+
+		#if defined(HAS_AVX2_INSTRUCTIONS)
+			__m256i a0 = _mm256_load_si256((const __m256i*)&acc[0]);
+			__m256i a1 = _mm256_load_si256((const __m256i*)&acc[4]);
+			for (unsigned s=0; s<stripeCount; ++s, data+=ContentHasher::s_stripeSize, ++keys) {
+				__m256i d0 = _mm256_loadu_si256((const __m256i*)data);
+				__m256i d1 = _mm256_loadu_si256((const __m256i*)(data+32));
+				__m256i dk0 = _mm256_xor_si256(d0, _mm256_loadu_si256((const __m256i*)keys));
+				__m256i dk1 = _mm256_xor_si256(d1, _mm256_loadu_si256((const __m256i*)(keys+4)));
+				// lo32 * hi32 of each lane
+				__m256i p0 = _mm256_mul_epu32(dk0, _mm256_srli_epi64(dk0, 32));
+				__m256i p1 = _mm256_mul_epu32(dk1, _mm256_srli_epi64(dk1, 32));
+				// raw data goes to the neighbouring lane
+				a0 = _mm256_add_epi64(a0, _mm256_add_epi64(p0, _mm256_shuffle_epi32(d0, _MM_SHUFFLE(1,0,3,2))));
+				a1 = _mm256_add_epi64(a1, _mm256_add_epi64(p1, _mm256_shuffle_epi32(d1, _MM_SHUFFLE(1,0,3,2))));
+			}
+			_mm256_store_si256((__m256i*)&acc[0], a0);
+			_mm256_store_si256((__m256i*)&acc[4], a1);
+		#elif defined(HAS_SSE_INSTRUCTIONS)
+			__m128i a[4];
+			for (unsigned c=0; c<4; ++c) a[c] = _mm_load_si128((const __m128i*)&acc[c*2]);
+			for (unsigned s=0; s<stripeCount; ++s, data+=ContentHasher::s_stripeSize, ++keys) {
+				for (unsigned c=0; c<4; ++c) {
+					__m128i d = _mm_loadu_si128((const __m128i*)(data+c*16));
+					__m128i dk = _mm_xor_si128(d, _mm_loadu_si128((const __m128i*)(keys+c*2)));
+					__m128i p = _mm_mul_epu32(dk, _mm_srli_epi64(dk, 32));
+					a[c] = _mm_add_epi64(a[c], _mm_add_epi64(p, _mm_shuffle_epi32(d, _MM_SHUFFLE(1,0,3,2))));
+				}
+			}
+			for (unsigned c=0; c<4; ++c) _mm_store_si128((__m128i*)&acc[c*2], a[c]);
+		#else
+			for (unsigned s=0; s<stripeCount; ++s, data+=ContentHasher::s_stripeSize, ++keys) {
+				for (unsigned c=0; c<s_laneCount; ++c) {
+					uint64_t d = Read64(data + c*8);
+					uint64_t dk = d ^ keys[c];
+					acc[c^1] += d;
+					acc[c] += (dk & 0xffffffffull) * (dk >> 32ull);
+				}
+			}
+		#endif
+	}
+
+	static void ScrambleAccumulators(uint64_t acc[s_laneCount])
+	{
+		for (unsigned c=0; c<s_laneCount; ++c) {
+			auto a = acc[c];
+			a ^= a >> 47;
+			a ^= s_keyTable._keys[s_scrambleKeys+c];
+			a *= s_prime32_1;
+			acc[c] = a;
+		}
+	}
+
+	static void ConsumeStripes(uint64_t acc[s_laneCount], unsigned& stripeInBlock, const uint8_t* data, size_t stripeCount)
+	{
+		while (stripeCount) {
+			if (stripeInBlock == s_stripesPerBlock) {
+				ScrambleAccumulators(acc);
+				stripeInBlock = 0;
+			}
+			auto count = (unsigned)std::min(stripeCount, size_t(s_stripesPerBlock - stripeInBlock));
+			AccumulateStripes(acc, data, count, stripeInBlock);
+			stripeInBlock += count;
+			data += count * ContentHasher::s_stripeSize;
+			stripeCount -= count;
+		}
+	}
+
+	static void ConsumeFinalPartialStripe(uint64_t acc[s_laneCount], unsigned& stripeInBlock, const uint8_t* data, size_t size)
+	{
+		assert(size < ContentHasher::s_stripeSize);
+		if (!size) return;
+		alignas(32) uint8_t padded[ContentHasher::s_stripeSize];
+		std::memcpy(padded, data, size);
+		std::memset(padded+size, 0, sizeof(padded)-size);
+		ConsumeStripes(acc, stripeInBlock, padded, 1);
+	}
+
+	static uint64_t MergeAccumulators(const uint64_t acc[s_laneCount], const uint64_t* keys, uint64_t start)
+	{
+		uint64_t result = start;
+		for (unsigned c=0; c<s_laneCount; c+=2)
+			result += Mul128Fold64(acc[c] ^ keys[c], acc[c+1] ^ keys[c+1]);
+		return Avalanche(result);
+	}
+
+	template<bool Calculate128>
+		static Hash128 FinishLong(const uint64_t acc[s_laneCount], uint64_t totalLength)
+	{
+		Hash128 result;
+		result._low = MergeAccumulators(acc, &s_keyTable._keys[s_mergeKeysLow], totalLength * s_prime64_1);
+		if constexpr (Calculate128)
+			result._high = MergeAccumulators(acc, &s_keyTable._keys[s_mergeKeysHigh], ~(totalLength * s_prime64_2));
+		return result;
+	}
+
+	///////////////////////////////////////////////////////////////////////////////////////////////////
+
+	template<bool Calculate128>
+		static Hash128 HashShort(const uint8_t* data, size_t size, uint64_t seed)
+	{
+		assert(size <= ContentHasher::s_maxShortLength);
+		const uint64_t* keys = &s_keyTable._keys[s_shortKeys];
+		uint64_t low, high = 0;
+
+		if (size <= 16) {
+			uint64_t a, b;
+			if (size >= 8) {
+				a = Read64(data);
+				b = Read64(data+size-8);
+			} else if (size >= 4) {
+				a = Read32(data);
+				b = Read32(data+size-4);
+			} else if (size) {
+				a = (uint64_t(data[0]) << 16ull) | (uint64_t(data[size>>1]) << 24ull) | uint64_t(data[size-1]);
+				b = 0;
+			} else {
+				a = b = 0;
+			}
+			auto lengthBits = uint64_t(size) * s_prime64_5;
+			low = Avalanche(Mul128Fold64(a ^ (keys[0] + seed), b ^ (keys[1] - seed)) + lengthBits);
+			if constexpr (Calculate128)
+				high = Avalanche(Mul128Fold64(a ^ (keys[2] - seed), b ^ (keys[3] + seed)) ^ ~lengthBits);
+		} else {
+			// 16 byte chunks, with the last chunk overlapping the previous one
+			low = uint64_t(size) * s_prime64_1;
+			high = ~(uint64_t(size) * s_prime64_2);
+			auto chunkCount = unsigned((size + 15) / 16);
+			for (unsigned c=0; c<chunkCount; ++c) {
+				auto* chunk = data + std::min(size_t(c*16), size-16);
+				auto a = Read64(chunk), b = Read64(chunk+8);
+				low += Mul128Fold64(a ^ (keys[(c*2)&15] + seed), b ^ (keys[(c*2+1)&15] - seed));
+				if constexpr (Calculate128)
+					high += Mul128Fold64(a ^ (keys[(c*2+5)&15] - seed), b ^ (keys[(c*2+8)&15] + seed));
+			}
+			low = Avalanche(low);
+			if constexpr (Calculate128)
+				high = Avalanche(high);
+		}
+		return { low, high };
+	}
+
+	template<bool Calculate128>
+		static Hash128 HashAll(IteratorRange<const void*> data, uint64_t seed)
+	{
+		auto* ptr = (const uint8_t*)data.begin();
+		auto size = data.size();
+		if (size <= ContentHasher::s_maxShortLength)
+			return HashShort<Calculate128>(ptr, size, seed);
+
+		alignas(32) uint64_t acc[s_laneCount];
+		InitAccumulators(acc, seed);
+		unsigned stripeInBlock = 0;
+		auto fullStripes = size / ContentHasher::s_stripeSize;
+		ConsumeStripes(acc, stripeInBlock, ptr, fullStripes);
+		ConsumeFinalPartialStripe(acc, stripeInBlock, ptr + fullStripes * ContentHasher::s_stripeSize, size % ContentHasher::s_stripeSize);
+		return FinishLong<Calculate128>(acc, size);
+	}
+
+	uint64_t ContentHash64(IteratorRange<const void*> data, uint64_t seed)
+	{
+		return HashAll<false>(data, seed)._low;
+	}
+
+	Hash128 ContentHash128(IteratorRange<const void*> data, uint64_t seed)
+	{
+		return HashAll<true>(data, seed);
+	}
+
+	///////////////////////////////////////////////////////////////////////////////////////////////////
+
+	void ContentHasher::Update(IteratorRange<const void*> data)
+	{
+		auto* ptr = (const uint8_t*)data.begin();
+		auto size = data.size();
+		_totalLength += size;
+
+		// Until we have more than s_maxShortLength bytes, we can't know if we're going to use the short
+		// or long path, so everything just goes into the buffer
+		if (_bufferedBytes + size <= s_maxShortLength) {
+			std::memcpy(&_buffer[_bufferedBytes], ptr, size);
+			_bufferedBytes += unsigned(size);
+			return;
+		}
+
+		// From here we're definitely on the long path. The buffer always starts on a stripe boundary, and
+		// s_maxShortLength is a multiple of the stripe size; so we can fill it and consume it as whole stripes
+		static_assert((s_maxShortLength % s_stripeSize) == 0);
+		if (_bufferedBytes) {
+			auto fill = s_maxShortLength - _bufferedBytes;
+			std::memcpy(&_buffer[_bufferedBytes], ptr, fill);
+			ptr += fill;
+			size -= fill;
+			ConsumeStripes(_acc, _stripeInBlock, _buffer, s_maxShortLength / s_stripeSize);
+			_bufferedBytes = 0;
+		}
+
+		auto fullStripes = size / s_stripeSize;
+		ConsumeStripes(_acc, _stripeInBlock, ptr, fullStripes);
+		ptr += fullStripes * s_stripeSize;
+		size -= fullStripes * s_stripeSize;
+
+		std::memcpy(_buffer, ptr, size);
+		_bufferedBytes = unsigned(size);
+	}
+
+	template<bool Calculate128>
+		Hash128 ContentHasher::Finalize() const
+	{
+		if (_totalLength <= s_maxShortLength)
+			return HashShort<Calculate128>(_buffer, _bufferedBytes, _seed);
+
+		alignas(32) uint64_t acc[s_laneCount];
+		std::memcpy(acc, _acc, sizeof(acc));
+		unsigned stripeInBlock = _stripeInBlock;
+		auto fullStripes = _bufferedBytes / s_stripeSize;
+		ConsumeStripes(acc, stripeInBlock, _buffer, fullStripes);
+		ConsumeFinalPartialStripe(acc, stripeInBlock, _buffer + fullStripes * s_stripeSize, _bufferedBytes % s_stripeSize);
+		return FinishLong<Calculate128>(acc, _totalLength);
+	}
+
+	uint64_t ContentHasher::Finalize64() const { return Finalize<false>()._low; }
+	Hash128 ContentHasher::Finalize128() const { return Finalize<true>(); }
+
+	void ContentHasher::Reset(uint64_t seed)
+	{
+		InitAccumulators(_acc, seed);
+		_totalLength = 0;
+		_seed = seed;
+		_bufferedBytes = 0;
+		_stripeInBlock = 0;
+	}
+
+	ContentHasher::ContentHasher(uint64_t seed)
+	{
+		Reset(seed);
+	}
+
+	ContentHasher::~ContentHasher() {}
+}
@@ -0,0 +1,72 @@
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "Detail/API.h"
+#include "MemoryUtils.h"
+#include "IteratorUtils.h"
+#include <cstdint>
+
+namespace Utility
+{
+	struct Hash128
+	{
+		uint64_t _low = 0, _high = 0;
+		friend bool operator==(const Hash128& lhs, const Hash128& rhs) { return lhs._low == rhs._low && lhs._high == rhs._high; }
+		friend bool operator!=(const Hash128& lhs, const Hash128& rhs) { return !(lhs == rhs); }
+	};
+
+	///
+	/// <summary>High throughput hash for large blocks of data, such as file contents & artifacts</summary>
+	///
+	/// This is intended for hashing large data (eg, files, compiled artifacts, archives), where the speed
+	/// of Hash64() is a bottleneck. Large inputs are processed in 64 byte stripes across 8 independent
+	/// accumulators, which maps well onto SIMD instructions (SSE/AVX2 are used where available).
+	///
+	/// ContentHasher allows the same value to be calculated incrementally, so data doesn't need to be held
+	/// in memory all at once. The result of a ContentHasher is always identical to calling ContentHash64()
+	/// (or ContentHash128()) on the concatenation of all data passed to Update().
+	///
+	/// Results are stable across platforms and instruction sets (the SIMD and scalar paths produce the same
+	/// values, and data is read as little endian), so they may be written to disk. However, they are not
+	/// compatible with Hash64() -- and Hash64() itself is unchanged by this.
+	///
+	/// The low 64 bits of the 128 bit result are always the same as the 64 bit result.
+	///
+	XL_UTILITY_API uint64_t ContentHash64(IteratorRange<const void*> data, uint64_t seed = DefaultSeed64);
+	XL_UTILITY_API Hash128 ContentHash128(IteratorRange<const void*> data, uint64_t seed = DefaultSeed64);
+
+	class XL_UTILITY_API ContentHasher
+	{
+	public:
+		void Update(IteratorRange<const void*> data);
+		void Update(const void* begin, const void* end) { Update(MakeIteratorRange(begin, end)); }
+
+		/// Calculate the hash of all data so far. This doesn't modify the state, so more data can be added afterwards
+		uint64_t Finalize64() const;
+		Hash128 Finalize128() const;
+
+		void Reset(uint64_t seed = DefaultSeed64);
+		uint64_t GetTotalLength() const { return _totalLength; }
+
+		ContentHasher(uint64_t seed = DefaultSeed64);
+		~ContentHasher();
+
+		static constexpr unsigned s_stripeSize = 64;
+		static constexpr unsigned s_maxShortLength = 128;
+
+	private:
+		alignas(32) uint64_t _acc[8];
+		alignas(32) uint8_t _buffer[s_maxShortLength];
+		uint64_t _totalLength;
+		uint64_t _seed;
+		unsigned _bufferedBytes;
+		unsigned _stripeInBlock;
+
+		template<bool Calculate128> Hash128 Finalize() const;
+	};
+}
+
+using namespace Utility;
@@ -5,6 +5,7 @@
 #pragma once
 
 #include "StringUtils.h"        // (for StringSection)
+#include "IteratorUtils.h"      // (for IteratorRange)
 
 namespace Utility
 {
@@ -14,9 +15,9 @@ namespace Utility
         However, it's not fully supported everywhere yet; so we need something to get us by
 
         The floating point versions are particularly important, but also particularly lagging in
-        support. They also seem surprisingly difficult to implement with all of the edge cases.
-        So the implementation here isn't actually 100%... but it works in at least some cases, and
-        is quick. Just be careful with it -- because it's not guaranteed to be correct
+        support. They use the Eisel-Lemire algorithm for the decimal to binary conversion (falling back
+        to the standard library for inputs with more than 19 significant digits that can't be resolved
+        with a truncated mantissa), and so should produce the same results as std::strtof/std::strtod
     */
     template<typename CharType> constexpr const CharType* FastParseValue(StringSection<CharType> input, int32_t& dst);
     template<typename CharType> constexpr const CharType* FastParseValue(StringSection<CharType> input, uint32_t& dst);
@@ -29,6 +30,25 @@ namespace Utility
     template<typename CharType> const CharType* FastParseValue(StringSection<CharType> input, float& dst);
     template<typename CharType> const CharType* FastParseValue(StringSection<CharType> input, double& dst);
 
+    /*
+        FastParseValueList parses a whitespace separated list of values in a single call. This is intended for
+        long lists of numbers (such as the array data in Collada files), where the overhead of calling FastParseValue
+        for each element is significant.
+
+        Parsing stops when "dst" is full, when the input is exhausted, or when a token is encountered that can't be
+        parsed. "parsedCount" receives the number of elements written to "dst", and the return value points just
+        after the last element parsed (or to the start of the input, if nothing was parsed).
+
+        Floating point values are converted exactly (ie, the result is the closest representable value, matching
+        std::strtof/std::strtod). Integers wrap on overflow, as with FastParseValue
+    */
+    template<typename CharType> const CharType* FastParseValueList(StringSection<CharType> input, IteratorRange<float*> dst, size_t& parsedCount);
+    template<typename CharType> const CharType* FastParseValueList(StringSection<CharType> input, IteratorRange<double*> dst, size_t& parsedCount);
+    template<typename CharType> const CharType* FastParseValueList(StringSection<CharType> input, IteratorRange<int32_t*> dst, size_t& parsedCount);
+    template<typename CharType> const CharType* FastParseValueList(StringSection<CharType> input, IteratorRange<uint32_t*> dst, size_t& parsedCount);
+    template<typename CharType> const CharType* FastParseValueList(StringSection<CharType> input, IteratorRange<int64_t*> dst, size_t& parsedCount);
+    template<typename CharType> const CharType* FastParseValueList(StringSection<CharType> input, IteratorRange<uint64_t*> dst, size_t& parsedCount);
+
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
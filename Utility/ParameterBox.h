@@ -95,6 +95,7 @@ namespace Utility
         uint64_t  CalculateFilteredHashValue(const ParameterBox& source) const;
         bool    AreParameterNamesEqual(const ParameterBox& other) const;
         IteratorRange<const void*> GetValueTable() const;
+        IteratorRange<const TypeDesc*> GetTypeTable() const;
 
         ////////////////////////////////////////////////////////////////////////////////////////
             //      M E R G I N G   &   I T E R A T O R                     //
@@ -358,6 +359,11 @@ namespace Utility
         return MakeIteratorRange(_values);
     }
 
+    inline auto ParameterBox::GetTypeTable() const -> IteratorRange<const TypeDesc*>
+    {
+        return MakeIteratorRange(_types);
+    }
+
     using StringTable = std::vector<std::pair<const utf8*, std::string>>;
     XLE_DEPRECATED_ATTRIBUTE void    BuildStringTable(StringTable& defines, const ParameterBox& box);
     XLE_DEPRECATED_ATTRIBUTE void    OverrideStringTable(StringTable& defines, const ParameterBox& box);
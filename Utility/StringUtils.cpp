@@ -9,7 +9,10 @@
 #include "StringUtils.h"
 #include "MemoryUtils.h"
 #include "PtrUtils.h"   // for AsPointer
+#include "ArithmeticUtils.h"
 #include <string.h>
+#include <cstring>
+#include <algorithm>
 #include <wchar.h>
 #include <locale>
 #include <assert.h>
@@ -28,6 +31,11 @@
     #include <mbstring.h>
 #endif
 
+#if (defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)) && defined(__SSE4_1__)
+    #include <immintrin.h>			// MSVC & clang intrinsic
+    #define HAS_SSE_INSTRUCTIONS
+#endif
+
 namespace Utility
 {
 
@@ -584,6 +592,167 @@ int XlCompareStringI(const ucs4* x, const ucs4* y)
     return (int)(XlToLower(*x) - XlToLower(*y));
 }
 
+    //
+    //      Search & case insensitive compare helpers for 8 bit strings
+    //
+    //  Sets of delimiters are converted into a 256 bit membership mask. When the set spans no more than 8
+    //  distinct high nibbles (which covers almost every delimiter list in practice), we also build a pair of
+    //  16 entry nibble tables, such that c is in the set when (low[c&0xf] & high[c>>4]) != 0. With SSE that
+    //  allows us to classify 16 characters at a time with 2 shuffles.
+    //
+    //  Case insensitive comparisons only fold ascii characters (as does XlToLower(utf8))
+    //
+namespace
+{
+    struct CharacterClass
+    {
+        uint32_t _members[8] = {};
+        alignas(16) uint8_t _lowNibbles[16] = {};
+        alignas(16) uint8_t _highNibbles[16] = {};
+        bool _hasNibbleTables = true;
+
+        bool IsMember(char c) const { auto u = (uint8_t)c; return (_members[u>>5] >> (u&31)) & 1; }
+
+        #if defined(HAS_SSE_INSTRUCTIONS)
+            uint32_t Match(__m128i v) const
+            {
+                const auto nibbleMask = _mm_set1_epi8(0x0f);
+                auto low = _mm_shuffle_epi8(_mm_load_si128((const __m128i*)_lowNibbles), _mm_and_si128(v, nibbleMask));
+                auto high = _mm_shuffle_epi8(_mm_load_si128((const __m128i*)_highNibbles), _mm_and_si128(_mm_srli_epi16(v, 4), nibbleMask));
+                auto outside = _mm_cmpeq_epi8(_mm_and_si128(low, high), _mm_setzero_si128());
+                return ~(uint32_t)_mm_movemask_epi8(outside) & 0xffffu;
+            }
+        #endif
+
+        CharacterClass(const char delims[])
+        {
+            unsigned highBitsAllocated = 0;
+            for (const char* d = delims; *d; ++d) {
+                auto c = (uint8_t)*d;
+                _members[c>>5] |= 1u << (c&31);
+                auto& highBit = _highNibbles[c>>4];
+                if (!highBit) {
+                    if (highBitsAllocated == 8) { _hasNibbleTables = false; continue; }
+                    highBit = uint8_t(1u << highBitsAllocated++);
+                }
+                _lowNibbles[c&0xf] |= highBit;
+            }
+        }
+    };
+
+    // first character in [begin, end) that is in the class (or not in the class, when "inverse" is set)
+    const char* FindInClass(const CharacterClass& cls, const char* begin, const char* end, bool inverse)
+    {
+        auto* i = begin;
+        #if defined(HAS_SSE_INSTRUCTIONS)
+            if (cls._hasNibbleTables) {
+                uint32_t invertMask = inverse ? 0xffffu : 0u;
+                for (; (end - i) >= 16; i += 16) {
+                    auto matches = cls.Match(_mm_loadu_si128((const __m128i*)i)) ^ invertMask;
+                    if (matches) return i + xl_ctz4(matches);
+                }
+            }
+        #endif
+        for (; i!=end; ++i)
+            if (cls.IsMember(*i) != inverse) return i;
+        return nullptr;
+    }
+
+    // as above, but for null terminated strings. Returns nullptr if the terminator is found first
+    const char* FindInClass(const CharacterClass& cls, const char* s, bool inverse)
+    {
+        #if defined(HAS_SSE_INSTRUCTIONS)
+            if (cls._hasNibbleTables) {
+                // We use aligned loads, which will never cross a page boundary -- so it's safe to read before
+                // the start of the string and beyond the terminator
+                auto* block = (const char*)(size_t(s) & ~size_t(15));
+                uint32_t validMask = 0xffffu << unsigned(s - block);
+                uint32_t invertMask = inverse ? 0xffffu : 0u;
+                for (;;) {
+                    auto v = _mm_load_si128((const __m128i*)block);
+                    uint32_t terminators = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()));
+                    uint32_t stops = ((cls.Match(v) ^ invertMask) | terminators) & validMask;
+                    if (stops) {
+                        auto* result = block + xl_ctz4(stops);
+                        return *result ? result : nullptr;
+                    }
+                    block += 16;
+                    validMask = 0xffffu;
+                }
+            }
+        #endif
+        for (; *s; ++s)
+            if (cls.IsMember(*s) != inverse) return s;
+        return nullptr;
+    }
+
+    #if defined(HAS_SSE_INSTRUCTIONS)
+        __m128i ToLowerAscii(__m128i v)
+        {
+            auto isUpper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A'-1)), _mm_cmplt_epi8(v, _mm_set1_epi8('Z'+1)));
+            return _mm_or_si128(v, _mm_and_si128(isUpper, _mm_set1_epi8(0x20)));
+        }
+    #endif
+
+    bool EqualRangeI(const char* a, const char* b, size_t count)
+    {
+        size_t i = 0;
+        #if defined(HAS_SSE_INSTRUCTIONS)
+            for (; (i+16) <= count; i += 16) {
+                auto av = ToLowerAscii(_mm_loadu_si128((const __m128i*)(a+i)));
+                auto bv = ToLowerAscii(_mm_loadu_si128((const __m128i*)(b+i)));
+                if (_mm_movemask_epi8(_mm_cmpeq_epi8(av, bv)) != 0xffff) return false;
+            }
+        #endif
+        for (; i<count; ++i)
+            if (XlToLower(a[i]) != XlToLower(b[i])) return false;
+        return true;
+    }
+
+    template<bool CaseInsensitive>
+        bool EqualRange(const char* a, const char* b, size_t count)
+    {
+        if constexpr (CaseInsensitive) return EqualRangeI(a, b, count);
+        else return std::memcmp(a, b, count) == 0;
+    }
+
+    // Requires 0 < xb <= sb
+    template<bool CaseInsensitive>
+        const char* FindSubstring(const char* s, size_t sb, const char* x, size_t xb)
+    {
+        assert(xb != 0 && xb <= sb);
+        size_t i = 0;
+        const size_t lastStart = sb - xb;
+        #if defined(HAS_SSE_INSTRUCTIONS)
+            // Test 16 starting positions at a time against the first & last character of "x", and only
+            // compare the middle part for candidates that match both
+            // (see "SIMD-friendly algorithms for substring searching", Wojciech Mula)
+            auto loadBlock = [](const char* p) {
+                auto v = _mm_loadu_si128((const __m128i*)p);
+                if constexpr (CaseInsensitive) v = ToLowerAscii(v);
+                return v;
+            };
+            const auto first = _mm_set1_epi8(CaseInsensitive ? XlToLower(x[0]) : x[0]);
+            const auto last = _mm_set1_epi8(CaseInsensitive ? XlToLower(x[xb-1]) : x[xb-1]);
+            for (; (i+16) <= (lastStart+1); i += 16) {
+                auto firstMatches = _mm_cmpeq_epi8(first, loadBlock(s+i));
+                auto lastMatches = _mm_cmpeq_epi8(last, loadBlock(s+i+xb-1));
+                auto candidates = (uint32_t)_mm_movemask_epi8(_mm_and_si128(firstMatches, lastMatches));
+                while (candidates) {
+                    auto c = i + xl_ctz4(candidates);
+                    if (xb <= 2 || EqualRange<CaseInsensitive>(s+c+1, x+1, xb-2))
+                        return s+c;
+                    candidates &= candidates - 1;
+                }
+            }
+        #endif
+        for (; i<=lastStart; ++i)
+            if (EqualRange<CaseInsensitive>(s+i, x, xb))
+                return s+i;
+        return nullptr;
+    }
+}
+
 const char* XlFindChar(const char* s, const char ch)
 {
     return strchr(s, ch);
@@ -596,74 +765,38 @@ char* XlFindChar(char* s, const char ch)
 
 const char*  XlFindChar(StringSection<char> s, char ch)
 {
-	for (const auto& chr:s)
-		if (chr == ch) return &chr;
-	return nullptr;
+    if (s.IsEmpty()) return nullptr;
+    return (const char*)std::memchr(s.begin(), ch, s.size());
 }
 
 const char*  XlFindAnyChar(const char s[], const char delims[])
 {
-    for (const char* i = s; *i; ++i) {
-        for (const char *d = delims; *d; ++d) {
-            if (*i == *d) return i;
-        }
-    }
-    return nullptr;
+    return FindInClass(CharacterClass{delims}, s, false);
 }
 
 char*  XlFindAnyChar(char s[], const char delims[])
 {
-    for (char* i = s; *i; ++i) {
-        for (const char *d = delims; *d; ++d) {
-            if (*i == *d) return i;
-        }
-    }
-    return nullptr;
+    return const_cast<char*>(FindInClass(CharacterClass{delims}, s, false));
 }
 
 const char*  XlFindAnyChar(StringSection<char> s, const char delims[])
 {
-    for (const auto& chr:s)
-        for (const char *d = delims; *d; ++d)
-            if (chr == *d) return &chr;
-    return nullptr;
+    return FindInClass(CharacterClass{delims}, s.begin(), s.end(), false);
 }
 
-
 const char*  XlFindNot(const char s[], const char delims[])
 {
-    for (const char* i = s; *i; ++i) {
-        const char *d = delims;
-        for (; *d; ++d) {
-            if (*i == *d) break;
-        }
-        if (*d == '\0') return i;
-    }
-    return nullptr;
+    return FindInClass(CharacterClass{delims}, s, true);
 }
 
 char*  XlFindNot(char s[], const char delims[])
 {
-    for (char* i = s; *i; ++i) {
-        const char *d = delims;
-        for (; *d; ++d) {
-            if (*i == *d) break;
-        }
-        if (*d == '\0') return i;
-    }
-    return nullptr;
+    return const_cast<char*>(FindInClass(CharacterClass{delims}, s, true));
 }
 
 const char*  XlFindNot(StringSection<char> s, const char delims[])
 {
-    for (auto* i = s.begin(); i!=s.end(); ++i) {
-        const char *d = delims;
-        for (; *d; ++d) {
-            if (*i == *d) break;
-        }
-        if (*d == '\0') return i;
-    }
-    return nullptr;
+    return FindInClass(CharacterClass{delims}, s.begin(), s.end(), true);
 }
 
 const char* XlFindCharReverse(const char* s, char ch)
@@ -683,32 +816,63 @@ char* XlFindString(char* s, const char* x)
 
 const char* XlFindStringI(const char* s, const char* x)
 {
-    size_t sb = XlStringSize(s), xb = XlStringSize(x);
-    if (sb < xb) return nullptr;
-    for (size_t i = 0; i <= sb - xb; ++i)
-        if (XlComparePrefixI(s + i, x, xb) == 0)
-            return s + i;
-    return nullptr;
+    return XlFindStringI(MakeStringSectionNullTerm(s), MakeStringSectionNullTerm(x));
 }
 
 const char*  XlFindString(StringSection<char> s, StringSection<char> x)
 {
 	size_t sb = s.size(), xb = x.size();
 	if (sb < xb) return nullptr;
-	for (size_t i = 0; i <= sb - xb; ++i)
-		if (XlEqString(MakeStringSection(s.begin() + i, s.begin() + i + xb), x))
-			return s.begin() + i;
-	return nullptr;
+	if (!xb) return s.begin();
+	return FindSubstring<false>(s.begin(), sb, x.begin(), xb);
 }
 
 const char*  XlFindStringI(StringSection<char> s, StringSection<char> x)
 {
 	size_t sb = s.size(), xb = x.size();
 	if (sb < xb) return nullptr;
-	for (size_t i = 0; i <= sb - xb; ++i)
-		if (XlEqStringI(MakeStringSection(s.begin() + i, s.begin() + i + xb), x))
-			return s.begin() + i;
-	return nullptr;
+	if (!xb) return s.begin();
+	return FindSubstring<true>(s.begin(), sb, x.begin(), xb);
+}
+
+template<>
+    bool XlEqStringI<char>(const StringSection<char>& a, const StringSection<char>& b)
+{
+    return a.Length() == b.Length() && EqualRangeI(a.begin(), b.begin(), a.Length());
+}
+
+template<>
+    int XlCompareStringI<char>(const StringSection<char>& a, const StringSection<char>& b)
+{
+    auto alen = a.Length(), blen = b.Length();
+    auto len = std::min(alen, blen);
+
+    // Compare the common prefix, with the same result as XlComparePrefixI() (ie, strncasecmp), which stops
+    // at the first difference, or at a null in both strings
+    const char* x = a.begin();
+    const char* y = b.begin();
+    size_t i = 0;
+    #if defined(HAS_SSE_INSTRUCTIONS)
+        for (; (i+16) <= len; i += 16) {
+            auto xv = ToLowerAscii(_mm_loadu_si128((const __m128i*)(x+i)));
+            auto yv = ToLowerAscii(_mm_loadu_si128((const __m128i*)(y+i)));
+            uint32_t stops = ((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(xv, yv)) ^ 0xffffu) | (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(xv, _mm_setzero_si128()));
+            if (stops) {
+                i += xl_ctz4(stops);
+                break;
+            }
+        }
+    #endif
+    for (; i<len; ++i) {
+        int cx = (uint8_t)XlToLower(x[i]), cy = (uint8_t)XlToLower(y[i]);
+        if (cx != cy) return cx - cy;
+        if (!cx) break;
+    }
+
+        // Initial prefix is identical (see the generic XlCompareStringI)
+    if (alen == blen) return 0;
+    if (alen < blen) return -int(XlToLower(b[alen]));
+    return XlToLower(a[blen]);
 }
 
 const char* XlFindStringSafe(const char* s, const char* x, size_t size)
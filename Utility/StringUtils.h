@@ -467,6 +467,10 @@ namespace Utility
             return true;
         }
 
+    // (8 bit version is vectorized, where possible)
+    template<>
+        XL_UTILITY_API bool XlEqStringI<char>(const StringSection<char>& a, const StringSection<char>& b);
+
     template<typename T>
         bool XlEqString(const StringSection<T>& a, const StringSection<T>& b)
         {
@@ -618,6 +622,9 @@ namespace Utility
             return XlToLower(a[blen]);
         }
 
+    template<>
+        XL_UTILITY_API int XlCompareStringI<char>(const StringSection<char>& a, const StringSection<char>& b);
+
     template<typename T>
         int XlCompareString(const std::basic_string<T>& a, const std::basic_string<T>& b)
         {
@@ -10,6 +10,7 @@
 #include "LockFree.h"
 #include "../HeapUtils.h"
 #include "../../ConsoleRig/AttachablePtr.h"
+#include "../../Core/Exceptions.h"
 #include <vector>
 #include <thread>
 #include <functional>
@@ -69,6 +70,18 @@ namespace Utility
     template<typename FutureType, typename Clock, typename Duration>
         std::future_status YieldToPoolUntil(std::shared_future<FutureType>& future, std::chrono::time_point<Clock, Duration> timepoint);
 
+    class ThreadPool;
+
+    /** <summary>Call fn(0) ... fn(count-1), spreading the calls across the thread pool and the calling thread</summary>
+        fn(0) runs on the calling thread, and the rest are queued on the pool. This doesn't return until every
+        call has completed -- even if some of them throw -- because the queued tasks reference "fn". After that,
+        the first exception is rethrown.
+
+        If the pool has no worker threads, every call is made on the calling thread.
+    */
+    template<typename Fn>
+        void ParallelFor(ThreadPool& pool, unsigned count, Fn&& fn);
+
     class ThreadPool
     {
     public:
@@ -310,6 +323,51 @@ namespace Utility
             return future.wait_until(timepoint);
         }
     }
+
+    template<typename Fn>
+        void ParallelFor(ThreadPool& pool, unsigned count, Fn&& fn)
+    {
+        if (count <= 1 || !pool.IsGood()) {
+            for (unsigned c=0; c<count; ++c) fn(c);
+            return;
+        }
+
+        std::vector<std::future<void>> futures;
+        futures.reserve(count-1);
+        for (unsigned c=1; c<count; ++c) {
+            std::promise<void> promise;
+            futures.emplace_back(promise.get_future());
+            pool.Enqueue(
+                [promise=std::move(promise), &fn, c]() mutable {
+                    TRY {
+                        fn(c);
+                        promise.set_value();
+                    } CATCH(...) {
+                        promise.set_exception(std::current_exception());
+                    } CATCH_END
+                });
+        }
+
+        std::exception_ptr firstException;
+        TRY {
+            fn(0);
+        } CATCH(...) {
+            firstException = std::current_exception();
+        } CATCH_END
+
+        // must wait for all tasks, even on exception, because they reference "fn"
+        for (auto& f:futures) {
+            YieldToPool(f);
+            TRY {
+                f.get();
+            } CATCH(...) {
+                if (!firstException) firstException = std::current_exception();
+            } CATCH_END
+        }
+
+        if (firstException)
+            std::rethrow_exception(firstException);
+    }
 }
 
 using namespace Utility;
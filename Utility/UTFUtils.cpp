@@ -7,7 +7,14 @@
 #include "UTFUtils.h"
 #include "StringUtils.h"
 #include "StringFormat.h"
+#include "ArithmeticUtils.h"
 #include <stdlib.h>
+#include <cstring>
+
+#if (defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)) && defined(__SSE4_1__)
+    #include <immintrin.h>			// MSVC & clang intrinsic
+    #define HAS_SSE_INSTRUCTIONS
+#endif
 
 namespace Utility
 {
@@ -109,7 +116,7 @@ static bool IsValid(const uint8_t* src, size_t len)
             break;
         case 0xF0: if (a < 0x90) return false; 
             break;
-        case 0xF4: if (a > 0x8F) return false; 
+        case 0xF4: if ((a < 0x80) || (a > 0x8F)) return false; 
             break;
         default:   if (a < 0x80) return false;
     }
@@ -143,6 +150,134 @@ bool IsValid(const uint8_t* s, const uint8_t* se)
     }
 }
 
+#if defined(HAS_SSE_INSTRUCTIONS)
+
+    // Vectorized validation, using the lookup approach from "Validating UTF-8 In Less Than One Instruction
+    // Per Byte" (Keiser & Lemire). Each byte is classified by 3 table lookups: the high & low nibbles of the
+    // previous byte and the high nibble of the current byte. An error bit survives the "and" of all 3 only
+    // when that pair of bytes is illegal. The one case that can't be decided from pairs (continuations that
+    // should be the 3rd or 4th byte of a sequence) is resolved by looking 2 & 3 bytes back
+static const uint8_t TooShort = 1<<0;           // lead byte or ascii, followed by a lead byte or ascii when a continuation is required
+static const uint8_t TooLong = 1<<1;            // ascii followed by a continuation
+static const uint8_t Overlong3 = 1<<2;          // E0 followed by 80-9F
+static const uint8_t TooLarge = 1<<3;           // F4 followed by 90-BF, or F5-FF
+static const uint8_t Surrogate = 1<<4;          // ED followed by A0-BF
+static const uint8_t Overlong2 = 1<<5;          // C0 or C1
+static const uint8_t TooLarge1000 = 1<<6;       // F5-FF followed by 80-8F
+static const uint8_t Overlong4 = 1<<6;          // F0 followed by 80-8F
+static const uint8_t TwoConts = 1<<7;           // continuation followed by a continuation
+static const uint8_t Carry = TooShort | TooLong | TwoConts;
+
+alignas(16) static const uint8_t s_utf8Byte1High[16] = {
+    TooLong, TooLong, TooLong, TooLong, TooLong, TooLong, TooLong, TooLong,     // 0_______
+    TwoConts, TwoConts, TwoConts, TwoConts,                                     // 10______
+    TooShort | Overlong2,                                                       // 1100____
+    TooShort,                                                                   // 1101____
+    TooShort | Overlong3 | Surrogate,                                           // 1110____
+    TooShort | TooLarge | TooLarge1000 | Overlong4                              // 1111____
+};
+
+alignas(16) static const uint8_t s_utf8Byte1Low[16] = {
+    Carry | Overlong3 | Overlong2 | Overlong4,                                  // ____0000
+    Carry | Overlong2,                                                          // ____0001
+    Carry, Carry,                                                               // ____001_
+    Carry | TooLarge,                                                           // ____0100
+    Carry | TooLarge | TooLarge1000, Carry | TooLarge | TooLarge1000,           // ____0101, ____0110
+    Carry | TooLarge | TooLarge1000,                                            // ____0111
+    Carry | TooLarge | TooLarge1000, Carry | TooLarge | TooLarge1000,           // ____1000, ____1001
+    Carry | TooLarge | TooLarge1000, Carry | TooLarge | TooLarge1000,           // ____1010, ____1011
+    Carry | TooLarge | TooLarge1000,                                            // ____1100
+    Carry | TooLarge | TooLarge1000 | Surrogate,                                // ____1101
+    Carry | TooLarge | TooLarge1000, Carry | TooLarge | TooLarge1000            // ____111_
+};
+
+alignas(16) static const uint8_t s_utf8Byte2High[16] = {
+    TooShort, TooShort, TooShort, TooShort, TooShort, TooShort, TooShort, TooShort, // 0_______
+    TooLong | Overlong2 | TwoConts | Overlong3 | TooLarge1000 | Overlong4,      // 1000____
+    TooLong | Overlong2 | TwoConts | Overlong3 | TooLarge,                      // 1001____
+    TooLong | Overlong2 | TwoConts | Surrogate | TooLarge,                      // 1010____
+    TooLong | Overlong2 | TwoConts | Surrogate | TooLarge,                      // 1011____
+    TooShort, TooShort, TooShort, TooShort                                      // 11______
+};
+
+// non-zero for any of the last 3 bytes that begin a sequence that doesn't fit in the block
+alignas(16) static const uint8_t s_utf8IncompleteThreshold[16] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xf0-1, 0xe0-1, 0xc0-1
+};
+
+static __m128i utf8_block_errors(__m128i input, __m128i prevInput)
+{
+    const auto nibbleMask = _mm_set1_epi8(0x0f);
+    auto prev1 = _mm_alignr_epi8(input, prevInput, 15);
+    auto byte1High = _mm_shuffle_epi8(_mm_load_si128((const __m128i*)s_utf8Byte1High), _mm_and_si128(_mm_srli_epi16(prev1, 4), nibbleMask));
+    auto byte1Low = _mm_shuffle_epi8(_mm_load_si128((const __m128i*)s_utf8Byte1Low), _mm_and_si128(prev1, nibbleMask));
+    auto byte2High = _mm_shuffle_epi8(_mm_load_si128((const __m128i*)s_utf8Byte2High), _mm_and_si128(_mm_srli_epi16(input, 4), nibbleMask));
+    auto specialCases = _mm_and_si128(_mm_and_si128(byte1High, byte1Low), byte2High);
+
+    // 2 continuations in a row are fine when they are part of a 3 or 4 byte sequence (and required, in
+    // the 3rd & 4th byte positions)
+    auto prev2 = _mm_alignr_epi8(input, prevInput, 14);
+    auto prev3 = _mm_alignr_epi8(input, prevInput, 13);
+    auto isThirdByte = _mm_subs_epu8(prev2, _mm_set1_epi8(char(0xe0-1)));
+    auto isFourthByte = _mm_subs_epu8(prev3, _mm_set1_epi8(char(0xf0-1)));
+    auto mustBeContinuation = _mm_cmpgt_epi8(_mm_or_si128(isThirdByte, isFourthByte), _mm_setzero_si128());
+    return _mm_xor_si128(_mm_and_si128(mustBeContinuation, _mm_set1_epi8(char(TwoConts))), specialCases);
+}
+
+#endif
+
+bool utf8_validate(const utf8* src, size_t sl)
+{
+    #if defined(HAS_SSE_INSTRUCTIONS)
+        const uint8_t* s = (const uint8_t*)src;
+        const uint8_t* se = s + sl;
+        auto error = _mm_setzero_si128();
+        auto prevInput = _mm_setzero_si128();
+        auto prevIncomplete = _mm_setzero_si128();
+        auto processBlock = [&](__m128i input) {
+            if (_mm_movemask_epi8(input) == 0) {
+                // ascii only; just need to check the last block didn't end mid sequence
+                error = _mm_or_si128(error, prevIncomplete);
+                prevIncomplete = _mm_setzero_si128();
+            } else {
+                error = _mm_or_si128(error, utf8_block_errors(input, prevInput));
+                prevIncomplete = _mm_subs_epu8(input, _mm_load_si128((const __m128i*)s_utf8IncompleteThreshold));
+            }
+            prevInput = input;
+        };
+
+        for (; (se - s) >= 16; s += 16)
+            processBlock(_mm_loadu_si128((const __m128i*)s));
+        if (s != se) {
+            // zero padding is ascii, so a sequence cut off by the end of the input will be caught as "TooShort"
+            alignas(16) uint8_t tail[16] = {};
+            std::memcpy(tail, s, se - s);
+            processBlock(_mm_load_si128((const __m128i*)tail));
+        }
+        error = _mm_or_si128(error, prevIncomplete);
+        return _mm_testz_si128(error, error) != 0;
+    #else
+        const uint8_t* s = (const uint8_t*)src;
+        const uint8_t* se = s + sl;
+        while (s < se) {
+            // skip over runs of ascii a word at a time
+            while ((se - s) >= 8) {
+                uint64_t w;
+                std::memcpy(&w, s, sizeof(w));
+                if (w & 0x8080808080808080ull) break;
+                s += 8;
+            }
+            if (s == se) break;
+            if (*s < 0x80) { ++s; continue; }
+            size_t len = _trailing_bytes[*s] + 1;
+            if (size_t(se - s) < len || !IsValid(s, len)) return false;
+            s += len;
+        }
+        return true;
+    #endif
+}
+
 int utf8_2_ucs4(const utf8* src, size_t sl, ucs4* dst, size_t dl)
 {
     ucs4 ch;
@@ -156,6 +291,22 @@ int utf8_2_ucs4(const utf8* src, size_t sl, ucs4* dst, size_t dl)
     ucs_conv_error err = UCE_OK;
 
     while (s < se) {
+        #if defined(HAS_SSE_INSTRUCTIONS)
+            // Runs of ascii (without nulls) can be widened 16 characters at a time
+            if (*s < 0x80) {
+                while ((se - s) >= 16 && (de - d) >= 16) {
+                    auto v = _mm_loadu_si128((const __m128i*)s);
+                    if (_mm_movemask_epi8(_mm_or_si128(v, _mm_cmpeq_epi8(v, _mm_setzero_si128()))) != 0) break;
+                    _mm_storeu_si128((__m128i*)d, _mm_cvtepu8_epi32(v));
+                    _mm_storeu_si128((__m128i*)(d+4), _mm_cvtepu8_epi32(_mm_srli_si128(v, 4)));
+                    _mm_storeu_si128((__m128i*)(d+8), _mm_cvtepu8_epi32(_mm_srli_si128(v, 8)));
+                    _mm_storeu_si128((__m128i*)(d+12), _mm_cvtepu8_epi32(_mm_srli_si128(v, 12)));
+                    s += 16; d += 16;
+                }
+                if (s >= se) break;
+            }
+        #endif
+
         nb = _trailing_bytes[*s];
         if (s + nb >= se) {
             err = UCE_SRC_EXHAUSTED;
@@ -303,6 +454,20 @@ int utf8_2_ucs2(const utf8* src, size_t sl, ucs2* dst, size_t dl)
     ucs_conv_error err = UCE_OK;
 
     while (s < se) {
+        #if defined(HAS_SSE_INSTRUCTIONS)
+            // Runs of ascii (without nulls) can be widened 16 characters at a time
+            if (*s < 0x80) {
+                while ((se - s) >= 16 && (de - d) >= 16) {
+                    auto v = _mm_loadu_si128((const __m128i*)s);
+                    if (_mm_movemask_epi8(_mm_or_si128(v, _mm_cmpeq_epi8(v, _mm_setzero_si128()))) != 0) break;
+                    _mm_storeu_si128((__m128i*)d, _mm_unpacklo_epi8(v, _mm_setzero_si128()));
+                    _mm_storeu_si128((__m128i*)(d+8), _mm_unpackhi_epi8(v, _mm_setzero_si128()));
+                    s += 16; d += 16;
+                }
+                if (s >= se) break;
+            }
+        #endif
+
         ucs4 ch = 0;
         uint8_t nb = _trailing_bytes[*s];
         if (s + nb >= se) {
@@ -621,13 +786,39 @@ ucs4 utf8_nextchar(utf8 const*& iterator, utf8 const* end)
 
 size_t utf8_strlen(const utf8* s)
 {
-    size_t cnt = 0;
-    size_t i = 0;
+    #if defined(HAS_SSE_INSTRUCTIONS)
+        // Every byte that isn't a continuation begins a new character (as per utf8_nextchar, which will also
+        // treat a continuation at the very start of the string as a character). This matches the scalar path
+        // for all well formed input
+        // We use aligned loads, so we will never read across a page boundary, even though we may read
+        // beyond the null terminator
+        if (!*s) return 0;
+        size_t cnt = isutf(*s) ? 0 : 1;
+        auto* block = (const uint8_t*)(size_t(s) & ~size_t(15));
+        uint32_t validMask = 0xffffu << (unsigned)((const uint8_t*)s - block);
+        const auto continuationMax = _mm_set1_epi8(char(0xBF));
+        for (;;) {
+            auto v = _mm_load_si128((const __m128i*)block);
+            uint32_t zeroes = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) & validMask;
+            uint32_t characters = (uint32_t)_mm_movemask_epi8(_mm_cmpgt_epi8(v, continuationMax)) & validMask;
+            if (zeroes) {
+                // (note that a null is counted as a non-continuation in "characters")
+                characters &= (1u << xl_ctz4(zeroes)) - 1u;
+                return cnt + popcount(characters);
+            }
+            cnt += popcount(characters);
+            block += 16;
+            validMask = 0xffffu;
+        }
+    #else
+        size_t cnt = 0;
+        size_t i = 0;
 
-    while (utf8_nextchar(s, &i) != 0)
-        cnt++;
+        while (utf8_nextchar(s, &i) != 0)
+            cnt++;
 
-    return cnt;
+        return cnt;
+    #endif
 }
 
 
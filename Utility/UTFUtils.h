@@ -43,6 +43,10 @@ namespace Utility
     XL_UTILITY_API int ucs4_2_ucs2(const ucs4* src, size_t sl, ucs2* dst, size_t dl);
     XL_UTILITY_API int ucs2_2_ucs4(const ucs2* src, size_t sl, ucs4* dst, size_t dl);
 
+    // returns true if the range is well formed UTF-8 (rejecting overlong encodings, surrogates and
+    // values above 0x10FFFF). Nulls are not treated as terminators
+    XL_UTILITY_API bool utf8_validate(const utf8* src, size_t sl);
+
     // refer ConvertUTF.h in libtransmission
     // remark_todo("need some safe conversion") 
 